@@ -12,4 +12,5 @@ $destination = "${env:APPVEYOR_BUILD_FOLDER}\haloray-${version}.zip"
 $buildLocation = "${env:APPVEYOR_BUILD_FOLDER}\build\main\release\*"
 
 7z a $destination $buildLocation '-x!*.lib' '-x!*.res' '-x!*.obj'
+7z a $destination "${env:APPVEYOR_BUILD_FOLDER}\build\replay\release\haloray-replay.exe"
 7z a $destination "${env:APPVEYOR_BUILD_FOLDER}\*.md"
@@ -0,0 +1,83 @@
+#include <QtTest>
+#include <random>
+#include <vector>
+#include "crystalMesh.h"
+#include "rayBatch.h"
+#include "rayTracer.h"
+#include "scalarTracer.h"
+
+using namespace HaloRay::Kernels;
+
+Q_DECLARE_METATYPE(HaloRay::Kernels::InstructionSet)
+
+namespace
+{
+
+const unsigned int rayCount = 65536;
+
+// Rays entering a column crystal through random faces
+RayBatch createRays(const CrystalMesh &mesh)
+{
+    std::mt19937 engine(1);
+    std::uniform_real_distribution<float> distribution(0.0f, 1.0f);
+    RayBatch rays;
+    rays.resize(rayCount);
+    for (auto i = 0u; i < rayCount; ++i)
+    {
+        auto rotation = getUniformRandomRotationMatrix(distribution(engine), distribution(engine), distribution(engine));
+        auto direction = Vector3{0.0f, -1.0f, 0.0f} * rotation;
+        auto triangleIndex = selectFirstTriangle(mesh, direction, distribution(engine));
+        auto origin = sampleTriangle(mesh, triangleIndex, distribution(engine), distribution(engine));
+        auto refracted = refract(direction, mesh.normals[triangleIndex], 1.0f / 1.31f);
+
+        rays.originX[i] = origin.x;
+        rays.originY[i] = origin.y;
+        rays.originZ[i] = origin.z;
+        rays.directionX[i] = refracted.x;
+        rays.directionY[i] = refracted.y;
+        rays.directionZ[i] = refracted.z;
+        rays.indexOfRefraction[i] = 1.31f;
+        rays.rayIndex[i] = i;
+    }
+    return rays;
+}
+
+}
+
+/* Rays traced per second by each kernel the processor supports. Run with
+   -iterations or -minimumvalue for steadier numbers. */
+class KernelBenchmarks : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void traceRays_data()
+    {
+        QTest::addColumn<InstructionSet>("instructionSet");
+        for (auto instructionSet : {InstructionSet::Scalar, InstructionSet::Sse4, InstructionSet::Avx2, InstructionSet::Avx512})
+        {
+            if (isInstructionSetSupported(instructionSet))
+                QTest::newRow(getInstructionSetName(instructionSet)) << instructionSet;
+        }
+    }
+
+    void traceRays()
+    {
+        QFETCH(InstructionSet, instructionSet);
+        auto shape = HexagonalCrystalShape::createDefault();
+        shape.caRatio = 3.0f;
+        auto mesh = createHexagonalCrystal(shape);
+        auto rays = createRays(mesh);
+        TraceSettings settings = {3, 1u};
+
+        QBENCHMARK
+        {
+            auto tracedRays = rays;
+            HaloRay::Kernels::traceRays(&mesh, true, tracedRays, settings, instructionSet);
+        }
+    }
+};
+
+QTEST_APPLESS_MAIN(KernelBenchmarks)
+
+#include "kernelBenchmarks.moc"
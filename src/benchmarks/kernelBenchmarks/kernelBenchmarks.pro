@@ -0,0 +1,23 @@
+TARGET = kernelBenchmarks
+TEMPLATE = app
+QT += testlib
+QT -= gui
+
+CONFIG += qt console warn_on depend_includepath c++17
+win32:CONFIG += windows
+
+SOURCES +=  \
+    kernelBenchmarks.cpp
+
+win32:CONFIG(release, debug|release): LIBS += -L$$OUT_PWD/../../haloray-kernels/release/ -lHaloRayKernels
+else:win32:CONFIG(debug, debug|release): LIBS += -L$$OUT_PWD/../../haloray-kernels/debug/ -lHaloRayKernels
+else:unix: LIBS += -L$$OUT_PWD/../../haloray-kernels/ -lHaloRayKernels
+
+INCLUDEPATH += $$PWD/../../haloray-kernels
+DEPENDPATH += $$PWD/../../haloray-kernels
+
+win32-g++:CONFIG(release, debug|release): PRE_TARGETDEPS += $$OUT_PWD/../../haloray-kernels/release/libHaloRayKernels.a
+else:win32-g++:CONFIG(debug, debug|release): PRE_TARGETDEPS += $$OUT_PWD/../../haloray-kernels/debug/libHaloRayKernels.a
+else:win32:!win32-g++:CONFIG(release, debug|release): PRE_TARGETDEPS += $$OUT_PWD/../../haloray-kernels/release/HaloRayKernels.lib
+else:win32:!win32-g++:CONFIG(debug, debug|release): PRE_TARGETDEPS += $$OUT_PWD/../../haloray-kernels/debug/HaloRayKernels.lib
+else:unix: PRE_TARGETDEPS += $$OUT_PWD/../../haloray-kernels/libHaloRayKernels.a
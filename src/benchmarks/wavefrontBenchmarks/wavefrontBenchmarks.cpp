@@ -0,0 +1,127 @@
+#include <QtTest>
+#include <QElapsedTimer>
+#include <QOffscreenSurface>
+#include <QOpenGLContext>
+#include <QOpenGLFunctions>
+#include <memory>
+#include "simulation/crystalPopulationRepository.h"
+#include "simulation/simulationEngine.h"
+#include "simulation/wavefront.h"
+
+using namespace HaloRay;
+
+namespace
+{
+
+const unsigned int raysPerStep = 1 << 20;
+const unsigned int timedSteps = 10;
+// Lanes that run in lockstep on most GPUs
+const unsigned int laneCount = 32;
+
+}
+
+/* Rays traced per second on the GPU with a single dispatch per population
+   and with wavefront tracing, for crystals with short and long paths.
+   Lane utilization is estimated from the path lengths of the traced rays. */
+class WavefrontBenchmarks : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void initTestCase()
+    {
+        Q_INIT_RESOURCE(haloray);
+
+        QSurfaceFormat format;
+        format.setVersion(4, 4);
+        format.setProfile(QSurfaceFormat::OpenGLContextProfile::CoreProfile);
+        m_context = std::make_unique<QOpenGLContext>();
+        m_context->setFormat(format);
+        m_surface = std::make_unique<QOffscreenSurface>();
+        m_surface->setFormat(format);
+        m_surface->create();
+        if (!m_context->create() || !m_context->makeCurrent(m_surface.get()))
+            QSKIP("OpenGL context could not be created");
+        if (m_context->format().version() < qMakePair(4, 4))
+            QSKIP("OpenGL 4.4 is not supported");
+    }
+
+    void step_data()
+    {
+        QTest::addColumn<int>("preset");
+        QTest::addColumn<double>("multipleScattering");
+        QTest::addColumn<bool>("wavefront");
+
+        const QPair<const char *, CrystalPopulationPreset> presets[] = {
+            {"plate", Plate},
+            {"column", Column},
+            {"pyramid", Pyramid},
+            {"random", Random}};
+        for (const auto &preset : presets)
+        {
+            for (auto wavefront : {false, true})
+            {
+                auto name = QString("%1 %2").arg(preset.first).arg(wavefront ? "wavefront" : "megakernel");
+                QTest::newRow(qPrintable(name)) << static_cast<int>(preset.second) << 0.0 << wavefront;
+            }
+        }
+        QTest::newRow("random multiple scattering megakernel") << static_cast<int>(Random) << 0.5 << false;
+        QTest::newRow("random multiple scattering wavefront") << static_cast<int>(Random) << 0.5 << true;
+    }
+
+    void step()
+    {
+        QFETCH(int, preset);
+        QFETCH(double, multipleScattering);
+        QFETCH(bool, wavefront);
+
+        auto repository = std::make_shared<CrystalPopulationRepository>();
+        repository->clear();
+        repository->add(static_cast<CrystalPopulationPreset>(preset));
+
+        SimulationEngine engine(repository);
+        engine.setRaysPerStep(raysPerStep);
+        engine.setMultipleScatteringProbability(multipleScattering);
+        engine.setPathLengthStatisticsEnabled(true);
+        engine.setWavefrontTracingEnabled(wavefront);
+        engine.start();
+
+        auto functions = m_context->functions();
+        engine.step();
+        functions->glFinish();
+
+        QElapsedTimer timer;
+        timer.start();
+        for (auto i = 0u; i < timedSteps; ++i)
+            engine.step();
+        functions->glFinish();
+        auto raysPerSecond = timedSteps * static_cast<double>(raysPerStep) / (timer.nsecsElapsed() * 1.0e-9);
+
+        auto histogram = engine.getPathLengthHistogram(0);
+        auto utilization = wavefront ? Wavefront::estimateWavefrontLaneUtilization(histogram, laneCount)
+                                     : Wavefront::estimateMegakernelLaneUtilization(histogram, laneCount);
+        qInfo("%.3g rays/s, mean path length %.2f, estimated lane utilization %.1f%%",
+              raysPerSecond, histogram.getMeanPathLength(), 100.0 * utilization);
+
+        QBENCHMARK
+        {
+            engine.step();
+            functions->glFinish();
+        }
+        engine.stop();
+    }
+
+    void cleanupTestCase()
+    {
+        if (m_context)
+            m_context->doneCurrent();
+    }
+
+private:
+    std::unique_ptr<QOpenGLContext> m_context;
+    std::unique_ptr<QOffscreenSurface> m_surface;
+};
+
+QTEST_MAIN(WavefrontBenchmarks)
+
+#include "wavefrontBenchmarks.moc"
@@ -39,8 +39,20 @@ QSize PreviewRenderArea::sizeHint() const
 void PreviewRenderArea::paintEvent(QPaintEvent *)
 {
     const int numVertices = 24;
-    initializeGeometry(m_vertices, numVertices);
-    float largestDimension = getFurthestVertexDistance(m_vertices, numVertices);
+    const ConvexPolyhedron &customShape = m_crystals->getCustomShape(m_populationIndex);
+    float largestDimension;
+    if (customShape.isEmpty())
+    {
+        initializeGeometry(m_vertices, numVertices);
+        largestDimension = getFurthestVertexDistance(m_vertices, numVertices);
+    } else {
+        largestDimension = 0.0f;
+        for (const auto &face : customShape.getFaces())
+        {
+            for (const auto &vertex : face.vertices)
+                largestDimension = std::max(largestDimension, QVector3D(vertex[0], vertex[1], vertex[2]).length());
+        }
+    }
 
     QMatrix4x4 transformMat;
     transformMat.scale(600.0f);
@@ -62,6 +74,12 @@ void PreviewRenderArea::paintEvent(QPaintEvent *)
 
     QMatrix4x4 orientationMatrix = getCrystalOrientationMatrix();
 
+    if (!customShape.isEmpty())
+    {
+        drawCustomShape(painter, transformMat * orientationMatrix, customShape);
+        return;
+    }
+
     QVector4D mappedVertices[numVertices];
     for (int i = 0; i < numVertices; ++i)
     {
@@ -90,6 +108,20 @@ void PreviewRenderArea::paintEvent(QPaintEvent *)
     }
 }
 
+void PreviewRenderArea::drawCustomShape(QPainter &painter, const QMatrix4x4 &transform, const ConvexPolyhedron &shape) const
+{
+    for (const auto &face : shape.getFaces())
+    {
+        QPolygon facePoints;
+        for (const auto &vertex : face.vertices)
+        {
+            QVector4D mappedVertex = transform * QVector4D(vertex[0], vertex[1], vertex[2], 1.0f);
+            facePoints << (mappedVertex / mappedVertex.w()).toPoint();
+        }
+        painter.drawPolygon(facePoints);
+    }
+}
+
 QVector2D lineIntersect(QVector2D line1, QVector2D line2)
 {
     float p1 = line1.x();
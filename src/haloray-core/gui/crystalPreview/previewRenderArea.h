@@ -6,6 +6,7 @@
 
 class QMatrix4x4;
 class QSize;
+class QPainter;
 
 namespace HaloRay
 {
@@ -23,6 +24,7 @@ public slots:
 protected:
     void paintEvent(QPaintEvent *event) override;
     void initializeGeometry(QVector3D *vertices, int numVertices);
+    void drawCustomShape(QPainter &painter, const QMatrix4x4 &transform, const ConvexPolyhedron &shape) const;
 
 private:
     QVariant getFromModel(int row, CrystalModel::Columns column) const;
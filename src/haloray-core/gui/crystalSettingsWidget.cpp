@@ -11,6 +11,12 @@
 #include <QGroupBox>
 #include <QTabWidget>
 #include <QCheckBox>
+#include <QFileDialog>
+#include <QMessageBox>
+#include <QFile>
+#include <QPlainTextEdit>
+#include <QPushButton>
+#include <stdexcept>
 #include "components/sliderSpinBox.h"
 #include "components/addCrystalPopulationButton.h"
 #include "simulation/crystalPopulation.h"
@@ -26,13 +32,13 @@ CrystalSettingsWidget::CrystalSettingsWidget(CrystalModel *model, QWidget *paren
     setupUi();
 
     auto tiltVisibilityHandler = [this](int index) {
-        bool showControls = index != 0;
+        bool showControls = index == Gaussian;
         setTiltVisibility(showControls);
     };
     connect(m_tiltDistributionComboBox, QOverload<int>::of(&QComboBox::currentIndexChanged), tiltVisibilityHandler);
 
     auto rotationVisibilityHandler = [this](int index) {
-        bool showControls = index != 0;
+        bool showControls = index == Gaussian;
         setRotationVisibility(showControls);
     };
     connect(m_rotationDistributionComboBox, QOverload<int>::of(&QComboBox::currentIndexChanged), rotationVisibilityHandler);
@@ -41,6 +47,7 @@ CrystalSettingsWidget::CrystalSettingsWidget(CrystalModel *model, QWidget *paren
     m_mapper->setModel(m_model);
     m_mapper->addMapping(m_caRatioSlider, CrystalModel::CaRatioAverage);
     m_mapper->addMapping(m_caRatioStdSlider, CrystalModel::CaRatioStd);
+    m_mapper->addMapping(m_crystalSizeSlider, CrystalModel::CrystalSize);
     m_mapper->addMapping(m_tiltDistributionComboBox, CrystalModel::TiltDistribution, "currentIndex");
     m_mapper->addMapping(m_tiltAverageSlider, CrystalModel::TiltAverage);
     m_mapper->addMapping(m_tiltStdSlider, CrystalModel::TiltStd);
@@ -60,6 +67,11 @@ CrystalSettingsWidget::CrystalSettingsWidget(CrystalModel *model, QWidget *paren
     {
         m_mapper->addMapping(m_prismFaceDistanceSliders[i], CrystalModel::PrismFaceDistance1 + i);
     }
+    for (auto i = 0; i < NUM_TABULATED_PARAMETERS; ++i)
+    {
+        m_mapper->addMapping(m_distributionTableLabels[i], CrystalModel::TiltDistributionTable + i, "text");
+    }
+    m_mapper->addMapping(m_customShapeLabel, CrystalModel::CustomShape, "text");
     m_mapper->toFirst();
     m_mapper->setSubmitPolicy(QDataWidgetMapper::SubmitPolicy::AutoSubmit);
 
@@ -72,6 +84,7 @@ CrystalSettingsWidget::CrystalSettingsWidget(CrystalModel *model, QWidget *paren
     connect(m_weightSlider, &SliderSpinBox::valueChanged, m_mapper, &QDataWidgetMapper::submit, Qt::QueuedConnection);
     connect(m_caRatioSlider, &SliderSpinBox::valueChanged, m_mapper, &QDataWidgetMapper::submit, Qt::QueuedConnection);
     connect(m_caRatioStdSlider, &SliderSpinBox::valueChanged, m_mapper, &QDataWidgetMapper::submit, Qt::QueuedConnection);
+    connect(m_crystalSizeSlider, &SliderSpinBox::valueChanged, m_mapper, &QDataWidgetMapper::submit, Qt::QueuedConnection);
     connect(m_tiltDistributionComboBox, QOverload<int>::of(&QComboBox::currentIndexChanged), m_mapper, &QDataWidgetMapper::submit, Qt::QueuedConnection);
     connect(m_tiltAverageSlider, &SliderSpinBox::valueChanged, m_mapper, &QDataWidgetMapper::submit, Qt::QueuedConnection);
     connect(m_tiltStdSlider, &SliderSpinBox::valueChanged, m_mapper, &QDataWidgetMapper::submit, Qt::QueuedConnection);
@@ -89,6 +102,23 @@ CrystalSettingsWidget::CrystalSettingsWidget(CrystalModel *model, QWidget *paren
         connect(m_prismFaceDistanceSliders[i], &SliderSpinBox::valueChanged, m_mapper, &QDataWidgetMapper::submit, Qt::QueuedConnection);
     }
 
+    for (auto i = 0; i < NUM_TABULATED_PARAMETERS; ++i)
+    {
+        auto parameter = static_cast<TabulatedParameter>(i);
+        connect(m_loadDistributionTableButtons[i], &QToolButton::clicked, [this, parameter]() {
+            loadDistributionTable(parameter);
+        });
+        connect(m_clearDistributionTableButtons[i], &QToolButton::clicked, [this, parameter]() {
+            m_model->setDistributionTable(m_mapper->currentIndex(), parameter, TabulatedDistribution());
+        });
+    }
+
+    connect(m_applyCustomShapeButton, &QPushButton::clicked, this, &CrystalSettingsWidget::applyCustomShapeFaces);
+    connect(m_importCustomShapeButton, &QPushButton::clicked, this, &CrystalSettingsWidget::importCustomShape);
+    connect(m_clearCustomShapeButton, &QPushButton::clicked, [this]() {
+        m_model->setCustomShape(m_mapper->currentIndex(), ConvexPolyhedron());
+    });
+
     setupPopulationComboBoxConnections();
 
     auto updateRemovePopulationButtonState = [this]()
@@ -101,12 +131,17 @@ CrystalSettingsWidget::CrystalSettingsWidget(CrystalModel *model, QWidget *paren
     connect(m_model, &CrystalModel::dataChanged, updateRemovePopulationButtonState);
     connect(m_model, &CrystalModel::rowsInserted, updateRemovePopulationButtonState);
     connect(m_model, &CrystalModel::rowsRemoved, updateRemovePopulationButtonState);
+    connect(m_model, &CrystalModel::modelReset, updateRemovePopulationButtonState);
 
     connect(m_model, &CrystalModel::rowsInserted, [this]() {
         if (m_mapper->currentIndex() == -1)
             m_mapper->toFirst();
     });
 
+    connect(m_model, &CrystalModel::modelReset, [this]() {
+        m_mapper->toFirst();
+    });
+
     connect(m_populationComboBox, QOverload<int>::of(&QComboBox::currentIndexChanged), [this](int index) {
         emit populationSelectionChanged(index);
     });
@@ -163,8 +198,12 @@ void CrystalSettingsWidget::setupUi()
 
     m_caRatioStdSlider = new SliderSpinBox(0.0, 10.0);
 
+    m_crystalSizeSlider = new SliderSpinBox(0.0, 200.0);
+    m_crystalSizeSlider->setSuffix(" µm");
+    m_crystalSizeSlider->setToolTip(tr("Crystal diameter for diffraction when the sun disk is convolved, zero for no diffraction"));
+
     m_tiltDistributionComboBox = new QComboBox();
-    m_tiltDistributionComboBox->addItems({tr("Uniform"), tr("Gaussian")});
+    m_tiltDistributionComboBox->addItems({tr("Uniform"), tr("Gaussian"), tr("Tabulated")});
 
     m_tiltAverageLabel = new QLabel(tr("Average"));
     m_tiltAverageSlider = SliderSpinBox::createAngleSlider(0.0, 180.0);
@@ -173,7 +212,7 @@ void CrystalSettingsWidget::setupUi()
     m_tiltStdSlider = SliderSpinBox::createAngleSlider(0.0, 360.0);
 
     m_rotationDistributionComboBox = new QComboBox();
-    m_rotationDistributionComboBox->addItems({tr("Uniform"), tr("Gaussian")});
+    m_rotationDistributionComboBox->addItems({tr("Uniform"), tr("Gaussian"), tr("Tabulated")});
 
     m_rotationAverageLabel = new QLabel(tr("Average"));
     m_rotationAverageSlider = SliderSpinBox::createAngleSlider(0.0, 180.0);
@@ -208,6 +247,29 @@ void CrystalSettingsWidget::setupUi()
         m_prismFaceDistanceSliders[i] = new SliderSpinBox(0.0, 4.0);
     }
 
+    for (auto i = 0; i < NUM_TABULATED_PARAMETERS; ++i)
+    {
+        m_distributionTableLabels[i] = new QLabel();
+
+        m_loadDistributionTableButtons[i] = new QToolButton();
+        m_loadDistributionTableButtons[i]->setIcon(QIcon::fromTheme("document-open"));
+        m_loadDistributionTableButtons[i]->setToolTip(tr("Load table from file"));
+
+        m_clearDistributionTableButtons[i] = new QToolButton();
+        m_clearDistributionTableButtons[i]->setIcon(QIcon::fromTheme("edit-clear"));
+        m_clearDistributionTableButtons[i]->setToolTip(tr("Clear table"));
+    }
+
+    m_customShapeLabel = new QLabel();
+
+    m_customShapeFacesEdit = new QPlainTextEdit();
+    m_customShapeFacesEdit->setPlaceholderText(tr("One face or form per line, e.g.\n{1 0 -1 0} 1.0\n{0 0 0 1} 2.0"));
+    m_customShapeFacesEdit->setToolTip(tr("Miller-Bravais indices of faces in parentheses, or of whole crystal forms in braces, followed by the distance of the face from the crystal center"));
+
+    m_applyCustomShapeButton = new QPushButton(tr("Apply faces"));
+    m_importCustomShapeButton = new QPushButton(tr("Import OBJ..."));
+    m_clearCustomShapeButton = new QPushButton(tr("Clear"));
+
     auto tabWidget = new QTabWidget();
 
     auto mainLayout = new QVBoxLayout(this->contentWidget());
@@ -230,6 +292,7 @@ void CrystalSettingsWidget::setupUi()
     auto basicShapeLayout = new QFormLayout(basicShapeTab);
     basicShapeLayout->addRow(tr("C/A ratio average"), m_caRatioSlider);
     basicShapeLayout->addRow(tr("C/A ratio std."), m_caRatioStdSlider);
+    basicShapeLayout->addRow(tr("Crystal size"), m_crystalSizeSlider);
     basicShapeLayout->addItem(new QSpacerItem(0, 5));
 
     auto tiltGroupBox = new QGroupBox(tr("C-axis tilt"));
@@ -278,6 +341,43 @@ void CrystalSettingsWidget::setupUi()
     }
 
     tabWidget->addTab(prismDistanceTab, tr("Prism faces"));
+
+    QWidget *distributionTableTab = new QWidget();
+    auto distributionTableLayout = new QFormLayout(distributionTableTab);
+    auto distributionTableGroupBox = new QGroupBox(tr("Tabulated distributions"));
+    auto distributionTableGroupLayout = new QFormLayout(distributionTableGroupBox);
+    distributionTableLayout->addRow(distributionTableGroupBox);
+    const char *distributionTableNames[NUM_TABULATED_PARAMETERS] = {
+        QT_TR_NOOP("C-axis tilt"),
+        QT_TR_NOOP("Rotation around C-axis"),
+        QT_TR_NOOP("C/A ratio"),
+        QT_TR_NOOP("Upper apex height"),
+        QT_TR_NOOP("Lower apex height")};
+    for (auto i = 0; i < NUM_TABULATED_PARAMETERS; ++i)
+    {
+        auto tableLayout = new QHBoxLayout();
+        tableLayout->addWidget(m_distributionTableLabels[i], 1);
+        tableLayout->addWidget(m_loadDistributionTableButtons[i]);
+        tableLayout->addWidget(m_clearDistributionTableButtons[i]);
+        distributionTableGroupLayout->addRow(tr(distributionTableNames[i]), tableLayout);
+    }
+
+    tabWidget->addTab(distributionTableTab, tr("Distributions"));
+
+    QWidget *customShapeTab = new QWidget();
+    auto customShapeLayout = new QFormLayout(customShapeTab);
+    auto customShapeGroupBox = new QGroupBox(tr("Custom crystal shape"));
+    auto customShapeGroupLayout = new QFormLayout(customShapeGroupBox);
+    customShapeLayout->addRow(customShapeGroupBox);
+    customShapeGroupLayout->addRow(tr("Current shape"), m_customShapeLabel);
+    customShapeGroupLayout->addRow(m_customShapeFacesEdit);
+    auto customShapeButtonLayout = new QHBoxLayout();
+    customShapeButtonLayout->addWidget(m_applyCustomShapeButton);
+    customShapeButtonLayout->addWidget(m_importCustomShapeButton);
+    customShapeButtonLayout->addWidget(m_clearCustomShapeButton);
+    customShapeGroupLayout->addRow(customShapeButtonLayout);
+
+    tabWidget->addTab(customShapeTab, tr("Custom shape"));
 }
 
 void CrystalSettingsWidget::setupPopulationComboBoxConnections()
@@ -298,6 +398,78 @@ void CrystalSettingsWidget::setupPopulationComboBoxConnections()
     connect(m_mapper, &QDataWidgetMapper::currentIndexChanged, m_populationComboBox, QOverload<int>::of(&QComboBox::setCurrentIndex), Qt::QueuedConnection);
 }
 
+void CrystalSettingsWidget::loadDistributionTable(TabulatedParameter parameter)
+{
+    QString filename = QFileDialog::getOpenFileName(this,
+                                                    tr("Open distribution table"),
+                                                    QString(),
+                                                    tr("Distribution tables (*.csv *.txt)"));
+
+    if (filename.isNull()) return;
+
+    QFile file(filename);
+    if (!file.open(QIODevice::ReadOnly | QIODevice::Text))
+    {
+        QMessageBox::warning(this, tr("Loading distribution table failed"), file.errorString());
+        return;
+    }
+
+    try
+    {
+        auto table = TabulatedDistribution::fromCsv(file.readAll().toStdString());
+        m_model->setDistributionTable(m_mapper->currentIndex(), parameter, table);
+        qInfo("Loaded distribution table with %u bins from: %s", table.getBinCount(), filename.toUtf8().constData());
+    }
+    catch (const std::runtime_error &e)
+    {
+        qWarning("Loading distribution table failed: %s", e.what());
+        QMessageBox::warning(this, tr("Loading distribution table failed"), e.what());
+    }
+}
+
+void CrystalSettingsWidget::applyCustomShapeFaces()
+{
+    try
+    {
+        auto shape = ConvexPolyhedron::fromMillerBravaisIndices(m_customShapeFacesEdit->toPlainText().toStdString());
+        m_model->setCustomShape(m_mapper->currentIndex(), shape);
+    }
+    catch (const std::runtime_error &e)
+    {
+        qWarning("Creating custom crystal shape failed: %s", e.what());
+        QMessageBox::warning(this, tr("Creating custom crystal shape failed"), e.what());
+    }
+}
+
+void CrystalSettingsWidget::importCustomShape()
+{
+    QString filename = QFileDialog::getOpenFileName(this,
+                                                    tr("Import crystal shape"),
+                                                    QString(),
+                                                    tr("Wavefront OBJ files (*.obj)"));
+
+    if (filename.isNull()) return;
+
+    QFile file(filename);
+    if (!file.open(QIODevice::ReadOnly | QIODevice::Text))
+    {
+        QMessageBox::warning(this, tr("Importing crystal shape failed"), file.errorString());
+        return;
+    }
+
+    try
+    {
+        auto shape = ConvexPolyhedron::fromObj(file.readAll().toStdString());
+        m_model->setCustomShape(m_mapper->currentIndex(), shape);
+        qInfo("Imported crystal shape with %zu faces from: %s", shape.getFaces().size(), filename.toUtf8().constData());
+    }
+    catch (const std::runtime_error &e)
+    {
+        qWarning("Importing crystal shape failed: %s", e.what());
+        QMessageBox::warning(this, tr("Importing crystal shape failed"), e.what());
+    }
+}
+
 void CrystalSettingsWidget::setTiltVisibility(bool visible)
 {
     m_tiltAverageSlider->setVisible(visible);
@@ -1,5 +1,6 @@
 #pragma once
 #include "components/collapsibleBox.h"
+#include "simulation/crystalPopulation.h"
 #include <memory>
 
 class QToolButton;
@@ -9,6 +10,8 @@ class QSpinBox;
 class QDataWidgetMapper;
 class QDoubleSpinBox;
 class QCheckBox;
+class QPlainTextEdit;
+class QPushButton;
 
 namespace HaloRay
 {
@@ -34,6 +37,9 @@ private:
     SliderSpinBox *createAngleSlider(double min, double max);
     void setTiltVisibility(bool);
     void setRotationVisibility(bool);
+    void loadDistributionTable(TabulatedParameter parameter);
+    void applyCustomShapeFaces();
+    void importCustomShape();
 
     AddCrystalPopulationButton *m_addPopulationButton;
     QToolButton *m_removePopulationButton;
@@ -41,6 +47,7 @@ private:
 
     SliderSpinBox *m_caRatioSlider;
     SliderSpinBox *m_caRatioStdSlider;
+    SliderSpinBox *m_crystalSizeSlider;
 
     QComboBox *m_tiltDistributionComboBox;
     SliderSpinBox *m_tiltAverageSlider;
@@ -64,6 +71,16 @@ private:
 
     SliderSpinBox *m_prismFaceDistanceSliders[6];
 
+    QLabel *m_distributionTableLabels[NUM_TABULATED_PARAMETERS];
+    QToolButton *m_loadDistributionTableButtons[NUM_TABULATED_PARAMETERS];
+    QToolButton *m_clearDistributionTableButtons[NUM_TABULATED_PARAMETERS];
+
+    QLabel *m_customShapeLabel;
+    QPlainTextEdit *m_customShapeFacesEdit;
+    QPushButton *m_applyCustomShapeButton;
+    QPushButton *m_importCustomShapeButton;
+    QPushButton *m_clearCustomShapeButton;
+
     SliderSpinBox *m_weightSlider;
 
     CrystalModel *m_model;
@@ -1,8 +1,11 @@
 #include "generalSettingsWidget.h"
 #include <QFormLayout>
 #include <QDoubleSpinBox>
+#include <QCheckBox>
+#include <limits>
 #include "components/sliderSpinBox.h"
 #include "simulation/lightSource.h"
+#include "simulation/simulationEngine.h"
 
 namespace HaloRay
 {
@@ -21,6 +24,18 @@ GeneralSettingsWidget::GeneralSettingsWidget(SimulationStateModel *viewModel, QW
     m_mapper->addMapping(m_multipleScatteringSlider, SimulationStateModel::MultipleScatteringProbability);
     m_mapper->addMapping(m_raysPerFrameSpinBox, SimulationStateModel::RaysPerFrame);
     m_mapper->addMapping(m_maximumFramesSpinBox, SimulationStateModel::MaximumIterations);
+    m_mapper->addMapping(m_maxScatteringOrdersSpinBox, SimulationStateModel::MaxScatteringOrders);
+    m_mapper->addMapping(m_russianRouletteDepthSpinBox, SimulationStateModel::RussianRouletteDepth);
+    m_mapper->addMapping(m_quasiRandomSamplingCheckBox, SimulationStateModel::QuasiRandomSampling);
+    m_mapper->addMapping(m_runSeedSpinBox, SimulationStateModel::RunSeed);
+    m_mapper->addMapping(m_transferTablesCheckBox, SimulationStateModel::TransferTables);
+    m_mapper->addMapping(m_sampleReweightingCheckBox, SimulationStateModel::SampleReweighting);
+    m_mapper->addMapping(m_sunConvolutionCheckBox, SimulationStateModel::SunConvolution);
+    m_mapper->addMapping(m_pathGuidingCheckBox, SimulationStateModel::PathGuiding);
+    m_mapper->addMapping(m_adaptiveRayAllocationCheckBox, SimulationStateModel::AdaptiveRayAllocation);
+    m_mapper->addMapping(m_wavefrontTracingCheckBox, SimulationStateModel::WavefrontTracing);
+    m_mapper->addMapping(m_hybridTracingCheckBox, SimulationStateModel::HybridTracing);
+    m_mapper->addMapping(m_monochromeCheckBox, SimulationStateModel::Monochrome);
     m_mapper->toFirst();
 
     connect(m_sunAltitudeSlider, &SliderSpinBox::valueChanged, m_mapper, &QDataWidgetMapper::submit, Qt::QueuedConnection);
@@ -28,6 +43,18 @@ GeneralSettingsWidget::GeneralSettingsWidget(SimulationStateModel *viewModel, QW
     connect(m_multipleScatteringSlider, &SliderSpinBox::valueChanged, m_mapper, &QDataWidgetMapper::submit, Qt::QueuedConnection);
     connect(m_raysPerFrameSpinBox, QOverload<int>::of(&QSpinBox::valueChanged), m_mapper, &QDataWidgetMapper::submit, Qt::QueuedConnection);
     connect(m_maximumFramesSpinBox, QOverload<int>::of(&QSpinBox::valueChanged), m_mapper, &QDataWidgetMapper::submit, Qt::QueuedConnection);
+    connect(m_maxScatteringOrdersSpinBox, QOverload<int>::of(&QSpinBox::valueChanged), m_mapper, &QDataWidgetMapper::submit, Qt::QueuedConnection);
+    connect(m_russianRouletteDepthSpinBox, QOverload<int>::of(&QSpinBox::valueChanged), m_mapper, &QDataWidgetMapper::submit, Qt::QueuedConnection);
+    connect(m_quasiRandomSamplingCheckBox, &QCheckBox::toggled, m_mapper, &QDataWidgetMapper::submit, Qt::QueuedConnection);
+    connect(m_runSeedSpinBox, QOverload<int>::of(&QSpinBox::valueChanged), m_mapper, &QDataWidgetMapper::submit, Qt::QueuedConnection);
+    connect(m_transferTablesCheckBox, &QCheckBox::toggled, m_mapper, &QDataWidgetMapper::submit, Qt::QueuedConnection);
+    connect(m_sampleReweightingCheckBox, &QCheckBox::toggled, m_mapper, &QDataWidgetMapper::submit, Qt::QueuedConnection);
+    connect(m_sunConvolutionCheckBox, &QCheckBox::toggled, m_mapper, &QDataWidgetMapper::submit, Qt::QueuedConnection);
+    connect(m_pathGuidingCheckBox, &QCheckBox::toggled, m_mapper, &QDataWidgetMapper::submit, Qt::QueuedConnection);
+    connect(m_adaptiveRayAllocationCheckBox, &QCheckBox::toggled, m_mapper, &QDataWidgetMapper::submit, Qt::QueuedConnection);
+    connect(m_wavefrontTracingCheckBox, &QCheckBox::toggled, m_mapper, &QDataWidgetMapper::submit, Qt::QueuedConnection);
+    connect(m_hybridTracingCheckBox, &QCheckBox::toggled, m_mapper, &QDataWidgetMapper::submit, Qt::QueuedConnection);
+    connect(m_monochromeCheckBox, &QCheckBox::toggled, m_mapper, &QDataWidgetMapper::submit, Qt::QueuedConnection);
 
     connect(m_viewModel, &SimulationStateModel::dataChanged, [this](const QModelIndex &topLeft, const QModelIndex &bottomRight) {
         if (topLeft.row() == 0 && topLeft.column() <= SimulationStateModel::RaysPerFrameUpperLimit && bottomRight.column() >= SimulationStateModel::RaysPerFrameUpperLimit) {
@@ -68,12 +95,66 @@ void GeneralSettingsWidget::setupUi()
     m_multipleScatteringSlider->setMinimum(0.0);
     m_multipleScatteringSlider->setMaximum(1.0);
 
+    m_maxScatteringOrdersSpinBox = new QSpinBox();
+    m_maxScatteringOrdersSpinBox->setMinimum(2);
+    m_maxScatteringOrdersSpinBox->setMaximum(SimulationEngine::scatteringOrderLimit);
+    m_maxScatteringOrdersSpinBox->setKeyboardTracking(false);
+    m_maxScatteringOrdersSpinBox->setToolTip(tr("Maximum number of crystals a ray can scatter from"));
+
+    m_russianRouletteDepthSpinBox = new QSpinBox();
+    m_russianRouletteDepthSpinBox->setMinimum(0);
+    m_russianRouletteDepthSpinBox->setMaximum(100);
+    m_russianRouletteDepthSpinBox->setKeyboardTracking(false);
+
+    m_quasiRandomSamplingCheckBox = new QCheckBox();
+
+    m_runSeedSpinBox = new QSpinBox();
+    m_runSeedSpinBox->setMinimum(0);
+    m_runSeedSpinBox->setMaximum(std::numeric_limits<int>::max());
+    m_runSeedSpinBox->setKeyboardTracking(false);
+
+    m_transferTablesCheckBox = new QCheckBox();
+    m_transferTablesCheckBox->setToolTip(tr("Reuse traced crystal shapes when only crystal orientations change"));
+
+    m_sampleReweightingCheckBox = new QCheckBox();
+    m_sampleReweightingCheckBox->setToolTip(tr("Keep traced rays when Gaussian crystal tilt, rotation or C/A ratio distributions change slightly"));
+
+    m_sunConvolutionCheckBox = new QCheckBox();
+    m_sunConvolutionCheckBox->setToolTip(tr("Trace rays from the center of the sun and blur the result with the sun disk and crystal diffraction"));
+
+    m_pathGuidingCheckBox = new QCheckBox();
+    m_pathGuidingCheckBox->setToolTip(tr("Learn which crystal orientations send rays into the view and trace more of them, useful when zoomed in"));
+
+    m_adaptiveRayAllocationCheckBox = new QCheckBox();
+    m_adaptiveRayAllocationCheckBox->setToolTip(tr("Give more rays to the crystal populations that leave the most noise in the image"));
+
+    m_wavefrontTracingCheckBox = new QCheckBox();
+    m_wavefrontTracingCheckBox->setToolTip(tr("Trace rays inside crystals in separate passes, which can be faster when some rays take very long paths"));
+
+    m_hybridTracingCheckBox = new QCheckBox();
+    m_hybridTracingCheckBox->setToolTip(tr("Trace part of the rays on the CPU at the same time as the GPU"));
+
+    m_monochromeCheckBox = new QCheckBox();
+    m_monochromeCheckBox->setToolTip(tr("Trace only the luminance of the rays, which is faster when color is not needed"));
+
     auto layout = new QFormLayout(this->contentWidget());
     layout->addRow(tr("Sun altitude"), m_sunAltitudeSlider);
     layout->addRow(tr("Sun diameter"), m_sunDiameterSpinBox);
     layout->addRow(tr("Rays per frame"), m_raysPerFrameSpinBox);
     layout->addRow(tr("Maximum frames"), m_maximumFramesSpinBox);
-    layout->addRow(tr("Double scattering"), m_multipleScatteringSlider);
+    layout->addRow(tr("Multiple scattering"), m_multipleScatteringSlider);
+    layout->addRow(tr("Scattering orders"), m_maxScatteringOrdersSpinBox);
+    layout->addRow(tr("Russian roulette depth"), m_russianRouletteDepthSpinBox);
+    layout->addRow(tr("Quasi-random sampling"), m_quasiRandomSamplingCheckBox);
+    layout->addRow(tr("Random seed"), m_runSeedSpinBox);
+    layout->addRow(tr("Crystal transfer tables"), m_transferTablesCheckBox);
+    layout->addRow(tr("Sample reweighting"), m_sampleReweightingCheckBox);
+    layout->addRow(tr("Sun disk convolution"), m_sunConvolutionCheckBox);
+    layout->addRow(tr("Path guiding"), m_pathGuidingCheckBox);
+    layout->addRow(tr("Adaptive ray allocation"), m_adaptiveRayAllocationCheckBox);
+    layout->addRow(tr("Wavefront tracing"), m_wavefrontTracingCheckBox);
+    layout->addRow(tr("Hybrid CPU tracing"), m_hybridTracingCheckBox);
+    layout->addRow(tr("Monochrome"), m_monochromeCheckBox);
 }
 
 void GeneralSettingsWidget::toggleComputeShaderParametersEnabled()
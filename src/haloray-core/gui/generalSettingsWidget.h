@@ -6,6 +6,7 @@
 
 class QDoubleSpinBox;
 class QSpinBox;
+class QCheckBox;
 
 namespace HaloRay
 {
@@ -29,6 +30,18 @@ private:
     QSpinBox *m_raysPerFrameSpinBox;
     QSpinBox *m_maximumFramesSpinBox;
     SliderSpinBox *m_multipleScatteringSlider;
+    QSpinBox *m_maxScatteringOrdersSpinBox;
+    QSpinBox *m_russianRouletteDepthSpinBox;
+    QCheckBox *m_quasiRandomSamplingCheckBox;
+    QSpinBox *m_runSeedSpinBox;
+    QCheckBox *m_transferTablesCheckBox;
+    QCheckBox *m_sampleReweightingCheckBox;
+    QCheckBox *m_sunConvolutionCheckBox;
+    QCheckBox *m_pathGuidingCheckBox;
+    QCheckBox *m_adaptiveRayAllocationCheckBox;
+    QCheckBox *m_wavefrontTracingCheckBox;
+    QCheckBox *m_hybridTracingCheckBox;
+    QCheckBox *m_monochromeCheckBox;
 
     QDataWidgetMapper *m_mapper;
     SimulationStateModel *m_viewModel;
@@ -0,0 +1,91 @@
+#include "haloComponentsWidget.h"
+#include <QCheckBox>
+#include <QFormLayout>
+#include <QHBoxLayout>
+#include <QLineEdit>
+
+namespace HaloRay
+{
+
+HaloComponentsWidget::HaloComponentsWidget(unsigned int layerCount, QWidget *parent)
+    : CollapsibleBox("Halo components", false, parent)
+{
+    setupUi(layerCount);
+    m_previousFilters = getFilters();
+
+    for (auto edit : m_filterEdits)
+    {
+        connect(edit, &QLineEdit::editingFinished, [this]() {
+            // Editing finishes also when focus is lost, which should not restart the simulation
+            auto filters = getFilters();
+            if (filters == m_previousFilters)
+                return;
+            m_previousFilters = filters;
+            emit filtersChanged(filters);
+        });
+    }
+
+    for (auto checkBox : m_visibleCheckBoxes)
+        connect(checkBox, &QCheckBox::toggled, this, &HaloComponentsWidget::emitVisibilityChanged);
+    connect(m_otherRaysVisibleCheckBox, &QCheckBox::toggled, this, &HaloComponentsWidget::emitVisibilityChanged);
+}
+
+void HaloComponentsWidget::setupUi(unsigned int layerCount)
+{
+    setMaximumWidth(400);
+
+    auto layout = new QFormLayout(this->contentWidget());
+    for (auto i = 0u; i < layerCount; ++i)
+    {
+        auto filterEdit = new QLineEdit();
+        filterEdit->setPlaceholderText(tr("e.g. 3-5"));
+        filterEdit->setToolTip(tr("Comma separated ray paths, such as 3-5 for rays entering face 3 and exiting face 5, "
+                                  "3-5:1 for the same with one internal reflection or 3 for external reflections off face 3"));
+
+        auto visibleCheckBox = new QCheckBox(tr("Show"));
+        visibleCheckBox->setChecked(true);
+
+        auto rowLayout = new QHBoxLayout();
+        rowLayout->addWidget(filterEdit);
+        rowLayout->addWidget(visibleCheckBox);
+        layout->addRow(tr("Layer %1").arg(i + 1), rowLayout);
+
+        m_filterEdits.push_back(filterEdit);
+        m_visibleCheckBoxes.push_back(visibleCheckBox);
+    }
+
+    m_otherRaysVisibleCheckBox = new QCheckBox();
+    m_otherRaysVisibleCheckBox->setChecked(true);
+    layout->addRow(tr("Show other rays"), m_otherRaysVisibleCheckBox);
+}
+
+QStringList HaloComponentsWidget::getFilters() const
+{
+    QStringList filters;
+    for (auto edit : m_filterEdits)
+        filters.append(edit->text());
+    return filters;
+}
+
+unsigned int HaloComponentsWidget::getVisibleLayers() const
+{
+    unsigned int visibleLayers = 0;
+    for (auto i = 0u; i < m_visibleCheckBoxes.size(); ++i)
+    {
+        if (m_visibleCheckBoxes[i]->isChecked())
+            visibleLayers |= 1u << i;
+    }
+    return visibleLayers;
+}
+
+bool HaloComponentsWidget::isOtherRaysVisible() const
+{
+    return m_otherRaysVisibleCheckBox->isChecked();
+}
+
+void HaloComponentsWidget::emitVisibilityChanged()
+{
+    emit visibilityChanged(getVisibleLayers(), isOtherRaysVisible());
+}
+
+}
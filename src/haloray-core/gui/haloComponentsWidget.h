@@ -0,0 +1,39 @@
+#pragma once
+#include <vector>
+#include <QStringList>
+#include "components/collapsibleBox.h"
+
+class QCheckBox;
+class QLineEdit;
+
+namespace HaloRay
+{
+
+/* Splits the image into halo component layers by ray path filters, and
+   shows or hides each layer */
+class HaloComponentsWidget : public CollapsibleBox
+{
+    Q_OBJECT
+public:
+    HaloComponentsWidget(unsigned int layerCount, QWidget *parent = nullptr);
+
+    QStringList getFilters() const;
+    // One bit for each visible layer
+    unsigned int getVisibleLayers() const;
+    bool isOtherRaysVisible() const;
+
+signals:
+    void filtersChanged(QStringList filters);
+    void visibilityChanged(unsigned int visibleLayers, bool otherRaysVisible);
+
+private:
+    void setupUi(unsigned int layerCount);
+    void emitVisibilityChanged();
+
+    std::vector<QLineEdit *> m_filterEdits;
+    std::vector<QCheckBox *> m_visibleCheckBoxes;
+    QCheckBox *m_otherRaysVisibleCheckBox;
+    QStringList m_previousFilters;
+};
+
+}
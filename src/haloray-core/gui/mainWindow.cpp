@@ -4,6 +4,7 @@
 #include <QGroupBox>
 #include <QFormLayout>
 #include <QString>
+#include <QStringList>
 #include <QScrollBar>
 #include <QIcon>
 #include <QMenu>
@@ -15,8 +16,16 @@
 #include <QScrollArea>
 #include <QStatusBar>
 #include <QSettings>
+#include <QMessageBox>
+#include <QProgressDialog>
+#include <QSignalBlocker>
+#include <QImage>
+#include <algorithm>
+#include <fstream>
+#include <stdexcept>
 #include "crystalPreview/crystalPreviewWindow.h"
 #include "stateSaver.h"
+#include "scatteringTableDialog.h"
 #include "models/crystalModel.h"
 #include "models/simulationStateModel.h"
 #include "openGLWidget.h"
@@ -24,11 +33,14 @@
 #include "crystalSettingsWidget.h"
 #include "viewSettingsWidget.h"
 #include "atmosphereSettingsWidget.h"
+#include "haloComponentsWidget.h"
 #include "components/collapsibleBox.h"
 #include "components/sliderSpinBox.h"
 #include "components/renderButton.h"
 #include "simulation/atmosphere.h"
 #include "simulation/crystalPopulation.h"
+#include "simulation/pathFilter.h"
+#include "simulation/toneMapping.h"
 #include "simulation/simulationEngine.h"
 
 #ifndef STRINGIFY0
@@ -41,7 +53,11 @@
 namespace HaloRay
 {
 
-MainWindow::MainWindow(QWidget *parent) : QMainWindow(parent), m_previousTimedIteration(0)
+MainWindow::MainWindow(QWidget *parent)
+    : QMainWindow(parent),
+      m_previousTimedIteration(0),
+      m_crystalEditsPending(false),
+      m_crystalShapesEdited(false)
 {
 #if _WIN32
     QIcon::setThemeName("HaloRayTheme");
@@ -60,25 +76,63 @@ MainWindow::MainWindow(QWidget *parent) : QMainWindow(parent), m_previousTimedIt
     connect(m_renderButton, &RenderButton::clicked, m_generalSettingsWidget, &GeneralSettingsWidget::toggleComputeShaderParametersEnabled);
 
     // Signals from crystal model
-    connect(m_crystalModel, &CrystalModel::dataChanged, [this]() {
-        restartSimulation();
+    m_crystalEditTimer.setSingleShot(true);
+    m_crystalEditTimer.setInterval(crystalEditDebounceInterval);
+    connect(&m_crystalEditTimer, &QTimer::timeout, this, &MainWindow::applyCrystalEdits);
+    connect(m_crystalModel, &CrystalModel::dataChanged, [this](const QModelIndex &topLeft, const QModelIndex &bottomRight) {
+        /* Scattering tables are traced for every population separately, so
+         * they stay valid when only population weights or names change */
+        for (auto column = topLeft.column(); column <= bottomRight.column(); ++column)
+        {
+            if (column != CrystalModel::PopulationWeight && column != CrystalModel::Enabled && column != CrystalModel::PopulationName)
+                m_crystalShapesEdited = true;
+        }
+
+        // No rays are traced until the edits are applied, so none mix old and new crystals
+        if (!m_crystalEditsPending)
+        {
+            m_crystalEditsPending = true;
+            m_engine->beginUpdate();
+        }
+        m_crystalEditTimer.start();
     });
     connect(m_crystalModel, &CrystalModel::rowsInserted, [this]() {
+        if (!m_engine->getScatteringTable().isEmpty())
+            setScatteringTable(ScatteringTable());
         restartSimulation();
     });
     connect(m_crystalModel, &CrystalModel::rowsRemoved, [this]() {
+        if (!m_engine->getScatteringTable().isEmpty())
+            setScatteringTable(ScatteringTable());
+        restartSimulation();
+    });
+    connect(m_crystalModel, &CrystalModel::modelReset, [this]() {
+        if (!m_engine->getScatteringTable().isEmpty())
+            setScatteringTable(ScatteringTable());
         restartSimulation();
     });
 
     // Signals from view settings
     connect(m_viewSettingsWidget, &ViewSettingsWidget::brightnessChanged, m_openGLWidget, &OpenGLWidget::setBrightness);
+    connect(m_viewSettingsWidget, &ViewSettingsWidget::denoisingChanged, m_openGLWidget, &OpenGLWidget::setDenoisingEnabled);
+    connect(m_viewSettingsWidget, &ViewSettingsWidget::autoExposureChanged, m_openGLWidget, &OpenGLWidget::setAutoExposure);
     connect(m_viewSettingsWidget, &ViewSettingsWidget::lockToLightSource, [this](bool locked) {
         m_engine->lockCameraToLightSource(locked);
         m_openGLWidget->update();
     });
     m_viewSettingsWidget->setBrightness(3.0);
 
+    // Signals from halo components
+    connect(m_haloComponentsWidget, &HaloComponentsWidget::filtersChanged, this, &MainWindow::setPathFilters);
+    connect(m_haloComponentsWidget, &HaloComponentsWidget::visibilityChanged, [this]() {
+        m_openGLWidget->makeCurrent();
+        updatePathLayerVisibility();
+        m_openGLWidget->doneCurrent();
+        m_openGLWidget->update();
+    });
+
     // Signals from OpenGL widget
+    connect(m_openGLWidget, &OpenGLWidget::brightnessChanged, m_viewSettingsWidget, &ViewSettingsWidget::setBrightness);
     connect(m_openGLWidget, &OpenGLWidget::nextIteration, m_progressBar, &QProgressBar::setValue);
 
     // Signals from view model
@@ -93,7 +147,7 @@ MainWindow::MainWindow(QWidget *parent) : QMainWindow(parent), m_previousTimedIt
     // Signals for menu bar
     connect(m_quitAction, &QAction::triggered, QApplication::instance(), &QApplication::quit);
     connect(m_saveImageAction, &QAction::triggered, [this]() {
-        auto image = m_openGLWidget->grabFramebuffer();
+        auto image = m_openGLWidget->grabRawFramebuffer();
         auto currentTime = QDateTime::currentDateTimeUtc().toString(Qt::DateFormat::ISODate);
         auto defaultFilename = QString("haloray_%1.png")
                                    .arg(currentTime)
@@ -137,6 +191,26 @@ MainWindow::MainWindow(QWidget *parent) : QMainWindow(parent), m_previousTimedIt
         connect(m_crystalSettingsWidget, &CrystalSettingsWidget::populationSelectionChanged, previewWindow, &CrystalPreviewWindow::onMainWindowPopulationSelectionChange);
         previewWindow->show();
     });
+    connect(m_collectPathLengthStatisticsAction, &QAction::toggled, [this](bool enabled) {
+        m_engine->setPathLengthStatisticsEnabled(enabled);
+        m_openGLWidget->update();
+    });
+    connect(m_buildScatteringTableAction, &QAction::triggered, this, &MainWindow::buildScatteringTable);
+    connect(m_loadScatteringTableAction, &QAction::triggered, this, &MainWindow::loadScatteringTable);
+    connect(m_saveScatteringTableAction, &QAction::triggered, this, &MainWindow::saveScatteringTable);
+    connect(m_discardScatteringTableAction, &QAction::triggered, [this]() {
+        setScatteringTable(ScatteringTable());
+    });
+    connect(m_engine, &SimulationEngine::scatteringTableChanged, this, &MainWindow::updateScatteringTableActions);
+    connect(m_dumpRaysAction, &QAction::toggled, this, &MainWindow::toggleRayDump);
+    updateScatteringTableActions();
+    connect(m_addOutputViewAction, &QAction::triggered, this, &MainWindow::addOutputView);
+    connect(m_clearOutputViewsAction, &QAction::triggered, [this]() {
+        setOutputViews({});
+    });
+    connect(m_saveOutputViewsAction, &QAction::triggered, this, &MainWindow::saveOutputViewImages);
+    connect(m_engine, &SimulationEngine::outputViewsChanged, this, &MainWindow::updateOutputViewActions);
+    updateOutputViewActions();
     connect(m_resetSimulationAction, &QAction::triggered, [this]() {
         m_crystalModel->clear();
         m_crystalModel->addRow(CrystalPopulationPreset::Random);
@@ -188,10 +262,24 @@ void MainWindow::setupMenuBar()
     m_loadSimulationAction = fileMenu->addAction(tr("&Load simulation"));
     m_saveSimulationAction = fileMenu->addAction(tr("&Save simulation"));
     fileMenu->addSeparator();
+    auto scatteringTableMenu = fileMenu->addMenu(tr("Scattering &table"));
+    m_buildScatteringTableAction = scatteringTableMenu->addAction(tr("&Build..."));
+    m_loadScatteringTableAction = scatteringTableMenu->addAction(tr("&Load..."));
+    m_saveScatteringTableAction = scatteringTableMenu->addAction(tr("&Save..."));
+    m_discardScatteringTableAction = scatteringTableMenu->addAction(tr("&Discard"));
+    m_dumpRaysAction = fileMenu->addAction(tr("&Dump rays to file..."));
+    m_dumpRaysAction->setCheckable(true);
+    fileMenu->addSeparator();
     m_quitAction = fileMenu->addAction(tr("&Quit"));
 
     auto miscMenu = menuBar()->addMenu(tr("&View"));
     m_openCrystalPreviewWindow = miscMenu->addAction(tr("Crystal &preview"));
+    m_collectPathLengthStatisticsAction = miscMenu->addAction(tr("Collect path length &statistics"));
+    m_collectPathLengthStatisticsAction->setCheckable(true);
+    miscMenu->addSeparator();
+    m_addOutputViewAction = miscMenu->addAction(tr("&Add current camera as output view"));
+    m_clearOutputViewsAction = miscMenu->addAction(tr("&Clear output views"));
+    m_saveOutputViewsAction = miscMenu->addAction(tr("Save output &view images..."));
 }
 
 QScrollArea *MainWindow::setupSideBarScrollArea()
@@ -200,6 +288,7 @@ QScrollArea *MainWindow::setupSideBarScrollArea()
     m_crystalSettingsWidget = new CrystalSettingsWidget(m_crystalModel);
     m_viewSettingsWidget = new ViewSettingsWidget(m_simulationStateModel);
     m_atmosphereSettingsWidget = new AtmosphereSettingsWidget(m_simulationStateModel);
+    m_haloComponentsWidget = new HaloComponentsWidget(SimulationEngine::maxPathLayers);
 
     auto scrollContainer = new QWidget();
     auto scrollableLayout = new QVBoxLayout(scrollContainer);
@@ -209,6 +298,7 @@ QScrollArea *MainWindow::setupSideBarScrollArea()
     scrollableLayout->addWidget(m_crystalSettingsWidget);
     scrollableLayout->addWidget(m_viewSettingsWidget);
     scrollableLayout->addWidget(m_atmosphereSettingsWidget);
+    scrollableLayout->addWidget(m_haloComponentsWidget);
     scrollableLayout->addStretch();
 
     auto scrollArea = new QScrollArea();
@@ -248,10 +338,32 @@ void MainWindow::setupRenderTimer()
             m_previousTimedIteration = currentIteration;
             return;
         }
+        if (m_engine->isUsingScatteringTable())
+        {
+            this->statusBar()->showMessage(tr("Resampling scattering table"));
+            return;
+        }
         unsigned int raysPerStep = m_engine->getRaysPerStep();
         unsigned int rate = (currentIteration - previousIteration) * raysPerStep;
         m_previousTimedIteration = currentIteration;
-        this->statusBar()->showMessage(QString("Simulation rate: %1 rays/s").arg(QLocale::system().toString(rate)));
+        auto message = QString("Simulation rate: %1 rays/s").arg(QLocale::system().toString(rate));
+        auto cpuRayShare = m_engine->getCpuRayShare();
+        if (cpuRayShare > 0.0)
+        {
+            auto cpuRate = static_cast<unsigned int>(rate * cpuRayShare);
+            message += QString(" (GPU %1, CPU %2)").arg(QLocale::system().toString(rate - cpuRate)).arg(QLocale::system().toString(cpuRate));
+        }
+        if (m_engine->isAdaptiveRayAllocationEnabled())
+        {
+            QStringList shares;
+            for (auto i = 0u; i < m_crystalRepository->getCount(); ++i)
+            {
+                auto name = QString::fromStdString(m_crystalRepository->getName(i));
+                shares << QString("%1 %2%").arg(name).arg(100.0 * m_engine->getRayShare(i), 0, 'f', 1);
+            }
+            message += QString(", rays per population: %1").arg(shares.join(", "));
+        }
+        this->statusBar()->showMessage(message);
     });
 
     connect(this->m_renderButton, &RenderButton::clicked, [this]() {
@@ -269,8 +381,311 @@ void MainWindow::setupRenderTimer()
 
 void HaloRay::MainWindow::restartSimulation()
 {
-    m_engine->clear();
+    m_engine->reset();
+    m_openGLWidget->update();
+}
+
+void MainWindow::applyCrystalEdits()
+{
+    if (!m_crystalEditsPending)
+        return;
+
+    m_crystalEditTimer.stop();
+    m_crystalEditsPending = false;
+    m_openGLWidget->makeCurrent();
+    m_engine->endUpdate();
+    m_openGLWidget->doneCurrent();
+
+    if (m_crystalShapesEdited && !m_engine->getScatteringTable().isEmpty())
+    {
+        qInfo("Crystal settings changed, discarding scattering table");
+        setScatteringTable(ScatteringTable());
+    }
+    m_crystalShapesEdited = false;
+
+    // Small changes to crystal parameter distributions can be applied to rays already traced
+    m_openGLWidget->makeCurrent();
+    auto reweighted = m_engine->reweightSamples();
+    m_openGLWidget->doneCurrent();
+    if (reweighted)
+        m_openGLWidget->update();
+    else
+        restartSimulation();
+}
+
+void MainWindow::buildScatteringTable()
+{
+    applyCrystalEdits();
+    if (m_engine->isRunning())
+    {
+        QMessageBox::information(this, tr("Build scattering table"), tr("Stop the simulation before building a scattering table."));
+        return;
+    }
+
+    ScatteringTableDialog dialog(m_engine->getLightSource().altitude, this);
+    if (dialog.exec() != QDialog::Accepted) return;
+
+    QProgressDialog progressDialog(tr("Building scattering table..."), tr("Cancel"), 0, 1, this);
+    progressDialog.setWindowModality(Qt::WindowModal);
+    progressDialog.setMinimumDuration(0);
+
+    m_openGLWidget->makeCurrent();
+    try
+    {
+        auto table = m_engine->buildScatteringTable(
+            dialog.getMinAltitude(),
+            dialog.getMaxAltitude(),
+            dialog.getAltitudeStep(),
+            dialog.getRaysPerAltitude(),
+            [&progressDialog](unsigned int done, unsigned int total) {
+                progressDialog.setMaximum(total);
+                progressDialog.setValue(done);
+                QApplication::processEvents();
+                return !progressDialog.wasCanceled();
+            });
+        if (!table.isEmpty())
+            m_engine->setScatteringTable(std::move(table));
+    }
+    catch (const std::runtime_error &e)
+    {
+        qWarning("Building scattering table failed: %s", e.what());
+        QMessageBox::warning(this, tr("Building scattering table failed"), e.what());
+    }
+    m_openGLWidget->doneCurrent();
+    m_openGLWidget->update();
+}
+
+void MainWindow::loadScatteringTable()
+{
+    QString filename = QFileDialog::getOpenFileName(this,
+                                                    tr("Open file"),
+                                                    QString(),
+                                                    tr("Scattering tables (*.hrst)"));
+
+    if (filename.isNull()) return;
+
+    qInfo("Loading scattering table from: %s", filename.toUtf8().constData());
+    try
+    {
+        std::ifstream file(filename.toStdString(), std::ios::binary);
+        if (!file)
+            throw std::runtime_error("Could not open file");
+        auto table = ScatteringTable::load(file);
+        if (!m_engine->matchesScatteringTable(table))
+            throw std::runtime_error("Scattering table was built with different crystals or simulation settings. Load the state the table was built with first.");
+        setScatteringTable(std::move(table));
+    }
+    catch (const std::runtime_error &e)
+    {
+        qWarning("Loading scattering table failed: %s", e.what());
+        QMessageBox::warning(this, tr("Loading scattering table failed"), e.what());
+    }
+}
+
+void MainWindow::saveScatteringTable()
+{
+    auto currentTime = QDateTime::currentDateTimeUtc().toString(Qt::DateFormat::ISODate);
+    auto defaultFilename = QString("haloray_table_%1.hrst")
+                               .arg(currentTime)
+                               .replace(":", "-");
+    QString filename = QFileDialog::getSaveFileName(this,
+                                                    tr("Save File"),
+                                                    defaultFilename,
+                                                    tr("Scattering tables (*.hrst)"));
+
+    if (filename.isNull()) return;
+
+    qInfo("Saving scattering table to: %s", filename.toUtf8().constData());
+    try
+    {
+        std::ofstream file(filename.toStdString(), std::ios::binary);
+        if (!file)
+            throw std::runtime_error("Could not open file");
+        m_engine->getScatteringTable().save(file);
+    }
+    catch (const std::runtime_error &e)
+    {
+        qWarning("Saving scattering table failed: %s", e.what());
+        QMessageBox::warning(this, tr("Saving scattering table failed"), e.what());
+    }
+}
+
+void MainWindow::toggleRayDump(bool enabled)
+{
+    if (!enabled)
+    {
+        // Rays still on the GPU are read back before the file is finished
+        m_openGLWidget->makeCurrent();
+        m_engine->stopRayDump();
+        m_openGLWidget->doneCurrent();
+        return;
+    }
+
+    auto currentTime = QDateTime::currentDateTimeUtc().toString(Qt::DateFormat::ISODate);
+    auto defaultFilename = QString("haloray_rays_%1.hrrays")
+                               .arg(currentTime)
+                               .replace(":", "-");
+    QString filename = QFileDialog::getSaveFileName(this,
+                                                    tr("Save File"),
+                                                    defaultFilename,
+                                                    tr("Ray dumps (*.hrrays)"));
+
+    try
+    {
+        if (!filename.isNull())
+        {
+            m_engine->startRayDump(filename.toStdString());
+            return;
+        }
+    }
+    catch (const std::runtime_error &e)
+    {
+        qWarning("Starting ray dump failed: %s", e.what());
+        QMessageBox::warning(this, tr("Starting ray dump failed"), e.what());
+    }
+
+    QSignalBlocker blocker(m_dumpRaysAction);
+    m_dumpRaysAction->setChecked(false);
+}
+
+void MainWindow::setPathFilters(const QStringList &filterTexts)
+{
+    std::vector<PathFilter> filters;
+    try
+    {
+        for (const auto &text : filterTexts)
+            filters.push_back(PathFilter::parse(text.toStdString()));
+    }
+    catch (const std::runtime_error &e)
+    {
+        qWarning("Invalid halo component filter: %s", e.what());
+        QMessageBox::warning(this, tr("Invalid halo component filter"), e.what());
+        return;
+    }
+
+    m_openGLWidget->makeCurrent();
+    m_engine->setPathFilters(filters);
+    updatePathLayerVisibility();
+    m_openGLWidget->doneCurrent();
+    m_openGLWidget->update();
+}
+
+void MainWindow::updatePathLayerVisibility()
+{
+    // The engine only has layers for the filters that are not empty
+    const auto filters = m_haloComponentsWidget->getFilters();
+    const auto visibleRows = m_haloComponentsWidget->getVisibleLayers();
+    unsigned int visibleLayers = 0;
+    unsigned int layer = 0;
+    for (auto row = 0; row < filters.size(); ++row)
+    {
+        if (filters[row].trimmed().isEmpty())
+            continue;
+        if (visibleRows & (1u << row))
+            visibleLayers |= 1u << layer;
+        ++layer;
+    }
+    m_engine->setPathLayerVisibility(visibleLayers, m_haloComponentsWidget->isOtherRaysVisible());
+}
+
+void MainWindow::setScatteringTable(ScatteringTable table)
+{
+    m_openGLWidget->makeCurrent();
+    m_engine->setScatteringTable(std::move(table));
+    m_openGLWidget->doneCurrent();
     m_openGLWidget->update();
 }
 
+void MainWindow::updateScatteringTableActions()
+{
+    bool hasTable = !m_engine->getScatteringTable().isEmpty();
+    m_saveScatteringTableAction->setEnabled(hasTable);
+    m_discardScatteringTableAction->setEnabled(hasTable);
+}
+
+void MainWindow::addOutputView()
+{
+    auto views = m_engine->getOutputViews();
+    if (views.size() >= SimulationEngine::maxOutputViews)
+    {
+        QMessageBox::information(this, tr("Add output view"), tr("At most %1 output views are supported.").arg(SimulationEngine::maxOutputViews));
+        return;
+    }
+
+    // The view has the size of the main image on screen, in device pixels
+    OutputView view;
+    view.camera = m_engine->getCamera();
+    view.width = static_cast<unsigned int>(qRound(m_openGLWidget->width() * m_openGLWidget->devicePixelRatioF()));
+    view.height = static_cast<unsigned int>(qRound(m_openGLWidget->height() * m_openGLWidget->devicePixelRatioF()));
+    views.push_back(view);
+    setOutputViews(std::move(views));
+}
+
+void MainWindow::setOutputViews(std::vector<OutputView> views)
+{
+    m_openGLWidget->makeCurrent();
+    try
+    {
+        m_engine->setOutputViews(std::move(views));
+    }
+    catch (const std::runtime_error &e)
+    {
+        qWarning("Setting output views failed: %s", e.what());
+        QMessageBox::warning(this, tr("Setting output views failed"), e.what());
+    }
+    m_openGLWidget->doneCurrent();
+    m_openGLWidget->update();
+}
+
+void MainWindow::saveOutputViewImages()
+{
+    auto currentTime = QDateTime::currentDateTimeUtc().toString(Qt::DateFormat::ISODate);
+    auto defaultFilename = QString("haloray_view_%1.png")
+                               .arg(currentTime)
+                               .replace(":", "-");
+    QString filename = QFileDialog::getSaveFileName(this,
+                                                    tr("Save File"),
+                                                    defaultFilename,
+                                                    tr("Images (*.png)"));
+
+    if (filename.isNull()) return;
+
+    // Each view gets its number after the chosen name
+    auto baseName = filename;
+    if (baseName.endsWith(".png", Qt::CaseInsensitive))
+        baseName.chop(4);
+
+    // Views are exposed like the main image, for the rays traced so far
+    const auto tracedRayCount = static_cast<double>(m_engine->getIteration() + 1) * m_engine->getRaysPerStep();
+    const auto views = m_engine->getOutputViews();
+    m_openGLWidget->makeCurrent();
+    for (auto viewIndex = 0u; viewIndex < views.size(); ++viewIndex)
+    {
+        const auto &view = views[viewIndex];
+        auto pixels = toneMap(m_engine->getOutputViewImage(viewIndex).data(), 4, view.width, view.height,
+                              static_cast<float>(m_openGLWidget->getBrightness()), view.camera.fov, tracedRayCount);
+
+        QImage image(view.width, view.height, QImage::Format_RGB888);
+        for (auto y = 0u; y < view.height; ++y)
+            std::copy_n(&pixels[static_cast<std::size_t>(y) * view.width * 3], view.width * 3, image.scanLine(y));
+
+        auto viewFilename = QString("%1_%2.png").arg(baseName).arg(viewIndex + 1);
+        qInfo("Saving output view to: %s", viewFilename.toUtf8().constData());
+        if (!image.save(viewFilename, "PNG"))
+        {
+            qWarning("Could not write output view image: %s", viewFilename.toUtf8().constData());
+            QMessageBox::warning(this, tr("Saving output view failed"), tr("Could not write %1").arg(viewFilename));
+            break;
+        }
+    }
+    m_openGLWidget->doneCurrent();
+}
+
+void MainWindow::updateOutputViewActions()
+{
+    bool hasViews = !m_engine->getOutputViews().empty();
+    m_clearOutputViewsAction->setEnabled(hasViews);
+    m_saveOutputViewsAction->setEnabled(hasViews);
+}
+
 }
@@ -3,6 +3,9 @@
 #include <memory>
 #include <QTimer>
 #include "gui/models/simulationStateModel.h"
+#include <vector>
+#include "simulation/outputView.h"
+#include "simulation/scatteringTable.h"
 
 
 class QDoubleSpinBox;
@@ -21,6 +24,7 @@ class ViewSettingsWidget;
 class GeneralSettingsWidget;
 class CrystalSettingsWidget;
 class AtmosphereSettingsWidget;
+class HaloComponentsWidget;
 class CrystalModel;
 
 class MainWindow : public QMainWindow
@@ -38,11 +42,25 @@ private:
     void setupMenuBar();
     void setupRenderTimer();
     void restartSimulation();
+    void applyCrystalEdits();
+    void buildScatteringTable();
+    void loadScatteringTable();
+    void saveScatteringTable();
+    void setScatteringTable(ScatteringTable table);
+    void updateScatteringTableActions();
+    void toggleRayDump(bool enabled);
+    void setPathFilters(const QStringList &filters);
+    void updatePathLayerVisibility();
+    void addOutputView();
+    void setOutputViews(std::vector<OutputView> views);
+    void saveOutputViewImages();
+    void updateOutputViewActions();
 
     GeneralSettingsWidget *m_generalSettingsWidget;
     CrystalSettingsWidget *m_crystalSettingsWidget;
     ViewSettingsWidget *m_viewSettingsWidget;
     AtmosphereSettingsWidget *m_atmosphereSettingsWidget;
+    HaloComponentsWidget *m_haloComponentsWidget;
     QProgressBar *m_progressBar;
     RenderButton *m_renderButton;
     OpenGLWidget *m_openGLWidget;
@@ -53,6 +71,15 @@ private:
     QAction *m_saveSimulationAction;
     QAction *m_loadSimulationAction;
     QAction *m_openCrystalPreviewWindow;
+    QAction *m_collectPathLengthStatisticsAction;
+    QAction *m_buildScatteringTableAction;
+    QAction *m_loadScatteringTableAction;
+    QAction *m_saveScatteringTableAction;
+    QAction *m_discardScatteringTableAction;
+    QAction *m_dumpRaysAction;
+    QAction *m_addOutputViewAction;
+    QAction *m_clearOutputViewsAction;
+    QAction *m_saveOutputViewsAction;
 
     std::shared_ptr<CrystalPopulationRepository> m_crystalRepository;
     SimulationEngine *m_engine;
@@ -61,6 +88,14 @@ private:
     CrystalModel *m_crystalModel;
     QTimer m_renderTimer;
     int m_previousTimedIteration;
+
+    /* Crystal edits, e.g. from a dragged slider, are collected in a batch
+       of engine updates until none has arrived for a while, and then
+       reweighted or restarted once */
+    static const int crystalEditDebounceInterval = 50;
+    QTimer m_crystalEditTimer;
+    bool m_crystalEditsPending;
+    bool m_crystalShapesEdited;
 };
 
 }
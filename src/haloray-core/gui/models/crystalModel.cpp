@@ -2,6 +2,7 @@
 #include <QAbstractTableModel>
 #include <QString>
 #include <QWidget>
+#include <stdexcept>
 #include "../../simulation/crystalPopulationRepository.h"
 
 namespace HaloRay
@@ -9,7 +10,8 @@ namespace HaloRay
 
 CrystalModel::CrystalModel(std::shared_ptr<CrystalPopulationRepository> crystalRepository, QWidget *parent)
     : QAbstractTableModel(parent),
-      m_crystals(crystalRepository)
+      m_crystals(crystalRepository),
+      m_updateDepth(0)
 {
 }
 
@@ -85,6 +87,26 @@ QVariant CrystalModel::data(const QModelIndex &index, int role) const
         return crystal.prismFaceDistances[5];
     case Enabled:
         return crystal.enabled;
+    case TiltDistributionTable:
+    case RotationDistributionTable:
+    case CaRatioDistributionTable:
+    case UpperApexHeightDistributionTable:
+    case LowerApexHeightDistributionTable:
+    {
+        const auto &table = crystal.distributionTables[index.column() - TiltDistributionTable];
+        if (table.isEmpty()) return tr("No table loaded");
+        return tr("%1 bins from %2 to %3")
+            .arg(table.getBinCount())
+            .arg(table.getBinEdges().front())
+            .arg(table.getBinEdges().back());
+    }
+    case CustomShape:
+        if (crystal.customShape.isEmpty()) return tr("Hexagonal crystal");
+        return tr("%1 faces, %2 vertices")
+            .arg(crystal.customShape.getFaces().size())
+            .arg(crystal.customShape.getVertexCount());
+    case CrystalSize:
+        return crystal.crystalSize;
     }
 
     return QVariant();
@@ -170,6 +192,9 @@ bool CrystalModel::setData(const QModelIndex &index, const QVariant &value, int
     case PrismFaceDistance6:
         crystal.prismFaceDistances[5] = value.toFloat();
         break;
+    case CrystalSize:
+        crystal.crystalSize = value.toFloat();
+        break;
     case Enabled:
         crystal.enabled = value.toBool();
     default:
@@ -192,6 +217,11 @@ Qt::ItemFlags CrystalModel::flags(const QModelIndex &index) const
 void CrystalModel::addRow(CrystalPopulationPreset preset)
 {
     auto row = m_crystals->getCount();
+    if (m_updateDepth > 0)
+    {
+        m_crystals->add(preset);
+        return;
+    }
     beginInsertRows(QModelIndex(), row, row);
     m_crystals->add(preset);
     endInsertRows();
@@ -200,6 +230,11 @@ void CrystalModel::addRow(CrystalPopulationPreset preset)
 void CrystalModel::addRow(CrystalPopulation population, double weight, QString name)
 {
     auto row = m_crystals->getCount();
+    if (m_updateDepth > 0)
+    {
+        m_crystals->add(population, weight, name.toStdString());
+        return;
+    }
     beginInsertRows(QModelIndex(), row, row);
     m_crystals->add(population, weight, name.toStdString());
     endInsertRows();
@@ -210,6 +245,11 @@ bool CrystalModel::removeRow(int row)
     if (m_crystals->getCount() <= 1)
         return false;
 
+    if (m_updateDepth > 0)
+    {
+        m_crystals->remove(row);
+        return true;
+    }
     beginRemoveRows(QModelIndex(), row, row);
     m_crystals->remove(row);
     endRemoveRows();
@@ -219,14 +259,53 @@ bool CrystalModel::removeRow(int row)
 
 void CrystalModel::clear()
 {
+    if (m_updateDepth > 0)
+    {
+        m_crystals->clear();
+        return;
+    }
     beginResetModel();
     m_crystals->clear();
     endResetModel();
 }
 
+void CrystalModel::beginUpdate()
+{
+    if (m_updateDepth++ == 0)
+        beginResetModel();
+}
+
+void CrystalModel::endUpdate()
+{
+    if (m_updateDepth == 0)
+        throw std::runtime_error("Ending an update that was not begun");
+
+    if (--m_updateDepth == 0)
+        endResetModel();
+}
+
 void CrystalModel::setName(int row, QString name)
 {
     setData(createIndex(row, PopulationName), name);
 }
 
+void CrystalModel::setDistributionTable(int row, TabulatedParameter parameter, TabulatedDistribution table)
+{
+    m_crystals->get(row).distributionTables[parameter] = table;
+    auto tableIndex = createIndex(row, TiltDistributionTable + parameter);
+    emit dataChanged(tableIndex, tableIndex);
+}
+
+void CrystalModel::setCustomShape(int row, ConvexPolyhedron shape)
+{
+    m_crystals->get(row).customShape = shape;
+    auto shapeIndex = createIndex(row, CustomShape);
+    emit dataChanged(shapeIndex, shapeIndex);
+}
+
+const ConvexPolyhedron &CrystalModel::getCustomShape(int row) const
+{
+    return m_crystals->get(row).customShape;
+}
+
 }
@@ -44,6 +44,13 @@ public:
         PrismFaceDistance5,
         PrismFaceDistance6,
         Enabled,
+        TiltDistributionTable,
+        RotationDistributionTable,
+        CaRatioDistributionTable,
+        UpperApexHeightDistributionTable,
+        LowerApexHeightDistributionTable,
+        CustomShape,
+        CrystalSize,
         NUM_COLUMNS
     };
 
@@ -58,9 +65,18 @@ public:
     bool removeRow(int row);
     void clear();
     void setName(int row, QString name);
+    void setDistributionTable(int row, TabulatedParameter parameter, TabulatedDistribution table);
+    void setCustomShape(int row, ConvexPolyhedron shape);
+    const ConvexPolyhedron &getCustomShape(int row) const;
+
+    /* Batches row changes into one model reset at the end of the outermost
+       batch, so views and the simulation react to them only once */
+    void beginUpdate();
+    void endUpdate();
 
 private:
     std::shared_ptr<CrystalPopulationRepository> m_crystals;
+    int m_updateDepth;
 };
 
 }
@@ -1,4 +1,6 @@
 #include "simulationStateModel.h"
+#include <QTimer>
+#include <stdexcept>
 #include "simulation/atmosphere.h"
 #include "simulation/camera.h"
 #include "simulation/lightSource.h"
@@ -10,9 +12,16 @@ namespace HaloRay
 SimulationStateModel::SimulationStateModel(SimulationEngine *engine, QObject *parent)
     : QAbstractTableModel(parent),
       m_simulationEngine(engine),
+      m_editTimer(new QTimer(this)),
+      m_editBatchOpen(false),
+      m_updateDepth(0),
       m_maximumIterations(600),
       m_raysPerFrameUpperLimit(50000000)
 {
+    m_editTimer->setSingleShot(true);
+    m_editTimer->setInterval(editDebounceInterval);
+    connect(m_editTimer, &QTimer::timeout, this, &SimulationStateModel::endEditBatch);
+
     connect(m_simulationEngine, &SimulationEngine::cameraChanged, [this]() {
         emit dataChanged(createIndex(0, CameraProjection), createIndex(0, HideSubHorizon));
     });
@@ -36,6 +45,58 @@ SimulationStateModel::SimulationStateModel(SimulationEngine *engine, QObject *pa
     connect(m_simulationEngine, &SimulationEngine::atmosphereChanged, [this]() {
         emit dataChanged(createIndex(0, AtmosphereEnabled), createIndex(0, GroundAlbedo));
     });
+
+    connect(m_simulationEngine, &SimulationEngine::russianRouletteDepthChanged, [this]() {
+        emit dataChanged(createIndex(0, RussianRouletteDepth), createIndex(0, RussianRouletteDepth));
+    });
+
+    connect(m_simulationEngine, &SimulationEngine::quasiRandomSamplingChanged, [this]() {
+        emit dataChanged(createIndex(0, QuasiRandomSampling), createIndex(0, QuasiRandomSampling));
+    });
+
+    connect(m_simulationEngine, &SimulationEngine::runSeedChanged, [this]() {
+        emit dataChanged(createIndex(0, RunSeed), createIndex(0, RunSeed));
+    });
+
+    connect(m_simulationEngine, &SimulationEngine::transferTablesEnabledChanged, [this]() {
+        emit dataChanged(createIndex(0, TransferTables), createIndex(0, TransferTables));
+    });
+
+    connect(m_simulationEngine, &SimulationEngine::sampleReweightingEnabledChanged, [this]() {
+        emit dataChanged(createIndex(0, SampleReweighting), createIndex(0, SampleReweighting));
+    });
+
+    connect(m_simulationEngine, &SimulationEngine::maxScatteringOrdersChanged, [this]() {
+        emit dataChanged(createIndex(0, MaxScatteringOrders), createIndex(0, MaxScatteringOrders));
+    });
+
+    connect(m_simulationEngine, &SimulationEngine::sunConvolutionEnabledChanged, [this]() {
+        emit dataChanged(createIndex(0, SunConvolution), createIndex(0, SunConvolution));
+    });
+
+    connect(m_simulationEngine, &SimulationEngine::pathGuidingEnabledChanged, [this]() {
+        emit dataChanged(createIndex(0, PathGuiding), createIndex(0, PathGuiding));
+    });
+
+    connect(m_simulationEngine, &SimulationEngine::adaptiveRayAllocationEnabledChanged, [this]() {
+        emit dataChanged(createIndex(0, AdaptiveRayAllocation), createIndex(0, AdaptiveRayAllocation));
+    });
+
+    connect(m_simulationEngine, &SimulationEngine::wavefrontTracingEnabledChanged, [this]() {
+        emit dataChanged(createIndex(0, WavefrontTracing), createIndex(0, WavefrontTracing));
+    });
+
+    connect(m_simulationEngine, &SimulationEngine::hybridTracingEnabledChanged, [this]() {
+        emit dataChanged(createIndex(0, HybridTracing), createIndex(0, HybridTracing));
+    });
+
+    connect(m_simulationEngine, &SimulationEngine::splatFilterChanged, [this]() {
+        emit dataChanged(createIndex(0, SplatFilter), createIndex(0, SplatFilterRadius));
+    });
+
+    connect(m_simulationEngine, &SimulationEngine::monochromeChanged, [this]() {
+        emit dataChanged(createIndex(0, Monochrome), createIndex(0, Monochrome));
+    });
 }
 
 QVariant SimulationStateModel::headerData(int section, Qt::Orientation orientation, int role) const
@@ -74,6 +135,34 @@ QVariant SimulationStateModel::headerData(int section, Qt::Orientation orientati
             return "Atmosphere turbidity";
         case GroundAlbedo:
             return "Ground albedo";
+        case RussianRouletteDepth:
+            return "Russian roulette depth";
+        case QuasiRandomSampling:
+            return "Quasi-random sampling";
+        case RunSeed:
+            return "Random seed";
+        case TransferTables:
+            return "Crystal transfer tables";
+        case SampleReweighting:
+            return "Sample reweighting";
+        case MaxScatteringOrders:
+            return "Maximum scattering orders";
+        case SunConvolution:
+            return "Sun disk convolution";
+        case PathGuiding:
+            return "Path guiding";
+        case AdaptiveRayAllocation:
+            return "Adaptive ray allocation";
+        case WavefrontTracing:
+            return "Wavefront tracing";
+        case HybridTracing:
+            return "Hybrid CPU tracing";
+        case SplatFilter:
+            return "Splat filter";
+        case SplatFilterRadius:
+            return "Splat filter radius";
+        case Monochrome:
+            return "Monochrome";
         }
     }
 
@@ -134,6 +223,34 @@ QVariant SimulationStateModel::data(const QModelIndex &index, int role) const
         return m_simulationEngine->getAtmosphere().turbidity;
     case GroundAlbedo:
         return m_simulationEngine->getAtmosphere().groundAlbedo;
+    case RussianRouletteDepth:
+        return m_simulationEngine->getRussianRouletteDepth();
+    case QuasiRandomSampling:
+        return m_simulationEngine->isQuasiRandomSampling();
+    case RunSeed:
+        return m_simulationEngine->getRunSeed();
+    case TransferTables:
+        return m_simulationEngine->isTransferTablesEnabled();
+    case SampleReweighting:
+        return m_simulationEngine->isSampleReweightingEnabled();
+    case MaxScatteringOrders:
+        return m_simulationEngine->getMaxScatteringOrders();
+    case SunConvolution:
+        return m_simulationEngine->isSunConvolutionEnabled();
+    case PathGuiding:
+        return m_simulationEngine->isPathGuidingEnabled();
+    case AdaptiveRayAllocation:
+        return m_simulationEngine->isAdaptiveRayAllocationEnabled();
+    case WavefrontTracing:
+        return m_simulationEngine->isWavefrontTracingEnabled();
+    case HybridTracing:
+        return m_simulationEngine->isHybridTracingEnabled();
+    case SplatFilter:
+        return m_simulationEngine->getSplatFilter().type;
+    case SplatFilterRadius:
+        return m_simulationEngine->getSplatFilter().radius;
+    case Monochrome:
+        return m_simulationEngine->isMonochrome();
     default:
         break;
     }
@@ -147,6 +264,17 @@ bool SimulationStateModel::setData(const QModelIndex &index, const QVariant &val
 
     if (data(index, role) == value) return false;
 
+    // Explicit batches are applied when they end, so only other edits are debounced
+    if (m_updateDepth == 0)
+    {
+        if (!m_editBatchOpen)
+        {
+            m_editBatchOpen = true;
+            m_simulationEngine->beginUpdate();
+        }
+        m_editTimer->start();
+    }
+
     switch (index.column())
     {
     case SunAltitude:
@@ -191,6 +319,56 @@ bool SimulationStateModel::setData(const QModelIndex &index, const QVariant &val
     case GroundAlbedo:
         setGroundAlbedo(value.toDouble());
         break;
+    case RussianRouletteDepth:
+        m_simulationEngine->setRussianRouletteDepth(value.toInt());
+        break;
+    case QuasiRandomSampling:
+        m_simulationEngine->setQuasiRandomSampling(value.toBool());
+        break;
+    case RunSeed:
+        m_simulationEngine->setRunSeed(value.toUInt());
+        break;
+    case TransferTables:
+        m_simulationEngine->setTransferTablesEnabled(value.toBool());
+        break;
+    case SampleReweighting:
+        m_simulationEngine->setSampleReweightingEnabled(value.toBool());
+        break;
+    case MaxScatteringOrders:
+        m_simulationEngine->setMaxScatteringOrders(value.toInt());
+        break;
+    case SunConvolution:
+        m_simulationEngine->setSunConvolutionEnabled(value.toBool());
+        break;
+    case PathGuiding:
+        m_simulationEngine->setPathGuidingEnabled(value.toBool());
+        break;
+    case AdaptiveRayAllocation:
+        m_simulationEngine->setAdaptiveRayAllocationEnabled(value.toBool());
+        break;
+    case WavefrontTracing:
+        m_simulationEngine->setWavefrontTracingEnabled(value.toBool());
+        break;
+    case HybridTracing:
+        m_simulationEngine->setHybridTracingEnabled(value.toBool());
+        break;
+    case Monochrome:
+        m_simulationEngine->setMonochrome(value.toBool());
+        break;
+    case SplatFilter:
+    {
+        auto filter = m_simulationEngine->getSplatFilter();
+        filter.type = value.toInt();
+        m_simulationEngine->setSplatFilter(filter);
+        break;
+    }
+    case SplatFilterRadius:
+    {
+        auto filter = m_simulationEngine->getSplatFilter();
+        filter.radius = value.toFloat();
+        m_simulationEngine->setSplatFilter(filter);
+        break;
+    }
     default:
         return false;
     }
@@ -210,14 +388,61 @@ Qt::ItemFlags SimulationStateModel::flags(const QModelIndex &index) const
     return Qt::ItemIsEditable | Qt::ItemIsEnabled;
 }
 
+void SimulationStateModel::beginUpdate()
+{
+    ++m_updateDepth;
+    m_simulationEngine->beginUpdate();
+    endEditBatch();
+}
+
+void SimulationStateModel::endUpdate()
+{
+    if (m_updateDepth == 0)
+        throw std::runtime_error("Ending an update that was not begun");
+
+    --m_updateDepth;
+    m_simulationEngine->endUpdate();
+}
+
+void SimulationStateModel::endEditBatch()
+{
+    if (!m_editBatchOpen)
+        return;
+
+    m_editTimer->stop();
+    m_editBatchOpen = false;
+    m_simulationEngine->endUpdate();
+}
+
 void SimulationStateModel::setRaysPerFrame(unsigned int maxRaysPerFrame)
 {
+    beginUpdate();
     setData(index(0, RaysPerFrame), maxRaysPerFrame);
+    endUpdate();
+}
+
+void SimulationStateModel::setRunSeed(unsigned int seed)
+{
+    beginUpdate();
+    setData(index(0, RunSeed), seed);
+    endUpdate();
+}
+
+void SimulationStateModel::setOutputViews(std::vector<OutputView> views)
+{
+    m_simulationEngine->setOutputViews(std::move(views));
+}
+
+void SimulationStateModel::setSplatFilter(Kernels::SplatFilter filter)
+{
+    m_simulationEngine->setSplatFilter(filter);
 }
 
 void SimulationStateModel::setRaysPerFrameUpperLimit(unsigned int upperLimit)
 {
+    beginUpdate();
     setData(index(0, RaysPerFrameUpperLimit), upperLimit);
+    endUpdate();
 }
 
 unsigned int SimulationStateModel::getRaysPerFrameUpperLimit() const
@@ -1,7 +1,12 @@
 #pragma once
 
 #include <QAbstractTableModel>
+#include <vector>
 #include "simulation/camera.h"
+#include "simulation/outputView.h"
+#include "splatFilter.h"
+
+class QTimer;
 
 namespace HaloRay {
 class SimulationEngine;
@@ -33,6 +38,20 @@ public:
         AtmosphereEnabled,
         Turbidity,
         GroundAlbedo,
+        RussianRouletteDepth,
+        QuasiRandomSampling,
+        RunSeed,
+        TransferTables,
+        SampleReweighting,
+        MaxScatteringOrders,
+        SunConvolution,
+        PathGuiding,
+        AdaptiveRayAllocation,
+        WavefrontTracing,
+        HybridTracing,
+        SplatFilter,
+        SplatFilterRadius,
+        Monochrome,
         NUM_COLUMNS
     };
 
@@ -57,9 +76,26 @@ public:
     void setLightSource(LightSource lightSource);
     void setCamera(Camera camera);
     void setAtmosphere(Atmosphere atmosphere);
+    void setRunSeed(unsigned int seed);
+    void setOutputViews(std::vector<OutputView> views);
+    void setSplatFilter(Kernels::SplatFilter filter);
+
+    /* Batches changes, so that the simulation is cleared at most once when
+       the outermost batch ends. Edits waiting for the debounce are applied
+       with the batch, so the simulation is up to date when it ends. */
+    void beginUpdate();
+    void endUpdate();
 
 private:
     SimulationEngine *m_simulationEngine;
+
+    /* Edits outside of batches, e.g. from a dragged slider, are collected
+       until none has arrived for this many milliseconds */
+    static const int editDebounceInterval = 50;
+    QTimer *m_editTimer;
+    bool m_editBatchOpen;
+    int m_updateDepth;
+    void endEditBatch();
     void setSunAltitude(float altitude);
     void setSunDiameter(float diameter);
     void setCameraProjection(Projection projection);
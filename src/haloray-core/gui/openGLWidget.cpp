@@ -9,6 +9,7 @@
 #include "simulation/camera.h"
 #include "simulation/lightSource.h"
 #include "simulation/crystalPopulation.h"
+#include "simulation/autoExposure.h"
 
 namespace HaloRay
 {
@@ -19,6 +20,12 @@ OpenGLWidget::OpenGLWidget(SimulationEngine *engine, SimulationStateModel *viewM
       m_dragging(false),
       m_previousDragPoint(QPoint(0, 0)),
       m_exposure(1.0f),
+      m_denoisingEnabled(true),
+      m_denoisingSuppressed(false),
+      m_autoExposureEnabled(false),
+      m_autoExposureKeyValue(AutoExposure::defaultKeyValue),
+      m_autoExposureHighlightPercentile(AutoExposure::defaultHighlightPercentile),
+      m_autoExposureIteration(-1),
       m_viewModel(viewModel)
 {
     setSizePolicy(QSizePolicy::MinimumExpanding, QSizePolicy::MinimumExpanding);
@@ -26,14 +33,19 @@ OpenGLWidget::OpenGLWidget(SimulationEngine *engine, SimulationStateModel *viewM
     connect(m_viewModel, &SimulationStateModel::dataChanged, [this]() {
         update();
     });
+    connect(m_engine, &SimulationEngine::cleared, [this]() {
+        update();
+    });
 }
 
 void OpenGLWidget::toggleRendering()
 {
+    makeCurrent();
     if (m_engine->isRunning())
         m_engine->stop();
     else
         m_engine->start();
+    doneCurrent();
     update();
 }
 
@@ -45,9 +57,14 @@ void OpenGLWidget::paintGL()
         emit nextIteration(m_engine->getIteration());
         update();
     }
-    const float adjustedExposure = 500000.0f * m_exposure / (m_engine->getIteration() + 1) / (m_engine->getCamera().fov / 180.0) / m_engine->getRaysPerStep();
+    const float exposureNormalization = 500000.0f / (m_engine->getIteration() + 1) / (m_engine->getCamera().fov / 180.0) / m_engine->getRaysPerStep();
+    if (m_autoExposureEnabled)
+        updateAutoExposure(exposureNormalization);
+    const float adjustedExposure = m_exposure * exposureNormalization;
     m_textureRenderer->setUniformFloat("adjustedExposure", adjustedExposure);
     m_textureRenderer->setUniformFloat("baseExposure", m_exposure);
+    m_textureRenderer->setDenoiseBlend(getDenoiseBlend());
+    m_textureRenderer->setSecondMomentTexture(m_engine->getSecondMomentTextureHandle());
     m_textureRenderer->render(m_engine->getOutputTextureHandle(), m_engine->getBackgroundTextureHandle());
 }
 
@@ -62,6 +79,7 @@ void OpenGLWidget::initializeGL()
     initializeOpenGLFunctions();
 
     m_textureRenderer = std::make_unique<OpenGL::TextureRenderer>();
+    m_luminanceHistogram = std::make_unique<OpenGL::LuminanceHistogram>();
 
     glClearColor(0.0, 0.0, 0.0, 1.0);
     glClear(GL_COLOR_BUFFER_BIT);
@@ -170,6 +188,76 @@ void OpenGLWidget::setBrightness(double brightness)
     update();
 }
 
+double OpenGLWidget::getBrightness() const
+{
+    return m_exposure;
+}
+
+void OpenGLWidget::setDenoisingEnabled(bool enabled)
+{
+    m_denoisingEnabled = enabled;
+    update();
+}
+
+/* Denoising only helps while there are few rays in each pixel, so it fades
+   out linearly as they accumulate */
+float OpenGLWidget::getDenoiseBlend() const
+{
+    if (!m_denoisingEnabled || m_denoisingSuppressed)
+        return 0.0f;
+    const double fadeRaysPerPixel = 64.0;
+    const double pixelCount = std::max(1.0, static_cast<double>(m_engine->getOutputWidth()) * m_engine->getOutputHeight());
+    const double raysPerPixel = (m_engine->getIteration() + 1.0) * m_engine->getRaysPerStep() / pixelCount;
+    return static_cast<float>(std::max(0.0, 1.0 - raysPerPixel / fadeRaysPerPixel));
+}
+
+void OpenGLWidget::setAutoExposure(bool enabled, double keyValue, double highlightPercentile)
+{
+    m_autoExposureEnabled = enabled;
+    m_autoExposureKeyValue = keyValue;
+    m_autoExposureHighlightPercentile = highlightPercentile;
+    m_autoExposureIteration = -1;
+    update();
+}
+
+/* The luminance statistics of the halos are gathered on the GPU every few
+   iterations, and the brightness follows them once they are ready */
+void OpenGLWidget::updateAutoExposure(float exposureNormalization)
+{
+    LuminanceStatistics statistics;
+    if (m_luminanceHistogram->getStatistics(statistics))
+    {
+        auto targetBrightness = AutoExposure::getTargetBrightness(statistics, m_autoExposureKeyValue, m_exposure);
+        auto brightness = static_cast<float>(AutoExposure::adapt(m_exposure, targetBrightness, 0.5));
+        if (brightness != m_exposure)
+        {
+            m_exposure = brightness;
+            emit brightnessChanged(m_exposure);
+        }
+    }
+
+    const int measurementInterval = 4;
+    const int iteration = static_cast<int>(m_engine->getIteration());
+    const bool measurementDue = m_autoExposureIteration < 0 || iteration < m_autoExposureIteration || iteration >= m_autoExposureIteration + measurementInterval;
+    if (measurementDue && !m_luminanceHistogram->isPending())
+    {
+        m_luminanceHistogram->update(m_engine->getOutputTextureHandle(), 0.1f * exposureNormalization, static_cast<float>(m_autoExposureHighlightPercentile));
+        m_autoExposureIteration = iteration;
+    }
+
+    // Keep painting until the statistics arrive, even when the simulation is stopped
+    if (m_luminanceHistogram->isPending())
+        update();
+}
+
+QImage OpenGLWidget::grabRawFramebuffer()
+{
+    m_denoisingSuppressed = true;
+    auto image = grabFramebuffer();
+    m_denoisingSuppressed = false;
+    return image;
+}
+
 QSize OpenGLWidget::sizeHint() const
 {
     return QSize(800, 600);
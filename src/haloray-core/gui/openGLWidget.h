@@ -4,6 +4,7 @@
 #include <QOpenGLFunctions_4_4_Core>
 #include <memory>
 #include "opengl/textureRenderer.h"
+#include "opengl/luminanceHistogram.h"
 
 
 class QMouseEvent;
@@ -24,15 +25,22 @@ public:
     explicit OpenGLWidget(SimulationEngine *engine, SimulationStateModel *viewModel, QWidget *parent = nullptr);
     QSize sizeHint() const override;
     QSize minimumSizeHint() const override;
+    double getBrightness() const;
+
+    // Grabs the displayed image without denoising, for saving
+    QImage grabRawFramebuffer();
 
 public slots:
     void toggleRendering();
     void setBrightness(double brightness);
+    void setDenoisingEnabled(bool enabled);
+    void setAutoExposure(bool enabled, double keyValue, double highlightPercentile);
 
 signals:
     void fieldOfViewChanged(double fieldOfView);
     void cameraOrientationChanged(double pitch, double yaw);
     void nextIteration(unsigned int iteration);
+    void brightnessChanged(double brightness);
 
 protected:
     void paintGL() override;
@@ -46,11 +54,21 @@ protected:
     void wheelEvent(QWheelEvent *event) override;
 
 private:
+    float getDenoiseBlend() const;
+    void updateAutoExposure(float exposureNormalization);
+
     SimulationEngine  *m_engine;
     std::unique_ptr<OpenGL::TextureRenderer> m_textureRenderer;
+    std::unique_ptr<OpenGL::LuminanceHistogram> m_luminanceHistogram;
     bool m_dragging;
     QPoint m_previousDragPoint;
     float m_exposure;
+    bool m_denoisingEnabled;
+    bool m_denoisingSuppressed;
+    bool m_autoExposureEnabled;
+    double m_autoExposureKeyValue;
+    double m_autoExposureHighlightPercentile;
+    int m_autoExposureIteration;
     SimulationStateModel *m_viewModel;
 };
 
@@ -0,0 +1,88 @@
+#include "scatteringTableDialog.h"
+#include <QDialogButtonBox>
+#include <QDoubleSpinBox>
+#include <QFormLayout>
+#include <QSpinBox>
+#include <QVBoxLayout>
+#include <algorithm>
+
+namespace HaloRay
+{
+
+ScatteringTableDialog::ScatteringTableDialog(float currentAltitude, QWidget *parent)
+    : QDialog(parent)
+{
+    setupUi(currentAltitude);
+
+    // Keep the altitude range valid
+    connect(m_minAltitudeSpinBox, QOverload<double>::of(&QDoubleSpinBox::valueChanged), [this](double value) {
+        if (m_maxAltitudeSpinBox->value() < value)
+            m_maxAltitudeSpinBox->setValue(value);
+    });
+    connect(m_maxAltitudeSpinBox, QOverload<double>::of(&QDoubleSpinBox::valueChanged), [this](double value) {
+        if (m_minAltitudeSpinBox->value() > value)
+            m_minAltitudeSpinBox->setValue(value);
+    });
+}
+
+void ScatteringTableDialog::setupUi(float currentAltitude)
+{
+    setWindowTitle(tr("Build scattering table"));
+
+    m_minAltitudeSpinBox = new QDoubleSpinBox();
+    m_minAltitudeSpinBox->setRange(-90.0, 90.0);
+    m_minAltitudeSpinBox->setSuffix("°");
+    m_minAltitudeSpinBox->setValue(std::max(-90.0f, currentAltitude - 10.0f));
+
+    m_maxAltitudeSpinBox = new QDoubleSpinBox();
+    m_maxAltitudeSpinBox->setRange(-90.0, 90.0);
+    m_maxAltitudeSpinBox->setSuffix("°");
+    m_maxAltitudeSpinBox->setValue(std::min(90.0f, currentAltitude + 10.0f));
+
+    m_altitudeStepSpinBox = new QDoubleSpinBox();
+    m_altitudeStepSpinBox->setRange(0.1, 10.0);
+    m_altitudeStepSpinBox->setSingleStep(0.1);
+    m_altitudeStepSpinBox->setSuffix("°");
+    m_altitudeStepSpinBox->setValue(1.0);
+
+    m_raysPerAltitudeSpinBox = new QSpinBox();
+    m_raysPerAltitudeSpinBox->setRange(1, 1000);
+    m_raysPerAltitudeSpinBox->setSuffix(tr(" million"));
+    m_raysPerAltitudeSpinBox->setValue(20);
+
+    auto buttons = new QDialogButtonBox(QDialogButtonBox::Ok | QDialogButtonBox::Cancel);
+    connect(buttons, &QDialogButtonBox::accepted, this, &QDialog::accept);
+    connect(buttons, &QDialogButtonBox::rejected, this, &QDialog::reject);
+
+    auto formLayout = new QFormLayout();
+    formLayout->addRow(tr("Lowest sun altitude"), m_minAltitudeSpinBox);
+    formLayout->addRow(tr("Highest sun altitude"), m_maxAltitudeSpinBox);
+    formLayout->addRow(tr("Altitude step"), m_altitudeStepSpinBox);
+    formLayout->addRow(tr("Rays per altitude"), m_raysPerAltitudeSpinBox);
+
+    auto layout = new QVBoxLayout(this);
+    layout->addLayout(formLayout);
+    layout->addWidget(buttons);
+}
+
+float ScatteringTableDialog::getMinAltitude() const
+{
+    return static_cast<float>(m_minAltitudeSpinBox->value());
+}
+
+float ScatteringTableDialog::getMaxAltitude() const
+{
+    return static_cast<float>(m_maxAltitudeSpinBox->value());
+}
+
+float ScatteringTableDialog::getAltitudeStep() const
+{
+    return static_cast<float>(m_altitudeStepSpinBox->value());
+}
+
+unsigned long long ScatteringTableDialog::getRaysPerAltitude() const
+{
+    return static_cast<unsigned long long>(m_raysPerAltitudeSpinBox->value()) * 1000000ull;
+}
+
+}
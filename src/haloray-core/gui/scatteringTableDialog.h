@@ -0,0 +1,32 @@
+#pragma once
+#include <QDialog>
+
+class QDoubleSpinBox;
+class QSpinBox;
+
+namespace HaloRay
+{
+
+/* Asks for the sun altitude range and the number of rays for building
+   a scattering table */
+class ScatteringTableDialog : public QDialog
+{
+    Q_OBJECT
+public:
+    ScatteringTableDialog(float currentAltitude, QWidget *parent = nullptr);
+
+    float getMinAltitude() const;
+    float getMaxAltitude() const;
+    float getAltitudeStep() const;
+    unsigned long long getRaysPerAltitude() const;
+
+private:
+    void setupUi(float currentAltitude);
+
+    QDoubleSpinBox *m_minAltitudeSpinBox;
+    QDoubleSpinBox *m_maxAltitudeSpinBox;
+    QDoubleSpinBox *m_altitudeStepSpinBox;
+    QSpinBox *m_raysPerAltitudeSpinBox;
+};
+
+}
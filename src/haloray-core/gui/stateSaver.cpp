@@ -2,6 +2,8 @@
 #include <QtGlobal>
 #include <QString>
 #include <QSettings>
+#include <vector>
+#include <stdexcept>
 #include "gui/models/simulationStateModel.h"
 #include "gui/models/crystalModel.h"
 #include "simulation/simulationEngine.h"
@@ -10,6 +12,41 @@
 namespace HaloRay
 {
 
+namespace
+{
+
+const char *distributionTableKeys[NUM_TABULATED_PARAMETERS] = {
+    "TiltTable",
+    "RotationTable",
+    "CaRatioTable",
+    "UpperApexHeightTable",
+    "LowerApexHeightTable"};
+
+// Keeps a batch of changes to a model open until the end of the scope
+template <typename Model>
+class UpdateBatch
+{
+public:
+    explicit UpdateBatch(Model *model)
+        : m_model(model)
+    {
+        m_model->beginUpdate();
+    }
+
+    ~UpdateBatch()
+    {
+        m_model->endUpdate();
+    }
+
+    UpdateBatch(const UpdateBatch &) = delete;
+    UpdateBatch &operator=(const UpdateBatch &) = delete;
+
+private:
+    Model *m_model;
+};
+
+}
+
 void StateSaver::SaveState(QString filename, SimulationEngine *engine, CrystalPopulationRepository *crystals)
 {
     qInfo("Saving simulation state to: %s", filename.toUtf8().constData());
@@ -51,6 +88,8 @@ void StateSaver::SaveState(QString filename, SimulationEngine *engine, CrystalPo
         settings.setValue("LowerApexHeightAverage", (double)population.lowerApexHeightAverage);
         settings.setValue("LowerApexHeightStd", (double)population.lowerApexHeightStd);
 
+        settings.setValue("CrystalSize", (double)population.crystalSize);
+
         settings.beginWriteArray("PrismFaceDistances");
         for (auto prismFaceIndex = 0u; prismFaceIndex < 6; ++prismFaceIndex)
         {
@@ -58,6 +97,37 @@ void StateSaver::SaveState(QString filename, SimulationEngine *engine, CrystalPo
             settings.setValue("Average", (double)population.prismFaceDistances[prismFaceIndex]);
         }
         settings.endArray();
+
+        for (auto parameter = 0u; parameter < NUM_TABULATED_PARAMETERS; ++parameter)
+        {
+            const auto &table = population.distributionTables[parameter];
+            if (table.isEmpty()) continue;
+
+            settings.beginWriteArray(distributionTableKeys[parameter]);
+            for (auto bin = 0u; bin < table.getBinCount(); ++bin)
+            {
+                settings.setArrayIndex(bin);
+                settings.setValue("LowerEdge", (double)table.getBinEdges()[bin]);
+                settings.setValue("UpperEdge", (double)table.getBinEdges()[bin + 1]);
+                settings.setValue("Weight", (double)table.getWeights()[bin]);
+            }
+            settings.endArray();
+        }
+
+        if (!population.customShape.isEmpty())
+        {
+            const auto &planes = population.customShape.getPlanes();
+            settings.beginWriteArray("CustomShape");
+            for (auto planeIndex = 0u; planeIndex < planes.size(); ++planeIndex)
+            {
+                settings.setArrayIndex(planeIndex);
+                settings.setValue("NormalX", planes[planeIndex].normal[0]);
+                settings.setValue("NormalY", planes[planeIndex].normal[1]);
+                settings.setValue("NormalZ", planes[planeIndex].normal[2]);
+                settings.setValue("Distance", planes[planeIndex].distance);
+            }
+            settings.endArray();
+        }
     }
     settings.endArray();
     settings.endGroup();
@@ -69,6 +139,27 @@ void StateSaver::SaveState(QString filename, SimulationEngine *engine, CrystalPo
     settings.setValue("Yaw", (double)camera.yaw);
     settings.setValue("FieldOfView", (double)camera.fov);
     settings.setValue("HideSubHorizon", camera.hideSubHorizon);
+    auto splatFilter = engine->getSplatFilter();
+    settings.setValue("SplatFilter", splatFilter.type);
+    settings.setValue("SplatFilterRadius", (double)splatFilter.radius);
+    settings.endGroup();
+
+    settings.beginGroup("OutputViews");
+    settings.beginWriteArray("view");
+    const auto &outputViews = engine->getOutputViews();
+    for (auto viewIndex = 0u; viewIndex < outputViews.size(); ++viewIndex)
+    {
+        settings.setArrayIndex(viewIndex);
+        const auto &view = outputViews[viewIndex];
+        settings.setValue("Width", view.width);
+        settings.setValue("Height", view.height);
+        settings.setValue("Projection", (double)view.camera.projection);
+        settings.setValue("Pitch", (double)view.camera.pitch);
+        settings.setValue("Yaw", (double)view.camera.yaw);
+        settings.setValue("FieldOfView", (double)view.camera.fov);
+        settings.setValue("HideSubHorizon", view.camera.hideSubHorizon);
+    }
+    settings.endArray();
     settings.endGroup();
 
     settings.beginGroup("Atmosphere");
@@ -77,6 +168,10 @@ void StateSaver::SaveState(QString filename, SimulationEngine *engine, CrystalPo
     settings.setValue("Turbidity", atmosphere.turbidity);
     settings.setValue("GroundAlbedo", atmosphere.groundAlbedo);
     settings.endGroup();
+
+    settings.beginGroup("Simulation");
+    settings.setValue("RunSeed", engine->getRunSeed());
+    settings.endGroup();
     qInfo("Finished saving simulation state");
 }
 
@@ -85,6 +180,12 @@ void StateSaver::LoadState(QString filename, SimulationStateModel *simState, Cry
     qInfo("Loading simulation state from: %s", filename.toUtf8().constData());
     QSettings settings(filename, QSettings::Format::IniFormat);
 
+    /* Every loaded setting would otherwise clear the simulation on its own.
+       The crystal batch ends first, so that the restart it causes also
+       falls within the simulation batch. */
+    UpdateBatch<SimulationStateModel> simulationBatch(simState);
+    UpdateBatch<CrystalModel> crystalBatch(crystalModel);
+
     auto lightSource = LightSource::createDefaultLightSource();
     lightSource.altitude = settings.value("LightSource/Altitude", lightSource.altitude).toFloat();
     lightSource.diameter = settings.value("LightSource/Diameter", lightSource.diameter).toFloat();
@@ -98,6 +199,18 @@ void StateSaver::LoadState(QString filename, SimulationStateModel *simState, Cry
     camera.hideSubHorizon = settings.value("Camera/HideSubHorizon", camera.hideSubHorizon).toBool();
     simState->setCamera(camera);
 
+    Kernels::SplatFilter splatFilter;
+    splatFilter.type = settings.value("Camera/SplatFilter", splatFilter.type).toInt();
+    splatFilter.radius = settings.value("Camera/SplatFilterRadius", splatFilter.radius).toFloat();
+    try
+    {
+        simState->setSplatFilter(splatFilter);
+    }
+    catch (const std::runtime_error &e)
+    {
+        qWarning("Ignoring invalid splat filter: %s", e.what());
+    }
+
     crystalModel->clear();
     auto crystalPopulationCount = settings.beginReadArray("CrystalPopulations/pop");
     for (auto popIndex = 0; popIndex < crystalPopulationCount; ++popIndex)
@@ -125,6 +238,8 @@ void StateSaver::LoadState(QString filename, SimulationStateModel *simState, Cry
         pop.lowerApexHeightAverage = settings.value("LowerApexHeightAverage", pop.lowerApexHeightAverage).toFloat();
         pop.lowerApexHeightStd = settings.value("LowerApexHeightStd", pop.lowerApexHeightStd).toFloat();
 
+        pop.crystalSize = settings.value("CrystalSize", pop.crystalSize).toFloat();
+
         auto name = settings.value("Name", "Default name").toString();
         double weight = settings.value("Weight", 1.0).toDouble();
 
@@ -136,6 +251,57 @@ void StateSaver::LoadState(QString filename, SimulationStateModel *simState, Cry
         }
         settings.endArray();
 
+        for (auto parameter = 0u; parameter < NUM_TABULATED_PARAMETERS; ++parameter)
+        {
+            auto binCount = settings.beginReadArray(distributionTableKeys[parameter]);
+            std::vector<float> binEdges;
+            std::vector<float> weights;
+            for (auto bin = 0; bin < binCount; ++bin)
+            {
+                settings.setArrayIndex(bin);
+                if (bin == 0)
+                    binEdges.push_back(settings.value("LowerEdge").toFloat());
+                binEdges.push_back(settings.value("UpperEdge").toFloat());
+                weights.push_back(settings.value("Weight").toFloat());
+            }
+            settings.endArray();
+
+            if (binCount == 0) continue;
+
+            try
+            {
+                pop.distributionTables[parameter] = TabulatedDistribution(binEdges, weights);
+            }
+            catch (const std::runtime_error &e)
+            {
+                qWarning("Ignoring invalid %s: %s", distributionTableKeys[parameter], e.what());
+            }
+        }
+
+        auto planeCount = settings.beginReadArray("CustomShape");
+        std::vector<CrystalPlane> planes;
+        for (auto planeIndex = 0; planeIndex < planeCount; ++planeIndex)
+        {
+            settings.setArrayIndex(planeIndex);
+            planes.push_back({{settings.value("NormalX").toDouble(),
+                               settings.value("NormalY").toDouble(),
+                               settings.value("NormalZ").toDouble()},
+                              settings.value("Distance").toDouble()});
+        }
+        settings.endArray();
+
+        if (planeCount > 0)
+        {
+            try
+            {
+                pop.customShape = ConvexPolyhedron::fromPlanes(planes);
+            }
+            catch (const std::runtime_error &e)
+            {
+                qWarning("Ignoring invalid custom crystal shape: %s", e.what());
+            }
+        }
+
         crystalModel->addRow(pop, weight, name);
     }
     settings.endArray();
@@ -145,6 +311,34 @@ void StateSaver::LoadState(QString filename, SimulationStateModel *simState, Cry
     atmosphere.turbidity = settings.value("Atmosphere/Turbidity", atmosphere.turbidity).toDouble();
     atmosphere.groundAlbedo = settings.value("Atmosphere/GroundAlbedo", atmosphere.groundAlbedo).toDouble();
     simState->setAtmosphere(atmosphere);
+
+    std::vector<OutputView> outputViews;
+    auto outputViewCount = settings.beginReadArray("OutputViews/view");
+    for (auto viewIndex = 0; viewIndex < outputViewCount; ++viewIndex)
+    {
+        settings.setArrayIndex(viewIndex);
+        OutputView view;
+        view.width = settings.value("Width", view.width).toUInt();
+        view.height = settings.value("Height", view.height).toUInt();
+        view.camera.projection = (Projection)settings.value("Projection", view.camera.projection).toInt();
+        view.camera.pitch = settings.value("Pitch", view.camera.pitch).toFloat();
+        view.camera.yaw = settings.value("Yaw", view.camera.yaw).toFloat();
+        view.camera.fov = settings.value("FieldOfView", view.camera.fov).toFloat();
+        view.camera.hideSubHorizon = settings.value("HideSubHorizon", view.camera.hideSubHorizon).toBool();
+        outputViews.push_back(view);
+    }
+    settings.endArray();
+    try
+    {
+        simState->setOutputViews(outputViews);
+    }
+    catch (const std::runtime_error &e)
+    {
+        qWarning("Ignoring invalid output views: %s", e.what());
+    }
+
+    if (settings.contains("Simulation/RunSeed"))
+        simState->setRunSeed(settings.value("Simulation/RunSeed").toUInt());
     qInfo("Finished loading simulation state");
 }
 
@@ -2,10 +2,13 @@
 #include <QFormLayout>
 #include <QComboBox>
 #include <QCheckBox>
+#include <QDoubleSpinBox>
 #include <QDataWidgetMapper>
 #include "models/simulationStateModel.h"
 #include "components/sliderSpinBox.h"
 #include "simulation/camera.h"
+#include "simulation/autoExposure.h"
+#include "splatFilter.h"
 
 namespace HaloRay
 {
@@ -24,6 +27,8 @@ ViewSettingsWidget::ViewSettingsWidget(SimulationStateModel *viewModel, QWidget
     m_mapper->addMapping(m_pitchSlider, SimulationStateModel::CameraPitch);
     m_mapper->addMapping(m_yawSlider, SimulationStateModel::CameraYaw);
     m_mapper->addMapping(m_hideSubHorizonCheckBox, SimulationStateModel::HideSubHorizon);
+    m_mapper->addMapping(m_splatFilterComboBox, SimulationStateModel::SplatFilter, "currentIndex");
+    m_mapper->addMapping(m_splatFilterRadiusSpinBox, SimulationStateModel::SplatFilterRadius);
     m_mapper->toFirst();
 
     connect(m_cameraProjectionComboBox, QOverload<int>::of(&QComboBox::currentIndexChanged), m_mapper, &QDataWidgetMapper::submit, Qt::QueuedConnection);
@@ -31,6 +36,15 @@ ViewSettingsWidget::ViewSettingsWidget(SimulationStateModel *viewModel, QWidget
     connect(m_pitchSlider, &SliderSpinBox::valueChanged, m_mapper, &QDataWidgetMapper::submit, Qt::QueuedConnection);
     connect(m_yawSlider, &SliderSpinBox::valueChanged, m_mapper, &QDataWidgetMapper::submit, Qt::QueuedConnection);
     connect(m_hideSubHorizonCheckBox, &QCheckBox::stateChanged, m_mapper, &QDataWidgetMapper::submit, Qt::QueuedConnection);
+    connect(m_splatFilterComboBox, QOverload<int>::of(&QComboBox::currentIndexChanged), m_mapper, &QDataWidgetMapper::submit, Qt::QueuedConnection);
+    connect(m_splatFilterRadiusSpinBox, QOverload<double>::of(&QDoubleSpinBox::valueChanged), m_mapper, &QDataWidgetMapper::submit, Qt::QueuedConnection);
+
+    // Only the tent and Gaussian filters have a radius
+    auto splatFilterRadiusHandler = [this](int index) {
+        m_splatFilterRadiusSpinBox->setEnabled(index == Kernels::SplatFilter::Tent || index == Kernels::SplatFilter::Gaussian);
+    };
+    connect(m_splatFilterComboBox, QOverload<int>::of(&QComboBox::currentIndexChanged), splatFilterRadiusHandler);
+    splatFilterRadiusHandler(m_splatFilterComboBox->currentIndex());
 
     /*
      * It is not possible to map multiple model columns to different properties
@@ -44,6 +58,21 @@ ViewSettingsWidget::ViewSettingsWidget(SimulationStateModel *viewModel, QWidget
 
     connect(m_brightnessSlider, &SliderSpinBox::valueChanged, this, &ViewSettingsWidget::brightnessChanged);
     connect(m_lockToLightSource, &QCheckBox::stateChanged, this, &ViewSettingsWidget::lockToLightSource);
+    connect(m_denoisePreviewCheckBox, &QCheckBox::toggled, this, &ViewSettingsWidget::denoisingChanged);
+
+    // The brightness is set automatically while auto brightness is on
+    auto autoExposureHandler = [this]() {
+        auto enabled = m_autoBrightnessCheckBox->isChecked();
+        m_brightnessSlider->setEnabled(!enabled);
+        m_keyValueSpinBox->setEnabled(enabled);
+        m_highlightPercentileSpinBox->setEnabled(enabled);
+        emit autoExposureChanged(enabled, m_keyValueSpinBox->value(), m_highlightPercentileSpinBox->value() / 100.0);
+    };
+    connect(m_autoBrightnessCheckBox, &QCheckBox::toggled, autoExposureHandler);
+    connect(m_keyValueSpinBox, QOverload<double>::of(&QDoubleSpinBox::valueChanged), autoExposureHandler);
+    connect(m_highlightPercentileSpinBox, QOverload<double>::of(&QDoubleSpinBox::valueChanged), autoExposureHandler);
+    m_keyValueSpinBox->setEnabled(false);
+    m_highlightPercentileSpinBox->setEnabled(false);
 }
 
 void ViewSettingsWidget::setupUi()
@@ -68,18 +97,63 @@ void ViewSettingsWidget::setupUi()
     m_brightnessSlider->setMinimum(0.1);
     m_brightnessSlider->setMaximum(30.0);
 
+    m_autoBrightnessCheckBox = new QCheckBox();
+    m_autoBrightnessCheckBox->setToolTip(tr("Set the brightness from the luminance of the halos"));
+
+    m_keyValueSpinBox = new QDoubleSpinBox();
+    m_keyValueSpinBox->setMinimum(0.01);
+    m_keyValueSpinBox->setMaximum(1.0);
+    m_keyValueSpinBox->setSingleStep(0.01);
+    m_keyValueSpinBox->setValue(AutoExposure::defaultKeyValue);
+    m_keyValueSpinBox->setKeyboardTracking(false);
+    m_keyValueSpinBox->setToolTip(tr("Brightness of the average halo luminance, from black to white"));
+
+    m_highlightPercentileSpinBox = new QDoubleSpinBox();
+    m_highlightPercentileSpinBox->setSuffix(tr(" %"));
+    m_highlightPercentileSpinBox->setDecimals(1);
+    m_highlightPercentileSpinBox->setMinimum(50.0);
+    m_highlightPercentileSpinBox->setMaximum(100.0);
+    m_highlightPercentileSpinBox->setSingleStep(0.5);
+    m_highlightPercentileSpinBox->setValue(100.0 * AutoExposure::defaultHighlightPercentile);
+    m_highlightPercentileSpinBox->setKeyboardTracking(false);
+    m_highlightPercentileSpinBox->setToolTip(tr("Share of halo pixels that are kept from being brighter than white"));
+
     m_hideSubHorizonCheckBox = new QCheckBox();
 
     m_lockToLightSource = new QCheckBox();
 
+    m_splatFilterComboBox = new QComboBox();
+    m_splatFilterComboBox->addItems({tr("Box"),
+                                     tr("Bilinear"),
+                                     tr("Tent"),
+                                     tr("Gaussian")});
+    m_splatFilterComboBox->setToolTip(tr("Spread the light of each ray over the pixels around it for a smoother image"));
+
+    m_splatFilterRadiusSpinBox = new QDoubleSpinBox();
+    m_splatFilterRadiusSpinBox->setSuffix(tr(" px"));
+    m_splatFilterRadiusSpinBox->setSingleStep(0.5);
+    m_splatFilterRadiusSpinBox->setMinimum(Kernels::SplatFilter::minRadius);
+    m_splatFilterRadiusSpinBox->setMaximum(Kernels::SplatFilter::maxRadius);
+    m_splatFilterRadiusSpinBox->setKeyboardTracking(false);
+
+    m_denoisePreviewCheckBox = new QCheckBox();
+    m_denoisePreviewCheckBox->setChecked(true);
+    m_denoisePreviewCheckBox->setToolTip(tr("Smooth out noise while the image has only a few rays. Saved images are not denoised."));
+
     auto layout = new QFormLayout(this->contentWidget());
     layout->addRow(tr("Camera projection"), m_cameraProjectionComboBox);
     layout->addRow(tr("Field of view"), m_fieldOfViewSlider);
     layout->addRow(tr("Pitch"), m_pitchSlider);
     layout->addRow(tr("Yaw"), m_yawSlider);
     layout->addRow(tr("Brightness"), m_brightnessSlider);
+    layout->addRow(tr("Auto brightness"), m_autoBrightnessCheckBox);
+    layout->addRow(tr("Key value"), m_keyValueSpinBox);
+    layout->addRow(tr("Highlight percentile"), m_highlightPercentileSpinBox);
     layout->addRow(tr("Hide sub-horizon"), m_hideSubHorizonCheckBox);
     layout->addRow(tr("Lock to light source"), m_lockToLightSource);
+    layout->addRow(tr("Splat filter"), m_splatFilterComboBox);
+    layout->addRow(tr("Filter radius"), m_splatFilterRadiusSpinBox);
+    layout->addRow(tr("Denoise preview"), m_denoisePreviewCheckBox);
 }
 
 void ViewSettingsWidget::setBrightness(double brightness)
@@ -4,6 +4,7 @@
 
 class QComboBox;
 class QCheckBox;
+class QDoubleSpinBox;
 class QDataWidgetMapper;
 
 namespace HaloRay
@@ -22,6 +23,8 @@ public:
 signals:
     void brightnessChanged(double brightness);
     void lockToLightSource(bool locked);
+    void denoisingChanged(bool enabled);
+    void autoExposureChanged(bool enabled, double keyValue, double highlightPercentile);
 
 private:
     void setupUi();
@@ -32,7 +35,13 @@ private:
     QComboBox *m_cameraProjectionComboBox;
     QCheckBox *m_hideSubHorizonCheckBox;
     SliderSpinBox *m_brightnessSlider;
+    QCheckBox *m_autoBrightnessCheckBox;
+    QDoubleSpinBox *m_keyValueSpinBox;
+    QDoubleSpinBox *m_highlightPercentileSpinBox;
     QCheckBox *m_lockToLightSource;
+    QCheckBox *m_denoisePreviewCheckBox;
+    QComboBox *m_splatFilterComboBox;
+    QDoubleSpinBox *m_splatFilterRadiusSpinBox;
 
     SimulationStateModel *m_viewModel;
     QDataWidgetMapper *m_mapper;
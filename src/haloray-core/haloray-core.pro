@@ -24,6 +24,10 @@ HALORAY_VERSION = $$(HALORAY_VERSION)
     DEFINES += "HALORAY_VERSION=\"$$HALORAY_VERSION\""
 }
 
+# Hybrid tracing runs the kernels on the CPU next to the GPU
+INCLUDEPATH += $$PWD/../haloray-kernels
+DEPENDPATH += $$PWD/../haloray-kernels
+
 HEADERS += \
     gui/atmosphereSettingsWidget.h \
     gui/components/addCrystalPopulationButton.h \
@@ -34,16 +38,22 @@ HEADERS += \
     gui/crystalPreview/previewRenderArea.h \
     gui/crystalSettingsWidget.h \
     gui/generalSettingsWidget.h \
+    gui/haloComponentsWidget.h \
     gui/mainWindow.h \
     gui/models/crystalModel.h \
     gui/models/simulationStateModel.h \
     gui/openGLWidget.h \
+    gui/scatteringTableDialog.h \
     gui/stateSaver.h \
     gui/viewSettingsWidget.h \
+    opengl/luminanceHistogram.h \
     opengl/texture.h \
     opengl/textureRenderer.h \
     simulation/atmosphere.h \
+    simulation/autoExposure.h \
     simulation/colorUtilities.h \
+    simulation/compensatedSum.h \
+    simulation/convexPolyhedron.h \
     simulation/hosekWilkie/ArHosekSkyModel.h \
     simulation/hosekWilkie/ArHosekSkyModelData_CIEXYZ.h \
     simulation/hosekWilkie/ArHosekSkyModelData_RGB.h \
@@ -51,10 +61,32 @@ HEADERS += \
     simulation/camera.h \
     simulation/crystalPopulation.h \
     simulation/crystalPopulationRepository.h \
+    simulation/fft.h \
+    simulation/hybridTracer.h \
+    simulation/invalidationTracker.h \
     simulation/lightSource.h \
+    simulation/outputView.h \
+    simulation/pathFilter.h \
+    simulation/pathGuide.h \
+    simulation/pathLengthHistogram.h \
+    simulation/phaseFunction.h \
+    simulation/philox.h \
+    simulation/rayAllocation.h \
+    simulation/rayDump.h \
+    simulation/rayReprojection.h \
+    simulation/sampleReweighting.h \
+    simulation/scatteringTable.h \
     simulation/simulationEngine.h \
     simulation/skyModel.h \
-    simulation/trigonometryUtilities.h
+    simulation/sobolSequence.h \
+    simulation/spscRingBuffer.h \
+    simulation/sunConvolution.h \
+    simulation/tabulatedDistribution.h \
+    simulation/throughputBalancer.h \
+    simulation/toneMapping.h \
+    simulation/transferTable.h \
+    simulation/trigonometryUtilities.h \
+    simulation/wavefront.h
 
 SOURCES += \
     gui/atmosphereSettingsWidget.cpp \
@@ -66,22 +98,49 @@ SOURCES += \
     gui/crystalPreview/previewRenderArea.cpp \
     gui/crystalSettingsWidget.cpp \
     gui/generalSettingsWidget.cpp \
+    gui/haloComponentsWidget.cpp \
     gui/mainWindow.cpp \
     gui/models/crystalModel.cpp \
     gui/models/simulationStateModel.cpp \
     gui/openGLWidget.cpp \
+    gui/scatteringTableDialog.cpp \
     gui/stateSaver.cpp \
     gui/viewSettingsWidget.cpp \
+    opengl/luminanceHistogram.cpp \
     opengl/texture.cpp \
     opengl/textureRenderer.cpp \
     simulation/atmosphere.cpp \
+    simulation/autoExposure.cpp \
     simulation/hosekWilkie/ArHosekSkyModel.c \
     simulation/camera.cpp \
+    simulation/compensatedSum.cpp \
+    simulation/convexPolyhedron.cpp \
     simulation/crystalPopulation.cpp \
     simulation/crystalPopulationRepository.cpp \
+    simulation/fft.cpp \
+    simulation/hybridTracer.cpp \
+    simulation/invalidationTracker.cpp \
     simulation/lightSource.cpp \
+    simulation/outputView.cpp \
+    simulation/pathFilter.cpp \
+    simulation/pathGuide.cpp \
+    simulation/pathLengthHistogram.cpp \
+    simulation/phaseFunction.cpp \
+    simulation/philox.cpp \
+    simulation/rayAllocation.cpp \
+    simulation/rayDump.cpp \
+    simulation/rayReprojection.cpp \
+    simulation/sampleReweighting.cpp \
+    simulation/scatteringTable.cpp \
     simulation/simulationEngine.cpp \
-    simulation/skyModel.cpp
+    simulation/skyModel.cpp \
+    simulation/sobolSequence.cpp \
+    simulation/sunConvolution.cpp \
+    simulation/tabulatedDistribution.cpp \
+    simulation/throughputBalancer.cpp \
+    simulation/toneMapping.cpp \
+    simulation/transferTable.cpp \
+    simulation/wavefront.cpp
 
 RESOURCES = \
     resources/haloray.qrc
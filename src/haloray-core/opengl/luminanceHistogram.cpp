@@ -0,0 +1,126 @@
+#include "luminanceHistogram.h"
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+#include <QtGlobal>
+
+namespace OpenGL
+{
+
+std::unique_ptr<QOpenGLShaderProgram> LuminanceHistogram::initializeShaderProgram(const char *name, const char *filename)
+{
+    qInfo("Initializing %s shader", name);
+    auto program = std::make_unique<QOpenGLShaderProgram>();
+    if (program->addCacheableShaderFromSourceFile(QOpenGLShader::ShaderTypeBit::Compute, filename) == false)
+    {
+        qWarning("%s shader read failed", name);
+        throw std::runtime_error(program->log().toUtf8());
+    }
+    qInfo("%s shader successfully initialized", name);
+
+    if (program->link() == false)
+    {
+        qWarning("%s shader compilation and linking failed", name);
+        throw std::runtime_error(program->log().toUtf8());
+    }
+    qInfo("%s shader program compilation and linking successful", name);
+
+    return program;
+}
+
+LuminanceHistogram::LuminanceHistogram()
+    : m_histogramBuffer(0),
+      m_statisticsBuffer(0),
+      m_fence(nullptr)
+{
+    initializeOpenGLFunctions();
+    m_histogramProgram = initializeShaderProgram("Luminance histogram", ":/shaders/luminanceHistogram.glsl");
+    m_percentileProgram = initializeShaderProgram("Luminance percentile", ":/shaders/luminancePercentiles.glsl");
+
+    glGenBuffers(1, &m_histogramBuffer);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, m_histogramBuffer);
+    glBufferData(GL_SHADER_STORAGE_BUFFER, HaloRay::AutoExposure::binCount * sizeof(std::uint32_t), nullptr, GL_DYNAMIC_DRAW);
+
+    glGenBuffers(1, &m_statisticsBuffer);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, m_statisticsBuffer);
+    glBufferData(GL_SHADER_STORAGE_BUFFER, 3 * sizeof(std::uint32_t), nullptr, GL_DYNAMIC_READ);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+}
+
+LuminanceHistogram::~LuminanceHistogram()
+{
+    if (m_fence != nullptr)
+        glDeleteSync(m_fence);
+    glDeleteBuffers(1, &m_histogramBuffer);
+    glDeleteBuffers(1, &m_statisticsBuffer);
+}
+
+bool LuminanceHistogram::isPending() const
+{
+    return m_fence != nullptr;
+}
+
+void LuminanceHistogram::update(unsigned int haloTextureHandle, float normalization, float highlightPercentile)
+{
+    if (isPending())
+        return;
+
+    int width;
+    int height;
+    glActiveTexture(GL_TEXTURE0);
+    glBindTexture(GL_TEXTURE_2D, haloTextureHandle);
+    glGetTexLevelParameteriv(GL_TEXTURE_2D, 0, GL_TEXTURE_WIDTH, &width);
+    glGetTexLevelParameteriv(GL_TEXTURE_2D, 0, GL_TEXTURE_HEIGHT, &height);
+
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, m_histogramBuffer);
+    glClearBufferData(GL_SHADER_STORAGE_BUFFER, GL_R32UI, GL_RED_INTEGER, GL_UNSIGNED_INT, nullptr);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 22, m_histogramBuffer);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 23, m_statisticsBuffer);
+
+    glMemoryBarrier(GL_SHADER_IMAGE_ACCESS_BARRIER_BIT | GL_TEXTURE_FETCH_BARRIER_BIT);
+    m_histogramProgram->bind();
+    m_histogramProgram->setUniformValue("normalization", normalization);
+    glDispatchCompute((width + 15) / 16, (height + 15) / 16, 1);
+    glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+
+    m_percentileProgram->bind();
+    m_percentileProgram->setUniformValue("highlightPercentile", highlightPercentile);
+    glDispatchCompute(1, 1, 1);
+    glMemoryBarrier(GL_BUFFER_UPDATE_BARRIER_BIT);
+
+    m_fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+}
+
+bool LuminanceHistogram::getStatistics(HaloRay::LuminanceStatistics &statistics)
+{
+    if (!isPending())
+        return false;
+
+    auto status = glClientWaitSync(m_fence, 0, 0);
+    if (status == GL_TIMEOUT_EXPIRED)
+        return false;
+    glDeleteSync(m_fence);
+    m_fence = nullptr;
+    if (status == GL_WAIT_FAILED)
+    {
+        qWarning("Waiting for luminance statistics failed");
+        return false;
+    }
+
+    std::uint32_t values[3];
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, m_statisticsBuffer);
+    glGetBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, sizeof(values), values);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+
+    float averageLuminance;
+    float highlightLuminance;
+    std::memcpy(&averageLuminance, &values[1], sizeof(float));
+    std::memcpy(&highlightLuminance, &values[2], sizeof(float));
+    statistics.litPixelCount = values[0];
+    statistics.averageLuminance = averageLuminance;
+    statistics.highlightLuminance = highlightLuminance;
+    return true;
+}
+
+}
@@ -0,0 +1,41 @@
+#pragma once
+#include <memory>
+#include <QOpenGLFunctions_4_4_Core>
+#include <QOpenGLShaderProgram>
+#include "simulation/autoExposure.h"
+
+namespace OpenGL
+{
+
+/* Builds a luminance histogram of a halo texture and reduces it to the
+   statistics used for automatic brightness, all on the GPU. Only the
+   statistics are read back, and only after a fence shows that the GPU has
+   finished, so that rendering never waits for them. */
+class LuminanceHistogram : protected QOpenGLFunctions_4_4_Core
+{
+public:
+    explicit LuminanceHistogram();
+    ~LuminanceHistogram();
+
+    bool isPending() const;
+
+    /* Starts building the statistics of the texture. The normalization
+       scales the accumulated light to the luminance shown with a
+       brightness of one. Does nothing while earlier statistics are still
+       pending. */
+    void update(unsigned int haloTextureHandle, float normalization, float highlightPercentile);
+
+    // Returns true when pending statistics have finished, without waiting for them
+    bool getStatistics(HaloRay::LuminanceStatistics &statistics);
+
+private:
+    static std::unique_ptr<QOpenGLShaderProgram> initializeShaderProgram(const char *name, const char *filename);
+
+    std::unique_ptr<QOpenGLShaderProgram> m_histogramProgram;
+    std::unique_ptr<QOpenGLShaderProgram> m_percentileProgram;
+    unsigned int m_histogramBuffer;
+    unsigned int m_statisticsBuffer;
+    GLsync m_fence;
+};
+
+}
@@ -7,7 +7,8 @@ namespace OpenGL
 enum TextureType
 {
     Color,
-    Monochrome
+    Monochrome,
+    Scalar
 };
 
 class Texture : protected QOpenGLFunctions_4_4_Core
@@ -2,6 +2,7 @@
 #include <memory>
 #include <string>
 #include <QtGlobal>
+#include <algorithm>
 #include <stdexcept>
 
 namespace OpenGL
@@ -39,7 +40,33 @@ std::unique_ptr<QOpenGLShaderProgram> TextureRenderer::initializeTexDrawShaderPr
     return program;
 }
 
+std::unique_ptr<QOpenGLShaderProgram> TextureRenderer::initializeDenoiseShaderProgram()
+{
+    qInfo("Initializing denoising shader");
+    auto program = std::make_unique<QOpenGLShaderProgram>();
+    if (program->addCacheableShaderFromSourceFile(QOpenGLShader::ShaderTypeBit::Compute, ":/shaders/denoise.glsl") == false)
+    {
+        qWarning("Denoising shader read failed");
+        throw std::runtime_error(program->log().toUtf8());
+    }
+    qInfo("Denoising shader successfully initialized");
+
+    if (program->link() == false)
+    {
+        qWarning("Denoising shader compilation and linking failed");
+        throw std::runtime_error(program->log().toUtf8());
+    }
+    qInfo("Denoising shader program compilation and linking successful");
+
+    return program;
+}
+
 TextureRenderer::TextureRenderer()
+    : m_denoiseBlend(0.0f),
+      m_secondMomentTexture(0),
+      m_denoiseTextures{0, 0},
+      m_denoiseTextureWidth(0),
+      m_denoiseTextureHeight(0)
 {
     initialize();
 }
@@ -69,15 +96,85 @@ void TextureRenderer::initialize()
     glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, 0, NULL);
 
     m_texDrawProgram = initializeTexDrawShaderProgram();
+    m_denoiseProgram = initializeDenoiseShaderProgram();
+}
+
+void TextureRenderer::initializeDenoiseTextures(int width, int height)
+{
+    deleteDenoiseTextures();
+    glGenTextures(2, m_denoiseTextures);
+    for (auto texture : m_denoiseTextures)
+    {
+        glBindTexture(GL_TEXTURE_2D, texture);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+        glTexStorage2D(GL_TEXTURE_2D, 1, GL_RGBA32F, width, height);
+    }
+    glBindTexture(GL_TEXTURE_2D, 0);
+    m_denoiseTextureWidth = width;
+    m_denoiseTextureHeight = height;
+}
+
+void TextureRenderer::deleteDenoiseTextures()
+{
+    if (m_denoiseTextures[0] == 0)
+        return;
+    glDeleteTextures(2, m_denoiseTextures);
+    m_denoiseTextures[0] = 0;
+    m_denoiseTextures[1] = 0;
+}
+
+void TextureRenderer::denoise(unsigned int haloTextureHandle)
+{
+    int width;
+    int height;
+    glBindTexture(GL_TEXTURE_2D, haloTextureHandle);
+    glGetTexLevelParameteriv(GL_TEXTURE_2D, 0, GL_TEXTURE_WIDTH, &width);
+    glGetTexLevelParameteriv(GL_TEXTURE_2D, 0, GL_TEXTURE_HEIGHT, &height);
+    if (width != m_denoiseTextureWidth || height != m_denoiseTextureHeight || m_denoiseTextures[0] == 0)
+        initializeDenoiseTextures(width, height);
+
+    /* The passes ping-pong between the two denoising textures, reading the
+       halo texture only in the first one */
+    m_denoiseProgram->bind();
+    glActiveTexture(GL_TEXTURE1);
+    glBindTexture(GL_TEXTURE_2D, m_secondMomentTexture);
+    unsigned int input = haloTextureHandle;
+    for (int pass = 0; pass < denoisePasses; ++pass)
+    {
+        unsigned int output = m_denoiseTextures[pass % 2];
+        m_denoiseProgram->setUniformValue("stepSize", 1 << pass);
+        m_denoiseProgram->setUniformValue("firstPass", pass == 0 ? 1 : 0);
+        glActiveTexture(GL_TEXTURE0);
+        glBindTexture(GL_TEXTURE_2D, input);
+        glBindImageTexture(3, output, 0, GL_FALSE, 0, GL_WRITE_ONLY, GL_RGBA32F);
+        glDispatchCompute((width + 15) / 16, (height + 15) / 16, 1);
+        glMemoryBarrier(GL_TEXTURE_FETCH_BARRIER_BIT);
+        input = output;
+    }
+}
+
+void TextureRenderer::setDenoiseBlend(float blend)
+{
+    m_denoiseBlend = std::max(0.0f, std::min(blend, 1.0f));
+}
+
+void TextureRenderer::setSecondMomentTexture(unsigned int secondMomentTextureHandle)
+{
+    m_secondMomentTexture = secondMomentTextureHandle;
 }
 
 void TextureRenderer::render(unsigned int haloTextureHandle, int backgroundTextureHandle)
 {
     glMemoryBarrier(GL_SHADER_IMAGE_ACCESS_BARRIER_BIT);
 
+    if (m_denoiseBlend > 0.0f)
+        denoise(haloTextureHandle);
+
     /* Render simulation result texture */
 
     m_texDrawProgram->bind();
+    m_texDrawProgram->setUniformValue("denoiseBlend", m_denoiseBlend);
     glClearColor(0.0f, 0.0f, 0.0f, 1.0f);
     glClear(GL_COLOR_BUFFER_BIT);
     glBindVertexArray(m_quadVao);
@@ -85,6 +182,8 @@ void TextureRenderer::render(unsigned int haloTextureHandle, int backgroundTextu
     glBindTexture(GL_TEXTURE_2D, haloTextureHandle);
     glActiveTexture(GL_TEXTURE1);
     glBindTexture(GL_TEXTURE_2D, backgroundTextureHandle);
+    glActiveTexture(GL_TEXTURE2);
+    glBindTexture(GL_TEXTURE_2D, m_denoiseBlend > 0.0f ? m_denoiseTextures[(denoisePasses - 1) % 2] : 0);
     glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
     glActiveTexture(GL_TEXTURE0);
 }
@@ -102,6 +201,8 @@ TextureRenderer::~TextureRenderer()
 
     glBindBuffer(GL_ARRAY_BUFFER, 0);
     glDeleteBuffers(1, &m_quadVbo);
+
+    deleteDenoiseTextures();
 }
 
 }
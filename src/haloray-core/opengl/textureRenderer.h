@@ -14,12 +14,33 @@ public:
     void setUniformFloat(std::string name, float value);
     void render(unsigned int textureHandle);
     void render(unsigned int haloTextureHandle, int backgroundTextureHandle);
+
+    /* Shows a denoised copy of the halo texture blended with the raw one,
+       from 0 for only the raw texture to 1 for only the denoised one. The
+       halo texture itself is never changed. */
+    void setDenoiseBlend(float blend);
+
+    /* The denoiser estimates the noise of each pixel from a texture with
+       the sum of the squared luminance of the rays that reached it */
+    void setSecondMomentTexture(unsigned int secondMomentTextureHandle);
     ~TextureRenderer();
 
+    static const int denoisePasses = 5;
+
 private:
     static std::unique_ptr<QOpenGLShaderProgram> initializeTexDrawShaderProgram();
+    static std::unique_ptr<QOpenGLShaderProgram> initializeDenoiseShaderProgram();
+    void denoise(unsigned int haloTextureHandle);
+    void initializeDenoiseTextures(int width, int height);
+    void deleteDenoiseTextures();
 
     std::unique_ptr<QOpenGLShaderProgram> m_texDrawProgram;
+    std::unique_ptr<QOpenGLShaderProgram> m_denoiseProgram;
+    float m_denoiseBlend;
+    unsigned int m_secondMomentTexture;
+    unsigned int m_denoiseTextures[2];
+    int m_denoiseTextureWidth;
+    int m_denoiseTextureHeight;
     unsigned int m_quadVao;
     unsigned int m_quadVbo;
 };
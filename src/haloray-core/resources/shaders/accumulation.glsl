@@ -0,0 +1,28 @@
+#version 440 core
+
+layout(local_size_x = 16, local_size_y = 16) in;
+
+/* Adds the light traced during a step to the accumulated image, which is
+   kept as unevaluated sums of two floats, and clears the step image for
+   the next step */
+layout(binding = 0, rgba32f) uniform image2D stepImage;
+layout(binding = 1, rgba32f) uniform image2D highImage;
+layout(binding = 3, rgba32f) uniform image2D lowImage;
+
+void main(void)
+{
+    ivec2 pixelCoordinates = ivec2(gl_GlobalInvocationID.xy);
+    if (any(greaterThanEqual(pixelCoordinates, imageSize(stepImage)))) return;
+
+    vec4 value = imageLoad(stepImage, pixelCoordinates);
+    if (value == vec4(0.0)) return;
+
+    vec4 high = imageLoad(highImage, pixelCoordinates);
+    vec3 newHigh = high.rgb;
+    vec3 newLow = imageLoad(lowImage, pixelCoordinates).rgb;
+    addCompensated(newHigh, newLow, value.rgb);
+
+    imageStore(highImage, pixelCoordinates, vec4(newHigh, max(high.a, value.a)));
+    imageStore(lowImage, pixelCoordinates, vec4(newLow, 0.0));
+    imageStore(stepImage, pixelCoordinates, vec4(0.0));
+}
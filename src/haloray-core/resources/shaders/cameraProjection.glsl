@@ -0,0 +1,109 @@
+/* Inverse of the camera projection in the raytracing shader, shared by the
+   shaders that draw light given per direction into the traced image. It is
+   inserted after the version directive of those shaders when they are
+   compiled, so it must not declare a version of its own. */
+
+#define PROJECTION_STEREOGRAPHIC 0
+#define PROJECTION_RECTILINEAR 1
+#define PROJECTION_EQUIDISTANT 2
+#define PROJECTION_EQUAL_AREA 3
+#define PROJECTION_ORTHOGRAPHIC 4
+
+uniform struct camera_t
+{
+    float pitch;
+    float yaw;
+    float focalLength;
+    int projection;
+    int hideSubHorizon;
+} camera;
+
+const float PI = 3.1415926535;
+
+mat3 rotateAroundX(float angle)
+{
+    return mat3(
+        1.0, 0.0, 0.0,
+        0.0, cos(angle), sin(angle),
+        0.0, -sin(angle), cos(angle)
+    );
+}
+
+mat3 rotateAroundY(float angle)
+{
+    return mat3(
+        cos(angle), 0.0, -sin(angle),
+        0.0, 1.0, 0.0,
+        sin(angle), 0.0, cos(angle)
+    );
+}
+
+mat3 getCameraOrientationMatrix()
+{
+    return rotateAroundX(camera.pitch) * rotateAroundY(camera.yaw);
+}
+
+vec3 getSunDirection(float altitude)
+{
+    // X and Z are horizontal, sun moves on the Y-Z plane
+    return normalize(vec3(
+        0.0,
+        sin(altitude),
+        cos(altitude)
+    ));
+}
+
+/* Returns the direction of a ray that ends up at the given image
+   coordinates, or false if no ray does. Must match projectRay in the
+   raytracing shader. */
+bool getRayDirection(vec2 imageCoordinates, vec2 resolution, out vec3 direction)
+{
+    float aspectRatio = resolution.y / resolution.x;
+    vec2 projected = imageCoordinates / resolution - 0.5;
+    projected.x /= aspectRatio;
+
+    float projectionFunction = length(projected) / camera.focalLength;
+    float angle = atan(projected.y, projected.x);
+
+    float polarAngle;
+    if (camera.projection == PROJECTION_STEREOGRAPHIC) {
+        polarAngle = 2.0 * atan(projectionFunction / 2.0);
+    } else if (camera.projection == PROJECTION_RECTILINEAR) {
+        polarAngle = atan(projectionFunction);
+    } else if (camera.projection == PROJECTION_EQUIDISTANT) {
+        if (projectionFunction > PI) return false;
+        polarAngle = projectionFunction;
+    } else if (camera.projection == PROJECTION_EQUAL_AREA) {
+        if (projectionFunction > 2.0) return false;
+        polarAngle = 2.0 * asin(projectionFunction / 2.0);
+    } else if (camera.projection == PROJECTION_ORTHOGRAPHIC) {
+        if (projectionFunction > 1.0) return false;
+        polarAngle = asin(projectionFunction);
+    }
+
+    vec3 cameraDirection = vec3(sin(polarAngle) * cos(angle), sin(polarAngle) * sin(angle), cos(polarAngle));
+    direction = -(cameraDirection * getCameraOrientationMatrix());
+    return true;
+}
+
+/* Returns the direction of the ray that ends up at the center of a pixel
+   and the solid angle the pixel covers, or false if the pixel is outside
+   the projection or hidden below the horizon */
+bool getPixelDirection(ivec2 pixelCoordinates, vec2 resolution, out vec3 direction, out float solidAngle)
+{
+    vec2 pixelCenter = vec2(pixelCoordinates) + 0.5;
+    vec3 left, right, bottom, top;
+    if (!getRayDirection(pixelCenter, resolution, direction) ||
+        !getRayDirection(pixelCenter - vec2(0.5, 0.0), resolution, left) ||
+        !getRayDirection(pixelCenter + vec2(0.5, 0.0), resolution, right) ||
+        !getRayDirection(pixelCenter - vec2(0.0, 0.5), resolution, bottom) ||
+        !getRayDirection(pixelCenter + vec2(0.0, 0.5), resolution, top))
+        return false;
+
+    // Hide subhorizon rays
+    if (camera.hideSubHorizon == 1 && direction.y > 0.0) return false;
+
+    // Solid angle covered by the pixel, from the directions at its edges
+    solidAngle = length(cross(right - left, top - bottom));
+    return true;
+}
@@ -0,0 +1,21 @@
+/* Adds light to an image kept as unevaluated sums of two floats. The high
+   part is the image that is shown and composited, and the low part holds
+   its rounding error, so that light added late in long runs is not lost.
+   It is inserted after the version directive of the shaders that add
+   traced light to such images when they are compiled. This must match the
+   CompensatedSum class. */
+void addCompensated(inout vec3 high, inout vec3 low, vec3 value)
+{
+    // The two-sum algorithm gives the exact rounding error of the sum
+    precise vec3 sum = high + value;
+    precise vec3 virtualValue = sum - high;
+    precise vec3 error = (high - (sum - virtualValue)) + (value - virtualValue);
+
+    // Renormalize, so that the high part is the total rounded to a float
+    precise vec3 newLow = low + error;
+    precise vec3 newHigh = sum + newLow;
+    newLow -= newHigh - sum;
+
+    high = newHigh;
+    low = newLow;
+}
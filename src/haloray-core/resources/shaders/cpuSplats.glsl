@@ -0,0 +1,44 @@
+#version 440 core
+
+layout(local_size_x = 64) in;
+layout(binding = 0, rgba32f) uniform coherent image2D outputImage;
+
+/* The light of the rays reaching a pixel is summed on the CPU, so its
+   square stands in for the sum of their squares. This overestimates the
+   noise of pixels reached by several CPU rays in one batch.
+   LUMINANCE_WEIGHTS is inserted from luminance.glsl. */
+layout(binding = 3, r32f) uniform coherent image2D secondMomentImage;
+
+/* Light of rays traced on the CPU, see the Splat struct of the kernels
+   for the layout. Each pixel appears at most once. */
+#define SPLAT_SIZE 4u
+
+layout(std430, binding = 21) readonly buffer cpuSplatBuffer
+{
+    uint cpuSplats[];
+};
+
+// Splats are processed in chunks, as the number of work groups is limited
+uniform uint splatOffset;
+uniform uint splatCount;
+
+void main(void)
+{
+    uint splatIndex = splatOffset + gl_GlobalInvocationID.x;
+    if (splatIndex >= splatCount) return;
+
+    uint offset = splatIndex * SPLAT_SIZE;
+    uint pixelIndex = cpuSplats[offset];
+    vec3 value = vec3(uintBitsToFloat(cpuSplats[offset + 1u]),
+                      uintBitsToFloat(cpuSplats[offset + 2u]),
+                      uintBitsToFloat(cpuSplats[offset + 3u]));
+
+    int width = imageSize(outputImage).x;
+    ivec2 pixelCoordinates = ivec2(int(pixelIndex) % width, int(pixelIndex) / width);
+    vec3 currentValue = imageLoad(outputImage, pixelCoordinates).xyz;
+    imageStore(outputImage, pixelCoordinates, vec4(currentValue + value, 1.0));
+
+    float luminance = dot(value, LUMINANCE_WEIGHTS);
+    float currentMoment = imageLoad(secondMomentImage, pixelCoordinates).r;
+    imageStore(secondMomentImage, pixelCoordinates, vec4(currentMoment + luminance * luminance));
+}
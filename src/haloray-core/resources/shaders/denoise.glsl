@@ -0,0 +1,69 @@
+#version 440 core
+
+layout(local_size_x = 16, local_size_y = 16) in;
+layout(binding = 0) uniform sampler2D inputImage;
+layout(binding = 1) uniform sampler2D secondMomentImage;
+layout(binding = 3, rgba32f) uniform writeonly image2D outputImage;
+
+/* One pass of an edge-aware a-trous wavelet filter. Each pass blurs with a
+   5x5 B3 spline kernel whose taps are stepSize pixels apart, and the step
+   size doubles between passes. Neighbours are ignored when their luminance
+   differs from the center by more than the noise of the two explains. The
+   first pass takes the noise of each pixel from the sum of the squared
+   luminance of the rays that reached it, which the simulation accumulates
+   alongside the image, and later passes filter it along with the image in
+   the alpha channel. The filter does not depend on the scale of the image,
+   so the raw accumulated light can be used as is. */
+uniform int stepSize;
+uniform int firstPass;
+
+#define LUMINANCE_SIGMA 4.0
+
+const float kernelWeights[3] = float[3](3.0 / 8.0, 1.0 / 4.0, 1.0 / 16.0);
+
+float getLuminance(vec3 color)
+{
+    return dot(color, vec3(0.2126, 0.7152, 0.0722));
+}
+
+float getVariance(ivec2 position, vec4 value)
+{
+    return firstPass == 1 ? texelFetch(secondMomentImage, position, 0).r : value.a;
+}
+
+void main(void)
+{
+    ivec2 size = textureSize(inputImage, 0);
+    ivec2 center = ivec2(gl_GlobalInvocationID.xy);
+    if (any(greaterThanEqual(center, size))) return;
+
+    vec4 centerValue = texelFetch(inputImage, center, 0);
+    float centerVariance = getVariance(center, centerValue);
+    float centerLuminance = getLuminance(centerValue.rgb);
+
+    vec3 colorSum = vec3(0.0);
+    float varianceSum = 0.0;
+    float weightSum = 0.0;
+    for (int y = -2; y <= 2; ++y)
+    {
+        for (int x = -2; x <= 2; ++x)
+        {
+            ivec2 position = center + stepSize * ivec2(x, y);
+            if (any(lessThan(position, ivec2(0))) || any(greaterThanEqual(position, size))) continue;
+
+            vec4 value = texelFetch(inputImage, position, 0);
+            float variance = getVariance(position, value);
+            // Pixels without rays have no variance of their own, so the noise of both pixels is used
+            float edgeScale = LUMINANCE_SIGMA * sqrt(centerVariance + variance) + 1.0e-20;
+            float edgeWeight = exp(-abs(getLuminance(value.rgb) - centerLuminance) / edgeScale);
+            float weight = kernelWeights[abs(x)] * kernelWeights[abs(y)] * edgeWeight;
+
+            colorSum += weight * value.rgb;
+            varianceSum += weight * weight * variance;
+            weightSum += weight;
+        }
+    }
+
+    // The center pixel always has a weight, so the sum cannot be zero
+    imageStore(outputImage, center, vec4(colorSum / weightSum, varianceSum / (weightSum * weightSum)));
+}
@@ -0,0 +1,28 @@
+#version 440 core
+
+layout(local_size_x = 16, local_size_y = 16) in;
+
+/* Adds the light traced during a step to every layer of an accumulated
+   texture array, like the accumulation shader does for the traced image.
+   Used for the halo component layers and the output views. */
+layout(binding = 0, rgba32f) uniform image2DArray stepImage;
+layout(binding = 1, rgba32f) uniform image2DArray highImage;
+layout(binding = 3, rgba32f) uniform image2DArray lowImage;
+
+void main(void)
+{
+    ivec3 coordinates = ivec3(gl_GlobalInvocationID);
+    if (any(greaterThanEqual(coordinates, imageSize(stepImage)))) return;
+
+    vec4 value = imageLoad(stepImage, coordinates);
+    if (value == vec4(0.0)) return;
+
+    vec4 high = imageLoad(highImage, coordinates);
+    vec3 newHigh = high.rgb;
+    vec3 newLow = imageLoad(lowImage, coordinates).rgb;
+    addCompensated(newHigh, newLow, value.rgb);
+
+    imageStore(highImage, coordinates, vec4(newHigh, max(high.a, value.a)));
+    imageStore(lowImage, coordinates, vec4(newLow, 0.0));
+    imageStore(stepImage, coordinates, vec4(0.0));
+}
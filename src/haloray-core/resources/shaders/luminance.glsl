@@ -0,0 +1,4 @@
+/* Weights of the linear sRGB channels in the luminance of a color, shared
+   by the shaders that estimate the noise of the image. It is inserted after
+   the version directive of those shaders when they are compiled. */
+#define LUMINANCE_WEIGHTS vec3(0.2126, 0.7152, 0.0722)
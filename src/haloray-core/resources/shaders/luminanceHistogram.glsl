@@ -0,0 +1,52 @@
+#version 440 core
+
+layout(local_size_x = 16, local_size_y = 16) in;
+layout(binding = 0) uniform sampler2D haloTexture;
+
+/* Histogram of the halo luminance in log2 space. Bin 0 counts pixels darker
+   than the smallest luminance, mostly those without any halo. This must
+   match the AutoExposure class. Each work group first counts its own pixels
+   in shared memory, so that only nonzero bins are added to the global
+   histogram. */
+#define LUMINANCE_BINS 256u
+#define MIN_LOG2_LUMINANCE -20.0
+#define MAX_LOG2_LUMINANCE 12.0
+
+layout(std430, binding = 22) buffer luminanceHistogramBuffer
+{
+    uint histogram[LUMINANCE_BINS];
+};
+
+// Scales the accumulated light to the luminance shown with a brightness of one
+uniform float normalization;
+
+shared uint localHistogram[LUMINANCE_BINS];
+
+uint getBin(float luminance)
+{
+    if (!(luminance > 0.0)) return 0u;
+    float log2Luminance = log2(luminance);
+    if (log2Luminance < MIN_LOG2_LUMINANCE) return 0u;
+    float position = (log2Luminance - MIN_LOG2_LUMINANCE) / (MAX_LOG2_LUMINANCE - MIN_LOG2_LUMINANCE) * float(LUMINANCE_BINS - 1u);
+    return min(uint(position) + 1u, LUMINANCE_BINS - 1u);
+}
+
+void main(void)
+{
+    // There are as many invocations in a work group as there are bins
+    localHistogram[gl_LocalInvocationIndex] = 0u;
+    barrier();
+
+    ivec2 size = textureSize(haloTexture, 0);
+    ivec2 position = ivec2(gl_GlobalInvocationID.xy);
+    if (all(lessThan(position, size)))
+    {
+        vec3 value = texelFetch(haloTexture, position, 0).rgb;
+        float luminance = normalization * dot(value, vec3(0.2126, 0.7152, 0.0722));
+        atomicAdd(localHistogram[getBin(luminance)], 1u);
+    }
+    barrier();
+
+    uint count = localHistogram[gl_LocalInvocationIndex];
+    if (count > 0u) atomicAdd(histogram[gl_LocalInvocationIndex], count);
+}
@@ -0,0 +1,68 @@
+#version 440 core
+
+layout(local_size_x = 256) in;
+
+/* Reduces the luminance histogram to the statistics used for automatic
+   brightness in a single work group, one invocation per bin. A parallel
+   prefix sum gives the number of lit pixels up to each bin, and the bin
+   where it crosses the highlight percentile gives the highlight luminance.
+   The average luminance is the geometric mean over the lit pixels. */
+#define LUMINANCE_BINS 256u
+#define MIN_LOG2_LUMINANCE -20.0
+#define MAX_LOG2_LUMINANCE 12.0
+
+layout(std430, binding = 22) readonly buffer luminanceHistogramBuffer
+{
+    uint histogram[LUMINANCE_BINS];
+};
+
+layout(std430, binding = 23) writeonly buffer luminanceStatisticsBuffer
+{
+    uint litPixelCount;
+    float averageLuminance;
+    float highlightLuminance;
+};
+
+uniform float highlightPercentile;
+
+shared uint cumulativeCounts[LUMINANCE_BINS];
+shared float cumulativeLog2Sums[LUMINANCE_BINS];
+
+float getBinLog2Luminance(uint bin)
+{
+    float binWidth = (MAX_LOG2_LUMINANCE - MIN_LOG2_LUMINANCE) / float(LUMINANCE_BINS - 1u);
+    return MIN_LOG2_LUMINANCE + (float(bin) - 0.5) * binWidth;
+}
+
+void main(void)
+{
+    uint bin = gl_LocalInvocationIndex;
+    uint count = bin == 0u ? 0u : histogram[bin];
+    cumulativeCounts[bin] = count;
+    cumulativeLog2Sums[bin] = bin == 0u ? 0.0 : float(count) * getBinLog2Luminance(bin);
+    barrier();
+
+    for (uint offset = 1u; offset < LUMINANCE_BINS; offset *= 2u)
+    {
+        uint previousCount = bin >= offset ? cumulativeCounts[bin - offset] : 0u;
+        float previousLog2Sum = bin >= offset ? cumulativeLog2Sums[bin - offset] : 0.0;
+        barrier();
+        cumulativeCounts[bin] += previousCount;
+        cumulativeLog2Sums[bin] += previousLog2Sum;
+        barrier();
+    }
+
+    uint total = cumulativeCounts[LUMINANCE_BINS - 1u];
+    if (bin == LUMINANCE_BINS - 1u)
+    {
+        litPixelCount = total;
+        averageLuminance = total > 0u ? exp2(cumulativeLog2Sums[bin] / float(total)) : 0.0;
+        if (total == 0u) highlightLuminance = 0.0;
+    }
+
+    if (total == 0u) return;
+    uint targetCount = clamp(uint(ceil(highlightPercentile * float(total))), 1u, total);
+    uint countBefore = cumulativeCounts[bin] - count;
+    if (countBefore < targetCount && cumulativeCounts[bin] >= targetCount)
+        highlightLuminance = exp2(getBinLog2Luminance(bin));
+}
@@ -0,0 +1,40 @@
+#version 440 core
+
+layout(local_size_x = 16, local_size_y = 16) in;
+
+/* Adds the fixed point luminance accumulated in monochrome mode during a
+   step to the traced image as gray, so that it is shown and composited
+   like a color image, and clears it for the next step. The traced image
+   is kept as unevaluated sums of two floats, so the integers only need to
+   hold a single step. This must match the raytracing shader. */
+layout(binding = 0, rgba32f) uniform image2D highImage;
+layout(binding = 1, r32ui) uniform uimage2D monochromeImage;
+layout(binding = 3, rgba32f) uniform image2D lowImage;
+
+/* Sum of squared luminance the denoiser estimates noise from, see the
+   raytracing shader. Rays are not added to it one by one in monochrome
+   mode, so the squared luminance of a whole step stands in for them. This
+   overestimates the noise of pixels reached by several rays in a step. */
+layout(binding = 2, r32f) uniform image2D secondMomentImage;
+#define MONOCHROME_WEIGHT_SCALE 256.0
+
+void main(void)
+{
+    ivec2 pixelCoordinates = ivec2(gl_GlobalInvocationID.xy);
+    if (any(greaterThanEqual(pixelCoordinates, imageSize(highImage)))) return;
+
+    uint fixedPointValue = imageLoad(monochromeImage, pixelCoordinates).r;
+    if (fixedPointValue == 0u) return;
+
+    vec3 value = vec3(float(fixedPointValue) / MONOCHROME_WEIGHT_SCALE);
+    vec3 high = imageLoad(highImage, pixelCoordinates).rgb;
+    vec3 low = imageLoad(lowImage, pixelCoordinates).rgb;
+    addCompensated(high, low, value);
+
+    imageStore(highImage, pixelCoordinates, vec4(high, 1.0));
+    imageStore(lowImage, pixelCoordinates, vec4(low, 0.0));
+    imageStore(monochromeImage, pixelCoordinates, uvec4(0u));
+
+    float moment = imageLoad(secondMomentImage, pixelCoordinates).r;
+    imageStore(secondMomentImage, pixelCoordinates, vec4(moment + value.g * value.g));
+}
@@ -0,0 +1,40 @@
+#version 440 core
+
+layout(local_size_x = 16, local_size_y = 16) in;
+layout(binding = 0, rgba32f) uniform readonly image2D tracedImage;
+layout(binding = 5, rgba32f) uniform writeonly image2D outputImage;
+
+/* Halo component layers accumulated by the raytracing shader. The traced
+   image contains all rays, so rays not in any layer are what is left
+   after subtracting the layers from it. */
+layout(binding = 6, rgba32f) uniform readonly image2DArray pathLayerImage;
+
+uniform int pathLayerCount;
+// Bit for each visible layer
+uniform int visiblePathLayers;
+uniform int otherRaysVisible;
+
+void main(void)
+{
+    ivec2 pixelCoordinates = ivec2(gl_GlobalInvocationID.xy);
+    ivec2 resolution = imageSize(outputImage);
+    if (any(greaterThanEqual(pixelCoordinates, resolution))) return;
+
+    vec3 layerSum = vec3(0.0);
+    vec3 visibleSum = vec3(0.0);
+    for (int layer = 0; layer < pathLayerCount; ++layer)
+    {
+        vec3 layerValue = imageLoad(pathLayerImage, ivec3(pixelCoordinates, layer)).rgb;
+        layerSum += layerValue;
+        if ((visiblePathLayers & (1 << layer)) != 0) visibleSum += layerValue;
+    }
+
+    vec3 value = visibleSum;
+    if (otherRaysVisible == 1)
+    {
+        vec3 tracedValue = imageLoad(tracedImage, pixelCoordinates).rgb;
+        value += max(tracedValue - layerSum, vec3(0.0));
+    }
+
+    imageStore(outputImage, pixelCoordinates, vec4(value, 1.0));
+}
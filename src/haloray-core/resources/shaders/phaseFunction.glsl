@@ -0,0 +1,164 @@
+#version 440 core
+
+layout(local_size_x = 16, local_size_y = 16) in;
+// The camera and getPixelDirection are inserted from cameraProjection.glsl
+layout(binding = 0, rgba32f) uniform readonly image2D tracedImage;
+layout(binding = 5, rgba32f) uniform writeonly image2D outputImage;
+
+/* Phase function of randomly oriented crystal populations, see the
+   PhaseFunction class for the layout */
+#define PHASE_FUNCTION_ANGLE_BINS 1800u
+#define PHASE_FUNCTION_WAVELENGTH_BINS 30u
+#define PHASE_FUNCTION_WEIGHT_SCALE 1024.0
+
+layout(std430, binding = 4) readonly buffer phaseFunctionBuffer
+{
+    uint phaseFunctionCounters[];
+};
+
+// RGB radiance per steradian for each scattering angle bin
+layout(std430, binding = 5) buffer phaseFunctionRadianceBuffer
+{
+    vec4 phaseFunctionRadiance[];
+};
+
+/* The phase function is first resolved into RGB radiance for each
+   scattering angle bin, and then added to the traced image through
+   the camera projection */
+#define PASS_RESOLVE 0
+#define PASS_COMPOSITE 1
+uniform int shaderPass;
+
+/* Number of rays the accumulated phase function is scaled to, relative
+   to the number of rays accumulated into it, so that the result matches
+   an image traced with the same number of rays */
+uniform float rayCountScale;
+
+uniform struct sunProperties_t
+{
+    float altitude;
+    float spectrum[31];
+} sun;
+
+uniform int atmosphereEnabled;
+
+float xFit_1931(float wave)
+{
+    float t1 = (wave - 442.0) * ((wave < 442.0) ? 0.0624 : 0.0374);
+    float t2 = (wave - 599.8) * ((wave < 599.8) ? 0.0264 : 0.0323);
+    float t3 = (wave - 501.1) * ((wave < 501.1) ? 0.0490 : 0.0382);
+    return 0.362 * exp(-0.5 * t1 * t1) + 1.056 * exp(-0.5 * t2 * t2) - 0.065f * exp(-0.5 * t3 * t3);
+}
+
+float yFit_1931(float wave)
+{
+    float t1 = (wave - 568.8) * ((wave < 568.8) ? 0.0213 : 0.0247);
+    float t2 = (wave - 530.9) * ((wave < 530.9) ? 0.0613 : 0.0322);
+    return 0.821 * exp(-0.5 * t1 * t1) + 0.286 * exp(-0.5 * t2 * t2);
+}
+
+float zFit_1931(float wave)
+{
+    float t1 = (wave - 437.0) * ((wave < 437.0) ? 0.0845 : 0.0278);
+    float t2 = (wave - 459.0) * ((wave < 459.0) ? 0.0385 : 0.0725);
+    return 1.217 * exp(-0.5 * t1 * t1) + 0.681 * exp(-0.5 * t2 * t2);
+}
+
+float daylightEstimate(float wavelength)
+{
+    return 1.0 - 0.0013333 * wavelength;
+}
+
+float sampleSunSpectrum(float wavelength)
+{
+    int index = clamp(int(floor((wavelength - 400.0) / 10.0)), 0, 29);
+    float wavelengthFract = (wavelength - (400.0 + index * 10.0)) / 10.0;
+    return mix(sun.spectrum[index], sun.spectrum[index + 1], wavelengthFract);
+}
+
+// Must match getRayColor in the raytracing shader
+vec3 getRayColor(float wavelength)
+{
+    float sunRadiance;
+    if (atmosphereEnabled == 1)
+    {
+        sunRadiance = sampleSunSpectrum(wavelength);
+    } else {
+        sunRadiance = daylightEstimate(wavelength);
+    }
+
+    vec3 cieXYZ = sunRadiance * vec3(xFit_1931(wavelength), yFit_1931(wavelength), zFit_1931(wavelength));
+    mat3 xyzToSrgb = mat3(3.24096994, -0.96924364, 0.05563008, -1.53738318, 1.8759675, -0.20397696, -0.49861076, 0.04155506, 1.05697151);
+    return xyzToSrgb * cieXYZ;
+}
+
+/* Wavelengths are traced uniformly within each bin, so the color of
+   a bin is averaged over a few wavelengths inside it */
+vec3 getWavelengthBinColor(uint wavelengthBin)
+{
+    vec3 color = vec3(0.0);
+    for (int i = 0; i < 4; ++i)
+        color += getRayColor(400.0 + 10.0 * (float(wavelengthBin) + (float(i) + 0.5) / 4.0));
+    return 0.25 * color;
+}
+
+void resolveRadiance(void)
+{
+    uint angleBin = gl_WorkGroupID.x * gl_WorkGroupSize.x * gl_WorkGroupSize.y + gl_LocalInvocationIndex;
+    if (angleBin >= PHASE_FUNCTION_ANGLE_BINS) return;
+
+    vec3 radiance = vec3(0.0);
+    for (uint wavelengthBin = 0u; wavelengthBin < PHASE_FUNCTION_WAVELENGTH_BINS; ++wavelengthBin)
+    {
+        uint counterIndex = 2u * (wavelengthBin * PHASE_FUNCTION_ANGLE_BINS + angleBin);
+        float weight = (float(phaseFunctionCounters[counterIndex + 1u]) * 4294967296.0 + float(phaseFunctionCounters[counterIndex])) / PHASE_FUNCTION_WEIGHT_SCALE;
+        radiance += weight * getWavelengthBinColor(wavelengthBin);
+    }
+
+    // Area of the ring between the two scattering angles on the unit sphere
+    float lowerAngle = PI * float(angleBin) / float(PHASE_FUNCTION_ANGLE_BINS);
+    float upperAngle = PI * float(angleBin + 1u) / float(PHASE_FUNCTION_ANGLE_BINS);
+    float solidAngle = 2.0 * PI * (cos(lowerAngle) - cos(upperAngle));
+
+    phaseFunctionRadiance[angleBin] = vec4(rayCountScale * radiance / solidAngle, 1.0);
+}
+
+vec3 getPhaseFunctionRadiance(vec3 direction)
+{
+    float scatteringAngle = acos(clamp(dot(direction, -getSunDirection(sun.altitude)), -1.0, 1.0));
+
+    // Interpolate linearly between the centers of the two nearest bins
+    float binCoordinate = scatteringAngle / PI * float(PHASE_FUNCTION_ANGLE_BINS) - 0.5;
+    int lowerBin = clamp(int(floor(binCoordinate)), 0, int(PHASE_FUNCTION_ANGLE_BINS) - 1);
+    int upperBin = min(lowerBin + 1, int(PHASE_FUNCTION_ANGLE_BINS) - 1);
+    float upperWeight = clamp(binCoordinate - float(lowerBin), 0.0, 1.0);
+    return mix(phaseFunctionRadiance[lowerBin].rgb, phaseFunctionRadiance[upperBin].rgb, upperWeight);
+}
+
+void composite(void)
+{
+    ivec2 pixelCoordinates = ivec2(gl_GlobalInvocationID.xy);
+    ivec2 resolution = imageSize(outputImage);
+    if (any(greaterThanEqual(pixelCoordinates, resolution))) return;
+
+    vec3 value = imageLoad(tracedImage, pixelCoordinates).rgb;
+
+    vec3 direction;
+    float solidAngle;
+    if (getPixelDirection(pixelCoordinates, vec2(resolution), direction, solidAngle))
+    {
+        value += solidAngle * getPhaseFunctionRadiance(direction);
+    }
+
+    imageStore(outputImage, pixelCoordinates, vec4(value, 1.0));
+}
+
+void main(void)
+{
+    if (shaderPass == PASS_RESOLVE)
+    {
+        resolveRadiance();
+    } else {
+        composite();
+    }
+}
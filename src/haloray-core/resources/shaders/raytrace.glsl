@@ -5,11 +5,67 @@ layout(binding = 0, rgba32f) uniform coherent image2D outputImage;
 
 /* MAX_HITS defines how many times
    a ray of light is allowed to bounce inside
-   the ice crystal before it is abandoned */
+   the ice crystal before it is abandoned. In practice
+   long paths are cut shorter by Russian roulette. */
 #define MAX_HITS 100
 
-uniform uint rngSeed;
+/* Path length histogram has one bin per escaped path length,
+   and three additional bins for rays terminated by Russian
+   roulette, rays trapped in a total internal reflection orbit
+   and rays reaching MAX_HITS */
+#define PATH_LENGTH_BINS (MAX_HITS + 3)
+#define PATH_TERMINATED_BY_ROULETTE MAX_HITS
+#define PATH_TRAPPED_IN_ORBIT (MAX_HITS + 1)
+#define PATH_REACHED_MAX_HITS (MAX_HITS + 2)
+
+#define RUSSIAN_ROULETTE_SURVIVAL_PROBABILITY 0.75
+
+// How closely a total internal reflection orbit must repeat its starting state
+#define ORBIT_POINT_TOLERANCE 1.0e-5
+#define ORBIT_DIRECTION_TOLERANCE 0.999999
+
+layout(std430, binding = 1) buffer pathLengthHistogram
+{
+    uint pathLengthCounts[];
+};
+
+uniform uint runSeed;
+uniform uvec2 rayIndexOffset;
 uniform float multipleScatter;
+uniform int russianRouletteDepth;
+uniform uint populationIndex;
+uniform int collectPathLengths;
+
+uniform int quasiRandomSampling;
+uniform uint sobolDirections[128];
+
+/* Sample dimensions of the quasi-random sampler. Dimensions are
+   shuffled in independent sets of four, so related dimensions
+   should be kept within the same set. The CPU kernels sample the
+   same dimensions in sceneTracer.cpp. */
+#define DIMENSION_SUN_DISK 0u
+#define DIMENSION_WAVELENGTH 2u
+#define DIMENSION_ORIENTATION_YAW 3u
+#define DIMENSION_TILT 4u
+#define DIMENSION_ROTATION 6u
+#define DIMENSION_ENTRY_TRIANGLE 8u
+#define DIMENSION_ENTRY_POINT 9u
+#define DIMENSION_ENTRY_FRESNEL 11u
+#define DIMENSION_CA_RATIO 12u
+#define DIMENSION_APEX_HEIGHTS 14u
+
+/* Each tabulated parameter replaces its normal distribution, and the
+   tilt and rotation tables are sampled from the dimensions path guiding
+   works on. Both apex heights share one normal pair, so their tables
+   need dimensions of their own. */
+#define DIMENSION_TILT_TABLE DIMENSION_TILT
+#define DIMENSION_ROTATION_TABLE DIMENSION_ROTATION
+#define DIMENSION_CA_RATIO_TABLE DIMENSION_CA_RATIO
+#define DIMENSION_UPPER_APEX_HEIGHT_TABLE 16u
+#define DIMENSION_LOWER_APEX_HEIGHT_TABLE 17u
+
+// Path guiding picks a cell first, and the guided dimensions are sampled within it
+#define DIMENSION_GUIDE_CELL 18u
 
 uniform struct sunProperties_t
 {
@@ -20,6 +76,50 @@ uniform struct sunProperties_t
 
 #define DISTRIBUTION_UNIFORM 0
 #define DISTRIBUTION_GAUSSIAN 1
+#define DISTRIBUTION_TABULATED 2
+
+#define TABLE_TILT 0
+#define TABLE_ROTATION 1
+#define TABLE_CA_RATIO 2
+#define TABLE_UPPER_APEX_HEIGHT 3
+#define TABLE_LOWER_APEX_HEIGHT 4
+#define NUM_DISTRIBUTION_TABLES 5
+
+/* Tabulated distributions with one row per tabulated parameter of each
+   crystal population. Each texel holds the cumulative probability at a
+   bin edge and the edge itself. Rows are padded with their last edge. */
+layout(binding = 3) uniform sampler2D distributionTables;
+
+/* General convex crystal shapes, compiled on the CPU side by the
+   ConvexPolyhedron class. Faces of all crystal populations are stored
+   in the same buffers, and each population refers to its own range
+   of faces. Each face is split into a triangle fan for sampling entry
+   points, and v0.w of each triangle holds the cumulative area fraction
+   of the fan up to and including the triangle. */
+struct CrystalFace
+{
+    // Outward normal in xyz, distance from crystal center in w
+    vec4 plane;
+    // Area, index of first triangle, number of triangles, unused
+    vec4 properties;
+};
+
+struct CrystalTriangle
+{
+    vec4 v0;
+    vec4 v1;
+    vec4 v2;
+};
+
+layout(std430, binding = 2) readonly buffer crystalFaceBuffer
+{
+    CrystalFace crystalFaces[];
+};
+
+layout(std430, binding = 3) readonly buffer crystalTriangleBuffer
+{
+    CrystalTriangle crystalTriangles[];
+};
 
 uniform struct crystalProperties_t
 {
@@ -43,6 +143,11 @@ uniform struct crystalProperties_t
     float lowerApexHeightStd;
 
     float prismFaceDistances[6];
+
+    int tabulatedParameters;
+
+    int customShapeFaceOffset;
+    int customShapeFaceCount;
 } crystalProperties;
 
 #define PROJECTION_STEREOGRAPHIC 0
@@ -60,8 +165,271 @@ uniform struct camera_t
     int hideSubHorizon;
 } camera;
 
+/* Rays can also be accumulated into extra output views, each with its own
+   camera and resolution. The views are layers of one image as large as the
+   largest view, and must match the OutputView class. */
+#define MAX_OUTPUT_VIEWS 4
+
+uniform int outputViewCount;
+uniform camera_t outputViews[MAX_OUTPUT_VIEWS];
+uniform ivec2 outputViewResolutions[MAX_OUTPUT_VIEWS];
+
+layout(binding = 4, rgba32f) uniform coherent image2DArray outputViewImage;
+
+/* In monochrome mode only the luminance of each ray is traced, and the main
+   image is accumulated in fixed point with integer atomics. Light is
+   rounded up or down at random, so that dim rays are not lost on average.
+   The integers are folded into the traced image and cleared after every
+   step, so a pixel only wraps around if it gets more than 2^32 units of
+   light in a single step. This must match the monochrome shader. */
+layout(binding = 1, r32ui) uniform coherent uimage2D monochromeImage;
+uniform int monochrome;
+#define MONOCHROME_WEIGHT_SCALE 256.0
+// Largest float below 2^32, which converts to an unsigned integer without overflowing
+#define MAX_FIXED_POINT_VALUE 4294967040.0
+
+/* Sum of the squared luminance of every ray reaching each pixel of the
+   main image. As each pixel is reached by only a small share of all rays,
+   it estimates the variance of the accumulated light in the pixel. In
+   monochrome mode the monochrome shader adds it once per step instead.
+   LUMINANCE_WEIGHTS is inserted from luminance.glsl. */
+layout(binding = 3, r32f) uniform coherent image2D secondMomentImage;
+
 uniform int atmosphereEnabled;
 
+/* When building a scattering table, rays are stored by their direction
+   in the world frame instead of being projected through the camera.
+   The mapping must match the ScatteringTable class. */
+uniform int directionTableOutput;
+
+/* Randomly oriented populations are accumulated into a phase function
+   of scattering angle and wavelength instead of the image. The layout
+   must match the PhaseFunction class. */
+uniform int phaseFunctionOutput;
+
+#define PHASE_FUNCTION_ANGLE_BINS 1800u
+#define PHASE_FUNCTION_WAVELENGTH_BINS 30u
+#define PHASE_FUNCTION_WEIGHT_SCALE 1024.0
+
+layout(std430, binding = 4) buffer phaseFunctionBuffer
+{
+    uint phaseFunctionCounters[];
+};
+
+/* Rays are either traced through the crystal directly, or sampled from
+   a transfer table of the crystal shape, which is first built by tracing
+   rays in the crystal frame. The layout must match the TransferTable
+   class. */
+#define TRACE_MODE_DIRECT 0
+#define TRACE_MODE_BUILD_TRANSFER_TABLE 1
+#define TRACE_MODE_TRANSFER_TABLE 2
+uniform int traceMode;
+
+#define TRANSFER_TABLE_INCIDENCE_RESOLUTION 256u
+#define TRANSFER_TABLE_SAMPLES_PER_CELL 16u
+
+/* Two vectors per sample: the exit direction scaled by the ray weight
+   and the wavelength, and the incidence direction the ray was traced from */
+layout(std430, binding = 6) buffer transferTableBuffer
+{
+    vec4 transferSamples[];
+};
+
+/* Sample slot of every cell to trace again, or -1 to build the whole
+   table */
+uniform int transferTableSlot;
+
+#define DIMENSION_TRANSFER_SAMPLE DIMENSION_ENTRY_TRIANGLE
+
+/* Rays that reach the image can be stored with the crystal parameters
+   they were sampled with, so that the image can be rebuilt for slightly
+   different parameter distributions. The layout must match the
+   SampleReweighting class and the reweighting shader. */
+uniform int recordSamples;
+uniform uint samplingEpochSlot;
+
+#define SAMPLE_RECORD_SIZE 7u
+
+layout(std430, binding = 7) buffer sampleRecordBuffer
+{
+    uint sampleRecordCount;
+    uint sampleRecords[];
+};
+
+/* Escaping rays can be dumped in the world frame for offline processing.
+   The layout must match the RayExitRecord struct. */
+uniform int dumpRays;
+
+#define RAY_DUMP_RECORD_SIZE 8u
+#define UNKNOWN_PATH_LENGTH 0xffffffffu
+
+layout(std430, binding = 10) buffer rayDumpBuffer
+{
+    uint rayDumpCount;
+    uint rayDumpRecords[];
+};
+
+// Internal reflections of the current ray, summed over all scattering events
+uint rayPathLength = 0u;
+
+/* Rays that scatter again are queued for the next scattering order,
+   which is traced by separate indirect dispatches for each population.
+   Each queue buffer starts with a header of four uints for each
+   population: the number of work groups to dispatch, two ones for the
+   other dispatch dimensions, and the number of queued rays. The header
+   is followed by a fixed size queue for each population. The layout
+   must match the continuation buffers of the simulation engine. */
+uniform int maxScatteringOrders;
+uniform int continuationPass;
+uniform int crossPopulationScattering;
+uniform uint continuationCapacity;
+uniform uint queuePopulationCount;
+
+#define CONTINUATION_RECORD_SIZE 9u
+#define CONTINUATION_HEADER_SIZE 4u
+
+layout(std430, binding = 12) readonly buffer continuationInputBuffer
+{
+    uint continuationInput[];
+};
+
+layout(std430, binding = 13) buffer continuationOutputBuffer
+{
+    uint continuationOutput[];
+};
+
+// Cumulative probabilities of the populations a ray scatters from next
+layout(std430, binding = 14) readonly buffer populationCdfBuffer
+{
+    float populationCdf[];
+};
+
+/* Rays can be split into halo component layers by their path through the
+   crystal. Each layer has a bit mask over path signatures for hexagonal
+   and custom crystals, see the PathFilter class. A ray goes to the first
+   layer that matches it. */
+uniform int pathLayerCount;
+
+#define PATH_FACE_BITS 6u
+#define PATH_SIGNATURE_COUNT 16384u
+#define PATH_BOUNCE_EXTERNAL_REFLECTION 0u
+
+layout(binding = 6, rgba32f) uniform coherent image2DArray pathLayerImage;
+
+layout(std430, binding = 11) readonly buffer pathLayerMaskBuffer
+{
+    uint pathLayerMasks[];
+};
+
+/* Rays can be traced from the center of the sun and accumulated into a
+   grid of directions around it, which is later convolved with the sun
+   disk and the diffraction patterns of the crystals. The grid has one
+   layer for each population and must match the SunConvolution class. */
+uniform int sunConvolution;
+
+#define SUN_CONVOLUTION_GRID_SIZE 1024
+#define SUN_CONVOLUTION_GRID_RADIUS 416
+#define SUN_CONVOLUTION_CELL_ANGLE radians(0.125)
+
+layout(binding = 7, rgba32f) uniform coherent image2DArray sunConvolutionGrid;
+
+/* Path guiding samples the random numbers of the crystal orientation and
+   entry face from cells that have sent rays into the image before. The
+   random numbers of the yaw, tilt, rotation and entry face form a grid of
+   cells for each population. The weight of rays reaching the image is
+   accumulated per cell into pairs of 32-bit fixed point counters, and
+   cells are picked from cumulative probabilities built from them. This
+   must match the PathGuide class. */
+uniform int pathGuiding;
+
+#define GUIDE_YAW_BINS 32u
+#define GUIDE_TILT_BINS 16u
+#define GUIDE_ROTATION_BINS 16u
+#define GUIDE_ENTRY_BINS 4u
+#define GUIDE_CELL_COUNT 32768u
+#define GUIDE_WEIGHT_SCALE 256.0
+#define GUIDE_NO_CELL 0xffffffffu
+
+layout(std430, binding = 15) readonly buffer pathGuideCdfBuffer
+{
+    float pathGuideCdf[];
+};
+
+layout(std430, binding = 16) buffer pathGuideCounterBuffer
+{
+    uint pathGuideCounters[];
+};
+
+/* Populations can get more or fewer rays than their probability would
+   give them, and their rays are weighted by the probability divided by
+   the share of rays to compensate. Second moments of the weights of rays
+   reaching the image are accumulated for each population into slots of
+   64-bit fixed point counters, spread to keep atomic operations from
+   piling up on one address. This must match the RayAllocation class. */
+uniform float populationWeight;
+uniform int recordRayMoments;
+
+#define RAY_MOMENT_SLOTS 64u
+#define RAY_MOMENT_SCALE 65536.0
+
+layout(std430, binding = 17) buffer rayMomentBuffer
+{
+    uint rayMomentCounters[];
+};
+
+/* Wavefront tracing splits each dispatch into stages connected by queues,
+   so that rays with long paths inside the crystal do not keep the rest of
+   their work group waiting. The generate stage samples rays and crystals
+   like a normal dispatch, but queues the rays entering a crystal instead
+   of tracing them. Each bounce stage traces the queued rays for a few
+   internal reflections and queues the ones still inside the crystal
+   again, packed together. The splat stage scatters the escaped rays again
+   or adds them to the image. Each queue starts with the same header as the
+   continuation queues, so that the next stage is dispatched indirectly.
+   Rays that do not fit in a queue are traced to the end right away. This
+   must match the Wavefront class. */
+uniform int wavefrontStage;
+uniform uint wavefrontCapacity;
+
+#define WAVEFRONT_DISABLED 0
+#define WAVEFRONT_STAGE_GENERATE 1
+#define WAVEFRONT_STAGE_BOUNCE 2
+#define WAVEFRONT_STAGE_SPLAT 3
+#define WAVEFRONT_BOUNCES_PER_PASS 8
+#define WAVEFRONT_HEADER_SIZE 4u
+#define RAY_STATE_SIZE 16
+#define BOUNCE_RECORD_SIZE 44u
+#define ESCAPE_RECORD_SIZE 24u
+
+layout(std430, binding = 18) readonly buffer bounceInputBuffer
+{
+    uint bounceInput[];
+};
+
+layout(std430, binding = 19) buffer bounceOutputBuffer
+{
+    uint bounceOutput[];
+};
+
+layout(std430, binding = 20) buffer escapeQueueBuffer
+{
+    uint escapeQueue[];
+};
+
+// Orientation and shape of the current crystal, kept for queueing rays between stages
+mat3 crystalRotation = mat3(1.0);
+vec3 crystalShape = vec3(0.0);
+
+// Path of the current ray through the crystal, zero if not known
+uint pathEntryFace = 0u;
+uint pathExitFace = 0u;
+uint pathBounceClass = 0u;
+
+// Parameters sampled from Gaussian distributions for the current ray
+float sampledTilt = 0.0;
+float sampledRotation = 0.0;
+float sampledCaRatio = 0.0;
+
 const float PI = 3.1415926535;
 
 struct intersection {
@@ -140,36 +508,159 @@ ivec3 triangles[] = ivec3[](
 
 vec3 triangleNormalCache[triangles.length()];
 
-uint wang_hash(uint a)
+/* Philox4x32-10 counter-based random number generator, equivalent to
+   the Philox class on the CPU side. The key is formed from the run seed
+   and the crystal population, and the counter from the index of the ray
+   within the population and the number of draws made so far. Random
+   numbers therefore only depend on which ray is being traced, not on
+   how rays are split into dispatches or between the GPU and the CPU
+   kernels, which draw the same numbers in randomStream.h. */
+
+uvec4 philox4x32(uvec4 counter, uvec2 key)
 {
-    a -= (a << 6);
-    a ^= (a >> 17);
-    a -= (a << 9);
-    a ^= (a << 4);
-    a -= (a << 3);
-    a ^= (a << 10);
-    a ^= (a >> 15);
-    return a;
+    for (int i = 0; i < 10; ++i)
+    {
+        uint high0, low0, high1, low1;
+        umulExtended(0xd2511f53u, counter.x, high0, low0);
+        umulExtended(0xcd9e8d57u, counter.z, high1, low1);
+        counter = uvec4(high1 ^ counter.y ^ key.x, low1, high0 ^ counter.w ^ key.y, low0);
+        key += uvec2(0x9e3779b9u, 0xbb67ae85u);
+    }
+    return counter;
 }
 
-uint rngState = wang_hash(rngSeed + uint(gl_GlobalInvocationID.x));
+uvec2 rayIndex;
+uvec4 rngCounter;
+uvec4 rngBuffer;
+int rngBufferPosition = 4;
+
+void initializeRandomNumberGenerator(void)
+{
+    uint carry;
+    rayIndex.x = uaddCarry(rayIndexOffset.x, gl_GlobalInvocationID.x, carry);
+    rayIndex.y = rayIndexOffset.y + carry;
+    rngCounter = uvec4(rayIndex, 0u, 0u);
+}
+
+uint rand_philox(void)
+{
+    if (rngBufferPosition == 4)
+    {
+        rngBuffer = philox4x32(rngCounter, uvec2(runSeed, populationIndex));
+        rngCounter.z += 1u;
+        rngBufferPosition = 0;
+    }
+    return rngBuffer[rngBufferPosition++];
+}
+
+float rand(void) { return float(rand_philox()) / 4294967295.0; }
+
+/* Owen-scrambled Sobol sequence, based on "Practical Hash-based
+   Owen Scrambling" by Brent Burley (2020). Direction numbers are
+   generated on the CPU side by the SobolSequence class. */
+
+uint laineKarrasPermutation(uint x, uint seed)
+{
+    x += seed;
+    x ^= x * 0x6c50b47cu;
+    x ^= x * 0xb82f1e52u;
+    x ^= x * 0xc7afe638u;
+    x ^= x * 0x8d22f6e6u;
+    return x;
+}
+
+uint nestedUniformScramble(uint x, uint seed)
+{
+    return bitfieldReverse(laineKarrasPermutation(bitfieldReverse(x), seed));
+}
+
+uint hashCombine(uint seed, uint value)
+{
+    return seed ^ (value + (seed << 6) + (seed >> 2));
+}
+
+uint sobol(uint index, uint dimension)
+{
+    uint result = 0u;
+    for (uint bit = 0u; index != 0u; ++bit, index >>= 1)
+    {
+        if ((index & 1u) != 0u) result ^= sobolDirections[dimension * 32u + bit];
+    }
+    return result;
+}
+
+/* The quasi-random sequence only covers the first scattering event.
+   Any further events and internal reflections use the pseudo-random
+   generator. */
+int scatteringEvent = 0;
+
+// Guide cell of the current ray and the random numbers chosen within it
+uint guideCell = GUIDE_NO_CELL;
+uvec4 guidedDimensions;
+vec4 guidedSample;
+
+float sampleDimension(uint dimension)
+{
+    if (guideCell != GUIDE_NO_CELL && scatteringEvent == 0)
+    {
+        for (int i = 0; i < 4; ++i)
+        {
+            if (dimension == guidedDimensions[i]) return guidedSample[i];
+        }
+    }
+
+    if (quasiRandomSampling == 0 || scatteringEvent > 0) return rand();
 
-uint rand_xorshift(void)
- {
-    // Xorshift algorithm from George Marsaglia's paper
-    rngState ^= (rngState << 13);
-    rngState ^= (rngState >> 17);
-    rngState ^= (rngState << 5);
-    return rngState;
- }
+    uint seed = hashCombine(laineKarrasPermutation(runSeed, 0x2545f491u), populationIndex);
+    uint shuffledIndex = nestedUniformScramble(rayIndex.x, hashCombine(seed, dimension / 4u));
+    uint value = nestedUniformScramble(sobol(shuffledIndex, dimension % 4u), hashCombine(seed, dimension + 0x9e3779b9u));
+    return float(value >> 8) / 16777216.0;
+}
 
-float rand(void) { return float(rand_xorshift()) / 4294967295.0; }
+vec2 randn(float u1, float u2)
+{
+    float radius = sqrt(-2.0 * log(max(u1, 1.0e-7)));
+    float angle = 2.0 * PI * u2;
+    return vec2(radius * cos(angle), radius * sin(angle));
+}
 
 vec2 randn(void)
 {
-    float u1 = sqrt(-2.0 * log(rand()));
-    float u2 = 2.0 * PI * rand();
-    return vec2(u1 * cos(u2), u1 * sin(u2));
+    return randn(rand(), rand());
+}
+
+vec2 randn(uint dimension)
+{
+    return randn(sampleDimension(dimension), sampleDimension(dimension + 1u));
+}
+
+bool isTabulated(int table)
+{
+    return (crystalProperties.tabulatedParameters & (1 << table)) != 0;
+}
+
+/* Inverts the cumulative distribution exactly like
+   TabulatedDistribution::sample, so that empty bins are never sampled */
+float sampleTable(int table, float u)
+{
+    int row = int(populationIndex) * NUM_DISTRIBUTION_TABLES + table;
+    u = min(u, 0.99999994);
+
+    // Binary search for the bin with lower cumulative probability <= u < upper
+    int lowerEdge = 0;
+    int upperEdge = textureSize(distributionTables, 0).x - 1;
+    while (upperEdge - lowerEdge > 1)
+    {
+        int middleEdge = (lowerEdge + upperEdge) / 2;
+        if (texelFetch(distributionTables, ivec2(middleEdge, row), 0).r <= u)
+            lowerEdge = middleEdge;
+        else
+            upperEdge = middleEdge;
+    }
+
+    vec2 lower = texelFetch(distributionTables, ivec2(lowerEdge, row), 0).rg;
+    vec2 upper = texelFetch(distributionTables, ivec2(upperEdge, row), 0).rg;
+    return mix(lower.g, upper.g, clamp((u - lower.r) / (upper.r - lower.r), 0.0, 1.0));
 }
 
 float xFit_1931(float wave)
@@ -200,6 +691,18 @@ float getIceIOR(float wavelength)
     return 1.3203 - 0.0000333 * wavelength;
 }
 
+// Caches the normal of the triangle and returns its area
+float cacheTriangleNormal(int triangleIndex)
+{
+    ivec3 triangle = triangles[triangleIndex];
+    vec3 v0 = vertices[triangle.x];
+    vec3 v1 = vertices[triangle.y];
+    vec3 v2 = vertices[triangle.z];
+    vec3 triangleCrossProduct = cross(v2 - v0, v1 - v0);
+    triangleNormalCache[triangleIndex] = normalize(triangleCrossProduct);
+    return 0.5 * length(triangleCrossProduct);
+}
+
 uint selectFirstTriangle(vec3 rayDirection)
 {
     // Calculate triangle normals and projected areas
@@ -207,21 +710,13 @@ uint selectFirstTriangle(vec3 rayDirection)
     float sumProjectedAreas = 0.0;
     for (int i = 0; i < triangles.length(); ++i)
     {
-        ivec3 triangle = triangles[i];
-        vec3 v0 = vertices[triangle.x];
-        vec3 v1 = vertices[triangle.y];
-        vec3 v2 = vertices[triangle.z];
-        vec3 triangleCrossProduct = cross(v2 - v0, v1 - v0);
-        float triangleArea = 0.5 * length(triangleCrossProduct);
-        vec3 triangleNormal = normalize(triangleCrossProduct);
-        triangleNormalCache[i] = triangleNormal;
-
-        triangleProjectedAreas[i] = max(0.0, triangleArea * dot(triangleNormal, -rayDirection));
+        float triangleArea = cacheTriangleNormal(i);
+        triangleProjectedAreas[i] = max(0.0, triangleArea * dot(triangleNormalCache[i], -rayDirection));
         sumProjectedAreas += triangleProjectedAreas[i];
     }
 
     // Select triangle to hit
-    float triangleSelector = rand() * sumProjectedAreas;
+    float triangleSelector = sampleDimension(DIMENSION_ENTRY_TRIANGLE) * sumProjectedAreas;
     for (int i = 0; i < triangleProjectedAreas.length(); ++i)
     {
         triangleSelector -= triangleProjectedAreas[i];
@@ -240,8 +735,8 @@ vec3 sampleTriangle(uint triangleIndex)
     vec3 v0 = vertices[triangle.x];
     vec3 v1 = vertices[triangle.y];
     vec3 v2 = vertices[triangle.z];
-    float u = rand();
-    float v = rand();
+    float u = sampleDimension(DIMENSION_ENTRY_POINT);
+    float v = sampleDimension(DIMENSION_ENTRY_POINT + 1u);
     if (u + v > 1.0) {
         u = 1.0 - u;
         v = 1.0 - v;
@@ -250,8 +745,70 @@ vec3 sampleTriangle(uint triangleIndex)
     return v0 + u * (v1 - v0) + v * (v2 - v0);
 }
 
+bool isCustomShape(void)
+{
+    return crystalProperties.customShapeFaceCount > 0;
+}
+
+/* Selects the entry face of a custom crystal shape with probability
+   proportional to its projected area, and samples a uniformly distributed
+   point on it. Returns the index of the face. */
+uint selectFirstFace(vec3 rayDirection, out vec3 startingPoint)
+{
+    int firstFace = crystalProperties.customShapeFaceOffset;
+    int lastFace = firstFace + crystalProperties.customShapeFaceCount;
+
+    float sumProjectedAreas = 0.0;
+    for (int i = firstFace; i < lastFace; ++i)
+    {
+        sumProjectedAreas += max(0.0, crystalFaces[i].properties.x * dot(crystalFaces[i].plane.xyz, -rayDirection));
+    }
+
+    float faceSelector = sampleDimension(DIMENSION_ENTRY_TRIANGLE) * sumProjectedAreas;
+    int faceIndex = firstFace;
+    float projectedArea = 0.0;
+    for (int i = firstFace; i < lastFace; ++i)
+    {
+        float area = max(0.0, crystalFaces[i].properties.x * dot(crystalFaces[i].plane.xyz, -rayDirection));
+        if (area <= 0.0) continue;
+        faceIndex = i;
+        projectedArea = area;
+        if (faceSelector < area) break;
+        faceSelector -= area;
+    }
+
+    // The remainder of the selector picks the triangle within the face
+    float triangleSelector = projectedArea > 0.0 ? clamp(faceSelector / projectedArea, 0.0, 1.0) : 0.0;
+    int firstTriangle = int(crystalFaces[faceIndex].properties.y);
+    int triangleCount = int(crystalFaces[faceIndex].properties.z);
+    int triangleIndex = firstTriangle + triangleCount - 1;
+    for (int i = firstTriangle; i < firstTriangle + triangleCount; ++i)
+    {
+        if (triangleSelector < crystalTriangles[i].v0.w)
+        {
+            triangleIndex = i;
+            break;
+        }
+    }
+
+    vec3 v0 = crystalTriangles[triangleIndex].v0.xyz;
+    vec3 v1 = crystalTriangles[triangleIndex].v1.xyz;
+    vec3 v2 = crystalTriangles[triangleIndex].v2.xyz;
+    float u = sampleDimension(DIMENSION_ENTRY_POINT);
+    float v = sampleDimension(DIMENSION_ENTRY_POINT + 1u);
+    if (u + v > 1.0) {
+        u = 1.0 - u;
+        v = 1.0 - v;
+    }
+    startingPoint = v0 + u * (v1 - v0) + v * (v2 - v0);
+
+    return uint(faceIndex);
+}
+
 vec3 getNormal(uint triangleIndex)
 {
+    // For custom crystal shapes the index refers to a face instead of a triangle
+    if (isCustomShape()) return -crystalFaces[triangleIndex].plane.xyz;
     return -triangleNormalCache[triangleIndex];
 }
 
@@ -269,8 +826,37 @@ float getReflectionCoefficient(vec3 normal, vec3 rayDir, float n0, float n1)
     return 0.5 * (rs + rp);
 }
 
+/* The exit point of a ray inside a convex crystal is on the closest
+   face plane the ray is heading towards, so there is no need to
+   test the ray against individual triangles */
+intersection findFaceIntersection(vec3 rayOrigin, vec3 rayDirection)
+{
+    int firstFace = crystalProperties.customShapeFaceOffset;
+    int lastFace = firstFace + crystalProperties.customShapeFaceCount;
+
+    int closestFace = -1;
+    float closestDistance = 1.0e30;
+    for (int i = firstFace; i < lastFace; ++i)
+    {
+        vec4 plane = crystalFaces[i].plane;
+        float cosine = dot(plane.xyz, rayDirection);
+        if (cosine <= 0.0) continue;
+        float t = (plane.w - dot(plane.xyz, rayOrigin)) / cosine;
+        if (t < closestDistance)
+        {
+            closestDistance = t;
+            closestFace = i;
+        }
+    }
+
+    if (closestFace < 0) return intersection(false, 0, vec3(0.0));
+    return intersection(true, uint(closestFace), rayOrigin + max(closestDistance, 0.0) * rayDirection);
+}
+
 intersection findIntersection(vec3 rayOrigin, vec3 rayDirection)
 {
+    if (isCustomShape()) return findFaceIntersection(rayOrigin, rayDirection);
+
     for (int triangleIndex = 0; triangleIndex < triangles.length(); ++triangleIndex)
     {
         ivec3 triangle = triangles[triangleIndex];
@@ -301,27 +887,107 @@ intersection findIntersection(vec3 rayOrigin, vec3 rayDirection)
     return intersection(false, 0, vec3(0.0));
 }
 
-vec3 traceRay(vec3 rayOrigin, vec3 rayDirection, float indexOfRefraction)
+void recordPathLength(uint bin)
+{
+    if (collectPathLengths == 0) return;
+    atomicAdd(pathLengthCounts[populationIndex * PATH_LENGTH_BINS + bin], 1u);
+}
+
+// Face numbers as in HaloSim, see the PathSignature namespace
+uint getFaceNumber(uint triangleIndex)
+{
+    if (isCustomShape()) return min(triangleIndex - uint(crystalProperties.customShapeFaceOffset) + 1u, (1u << PATH_FACE_BITS) - 1u);
+    if (triangleIndex < 4u) return 1u;
+    if (triangleIndex < 16u) return 13u + (triangleIndex - 4u) / 2u;
+    if (triangleIndex < 20u) return 2u;
+    if (triangleIndex < 32u) return 23u + (triangleIndex - 20u) / 2u;
+    return 3u + (triangleIndex - 32u) / 2u;
+}
+
+// Ray inside a crystal, with what is needed to continue tracing it later
+struct crystalRay {
+    vec3 origin;
+    vec3 direction;
+    float indexOfRefraction;
+    int hits;
+    /* Total internal reflection is deterministic, so a ray that hits
+       the same point in the same direction again without escaping in
+       between is bouncing around a closed orbit, and is not going to
+       escape. Matching only the face and direction would also catch
+       skew rays that still find their way out. */
+    bool totalInternalReflectionRun;
+    vec3 orbitStartPoint;
+    vec3 orbitStartDirection;
+};
+
+crystalRay startCrystalRay(vec3 rayOrigin, vec3 rayDirection, float indexOfRefraction)
+{
+    return crystalRay(rayOrigin, rayDirection, indexOfRefraction, 0, false, vec3(0.0), vec3(0.0));
+}
+
+/* Traces the ray until it escapes, is lost or has hit the crystal
+   hitLimit times in total. Returns false if the ray is still inside the
+   crystal, and otherwise the escaping ray, or zero if the ray was lost. */
+bool bounceRay(inout crystalRay ray, int hitLimit, inout float weight, out vec3 resultRay)
 {
-    vec3 ro = rayOrigin;
-    vec3 rd = rayDirection;
-    for (int i = 0; i < MAX_HITS; ++i)
+    resultRay = vec3(0.0);
+    for (; ray.hits < hitLimit; ++ray.hits)
     {
-        intersection hitResult = findIntersection(ro, rd);
-        if (hitResult.didHit == false) break;
+        int i = ray.hits;
+        intersection hitResult = findIntersection(ray.origin, ray.direction);
+        if (hitResult.didHit == false)
+        {
+            ray.hits = MAX_HITS;
+            break;
+        }
         vec3 normal = getNormal(hitResult.triangleIndex);
-        float reflectionCoefficient = getReflectionCoefficient(normal, rd, indexOfRefraction, 1.0);
+        float reflectionCoefficient = getReflectionCoefficient(normal, ray.direction, ray.indexOfRefraction, 1.0);
+
+        if (reflectionCoefficient >= 1.0)
+        {
+            if (ray.totalInternalReflectionRun == false)
+            {
+                ray.totalInternalReflectionRun = true;
+                ray.orbitStartPoint = hitResult.hitPoint;
+                ray.orbitStartDirection = ray.direction;
+            } else if (distance(hitResult.hitPoint, ray.orbitStartPoint) < ORBIT_POINT_TOLERANCE && dot(ray.direction, ray.orbitStartDirection) > ORBIT_DIRECTION_TOLERANCE) {
+                recordPathLength(PATH_TRAPPED_IN_ORBIT);
+                return true;
+            }
+        } else {
+            ray.totalInternalReflectionRun = false;
+        }
+
+        // Russian roulette, surviving rays are reweighted to keep the result unbiased
+        if (i >= russianRouletteDepth)
+        {
+            if (rand() > RUSSIAN_ROULETTE_SURVIVAL_PROBABILITY)
+            {
+                recordPathLength(PATH_TERMINATED_BY_ROULETTE);
+                return true;
+            }
+            weight /= RUSSIAN_ROULETTE_SURVIVAL_PROBABILITY;
+        }
+
         if (rand() < reflectionCoefficient)
         {
             // Ray reflects back into crystal
-            ro = hitResult.hitPoint;
-            rd = reflect(rd, normal);
+            ray.origin = hitResult.hitPoint;
+            ray.direction = reflect(ray.direction, normal);
         } else {
             // Ray refracts out of crystal
-            return refract(rd, normal, indexOfRefraction);
+            recordPathLength(i);
+            rayPathLength += uint(i);
+            pathExitFace = getFaceNumber(hitResult.triangleIndex);
+            pathBounceClass = uint(min(i, 2)) + 1u;
+            resultRay = refract(ray.direction, normal, ray.indexOfRefraction);
+            return true;
         }
     }
-    return vec3(0.0);
+
+    if (ray.hits < MAX_HITS) return false;
+    recordPathLength(PATH_REACHED_MAX_HITS);
+    return true;
 }
 
 vec3 getSunDirection(float altitude)
@@ -334,21 +1000,42 @@ vec3 getSunDirection(float altitude)
     ));
 }
 
-vec3 sampleSun(float altitude)
+vec3 sampleSunDisk(vec3 sunCenterDirection)
 {
-    vec3 sunCenterDirection = getSunDirection(altitude);
-
     // X axis is always perpendicular to the Y-Z plane
     vec3 diskBasis0 = vec3(1.0, 0.0, 0.0);
     vec3 diskBasis1 = cross(sunCenterDirection, diskBasis0);
     // Sample uniform point on disk
-    float sampleAngle = rand() * 2.0 * PI;
-    float sampleDistance = sqrt(rand()) * 0.5 * sun.diameter;
+    float sampleAngle = sampleDimension(DIMENSION_SUN_DISK) * 2.0 * PI;
+    float sampleDistance = sqrt(sampleDimension(DIMENSION_SUN_DISK + 1u)) * 0.5 * sun.diameter;
     vec3 offset = sampleDistance * (sin(sampleAngle) * diskBasis0 + cos(sampleAngle) * diskBasis1);
     vec3 sampleDirection = sunCenterDirection + offset;
     return normalize(sampleDirection);
 }
 
+vec3 sampleSun(float altitude)
+{
+    vec3 sunCenterDirection = getSunDirection(altitude);
+    // The sun disk is applied after tracing when it is convolved with the result
+    if (sunConvolution == 1) return sunCenterDirection;
+    return sampleSunDisk(sunCenterDirection);
+}
+
+/* Rotates a ray traced from the center of the sun as if it had come from
+   a sampled point on the sun disk instead, for rays that fall outside
+   the sun convolution grid */
+vec3 applySunDiskOffset(vec3 resultRay)
+{
+    vec3 sunCenterDirection = getSunDirection(sun.altitude);
+    vec3 sampleDirection = sampleSunDisk(sunCenterDirection);
+    vec3 axis = cross(sunCenterDirection, sampleDirection);
+    float sinAngle = length(axis);
+    if (sinAngle < 1.0e-7) return resultRay;
+    axis /= sinAngle;
+    float cosAngle = dot(sunCenterDirection, sampleDirection);
+    return resultRay * cosAngle + cross(axis, resultRay) * sinAngle + axis * dot(axis, resultRay) * (1.0 - cosAngle);
+}
+
 mat3 rotateAroundX(float angle)
 {
     return mat3(
@@ -376,22 +1063,77 @@ mat3 rotateAroundZ(float angle)
     );
 }
 
-mat3 getCameraOrientationMatrix()
+mat3 getCameraOrientationMatrix(camera_t view)
 {
-    return rotateAroundX(camera.pitch) * rotateAroundY(camera.yaw);
+    return rotateAroundX(view.pitch) * rotateAroundY(view.yaw);
 }
 
 mat3 getUniformRandomRotationMatrix(void)
 {
     // From Fast Random Rotation Matrices, by James Arvo
-    float theta = 2.0 * PI * rand();
-    float phi = 2.0 * PI * rand();
-    float z = rand();
+    float theta = 2.0 * PI * sampleDimension(DIMENSION_ORIENTATION_YAW);
+    float phi = 2.0 * PI * sampleDimension(DIMENSION_TILT);
+    float z = sampleDimension(DIMENSION_TILT + 1u);
     mat3 zRotationMatrix = mat3(cos(theta), -sin(theta), 0.0, sin(theta), cos(theta), 0.0, 0.0, 0.0, 1.0);
     vec3 reflectionVector = vec3(cos(phi) * sqrt(z), sin(phi) * sqrt(z), sqrt(1.0 - z));
     return (2.0 * outerProduct(reflectionVector, reflectionVector) - mat3(1.0, 0.0, 0.0, 0.0, 1.0, 0.0, 0.0, 0.0, 1.0)) * zRotationMatrix;
 }
 
+/* Moves the random numbers of the crystal orientation and entry face into
+   a cell picked from the guide, keeping their position within the cell.
+   The ray weight is divided by how much more likely the cell is than
+   with uniform random numbers. */
+void startPathGuiding(inout float weight)
+{
+    // Uniformly random orientations use the second tilt dimension instead of the rotation
+    bool randomOrientation = crystalProperties.tiltDistribution == DISTRIBUTION_UNIFORM && crystalProperties.rotationDistribution == DISTRIBUTION_UNIFORM;
+    guidedDimensions = uvec4(DIMENSION_ORIENTATION_YAW, DIMENSION_TILT, randomOrientation ? DIMENSION_TILT + 1u : DIMENSION_ROTATION, DIMENSION_ENTRY_TRIANGLE);
+    vec4 originalSample = vec4(sampleDimension(guidedDimensions.x), sampleDimension(guidedDimensions.y), sampleDimension(guidedDimensions.z), sampleDimension(guidedDimensions.w));
+
+    uint cdfOffset = populationIndex * GUIDE_CELL_COUNT;
+    float selector = sampleDimension(DIMENSION_GUIDE_CELL);
+    uint low = 0u;
+    uint high = GUIDE_CELL_COUNT - 1u;
+    while (low < high)
+    {
+        uint middle = (low + high) / 2u;
+        if (pathGuideCdf[cdfOffset + middle] > selector) high = middle;
+        else low = middle + 1u;
+    }
+
+    float cellProbability = pathGuideCdf[cdfOffset + low] - (low > 0u ? pathGuideCdf[cdfOffset + low - 1u] : 0.0);
+    if (cellProbability <= 0.0) return;
+
+    uvec4 bins = uvec4(GUIDE_YAW_BINS, GUIDE_TILT_BINS, GUIDE_ROTATION_BINS, GUIDE_ENTRY_BINS);
+    uvec4 cellCoordinates = uvec4(
+        low / (GUIDE_TILT_BINS * GUIDE_ROTATION_BINS * GUIDE_ENTRY_BINS),
+        (low / (GUIDE_ROTATION_BINS * GUIDE_ENTRY_BINS)) % GUIDE_TILT_BINS,
+        (low / GUIDE_ENTRY_BINS) % GUIDE_ROTATION_BINS,
+        low % GUIDE_ENTRY_BINS);
+    guidedSample = (vec4(cellCoordinates) + originalSample) / vec4(bins);
+    weight *= 1.0 / (float(GUIDE_CELL_COUNT) * cellProbability);
+    guideCell = low;
+}
+
+void recordGuideHit(float weight)
+{
+    if (guideCell == GUIDE_NO_CELL) return;
+    uint counterIndex = 2u * (populationIndex * GUIDE_CELL_COUNT + guideCell);
+    uint value = uint(min(weight * GUIDE_WEIGHT_SCALE + 0.5, MAX_FIXED_POINT_VALUE));
+    uint previous = atomicAdd(pathGuideCounters[counterIndex], value);
+    if (previous + value < previous) atomicAdd(pathGuideCounters[counterIndex + 1u], 1u);
+}
+
+void recordRayMoment(float weight)
+{
+    // The moment is of the weight the ray would have without reallocation
+    float unscaledWeight = weight / populationWeight;
+    uint slot = populationIndex * RAY_MOMENT_SLOTS + gl_GlobalInvocationID.x % RAY_MOMENT_SLOTS;
+    uint value = uint(min(unscaledWeight * unscaledWeight * RAY_MOMENT_SCALE + 0.5, MAX_FIXED_POINT_VALUE));
+    uint previous = atomicAdd(rayMomentCounters[2u * slot], value);
+    if (previous + value < previous) atomicAdd(rayMomentCounters[2u * slot + 1u], 1u);
+}
+
 vec2 cartesianToPolar(vec3 direction)
 {
     float r = atan(length(direction.xy), direction.z);
@@ -412,26 +1154,33 @@ mat3 getRotationMatrix(void)
     // Rotation around crystal C-axis
     mat3 rotationMat;
 
-    if (crystalProperties.tiltDistribution == DISTRIBUTION_UNIFORM) {
-        tiltMat = rotateAroundZ(rand() * 2.0 * PI);
+    if (isTabulated(TABLE_TILT)) {
+        tiltMat = rotateAroundZ(sampleTable(TABLE_TILT, sampleDimension(DIMENSION_TILT_TABLE)));
+    } else if (crystalProperties.tiltDistribution == DISTRIBUTION_UNIFORM) {
+        tiltMat = rotateAroundZ(sampleDimension(DIMENSION_TILT) * 2.0 * PI);
     } else {
         float angleAverage = crystalProperties.tiltAverage;
         float angleStd = crystalProperties.tiltStd;
-        float tiltAngle = angleAverage + angleStd * randn().x;
+        float tiltAngle = angleAverage + angleStd * randn(DIMENSION_TILT).x;
+        sampledTilt = tiltAngle;
         tiltMat = rotateAroundZ(tiltAngle);
     }
 
-    if (crystalProperties.rotationDistribution == DISTRIBUTION_UNIFORM)
+    if (isTabulated(TABLE_ROTATION))
+    {
+        rotationMat = rotateAroundY(sampleTable(TABLE_ROTATION, sampleDimension(DIMENSION_ROTATION_TABLE)));
+    } else if (crystalProperties.rotationDistribution == DISTRIBUTION_UNIFORM)
     {
-        rotationMat = rotateAroundY(rand() * 2.0 * PI);
+        rotationMat = rotateAroundY(sampleDimension(DIMENSION_ROTATION) * 2.0 * PI);
     } else {
         float angleAverage = crystalProperties.rotationAverage;
         float angleStd = crystalProperties.rotationStd;
-        float rotationAngle = angleAverage + angleStd * randn().x;
+        float rotationAngle = angleAverage + angleStd * randn(DIMENSION_ROTATION).x;
+        sampledRotation = rotationAngle;
         rotationMat = rotateAroundY(rotationAngle);
     }
 
-    return rotateAroundY(rand() * 2.0 * PI) * tiltMat * rotationMat;
+    return rotateAroundY(sampleDimension(DIMENSION_ORIENTATION_YAW) * 2.0 * PI) * tiltMat * rotationMat;
 }
 
 float daylightEstimate(float wavelength)
@@ -446,6 +1195,46 @@ float sampleSunSpectrum(float wavelength)
     return mix(sun.spectrum[index], sun.spectrum[index + 1], wavelengthFract);
 }
 
+float getSunRadiance(float wavelength)
+{
+    if (atmosphereEnabled == 1)
+    {
+        return sampleSunSpectrum(wavelength);
+    } else {
+        return daylightEstimate(wavelength);
+    }
+}
+
+vec3 getRayColor(float wavelength)
+{
+    float sunRadiance = getSunRadiance(wavelength);
+    vec3 cieXYZ = sunRadiance * vec3(xFit_1931(wavelength), yFit_1931(wavelength), zFit_1931(wavelength));
+    mat3 xyzToSrgb = mat3(3.24096994, -0.96924364, 0.05563008, -1.53738318, 1.8759675, -0.20397696, -0.49861076, 0.04155506, 1.05697151);
+    return xyzToSrgb * cieXYZ;
+}
+
+// Luminance of the color of a ray, which is gray in linear sRGB
+vec3 getRayLuminance(float wavelength)
+{
+    return vec3(getSunRadiance(wavelength) * yFit_1931(wavelength));
+}
+
+void recordPhaseFunction(vec3 resultRay, float wavelength, float weight)
+{
+    // Angle between the ray and light coming straight from the center of the sun
+    float scatteringAngle = acos(clamp(dot(resultRay, -getSunDirection(sun.altitude)), -1.0, 1.0));
+    uint angleBin = min(uint(scatteringAngle / PI * float(PHASE_FUNCTION_ANGLE_BINS)), PHASE_FUNCTION_ANGLE_BINS - 1u);
+    uint wavelengthBin = min(uint((wavelength - 400.0) / 10.0), PHASE_FUNCTION_WAVELENGTH_BINS - 1u);
+    uint counterIndex = 2u * (wavelengthBin * PHASE_FUNCTION_ANGLE_BINS + angleBin);
+
+    /* Weights are accumulated as 64-bit fixed point numbers, carrying
+       overflows of the low word into the high word */
+    uint value = uint(min(weight * PHASE_FUNCTION_WEIGHT_SCALE + 0.5, MAX_FIXED_POINT_VALUE));
+    uint previousValue = atomicAdd(phaseFunctionCounters[counterIndex], value);
+    if (previousValue + value < previousValue)
+        atomicAdd(phaseFunctionCounters[counterIndex + 1u], 1u);
+}
+
 void storePixel(ivec2 pixelCoordinates, vec3 value)
 {
     memoryBarrierImage();
@@ -453,27 +1242,308 @@ void storePixel(ivec2 pixelCoordinates, vec3 value)
     imageStore(outputImage, pixelCoordinates, vec4(currentValue + value, 1.0));
 }
 
-vec3 castRayThroughCrystal(vec3 rayDirection, float wavelength)
+// Adds the square of the luminance a ray brings to a pixel, from which the denoiser estimates the noise of the pixel
+void storeSecondMoment(ivec2 pixelCoordinates, float luminance)
+{
+    memoryBarrierImage();
+    float currentValue = imageLoad(secondMomentImage, pixelCoordinates).r;
+    imageStore(secondMomentImage, pixelCoordinates, vec4(currentValue + luminance * luminance));
+}
+
+void storeMonochromePixel(ivec2 pixelCoordinates, float value)
+{
+    uint fixedPointValue = uint(min(value * MONOCHROME_WEIGHT_SCALE + rand(), MAX_FIXED_POINT_VALUE));
+    if (fixedPointValue > 0u) imageAtomicAdd(monochromeImage, pixelCoordinates, fixedPointValue);
+}
+
+void storeOutputView(ivec2 pixelCoordinates, int view, vec3 value)
+{
+    ivec3 viewCoordinates = ivec3(pixelCoordinates, view);
+    memoryBarrierImage();
+    vec3 currentValue = imageLoad(outputViewImage, viewCoordinates).xyz;
+    imageStore(outputViewImage, viewCoordinates, vec4(currentValue + value, 1.0));
+}
+
+/* Adds the ray to the sun convolution grid, or returns false if it is
+   too far from the sun to be in it. The grid is an azimuthal equidistant
+   projection around the sun, like in the sun convolution shader. */
+bool storeSunConvolutionGrid(vec3 resultRay, vec3 value)
+{
+    // Direction in the sky the ray is seen from
+    vec3 viewDirection = -normalize(resultRay);
+    vec3 sunCenterDirection = getSunDirection(sun.altitude);
+    float angleFromSun = acos(clamp(dot(viewDirection, sunCenterDirection), -1.0, 1.0));
+    if (angleFromSun >= float(SUN_CONVOLUTION_GRID_RADIUS) * SUN_CONVOLUTION_CELL_ANGLE) return false;
+
+    vec3 gridBasis1 = cross(sunCenterDirection, vec3(1.0, 0.0, 0.0));
+    vec2 tangent = vec2(viewDirection.x, dot(viewDirection, gridBasis1));
+    float tangentLength = length(tangent);
+    vec2 gridPosition = tangentLength > 0.0 ? angleFromSun / tangentLength * tangent : vec2(0.0);
+    ivec2 cell = ivec2(floor(gridPosition / SUN_CONVOLUTION_CELL_ANGLE + 0.5)) + SUN_CONVOLUTION_GRID_SIZE / 2;
+
+    ivec3 gridCoordinates = ivec3(cell, int(populationIndex));
+    memoryBarrierImage();
+    vec3 currentValue = imageLoad(sunConvolutionGrid, gridCoordinates).xyz;
+    imageStore(sunConvolutionGrid, gridCoordinates, vec4(currentValue + value, 1.0));
+    return true;
+}
+
+/* Everything about the current ray that is not in the queue records
+   themselves, so that a ray continues from another stage with the same
+   random numbers as if it had been traced in one go */
+void packRayState(out uint state[RAY_STATE_SIZE])
+{
+    state[0] = rayIndex.x;
+    state[1] = rayIndex.y;
+    state[2] = rngCounter.z;
+    state[3] = rngCounter.w;
+    for (int i = 0; i < 4; ++i) state[4 + i] = rngBuffer[i];
+    state[8] = uint(rngBufferPosition);
+    state[9] = rayPathLength;
+    state[10] = pathEntryFace | (pathExitFace << 8u) | (pathBounceClass << 16u);
+    state[11] = guideCell;
+    state[12] = uint(scatteringEvent);
+    state[13] = floatBitsToUint(sampledTilt);
+    state[14] = floatBitsToUint(sampledRotation);
+    state[15] = floatBitsToUint(sampledCaRatio);
+}
+
+void unpackRayState(uint state[RAY_STATE_SIZE])
 {
-    uint triangleIndex = selectFirstTriangle(rayDirection);
-    vec3 startingPoint = sampleTriangle(triangleIndex);
+    rayIndex = uvec2(state[0], state[1]);
+    rngCounter = uvec4(rayIndex, state[2], state[3]);
+    for (int i = 0; i < 4; ++i) rngBuffer[i] = state[4 + i];
+    rngBufferPosition = int(state[8]);
+    rayPathLength = state[9];
+    pathEntryFace = state[10] & 0xffu;
+    pathExitFace = (state[10] >> 8u) & 0xffu;
+    pathBounceClass = state[10] >> 16u;
+    guideCell = state[11];
+    scatteringEvent = int(state[12]);
+    sampledTilt = uintBitsToFloat(state[13]);
+    sampledRotation = uintBitsToFloat(state[14]);
+    sampledCaRatio = uintBitsToFloat(state[15]);
+}
+
+/* Queues a ray inside a crystal for the next bounce stage. Returns false
+   if the queue is full. */
+bool queueBounce(crystalRay ray, float wavelength, float weight)
+{
+    uint index = atomicAdd(bounceOutput[3], 1u);
+    if (index >= wavefrontCapacity) return false;
+
+    // The first ray of each work group adds the group to the indirect dispatch
+    if (index % gl_WorkGroupSize.x == 0u) atomicAdd(bounceOutput[0], 1u);
+
+    uint offset = WAVEFRONT_HEADER_SIZE + index * BOUNCE_RECORD_SIZE;
+    uint state[RAY_STATE_SIZE];
+    packRayState(state);
+    for (int i = 0; i < RAY_STATE_SIZE; ++i) bounceOutput[offset + uint(i)] = state[i];
+    offset += uint(RAY_STATE_SIZE);
+
+    for (int i = 0; i < 3; ++i)
+    {
+        bounceOutput[offset + uint(i)] = floatBitsToUint(ray.origin[i]);
+        bounceOutput[offset + 3u + uint(i)] = floatBitsToUint(ray.direction[i]);
+        bounceOutput[offset + 10u + uint(i)] = floatBitsToUint(ray.orbitStartPoint[i]);
+        bounceOutput[offset + 13u + uint(i)] = floatBitsToUint(ray.orbitStartDirection[i]);
+        bounceOutput[offset + 16u + uint(i)] = floatBitsToUint(crystalShape[i]);
+        for (int j = 0; j < 3; ++j) bounceOutput[offset + 19u + uint(3 * i + j)] = floatBitsToUint(crystalRotation[i][j]);
+    }
+    bounceOutput[offset + 6u] = floatBitsToUint(ray.indexOfRefraction);
+    bounceOutput[offset + 7u] = floatBitsToUint(wavelength);
+    bounceOutput[offset + 8u] = floatBitsToUint(weight);
+    bounceOutput[offset + 9u] = uint(ray.hits) | (ray.totalInternalReflectionRun ? 0x10000u : 0u);
+    return true;
+}
+
+// Loads a ray queued by the previous stage, or returns false if there are no more rays
+bool loadBounce(out crystalRay ray, out float wavelength, out float weight)
+{
+    uint index = gl_GlobalInvocationID.x;
+    if (index >= min(bounceInput[3], wavefrontCapacity)) return false;
+
+    uint offset = WAVEFRONT_HEADER_SIZE + index * BOUNCE_RECORD_SIZE;
+    uint state[RAY_STATE_SIZE];
+    for (int i = 0; i < RAY_STATE_SIZE; ++i) state[i] = bounceInput[offset + uint(i)];
+    unpackRayState(state);
+    offset += uint(RAY_STATE_SIZE);
+
+    for (int i = 0; i < 3; ++i)
+    {
+        ray.origin[i] = uintBitsToFloat(bounceInput[offset + uint(i)]);
+        ray.direction[i] = uintBitsToFloat(bounceInput[offset + 3u + uint(i)]);
+        ray.orbitStartPoint[i] = uintBitsToFloat(bounceInput[offset + 10u + uint(i)]);
+        ray.orbitStartDirection[i] = uintBitsToFloat(bounceInput[offset + 13u + uint(i)]);
+        crystalShape[i] = uintBitsToFloat(bounceInput[offset + 16u + uint(i)]);
+        for (int j = 0; j < 3; ++j) crystalRotation[i][j] = uintBitsToFloat(bounceInput[offset + 19u + uint(3 * i + j)]);
+    }
+    ray.indexOfRefraction = uintBitsToFloat(bounceInput[offset + 6u]);
+    wavelength = uintBitsToFloat(bounceInput[offset + 7u]);
+    weight = uintBitsToFloat(bounceInput[offset + 8u]);
+    uint hitWord = bounceInput[offset + 9u];
+    ray.hits = int(hitWord & 0xffffu);
+    ray.totalInternalReflectionRun = (hitWord & 0x10000u) != 0u;
+    return true;
+}
+
+/* Queues a ray escaped from a crystal in the world frame for the splat
+   stage. Returns false if the queue is full. */
+bool queueEscapedRay(vec3 resultRay, float wavelength, float weight)
+{
+    uint index = atomicAdd(escapeQueue[3], 1u);
+    if (index >= wavefrontCapacity) return false;
+    if (index % gl_WorkGroupSize.x == 0u) atomicAdd(escapeQueue[0], 1u);
+
+    uint offset = WAVEFRONT_HEADER_SIZE + index * ESCAPE_RECORD_SIZE;
+    uint state[RAY_STATE_SIZE];
+    packRayState(state);
+    for (int i = 0; i < RAY_STATE_SIZE; ++i) escapeQueue[offset + uint(i)] = state[i];
+    offset += uint(RAY_STATE_SIZE);
+
+    for (int i = 0; i < 3; ++i) escapeQueue[offset + uint(i)] = floatBitsToUint(resultRay[i]);
+    escapeQueue[offset + 3u] = floatBitsToUint(wavelength);
+    escapeQueue[offset + 4u] = floatBitsToUint(weight);
+    for (int i = 0; i < 3; ++i) escapeQueue[offset + 5u + uint(i)] = floatBitsToUint(crystalShape[i]);
+    return true;
+}
+
+bool loadEscapedRay(out vec3 resultRay, out float wavelength, out float weight)
+{
+    uint index = gl_GlobalInvocationID.x;
+    if (index >= min(escapeQueue[3], wavefrontCapacity)) return false;
+
+    uint offset = WAVEFRONT_HEADER_SIZE + index * ESCAPE_RECORD_SIZE;
+    uint state[RAY_STATE_SIZE];
+    for (int i = 0; i < RAY_STATE_SIZE; ++i) state[i] = escapeQueue[offset + uint(i)];
+    unpackRayState(state);
+    offset += uint(RAY_STATE_SIZE);
+
+    for (int i = 0; i < 3; ++i) resultRay[i] = uintBitsToFloat(escapeQueue[offset + uint(i)]);
+    wavelength = uintBitsToFloat(escapeQueue[offset + 3u]);
+    weight = uintBitsToFloat(escapeQueue[offset + 4u]);
+    for (int i = 0; i < 3; ++i) crystalShape[i] = uintBitsToFloat(escapeQueue[offset + 5u + uint(i)]);
+    return true;
+}
+
+vec3 castRayThroughCrystal(vec3 rayDirection, float wavelength, inout float weight)
+{
+    uint triangleIndex;
+    vec3 startingPoint;
+    if (isCustomShape()) {
+        triangleIndex = selectFirstFace(rayDirection, startingPoint);
+    } else {
+        triangleIndex = selectFirstTriangle(rayDirection);
+        startingPoint = sampleTriangle(triangleIndex);
+    }
     vec3 startingPointNormal = -getNormal(triangleIndex);
     float indexOfRefraction = getIceIOR(wavelength);
     float reflectionCoeff = getReflectionCoefficient(startingPointNormal, rayDirection, 1.0, indexOfRefraction);
     vec3 resultRay = vec3(0.0);
-    if (rand() < reflectionCoeff)
+    pathEntryFace = getFaceNumber(triangleIndex);
+    if (sampleDimension(DIMENSION_ENTRY_FRESNEL) < reflectionCoeff)
     {
         // Ray reflects off crystal
         resultRay = reflect(rayDirection, startingPointNormal);
+        pathExitFace = pathEntryFace;
+        pathBounceClass = PATH_BOUNCE_EXTERNAL_REFLECTION;
     } else {
         // Ray enters crystal
         vec3 refractedRayDirection = refract(rayDirection, startingPointNormal, 1.0 / indexOfRefraction);
-        resultRay = traceRay(startingPoint, refractedRayDirection, indexOfRefraction);
+        crystalRay ray = startCrystalRay(startingPoint, refractedRayDirection, indexOfRefraction);
+
+        // In the generate stage the ray is traced later, and nothing escapes for now
+        if (wavefrontStage == WAVEFRONT_STAGE_GENERATE && queueBounce(ray, wavelength, weight)) return vec3(0.0);
+        bounceRay(ray, MAX_HITS, weight, resultRay);
     }
 
     return resultRay;
 }
 
+// Octahedral equal-area mapping, see TransferTable::getSquareCoordinates
+vec2 getTransferTableCoordinates(vec3 direction)
+{
+    vec3 absolute = abs(direction);
+    float r = sqrt((absolute.x * absolute.x + absolute.z * absolute.z) / (1.0 + absolute.y));
+    float a = max(absolute.x, absolute.z);
+    float phi = a == 0.0 ? 0.0 : atan(min(absolute.x, absolute.z) / a) * 2.0 / PI;
+    if (absolute.x < absolute.z) phi = 1.0 - phi;
+
+    vec2 uv = vec2(r - phi * r, phi * r);
+    if (direction.y < 0.0) uv = 1.0 - uv.yx;
+    return 0.5 * (vec2(direction.x < 0.0 ? -uv.x : uv.x, direction.z < 0.0 ? -uv.y : uv.y) + 1.0);
+}
+
+vec3 getTransferTableDirection(vec2 coordinates)
+{
+    vec2 signedCoordinates = 2.0 * coordinates - 1.0;
+    vec2 absolute = abs(signedCoordinates);
+    float signedDistance = 1.0 - (absolute.x + absolute.y);
+    float r = 1.0 - abs(signedDistance);
+    float phi = (r == 0.0 ? 1.0 : (absolute.y - absolute.x) / r + 1.0) * PI / 4.0;
+    float horizontal = r * sqrt(max(0.0, 2.0 - r * r));
+    return vec3(
+        (signedCoordinates.x < 0.0 ? -cos(phi) : cos(phi)) * horizontal,
+        signedDistance < 0.0 ? r * r - 1.0 : 1.0 - r * r,
+        (signedCoordinates.y < 0.0 ? -sin(phi) : sin(phi)) * horizontal);
+}
+
+uint getTransferTableCell(vec3 direction)
+{
+    uvec2 cell = min(uvec2(getTransferTableCoordinates(direction) * float(TRANSFER_TABLE_INCIDENCE_RESOLUTION)),
+                     uvec2(TRANSFER_TABLE_INCIDENCE_RESOLUTION - 1u));
+    return cell.y * TRANSFER_TABLE_INCIDENCE_RESOLUTION + cell.x;
+}
+
+void buildTransferTable(void)
+{
+    uint sampleIndex = transferTableSlot < 0 ? gl_GlobalInvocationID.x : gl_GlobalInvocationID.x * TRANSFER_TABLE_SAMPLES_PER_CELL + uint(transferTableSlot);
+    if (2u * sampleIndex >= uint(transferSamples.length())) return;
+
+    // Each ray is traced from its own direction within the cell
+    uint cell = sampleIndex / TRANSFER_TABLE_SAMPLES_PER_CELL;
+    vec2 cellCoordinates = vec2(cell % TRANSFER_TABLE_INCIDENCE_RESOLUTION, cell / TRANSFER_TABLE_INCIDENCE_RESOLUTION);
+    vec3 rayDirection = getTransferTableDirection((cellCoordinates + vec2(rand(), rand())) / float(TRANSFER_TABLE_INCIDENCE_RESOLUTION));
+    float wavelength = 400.0 + rand() * 300.0;
+    float weight = 1.0;
+    vec3 resultRay = castRayThroughCrystal(rayDirection, wavelength, weight);
+
+    if (length(resultRay) < 0.0001)
+    {
+        transferSamples[2u * sampleIndex] = vec4(0.0, 0.0, 0.0, wavelength);
+    } else {
+        transferSamples[2u * sampleIndex] = vec4(weight * normalize(resultRay), wavelength);
+    }
+    transferSamples[2u * sampleIndex + 1u] = vec4(rayDirection, 0.0);
+}
+
+/* Picks a ray traced from the transfer table cell of the given incidence
+   direction in the crystal frame. The ray was traced from another
+   direction within the cell, so its exit direction is rotated by the
+   smallest rotation from that direction to the actual incidence
+   direction. */
+vec3 sampleTransferTable(vec3 rayDirection, out float wavelength, inout float weight)
+{
+    uint cell = getTransferTableCell(rayDirection);
+    uint sampleOffset = min(uint(sampleDimension(DIMENSION_TRANSFER_SAMPLE) * float(TRANSFER_TABLE_SAMPLES_PER_CELL)), TRANSFER_TABLE_SAMPLES_PER_CELL - 1u);
+    uint sampleIndex = cell * TRANSFER_TABLE_SAMPLES_PER_CELL + sampleOffset;
+    vec4 transferSample = transferSamples[2u * sampleIndex];
+    wavelength = transferSample.w;
+    float transferWeight = length(transferSample.xyz);
+    if (transferWeight < 0.0001) return vec3(0.0);
+
+    // The ray may already be weighted by path guiding
+    weight *= transferWeight;
+    vec3 exitDirection = transferSample.xyz / transferWeight;
+    vec3 tracedDirection = transferSamples[2u * sampleIndex + 1u].xyz;
+    vec3 rotationAxis = cross(tracedDirection, rayDirection);
+    float cosAngle = dot(tracedDirection, rayDirection);
+    if (cosAngle <= -0.9999) return exitDirection;
+
+    // Rodrigues' rotation formula with an unnormalized axis
+    return exitDirection * cosAngle + cross(rotationAxis, exitDirection) + rotationAxis * dot(rotationAxis, exitDirection) / (1.0 + cosAngle);
+}
+
 /* Lines are represented in Hesse normal form, where X component
    of the vector is the closest distance from origin to the line,
    and Y component of the vector is the angle of the line's normal
@@ -493,8 +1563,158 @@ vec2 lineIntersect(vec2 line1, vec2 line2)
     return vec2(x, y);
 }
 
-void initializeCrystal()
+void recordSample(vec2 pixelPosition, vec3 value)
+{
+    uint recordIndex = atomicAdd(sampleRecordCount, 1u);
+    if (recordIndex >= uint(sampleRecords.length()) / SAMPLE_RECORD_SIZE) return;
+
+    // Colors are stored in half precision, so they are clamped to its range
+    value = min(value, vec3(65504.0));
+
+    uint offset = recordIndex * SAMPLE_RECORD_SIZE;
+    sampleRecords[offset] = floatBitsToUint(pixelPosition.x);
+    sampleRecords[offset + 1u] = floatBitsToUint(pixelPosition.y);
+    sampleRecords[offset + 2u] = floatBitsToUint(sampledTilt);
+    sampleRecords[offset + 3u] = floatBitsToUint(sampledRotation);
+    sampleRecords[offset + 4u] = floatBitsToUint(sampledCaRatio);
+    sampleRecords[offset + 5u] = packHalf2x16(value.rg);
+    sampleRecords[offset + 6u] = (packHalf2x16(vec2(value.b, 0.0)) & 0xffffu) | (samplingEpochSlot << 16);
+}
+
+void dumpRay(vec3 direction, float wavelength, float weight)
+{
+    uint recordIndex = atomicAdd(rayDumpCount, 1u);
+    if (recordIndex >= uint(rayDumpRecords.length()) / RAY_DUMP_RECORD_SIZE) return;
+
+    uint offset = recordIndex * RAY_DUMP_RECORD_SIZE;
+    rayDumpRecords[offset] = floatBitsToUint(direction.x);
+    rayDumpRecords[offset + 1u] = floatBitsToUint(direction.y);
+    rayDumpRecords[offset + 2u] = floatBitsToUint(direction.z);
+    rayDumpRecords[offset + 3u] = floatBitsToUint(wavelength);
+    rayDumpRecords[offset + 4u] = populationIndex;
+    rayDumpRecords[offset + 5u] = floatBitsToUint(weight);
+    rayDumpRecords[offset + 6u] = rayPathLength;
+    rayDumpRecords[offset + 7u] = uint(scatteringEvent + 1);
+}
+
+uint getPathSignature(void)
+{
+    // Paths are only classified for rays scattered once
+    if (pathExitFace == 0u || scatteringEvent > 0) return 0u;
+    return pathEntryFace | (pathExitFace << PATH_FACE_BITS) | (pathBounceClass << (2u * PATH_FACE_BITS));
+}
+
+void storePathLayer(ivec2 pixelCoordinates, vec3 value)
+{
+    uint signature = getPathSignature();
+    if (signature == 0u) return;
+
+    uint maskOffset = isCustomShape() ? 1u : 0u;
+    for (int layer = 0; layer < pathLayerCount; ++layer)
+    {
+        uint maskWord = pathLayerMasks[(2u * uint(layer) + maskOffset) * (PATH_SIGNATURE_COUNT / 32u) + signature / 32u];
+        if ((maskWord & (1u << (signature % 32u))) != 0u)
+        {
+            ivec3 layerCoordinates = ivec3(pixelCoordinates, layer);
+            memoryBarrierImage();
+            vec3 currentValue = imageLoad(pathLayerImage, layerCoordinates).xyz;
+            imageStore(pathLayerImage, layerCoordinates, vec4(currentValue + value, 1.0));
+            return;
+        }
+    }
+}
+
+uint getContinuationOffset(uint population, uint index)
+{
+    return queuePopulationCount * CONTINUATION_HEADER_SIZE + (population * continuationCapacity + index) * CONTINUATION_RECORD_SIZE;
+}
+
+uint selectNextPopulation(void)
+{
+    if (crossPopulationScattering == 0) return populationIndex;
+
+    float u = rand();
+    for (uint i = 0u; i + 1u < queuePopulationCount; ++i)
+    {
+        if (u < populationCdf[i]) return i;
+    }
+    return queuePopulationCount - 1u;
+}
+
+/* Queues the ray to be scattered again by a crystal of the next
+   population. Returns false if the queue is full. Rays are counted even
+   when they do not fit, so that the next pass can weight up the rays
+   that did. */
+bool queueContinuation(vec3 direction, float wavelength, float weight)
+{
+    uint population = selectNextPopulation();
+    uint headerOffset = population * CONTINUATION_HEADER_SIZE;
+    uint index = atomicAdd(continuationOutput[headerOffset + 3u], 1u);
+    if (index >= continuationCapacity) return false;
+
+    // The first ray of each work group adds the group to the indirect dispatch
+    if (index % gl_WorkGroupSize.x == 0u) atomicAdd(continuationOutput[headerOffset], 1u);
+
+    uint offset = getContinuationOffset(population, index);
+    continuationOutput[offset] = floatBitsToUint(direction.x);
+    continuationOutput[offset + 1u] = floatBitsToUint(direction.y);
+    continuationOutput[offset + 2u] = floatBitsToUint(direction.z);
+    continuationOutput[offset + 3u] = floatBitsToUint(wavelength);
+    continuationOutput[offset + 4u] = floatBitsToUint(weight);
+    continuationOutput[offset + 5u] = rayPathLength;
+    continuationOutput[offset + 6u] = rngCounter.x;
+    continuationOutput[offset + 7u] = rngCounter.y;
+    continuationOutput[offset + 8u] = (rngCounter.w & 0xffff00u) | uint(scatteringEvent + 1);
+    return true;
+}
+
+/* Loads a queued ray for the next scattering event. Random numbers
+   continue from the ray index of the original ray, in a stream of its
+   own for every scattering event. If more rays were queued than fit,
+   the rays that fit stand in for the dropped ones. */
+bool loadContinuation(out vec3 direction, out float wavelength, out float weight)
+{
+    uint index = gl_GlobalInvocationID.x;
+    uint count = continuationInput[populationIndex * CONTINUATION_HEADER_SIZE + 3u];
+    if (index >= min(count, continuationCapacity)) return false;
+
+    uint offset = getContinuationOffset(populationIndex, index);
+    direction = vec3(uintBitsToFloat(continuationInput[offset]),
+                     uintBitsToFloat(continuationInput[offset + 1u]),
+                     uintBitsToFloat(continuationInput[offset + 2u]));
+    wavelength = uintBitsToFloat(continuationInput[offset + 3u]);
+    weight = uintBitsToFloat(continuationInput[offset + 4u]);
+    if (count > continuationCapacity) weight *= float(count) / float(continuationCapacity);
+    rayPathLength = continuationInput[offset + 5u];
+    uint eventWord = continuationInput[offset + 8u];
+    scatteringEvent = int(eventWord & 0xffu);
+    rayIndex = uvec2(continuationInput[offset + 6u], continuationInput[offset + 7u]);
+    rngCounter = uvec4(rayIndex, 0u, eventWord);
+    rngBufferPosition = 4;
+    return true;
+}
+
+// Scatters a ray in the world frame by a crystal of the current population
+vec3 scatterRay(vec3 direction, float wavelength, inout float weight)
+{
+    // Rotation matrix to orient ray/crystal
+    mat3 rotationMatrix = getRotationMatrix();
+    crystalRotation = rotationMatrix;
+
+    /* The inverse rotation matrix must be applied because we are
+    rotating the incoming ray and not the crystal itself. */
+    vec3 rotatedRayDirection = normalize(direction * rotationMatrix);
+
+    vec3 resultRay = castRayThroughCrystal(rotatedRayDirection, wavelength, weight);
+    if (length(resultRay) < 0.0001) return vec3(0.0);
+    return rotationMatrix * resultRay;
+}
+
+/* Builds the vertices of a hexagonal crystal from its C/A ratio
+   multiplier and the heights of its pyramid caps */
+void buildCrystal(vec3 shape)
 {
+    crystalShape = shape;
     float deltaAngle = radians(60.0);
     vec2 hexagonCorners[6];
     /* The sqrt(3)/2 multiplier makes the default crystal such
@@ -560,108 +1780,279 @@ void initializeCrystal()
     }
 
     // Stretch the crystal to correct C/A ratio
-    float caMultiplier = max(0.0, crystalProperties.caRatioAverage + randn().x * crystalProperties.caRatioStd);
     for (int i = 0; i < vertices.length(); ++i)
     {
-        vertices[i].y *= max(0.0, caMultiplier);
+        vertices[i].y *= shape.x;
     }
 
     // Scale pyramid caps
     float upperApexMaxHeight = sizeScaler / tan(crystalProperties.upperApexAngle / 2.0);
     float lowerApexMaxHeight = sizeScaler / tan(crystalProperties.lowerApexAngle / 2.0);
 
-    vec2 random = randn();
-    float upperApexHeight = clamp(crystalProperties.upperApexHeightAverage + crystalProperties.upperApexHeightStd * random.x, 0.0, 1.0);
-    float lowerApexHeight = clamp(crystalProperties.lowerApexHeightAverage + crystalProperties.lowerApexHeightStd * random.y, 0.0, 1.0);
-
     for (int i = 0; i < 6; ++i)
     {
-        vertices[i].xz *= 1.0 - upperApexHeight;
-        vertices[i].y += upperApexHeight * upperApexMaxHeight;
+        vertices[i].xz *= 1.0 - shape.y;
+        vertices[i].y += shape.y * upperApexMaxHeight;
 
-        vertices[vertices.length() - i - 1].xz *= 1.0 - lowerApexHeight;
-        vertices[vertices.length() - i - 1].y -= lowerApexHeight * lowerApexMaxHeight;
+        vertices[vertices.length() - i - 1].xz *= 1.0 - shape.z;
+        vertices[vertices.length() - i - 1].y -= shape.z * lowerApexMaxHeight;
     }
 }
 
-void main(void)
+void initializeCrystal()
 {
-    initializeCrystal();
+    float caMultiplier;
+    if (isTabulated(TABLE_CA_RATIO)) {
+        caMultiplier = sampleTable(TABLE_CA_RATIO, sampleDimension(DIMENSION_CA_RATIO_TABLE));
+    } else {
+        caMultiplier = crystalProperties.caRatioAverage + randn(DIMENSION_CA_RATIO).x * crystalProperties.caRatioStd;
+        sampledCaRatio = caMultiplier;
+    }
 
-    vec3 rayDirection = -sampleSun(sun.altitude);
-    float wavelength = 400.0 + rand() * 300.0;
+    vec2 random = randn(DIMENSION_APEX_HEIGHTS);
+    float upperApexHeight = crystalProperties.upperApexHeightAverage + crystalProperties.upperApexHeightStd * random.x;
+    float lowerApexHeight = crystalProperties.lowerApexHeightAverage + crystalProperties.lowerApexHeightStd * random.y;
+    if (isTabulated(TABLE_UPPER_APEX_HEIGHT)) upperApexHeight = sampleTable(TABLE_UPPER_APEX_HEIGHT, sampleDimension(DIMENSION_UPPER_APEX_HEIGHT_TABLE));
+    if (isTabulated(TABLE_LOWER_APEX_HEIGHT)) lowerApexHeight = sampleTable(TABLE_LOWER_APEX_HEIGHT, sampleDimension(DIMENSION_LOWER_APEX_HEIGHT_TABLE));
 
-    // Rotation matrix to orient ray/crystal
-    mat3 rotationMatrix = getRotationMatrix();
+    buildCrystal(vec3(max(0.0, caMultiplier), clamp(upperApexHeight, 0.0, 1.0), clamp(lowerApexHeight, 0.0, 1.0)));
+}
 
-    /* The inverse rotation matrix must be applied because we are
-    rotating the incoming ray and not the crystal itself. */
-    vec3 rotatedRayDirection = normalize(rayDirection * rotationMatrix);
+/* Finds the point in pixels a ray is seen at through a camera, or returns
+   false if the camera does not see it */
+bool projectRay(vec3 resultRay, camera_t view, ivec2 resolution, out vec2 pixelPosition)
+{
+    // Hide subhorizon rays
+    if (view.hideSubHorizon == 1 && resultRay.y > 0.0) return false;
 
-    vec3 resultRay = castRayThroughCrystal(rotatedRayDirection, wavelength);
+    float aspectRatio = float(resolution.y) / float(resolution.x);
 
-    if (length(resultRay) < 0.0001) return;
+    vec3 viewRay = normalize(-getCameraOrientationMatrix(view) * resultRay);
+    vec2 polar = cartesianToPolar(viewRay);
+
+    float projectionFunction;
+
+    // The projection converts 3D vectors to 2D points
+    if (view.projection == PROJECTION_STEREOGRAPHIC) {
+        projectionFunction = 2.0 * tan(polar.x / 2.0);
+    } else if (view.projection == PROJECTION_RECTILINEAR) {
+        if (polar.x > 0.5 * PI) return false;
+        projectionFunction = tan(polar.x);
+    } else if (view.projection == PROJECTION_EQUIDISTANT) {
+        projectionFunction = polar.x;
+    } else if (view.projection == PROJECTION_EQUAL_AREA) {
+        projectionFunction = 2.0 * sin(polar.x / 2.0);
+    } else if (view.projection == PROJECTION_ORTHOGRAPHIC) {
+        if (polar.x > 0.5 * PI) return false;
+        projectionFunction = sin(polar.x);
+    }
+
+    vec2 projected = view.focalLength * projectionFunction * vec2(aspectRatio * cos(polar.y), sin(polar.y));
+    vec2 normalizedCoordinates = 0.5 + projected;
 
-    resultRay = rotationMatrix * resultRay;
+    if (any(lessThanEqual(normalizedCoordinates, vec2(0.0))) || any(greaterThanEqual(normalizedCoordinates, vec2(1.0))))
+        return false;
+
+    pixelPosition = vec2(resolution) * normalizedCoordinates;
+    return true;
+}
 
-    if (multipleScatter != 0.0 && multipleScatter > rand())
+/* Adds light to the pixels under the splat filter around a point in
+   pixels, in an output view or in the main image if the view is negative.
+   getSplatWeights is inserted from splatFilter.glsl. */
+void storeFiltered(vec2 pixelPosition, ivec2 resolution, int view, vec3 value)
+{
+    int firstX;
+    int firstY;
+    float weightsX[MAX_SPLAT_FOOTPRINT];
+    float weightsY[MAX_SPLAT_FOOTPRINT];
+    int countX = getSplatWeights(pixelPosition.x, firstX, weightsX);
+    int countY = getSplatWeights(pixelPosition.y, firstY, weightsY);
+
+    // Rays are stored once, and the filter is applied again when they are reweighted
+    if (view < 0 && recordSamples == 1) recordSample(pixelPosition, value);
+
+    for (int j = 0; j < countY; ++j)
     {
-        // Rotation matrix to orient ray/crystal
-        rotationMatrix = getRotationMatrix();
+        for (int i = 0; i < countX; ++i)
+        {
+            ivec2 pixelCoordinates = ivec2(firstX + i, firstY + j);
+            float pixelWeight = weightsX[i] * weightsY[j];
+            if (pixelWeight <= 0.0 || any(lessThan(pixelCoordinates, ivec2(0))) || any(greaterThanEqual(pixelCoordinates, resolution))) continue;
+
+            vec3 pixelValue = pixelWeight * value;
+            if (view >= 0)
+            {
+                storeOutputView(pixelCoordinates, view, pixelValue);
+                continue;
+            }
+            if (monochrome == 1)
+            {
+                storeMonochromePixel(pixelCoordinates, pixelValue.g);
+            } else {
+                storePixel(pixelCoordinates, pixelValue);
+                storeSecondMoment(pixelCoordinates, dot(pixelValue, LUMINANCE_WEIGHTS));
+            }
+            if (pathLayerCount > 0) storePathLayer(pixelCoordinates, pixelValue);
+        }
+    }
+}
 
-        /* The inverse rotation matrix must be applied because we are
-        rotating the incoming ray and not the crystal itself. */
-        rotatedRayDirection = normalize(resultRay * rotationMatrix);
+// Scatters an escaped ray again, or adds it to the image
+void splatRay(vec3 resultRay, float wavelength, float weight)
+{
+    while (scatteringEvent + 1 < maxScatteringOrders && multipleScatter != 0.0 && multipleScatter > rand())
+    {
+        /* A ray that does not fit in the queue of the population it
+        picked is dropped, and is made up for by the ray weights of the
+        next pass */
+        queueContinuation(resultRay, wavelength, weight);
+        return;
+    }
 
-        resultRay = castRayThroughCrystal(rotatedRayDirection, wavelength);
+    if (dumpRays == 1) dumpRay(normalize(resultRay), wavelength, weight);
 
-        if (length(resultRay) < 0.0001) return;
+    if (phaseFunctionOutput == 1)
+    {
+        recordPhaseFunction(resultRay, wavelength, weight);
+        return;
+    }
 
-        resultRay = rotationMatrix * resultRay;
+    if (directionTableOutput == 1)
+    {
+        ivec2 tableSize = imageSize(outputImage);
+        vec2 tableCoordinates = vec2(atan(resultRay.x, resultRay.z) / (2.0 * PI) + 0.5, 0.5 * (clamp(resultRay.y, -1.0, 1.0) + 1.0));
+        ivec2 tableCell = clamp(ivec2(tableCoordinates * vec2(tableSize)), ivec2(0), tableSize - 1);
+        storePixel(tableCell, weight * getRayColor(wavelength));
+        return;
     }
 
-    // Hide subhorizon rays
-    if (camera.hideSubHorizon == 1 && resultRay.y > 0.0) return;
+    if (sunConvolution == 1)
+    {
+        if (storeSunConvolutionGrid(resultRay, weight * getRayColor(wavelength)))
+        {
+            if (pathGuiding == 1) recordGuideHit(weight / populationWeight);
+            if (recordRayMoments == 1 && continuationPass == 0) recordRayMoment(weight);
+            return;
+        }
+        resultRay = applySunDiskOffset(resultRay);
+    }
+
+    vec3 color = weight * (monochrome == 1 ? getRayLuminance(wavelength) : getRayColor(wavelength));
+    for (int view = 0; view < outputViewCount; ++view)
+    {
+        vec2 viewPosition;
+        if (projectRay(resultRay, outputViews[view], outputViewResolutions[view], viewPosition))
+            storeFiltered(viewPosition, outputViewResolutions[view], view, color);
+    }
 
     ivec2 resolution = imageSize(outputImage);
-    float aspectRatio = float(resolution.y) / float(resolution.x);
+    vec2 pixelPosition;
+    if (!projectRay(resultRay, camera, resolution, pixelPosition)) return;
 
-    resultRay = normalize(-getCameraOrientationMatrix() * resultRay);
-    vec2 polar = cartesianToPolar(resultRay);
+    storeFiltered(pixelPosition, resolution, -1, color);
+    if (pathGuiding == 1) recordGuideHit(weight / populationWeight);
+    if (recordRayMoments == 1 && continuationPass == 0) recordRayMoment(weight);
+}
 
-    float projectionFunction;
+// Bounce stage of wavefront tracing
+void continueBounces(void)
+{
+    crystalRay ray;
+    float wavelength;
+    float weight;
+    if (!loadBounce(ray, wavelength, weight)) return;
+    if (!isCustomShape())
+    {
+        buildCrystal(crystalShape);
+        for (int i = 0; i < triangles.length(); ++i) cacheTriangleNormal(i);
+    }
 
-    // The projection converts 3D vectors to 2D points
-    if (camera.projection == PROJECTION_STEREOGRAPHIC) {
-        projectionFunction = 2.0 * tan(polar.x / 2.0);
-    } else if (camera.projection == PROJECTION_RECTILINEAR) {
-        if (polar.x > 0.5 * PI) return;
-        projectionFunction = tan(polar.x);
-    } else if (camera.projection == PROJECTION_EQUIDISTANT) {
-        projectionFunction = polar.x;
-    } else if (camera.projection == PROJECTION_EQUAL_AREA) {
-        projectionFunction = 2.0 * sin(polar.x / 2.0);
-    } else if (camera.projection == PROJECTION_ORTHOGRAPHIC) {
-        if (polar.x > 0.5 * PI) return;
-        projectionFunction = sin(polar.x);
+    vec3 resultRay;
+    if (!bounceRay(ray, min(ray.hits + WAVEFRONT_BOUNCES_PER_PASS, MAX_HITS), weight, resultRay))
+    {
+        if (queueBounce(ray, wavelength, weight)) return;
+
+        // The queue is full, so the ray is traced to the end right away
+        bounceRay(ray, MAX_HITS, weight, resultRay);
     }
 
-    vec2 projected = camera.focalLength * projectionFunction * vec2(aspectRatio * cos(polar.y), sin(polar.y));
-    vec2 normalizedCoordinates = 0.5 + projected;
+    if (length(resultRay) < 0.0001) return;
+    resultRay = crystalRotation * resultRay;
+    if (continuationPass == 0) rngCounter.w = populationIndex << 8;
 
-    if (any(lessThanEqual(normalizedCoordinates, vec2(0.0))) || any(greaterThanEqual(normalizedCoordinates, vec2(1.0))))
+    if (queueEscapedRay(resultRay, wavelength, weight)) return;
+    splatRay(resultRay, wavelength, weight);
+}
+
+void main(void)
+{
+    initializeRandomNumberGenerator();
+    if (wavefrontStage == WAVEFRONT_STAGE_BOUNCE)
+    {
+        continueBounces();
         return;
+    }
 
-    float sunRadiance;
-    if (atmosphereEnabled == 1)
+    if (wavefrontStage == WAVEFRONT_STAGE_SPLAT)
     {
-        sunRadiance = sampleSunSpectrum(wavelength);
+        vec3 resultRay;
+        float wavelength;
+        float weight;
+        if (loadEscapedRay(resultRay, wavelength, weight)) splatRay(resultRay, wavelength, weight);
+        return;
+    }
+
+    float wavelength;
+    float weight = 1.0;
+    vec3 resultRay;
+    if (continuationPass == 1)
+    {
+        // The crystal is drawn from the random stream of the loaded ray
+        vec3 rayDirection;
+        if (!loadContinuation(rayDirection, wavelength, weight)) return;
+        if (!isCustomShape()) initializeCrystal();
+        resultRay = scatterRay(rayDirection, wavelength, weight);
     } else {
-        sunRadiance = daylightEstimate(wavelength);
+        if (traceMode != TRACE_MODE_TRANSFER_TABLE && !isCustomShape()) initializeCrystal();
+
+        if (traceMode == TRACE_MODE_BUILD_TRANSFER_TABLE)
+        {
+            buildTransferTable();
+            return;
+        }
+
+        vec3 rayDirection = -sampleSun(sun.altitude);
+        wavelength = 400.0 + sampleDimension(DIMENSION_WAVELENGTH) * 300.0;
+        weight = populationWeight;
+
+        if (pathGuiding == 1) startPathGuiding(weight);
+
+        // Rotation matrix to orient ray/crystal
+        mat3 rotationMatrix = getRotationMatrix();
+        crystalRotation = rotationMatrix;
+
+        /* The inverse rotation matrix must be applied because we are
+        rotating the incoming ray and not the crystal itself. */
+        vec3 rotatedRayDirection = normalize(rayDirection * rotationMatrix);
+
+        if (traceMode == TRACE_MODE_TRANSFER_TABLE)
+        {
+            resultRay = sampleTransferTable(rotatedRayDirection, wavelength, weight);
+            rayPathLength = UNKNOWN_PATH_LENGTH;
+        } else {
+            resultRay = castRayThroughCrystal(rotatedRayDirection, wavelength, weight);
+        }
+
+        if (length(resultRay) < 0.0001) return;
+        resultRay = rotationMatrix * resultRay;
+
+        // Random streams of later scattering events are told apart by the population the ray started from
+        rngCounter.w = populationIndex << 8;
     }
 
-    ivec2 pixelCoordinates = ivec2(resolution.x * normalizedCoordinates.x, resolution.y * normalizedCoordinates.y);
-    vec3 cieXYZ = sunRadiance * vec3(xFit_1931(wavelength), yFit_1931(wavelength), zFit_1931(wavelength));
-    mat3 xyzToSrgb = mat3(3.24096994, -0.96924364, 0.05563008, -1.53738318, 1.8759675, -0.20397696, -0.49861076, 0.04155506, 1.05697151);
-    storePixel(pixelCoordinates, xyzToSrgb * cieXYZ);
+    if (length(resultRay) < 0.0001) return;
+
+    if (wavefrontStage == WAVEFRONT_STAGE_GENERATE && queueEscapedRay(resultRay, wavelength, weight)) return;
+    splatRay(resultRay, wavelength, weight);
 }
@@ -6,6 +6,10 @@ uniform float adjustedExposure;
 layout (binding = 0) uniform sampler2D haloTexture;
 layout (binding = 1) uniform sampler2D backgroundTexture;
 
+// Share of the denoised halo texture shown instead of the raw one
+uniform float denoiseBlend;
+layout (binding = 2) uniform sampler2D denoisedHaloTexture;
+
 #define FXAA_REDUCE_MIN   (1.0/ 128.0)
 #define FXAA_REDUCE_MUL   (1.0 / 8.0)
 #define FXAA_SPAN_MAX     8.0
@@ -68,7 +72,10 @@ vec4 fxaa(sampler2D tex, vec2 fragCoord)
 void main(void) {
     vec4 antialiasedBackground = fxaa(backgroundTexture, gl_FragCoord.xy);
     vec3 backgroundLinearSrgb = max(vec3(0.0), baseExposure * antialiasedBackground.rgb);
-    vec3 haloLinearSrgb = adjustedExposure * texelFetch(haloTexture, ivec2(gl_FragCoord.xy), 0).xyz;
+    vec3 halo = texelFetch(haloTexture, ivec2(gl_FragCoord.xy), 0).xyz;
+    if (denoiseBlend > 0.0)
+        halo = mix(halo, texelFetch(denoisedHaloTexture, ivec2(gl_FragCoord.xy), 0).xyz, denoiseBlend);
+    vec3 haloLinearSrgb = adjustedExposure * halo;
     vec3 linearImage = 0.005 * backgroundLinearSrgb + 0.1 * haloLinearSrgb;
     vec3 gammaCorrected = 1.055 * pow(linearImage, vec3(0.417)) - 0.055;
     color = vec4(clamp(gammaCorrected, 0.0, 1.0), 1.0);
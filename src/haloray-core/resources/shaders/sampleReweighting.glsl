@@ -0,0 +1,98 @@
+#version 440 core
+
+layout(local_size_x = 64) in;
+layout(binding = 0, rgba32f) uniform coherent image2D outputImage;
+/* Sum of the squared luminance of the rays in each pixel, see the
+   raytracing shader. LUMINANCE_WEIGHTS is inserted from luminance.glsl,
+   and getSplatWeights from splatFilter.glsl. */
+layout(binding = 3, r32f) uniform coherent image2D secondMomentImage;
+
+/* Rays stored by the raytracing shader, see the SampleReweighting class
+   for the layout */
+#define SAMPLE_RECORD_SIZE 7u
+#define MAX_SAMPLING_EPOCHS 16u
+#define FLOATS_PER_DISTRIBUTIONS 8u
+
+layout(std430, binding = 7) readonly buffer sampleRecordBuffer
+{
+    uint sampleRecordCount;
+    uint sampleRecords[];
+};
+
+// Distributions each population was traced with in each sampling epoch
+layout(std430, binding = 8) readonly buffer samplingDistributionBuffer
+{
+    float samplingDistributions[];
+};
+
+// Distributions each population is reweighted to
+layout(std430, binding = 9) readonly buffer targetDistributionBuffer
+{
+    float targetDistributions[];
+};
+
+// Records are processed in chunks, as the number of work groups is limited
+uniform uint recordOffset;
+uniform uint recordCount;
+
+void storePixel(ivec2 pixelCoordinates, vec3 value)
+{
+    memoryBarrierImage();
+    vec3 currentValue = imageLoad(outputImage, pixelCoordinates).xyz;
+    imageStore(outputImage, pixelCoordinates, vec4(currentValue + value, 1.0));
+
+    float luminance = dot(value, LUMINANCE_WEIGHTS);
+    float currentMoment = imageLoad(secondMomentImage, pixelCoordinates).r;
+    imageStore(secondMomentImage, pixelCoordinates, vec4(currentMoment + luminance * luminance));
+}
+
+// Ratio of the densities of two Gaussian distributions at the given value
+float getDensityRatio(float value, uint fromIndex, uint toIndex)
+{
+    float fromStd = samplingDistributions[fromIndex + 1u];
+    if (fromStd < 0.0) return 1.0;
+    float toStd = targetDistributions[toIndex + 1u];
+
+    float fromZ = (value - samplingDistributions[fromIndex]) / fromStd;
+    float toZ = (value - targetDistributions[toIndex]) / toStd;
+    return fromStd / toStd * exp(0.5 * (fromZ * fromZ - toZ * toZ));
+}
+
+void main(void)
+{
+    uint recordIndex = recordOffset + gl_GlobalInvocationID.x;
+    if (recordIndex >= recordCount) return;
+
+    uint offset = recordIndex * SAMPLE_RECORD_SIZE;
+    uint slot = sampleRecords[offset + 6u] >> 16;
+    uint population = slot / MAX_SAMPLING_EPOCHS;
+    uint fromIndex = slot * FLOATS_PER_DISTRIBUTIONS;
+    uint toIndex = population * FLOATS_PER_DISTRIBUTIONS;
+
+    float ratio = getDensityRatio(uintBitsToFloat(sampleRecords[offset + 2u]), fromIndex, toIndex) *
+                  getDensityRatio(uintBitsToFloat(sampleRecords[offset + 3u]), fromIndex + 2u, toIndex + 2u) *
+                  getDensityRatio(uintBitsToFloat(sampleRecords[offset + 4u]), fromIndex + 4u, toIndex + 4u);
+
+    vec3 value = ratio * vec3(unpackHalf2x16(sampleRecords[offset + 5u]), unpackHalf2x16(sampleRecords[offset + 6u] & 0xffffu).x);
+
+    // Rays are stored once, so they are spread over the pixels like in the raytracing shader
+    vec2 pixelPosition = vec2(uintBitsToFloat(sampleRecords[offset]), uintBitsToFloat(sampleRecords[offset + 1u]));
+    int firstX;
+    int firstY;
+    float weightsX[MAX_SPLAT_FOOTPRINT];
+    float weightsY[MAX_SPLAT_FOOTPRINT];
+    int countX = getSplatWeights(pixelPosition.x, firstX, weightsX);
+    int countY = getSplatWeights(pixelPosition.y, firstY, weightsY);
+
+    ivec2 resolution = imageSize(outputImage);
+    for (int j = 0; j < countY; ++j)
+    {
+        for (int i = 0; i < countX; ++i)
+        {
+            ivec2 pixelCoordinates = ivec2(firstX + i, firstY + j);
+            float pixelWeight = weightsX[i] * weightsY[j];
+            if (pixelWeight <= 0.0 || any(lessThan(pixelCoordinates, ivec2(0))) || any(greaterThanEqual(pixelCoordinates, resolution))) continue;
+            storePixel(pixelCoordinates, pixelWeight * value);
+        }
+    }
+}
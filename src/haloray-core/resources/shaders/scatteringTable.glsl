@@ -0,0 +1,36 @@
+#version 440 core
+
+layout(local_size_x = 16, local_size_y = 16) in;
+// The camera and getPixelDirection are inserted from cameraProjection.glsl
+layout(binding = 0, rgba32f) uniform image2D outputImage;
+
+/* Scattering table with one layer per sun altitude and crystal
+   population, see the ScatteringTable class for the layout */
+layout(binding = 4) uniform sampler2DArray scatteringTable;
+
+uniform int lowerLayer;
+uniform int upperLayer;
+uniform float upperLayerWeight;
+
+/* Number of rays the tabulated radiance is scaled to, so that the
+   result matches an image traced with the same number of rays */
+uniform float rayCount;
+
+void main(void)
+{
+    ivec2 pixelCoordinates = ivec2(gl_GlobalInvocationID.xy);
+    ivec2 resolution = imageSize(outputImage);
+    if (any(greaterThanEqual(pixelCoordinates, resolution))) return;
+
+    vec3 direction;
+    float solidAngle;
+    if (!getPixelDirection(pixelCoordinates, vec2(resolution), direction, solidAngle)) return;
+
+    vec2 tableCoordinates = vec2(atan(direction.x, direction.z) / (2.0 * PI) + 0.5, 0.5 * (clamp(direction.y, -1.0, 1.0) + 1.0));
+    vec3 lowerRadiance = texture(scatteringTable, vec3(tableCoordinates, float(lowerLayer))).rgb;
+    vec3 upperRadiance = texture(scatteringTable, vec3(tableCoordinates, float(upperLayer))).rgb;
+    vec3 radiance = mix(lowerRadiance, upperRadiance, upperLayerWeight);
+
+    vec3 currentValue = imageLoad(outputImage, pixelCoordinates).rgb;
+    imageStore(outputImage, pixelCoordinates, vec4(currentValue + rayCount * solidAngle * radiance, 1.0));
+}
@@ -0,0 +1,51 @@
+/* The light of a ray can be spread over the pixels around the point it is
+   seen at with a separable filter, whose weights along each axis sum to
+   one. It is inserted after the version directive of the shaders that add
+   rays to the image when they are compiled. This must match the
+   SplatFilter class. */
+#define SPLAT_FILTER_BOX 0
+#define SPLAT_FILTER_BILINEAR 1
+#define SPLAT_FILTER_TENT 2
+#define SPLAT_FILTER_GAUSSIAN 3
+#define MAX_SPLAT_FOOTPRINT 7
+
+uniform int splatFilter;
+uniform float splatFilterRadius;
+
+/* Weights of the splat filter along one axis for the pixels from
+   firstPixel on, around a position in pixels. Returns the number of
+   pixels covered. */
+int getSplatWeights(float position, out int firstPixel, out float weights[MAX_SPLAT_FOOTPRINT])
+{
+    if (splatFilter == SPLAT_FILTER_BOX)
+    {
+        firstPixel = int(floor(position));
+        weights[0] = 1.0;
+        return 1;
+    }
+
+    float filterRadius = splatFilter == SPLAT_FILTER_BILINEAR ? 1.0 : splatFilterRadius;
+
+    // Pixels whose centers are closer than the radius
+    firstPixel = int(ceil(position - 0.5 - filterRadius));
+    int count = min(int(floor(position - 0.5 + filterRadius)) - firstPixel + 1, MAX_SPLAT_FOOTPRINT);
+
+    float totalWeight = 0.0;
+    for (int i = 0; i < count; ++i)
+    {
+        float centerDistance = abs(float(firstPixel + i) + 0.5 - position);
+        if (splatFilter == SPLAT_FILTER_GAUSSIAN)
+        {
+            float deviation = 0.5 * filterRadius;
+            weights[i] = centerDistance < filterRadius ? exp(-0.5 * centerDistance * centerDistance / (deviation * deviation)) : 0.0;
+        }
+        else
+        {
+            weights[i] = max(1.0 - centerDistance / filterRadius, 0.0);
+        }
+        totalWeight += weights[i];
+    }
+
+    for (int i = 0; i < count; ++i) weights[i] /= totalWeight;
+    return count;
+}
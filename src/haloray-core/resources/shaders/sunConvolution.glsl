@@ -0,0 +1,60 @@
+#version 440 core
+
+layout(local_size_x = 16, local_size_y = 16) in;
+// The camera and getPixelDirection are inserted from cameraProjection.glsl
+layout(binding = 0, rgba32f) uniform readonly image2D tracedImage;
+layout(binding = 5, rgba32f) uniform writeonly image2D outputImage;
+
+/* Light accumulated around the sun and convolved with the sun disk and
+   the diffraction patterns of the crystals. The grid is an azimuthal
+   equidistant projection centered on the sun and must match the
+   SunConvolution class. */
+layout(binding = 7) uniform sampler2D sunConvolutionGrid;
+
+#define SUN_CONVOLUTION_GRID_SIZE 1024
+#define SUN_CONVOLUTION_CELL_ANGLE radians(0.125)
+
+/* Number of rays the convolved grid is scaled to, relative to the number
+   of rays accumulated into it, so that it matches the traced image */
+uniform float rayCountScale;
+
+uniform struct sunProperties_t
+{
+    float altitude;
+} sun;
+
+void main(void)
+{
+    ivec2 pixelCoordinates = ivec2(gl_GlobalInvocationID.xy);
+    ivec2 resolution = imageSize(outputImage);
+    if (any(greaterThanEqual(pixelCoordinates, resolution))) return;
+
+    vec3 value = imageLoad(tracedImage, pixelCoordinates).rgb;
+
+    vec3 direction;
+    float solidAngle;
+    if (getPixelDirection(pixelCoordinates, vec2(resolution), direction, solidAngle))
+    {
+        // Same projection as when storing rays in the raytracing shader
+        vec3 viewDirection = -direction;
+        vec3 sunCenterDirection = getSunDirection(sun.altitude);
+        float angleFromSun = acos(clamp(dot(viewDirection, sunCenterDirection), -1.0, 1.0));
+        vec3 gridBasis1 = cross(sunCenterDirection, vec3(1.0, 0.0, 0.0));
+        vec2 tangent = vec2(viewDirection.x, dot(viewDirection, gridBasis1));
+        float tangentLength = length(tangent);
+        vec2 gridPosition = tangentLength > 0.0 ? angleFromSun / tangentLength * tangent : vec2(0.0);
+        vec2 gridCoordinates = (gridPosition / SUN_CONVOLUTION_CELL_ANGLE + 0.5 + float(SUN_CONVOLUTION_GRID_SIZE / 2)) / float(SUN_CONVOLUTION_GRID_SIZE);
+
+        if (all(greaterThan(gridCoordinates, vec2(0.0))) && all(lessThan(gridCoordinates, vec2(1.0))))
+        {
+            // Cells cover less of the sky away from the sun, see SunConvolution::getCellSolidAngle
+            float cellSolidAngle = SUN_CONVOLUTION_CELL_ANGLE * SUN_CONVOLUTION_CELL_ANGLE;
+            if (angleFromSun > 1.0e-6) cellSolidAngle *= sin(angleFromSun) / angleFromSun;
+
+            vec3 radiance = texture(sunConvolutionGrid, gridCoordinates).rgb / cellSolidAngle;
+            value += rayCountScale * solidAngle * radiance;
+        }
+    }
+
+    imageStore(outputImage, pixelCoordinates, vec4(value, 1.0));
+}
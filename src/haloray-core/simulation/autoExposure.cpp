@@ -0,0 +1,46 @@
+#include "autoExposure.h"
+#include <algorithm>
+#include <cmath>
+
+namespace HaloRay
+{
+
+unsigned int AutoExposure::getBin(double luminance)
+{
+    if (!(luminance > 0.0))
+        return 0;
+    auto log2Luminance = std::log2(luminance);
+    if (log2Luminance < minLog2Luminance)
+        return 0;
+    auto position = (log2Luminance - minLog2Luminance) / (maxLog2Luminance - minLog2Luminance) * (binCount - 1);
+    return std::min(static_cast<unsigned int>(position) + 1, binCount - 1);
+}
+
+double AutoExposure::getBinLuminance(unsigned int bin)
+{
+    if (bin == 0)
+        return 0.0;
+    auto binWidth = (maxLog2Luminance - minLog2Luminance) / (binCount - 1);
+    return std::exp2(minLog2Luminance + (bin - 0.5) * binWidth);
+}
+
+double AutoExposure::getTargetBrightness(const LuminanceStatistics &statistics, double keyValue, double previousBrightness)
+{
+    if (statistics.litPixelCount == 0 || statistics.averageLuminance <= 0.0)
+        return previousBrightness;
+
+    auto brightness = keyValue / statistics.averageLuminance;
+    if (statistics.highlightLuminance > 0.0)
+        brightness = std::min(brightness, 1.0 / statistics.highlightLuminance);
+    return std::max(static_cast<double>(minBrightness), std::min(brightness, static_cast<double>(maxBrightness)));
+}
+
+double AutoExposure::adapt(double brightness, double targetBrightness, double rate)
+{
+    if (brightness <= 0.0)
+        return targetBrightness;
+    rate = std::max(0.0, std::min(rate, 1.0));
+    return brightness * std::pow(targetBrightness / brightness, rate);
+}
+
+}
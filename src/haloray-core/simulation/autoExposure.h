@@ -0,0 +1,44 @@
+#pragma once
+
+namespace HaloRay
+{
+
+/* Statistics of a luminance histogram of the displayed halos, built on the
+   GPU. Luminances are those shown with a brightness of one, where one is
+   white. Pixels without any halo are left out. */
+struct LuminanceStatistics
+{
+    unsigned int litPixelCount = 0;
+    double averageLuminance = 0.0;
+    double highlightLuminance = 0.0;
+};
+
+/* Automatic brightness from luminance statistics. The average luminance is
+   shown at the key value, unless that would push the highlight luminance
+   past white. The histogram bins must match luminanceHistogram.glsl: bin 0
+   counts pixels darker than the smallest luminance, and the others are
+   spaced evenly in log2 luminance. */
+class AutoExposure
+{
+public:
+    static const unsigned int binCount = 256;
+    static constexpr double minLog2Luminance = -20.0;
+    static constexpr double maxLog2Luminance = 12.0;
+
+    static constexpr double minBrightness = 0.1;
+    static constexpr double maxBrightness = 30.0;
+
+    static constexpr double defaultKeyValue = 0.18;
+    static constexpr double defaultHighlightPercentile = 0.99;
+
+    static unsigned int getBin(double luminance);
+    static double getBinLuminance(unsigned int bin);
+
+    // Returns the previous brightness when nothing was lit
+    static double getTargetBrightness(const LuminanceStatistics &statistics, double keyValue, double previousBrightness);
+
+    // Moves the brightness towards the target by a share of the way in log space
+    static double adapt(double brightness, double targetBrightness, double rate);
+};
+
+}
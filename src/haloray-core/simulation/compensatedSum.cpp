@@ -0,0 +1,25 @@
+#include "compensatedSum.h"
+
+namespace HaloRay
+{
+
+void CompensatedSum::add(float value)
+{
+    // The two-sum algorithm gives the exact rounding error of the sum
+    float sum = high + value;
+    float virtualValue = sum - high;
+    float error = (high - (sum - virtualValue)) + (value - virtualValue);
+
+    // Renormalize, so that the high part is the total rounded to a float
+    low += error;
+    float newHigh = sum + low;
+    low -= newHigh - sum;
+    high = newHigh;
+}
+
+double CompensatedSum::get() const
+{
+    return static_cast<double>(high) + low;
+}
+
+}
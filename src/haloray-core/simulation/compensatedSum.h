@@ -0,0 +1,21 @@
+#pragma once
+
+namespace HaloRay
+{
+
+/* Sum of floats kept as an unevaluated pair of floats, whose high part is
+   the sum rounded to a float and whose low part holds the rounding error.
+   This has about twice the precision of a single float, so that small
+   additions to a large sum are not lost. Each step of the simulation is
+   traced into a separate image, which is then added to the accumulated
+   image in this way. This must match compensatedSum.glsl. */
+struct CompensatedSum
+{
+    float high = 0.0f;
+    float low = 0.0f;
+
+    void add(float value);
+    double get() const;
+};
+
+}
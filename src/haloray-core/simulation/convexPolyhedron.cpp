@@ -0,0 +1,506 @@
+#include "convexPolyhedron.h"
+#include <algorithm>
+#include <cmath>
+#include <sstream>
+#include <stdexcept>
+#include "trigonometryUtilities.h"
+
+namespace HaloRay
+{
+
+namespace
+{
+
+/* Planes of the initial box that is clipped down to the crystal.
+   Any of these remaining after clipping means the crystal is unbounded. */
+const double boundingBoxSize = 1000.0;
+const double epsilon = 1.0e-7;
+
+Vector3 operator+(const Vector3 &a, const Vector3 &b) { return {a[0] + b[0], a[1] + b[1], a[2] + b[2]}; }
+Vector3 operator-(const Vector3 &a, const Vector3 &b) { return {a[0] - b[0], a[1] - b[1], a[2] - b[2]}; }
+Vector3 operator*(double s, const Vector3 &a) { return {s * a[0], s * a[1], s * a[2]}; }
+
+double dot(const Vector3 &a, const Vector3 &b)
+{
+    return a[0] * b[0] + a[1] * b[1] + a[2] * b[2];
+}
+
+Vector3 cross(const Vector3 &a, const Vector3 &b)
+{
+    return {a[1] * b[2] - a[2] * b[1],
+            a[2] * b[0] - a[0] * b[2],
+            a[0] * b[1] - a[1] * b[0]};
+}
+
+double length(const Vector3 &a)
+{
+    return std::sqrt(dot(a, a));
+}
+
+Vector3 normalize(const Vector3 &a)
+{
+    return (1.0 / length(a)) * a;
+}
+
+double signedDistance(const CrystalPlane &plane, const Vector3 &point)
+{
+    return dot(plane.normal, point) - plane.distance;
+}
+
+struct ClippedFace
+{
+    CrystalFace face;
+    bool isBoundingBoxFace;
+};
+
+std::vector<ClippedFace> createBoundingBox()
+{
+    std::vector<ClippedFace> faces;
+    for (auto axis = 0u; axis < 3; ++axis)
+    {
+        for (double sign : {-1.0, 1.0})
+        {
+            Vector3 normal = {0.0, 0.0, 0.0};
+            normal[axis] = sign;
+            Vector3 u = {0.0, 0.0, 0.0};
+            u[(axis + 1) % 3] = 1.0;
+            Vector3 v = cross(normal, u);
+
+            CrystalFace face;
+            face.plane = {normal, boundingBoxSize};
+            auto center = boundingBoxSize * normal;
+            face.vertices = {
+                center - boundingBoxSize * u - boundingBoxSize * v,
+                center + boundingBoxSize * u - boundingBoxSize * v,
+                center + boundingBoxSize * u + boundingBoxSize * v,
+                center - boundingBoxSize * u + boundingBoxSize * v};
+            faces.push_back({face, true});
+        }
+    }
+    return faces;
+}
+
+/* Sorts points lying on a plane counterclockwise around the plane normal
+   and removes duplicates */
+std::vector<Vector3> sortAroundNormal(std::vector<Vector3> points, const Vector3 &normal)
+{
+    Vector3 centroid = {0.0, 0.0, 0.0};
+    for (const auto &point : points)
+        centroid = centroid + point;
+    centroid = (1.0 / points.size()) * centroid;
+
+    Vector3 helper = std::abs(normal[0]) < 0.9 ? Vector3{1.0, 0.0, 0.0} : Vector3{0.0, 1.0, 0.0};
+    auto u = normalize(cross(normal, helper));
+    auto v = cross(normal, u);
+
+    std::sort(points.begin(), points.end(), [&](const Vector3 &a, const Vector3 &b) {
+        auto da = a - centroid;
+        auto db = b - centroid;
+        return std::atan2(dot(da, v), dot(da, u)) < std::atan2(dot(db, v), dot(db, u));
+    });
+
+    std::vector<Vector3> unique;
+    for (const auto &point : points)
+    {
+        if (unique.empty() || length(point - unique.back()) > 1.0e-6)
+            unique.push_back(point);
+    }
+    while (unique.size() > 1 && length(unique.front() - unique.back()) <= 1.0e-6)
+        unique.pop_back();
+
+    return unique;
+}
+
+void clip(std::vector<ClippedFace> &faces, const CrystalPlane &plane)
+{
+    bool cutsPolyhedron = false;
+    for (const auto &clippedFace : faces)
+    {
+        for (const auto &vertex : clippedFace.face.vertices)
+        {
+            if (signedDistance(plane, vertex) > epsilon)
+                cutsPolyhedron = true;
+        }
+    }
+
+    // Planes that do not cut anything off would only add degenerate faces
+    if (!cutsPolyhedron) return;
+
+    std::vector<ClippedFace> result;
+    std::vector<Vector3> capPoints;
+    for (const auto &clippedFace : faces)
+    {
+        const auto &vertices = clippedFace.face.vertices;
+        std::vector<Vector3> clippedVertices;
+        for (auto i = 0u; i < vertices.size(); ++i)
+        {
+            const auto &current = vertices[i];
+            const auto &next = vertices[(i + 1) % vertices.size()];
+            auto currentDistance = signedDistance(plane, current);
+            auto nextDistance = signedDistance(plane, next);
+
+            if (currentDistance <= epsilon)
+                clippedVertices.push_back(current);
+            if (std::abs(currentDistance) <= epsilon)
+                capPoints.push_back(current);
+
+            if ((currentDistance < -epsilon && nextDistance > epsilon) || (currentDistance > epsilon && nextDistance < -epsilon))
+            {
+                auto t = currentDistance / (currentDistance - nextDistance);
+                auto intersection = current + t * (next - current);
+                clippedVertices.push_back(intersection);
+                capPoints.push_back(intersection);
+            }
+        }
+
+        if (clippedVertices.size() >= 3)
+        {
+            auto clipped = clippedFace;
+            clipped.face.vertices = clippedVertices;
+            result.push_back(clipped);
+        }
+    }
+
+    if (capPoints.size() >= 3)
+    {
+        CrystalFace cap;
+        cap.plane = plane;
+        cap.vertices = sortAroundNormal(capPoints, plane.normal);
+        if (cap.vertices.size() >= 3)
+            result.push_back({cap, false});
+    }
+
+    faces = result;
+}
+
+void appendVector(std::vector<float> &table, const Vector3 &vector, double w)
+{
+    table.push_back((float)vector[0]);
+    table.push_back((float)vector[1]);
+    table.push_back((float)vector[2]);
+    table.push_back((float)w);
+}
+
+int parseIndices(const std::string &indices, std::vector<int> &result)
+{
+    auto trimmedStart = indices.find_first_not_of(" \t");
+    auto trimmedEnd = indices.find_last_not_of(" \t");
+    if (trimmedStart == std::string::npos) return 0;
+    auto trimmed = indices.substr(trimmedStart, trimmedEnd - trimmedStart + 1);
+
+    if (trimmed.find_first_of(" \t,") != std::string::npos)
+    {
+        std::replace(trimmed.begin(), trimmed.end(), ',', ' ');
+        std::istringstream stream(trimmed);
+        int value;
+        while (stream >> value)
+            result.push_back(value);
+        return stream.eof() ? static_cast<int>(result.size()) : 0;
+    }
+
+    // Compact notation such as 10-11, where each index is a single digit
+    int sign = 1;
+    for (auto character : trimmed)
+    {
+        if (character == '-') {
+            sign = -1;
+        } else if (character >= '0' && character <= '9') {
+            result.push_back(sign * (character - '0'));
+            sign = 1;
+        } else {
+            return 0;
+        }
+    }
+    return static_cast<int>(result.size());
+}
+
+}
+
+double CrystalFace::getArea() const
+{
+    Vector3 sum = {0.0, 0.0, 0.0};
+    for (auto i = 1u; i + 1 < vertices.size(); ++i)
+    {
+        sum = sum + cross(vertices[i] - vertices[0], vertices[i + 1] - vertices[0]);
+    }
+    return 0.5 * length(sum);
+}
+
+ConvexPolyhedron::ConvexPolyhedron()
+{
+}
+
+bool ConvexPolyhedron::isEmpty() const
+{
+    return m_faces.empty();
+}
+
+const std::vector<CrystalPlane> &ConvexPolyhedron::getPlanes() const
+{
+    return m_planes;
+}
+
+const std::vector<CrystalFace> &ConvexPolyhedron::getFaces() const
+{
+    return m_faces;
+}
+
+unsigned int ConvexPolyhedron::getVertexCount() const
+{
+    if (isEmpty()) return 0;
+
+    // Euler's formula for convex polyhedra
+    unsigned int edgeCount = 0;
+    for (const auto &face : m_faces)
+        edgeCount += static_cast<unsigned int>(face.vertices.size());
+    edgeCount /= 2;
+    return edgeCount - static_cast<unsigned int>(m_faces.size()) + 2;
+}
+
+unsigned int ConvexPolyhedron::getTriangleCount() const
+{
+    unsigned int triangleCount = 0;
+    for (const auto &face : m_faces)
+        triangleCount += static_cast<unsigned int>(face.vertices.size()) - 2;
+    return triangleCount;
+}
+
+void ConvexPolyhedron::appendFaceTable(std::vector<float> &faceTable, std::vector<float> &triangleTable) const
+{
+    for (const auto &face : m_faces)
+    {
+        auto area = face.getArea();
+        auto firstTriangle = triangleTable.size() / triangleTableStride;
+        auto triangleCount = face.vertices.size() - 2;
+
+        appendVector(faceTable, face.plane.normal, face.plane.distance);
+        faceTable.push_back((float)area);
+        faceTable.push_back((float)firstTriangle);
+        faceTable.push_back((float)triangleCount);
+        faceTable.push_back(0.0f);
+
+        // The W component of the first vertex is the cumulative area fraction of the fan
+        double cumulativeArea = 0.0;
+        for (auto i = 1u; i + 1 < face.vertices.size(); ++i)
+        {
+            const auto &v0 = face.vertices[0];
+            const auto &v1 = face.vertices[i];
+            const auto &v2 = face.vertices[i + 1];
+            cumulativeArea += 0.5 * length(cross(v1 - v0, v2 - v0));
+            bool lastTriangle = i + 2 == face.vertices.size();
+            appendVector(triangleTable, v0, lastTriangle ? 1.0 : cumulativeArea / area);
+            appendVector(triangleTable, v1, 0.0);
+            appendVector(triangleTable, v2, 0.0);
+        }
+    }
+}
+
+ConvexPolyhedron ConvexPolyhedron::fromPlanes(const std::vector<CrystalPlane> &planes)
+{
+    auto faces = createBoundingBox();
+    for (auto plane : planes)
+    {
+        auto normalLength = length(plane.normal);
+        if (normalLength < epsilon)
+            throw std::runtime_error("Crystal face normal must not be zero");
+        plane.normal = (1.0 / normalLength) * plane.normal;
+        plane.distance /= normalLength;
+        if (plane.distance <= 0.0)
+            throw std::runtime_error("Crystal faces must be on the opposite side of the crystal center than their normals point to");
+
+        clip(faces, plane);
+    }
+
+    ConvexPolyhedron polyhedron;
+    for (const auto &clippedFace : faces)
+    {
+        if (clippedFace.isBoundingBoxFace)
+            throw std::runtime_error("Crystal faces do not form a closed crystal");
+        polyhedron.m_faces.push_back(clippedFace.face);
+        polyhedron.m_planes.push_back(clippedFace.face.plane);
+    }
+
+    return polyhedron;
+}
+
+Vector3 ConvexPolyhedron::getMillerBravaisNormal(int h, int k, int i, int l)
+{
+    if (h + k + i != 0)
+        throw std::runtime_error("Miller-Bravais indices must satisfy h + k + i = 0");
+
+    /* Reciprocal lattice vector of the hexagonal lattice with unit a-axes.
+       The crystallographic c-axis is the Y-axis of the crystal frame. */
+    Vector3 normal = {
+        (double)h,
+        (double)l / iceLatticeRatio,
+        (h + 2.0 * k) / std::sqrt(3.0)};
+
+    if (length(normal) < epsilon)
+        throw std::runtime_error("Miller-Bravais indices must not all be zero");
+
+    return normalize(normal);
+}
+
+ConvexPolyhedron ConvexPolyhedron::fromMillerBravaisIndices(const std::string &text)
+{
+    std::vector<CrystalPlane> planes;
+
+    std::istringstream lines(text);
+    std::string line;
+    unsigned int lineNumber = 0;
+    while (std::getline(lines, line))
+    {
+        ++lineNumber;
+        auto lineError = "Line " + std::to_string(lineNumber) + ": ";
+        auto first = line.find_first_not_of(" \t\r");
+        if (first == std::string::npos || line[first] == '#')
+            continue;
+
+        auto opening = line[first];
+        if (opening != '{' && opening != '(')
+            throw std::runtime_error(lineError + "faces must start with ( and forms with {");
+        auto closing = line.find(opening == '{' ? '}' : ')', first);
+        if (closing == std::string::npos)
+            throw std::runtime_error(lineError + "missing closing bracket");
+
+        std::vector<int> indices;
+        if (parseIndices(line.substr(first + 1, closing - first - 1), indices) != 4)
+            throw std::runtime_error(lineError + "expected four Miller-Bravais indices");
+
+        std::istringstream rest(line.substr(closing + 1));
+        double distance;
+        if (!(rest >> distance))
+            throw std::runtime_error(lineError + "expected face distance after the indices");
+
+        Vector3 normal;
+        try
+        {
+            normal = getMillerBravaisNormal(indices[0], indices[1], indices[2], indices[3]);
+        }
+        catch (const std::runtime_error &e)
+        {
+            throw std::runtime_error(lineError + e.what());
+        }
+
+        if (opening == '(')
+        {
+            planes.push_back({normal, distance});
+            continue;
+        }
+
+        // Forms include all faces related by the hexagonal symmetry of ice
+        for (auto rotation = 0; rotation < 6; ++rotation)
+        {
+            auto angle = rotation * PI / 3.0;
+            Vector3 rotated = {
+                std::cos(angle) * normal[0] - std::sin(angle) * normal[2],
+                normal[1],
+                std::sin(angle) * normal[0] + std::cos(angle) * normal[2]};
+            planes.push_back({rotated, distance});
+            if (std::abs(rotated[1]) > epsilon)
+                planes.push_back({{rotated[0], -rotated[1], rotated[2]}, distance});
+        }
+    }
+
+    if (planes.empty())
+        throw std::runtime_error("No crystal faces defined");
+
+    return fromPlanes(planes);
+}
+
+ConvexPolyhedron ConvexPolyhedron::fromObj(const std::string &text)
+{
+    std::vector<Vector3> vertices;
+    std::vector<std::vector<unsigned int>> faces;
+
+    std::istringstream lines(text);
+    std::string line;
+    unsigned int lineNumber = 0;
+    while (std::getline(lines, line))
+    {
+        ++lineNumber;
+        auto lineError = "Line " + std::to_string(lineNumber) + ": ";
+        std::istringstream columns(line);
+        std::string type;
+        if (!(columns >> type)) continue;
+
+        if (type == "v")
+        {
+            Vector3 vertex;
+            if (!(columns >> vertex[0] >> vertex[1] >> vertex[2]))
+                throw std::runtime_error(lineError + "vertex must have three coordinates");
+            vertices.push_back(vertex);
+        }
+        else if (type == "f")
+        {
+            std::vector<unsigned int> face;
+            std::string reference;
+            while (columns >> reference)
+            {
+                // Only the vertex index of v/vt/vn references is needed
+                auto index = std::atoi(reference.substr(0, reference.find('/')).c_str());
+                if (index < 0)
+                    index += static_cast<int>(vertices.size()) + 1;
+                if (index < 1 || index > static_cast<int>(vertices.size()))
+                    throw std::runtime_error(lineError + "invalid vertex index");
+                face.push_back(static_cast<unsigned int>(index - 1));
+            }
+            if (face.size() < 3)
+                throw std::runtime_error(lineError + "face must have at least three vertices");
+            faces.push_back(face);
+        }
+    }
+
+    if (faces.size() < 4)
+        throw std::runtime_error("Mesh must have at least four faces");
+
+    Vector3 center = {0.0, 0.0, 0.0};
+    for (const auto &vertex : vertices)
+        center = center + vertex;
+    center = (1.0 / vertices.size()) * center;
+
+    double size = 0.0;
+    for (const auto &vertex : vertices)
+        size = std::max(size, length(vertex - center));
+    if (size < epsilon)
+        throw std::runtime_error("Mesh has no volume");
+
+    // Center the crystal and scale its furthest vertex to unit distance
+    for (auto &vertex : vertices)
+        vertex = (1.0 / size) * (vertex - center);
+
+    std::vector<CrystalPlane> planes;
+    for (const auto &face : faces)
+    {
+        // Newell's method handles slightly non-planar polygons gracefully
+        Vector3 normal = {0.0, 0.0, 0.0};
+        for (auto i = 0u; i < face.size(); ++i)
+        {
+            const auto &current = vertices[face[i]];
+            const auto &next = vertices[face[(i + 1) % face.size()]];
+            normal = normal + cross(current, next);
+        }
+        if (length(normal) < epsilon)
+            continue;
+        normal = normalize(normal);
+
+        auto distance = dot(normal, vertices[face[0]]);
+        if (distance < 0.0)
+        {
+            normal = -1.0 * normal;
+            distance = -distance;
+        }
+
+        for (const auto &vertex : vertices)
+        {
+            if (dot(normal, vertex) > distance + 1.0e-4)
+                throw std::runtime_error("Mesh is not convex");
+        }
+
+        planes.push_back({normal, distance});
+    }
+
+    return fromPlanes(planes);
+}
+
+}
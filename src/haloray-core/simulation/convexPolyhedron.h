@@ -0,0 +1,64 @@
+#pragma once
+#include <array>
+#include <vector>
+#include <string>
+
+namespace HaloRay
+{
+
+using Vector3 = std::array<double, 3>;
+
+/* Plane with an outward unit normal. Points x inside the crystal satisfy
+   dot(normal, x) <= distance. */
+struct CrystalPlane
+{
+    Vector3 normal;
+    double distance;
+};
+
+struct CrystalFace
+{
+    CrystalPlane plane;
+    // Vertices in counterclockwise order when seen from outside the crystal
+    std::vector<Vector3> vertices;
+
+    double getArea() const;
+};
+
+/* General convex crystal shape, stored as the intersection of half-spaces
+   and compiled into face polygons. The crystal frame is the same as for
+   the built-in hexagonal crystals, with the C-axis along the Y-axis. */
+class ConvexPolyhedron
+{
+public:
+    /* Ratio of the c and a lattice parameters of ice Ih, which defines
+       the face normals given by Miller-Bravais indices */
+    static constexpr double iceLatticeRatio = 1.629;
+
+    ConvexPolyhedron();
+
+    bool isEmpty() const;
+    const std::vector<CrystalPlane> &getPlanes() const;
+    const std::vector<CrystalFace> &getFaces() const;
+    unsigned int getVertexCount() const;
+    unsigned int getTriangleCount() const;
+
+    /* Packs the faces and their triangle fans for the raytracing shader.
+       See the CrystalFace and CrystalTriangle structs in the shader for
+       the layout. */
+    static const unsigned int faceTableStride = 8;
+    static const unsigned int triangleTableStride = 12;
+    void appendFaceTable(std::vector<float> &faceTable, std::vector<float> &triangleTable) const;
+
+    static ConvexPolyhedron fromPlanes(const std::vector<CrystalPlane> &planes);
+    static ConvexPolyhedron fromMillerBravaisIndices(const std::string &text);
+    static ConvexPolyhedron fromObj(const std::string &text);
+
+    static Vector3 getMillerBravaisNormal(int h, int k, int i, int l);
+
+private:
+    std::vector<CrystalPlane> m_planes;
+    std::vector<CrystalFace> m_faces;
+};
+
+}
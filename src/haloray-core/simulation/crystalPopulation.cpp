@@ -164,9 +164,34 @@ void CrystalPopulation::initializePrismFaceDistances()
 CrystalPopulation::CrystalPopulation()
 {
     enabled = true;
+    crystalSize = 0.0f;
     initializePrismFaceDistances();
 }
 
+bool CrystalPopulation::usesTable(TabulatedParameter parameter) const
+{
+    if (distributionTables[parameter].isEmpty())
+        return false;
+
+    switch (parameter)
+    {
+    case TiltTable:
+        return tiltDistribution == Tabulated;
+    case RotationTable:
+        return rotationDistribution == Tabulated;
+    default:
+        return true;
+    }
+}
+
+bool CrystalPopulation::isRandomlyOriented() const
+{
+    // Tabulated distributions without a table fall back to uniform distributions
+    auto uniformTilt = tiltDistribution == Uniform || (tiltDistribution == Tabulated && !usesTable(TiltTable));
+    auto uniformRotation = rotationDistribution == Uniform || (rotationDistribution == Tabulated && !usesTable(RotationTable));
+    return uniformTilt && uniformRotation;
+}
+
 CrystalPopulation CrystalPopulation::presetPopulation(CrystalPopulationPreset preset)
 {
     switch (preset)
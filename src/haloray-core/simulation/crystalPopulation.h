@@ -1,4 +1,6 @@
 #pragma once
+#include "tabulatedDistribution.h"
+#include "convexPolyhedron.h"
 
 namespace HaloRay
 {
@@ -13,6 +15,27 @@ enum CrystalPopulationPreset
     Pyramid
 };
 
+/* Distribution types for crystal tilt and rotation. These must match the
+   DISTRIBUTION_* definitions in the raytracing shader. */
+enum DistributionType
+{
+    Uniform,
+    Gaussian,
+    Tabulated
+};
+
+/* Parameters that can be sampled from tabulated distributions. These must
+   match the TABLE_* definitions in the raytracing shader. */
+enum TabulatedParameter
+{
+    TiltTable,
+    RotationTable,
+    CaRatioTable,
+    UpperApexHeightTable,
+    LowerApexHeightTable,
+    NUM_TABULATED_PARAMETERS
+};
+
 struct CrystalPopulation
 {
     CrystalPopulation();
@@ -40,6 +63,22 @@ struct CrystalPopulation
 
     float prismFaceDistances[6];
 
+    /* Diameter of the crystals in micrometers, which sets how much light
+       diffracts at them when the result is convolved with the sun disk.
+       Zero means no diffraction. */
+    float crystalSize;
+
+    TabulatedDistribution distributionTables[NUM_TABULATED_PARAMETERS];
+    bool usesTable(TabulatedParameter parameter) const;
+
+    /* True if the crystals are oriented uniformly at random, in which case
+       their halos are rotationally symmetric around the sun */
+    bool isRandomlyOriented() const;
+
+    /* Custom crystal shape. When set, it replaces the hexagonal crystal,
+       and the C/A ratio, pyramid and prism face settings are ignored. */
+    ConvexPolyhedron customShape;
+
     static CrystalPopulation presetPopulation(CrystalPopulationPreset);
     static CrystalPopulation createLowitz();
     static CrystalPopulation createPlate();
@@ -5,6 +5,42 @@
 namespace HaloRay
 {
 
+namespace
+{
+
+// 64-bit FNV-1a, which gives the same result on every platform
+class Fingerprint
+{
+public:
+    Fingerprint() : m_hash(14695981039346656037ull) {}
+
+    template <typename T>
+    void add(T value)
+    {
+        auto bytes = reinterpret_cast<const unsigned char *>(&value);
+        for (auto i = 0u; i < sizeof(T); ++i)
+        {
+            m_hash ^= bytes[i];
+            m_hash *= 1099511628211ull;
+        }
+    }
+
+    template <typename T>
+    void add(const std::vector<T> &values)
+    {
+        add<std::uint64_t>(values.size());
+        for (auto value : values)
+            add(value);
+    }
+
+    std::uint64_t getHash() const { return m_hash; }
+
+private:
+    std::uint64_t m_hash;
+};
+
+}
+
 CrystalPopulationRepository::CrystalPopulationRepository()
     : m_nextId(1)
 {
@@ -88,6 +124,46 @@ double CrystalPopulationRepository::getProbability(unsigned int index) const
     return m_weights[index] / totalWeights;
 }
 
+std::uint64_t CrystalPopulationRepository::getFingerprint() const
+{
+    Fingerprint fingerprint;
+    fingerprint.add<std::uint32_t>(getCount());
+    for (const auto &crystal : m_crystals)
+    {
+        fingerprint.add(crystal.caRatioAverage);
+        fingerprint.add(crystal.caRatioStd);
+        fingerprint.add<std::int32_t>(crystal.tiltDistribution);
+        fingerprint.add(crystal.tiltAverage);
+        fingerprint.add(crystal.tiltStd);
+        fingerprint.add<std::int32_t>(crystal.rotationDistribution);
+        fingerprint.add(crystal.rotationAverage);
+        fingerprint.add(crystal.rotationStd);
+        fingerprint.add(crystal.upperApexAngle);
+        fingerprint.add(crystal.upperApexHeightAverage);
+        fingerprint.add(crystal.upperApexHeightStd);
+        fingerprint.add(crystal.lowerApexAngle);
+        fingerprint.add(crystal.lowerApexHeightAverage);
+        fingerprint.add(crystal.lowerApexHeightStd);
+        for (auto distance : crystal.prismFaceDistances)
+            fingerprint.add(distance);
+        fingerprint.add(crystal.crystalSize);
+        for (const auto &table : crystal.distributionTables)
+        {
+            fingerprint.add(table.getBinEdges());
+            fingerprint.add(table.getWeights());
+        }
+        const auto &planes = crystal.customShape.getPlanes();
+        fingerprint.add<std::uint64_t>(planes.size());
+        for (const auto &plane : planes)
+        {
+            for (auto component : plane.normal)
+                fingerprint.add(component);
+            fingerprint.add(plane.distance);
+        }
+    }
+    return fingerprint.getHash();
+}
+
 double CrystalPopulationRepository::getWeight(unsigned int index) const
 {
     return m_weights[index];
@@ -1,6 +1,7 @@
 #pragma once
 #include <vector>
 #include <string>
+#include <cstdint>
 #include "crystalPopulation.h"
 
 namespace HaloRay
@@ -26,6 +27,12 @@ public:
 
     unsigned int getCount() const;
 
+    /* Hash of the crystal parameters of all populations, in order. Names,
+       weights and whether populations are enabled are left out, since
+       scattering tables keep populations apart and stay valid when they
+       change. */
+    std::uint64_t getFingerprint() const;
+
 private:
     void addDefaults();
     std::vector<CrystalPopulation> m_crystals;
@@ -0,0 +1,135 @@
+#include "fft.h"
+#include <algorithm>
+#include <cmath>
+#include <functional>
+#include <stdexcept>
+#include <thread>
+#include "trigonometryUtilities.h"
+
+namespace HaloRay
+{
+
+namespace
+{
+
+void transformContiguous(std::complex<float> *data, unsigned int size, const std::vector<std::complex<float>> &twiddles)
+{
+    // Bit reversal permutation
+    for (unsigned int i = 1, j = 0; i < size; ++i)
+    {
+        auto bit = size >> 1;
+        for (; j & bit; bit >>= 1)
+            j ^= bit;
+        j ^= bit;
+        if (i < j)
+            std::swap(data[i], data[j]);
+    }
+
+    // Iterative radix-2 butterflies, with twiddle factors of the full size strided for the shorter lengths
+    for (auto length = 2u; length <= size; length <<= 1)
+    {
+        auto halfLength = length / 2;
+        auto twiddleStride = size / length;
+        for (auto start = 0u; start < size; start += length)
+        {
+            for (auto k = 0u; k < halfLength; ++k)
+            {
+                auto even = data[start + k];
+                auto odd = data[start + k + halfLength] * twiddles[k * twiddleStride];
+                data[start + k] = even + odd;
+                data[start + k + halfLength] = even - odd;
+            }
+        }
+    }
+}
+
+std::vector<std::complex<float>> computeTwiddles(unsigned int size, bool inverse)
+{
+    std::vector<std::complex<float>> twiddles(size / 2);
+    auto sign = inverse ? 1.0 : -1.0;
+    for (auto k = 0u; k < size / 2; ++k)
+    {
+        auto angle = sign * 2.0 * PI * k / size;
+        twiddles[k] = std::complex<float>(static_cast<float>(std::cos(angle)), static_cast<float>(std::sin(angle)));
+    }
+    return twiddles;
+}
+
+void parallelFor(unsigned int count, const std::function<void(unsigned int, unsigned int)> &work)
+{
+    auto threadCount = std::max(1u, std::min(std::thread::hardware_concurrency(), count));
+    std::vector<std::thread> threads;
+    for (auto thread = 0u; thread < threadCount; ++thread)
+    {
+        auto begin = static_cast<unsigned int>(static_cast<unsigned long long>(count) * thread / threadCount);
+        auto end = static_cast<unsigned int>(static_cast<unsigned long long>(count) * (thread + 1) / threadCount);
+        threads.emplace_back(work, begin, end);
+    }
+    for (auto &thread : threads)
+        thread.join();
+}
+
+}
+
+namespace FFT
+{
+
+bool isPowerOfTwo(unsigned int size)
+{
+    return size != 0 && (size & (size - 1)) == 0;
+}
+
+void transform(std::complex<float> *data, unsigned int size, unsigned int stride, bool inverse)
+{
+    if (!isPowerOfTwo(size))
+        throw std::runtime_error("FFT size must be a power of two");
+
+    auto twiddles = computeTwiddles(size, inverse);
+    std::vector<std::complex<float>> values(size);
+    for (auto i = 0u; i < size; ++i)
+        values[i] = data[static_cast<std::size_t>(i) * stride];
+
+    transformContiguous(values.data(), size, twiddles);
+
+    auto scale = inverse ? 1.0f / size : 1.0f;
+    for (auto i = 0u; i < size; ++i)
+        data[static_cast<std::size_t>(i) * stride] = scale * values[i];
+}
+
+void transform2D(std::vector<std::complex<float>> &data, unsigned int size, bool inverse)
+{
+    if (!isPowerOfTwo(size))
+        throw std::runtime_error("FFT size must be a power of two");
+    if (data.size() != static_cast<std::size_t>(size) * size)
+        throw std::runtime_error("FFT data is not a square image of the given size");
+
+    auto twiddles = computeTwiddles(size, inverse);
+    auto scale = inverse ? 1.0f / size : 1.0f;
+
+    parallelFor(size, [&](unsigned int begin, unsigned int end) {
+        for (auto row = begin; row < end; ++row)
+        {
+            auto rowData = data.data() + static_cast<std::size_t>(row) * size;
+            transformContiguous(rowData, size, twiddles);
+            for (auto i = 0u; i < size; ++i)
+                rowData[i] *= scale;
+        }
+    });
+
+    // Columns are copied out to keep the butterflies in cache
+    parallelFor(size, [&](unsigned int begin, unsigned int end) {
+        std::vector<std::complex<float>> column(size);
+        for (auto x = begin; x < end; ++x)
+        {
+            for (auto y = 0u; y < size; ++y)
+                column[y] = data[static_cast<std::size_t>(y) * size + x];
+            transformContiguous(column.data(), size, twiddles);
+            for (auto y = 0u; y < size; ++y)
+                data[static_cast<std::size_t>(y) * size + x] = scale * column[y];
+        }
+    });
+}
+
+}
+
+}
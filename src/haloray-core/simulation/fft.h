@@ -0,0 +1,24 @@
+#pragma once
+#include <complex>
+#include <vector>
+
+namespace HaloRay
+{
+
+/* In-place fast Fourier transforms of complex data whose size is a power
+   of two. Inverse transforms are scaled, so that a forward transform
+   followed by an inverse transform gives back the original data. */
+namespace FFT
+{
+bool isPowerOfTwo(unsigned int size);
+
+// Transforms size values that are stride elements apart
+void transform(std::complex<float> *data, unsigned int size, unsigned int stride, bool inverse);
+
+/* Transforms a square image stored row by row, first along its rows
+   and then along its columns. The rows and columns are split between
+   threads. */
+void transform2D(std::vector<std::complex<float>> &data, unsigned int size, bool inverse);
+}
+
+}
@@ -0,0 +1,158 @@
+#include "hybridTracer.h"
+#include <algorithm>
+
+namespace HaloRay
+{
+
+unsigned int HybridTracer::getDefaultThreadCount()
+{
+    auto hardwareThreads = std::thread::hardware_concurrency();
+    return hardwareThreads > 1 ? hardwareThreads - 1 : 1;
+}
+
+HybridTracer::HybridTracer(unsigned int threadCount)
+    : m_threadSplats(std::max(1u, threadCount)),
+      m_nextChunk(0),
+      m_generation(0),
+      m_busyThreads(0),
+      m_waited(true),
+      m_quitting(false),
+      m_lastRayCount(0)
+{
+    for (auto i = 0u; i < m_threadSplats.size(); ++i)
+        m_threads.emplace_back(&HybridTracer::work, this, i);
+}
+
+HybridTracer::~HybridTracer()
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_quitting = true;
+    }
+    m_workAvailable.notify_all();
+    for (auto &thread : m_threads)
+        thread.join();
+}
+
+unsigned int HybridTracer::getThreadCount() const
+{
+    return static_cast<unsigned int>(m_threads.size());
+}
+
+void HybridTracer::start(std::vector<HybridTracerTask> tasks)
+{
+    if (!m_waited)
+        wait();
+
+    m_tasks = std::move(tasks);
+    m_chunks.clear();
+    m_lastRayCount = 0;
+    for (auto taskIndex = 0u; taskIndex < m_tasks.size(); ++taskIndex)
+    {
+        const auto &task = m_tasks[taskIndex];
+        for (auto offset = 0u; offset < task.rayCount; offset += chunkSize)
+            m_chunks.push_back({taskIndex, task.firstRay + offset, std::min(chunkSize, task.rayCount - offset)});
+        m_lastRayCount += task.rayCount;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_nextChunk = 0;
+        m_busyThreads = getThreadCount();
+        m_waited = false;
+        m_startTime = std::chrono::steady_clock::now();
+        ++m_generation;
+    }
+    m_workAvailable.notify_all();
+}
+
+const std::vector<Kernels::Splat> &HybridTracer::wait()
+{
+    if (m_waited)
+        return m_splats;
+
+    {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        m_workDone.wait(lock, [this]() { return m_busyThreads == 0; });
+        m_waited = true;
+    }
+
+    m_splats.clear();
+    for (const auto &threadSplats : m_threadSplats)
+        m_splats.insert(m_splats.end(), threadSplats.begin(), threadSplats.end());
+
+    // Rays reaching the same pixel are summed, so that merging them into the image writes each pixel once
+    std::sort(m_splats.begin(), m_splats.end(), [](const Kernels::Splat &a, const Kernels::Splat &b) { return a.pixelIndex < b.pixelIndex; });
+    std::size_t pixelCount = 0;
+    for (const auto &splat : m_splats)
+    {
+        if (pixelCount > 0 && m_splats[pixelCount - 1].pixelIndex == splat.pixelIndex)
+        {
+            auto &pixel = m_splats[pixelCount - 1];
+            pixel.red += splat.red;
+            pixel.green += splat.green;
+            pixel.blue += splat.blue;
+        }
+        else
+        {
+            m_splats[pixelCount++] = splat;
+        }
+    }
+    m_splats.resize(pixelCount);
+    return m_splats;
+}
+
+bool HybridTracer::isBusy() const
+{
+    return !m_waited;
+}
+
+bool HybridTracer::isFinished() const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_busyThreads == 0;
+}
+
+std::uint64_t HybridTracer::getLastRayCount() const
+{
+    return m_lastRayCount;
+}
+
+double HybridTracer::getLastSeconds() const
+{
+    return std::chrono::duration<double>(m_finishTime - m_startTime).count();
+}
+
+void HybridTracer::work(unsigned int threadIndex)
+{
+    std::uint64_t finishedGeneration = 0;
+    while (true)
+    {
+        {
+            std::unique_lock<std::mutex> lock(m_mutex);
+            m_workAvailable.wait(lock, [this, finishedGeneration]() { return m_quitting || m_generation != finishedGeneration; });
+            if (m_quitting)
+                return;
+            finishedGeneration = m_generation;
+        }
+
+        auto &splats = m_threadSplats[threadIndex];
+        splats.clear();
+        for (auto chunkIndex = m_nextChunk++; chunkIndex < m_chunks.size(); chunkIndex = m_nextChunk++)
+        {
+            const auto &chunk = m_chunks[chunkIndex];
+            Kernels::traceScene(m_tasks[chunk.taskIndex].settings, chunk.firstRay, chunk.rayCount, splats);
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            if (--m_busyThreads == 0)
+            {
+                m_finishTime = std::chrono::steady_clock::now();
+                m_workDone.notify_all();
+            }
+        }
+    }
+}
+
+}
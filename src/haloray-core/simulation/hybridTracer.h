@@ -0,0 +1,88 @@
+#pragma once
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include "sceneTracer.h"
+
+namespace HaloRay
+{
+
+static_assert(sizeof(Kernels::Splat) == 16, "Splats must match the CPU splat shader");
+
+// Rays of one crystal population for the CPU to trace
+struct HybridTracerTask
+{
+    Kernels::SceneSettings settings;
+    std::uint64_t firstRay;
+    unsigned int rayCount;
+};
+
+/* Traces rays on CPU worker threads while the GPU traces the rest of the
+   frame. The threads are kept between frames and take the rays in chunks,
+   so that they finish at about the same time. Each thread collects the
+   rays reaching the image on its own, and they are joined when waiting. */
+class HybridTracer
+{
+public:
+    static const unsigned int chunkSize = 4096;
+
+    // One thread is left for the GUI and for driving the GPU
+    static unsigned int getDefaultThreadCount();
+
+    explicit HybridTracer(unsigned int threadCount = getDefaultThreadCount());
+    ~HybridTracer();
+
+    unsigned int getThreadCount() const;
+
+    // Starts tracing in the background, waiting first for rays started earlier
+    void start(std::vector<HybridTracerTask> tasks);
+
+    /* Waits for the rays started last and returns the light they brought
+       to each pixel, in the order of the pixels. The result is valid until
+       the next start. */
+    const std::vector<Kernels::Splat> &wait();
+    bool isBusy() const;
+
+    // Returns true when the rays started last have been traced, so that waiting for them returns right away
+    bool isFinished() const;
+
+    // Rays traced and time taken by the threads for the rays started last
+    std::uint64_t getLastRayCount() const;
+    double getLastSeconds() const;
+
+private:
+    struct Chunk
+    {
+        unsigned int taskIndex;
+        std::uint64_t firstRay;
+        unsigned int rayCount;
+    };
+
+    void work(unsigned int threadIndex);
+
+    std::vector<std::thread> m_threads;
+    std::vector<std::vector<Kernels::Splat>> m_threadSplats;
+    std::vector<Kernels::Splat> m_splats;
+    std::vector<HybridTracerTask> m_tasks;
+    std::vector<Chunk> m_chunks;
+    std::atomic<std::size_t> m_nextChunk;
+
+    mutable std::mutex m_mutex;
+    std::condition_variable m_workAvailable;
+    std::condition_variable m_workDone;
+    // Incremented for every start, so that each thread takes part once
+    std::uint64_t m_generation;
+    unsigned int m_busyThreads;
+    bool m_waited;
+    bool m_quitting;
+
+    std::chrono::steady_clock::time_point m_startTime;
+    std::chrono::steady_clock::time_point m_finishTime;
+    std::uint64_t m_lastRayCount;
+};
+
+}
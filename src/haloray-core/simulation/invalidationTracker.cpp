@@ -0,0 +1,40 @@
+#include "invalidationTracker.h"
+#include <stdexcept>
+
+namespace HaloRay
+{
+
+void InvalidationTracker::beginUpdate()
+{
+    ++m_depth;
+}
+
+InvalidationTracker::Invalidation InvalidationTracker::endUpdate()
+{
+    if (m_depth == 0)
+        throw std::runtime_error("Ending an update that was not begun");
+
+    if (--m_depth > 0)
+        return None;
+
+    auto invalidation = m_pending;
+    m_pending = None;
+    return invalidation;
+}
+
+bool InvalidationTracker::isUpdating() const
+{
+    return m_depth > 0;
+}
+
+bool InvalidationTracker::invalidate(Invalidation invalidation)
+{
+    if (!isUpdating())
+        return true;
+
+    if (invalidation > m_pending)
+        m_pending = invalidation;
+    return false;
+}
+
+}
@@ -0,0 +1,34 @@
+#pragma once
+
+namespace HaloRay
+{
+
+/* Collects invalidations of the simulation during batched updates, so that
+   a batch of changes is applied with at most one invalidation when it ends.
+   Batches can be nested, and only the strongest invalidation requested
+   before the outermost batch ends is applied. */
+class InvalidationTracker
+{
+public:
+    // Resetting also clears, so it is the stronger invalidation
+    enum Invalidation
+    {
+        None,
+        Clear,
+        Reset
+    };
+
+    void beginUpdate();
+    // Returns the invalidation to apply once the outermost batch has ended
+    Invalidation endUpdate();
+    bool isUpdating() const;
+
+    // Returns true if the invalidation is to be applied right away, and false if it waits for the end of the batch
+    bool invalidate(Invalidation invalidation);
+
+private:
+    unsigned int m_depth = 0;
+    Invalidation m_pending = None;
+};
+
+}
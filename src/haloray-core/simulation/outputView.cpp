@@ -0,0 +1,23 @@
+#include "outputView.h"
+
+namespace HaloRay
+{
+
+bool OutputView::isValid() const
+{
+    return width > 0 && height > 0 && width <= maxSize && height <= maxSize;
+}
+
+bool OutputView::operator==(const OutputView &other) const
+{
+    return camera == other.camera
+            && width == other.width
+            && height == other.height;
+}
+
+bool OutputView::operator!=(const OutputView &other) const
+{
+    return !(*this == other);
+}
+
+}
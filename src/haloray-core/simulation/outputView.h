@@ -0,0 +1,22 @@
+#pragma once
+#include "camera.h"
+
+namespace HaloRay
+{
+
+/* Extra camera that traced rays are accumulated into alongside the main
+   image, with its own projection and resolution */
+struct OutputView
+{
+    Camera camera;
+    unsigned int width = 1920;
+    unsigned int height = 1080;
+
+    static const unsigned int maxSize = 8192;
+    bool isValid() const;
+
+    bool operator==(const OutputView&) const;
+    bool operator!=(const OutputView&) const;
+};
+
+}
@@ -0,0 +1,215 @@
+#include "pathFilter.h"
+#include <sstream>
+#include <stdexcept>
+
+namespace HaloRay
+{
+
+namespace PathSignature
+{
+
+unsigned int encode(unsigned int entryFace, unsigned int exitFace, unsigned int bounceClass)
+{
+    return entryFace | (exitFace << faceBits) | (bounceClass << (2 * faceBits));
+}
+
+unsigned int getEntryFace(unsigned int signature)
+{
+    return signature & maxFaceNumber;
+}
+
+unsigned int getExitFace(unsigned int signature)
+{
+    return (signature >> faceBits) & maxFaceNumber;
+}
+
+unsigned int getBounceClass(unsigned int signature)
+{
+    return signature >> (2 * faceBits);
+}
+
+}
+
+namespace
+{
+
+/* Maps a face of a hexagonal crystal to the face it ends up at when the
+   crystal is optionally mirrored and then rotated around its c-axis by
+   multiples of 60 degrees. Basal faces stay where they are. */
+unsigned int transformHexagonalFace(unsigned int face, bool mirror, unsigned int rotation)
+{
+    unsigned int firstFace;
+    if (face >= 3 && face <= 8)
+        firstFace = 3;
+    else if (face >= 13 && face <= 18)
+        firstFace = 13;
+    else if (face >= 23 && face <= 28)
+        firstFace = 23;
+    else
+        return face;
+
+    auto index = face - firstFace;
+    if (mirror)
+        index = (6 - index) % 6;
+    return firstFace + (index + rotation) % 6;
+}
+
+unsigned int parseFace(const std::string &text, const std::string &term)
+{
+    if (text == "*")
+        return 0;
+
+    try
+    {
+        std::size_t length;
+        auto face = std::stoi(text, &length);
+        if (length == text.size() && face >= 1 && face <= static_cast<int>(PathSignature::maxFaceNumber))
+            return static_cast<unsigned int>(face);
+    }
+    catch (const std::logic_error &)
+    {
+    }
+    throw std::runtime_error("Invalid face in ray path term \"" + term + "\"");
+}
+
+std::string trim(const std::string &text)
+{
+    auto first = text.find_first_not_of(" \t");
+    if (first == std::string::npos)
+        return "";
+    auto last = text.find_last_not_of(" \t");
+    return text.substr(first, last - first + 1);
+}
+
+}
+
+PathFilter::PathFilter()
+{
+}
+
+PathFilter PathFilter::parse(const std::string &expression)
+{
+    PathFilter filter;
+    filter.m_expression = trim(expression);
+    if (filter.m_expression.empty())
+        return filter;
+
+    std::istringstream stream(expression);
+    std::string termText;
+    while (std::getline(stream, termText, ','))
+    {
+        termText = trim(termText);
+        if (termText.empty())
+            throw std::runtime_error("Empty ray path term");
+
+        auto facesText = termText;
+        Term term;
+        term.bounceClass = -1;
+
+        auto colon = termText.find(':');
+        if (colon != std::string::npos)
+        {
+            auto reflections = trim(termText.substr(colon + 1));
+            facesText = trim(termText.substr(0, colon));
+            if (reflections == "0")
+                term.bounceClass = PathSignature::NoInternalReflections;
+            else if (reflections == "1")
+                term.bounceClass = PathSignature::OneInternalReflection;
+            else if (reflections == "2" || reflections == "2+")
+                term.bounceClass = PathSignature::ManyInternalReflections;
+            else
+                throw std::runtime_error("Number of internal reflections in ray path term \"" + termText + "\" must be 0, 1 or 2+");
+        }
+
+        auto dash = facesText.find('-');
+        if (dash == std::string::npos)
+        {
+            if (term.bounceClass >= 0)
+                throw std::runtime_error("External reflection \"" + termText + "\" cannot have internal reflections");
+            term.entryFace = parseFace(facesText, termText);
+            term.exitFace = term.entryFace;
+            term.bounceClass = PathSignature::ExternalReflection;
+        }
+        else
+        {
+            term.entryFace = parseFace(trim(facesText.substr(0, dash)), termText);
+            term.exitFace = parseFace(trim(facesText.substr(dash + 1)), termText);
+        }
+
+        filter.m_terms.push_back(term);
+    }
+
+    return filter;
+}
+
+bool PathFilter::isEmpty() const
+{
+    return m_terms.empty();
+}
+
+const std::string &PathFilter::getExpression() const
+{
+    return m_expression;
+}
+
+bool PathFilter::matchesTerm(const Term &term, unsigned int signature) const
+{
+    auto bounceClass = PathSignature::getBounceClass(signature);
+    if (term.bounceClass < 0)
+    {
+        if (bounceClass == PathSignature::ExternalReflection)
+            return false;
+    }
+    else if (bounceClass != static_cast<unsigned int>(term.bounceClass))
+    {
+        return false;
+    }
+
+    return (term.entryFace == 0 || term.entryFace == PathSignature::getEntryFace(signature)) &&
+           (term.exitFace == 0 || term.exitFace == PathSignature::getExitFace(signature));
+}
+
+bool PathFilter::matches(unsigned int signature, bool hexagonal) const
+{
+    if (signature == PathSignature::unknown)
+        return false;
+
+    for (const auto &term : m_terms)
+    {
+        if (!hexagonal)
+        {
+            if (matchesTerm(term, signature))
+                return true;
+            continue;
+        }
+
+        for (auto mirror : {false, true})
+        {
+            for (auto rotation = 0u; rotation < 6; ++rotation)
+            {
+                Term transformed = term;
+                if (term.entryFace != 0)
+                    transformed.entryFace = transformHexagonalFace(term.entryFace, mirror, rotation);
+                if (term.exitFace != 0)
+                    transformed.exitFace = transformHexagonalFace(term.exitFace, mirror, rotation);
+                if (matchesTerm(transformed, signature))
+                    return true;
+            }
+        }
+    }
+
+    return false;
+}
+
+std::vector<std::uint32_t> PathFilter::createMask(bool hexagonal) const
+{
+    std::vector<std::uint32_t> mask(maskWordCount, 0);
+    for (auto signature = 0u; signature < PathSignature::signatureCount; ++signature)
+    {
+        if (matches(signature, hexagonal))
+            mask[signature / 32] |= 1u << (signature % 32);
+    }
+    return mask;
+}
+
+}
@@ -0,0 +1,80 @@
+#pragma once
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace HaloRay
+{
+
+/* Ray paths through a crystal are summarized by a signature made of the
+   entry face, the exit face and a bounce class. Faces are numbered like
+   in HaloSim: 1 and 2 are the basal faces, 3-8 the prism faces, 13-18 the
+   upper pyramidal faces and 23-28 the lower pyramidal faces. Faces of
+   custom crystals are numbered from 1 in the order they are defined.
+   This must match getPathSignature in the raytracing shader. */
+namespace PathSignature
+{
+const unsigned int faceBits = 6;
+const unsigned int maxFaceNumber = (1u << faceBits) - 1;
+const unsigned int signatureCount = 1u << (2 * faceBits + 2);
+
+// Signature zero is used for rays without a known path
+const unsigned int unknown = 0;
+
+enum BounceClass
+{
+    ExternalReflection = 0,
+    NoInternalReflections = 1,
+    OneInternalReflection = 2,
+    ManyInternalReflections = 3
+};
+
+unsigned int encode(unsigned int entryFace, unsigned int exitFace, unsigned int bounceClass);
+unsigned int getEntryFace(unsigned int signature);
+unsigned int getExitFace(unsigned int signature);
+unsigned int getBounceClass(unsigned int signature);
+}
+
+/* Selects ray paths with a list of comma separated terms:
+
+     3-5     rays entering face 3 and exiting face 5
+     3-5:1   as above, with exactly one internal reflection
+     1-*:2   rays entering face 1 with two or more internal reflections
+     3       rays reflecting externally off face 3
+
+   For hexagonal crystals, every term also matches the paths that are
+   equivalent under the hexagonal symmetry of the crystal, so that 3-5
+   also matches 4-6, 5-3 and so on. Terms for custom crystals match only
+   the exact faces. */
+class PathFilter
+{
+public:
+    static const unsigned int maskWordCount = PathSignature::signatureCount / 32;
+
+    PathFilter();
+
+    static PathFilter parse(const std::string &expression);
+
+    bool isEmpty() const;
+    const std::string &getExpression() const;
+    bool matches(unsigned int signature, bool hexagonal) const;
+
+    // One bit for each path signature, as read by the raytracing shader
+    std::vector<std::uint32_t> createMask(bool hexagonal) const;
+
+private:
+    struct Term
+    {
+        // Zero matches any face and negative any bounce class
+        unsigned int entryFace;
+        unsigned int exitFace;
+        int bounceClass;
+    };
+
+    bool matchesTerm(const Term &term, unsigned int signature) const;
+
+    std::string m_expression;
+    std::vector<Term> m_terms;
+};
+
+}
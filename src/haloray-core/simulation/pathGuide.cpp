@@ -0,0 +1,63 @@
+#include "pathGuide.h"
+
+namespace HaloRay
+{
+
+unsigned int PathGuide::getCellIndex(unsigned int yawBin, unsigned int tiltBin, unsigned int rotationBin, unsigned int entryBin)
+{
+    return ((yawBin * tiltBins + tiltBin) * rotationBins + rotationBin) * entryBins + entryBin;
+}
+
+std::vector<float> PathGuide::createCdf(const std::uint32_t *counters)
+{
+    std::vector<double> weights(cellCount);
+    double totalWeight = 0.0;
+    for (auto cell = 0u; cell < cellCount; ++cell)
+    {
+        auto low = counters[cell * countersPerCell];
+        auto high = counters[cell * countersPerCell + 1];
+        weights[cell] = (static_cast<double>(high) * 4294967296.0 + low) / weightScale;
+        totalWeight += weights[cell];
+    }
+
+    // Nothing has reached the image yet
+    if (totalWeight <= 0.0)
+        return createUniformCdf();
+
+    std::vector<float> cdf(cellCount);
+    double cumulativeProbability = 0.0;
+    for (auto cell = 0u; cell < cellCount; ++cell)
+    {
+        cumulativeProbability += (1.0 - uniformFraction) * weights[cell] / totalWeight + uniformFraction / cellCount;
+        cdf[cell] = static_cast<float>(cumulativeProbability);
+    }
+    cdf.back() = 1.0f;
+    return cdf;
+}
+
+std::vector<float> PathGuide::createUniformCdf()
+{
+    std::vector<float> cdf(cellCount);
+    for (auto cell = 0u; cell < cellCount; ++cell)
+        cdf[cell] = static_cast<float>(static_cast<double>(cell + 1) / cellCount);
+    return cdf;
+}
+
+unsigned int PathGuide::sampleCell(const std::vector<float> &cdf, float selector, double &probability)
+{
+    unsigned int low = 0;
+    unsigned int high = static_cast<unsigned int>(cdf.size()) - 1;
+    while (low < high)
+    {
+        auto middle = (low + high) / 2;
+        if (cdf[middle] > selector)
+            high = middle;
+        else
+            low = middle + 1;
+    }
+
+    probability = cdf[low] - (low > 0 ? cdf[low - 1] : 0.0f);
+    return low;
+}
+
+}
@@ -0,0 +1,47 @@
+#pragma once
+#include <cstdint>
+#include <vector>
+
+namespace HaloRay
+{
+
+/* Path guiding learns which crystal orientations and entry faces send rays
+   into the image, and samples them more often. It works on the uniform
+   random numbers the raytracing shader turns into the crystal yaw, tilt,
+   rotation and entry face, so it does not depend on the orientation
+   distributions. Their unit hypercube is split into cells, and the weight
+   of rays reaching the image from each cell is accumulated for each
+   population. Cells are then sampled in proportion to their weight,
+   mixed with a uniform share so that every ray stays possible, and ray
+   weights are divided by how much more likely their cell became. This
+   must match the raytracing shader. */
+class PathGuide
+{
+public:
+    static const unsigned int yawBins = 32;
+    static const unsigned int tiltBins = 16;
+    static const unsigned int rotationBins = 16;
+    static const unsigned int entryBins = 4;
+    static const unsigned int cellCount = yawBins * tiltBins * rotationBins * entryBins;
+
+    /* Ray weights are accumulated as fixed point numbers in pairs of
+       32-bit counters, low word first */
+    static constexpr double weightScale = 256.0;
+    static const unsigned int countersPerCell = 2;
+
+    // Share of samples spread evenly over all cells
+    static constexpr double uniformFraction = 0.2;
+
+    static unsigned int getCellIndex(unsigned int yawBin, unsigned int tiltBin, unsigned int rotationBin, unsigned int entryBin);
+
+    // Cumulative sampling probabilities of the cells, from the counters of one population
+    static std::vector<float> createCdf(const std::uint32_t *counters);
+    static std::vector<float> createUniformCdf();
+
+    /* Picks the cell a uniform random number falls in and gives the
+       probability of picking it, like the raytracing shader does. Rays
+       from the cell are weighted by 1 / (cellCount * probability). */
+    static unsigned int sampleCell(const std::vector<float> &cdf, float selector, double &probability);
+};
+
+}
@@ -0,0 +1,69 @@
+#include "pathLengthHistogram.h"
+#include <algorithm>
+
+namespace HaloRay
+{
+
+PathLengthHistogram::PathLengthHistogram()
+    : escapedCounts(maxHits, 0),
+      terminatedByRussianRoulette(0),
+      trappedInOrbit(0),
+      reachedMaxHits(0)
+{
+}
+
+unsigned int PathLengthHistogram::getEscapedCount() const
+{
+    unsigned int count = 0;
+    for (auto binCount : escapedCounts)
+    {
+        count += binCount;
+    }
+    return count;
+}
+
+unsigned int PathLengthHistogram::getTerminatedCount() const
+{
+    return terminatedByRussianRoulette + trappedInOrbit + reachedMaxHits;
+}
+
+double PathLengthHistogram::getMeanPathLength() const
+{
+    auto escapedCount = getEscapedCount();
+    if (escapedCount == 0) return 0.0;
+
+    double sum = 0.0;
+    for (auto pathLength = 0u; pathLength < escapedCounts.size(); ++pathLength)
+    {
+        sum += (double)pathLength * escapedCounts[pathLength];
+    }
+    return sum / escapedCount;
+}
+
+unsigned int PathLengthHistogram::getPathLengthPercentile(double percentile) const
+{
+    auto escapedCount = getEscapedCount();
+    if (escapedCount == 0) return 0;
+
+    double threshold = std::min(std::max(percentile, 0.0), 1.0) * escapedCount;
+    unsigned int cumulativeCount = 0;
+    for (auto pathLength = 0u; pathLength < escapedCounts.size(); ++pathLength)
+    {
+        cumulativeCount += escapedCounts[pathLength];
+        if (cumulativeCount >= threshold && cumulativeCount > 0)
+            return pathLength;
+    }
+    return maxHits - 1;
+}
+
+PathLengthHistogram PathLengthHistogram::fromBins(const unsigned int *bins)
+{
+    PathLengthHistogram histogram;
+    std::copy(bins, bins + maxHits, histogram.escapedCounts.begin());
+    histogram.terminatedByRussianRoulette = bins[maxHits];
+    histogram.trappedInOrbit = bins[maxHits + 1];
+    histogram.reachedMaxHits = bins[maxHits + 2];
+    return histogram;
+}
+
+}
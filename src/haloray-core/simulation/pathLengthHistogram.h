@@ -0,0 +1,29 @@
+#pragma once
+#include <vector>
+
+namespace HaloRay
+{
+
+struct PathLengthHistogram
+{
+    /* These must match the MAX_HITS and PATH_LENGTH_BINS
+       definitions in the raytracing shader */
+    static const unsigned int maxHits = 100;
+    static const unsigned int numBins = maxHits + 3;
+
+    PathLengthHistogram();
+
+    std::vector<unsigned int> escapedCounts;
+    unsigned int terminatedByRussianRoulette;
+    unsigned int trappedInOrbit;
+    unsigned int reachedMaxHits;
+
+    unsigned int getEscapedCount() const;
+    unsigned int getTerminatedCount() const;
+    double getMeanPathLength() const;
+    unsigned int getPathLengthPercentile(double percentile) const;
+
+    static PathLengthHistogram fromBins(const unsigned int *bins);
+};
+
+}
@@ -0,0 +1,35 @@
+#include "phaseFunction.h"
+#include <algorithm>
+#include <cmath>
+#include "trigonometryUtilities.h"
+
+namespace HaloRay
+{
+
+unsigned int PhaseFunction::getAngleBin(double scatteringAngle)
+{
+    auto bin = static_cast<int>(std::floor(scatteringAngle / PI * angleBinCount));
+    return static_cast<unsigned int>(std::min(std::max(bin, 0), static_cast<int>(angleBinCount) - 1));
+}
+
+unsigned int PhaseFunction::getWavelengthBin(double wavelength)
+{
+    auto binWidth = (maxWavelength - minWavelength) / wavelengthBinCount;
+    auto bin = static_cast<int>(std::floor((wavelength - minWavelength) / binWidth));
+    return static_cast<unsigned int>(std::min(std::max(bin, 0), static_cast<int>(wavelengthBinCount) - 1));
+}
+
+unsigned int PhaseFunction::getCounterIndex(unsigned int angleBin, unsigned int wavelengthBin)
+{
+    return (wavelengthBin * angleBinCount + angleBin) * countersPerBin;
+}
+
+double PhaseFunction::getBinSolidAngle(unsigned int angleBin)
+{
+    // Area of the ring between the two scattering angles on the unit sphere
+    auto lowerAngle = PI * angleBin / angleBinCount;
+    auto upperAngle = PI * (angleBin + 1) / angleBinCount;
+    return 2.0 * PI * (std::cos(lowerAngle) - std::cos(upperAngle));
+}
+
+}
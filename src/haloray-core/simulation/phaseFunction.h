@@ -0,0 +1,33 @@
+#pragma once
+
+namespace HaloRay
+{
+
+/* Scattering phase function of randomly oriented crystal populations.
+   Their halos are rotationally symmetric around the sun, so the scattered
+   light only depends on the scattering angle and the wavelength. It is
+   accumulated into a histogram of scattering angle bins for each
+   wavelength bin, which does not depend on the camera or the sun
+   altitude. */
+struct PhaseFunction
+{
+    /* These must match the PHASE_FUNCTION_* definitions in the raytracing
+       and phase function shaders */
+    static const unsigned int angleBinCount = 1800;
+    static const unsigned int wavelengthBinCount = 30;
+    static constexpr double minWavelength = 400.0;
+    static constexpr double maxWavelength = 700.0;
+
+    /* Ray weights are accumulated as fixed point numbers in pairs of
+       32-bit counters, low word first */
+    static constexpr double weightScale = 1024.0;
+    static const unsigned int countersPerBin = 2;
+    static const unsigned int counterCount = angleBinCount * wavelengthBinCount * countersPerBin;
+
+    static unsigned int getAngleBin(double scatteringAngle);
+    static unsigned int getWavelengthBin(double wavelength);
+    static unsigned int getCounterIndex(unsigned int angleBin, unsigned int wavelengthBin);
+    static double getBinSolidAngle(unsigned int angleBin);
+};
+
+}
@@ -0,0 +1,39 @@
+#include "philox.h"
+#include <cstdint>
+
+namespace HaloRay
+{
+
+namespace
+{
+
+const unsigned int multiplier0 = 0xd2511f53u;
+const unsigned int multiplier1 = 0xcd9e8d57u;
+const unsigned int weyl0 = 0x9e3779b9u;
+const unsigned int weyl1 = 0xbb67ae85u;
+
+void multiplyHighLow(unsigned int a, unsigned int b, unsigned int &high, unsigned int &low)
+{
+    auto product = static_cast<std::uint64_t>(a) * b;
+    high = static_cast<unsigned int>(product >> 32);
+    low = static_cast<unsigned int>(product);
+}
+
+}
+
+Philox::Counter Philox::generate(Counter counter, Key key)
+{
+    for (auto round = 0u; round < rounds; ++round)
+    {
+        unsigned int high0, low0, high1, low1;
+        multiplyHighLow(multiplier0, counter[0], high0, low0);
+        multiplyHighLow(multiplier1, counter[2], high1, low1);
+        counter = {high1 ^ counter[1] ^ key[0], low1, high0 ^ counter[3] ^ key[1], low0};
+
+        key[0] += weyl0;
+        key[1] += weyl1;
+    }
+    return counter;
+}
+
+}
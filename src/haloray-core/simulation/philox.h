@@ -0,0 +1,23 @@
+#pragma once
+#include <array>
+
+namespace HaloRay
+{
+
+/* Philox4x32-10 counter-based random number generator from "Parallel
+   Random Numbers: As Easy as 1, 2, 3" by Salmon et al. (2011). Every
+   counter and key pair maps to four independent random numbers, so
+   random streams do not depend on the order rays are traced in. The
+   raytracing shader contains an equivalent implementation. */
+class Philox
+{
+public:
+    using Counter = std::array<unsigned int, 4>;
+    using Key = std::array<unsigned int, 2>;
+
+    static const unsigned int rounds = 10;
+
+    static Counter generate(Counter counter, Key key);
+};
+
+}
@@ -0,0 +1,47 @@
+#include "rayAllocation.h"
+#include <cmath>
+
+namespace HaloRay
+{
+
+double RayAllocation::getMomentSum(const std::uint32_t *counters)
+{
+    double sum = 0.0;
+    for (auto slot = 0u; slot < slotsPerPopulation; ++slot)
+    {
+        auto low = counters[slot * countersPerSlot];
+        auto high = counters[slot * countersPerSlot + 1];
+        sum += static_cast<double>(high) * 4294967296.0 + low;
+    }
+    return sum / momentScale;
+}
+
+std::vector<double> RayAllocation::allocate(const std::vector<double> &probabilities,
+                                            const std::vector<double> &secondMoments,
+                                            const std::vector<bool> &adaptive)
+{
+    std::vector<double> shares(probabilities);
+
+    double adaptiveProbability = 0.0;
+    double totalNoise = 0.0;
+    for (auto i = 0u; i < probabilities.size(); ++i)
+    {
+        if (!adaptive[i]) continue;
+        adaptiveProbability += probabilities[i];
+        totalNoise += probabilities[i] * std::sqrt(secondMoments[i]);
+    }
+
+    // Nothing has reached the image yet
+    if (totalNoise <= 0.0)
+        return shares;
+
+    for (auto i = 0u; i < probabilities.size(); ++i)
+    {
+        if (!adaptive[i]) continue;
+        auto noise = probabilities[i] * std::sqrt(secondMoments[i]);
+        shares[i] = minShareFraction * probabilities[i] + (1.0 - minShareFraction) * adaptiveProbability * noise / totalNoise;
+    }
+    return shares;
+}
+
+}
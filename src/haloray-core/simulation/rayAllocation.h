@@ -0,0 +1,41 @@
+#pragma once
+#include <cstdint>
+#include <vector>
+
+namespace HaloRay
+{
+
+/* Splits the rays of each frame between crystal populations by how much
+   noise they leave in the image, instead of by population weight alone.
+   Noise summed over all pixels is smallest when each population gets rays
+   in proportion to its probability times the root mean square weight of
+   its rays reaching the image. Rays are weighted by their probability
+   divided by their share of rays, so the image converges to the same
+   result. */
+class RayAllocation
+{
+public:
+    /* Second moments of ray weights are accumulated by the raytracing
+       shader into this many slots of 64-bit fixed point counters for each
+       population, low word first. This must match the shader. */
+    static const unsigned int slotsPerPopulation = 64;
+    static const unsigned int countersPerSlot = 2;
+    static constexpr double momentScale = 65536.0;
+
+    /* Every adaptive population gets at least this fraction of the rays
+       its probability would give it, so that a population that has not
+       reached the image yet is still traced */
+    static constexpr double minShareFraction = 0.25;
+
+    // Sum of the squared ray weights from the counters of one population
+    static double getMomentSum(const std::uint32_t *counters);
+
+    /* Shares of rays for each population, summing to the sum of the
+       probabilities. Populations that are not adaptive keep their
+       probability. Second moments are per traced ray. */
+    static std::vector<double> allocate(const std::vector<double> &probabilities,
+                                        const std::vector<double> &secondMoments,
+                                        const std::vector<bool> &adaptive);
+};
+
+}
@@ -0,0 +1,176 @@
+#include "rayDump.h"
+#include <chrono>
+#include <cstring>
+#include <stdexcept>
+#include <QFile>
+
+namespace HaloRay
+{
+
+namespace
+{
+
+const char fileMagic[8] = {'H', 'R', 'R', 'A', 'Y', 'S', '0', '2'};
+// Files of the first version have a header of a single record, without the dropped count
+const char firstVersionMagic[8] = {'H', 'R', 'R', 'A', 'Y', 'S', '0', '1'};
+const std::size_t firstVersionHeaderSize = sizeof(RayExitRecord);
+
+// Records are moved from the ring buffer to the file in batches of this size
+const std::size_t writeBatchSize = 1 << 16;
+
+}
+
+RayDumpWriter::RayDumpWriter(const std::string &path)
+    : m_file(path, std::ios::binary | std::ios::trunc),
+      m_buffer(bufferCapacity),
+      m_closing(false),
+      m_recordCount(0),
+      m_droppedCount(0),
+      m_tracedRayCount(0),
+      m_closed(false)
+{
+    if (!m_file)
+        throw std::runtime_error("Could not open ray dump file");
+
+    // The header is written again with the final counts when closing
+    writeHeader();
+    m_writerThread = std::thread(&RayDumpWriter::writeRecords, this);
+}
+
+RayDumpWriter::~RayDumpWriter()
+{
+    close();
+}
+
+std::size_t RayDumpWriter::write(const RayExitRecord *records, std::size_t count)
+{
+    auto queuedCount = m_buffer.push(records, count);
+    if (queuedCount < count)
+        m_droppedCount += count - queuedCount;
+    return queuedCount;
+}
+
+void RayDumpWriter::addTracedRays(std::uint64_t count)
+{
+    m_tracedRayCount += count;
+}
+
+std::uint64_t RayDumpWriter::getRecordCount() const
+{
+    return m_recordCount;
+}
+
+std::uint64_t RayDumpWriter::getDroppedCount() const
+{
+    return m_droppedCount;
+}
+
+void RayDumpWriter::close()
+{
+    if (m_closed)
+        return;
+    m_closed = true;
+
+    m_closing = true;
+    m_writerThread.join();
+
+    m_file.seekp(0);
+    writeHeader();
+    m_file.close();
+}
+
+void RayDumpWriter::writeRecords()
+{
+    std::vector<RayExitRecord> batch(writeBatchSize);
+    while (true)
+    {
+        // Records pushed before closing was requested are still written
+        auto closing = m_closing.load();
+        auto count = m_buffer.pop(batch.data(), batch.size());
+        if (count > 0)
+        {
+            m_file.write(reinterpret_cast<const char *>(batch.data()), count * sizeof(RayExitRecord));
+            m_recordCount += count;
+        }
+        else if (closing)
+        {
+            break;
+        }
+        else
+        {
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+    }
+}
+
+void RayDumpWriter::writeHeader()
+{
+    RayDumpHeader header = {};
+    std::memcpy(header.magic, fileMagic, sizeof(fileMagic));
+    header.recordSize = sizeof(RayExitRecord);
+    header.recordCount = m_recordCount;
+    header.tracedRayCount = m_tracedRayCount;
+    header.droppedCount = m_droppedCount;
+    m_file.write(reinterpret_cast<const char *>(&header), sizeof(header));
+}
+
+RayDumpReader::RayDumpReader(const std::string &path)
+    : m_file(std::make_unique<QFile>(QString::fromStdString(path))),
+      m_records(nullptr),
+      m_recordCount(0),
+      m_tracedRayCount(0),
+      m_droppedCount(0)
+{
+    if (!m_file->open(QIODevice::ReadOnly))
+        throw std::runtime_error("Could not open ray dump file");
+
+    auto size = static_cast<std::uint64_t>(m_file->size());
+    if (size < firstVersionHeaderSize)
+        throw std::runtime_error("File is not a HaloRay ray dump");
+
+    auto data = m_file->map(0, m_file->size());
+    if (data == nullptr)
+        throw std::runtime_error("Could not map ray dump file to memory");
+
+    RayDumpHeader header = {};
+    std::size_t headerSize;
+    if (std::memcmp(data, firstVersionMagic, sizeof(firstVersionMagic)) == 0)
+        headerSize = firstVersionHeaderSize;
+    else if (std::memcmp(data, fileMagic, sizeof(fileMagic)) == 0 && size >= sizeof(RayDumpHeader))
+        headerSize = sizeof(RayDumpHeader);
+    else
+        throw std::runtime_error("File is not a HaloRay ray dump");
+
+    std::memcpy(&header, data, headerSize);
+    if (header.recordSize != sizeof(RayExitRecord))
+        throw std::runtime_error("File is not a HaloRay ray dump");
+
+    m_records = reinterpret_cast<const RayExitRecord *>(data + headerSize);
+    m_recordCount = (size - headerSize) / sizeof(RayExitRecord);
+    m_tracedRayCount = header.tracedRayCount;
+    m_droppedCount = header.droppedCount;
+}
+
+RayDumpReader::~RayDumpReader() = default;
+
+std::uint64_t RayDumpReader::getRecordCount() const
+{
+    return m_recordCount;
+}
+
+std::uint64_t RayDumpReader::getTracedRayCount() const
+{
+    return m_tracedRayCount;
+}
+
+std::uint64_t RayDumpReader::getDroppedCount() const
+{
+    return m_droppedCount;
+}
+
+const RayExitRecord *RayDumpReader::getRecords() const
+{
+    return m_records;
+}
+
+}
@@ -0,0 +1,112 @@
+#pragma once
+#include <atomic>
+#include <cstdint>
+#include <fstream>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+#include "spscRingBuffer.h"
+
+class QFile;
+
+namespace HaloRay
+{
+
+/* A ray escaping the crystals, in the world frame. The layout must match
+   the ray dump in the raytracing shader. */
+struct RayExitRecord
+{
+    float direction[3];
+    float wavelength;
+    std::uint32_t populationIndex;
+    float weight;
+    // Number of internal reflections, summed over all scattering events
+    std::uint32_t pathLength;
+    std::uint32_t scatteringEvents;
+
+    // Rays sampled from transfer tables do not know their path length
+    static const std::uint32_t unknownPathLength = 0xffffffffu;
+};
+
+static_assert(sizeof(RayExitRecord) == 32, "Ray exit records must be 32 bytes");
+
+/* Ray dump files start with a header of the same size as two records, so
+   that the records can be used directly from a memory mapped file. Files
+   of the first version have a header of one record, which ends after the
+   traced ray count. */
+struct RayDumpHeader
+{
+    char magic[8];
+    std::uint32_t recordSize;
+    std::uint32_t reserved;
+    std::uint64_t recordCount;
+    // Number of rays traced while dumping, including rays that did not escape
+    std::uint64_t tracedRayCount;
+    // Records dropped because the disk could not keep up, their rays are included in the traced ray count
+    std::uint64_t droppedCount;
+    std::uint64_t padding[3];
+};
+
+static_assert(sizeof(RayDumpHeader) == 2 * sizeof(RayExitRecord), "Ray dump header must be the size of two records");
+
+/* Streams ray exit records to a file. Records are queued in a lock-free
+   ring buffer and written by a separate thread, so the simulation never
+   waits for the disk. If the disk cannot keep up, records that do not fit
+   in the buffer are dropped and counted. */
+class RayDumpWriter
+{
+public:
+    static const std::size_t bufferCapacity = 1 << 21;
+
+    explicit RayDumpWriter(const std::string &path);
+    ~RayDumpWriter();
+
+    // Returns the number of records queued for writing
+    std::size_t write(const RayExitRecord *records, std::size_t count);
+    void addTracedRays(std::uint64_t count);
+
+    std::uint64_t getRecordCount() const;
+    std::uint64_t getDroppedCount() const;
+
+    // Writes all queued records and finishes the file
+    void close();
+
+private:
+    void writeRecords();
+    void writeHeader();
+
+    std::ofstream m_file;
+    SpscRingBuffer<RayExitRecord> m_buffer;
+    std::thread m_writerThread;
+    std::atomic<bool> m_closing;
+    std::atomic<std::uint64_t> m_recordCount;
+    std::atomic<std::uint64_t> m_droppedCount;
+    std::uint64_t m_tracedRayCount;
+    bool m_closed;
+};
+
+// Memory maps a ray dump file for reading
+class RayDumpReader
+{
+public:
+    explicit RayDumpReader(const std::string &path);
+    ~RayDumpReader();
+
+    /* The record count is taken from the file size, so that files left
+       unfinished by a crash can still be read */
+    std::uint64_t getRecordCount() const;
+    std::uint64_t getTracedRayCount() const;
+    // Always zero for files of the first version, which did not count them
+    std::uint64_t getDroppedCount() const;
+    const RayExitRecord *getRecords() const;
+
+private:
+    std::unique_ptr<QFile> m_file;
+    const RayExitRecord *m_records;
+    std::uint64_t m_recordCount;
+    std::uint64_t m_tracedRayCount;
+    std::uint64_t m_droppedCount;
+};
+
+}
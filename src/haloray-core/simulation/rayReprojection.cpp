@@ -0,0 +1,147 @@
+#include "rayReprojection.h"
+#include <algorithm>
+#include <cmath>
+#include "trigonometryUtilities.h"
+
+namespace HaloRay
+{
+
+namespace
+{
+
+float xFit1931(float wave)
+{
+    float t1 = (wave - 442.0f) * ((wave < 442.0f) ? 0.0624f : 0.0374f);
+    float t2 = (wave - 599.8f) * ((wave < 599.8f) ? 0.0264f : 0.0323f);
+    float t3 = (wave - 501.1f) * ((wave < 501.1f) ? 0.0490f : 0.0382f);
+    return 0.362f * std::exp(-0.5f * t1 * t1) + 1.056f * std::exp(-0.5f * t2 * t2) - 0.065f * std::exp(-0.5f * t3 * t3);
+}
+
+float yFit1931(float wave)
+{
+    float t1 = (wave - 568.8f) * ((wave < 568.8f) ? 0.0213f : 0.0247f);
+    float t2 = (wave - 530.9f) * ((wave < 530.9f) ? 0.0613f : 0.0322f);
+    return 0.821f * std::exp(-0.5f * t1 * t1) + 0.286f * std::exp(-0.5f * t2 * t2);
+}
+
+float zFit1931(float wave)
+{
+    float t1 = (wave - 437.0f) * ((wave < 437.0f) ? 0.0845f : 0.0278f);
+    float t2 = (wave - 459.0f) * ((wave < 459.0f) ? 0.0385f : 0.0725f);
+    return 1.217f * std::exp(-0.5f * t1 * t1) + 0.681f * std::exp(-0.5f * t2 * t2);
+}
+
+}
+
+RayReprojection::RayReprojection(const Camera &camera, unsigned int width, unsigned int height)
+    : m_camera(camera),
+      m_focalLength(camera.getFocalLength()),
+      m_width(width),
+      m_height(height),
+      m_image(static_cast<std::size_t>(width) * height * 3, 0.0f)
+{
+}
+
+bool RayReprojection::getPixel(const float direction[3], unsigned int &x, unsigned int &y) const
+{
+    // Hide subhorizon rays
+    if (m_camera.hideSubHorizon && direction[1] > 0.0f)
+        return false;
+
+    // Rotate to the camera frame, like getCameraOrientationMatrix in the raytracing shader
+    float pitch = degToRad(m_camera.pitch);
+    float yaw = degToRad(m_camera.yaw);
+    float yawed[3] = {
+        std::cos(yaw) * direction[0] + std::sin(yaw) * direction[2],
+        direction[1],
+        -std::sin(yaw) * direction[0] + std::cos(yaw) * direction[2]};
+    float rotated[3] = {
+        -yawed[0],
+        -(std::cos(pitch) * yawed[1] - std::sin(pitch) * yawed[2]),
+        -(std::sin(pitch) * yawed[1] + std::cos(pitch) * yawed[2])};
+
+    float length = std::sqrt(rotated[0] * rotated[0] + rotated[1] * rotated[1] + rotated[2] * rotated[2]);
+    if (length == 0.0f)
+        return false;
+
+    float polarAngle = std::atan2(std::hypot(rotated[0], rotated[1]), rotated[2]);
+    float azimuth = std::atan2(rotated[1], rotated[0]);
+
+    float projectionFunction = 0.0f;
+    switch (m_camera.projection)
+    {
+    case Stereographic:
+        projectionFunction = 2.0f * std::tan(polarAngle / 2.0f);
+        break;
+    case Rectilinear:
+        if (polarAngle > 0.5f * PI)
+            return false;
+        projectionFunction = std::tan(polarAngle);
+        break;
+    case Equidistant:
+        projectionFunction = polarAngle;
+        break;
+    case EqualArea:
+        projectionFunction = 2.0f * std::sin(polarAngle / 2.0f);
+        break;
+    case Orthographic:
+        if (polarAngle > 0.5f * PI)
+            return false;
+        projectionFunction = std::sin(polarAngle);
+        break;
+    }
+
+    float aspectRatio = static_cast<float>(m_height) / m_width;
+    float normalizedX = 0.5f + m_focalLength * projectionFunction * aspectRatio * std::cos(azimuth);
+    float normalizedY = 0.5f + m_focalLength * projectionFunction * std::sin(azimuth);
+    if (normalizedX <= 0.0f || normalizedY <= 0.0f || normalizedX >= 1.0f || normalizedY >= 1.0f)
+        return false;
+
+    x = std::min(static_cast<unsigned int>(m_width * normalizedX), m_width - 1);
+    y = std::min(static_cast<unsigned int>(m_height * normalizedY), m_height - 1);
+    return true;
+}
+
+void RayReprojection::addRays(const RayExitRecord *records, std::size_t count)
+{
+    for (std::size_t i = 0; i < count; ++i)
+    {
+        const auto &record = records[i];
+        unsigned int x, y;
+        if (!getPixel(record.direction, x, y))
+            continue;
+
+        auto color = getRayColor(record.wavelength);
+        auto pixel = &m_image[(static_cast<std::size_t>(y) * m_width + x) * 3];
+        for (auto channel = 0u; channel < 3; ++channel)
+            pixel[channel] += record.weight * color[channel];
+    }
+}
+
+unsigned int RayReprojection::getWidth() const
+{
+    return m_width;
+}
+
+unsigned int RayReprojection::getHeight() const
+{
+    return m_height;
+}
+
+const std::vector<float> &RayReprojection::getImage() const
+{
+    return m_image;
+}
+
+std::array<float, 3> RayReprojection::getRayColor(float wavelength)
+{
+    float sunRadiance = 1.0f - 0.0013333f * wavelength;
+    float x = sunRadiance * xFit1931(wavelength);
+    float y = sunRadiance * yFit1931(wavelength);
+    float z = sunRadiance * zFit1931(wavelength);
+    return {3.24096994f * x - 1.53738318f * y - 0.49861076f * z,
+            -0.96924364f * x + 1.8759675f * y + 0.04155506f * z,
+            0.05563008f * x - 0.20397696f * y + 1.05697151f * z};
+}
+
+}
@@ -0,0 +1,43 @@
+#pragma once
+#include <array>
+#include <cstddef>
+#include <vector>
+#include "camera.h"
+#include "rayDump.h"
+
+namespace HaloRay
+{
+
+/* Bins dumped rays into an image through a camera, in the same way the
+   raytracing shader projects traced rays. Rows are stored from the bottom
+   up, like in the simulation texture. */
+class RayReprojection
+{
+public:
+    RayReprojection(const Camera &camera, unsigned int width, unsigned int height);
+
+    /* Finds the pixel a ray escaping in the given direction ends up in.
+       Returns false if the ray misses the image. */
+    bool getPixel(const float direction[3], unsigned int &x, unsigned int &y) const;
+
+    void addRays(const RayExitRecord *records, std::size_t count);
+
+    unsigned int getWidth() const;
+    unsigned int getHeight() const;
+    // RGB values of each pixel
+    const std::vector<float> &getImage() const;
+
+    /* Linear sRGB color of a ray of the given wavelength, for a sun with
+       a daylight spectrum. This matches getRayColor in the raytracing
+       shader without the atmosphere. */
+    static std::array<float, 3> getRayColor(float wavelength);
+
+private:
+    Camera m_camera;
+    float m_focalLength;
+    unsigned int m_width;
+    unsigned int m_height;
+    std::vector<float> m_image;
+};
+
+}
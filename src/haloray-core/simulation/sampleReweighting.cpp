@@ -0,0 +1,135 @@
+#include "sampleReweighting.h"
+#include <cmath>
+#include <limits>
+#include "transferTable.h"
+#include "trigonometryUtilities.h"
+
+namespace HaloRay
+{
+
+namespace
+{
+
+bool usesSameTable(const CrystalPopulation &first, const CrystalPopulation &second, TabulatedParameter parameter)
+{
+    if (first.usesTable(parameter) != second.usesTable(parameter))
+        return false;
+    if (!first.usesTable(parameter))
+        return true;
+
+    const auto &firstTable = first.distributionTables[parameter];
+    const auto &secondTable = second.distributionTables[parameter];
+    return firstTable.getBinEdges() == secondTable.getBinEdges() && firstTable.getWeights() == secondTable.getWeights();
+}
+
+// Changes to a Gaussian distribution can only be reweighted if neither is a point
+bool canReweightGaussian(float fromAverage, float fromStd, float toAverage, float toStd)
+{
+    if (fromStd < 0.0f || (fromAverage == toAverage && fromStd == toStd))
+        return true;
+    return fromStd > 0.0f && toStd > 0.0f;
+}
+
+}
+
+void LatentDistributions::appendTo(std::vector<float> &buffer) const
+{
+    buffer.insert(buffer.end(), {tiltAverage, tiltStd, rotationAverage, rotationStd, caRatioAverage, caRatioStd, 0.0f, 0.0f});
+}
+
+bool LatentDistributions::operator==(const LatentDistributions &other) const
+{
+    return tiltAverage == other.tiltAverage &&
+           tiltStd == other.tiltStd &&
+           rotationAverage == other.rotationAverage &&
+           rotationStd == other.rotationStd &&
+           caRatioAverage == other.caRatioAverage &&
+           caRatioStd == other.caRatioStd;
+}
+
+bool LatentDistributions::operator!=(const LatentDistributions &other) const
+{
+    return !(*this == other);
+}
+
+LatentDistributions LatentDistributions::fromPopulation(const CrystalPopulation &population)
+{
+    LatentDistributions distributions;
+    auto gaussianTilt = population.tiltDistribution == Gaussian;
+    auto gaussianRotation = population.rotationDistribution == Gaussian;
+    auto gaussianCaRatio = population.customShape.isEmpty() && !population.usesTable(CaRatioTable);
+
+    distributions.tiltAverage = gaussianTilt ? degToRad(population.tiltAverage) : 0.0f;
+    distributions.tiltStd = gaussianTilt ? degToRad(population.tiltStd) : -1.0f;
+    distributions.rotationAverage = gaussianRotation ? degToRad(population.rotationAverage) : 0.0f;
+    distributions.rotationStd = gaussianRotation ? degToRad(population.rotationStd) : -1.0f;
+    distributions.caRatioAverage = gaussianCaRatio ? population.caRatioAverage : 0.0f;
+    distributions.caRatioStd = gaussianCaRatio ? population.caRatioStd : -1.0f;
+    return distributions;
+}
+
+bool SampleReweighting::canReweight(const CrystalPopulation &from, const CrystalPopulation &to)
+{
+    // Apart from the reweighted parameters, the populations must be identical
+    auto normalized = to;
+    normalized.tiltAverage = from.tiltAverage;
+    normalized.tiltStd = from.tiltStd;
+    normalized.rotationAverage = from.rotationAverage;
+    normalized.rotationStd = from.rotationStd;
+    normalized.caRatioAverage = from.caRatioAverage;
+    normalized.caRatioStd = from.caRatioStd;
+
+    if (normalized.enabled != from.enabled ||
+        normalized.tiltDistribution != from.tiltDistribution ||
+        normalized.rotationDistribution != from.rotationDistribution ||
+        !usesSameTable(normalized, from, TiltTable) ||
+        !usesSameTable(normalized, from, RotationTable) ||
+        TransferTable::getShapeKey(normalized) != TransferTable::getShapeKey(from))
+        return false;
+
+    auto fromDistributions = LatentDistributions::fromPopulation(from);
+    auto toDistributions = LatentDistributions::fromPopulation(to);
+    return canReweightGaussian(fromDistributions.tiltAverage, fromDistributions.tiltStd, toDistributions.tiltAverage, toDistributions.tiltStd) &&
+           canReweightGaussian(fromDistributions.rotationAverage, fromDistributions.rotationStd, toDistributions.rotationAverage, toDistributions.rotationStd) &&
+           canReweightGaussian(fromDistributions.caRatioAverage, fromDistributions.caRatioStd, toDistributions.caRatioAverage, toDistributions.caRatioStd);
+}
+
+double SampleReweighting::getSecondMoment(double fromAverage, double fromStd, double toAverage, double toStd)
+{
+    if (fromStd <= 0.0 || toStd <= 0.0)
+        return fromAverage == toAverage && fromStd == toStd ? 1.0 : std::numeric_limits<double>::infinity();
+
+    // The integral diverges if the new distribution is much wider than the old one
+    auto denominator = 2.0 * fromStd * fromStd - toStd * toStd;
+    if (denominator <= 0.0)
+        return std::numeric_limits<double>::infinity();
+
+    auto averageDifference = toAverage - fromAverage;
+    return fromStd * fromStd / (toStd * std::sqrt(denominator)) * std::exp(averageDifference * averageDifference / denominator);
+}
+
+double SampleReweighting::getEffectiveSampleFraction(const std::vector<SamplingEpoch> &epochs, const LatentDistributions &target)
+{
+    double rayCount = 0.0;
+    double weightedRayCount = 0.0;
+    for (const auto &epoch : epochs)
+    {
+        const auto &from = epoch.distributions;
+        double secondMoment = 1.0;
+        if (from.tiltStd >= 0.0f)
+            secondMoment *= getSecondMoment(from.tiltAverage, from.tiltStd, target.tiltAverage, target.tiltStd);
+        if (from.rotationStd >= 0.0f)
+            secondMoment *= getSecondMoment(from.rotationAverage, from.rotationStd, target.rotationAverage, target.rotationStd);
+        if (from.caRatioStd >= 0.0f)
+            secondMoment *= getSecondMoment(from.caRatioAverage, from.caRatioStd, target.caRatioAverage, target.caRatioStd);
+
+        rayCount += epoch.rayCount;
+        weightedRayCount += epoch.rayCount * secondMoment;
+    }
+
+    if (rayCount == 0.0)
+        return 1.0;
+    return rayCount / weightedRayCount;
+}
+
+}
@@ -0,0 +1,67 @@
+#pragma once
+#include <vector>
+#include "crystalPopulation.h"
+
+namespace HaloRay
+{
+
+/* Gaussian distributions of the crystal parameters that traced rays can
+   be reweighted for. Angles are in radians. A negative standard deviation
+   means the parameter is not sampled from a Gaussian distribution, and
+   does not affect the weights. */
+struct LatentDistributions
+{
+    float tiltAverage;
+    float tiltStd;
+    float rotationAverage;
+    float rotationStd;
+    float caRatioAverage;
+    float caRatioStd;
+
+    static const unsigned int floatsPerDistributions = 8;
+    void appendTo(std::vector<float> &buffer) const;
+
+    bool operator==(const LatentDistributions &other) const;
+    bool operator!=(const LatentDistributions &other) const;
+
+    static LatentDistributions fromPopulation(const CrystalPopulation &population);
+};
+
+// Rays traced for a crystal population with the same distributions
+struct SamplingEpoch
+{
+    LatentDistributions distributions;
+    double rayCount;
+};
+
+/* Reuses rays traced with one set of crystal parameter distributions for
+   another, by weighting each ray with the ratio of the probability
+   densities of its sampled parameters */
+struct SampleReweighting
+{
+    /* Maximum number of rays stored for reweighting, and the size of each
+       record. Rays are stored once with the point they are seen at, before
+       the splat filter spreads them over pixels. These must match the
+       sample recording in the raytracing and reweighting shaders. */
+    static const unsigned int recordCapacity = 1u << 22;
+    static const unsigned int uintsPerRecord = 7;
+    static const unsigned int maxEpochs = 16;
+
+    // Reweighting is abandoned if it leaves fewer effective samples than this
+    static constexpr double minEffectiveSampleFraction = 0.25;
+
+    /* Returns true if rays traced for the first population are valid
+       samples for the second one after reweighting, i.e. only the
+       averages and standard deviations of Gaussian tilt, rotation and
+       C/A ratio distributions differ */
+    static bool canReweight(const CrystalPopulation &from, const CrystalPopulation &to);
+
+    // Expected value of the squared density ratio of two Gaussian distributions
+    static double getSecondMoment(double fromAverage, double fromStd, double toAverage, double toStd);
+
+    /* Expected effective sample size after reweighting rays of all epochs
+       to the target distributions, relative to the number of rays */
+    static double getEffectiveSampleFraction(const std::vector<SamplingEpoch> &epochs, const LatentDistributions &target);
+};
+
+}
@@ -0,0 +1,277 @@
+#include "scatteringTable.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <istream>
+#include <ostream>
+#include <stdexcept>
+
+namespace HaloRay
+{
+
+namespace
+{
+
+const char fileMagic[8] = {'H', 'R', 'S', 'C', 'T', 'B', 'L', '2'};
+// Tables saved before the settings were stored with them
+const char unversionedFileMagic[8] = {'H', 'R', 'S', 'C', 'T', 'B', 'L', '1'};
+const float pi = 3.14159265358979f;
+
+// Upper limit for the size of loaded tables, to reject corrupted files early
+const std::uint64_t maxValueCount = 1ull << 32;
+
+template <typename T>
+void writeValue(std::ostream &stream, T value)
+{
+    stream.write(reinterpret_cast<const char *>(&value), sizeof(T));
+}
+
+template <typename T>
+T readValue(std::istream &stream)
+{
+    T value;
+    stream.read(reinterpret_cast<char *>(&value), sizeof(T));
+    if (!stream)
+        throw std::runtime_error("Unexpected end of scattering table file");
+    return value;
+}
+
+}
+
+ScatteringTable::Settings::Settings()
+    : crystalFingerprint(0),
+      multipleScatteringProbability(0.0f),
+      maxScatteringOrders(0),
+      russianRouletteDepth(0),
+      runSeed(0),
+      quasiRandomSampling(false),
+      sunDiameter(0.0f),
+      atmosphere({false, 0.0, 0.0})
+{
+}
+
+bool ScatteringTable::Settings::operator==(const Settings &other) const
+{
+    return crystalFingerprint == other.crystalFingerprint &&
+           multipleScatteringProbability == other.multipleScatteringProbability &&
+           maxScatteringOrders == other.maxScatteringOrders &&
+           russianRouletteDepth == other.russianRouletteDepth &&
+           runSeed == other.runSeed &&
+           quasiRandomSampling == other.quasiRandomSampling &&
+           sunDiameter == other.sunDiameter &&
+           atmosphere == other.atmosphere;
+}
+
+bool ScatteringTable::Settings::operator!=(const Settings &other) const
+{
+    return !(*this == other);
+}
+
+ScatteringTable::ScatteringTable()
+    : m_width(0),
+      m_height(0),
+      m_minAltitude(0.0f),
+      m_altitudeStep(1.0f),
+      m_altitudeCount(0),
+      m_populationCount(0)
+{
+}
+
+ScatteringTable::ScatteringTable(unsigned int width, unsigned int height, float minAltitude, float altitudeStep, unsigned int altitudeCount, unsigned int populationCount)
+    : m_width(width),
+      m_height(height),
+      m_minAltitude(minAltitude),
+      m_altitudeStep(altitudeStep),
+      m_altitudeCount(altitudeCount),
+      m_populationCount(populationCount)
+{
+    if (width == 0 || height == 0 || altitudeCount == 0 || populationCount == 0)
+        throw std::runtime_error("Scattering table must not be empty");
+    if (!(altitudeStep > 0.0f))
+        throw std::runtime_error("Scattering table altitude step must be positive");
+
+    m_data.resize(static_cast<std::size_t>(getLayerSize()) * getLayerCount(), 0.0f);
+}
+
+bool ScatteringTable::isEmpty() const
+{
+    return m_data.empty();
+}
+
+unsigned int ScatteringTable::getWidth() const
+{
+    return m_width;
+}
+
+unsigned int ScatteringTable::getHeight() const
+{
+    return m_height;
+}
+
+float ScatteringTable::getMinAltitude() const
+{
+    return m_minAltitude;
+}
+
+float ScatteringTable::getMaxAltitude() const
+{
+    return getAltitude(m_altitudeCount - 1);
+}
+
+float ScatteringTable::getAltitudeStep() const
+{
+    return m_altitudeStep;
+}
+
+unsigned int ScatteringTable::getAltitudeCount() const
+{
+    return m_altitudeCount;
+}
+
+unsigned int ScatteringTable::getPopulationCount() const
+{
+    return m_populationCount;
+}
+
+float ScatteringTable::getAltitude(unsigned int altitudeIndex) const
+{
+    return m_minAltitude + altitudeIndex * m_altitudeStep;
+}
+
+const ScatteringTable::Settings &ScatteringTable::getSettings() const
+{
+    return m_settings;
+}
+
+void ScatteringTable::setSettings(const Settings &settings)
+{
+    m_settings = settings;
+}
+
+bool ScatteringTable::coversAltitude(float altitude) const
+{
+    if (isEmpty()) return false;
+    // Allow for rounding errors in the altitude of the last slice
+    float tolerance = 1.0e-3f * m_altitudeStep;
+    return altitude >= m_minAltitude - tolerance && altitude <= getMaxAltitude() + tolerance;
+}
+
+void ScatteringTable::getAltitudeSlices(float altitude, unsigned int &lowerIndex, unsigned int &upperIndex, float &upperWeight) const
+{
+    float position = (altitude - m_minAltitude) / m_altitudeStep;
+    position = std::min(std::max(position, 0.0f), static_cast<float>(m_altitudeCount - 1));
+    lowerIndex = static_cast<unsigned int>(std::floor(position));
+    upperIndex = std::min(lowerIndex + 1, m_altitudeCount - 1);
+    upperWeight = position - lowerIndex;
+}
+
+unsigned int ScatteringTable::getLayerIndex(unsigned int altitudeIndex, unsigned int populationIndex) const
+{
+    return altitudeIndex * m_populationCount + populationIndex;
+}
+
+unsigned int ScatteringTable::getLayerCount() const
+{
+    return m_altitudeCount * m_populationCount;
+}
+
+unsigned int ScatteringTable::getLayerSize() const
+{
+    return m_width * m_height * 3;
+}
+
+float *ScatteringTable::getLayer(unsigned int layerIndex)
+{
+    return m_data.data() + static_cast<std::size_t>(layerIndex) * getLayerSize();
+}
+
+const float *ScatteringTable::getLayer(unsigned int layerIndex) const
+{
+    return m_data.data() + static_cast<std::size_t>(layerIndex) * getLayerSize();
+}
+
+const std::vector<float> &ScatteringTable::getData() const
+{
+    return m_data;
+}
+
+float ScatteringTable::getCellSolidAngle() const
+{
+    // The map is equal-area, so every cell covers the same solid angle
+    return 4.0f * pi / (m_width * m_height);
+}
+
+std::array<float, 2> ScatteringTable::getTableCoordinates(float x, float y, float z)
+{
+    float azimuth = std::atan2(x, z);
+    return {azimuth / (2.0f * pi) + 0.5f, 0.5f * (std::min(std::max(y, -1.0f), 1.0f) + 1.0f)};
+}
+
+void ScatteringTable::save(std::ostream &stream) const
+{
+    stream.write(fileMagic, sizeof(fileMagic));
+    writeValue<std::uint32_t>(stream, m_width);
+    writeValue<std::uint32_t>(stream, m_height);
+    writeValue<std::uint32_t>(stream, m_altitudeCount);
+    writeValue<std::uint32_t>(stream, m_populationCount);
+    writeValue<float>(stream, m_minAltitude);
+    writeValue<float>(stream, m_altitudeStep);
+    writeValue<std::uint64_t>(stream, m_settings.crystalFingerprint);
+    writeValue<float>(stream, m_settings.multipleScatteringProbability);
+    writeValue<std::int32_t>(stream, m_settings.maxScatteringOrders);
+    writeValue<std::int32_t>(stream, m_settings.russianRouletteDepth);
+    writeValue<std::uint32_t>(stream, m_settings.runSeed);
+    writeValue<std::uint8_t>(stream, m_settings.quasiRandomSampling ? 1 : 0);
+    writeValue<float>(stream, m_settings.sunDiameter);
+    writeValue<std::uint8_t>(stream, m_settings.atmosphere.enabled ? 1 : 0);
+    writeValue<double>(stream, m_settings.atmosphere.turbidity);
+    writeValue<double>(stream, m_settings.atmosphere.groundAlbedo);
+    stream.write(reinterpret_cast<const char *>(m_data.data()), m_data.size() * sizeof(float));
+
+    if (!stream)
+        throw std::runtime_error("Writing scattering table failed");
+}
+
+ScatteringTable ScatteringTable::load(std::istream &stream)
+{
+    char magic[sizeof(fileMagic)];
+    stream.read(magic, sizeof(magic));
+    if (stream && std::memcmp(magic, unversionedFileMagic, sizeof(magic)) == 0)
+        throw std::runtime_error("Scattering table does not record the settings it was built with, and must be built again");
+    if (!stream || std::memcmp(magic, fileMagic, sizeof(magic)) != 0)
+        throw std::runtime_error("File is not a HaloRay scattering table");
+
+    auto width = readValue<std::uint32_t>(stream);
+    auto height = readValue<std::uint32_t>(stream);
+    auto altitudeCount = readValue<std::uint32_t>(stream);
+    auto populationCount = readValue<std::uint32_t>(stream);
+    auto minAltitude = readValue<float>(stream);
+    auto altitudeStep = readValue<float>(stream);
+
+    Settings settings;
+    settings.crystalFingerprint = readValue<std::uint64_t>(stream);
+    settings.multipleScatteringProbability = readValue<float>(stream);
+    settings.maxScatteringOrders = readValue<std::int32_t>(stream);
+    settings.russianRouletteDepth = readValue<std::int32_t>(stream);
+    settings.runSeed = readValue<std::uint32_t>(stream);
+    settings.quasiRandomSampling = readValue<std::uint8_t>(stream) != 0;
+    settings.sunDiameter = readValue<float>(stream);
+    settings.atmosphere.enabled = readValue<std::uint8_t>(stream) != 0;
+    settings.atmosphere.turbidity = readValue<double>(stream);
+    settings.atmosphere.groundAlbedo = readValue<double>(stream);
+
+    auto valueCount = static_cast<std::uint64_t>(width) * height * 3 * altitudeCount * populationCount;
+    if (valueCount > maxValueCount)
+        throw std::runtime_error("Scattering table is too large");
+
+    ScatteringTable table(width, height, minAltitude, altitudeStep, altitudeCount, populationCount);
+    table.m_settings = settings;
+    stream.read(reinterpret_cast<char *>(table.m_data.data()), table.m_data.size() * sizeof(float));
+    if (!stream)
+        throw std::runtime_error("Unexpected end of scattering table file");
+
+    return table;
+}
+
+}
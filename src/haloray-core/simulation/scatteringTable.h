@@ -0,0 +1,96 @@
+#pragma once
+#include <vector>
+#include <array>
+#include <iosfwd>
+#include <cstdint>
+#include "atmosphere.h"
+
+namespace HaloRay
+{
+
+/* Directions of scattered light for a range of sun altitudes, tabulated
+   separately for each crystal population. Each layer of the table is an
+   equal-area cylindrical map of ray directions in the world frame, where
+   X is the azimuth of the ray measured from the Z-axis and Y is the
+   Y component of the ray direction. Layers contain the RGB radiance
+   scattered into each direction per traced ray and per steradian, so
+   they do not depend on the camera or the number of traced rays. */
+class ScatteringTable
+{
+public:
+    static const unsigned int defaultWidth = 720;
+    static const unsigned int defaultHeight = 360;
+
+    /* Crystals and simulation settings the table was built with. They
+       are stored with the table, so that a table is never used for a
+       simulation it does not describe. */
+    struct Settings
+    {
+        Settings();
+
+        // Hash of the crystal populations, see CrystalPopulationRepository::getFingerprint
+        std::uint64_t crystalFingerprint;
+        float multipleScatteringProbability;
+        int maxScatteringOrders;
+        int russianRouletteDepth;
+        unsigned int runSeed;
+        bool quasiRandomSampling;
+        float sunDiameter;
+        Atmosphere atmosphere;
+
+        bool operator==(const Settings &other) const;
+        bool operator!=(const Settings &other) const;
+    };
+
+    ScatteringTable();
+    ScatteringTable(unsigned int width, unsigned int height, float minAltitude, float altitudeStep, unsigned int altitudeCount, unsigned int populationCount);
+
+    bool isEmpty() const;
+    unsigned int getWidth() const;
+    unsigned int getHeight() const;
+    float getMinAltitude() const;
+    float getMaxAltitude() const;
+    float getAltitudeStep() const;
+    unsigned int getAltitudeCount() const;
+    unsigned int getPopulationCount() const;
+    float getAltitude(unsigned int altitudeIndex) const;
+
+    const Settings &getSettings() const;
+    void setSettings(const Settings &settings);
+
+    bool coversAltitude(float altitude) const;
+    /* Finds the two altitude slices surrounding the given altitude, and
+       the interpolation weight of the upper slice */
+    void getAltitudeSlices(float altitude, unsigned int &lowerIndex, unsigned int &upperIndex, float &upperWeight) const;
+
+    /* Layers are ordered by altitude first, so that each altitude slice
+       has consecutive layers for all populations */
+    unsigned int getLayerIndex(unsigned int altitudeIndex, unsigned int populationIndex) const;
+    unsigned int getLayerCount() const;
+    unsigned int getLayerSize() const;
+    float *getLayer(unsigned int layerIndex);
+    const float *getLayer(unsigned int layerIndex) const;
+    const std::vector<float> &getData() const;
+
+    float getCellSolidAngle() const;
+
+    /* Table coordinates of a normalized direction in the range [0, 1].
+       This must match the direction mapping in the raytracing and
+       scattering table shaders. */
+    static std::array<float, 2> getTableCoordinates(float x, float y, float z);
+
+    void save(std::ostream &stream) const;
+    static ScatteringTable load(std::istream &stream);
+
+private:
+    unsigned int m_width;
+    unsigned int m_height;
+    float m_minAltitude;
+    float m_altitudeStep;
+    unsigned int m_altitudeCount;
+    unsigned int m_populationCount;
+    Settings m_settings;
+    std::vector<float> m_data;
+};
+
+}
@@ -5,6 +5,7 @@
 #include <cmath>
 #include <algorithm>
 #include <stdexcept>
+#include <QFile>
 #include "../opengl/texture.h"
 #include "trigonometryUtilities.h"
 #include "camera.h"
@@ -12,18 +13,42 @@
 #include "crystalPopulation.h"
 #include "hosekWilkie/ArHosekSkyModel.h"
 #include "skyModel.h"
+#include "sobolSequence.h"
+#include "pathGuide.h"
+#include "phaseFunction.h"
+#include "rayAllocation.h"
+#include "transferTable.h"
+#include "wavefront.h"
 
 namespace HaloRay
 {
 
+namespace
+{
+
+// Trace modes of the raytracing shader, which must match the TRACE_MODE_* definitions in it
+enum TraceMode
+{
+    TraceModeDirect,
+    TraceModeBuildTransferTable,
+    TraceModeTransferTable
+};
+
+/* Results gathered on the CPU are refreshed less often as the image
+converges: on the first iterations and then every 16th one */
+bool isRefreshIteration(unsigned int iteration)
+{
+    return iteration < 16 ? (iteration & (iteration - 1)) == 0 : iteration % 16 == 0;
+}
+
+}
+
 SimulationEngine::SimulationEngine(
     std::shared_ptr<CrystalPopulationRepository> crystalRepository,
     QObject *parent)
     : QObject(parent),
       m_outputWidth(800),
       m_outputHeight(600),
-      m_mersenneTwister(std::mt19937(std::random_device()())),
-      m_uniformDistribution(std::uniform_int_distribution<unsigned int>(0, std::numeric_limits<unsigned int>::max())),
       m_camera(Camera::createDefaultCamera()),
       m_light(LightSource::createDefaultLightSource()),
       m_running(false),
@@ -32,6 +57,74 @@ SimulationEngine::SimulationEngine(
       m_iteration(0),
       m_cameraLockedToLightSource(false),
       m_multipleScatteringProbability(0.0),
+      m_russianRouletteDepth(10),
+      m_pathLengthStatisticsEnabled(false),
+      m_pathLengthBuffer(0),
+      m_pathLengthBufferPopulationCount(0),
+      m_quasiRandomSampling(true),
+      m_runSeed(std::random_device()() % std::numeric_limits<int>::max()),
+      m_distributionTableTexture(0),
+      m_crystalFaceBuffer(0),
+      m_crystalTriangleBuffer(0),
+      m_scatteringTableSettings(),
+      m_scatteringTableTexture(0),
+      m_phaseFunctionBuffer(0),
+      m_phaseFunctionRadianceBuffer(0),
+      m_phaseFunctionRayCount(0.0),
+      m_phaseFunctionRaysPerStep(0.0),
+      m_compositingPhaseFunction(false),
+      m_transferTablesEnabled(false),
+      m_sampleReweightingEnabled(false),
+      m_sampleRecordsOverflowed(false),
+      m_sampleRecordBuffer(0),
+      m_samplingDistributionBuffer(0),
+      m_targetDistributionBuffer(0),
+      m_rayDumpBuffers(),
+      m_rayDumpBufferIndex(0),
+      m_rayDumpBufferCapacity(0),
+      m_maxScatteringOrders(2),
+      m_continuationBuffers{0, 0},
+      m_continuationCapacity(0),
+      m_continuationPopulationCount(0),
+      m_populationCdfBuffer(0),
+      m_pathLayerTexture(0),
+      m_pathLayerStepTexture(0),
+      m_pathLayerErrorTexture(0),
+      m_pathLayerMaskBuffer(0),
+      m_visiblePathLayers((1u << maxPathLayers) - 1),
+      m_otherRaysVisible(true),
+      m_compositingPathLayers(false),
+      m_sunConvolutionEnabled(false),
+      m_sunConvolutionGridTexture(0),
+      m_sunConvolutionGridLayers(0),
+      m_sunConvolutionTexture(0),
+      m_sunConvolutionIteration(0),
+      m_limbDarkeningScaler{1.0f, 1.0f, 1.0f},
+      m_compositingSunConvolution(false),
+      m_pathGuidingEnabled(false),
+      m_pathGuideCdfBuffer(0),
+      m_pathGuideCounterBuffer(0),
+      m_pathGuidePopulationCount(0),
+      m_adaptiveRayAllocationEnabled(false),
+      m_rayMomentBuffer(0),
+      m_rayMomentPopulationCount(0),
+      m_wavefrontTracingEnabled(false),
+      m_wavefrontBounceBuffers{0, 0},
+      m_wavefrontEscapeBuffer(0),
+      m_wavefrontCapacity(0),
+      m_hybridTracingEnabled(false),
+      m_cpuBatchStale(false),
+      m_cpuSplatBuffer(0),
+      m_gpuTimerQuery(0),
+      m_gpuTimerPending(false),
+      m_gpuTimedRayCount(0),
+      m_cpuRayShare(0.0),
+      m_outputViewTexture(0),
+      m_outputViewStepTexture(0),
+      m_outputViewErrorTexture(0),
+      m_outputViewTextureWidth(0),
+      m_outputViewTextureHeight(0),
+      m_monochrome(false),
       m_crystalRepository(crystalRepository),
       m_atmosphere(Atmosphere::createDefaultAtmosphere())
 {
@@ -70,7 +163,11 @@ void SimulationEngine::setLightSource(const LightSource light)
 {
     if (m_light == light) return;
 
-    clear();
+    // The phase function includes the size of the sun disk, but not its altitude
+    if (m_light.diameter != light.diameter)
+        reset();
+    else
+        clear();
     m_light = light;
     if (m_cameraLockedToLightSource)
     {
@@ -96,6 +193,8 @@ void SimulationEngine::setAtmosphere(Atmosphere atmosphere)
 
 unsigned int SimulationEngine::getOutputTextureHandle() const
 {
+    if (m_compositingPhaseFunction || m_compositingPathLayers || m_compositingSunConvolution)
+        return m_compositeTexture->getHandle();
     return m_simulationTexture->getHandle();
 }
 
@@ -104,6 +203,21 @@ unsigned int SimulationEngine::getBackgroundTextureHandle() const
     return m_backgroundTexture->getHandle();
 }
 
+unsigned int SimulationEngine::getSecondMomentTextureHandle() const
+{
+    return m_secondMomentTexture->getHandle();
+}
+
+unsigned int SimulationEngine::getOutputWidth() const
+{
+    return m_outputWidth;
+}
+
+unsigned int SimulationEngine::getOutputHeight() const
+{
+    return m_outputHeight;
+}
+
 unsigned int SimulationEngine::getIteration() const
 {
     return m_iteration;
@@ -121,19 +235,26 @@ void SimulationEngine::start()
 void SimulationEngine::stop()
 {
     m_running = false;
+    if (m_pathLengthStatisticsEnabled)
+        logPathLengthStatistics();
 }
 
 void SimulationEngine::step()
 {
+    // Rays would be traced with only part of the changes of the batch applied
+    if (m_invalidations.isUpdating())
+        return;
+
     ++m_iteration;
+    m_compositingPhaseFunction = false;
+    m_compositingPathLayers = false;
+    m_compositingSunConvolution = false;
 
     if (m_atmosphere.enabled && m_iteration == 1)
     {
         auto skyState = SkyModel::Create(degToRad(m_light.altitude), m_atmosphere.turbidity, m_atmosphere.groundAlbedo, degToRad(m_light.diameter / 2.0));
 
-        for (auto i = 0u; i < 31; ++i) {
-            m_sunSpectrumCache[i] = skyState.sunSpectrum[i];
-        }
+        updateSunSpectrum(skyState);
 
         glMemoryBarrier(GL_SHADER_IMAGE_ACCESS_BARRIER_BIT);
         glBindImageTexture(m_backgroundTexture->getTextureUnit(), m_backgroundTexture->getHandle(), 0, GL_FALSE, 0, GL_READ_WRITE, GL_RGBA32F);
@@ -163,66 +284,537 @@ void SimulationEngine::step()
         glDispatchCompute(m_outputWidth, m_outputHeight, 1);
     }
 
+    if (isUsingScatteringTable())
+    {
+        resampleScatteringTable();
+        return;
+    }
+
+    if (m_iteration == 1)
+    {
+        updateDistributionTables();
+        updateCustomShapeBuffers();
+    }
+    if (usesContinuations())
+    {
+        if (m_iteration == 1 || m_continuationBuffers[0] == 0)
+            initializeContinuationBuffers(true);
+        startContinuationQueue();
+    }
+    if (m_wavefrontTracingEnabled && m_iteration == 1)
+        initializeWavefrontBuffers();
+    glActiveTexture(GL_TEXTURE3);
+    glBindTexture(GL_TEXTURE_2D, m_distributionTableTexture);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 2, m_crystalFaceBuffer);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 3, m_crystalTriangleBuffer);
+
+    // Rays are traced into a separate image for each step, which is added to the accumulated one afterwards
     glMemoryBarrier(GL_SHADER_IMAGE_ACCESS_BARRIER_BIT);
-    glBindImageTexture(m_simulationTexture->getTextureUnit(), m_simulationTexture->getHandle(), 0, GL_FALSE, 0, GL_READ_WRITE, GL_RGBA32F);
+    const auto &targetTexture = usesTwoLevelAccumulation() ? m_accumulationStepTexture : m_simulationTexture;
+    glBindImageTexture(0, targetTexture->getHandle(), 0, GL_FALSE, 0, GL_READ_WRITE, GL_RGBA32F);
+    glBindImageTexture(3, m_secondMomentTexture->getHandle(), 0, GL_FALSE, 0, GL_READ_WRITE, GL_R32F);
+
+    if (m_pathLengthBufferPopulationCount != m_crystalRepository->getCount())
+        initializePathLengthBuffer();
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 1, m_pathLengthBuffer);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 4, m_phaseFunctionBuffer);
+
+    if (usesSampleRecording())
+    {
+        if (m_samplingEpochs.empty())
+            startSamplingEpochs();
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 7, m_sampleRecordBuffer);
+    }
+
+    if (m_rayDumpWriter)
+    {
+        // Each traced ray escapes at most once
+        if (m_rayDumpBufferCapacity < m_raysPerStep)
+        {
+            readBackRayDumps();
+            m_rayDumpBufferCapacity = m_raysPerStep;
+            for (auto &dump : m_rayDumpBuffers)
+            {
+                if (dump.buffer == 0)
+                    glGenBuffers(1, &dump.buffer);
+                glBindBuffer(GL_SHADER_STORAGE_BUFFER, dump.buffer);
+                glBufferData(GL_SHADER_STORAGE_BUFFER, sizeof(unsigned int) + static_cast<std::size_t>(m_rayDumpBufferCapacity) * sizeof(RayExitRecord), NULL, GL_STREAM_READ);
+            }
+        }
+        auto &dump = m_rayDumpBuffers[m_rayDumpBufferIndex];
+        // The buffer was last used two steps ago, so this rarely has to wait
+        readBackRayDump(dump);
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, dump.buffer);
+        glClearBufferSubData(GL_SHADER_STORAGE_BUFFER, GL_R32UI, 0, sizeof(unsigned int), GL_RED_INTEGER, GL_UNSIGNED_INT, NULL);
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 10, dump.buffer);
+    }
+
+    if (usesPathLayers())
+    {
+        glBindImageTexture(6, usesTwoLevelAccumulation() ? m_pathLayerStepTexture : m_pathLayerTexture, 0, GL_TRUE, 0, GL_READ_WRITE, GL_RGBA32F);
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 11, m_pathLayerMaskBuffer);
+    }
+
+    if (usesOutputViews())
+        glBindImageTexture(4, usesTwoLevelAccumulation() ? m_outputViewStepTexture : m_outputViewTexture, 0, GL_TRUE, 0, GL_READ_WRITE, GL_RGBA32F);
+
+    if (m_monochrome)
+        glBindImageTexture(m_monochromeTexture->getTextureUnit(), m_monochromeTexture->getHandle(), 0, GL_FALSE, 0, GL_READ_WRITE, GL_R32UI);
+
+    if (usesSunConvolution())
+    {
+        if (m_sunConvolutionGridLayers != m_crystalRepository->getCount())
+            initializeSunConvolutionGrid();
+        glBindImageTexture(7, m_sunConvolutionGridTexture, 0, GL_TRUE, 0, GL_READ_WRITE, GL_RGBA32F);
+    }
+
+    if (usesPathGuiding())
+    {
+        if (m_pathGuidePopulationCount != m_crystalRepository->getCount())
+            initializePathGuide();
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 15, m_pathGuideCdfBuffer);
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 16, m_pathGuideCounterBuffer);
+    }
+
+    if (usesAdaptiveRayAllocation())
+    {
+        if (m_rayMomentPopulationCount != m_crystalRepository->getCount())
+            initializeRayMomentBuffer();
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 17, m_rayMomentBuffer);
+    }
 
     m_simulationShader->bind();
 
+    m_rayIndexOffsets.resize(m_crystalRepository->getCount(), 0);
+    std::uint64_t tracedRayCount = 0;
+
+    // Rays of each population left for the GPU once the CPU has taken its share
+    std::vector<unsigned int> gpuRays(m_crystalRepository->getCount());
+    for (auto i = 0u; i < m_crystalRepository->getCount(); ++i)
+        gpuRays[i] = static_cast<unsigned int>(m_raysPerStep * getRayShare(i));
+    auto cpuRayCount = 0u;
+    if (usesHybridTracing())
+    {
+        cpuRayCount = mergeCpuSplats(gpuRays);
+        if (!m_hybridTracer || !m_hybridTracer->isBusy())
+            startHybridTracing();
+    }
+    auto timingGpu = usesHybridTracing() && !m_gpuTimerPending;
+    if (timingGpu)
+        glBeginQuery(GL_TIME_ELAPSED, m_gpuTimerQuery);
+
+    m_phaseFunctionRaysPerStep = 0.0;
     for (auto i = 0u; i < m_crystalRepository->getCount(); ++i)
     {
         glMemoryBarrier(GL_SHADER_IMAGE_ACCESS_BARRIER_BIT);
-        unsigned int seed = m_uniformDistribution(m_mersenneTwister);
 
-        auto crystals = m_crystalRepository->get(i);
+        auto numRays = static_cast<unsigned int>(m_raysPerStep * getRayShare(i));
+        traceRays(i, gpuRays[i], m_light.altitude, false);
+        tracedRayCount += numRays;
+        if (i < m_rayMomentRayCounts.size())
+            m_rayMomentRayCounts[i] += numRays;
+
+        if (usesPhaseFunction(i))
+            m_phaseFunctionRaysPerStep += numRays;
+        else if (i < m_samplingEpochs.size())
+            m_samplingEpochs[i].back().rayCount += numRays;
+    }
+
+    if (timingGpu)
+    {
+        glEndQuery(GL_TIME_ELAPSED);
+        m_gpuTimerPending = true;
+        m_gpuTimedRayCount = static_cast<unsigned int>(tracedRayCount) - cpuRayCount;
+    }
+
+    m_cpuRayShare = tracedRayCount > 0 ? static_cast<double>(cpuRayCount) / tracedRayCount : 0.0;
+
+    if (usesContinuations())
+        traceContinuations(m_light.altitude, false);
+
+    if (m_monochrome)
+        resolveMonochromeImage();
+    else if (usesTwoLevelAccumulation())
+        flushAccumulation();
+
+    /* Rays that no longer fit in the record buffer cannot be reweighted,
+    so recording stops, and the image is accumulated in two levels from
+    the next step on */
+    if (usesSampleRecording() && isRefreshIteration(m_iteration) && getSampleRecordCount() > SampleReweighting::recordCapacity)
+    {
+        qInfo("Sample record buffer is full, stopping sample reweighting until the simulation is restarted");
+        m_sampleRecordsOverflowed = true;
+        m_samplingEpochs.clear();
+    }
+
+    if (usesPathGuiding() && isRefreshIteration(m_iteration))
+        updatePathGuide();
+
+    if (usesAdaptiveRayAllocation() && isRefreshIteration(m_iteration))
+        updateRayAllocation();
+
+    if (usesSunConvolution())
+    {
+        // Convolution runs on the CPU, and the last result is scaled up in between
+        if (isRefreshIteration(m_iteration))
+            convolveSunConvolutionGrid();
+        compositeSunConvolution();
+    }
+
+    if (m_phaseFunctionRaysPerStep > 0.0)
+    {
+        m_phaseFunctionRayCount += m_phaseFunctionRaysPerStep;
+        compositePhaseFunction();
+    }
+
+    if (usesPathLayers())
+        compositePathLayers();
+
+    if (m_rayDumpWriter)
+        flushRayDump(tracedRayCount);
+}
+
+void SimulationEngine::traceRays(unsigned int populationIndex, unsigned int numRays, float sunAltitude, bool directionTableOutput)
+{
+    // Building a transfer table uses the same shader, so it must be done before setting uniforms
+    auto traceMode = !directionTableOutput && usesTransferTable() ? TraceModeTransferTable : TraceModeDirect;
+    if (traceMode == TraceModeTransferTable)
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 6, getTransferTable(populationIndex));
+
+    setTraceUniforms(populationIndex, sunAltitude, directionTableOutput, traceMode);
+    m_simulationShader->setUniformValue("continuationPass", 0);
+
+    auto numGroups = static_cast<unsigned int>(numRays / 64.0);
+    if (!usesWavefront(traceMode))
+    {
+        glDispatchCompute(numGroups, 1, 1);
+
+        /* Rays are numbered consecutively within each population, so the
+        next dispatch continues the random streams where this one ended */
+        m_rayIndexOffsets[populationIndex] += numGroups * 64;
+        return;
+    }
+
+    // Rays are generated in chunks that fit in the queues, numbered as in a single dispatch
+    if (m_wavefrontEscapeBuffer == 0)
+        initializeWavefrontBuffers();
+    while (numGroups > 0)
+    {
+        auto chunkGroups = std::min(numGroups, m_wavefrontCapacity / 64);
+        glUniform2ui(glGetUniformLocation(m_simulationShader->programId(), "rayIndexOffset"),
+                     static_cast<unsigned int>(m_rayIndexOffsets[populationIndex]),
+                     static_cast<unsigned int>(m_rayIndexOffsets[populationIndex] >> 32));
+        startWavefrontQueues();
+        glDispatchCompute(chunkGroups, 1, 1);
+        traceWavefront();
+
+        m_rayIndexOffsets[populationIndex] += chunkGroups * 64;
+        numGroups -= chunkGroups;
+    }
+}
+
+void SimulationEngine::setTraceUniforms(unsigned int populationIndex, float sunAltitude, bool directionTableOutput, int traceMode)
+{
+    /*
+    The following line needs to use glUniform1ui instead of the
+    setUniformValue method because of a bug in Qt:
+    https://bugreports.qt.io/browse/QTBUG-45507
+    */
+    glUniform1ui(glGetUniformLocation(m_simulationShader->programId(), "runSeed"), m_runSeed);
+    glUniform1ui(glGetUniformLocation(m_simulationShader->programId(), "populationIndex"), populationIndex);
+    glUniform2ui(glGetUniformLocation(m_simulationShader->programId(), "rayIndexOffset"),
+                 static_cast<unsigned int>(m_rayIndexOffsets[populationIndex]),
+                 static_cast<unsigned int>(m_rayIndexOffsets[populationIndex] >> 32));
+    m_simulationShader->setUniformValue("sun.altitude", degToRad(sunAltitude));
+    m_simulationShader->setUniformValue("sun.diameter", degToRad(m_light.diameter));
+    m_simulationShader->setUniformValueArray("sun.spectrum", m_sunSpectrumCache, 31, 1);
+    setCrystalUniforms(populationIndex);
+
+    m_simulationShader->setUniformValue("camera.pitch", degToRad(m_camera.pitch));
+    m_simulationShader->setUniformValue("camera.yaw", degToRad(m_camera.yaw));
+    m_simulationShader->setUniformValue("camera.focalLength", m_camera.getFocalLength());
+    m_simulationShader->setUniformValue("camera.projection", m_camera.projection);
+    m_simulationShader->setUniformValue("camera.hideSubHorizon", m_camera.hideSubHorizon ? 1 : 0);
+
+    m_simulationShader->setUniformValue("splatFilter", m_splatFilter.type);
+    m_simulationShader->setUniformValue("splatFilterRadius", m_splatFilter.radius);
+    // Tables of directions are always traced in color
+    m_simulationShader->setUniformValue("monochrome", !directionTableOutput && m_monochrome ? 1 : 0);
+
+    // Views are not filled while tracing tables of directions
+    auto outputViewCount = directionTableOutput ? 0u : static_cast<unsigned int>(m_outputViews.size());
+    m_simulationShader->setUniformValue("outputViewCount", static_cast<int>(outputViewCount));
+    for (auto i = 0u; i < outputViewCount; ++i)
+    {
+        const auto &view = m_outputViews[i];
+        const auto prefix = "outputViews[" + std::to_string(i) + "].";
+        m_simulationShader->setUniformValue((prefix + "pitch").c_str(), degToRad(view.camera.pitch));
+        m_simulationShader->setUniformValue((prefix + "yaw").c_str(), degToRad(view.camera.yaw));
+        m_simulationShader->setUniformValue((prefix + "focalLength").c_str(), view.camera.getFocalLength());
+        m_simulationShader->setUniformValue((prefix + "projection").c_str(), view.camera.projection);
+        m_simulationShader->setUniformValue((prefix + "hideSubHorizon").c_str(), view.camera.hideSubHorizon ? 1 : 0);
+        glUniform2i(glGetUniformLocation(m_simulationShader->programId(), ("outputViewResolutions[" + std::to_string(i) + "]").c_str()),
+                    static_cast<int>(view.width), static_cast<int>(view.height));
+    }
+
+    m_simulationShader->setUniformValue("multipleScatter", m_multipleScatteringProbability);
+    m_simulationShader->setUniformValue("russianRouletteDepth", m_russianRouletteDepth);
+    m_simulationShader->setUniformValue("collectPathLengths", m_pathLengthStatisticsEnabled ? 1 : 0);
+    m_simulationShader->setUniformValue("quasiRandomSampling", m_quasiRandomSampling ? 1 : 0);
+    m_simulationShader->setUniformValue("atmosphereEnabled", m_atmosphere.enabled ? 1 : 0);
+    m_simulationShader->setUniformValue("directionTableOutput", directionTableOutput ? 1 : 0);
+    m_simulationShader->setUniformValue("phaseFunctionOutput", !directionTableOutput && usesPhaseFunction(populationIndex) ? 1 : 0);
+    m_simulationShader->setUniformValue("traceMode", traceMode);
+    m_simulationShader->setUniformValue("dumpRays", !directionTableOutput && m_rayDumpWriter ? 1 : 0);
+    m_simulationShader->setUniformValue("pathLayerCount", directionTableOutput ? 0 : static_cast<int>(m_pathFilters.size()));
+    m_simulationShader->setUniformValue("sunConvolution", !directionTableOutput && usesSunConvolution() ? 1 : 0);
+    // Rays of the phase function all count, wherever they go
+    m_simulationShader->setUniformValue("pathGuiding", !directionTableOutput && usesPathGuiding() && !usesPhaseFunction(populationIndex) ? 1 : 0);
+
+    auto share = getRayShare(populationIndex);
+    auto populationWeight = directionTableOutput || share <= 0.0 ? 1.0 : m_crystalRepository->getProbability(populationIndex) / share;
+    m_simulationShader->setUniformValue("populationWeight", static_cast<float>(populationWeight));
+    m_simulationShader->setUniformValue("recordRayMoments", !directionTableOutput && usesAdaptiveRayAllocation() ? 1 : 0);
+
+    auto recordSamples = !directionTableOutput && !usesPhaseFunction(populationIndex) && populationIndex < m_samplingEpochs.size();
+    m_simulationShader->setUniformValue("recordSamples", recordSamples ? 1 : 0);
+    if (recordSamples)
+    {
+        glUniform1ui(glGetUniformLocation(m_simulationShader->programId(), "samplingEpochSlot"),
+                     populationIndex * SampleReweighting::maxEpochs + static_cast<unsigned int>(m_samplingEpochs[populationIndex].size()) - 1);
+    }
+
+    m_simulationShader->setUniformValue("maxScatteringOrders", usesContinuations() ? m_maxScatteringOrders : 1);
+    m_simulationShader->setUniformValue("crossPopulationScattering", directionTableOutput ? 0 : 1);
+    glUniform1ui(glGetUniformLocation(m_simulationShader->programId(), "continuationCapacity"), m_continuationCapacity);
+    glUniform1ui(glGetUniformLocation(m_simulationShader->programId(), "queuePopulationCount"), m_continuationPopulationCount);
+    m_simulationShader->setUniformValue("wavefrontStage", usesWavefront(traceMode) ? static_cast<int>(Wavefront::StageGenerate) : static_cast<int>(Wavefront::StageDisabled));
+    glUniform1ui(glGetUniformLocation(m_simulationShader->programId(), "wavefrontCapacity"), m_wavefrontCapacity);
+}
+
+bool SimulationEngine::usesContinuations() const
+{
+    return m_multipleScatteringProbability > 0.0f && m_maxScatteringOrders > 1;
+}
+
+void SimulationEngine::initializeContinuationBuffers(bool crossPopulation)
+{
+    const auto populationCount = m_crystalRepository->getCount();
+    std::vector<float> populationCdf;
+    double cumulativeProbability = 0.0;
+    double maxProbability = 0.0;
+    for (auto i = 0u; i < populationCount; ++i)
+    {
         auto probability = m_crystalRepository->getProbability(i);
-        auto numRays = static_cast<unsigned int>(m_raysPerStep * probability);
+        cumulativeProbability += probability;
+        maxProbability = std::max(maxProbability, probability);
+        populationCdf.push_back(static_cast<float>(cumulativeProbability));
+    }
+
+    /* Rays continuing from one dispatch are spread over the populations
+    by their weights, or all stay in their own population. The queues
+    have enough headroom that they practically never fill up. Rays that
+    still do not fit are dropped, and the rays that fit are weighted up
+    by the number of rays that tried. */
+    auto share = crossPopulation ? maxProbability : 1.0;
+    auto capacity = static_cast<unsigned int>(1.25 * m_multipleScatteringProbability * m_raysPerStep * share) + 1024;
+    m_continuationCapacity = (capacity + 63) / 64 * 64;
+    m_continuationPopulationCount = populationCount;
+
+    auto bufferSize = (static_cast<std::size_t>(populationCount) * continuationHeaderSize +
+                       static_cast<std::size_t>(populationCount) * m_continuationCapacity * continuationRecordSize) *
+                      sizeof(unsigned int);
+    for (auto &buffer : m_continuationBuffers)
+    {
+        if (buffer == 0)
+            glGenBuffers(1, &buffer);
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, buffer);
+        glBufferData(GL_SHADER_STORAGE_BUFFER, bufferSize, NULL, GL_DYNAMIC_COPY);
+    }
+
+    if (m_populationCdfBuffer == 0)
+        glGenBuffers(1, &m_populationCdfBuffer);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, m_populationCdfBuffer);
+    glBufferData(GL_SHADER_STORAGE_BUFFER, populationCdf.size() * sizeof(float), populationCdf.data(), GL_STATIC_DRAW);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 14, m_populationCdfBuffer);
+}
+
+void SimulationEngine::deleteContinuationBuffers()
+{
+    glDeleteBuffers(2, m_continuationBuffers);
+    m_continuationBuffers[0] = 0;
+    m_continuationBuffers[1] = 0;
+    if (m_populationCdfBuffer != 0)
+        glDeleteBuffers(1, &m_populationCdfBuffer);
+    m_populationCdfBuffer = 0;
+    m_continuationCapacity = 0;
+    m_continuationPopulationCount = 0;
+}
+
+void SimulationEngine::startContinuationQueue()
+{
+    // Each header is an indirect dispatch of zero work groups followed by the number of queued rays
+    const unsigned int emptyHeader[continuationHeaderSize] = {0, 1, 1, 0};
+    glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT | GL_COMMAND_BARRIER_BIT);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, m_continuationBuffers[0]);
+    glClearBufferSubData(GL_SHADER_STORAGE_BUFFER, GL_RGBA32UI, 0, m_continuationPopulationCount * continuationHeaderSize * sizeof(unsigned int),
+                         GL_RGBA_INTEGER, GL_UNSIGNED_INT, emptyHeader);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 13, m_continuationBuffers[0]);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 14, m_populationCdfBuffer);
+}
 
-        /*
-        The following line needs to use glUniform1ui instead of the
-        setUniformValue method because of a bug in Qt:
-        https://bugreports.qt.io/browse/QTBUG-45507
-        */
-        glUniform1ui(glGetUniformLocation(m_simulationShader->programId(), "rngSeed"), seed);
-        m_simulationShader->setUniformValue("sun.altitude", degToRad(m_light.altitude));
-        m_simulationShader->setUniformValue("sun.diameter", degToRad(m_light.diameter));
-        m_simulationShader->setUniformValueArray("sun.spectrum", m_sunSpectrumCache, 31, 1);
+void SimulationEngine::traceContinuations(float sunAltitude, bool directionTableOutput)
+{
+    /* Each scattering order traces the rays queued by the previous one
+    and queues the rays that scatter again into the other buffer. The
+    number of rays is only known on the GPU, so every population is
+    dispatched indirectly, and empty queues dispatch no work groups. */
+    for (auto order = 2; order <= m_maxScatteringOrders; ++order)
+    {
+        std::swap(m_continuationBuffers[0], m_continuationBuffers[1]);
+        startContinuationQueue();
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 12, m_continuationBuffers[1]);
+
+        for (auto i = 0u; i < m_continuationPopulationCount; ++i)
+        {
+            glMemoryBarrier(GL_SHADER_IMAGE_ACCESS_BARRIER_BIT);
+            setTraceUniforms(i, sunAltitude, directionTableOutput, TraceModeDirect);
+            m_simulationShader->setUniformValue("continuationPass", 1);
+
+            // Wavefront stages dispatch from their own queues in between
+            auto wavefront = usesWavefront(TraceModeDirect);
+            if (wavefront)
+            {
+                if (m_wavefrontEscapeBuffer == 0)
+                    initializeWavefrontBuffers();
+                startWavefrontQueues();
+            }
+            glBindBuffer(GL_DISPATCH_INDIRECT_BUFFER, m_continuationBuffers[1]);
+            glDispatchComputeIndirect(static_cast<GLintptr>(i) * continuationHeaderSize * sizeof(unsigned int));
+            if (wavefront)
+                traceWavefront();
+        }
+    }
+}
 
-        m_simulationShader->setUniformValue("crystalProperties.caRatioAverage", crystals.caRatioAverage);
-        m_simulationShader->setUniformValue("crystalProperties.caRatioStd", crystals.caRatioStd);
+void SimulationEngine::setCrystalUniforms(unsigned int populationIndex)
+{
+    const auto &crystals = m_crystalRepository->get(populationIndex);
+
+    m_simulationShader->setUniformValue("crystalProperties.caRatioAverage", crystals.caRatioAverage);
+    m_simulationShader->setUniformValue("crystalProperties.caRatioStd", crystals.caRatioStd);
+
+    int tabulatedParameters = 0;
+    for (auto parameter = 0; parameter < NUM_TABULATED_PARAMETERS; ++parameter)
+    {
+        if (crystals.usesTable(static_cast<TabulatedParameter>(parameter)))
+            tabulatedParameters |= 1 << parameter;
+    }
+    m_simulationShader->setUniformValue("crystalProperties.tabulatedParameters", tabulatedParameters);
+
+    // Tabulated distributions without a table fall back to uniform distributions
+    auto tiltDistribution = crystals.tiltDistribution == Tabulated && !crystals.usesTable(TiltTable) ? Uniform : crystals.tiltDistribution;
+    auto rotationDistribution = crystals.rotationDistribution == Tabulated && !crystals.usesTable(RotationTable) ? Uniform : crystals.rotationDistribution;
 
-        m_simulationShader->setUniformValue("crystalProperties.tiltDistribution", crystals.tiltDistribution);
-        m_simulationShader->setUniformValue("crystalProperties.tiltAverage", degToRad(crystals.tiltAverage));
-        m_simulationShader->setUniformValue("crystalProperties.tiltStd", degToRad(crystals.tiltStd));
+    m_simulationShader->setUniformValue("crystalProperties.tiltDistribution", tiltDistribution);
+    m_simulationShader->setUniformValue("crystalProperties.tiltAverage", degToRad(crystals.tiltAverage));
+    m_simulationShader->setUniformValue("crystalProperties.tiltStd", degToRad(crystals.tiltStd));
 
-        m_simulationShader->setUniformValue("crystalProperties.rotationDistribution", crystals.rotationDistribution);
-        m_simulationShader->setUniformValue("crystalProperties.rotationAverage", degToRad(crystals.rotationAverage));
-        m_simulationShader->setUniformValue("crystalProperties.rotationStd", degToRad(crystals.rotationStd));
+    m_simulationShader->setUniformValue("crystalProperties.rotationDistribution", rotationDistribution);
+    m_simulationShader->setUniformValue("crystalProperties.rotationAverage", degToRad(crystals.rotationAverage));
+    m_simulationShader->setUniformValue("crystalProperties.rotationStd", degToRad(crystals.rotationStd));
 
-        m_simulationShader->setUniformValue("crystalProperties.upperApexAngle", degToRad(crystals.upperApexAngle));
-        m_simulationShader->setUniformValue("crystalProperties.upperApexHeightAverage", crystals.upperApexHeightAverage);
-        m_simulationShader->setUniformValue("crystalProperties.upperApexHeightStd", crystals.upperApexHeightStd);
+    m_simulationShader->setUniformValue("crystalProperties.upperApexAngle", degToRad(crystals.upperApexAngle));
+    m_simulationShader->setUniformValue("crystalProperties.upperApexHeightAverage", crystals.upperApexHeightAverage);
+    m_simulationShader->setUniformValue("crystalProperties.upperApexHeightStd", crystals.upperApexHeightStd);
+
+    m_simulationShader->setUniformValue("crystalProperties.lowerApexAngle", degToRad(crystals.lowerApexAngle));
+    m_simulationShader->setUniformValue("crystalProperties.lowerApexHeightAverage", crystals.lowerApexHeightAverage);
+    m_simulationShader->setUniformValue("crystalProperties.lowerApexHeightStd", crystals.lowerApexHeightStd);
+    m_simulationShader->setUniformValueArray("crystalProperties.prismFaceDistances", crystals.prismFaceDistances, 6, 1);
+    m_simulationShader->setUniformValue("crystalProperties.customShapeFaceOffset", m_customShapeFaceOffsets[populationIndex]);
+    m_simulationShader->setUniformValue("crystalProperties.customShapeFaceCount", m_customShapeFaceCounts[populationIndex]);
+}
 
-        m_simulationShader->setUniformValue("crystalProperties.lowerApexAngle", degToRad(crystals.lowerApexAngle));
-        m_simulationShader->setUniformValue("crystalProperties.lowerApexHeightAverage", crystals.lowerApexHeightAverage);
-        m_simulationShader->setUniformValue("crystalProperties.lowerApexHeightStd", crystals.lowerApexHeightStd);
-        m_simulationShader->setUniformValueArray("crystalProperties.prismFaceDistances", crystals.prismFaceDistances, 6, 1);
+bool SimulationEngine::usesTransferTable() const
+{
+    // A second scattering event would pick a ray of another wavelength from the table
+    return m_transferTablesEnabled && m_multipleScatteringProbability == 0.0f;
+}
 
-        m_simulationShader->setUniformValue("camera.pitch", degToRad(m_camera.pitch));
-        m_simulationShader->setUniformValue("camera.yaw", degToRad(m_camera.yaw));
-        m_simulationShader->setUniformValue("camera.focalLength", m_camera.getFocalLength());
-        m_simulationShader->setUniformValue("camera.projection", m_camera.projection);
-        m_simulationShader->setUniformValue("camera.hideSubHorizon", m_camera.hideSubHorizon ? 1 : 0);
+unsigned int SimulationEngine::getTransferTable(unsigned int populationIndex)
+{
+    auto key = TransferTable::getShapeKey(m_crystalRepository->get(populationIndex));
+    auto cached = std::find_if(m_transferTables.begin(), m_transferTables.end(), [&key](const auto &table) { return table.shapeKey == key; });
+    if (cached != m_transferTables.end())
+    {
+        std::rotate(cached, cached + 1, m_transferTables.end());
+        auto &table = m_transferTables.back();
 
-        m_simulationShader->setUniformValue("multipleScatter", m_multipleScatteringProbability);
-        m_simulationShader->setUniformValue("atmosphereEnabled", m_atmosphere.enabled ? 1 : 0);
+        /* One sample of every cell is traced again once per step, so that
+           the image is not limited to the rays the table was built with */
+        if (table.refinedIteration != m_iteration)
+        {
+            ++table.generation;
+            table.refinedIteration = m_iteration;
+            buildTransferTable(populationIndex, table.buffer, table.generation % TransferTable::samplesPerCell, table.generation);
+        }
+        return table.buffer;
+    }
 
-        glDispatchCompute(numRays / 64.0, 1, 1);
+    unsigned int buffer;
+    if (m_transferTables.size() >= TransferTable::maxCachedTables)
+    {
+        buffer = m_transferTables.front().buffer;
+        m_transferTables.erase(m_transferTables.begin());
     }
+    else
+    {
+        glGenBuffers(1, &buffer);
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, buffer);
+        glBufferData(GL_SHADER_STORAGE_BUFFER, TransferTable::sampleCount * TransferTable::floatsPerSample * sizeof(float), NULL, GL_STATIC_DRAW);
+    }
+
+    qInfo("Building transfer table for crystal population \"%s\"", m_crystalRepository->getName(populationIndex).c_str());
+    buildTransferTable(populationIndex, buffer, -1, 0);
+    m_transferTables.push_back({key, buffer, 0, m_iteration});
+    return buffer;
+}
+
+void SimulationEngine::buildTransferTable(unsigned int populationIndex, unsigned int buffer, int slot, unsigned int generation)
+{
+    // The buffer may be reused from a table that earlier dispatches still read
+    glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 6, buffer);
+
+    m_simulationShader->bind();
+    glUniform1ui(glGetUniformLocation(m_simulationShader->programId(), "runSeed"), m_runSeed);
+    glUniform1ui(glGetUniformLocation(m_simulationShader->programId(), "populationIndex"), TransferTable::randomStreamIndex);
+    glUniform2ui(glGetUniformLocation(m_simulationShader->programId(), "rayIndexOffset"), 0, generation);
+    setCrystalUniforms(populationIndex);
+    m_simulationShader->setUniformValue("multipleScatter", 0.0f);
+    m_simulationShader->setUniformValue("russianRouletteDepth", m_russianRouletteDepth);
+    m_simulationShader->setUniformValue("collectPathLengths", 0);
+    // Quasi-random points depend only on the ray index, so they would repeat in every generation
+    m_simulationShader->setUniformValue("quasiRandomSampling", 0);
+    m_simulationShader->setUniformValue("traceMode", TraceModeBuildTransferTable);
+    m_simulationShader->setUniformValue("transferTableSlot", slot);
+    m_simulationShader->setUniformValue("wavefrontStage", static_cast<int>(Wavefront::StageDisabled));
+
+    glDispatchCompute((slot < 0 ? TransferTable::sampleCount : TransferTable::cellCount) / 64, 1, 1);
+    glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+}
+
+void SimulationEngine::clearTransferTables()
+{
+    for (const auto &table : m_transferTables)
+        glDeleteBuffers(1, &table.buffer);
+    m_transferTables.clear();
 }
 
 void SimulationEngine::clear()
 {
-    if (!m_initialized)
+    if (!m_initialized || !m_invalidations.invalidate(InvalidationTracker::Clear))
         return;
     glMemoryBarrier(GL_SHADER_IMAGE_ACCESS_BARRIER_BIT);
 
@@ -231,7 +823,114 @@ void SimulationEngine::clear()
 
     glClearTexImage(m_backgroundTexture->getHandle(), 0, GL_RGBA, GL_FLOAT, NULL);
     glBindImageTexture(m_backgroundTexture->getTextureUnit(), m_backgroundTexture->getHandle(), 0, GL_FALSE, 0, GL_READ_WRITE, GL_RGBA32F);
+
+    glClearTexImage(m_accumulationStepTexture->getHandle(), 0, GL_RGBA, GL_FLOAT, NULL);
+    glClearTexImage(m_accumulationErrorTexture->getHandle(), 0, GL_RGBA, GL_FLOAT, NULL);
+    glClearTexImage(m_secondMomentTexture->getHandle(), 0, GL_RED, GL_FLOAT, NULL);
+
+    if (m_monochromeTexture)
+    {
+        glClearTexImage(m_monochromeTexture->getHandle(), 0, GL_RED_INTEGER, GL_UNSIGNED_INT, NULL);
+        glBindImageTexture(m_monochromeTexture->getTextureUnit(), m_monochromeTexture->getHandle(), 0, GL_FALSE, 0, GL_READ_WRITE, GL_R32UI);
+    }
+
+    if (m_pathLengthBuffer != 0)
+    {
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, m_pathLengthBuffer);
+        glClearBufferData(GL_SHADER_STORAGE_BUFFER, GL_R32UI, GL_RED_INTEGER, GL_UNSIGNED_INT, NULL);
+    }
+
+    glClearTexImage(m_compositeTexture->getHandle(), 0, GL_RGBA, GL_FLOAT, NULL);
+    m_compositingPhaseFunction = false;
+
+    for (auto texture : {m_pathLayerTexture, m_pathLayerStepTexture, m_pathLayerErrorTexture, m_outputViewTexture, m_outputViewStepTexture, m_outputViewErrorTexture})
+    {
+        if (texture != 0)
+            glClearTexImage(texture, 0, GL_RGBA, GL_FLOAT, NULL);
+    }
+    m_compositingPathLayers = false;
+
+    if (m_sunConvolutionGridTexture != 0)
+        glClearTexImage(m_sunConvolutionGridTexture, 0, GL_RGBA, GL_FLOAT, NULL);
+    m_sunConvolutionIteration = 0;
+    m_compositingSunConvolution = false;
+
+    // What the guide has learned depends on the camera and the crystals
+    if (m_pathGuideCdfBuffer != 0)
+        clearPathGuide();
+    if (m_rayMomentBuffer != 0)
+        clearRayMoments();
+    m_rayShares.clear();
+
+    if (m_sampleRecordBuffer != 0)
+    {
+        glMemoryBarrier(GL_BUFFER_UPDATE_BARRIER_BIT);
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, m_sampleRecordBuffer);
+        glClearBufferSubData(GL_SHADER_STORAGE_BUFFER, GL_R32UI, 0, sizeof(unsigned int), GL_RED_INTEGER, GL_UNSIGNED_INT, NULL);
+    }
+    m_samplingEpochs.clear();
+    m_sampleRecordsOverflowed = false;
+
+    if (m_hybridTracer && m_hybridTracer->isBusy())
+        m_cpuBatchStale = true;
+
+    // Randomly oriented populations continue their random streams, as their phase function is kept
+    for (auto i = 0u; i < m_rayIndexOffsets.size(); ++i)
+    {
+        if (i >= m_crystalRepository->getCount() || !usesPhaseFunction(i))
+            m_rayIndexOffsets[i] = 0;
+    }
     m_iteration = 0;
+
+    emit cleared();
+}
+
+void SimulationEngine::reset()
+{
+    if (!m_initialized || !m_invalidations.invalidate(InvalidationTracker::Reset))
+        return;
+
+    clear();
+
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, m_phaseFunctionBuffer);
+    glClearBufferData(GL_SHADER_STORAGE_BUFFER, GL_R32UI, GL_RED_INTEGER, GL_UNSIGNED_INT, NULL);
+    m_phaseFunctionRayCount = 0.0;
+    m_rayIndexOffsets.clear();
+}
+
+void SimulationEngine::beginUpdate()
+{
+    m_invalidations.beginUpdate();
+}
+
+void SimulationEngine::endUpdate()
+{
+    switch (m_invalidations.endUpdate())
+    {
+    case InvalidationTracker::Reset:
+        reset();
+        break;
+    case InvalidationTracker::Clear:
+        clear();
+        break;
+    default:
+        break;
+    }
+}
+
+bool SimulationEngine::isUpdating() const
+{
+    return m_invalidations.isUpdating();
+}
+
+bool SimulationEngine::usesPhaseFunction(unsigned int populationIndex) const
+{
+    /* A second scattering event breaks the symmetry around the sun, the
+    phase function does not know the paths of the rays in it, it already
+    includes the sun disk, and it is only composited through the main
+    camera. It is also resolved in color. */
+    return m_multipleScatteringProbability == 0.0f && !usesPathLayers() && !usesSunConvolution() && !usesOutputViews() && !m_monochrome &&
+           m_crystalRepository->get(populationIndex).isRandomlyOriented();
 }
 
 unsigned int SimulationEngine::getRaysPerStep() const
@@ -256,96 +955,1766 @@ void SimulationEngine::initialize()
     initializeOpenGLFunctions();
     initializeShaders();
     initializeTextures();
+    initializePhaseFunctionBuffers();
+    initializePathLayers();
+    initializeOutputViews();
     m_initialized = true;
 }
 
-void SimulationEngine::initializeShaders()
+std::unique_ptr<QOpenGLShaderProgram> SimulationEngine::initializeShaderProgram(const char *name, const char *filename, std::initializer_list<const char *> sharedFilenames)
 {
-    qInfo("Initializing raytracing shader");
-    m_simulationShader = std::make_unique<QOpenGLShaderProgram>();
-    bool raytraceShaderReadSucceeded = m_simulationShader->addCacheableShaderFromSourceFile(QOpenGLShader::ShaderTypeBit::Compute, ":/shaders/raytrace.glsl");
-    if (raytraceShaderReadSucceeded == false)
+    qInfo("Initializing %s shader", name);
+    auto program = std::make_unique<QOpenGLShaderProgram>();
+
+    /* GLSL has no includes, so shared sources are inserted after the
+       version directive, which must be the first line of the shader */
+    QFile file(filename);
+    if (file.open(QIODevice::ReadOnly) == false)
     {
-        qWarning("Reading raytracing shader failed");
-        throw std::runtime_error(m_simulationShader->log().toUtf8());
+        qWarning("%s shader read failed", name);
+        throw std::runtime_error(file.errorString().toUtf8());
     }
-    qInfo("Raytracing shader successfully initialized");
-
-    if (m_simulationShader->link() == false)
+    auto source = file.readLine();
+    for (auto sharedFilename : sharedFilenames)
     {
-        qWarning("Compiling and linking raytracing shader failed");
-        throw std::runtime_error(m_simulationShader->log().toUtf8());
+        QFile sharedFile(sharedFilename);
+        if (sharedFile.open(QIODevice::ReadOnly) == false)
+        {
+            qWarning("%s shader read failed", sharedFilename);
+            throw std::runtime_error(sharedFile.errorString().toUtf8());
+        }
+        source += sharedFile.readAll() + "\n";
     }
-    qInfo("Raytracing shader program compilation and linking successful");
+    // Compiler messages refer to the lines of the shader itself
+    source += "#line 2\n" + file.readAll();
 
-    qInfo("Initializing sky shader");
-    m_skyShader = new QOpenGLShaderProgram(this);
-    bool skyShaderReadSucceeded = m_skyShader->addCacheableShaderFromSourceFile(QOpenGLShader::ShaderTypeBit::Compute, ":/shaders/sky.glsl");
-    if (skyShaderReadSucceeded == false)
+    if (program->addCacheableShaderFromSourceCode(QOpenGLShader::ShaderTypeBit::Compute, source) == false)
     {
-        qWarning("Reading sky shader failed");
-        throw std::runtime_error(m_skyShader->log().toUtf8());
+        qWarning("%s shader read failed", name);
+        throw std::runtime_error(program->log().toUtf8());
     }
-    qInfo("Sky shader successfully initialized");
+    qInfo("%s shader successfully initialized", name);
 
-    if (m_skyShader->link() == false)
+    if (program->link() == false)
     {
-        qWarning("Compiling and linking sky shader failed");
-        throw std::runtime_error(m_skyShader->log().toUtf8());
+        qWarning("%s shader compilation and linking failed", name);
+        throw std::runtime_error(program->log().toUtf8());
     }
-    qInfo("Sky shader program compilation and linking successful");
+    qInfo("%s shader program compilation and linking successful", name);
+
+    return program;
+}
+
+void SimulationEngine::initializeShaders()
+{
+    m_simulationShader = initializeShaderProgram("Raytracing", ":/shaders/raytrace.glsl", {":/shaders/luminance.glsl", ":/shaders/splatFilter.glsl"});
+    const auto &sobolDirections = SobolSequence::getDirectionNumbers();
+    glProgramUniform1uiv(m_simulationShader->programId(),
+                         glGetUniformLocation(m_simulationShader->programId(), "sobolDirections"),
+                         sobolDirections.size(),
+                         sobolDirections.data());
+
+    m_scatteringTableShader = initializeShaderProgram("Scattering table", ":/shaders/scatteringTable.glsl", {":/shaders/cameraProjection.glsl"});
+    m_phaseFunctionShader = initializeShaderProgram("Phase function", ":/shaders/phaseFunction.glsl", {":/shaders/cameraProjection.glsl"});
+    m_sampleReweightingShader = initializeShaderProgram("Sample reweighting", ":/shaders/sampleReweighting.glsl", {":/shaders/luminance.glsl", ":/shaders/splatFilter.glsl"});
+    m_pathLayerShader = initializeShaderProgram("Path layer", ":/shaders/pathLayers.glsl");
+    m_sunConvolutionShader = initializeShaderProgram("Sun convolution", ":/shaders/sunConvolution.glsl", {":/shaders/cameraProjection.glsl"});
+    m_cpuSplatShader = initializeShaderProgram("CPU splat", ":/shaders/cpuSplats.glsl", {":/shaders/luminance.glsl"});
+    m_monochromeShader = initializeShaderProgram("Monochrome", ":/shaders/monochrome.glsl", {":/shaders/compensatedSum.glsl"});
+    m_accumulationShader = initializeShaderProgram("Accumulation", ":/shaders/accumulation.glsl", {":/shaders/compensatedSum.glsl"});
+    m_layerAccumulationShader = initializeShaderProgram("Layer accumulation", ":/shaders/layerAccumulation.glsl", {":/shaders/compensatedSum.glsl"});
+    m_skyShader = initializeShaderProgram("Sky", ":/shaders/sky.glsl");
 }
 
 void SimulationEngine::initializeTextures()
 {
     m_simulationTexture = std::make_unique<OpenGL::Texture>(m_outputWidth, m_outputHeight, 0, OpenGL::TextureType::Color);
     m_backgroundTexture = std::make_unique<OpenGL::Texture>(m_outputWidth, m_outputHeight, 2, OpenGL::TextureType::Color);
+    m_compositeTexture = std::make_unique<OpenGL::Texture>(m_outputWidth, m_outputHeight, 5, OpenGL::TextureType::Color);
+    m_accumulationStepTexture = std::make_unique<OpenGL::Texture>(m_outputWidth, m_outputHeight, 0, OpenGL::TextureType::Color);
+    m_accumulationErrorTexture = std::make_unique<OpenGL::Texture>(m_outputWidth, m_outputHeight, 3, OpenGL::TextureType::Color);
+    m_secondMomentTexture = std::make_unique<OpenGL::Texture>(m_outputWidth, m_outputHeight, 3, OpenGL::TextureType::Scalar);
+    if (m_monochrome)
+        m_monochromeTexture = std::make_unique<OpenGL::Texture>(m_outputWidth, m_outputHeight, 1, OpenGL::TextureType::Monochrome);
 }
 
-void SimulationEngine::resizeOutputTextureCallback(const unsigned int width, const unsigned int height)
+void SimulationEngine::resolveMonochromeImage()
 {
-    m_outputWidth = width;
-    m_outputHeight = height;
+    glMemoryBarrier(GL_SHADER_IMAGE_ACCESS_BARRIER_BIT);
+    glBindImageTexture(0, m_simulationTexture->getHandle(), 0, GL_FALSE, 0, GL_READ_WRITE, GL_RGBA32F);
+    glBindImageTexture(m_monochromeTexture->getTextureUnit(), m_monochromeTexture->getHandle(), 0, GL_FALSE, 0, GL_READ_WRITE, GL_R32UI);
+    glBindImageTexture(3, m_accumulationErrorTexture->getHandle(), 0, GL_FALSE, 0, GL_READ_WRITE, GL_RGBA32F);
+    glBindImageTexture(2, m_secondMomentTexture->getHandle(), 0, GL_FALSE, 0, GL_READ_WRITE, GL_R32F);
+    m_monochromeShader->bind();
+    glDispatchCompute((m_outputWidth + 15) / 16, (m_outputHeight + 15) / 16, 1);
+    glMemoryBarrier(GL_SHADER_IMAGE_ACCESS_BARRIER_BIT);
 
-    m_simulationTexture.reset();
-    m_backgroundTexture.reset();
+    // Later passes read the accumulated image and the background from their usual units
+    glBindImageTexture(m_simulationTexture->getTextureUnit(), m_simulationTexture->getHandle(), 0, GL_FALSE, 0, GL_READ_WRITE, GL_RGBA32F);
+    glBindImageTexture(m_backgroundTexture->getTextureUnit(), m_backgroundTexture->getHandle(), 0, GL_FALSE, 0, GL_READ_WRITE, GL_RGBA32F);
+}
 
-    initializeTextures();
-    clear();
+bool SimulationEngine::usesTwoLevelAccumulation() const
+{
+    /* Monochrome images are added to the compensated sum by their own
+    shader, and sample reweighting redraws the whole image from the
+    stored rays */
+    return !m_monochrome && !usesSampleRecording();
 }
 
-void SimulationEngine::lockCameraToLightSource(bool locked)
+void SimulationEngine::flushAccumulation()
 {
-    if (m_cameraLockedToLightSource == locked) return;
+    glMemoryBarrier(GL_SHADER_IMAGE_ACCESS_BARRIER_BIT);
+    glBindImageTexture(0, m_accumulationStepTexture->getHandle(), 0, GL_FALSE, 0, GL_READ_WRITE, GL_RGBA32F);
+    glBindImageTexture(1, m_simulationTexture->getHandle(), 0, GL_FALSE, 0, GL_READ_WRITE, GL_RGBA32F);
+    glBindImageTexture(3, m_accumulationErrorTexture->getHandle(), 0, GL_FALSE, 0, GL_READ_WRITE, GL_RGBA32F);
+    m_accumulationShader->bind();
+    glDispatchCompute((m_outputWidth + 15) / 16, (m_outputHeight + 15) / 16, 1);
 
-    m_cameraLockedToLightSource = locked;
-    pointCameraToLightSource();
+    if (usesPathLayers())
+        flushLayerAccumulation(m_pathLayerStepTexture, m_pathLayerTexture, m_pathLayerErrorTexture, m_outputWidth, m_outputHeight, static_cast<unsigned int>(m_pathFilters.size()));
+    if (usesOutputViews())
+        flushLayerAccumulation(m_outputViewStepTexture, m_outputViewTexture, m_outputViewErrorTexture, m_outputViewTextureWidth, m_outputViewTextureHeight, static_cast<unsigned int>(m_outputViews.size()));
+    glMemoryBarrier(GL_SHADER_IMAGE_ACCESS_BARRIER_BIT);
 
-    emit cameraChanged(m_camera);
-    emit lockCameraToLightSourceChanged(m_cameraLockedToLightSource);
+    // Later passes read the accumulated images from their usual units
+    glBindImageTexture(m_simulationTexture->getTextureUnit(), m_simulationTexture->getHandle(), 0, GL_FALSE, 0, GL_READ_WRITE, GL_RGBA32F);
+    if (usesPathLayers())
+        glBindImageTexture(6, m_pathLayerTexture, 0, GL_TRUE, 0, GL_READ_WRITE, GL_RGBA32F);
+    if (usesOutputViews())
+        glBindImageTexture(4, m_outputViewTexture, 0, GL_TRUE, 0, GL_READ_WRITE, GL_RGBA32F);
 }
 
-void SimulationEngine::pointCameraToLightSource()
+void SimulationEngine::flushLayerAccumulation(unsigned int stepTexture, unsigned int texture, unsigned int errorTexture, unsigned int width, unsigned int height, unsigned int layers)
 {
-    if (m_camera.yaw == 0.0f && m_camera.pitch == m_light.altitude) return;
-    clear();
-    m_camera.yaw = 0.0f;
-    m_camera.pitch = m_light.altitude;
+    glMemoryBarrier(GL_SHADER_IMAGE_ACCESS_BARRIER_BIT);
+    glBindImageTexture(0, stepTexture, 0, GL_TRUE, 0, GL_READ_WRITE, GL_RGBA32F);
+    glBindImageTexture(1, texture, 0, GL_TRUE, 0, GL_READ_WRITE, GL_RGBA32F);
+    glBindImageTexture(3, errorTexture, 0, GL_TRUE, 0, GL_READ_WRITE, GL_RGBA32F);
+    m_layerAccumulationShader->bind();
+    glDispatchCompute((width + 15) / 16, (height + 15) / 16, layers);
 }
 
-void SimulationEngine::setMultipleScatteringProbability(double probability)
+unsigned int SimulationEngine::createTextureArray(unsigned int width, unsigned int height, unsigned int layers)
 {
-    if (m_multipleScatteringProbability == probability) return;
+    unsigned int texture;
+    glGenTextures(1, &texture);
+    glBindTexture(GL_TEXTURE_2D_ARRAY, texture);
+    glTexStorage3D(GL_TEXTURE_2D_ARRAY, 1, GL_RGBA32F, static_cast<int>(width), static_cast<int>(height), static_cast<int>(layers));
+    glClearTexImage(texture, 0, GL_RGBA, GL_FLOAT, NULL);
+    return texture;
+}
 
-    clear();
-    m_multipleScatteringProbability = static_cast<float>(std::min(std::max(probability, 0.0), 1.0));
+void SimulationEngine::initializePhaseFunctionBuffers()
+{
+    glGenBuffers(1, &m_phaseFunctionBuffer);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, m_phaseFunctionBuffer);
+    glBufferData(GL_SHADER_STORAGE_BUFFER, PhaseFunction::counterCount * sizeof(unsigned int), NULL, GL_DYNAMIC_DRAW);
+    glClearBufferData(GL_SHADER_STORAGE_BUFFER, GL_R32UI, GL_RED_INTEGER, GL_UNSIGNED_INT, NULL);
 
-    emit multipleScatteringProbabilityChanged(m_multipleScatteringProbability);
+    // RGBA radiance for each scattering angle bin
+    glGenBuffers(1, &m_phaseFunctionRadianceBuffer);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, m_phaseFunctionRadianceBuffer);
+    glBufferData(GL_SHADER_STORAGE_BUFFER, PhaseFunction::angleBinCount * 4 * sizeof(float), NULL, GL_DYNAMIC_COPY);
 }
 
-double SimulationEngine::getMultipleScatteringProbability() const
+void SimulationEngine::compositePhaseFunction()
 {
-    return static_cast<double>(m_multipleScatteringProbability);
+    /* The phase function may have been accumulated over more steps
+    than the image, so it is scaled to the number of rays the image
+    would have by now */
+    auto rayCountScale = static_cast<float>(m_iteration * m_phaseFunctionRaysPerStep / m_phaseFunctionRayCount);
+
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 4, m_phaseFunctionBuffer);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 5, m_phaseFunctionRadianceBuffer);
+
+    m_phaseFunctionShader->bind();
+    m_phaseFunctionShader->setUniformValue("rayCountScale", rayCountScale);
+    m_phaseFunctionShader->setUniformValue("sun.altitude", degToRad(m_light.altitude));
+    m_phaseFunctionShader->setUniformValueArray("sun.spectrum", m_sunSpectrumCache, 31, 1);
+    m_phaseFunctionShader->setUniformValue("atmosphereEnabled", m_atmosphere.enabled ? 1 : 0);
+    m_phaseFunctionShader->setUniformValue("camera.pitch", degToRad(m_camera.pitch));
+    m_phaseFunctionShader->setUniformValue("camera.yaw", degToRad(m_camera.yaw));
+    m_phaseFunctionShader->setUniformValue("camera.focalLength", m_camera.getFocalLength());
+    m_phaseFunctionShader->setUniformValue("camera.projection", m_camera.projection);
+    m_phaseFunctionShader->setUniformValue("camera.hideSubHorizon", m_camera.hideSubHorizon ? 1 : 0);
+
+    // Resolve the spectral phase function into RGB radiance per scattering angle bin
+    glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+    m_phaseFunctionShader->setUniformValue("shaderPass", 0);
+    glDispatchCompute((PhaseFunction::angleBinCount + 255) / 256, 1, 1);
+
+    // Add it to the traced image through the camera projection
+    glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT | GL_SHADER_IMAGE_ACCESS_BARRIER_BIT);
+    glBindImageTexture(m_simulationTexture->getTextureUnit(), m_simulationTexture->getHandle(), 0, GL_FALSE, 0, GL_READ_WRITE, GL_RGBA32F);
+    glBindImageTexture(m_compositeTexture->getTextureUnit(), m_compositeTexture->getHandle(), 0, GL_FALSE, 0, GL_READ_WRITE, GL_RGBA32F);
+    m_phaseFunctionShader->setUniformValue("shaderPass", 1);
+    glDispatchCompute((m_outputWidth + 15) / 16, (m_outputHeight + 15) / 16, 1);
+
+    m_compositingPhaseFunction = true;
+}
+
+void SimulationEngine::initializePathLengthBuffer()
+{
+    if (m_pathLengthBuffer == 0)
+        glGenBuffers(1, &m_pathLengthBuffer);
+
+    m_pathLengthBufferPopulationCount = m_crystalRepository->getCount();
+    auto bufferSize = m_pathLengthBufferPopulationCount * PathLengthHistogram::numBins * sizeof(unsigned int);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, m_pathLengthBuffer);
+    glBufferData(GL_SHADER_STORAGE_BUFFER, bufferSize, NULL, GL_DYNAMIC_READ);
+    glClearBufferData(GL_SHADER_STORAGE_BUFFER, GL_R32UI, GL_RED_INTEGER, GL_UNSIGNED_INT, NULL);
+}
+
+void SimulationEngine::updateDistributionTables()
+{
+    if (m_distributionTableTexture == 0)
+        glGenTextures(1, &m_distributionTableTexture);
+
+    // Rows are as wide as the table with the most bins
+    auto tableWidth = 2u;
+    for (auto i = 0u; i < m_crystalRepository->getCount(); ++i)
+    {
+        const auto &crystals = m_crystalRepository->get(i);
+        for (auto parameter = 0u; parameter < NUM_TABULATED_PARAMETERS; ++parameter)
+        {
+            if (crystals.usesTable(static_cast<TabulatedParameter>(parameter)))
+                tableWidth = std::max(tableWidth, crystals.distributionTables[parameter].getBinCount() + 1);
+        }
+    }
+    const auto tableHeight = std::max(1u, m_crystalRepository->getCount() * NUM_TABULATED_PARAMETERS);
+    std::vector<float> tables(2 * tableWidth * tableHeight, 0.0f);
+
+    for (auto i = 0u; i < m_crystalRepository->getCount(); ++i)
+    {
+        const auto &crystals = m_crystalRepository->get(i);
+        for (auto parameter = 0u; parameter < NUM_TABULATED_PARAMETERS; ++parameter)
+        {
+            if (!crystals.usesTable(static_cast<TabulatedParameter>(parameter)))
+                continue;
+
+            auto table = crystals.distributionTables[parameter].createSamplingTable(tableWidth);
+
+            // Angles are given in degrees, but the shader uses radians
+            if (parameter == TiltTable || parameter == RotationTable)
+            {
+                for (auto edge = 1u; edge < table.size(); edge += 2)
+                    table[edge] = degToRad(table[edge]);
+            }
+
+            auto row = i * NUM_TABULATED_PARAMETERS + parameter;
+            std::copy(table.begin(), table.end(), tables.begin() + 2 * row * tableWidth);
+        }
+    }
+
+    glActiveTexture(GL_TEXTURE3);
+    glBindTexture(GL_TEXTURE_2D, m_distributionTableTexture);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RG32F, tableWidth, tableHeight, 0, GL_RG, GL_FLOAT, tables.data());
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+}
+
+void SimulationEngine::updateCustomShapeBuffers()
+{
+    if (m_crystalFaceBuffer == 0)
+        glGenBuffers(1, &m_crystalFaceBuffer);
+    if (m_crystalTriangleBuffer == 0)
+        glGenBuffers(1, &m_crystalTriangleBuffer);
+
+    std::vector<float> faceTable;
+    std::vector<float> triangleTable;
+    m_customShapeFaceOffsets.assign(m_crystalRepository->getCount(), 0);
+    m_customShapeFaceCounts.assign(m_crystalRepository->getCount(), 0);
+
+    for (auto i = 0u; i < m_crystalRepository->getCount(); ++i)
+    {
+        const auto &shape = m_crystalRepository->get(i).customShape;
+        if (shape.isEmpty())
+            continue;
+
+        m_customShapeFaceOffsets[i] = static_cast<int>(faceTable.size() / ConvexPolyhedron::faceTableStride);
+        m_customShapeFaceCounts[i] = static_cast<int>(shape.getFaces().size());
+        shape.appendFaceTable(faceTable, triangleTable);
+    }
+
+    // Empty buffers cannot be bound, so they always hold at least one entry
+    if (faceTable.empty())
+        faceTable.resize(ConvexPolyhedron::faceTableStride, 0.0f);
+    if (triangleTable.empty())
+        triangleTable.resize(ConvexPolyhedron::triangleTableStride, 0.0f);
+
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, m_crystalFaceBuffer);
+    glBufferData(GL_SHADER_STORAGE_BUFFER, faceTable.size() * sizeof(float), faceTable.data(), GL_STATIC_DRAW);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, m_crystalTriangleBuffer);
+    glBufferData(GL_SHADER_STORAGE_BUFFER, triangleTable.size() * sizeof(float), triangleTable.data(), GL_STATIC_DRAW);
+}
+
+void SimulationEngine::updateSunSpectrum(const SkyModel &skyState)
+{
+    for (auto i = 0u; i < 31; ++i) {
+        m_sunSpectrumCache[i] = skyState.sunSpectrum[i];
+    }
+}
+
+ScatteringTable SimulationEngine::buildScatteringTable(float minAltitude, float maxAltitude, float altitudeStep, unsigned long long raysPerAltitude,
+                                                       std::function<bool(unsigned int, unsigned int)> progressCallback)
+{
+    if (!(altitudeStep > 0.0f) || maxAltitude < minAltitude)
+        throw std::runtime_error("Invalid altitude range for scattering table");
+
+    const auto populationCount = m_crystalRepository->getCount();
+    const auto altitudeCount = static_cast<unsigned int>(std::floor((maxAltitude - minAltitude) / altitudeStep + 1.0e-3f)) + 1;
+    ScatteringTable table(ScatteringTable::defaultWidth, ScatteringTable::defaultHeight, minAltitude, altitudeStep, altitudeCount, populationCount);
+    table.setSettings(getScatteringTableSettings());
+    const auto width = table.getWidth();
+    const auto height = table.getHeight();
+    qInfo("Building scattering table for %u sun altitudes from %.2f to %.2f degrees", altitudeCount, table.getMinAltitude(), table.getMaxAltitude());
+
+    // Each population is traced into its own layer of the accumulation texture
+    unsigned int accumulationTexture;
+    glGenTextures(1, &accumulationTexture);
+    glBindTexture(GL_TEXTURE_2D_ARRAY, accumulationTexture);
+    glTexStorage3D(GL_TEXTURE_2D_ARRAY, 1, GL_RGBA32F, width, height, populationCount);
+
+    updateDistributionTables();
+    updateCustomShapeBuffers();
+    glActiveTexture(GL_TEXTURE3);
+    glBindTexture(GL_TEXTURE_2D, m_distributionTableTexture);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 2, m_crystalFaceBuffer);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 3, m_crystalTriangleBuffer);
+    if (m_pathLengthBufferPopulationCount != populationCount)
+        initializePathLengthBuffer();
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 1, m_pathLengthBuffer);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 4, m_phaseFunctionBuffer);
+
+    // Scattering tables keep populations apart, so rays scatter again only from their own population
+    if (usesContinuations())
+        initializeContinuationBuffers(false);
+
+    std::vector<float> accumulatedLayers(static_cast<std::size_t>(width) * height * 4 * populationCount);
+    bool cancelled = false;
+    for (auto altitudeIndex = 0u; altitudeIndex < altitudeCount && !cancelled; ++altitudeIndex)
+    {
+        auto altitude = table.getAltitude(altitudeIndex);
+        if (m_atmosphere.enabled)
+            updateSunSpectrum(SkyModel::Create(degToRad(altitude), m_atmosphere.turbidity, m_atmosphere.groundAlbedo, degToRad(m_light.diameter / 2.0)));
+
+        glClearTexImage(accumulationTexture, 0, GL_RGBA, GL_FLOAT, NULL);
+        m_simulationShader->bind();
+
+        /* Every altitude uses the same random numbers, so that noise in
+        neighboring slices is correlated and does not flicker when
+        interpolating between them */
+        m_rayIndexOffsets.assign(populationCount, 0);
+
+        // All populations are traced, so that their weights can still be changed
+        for (auto i = 0u; i < populationCount; ++i)
+        {
+            glBindImageTexture(0, accumulationTexture, 0, GL_FALSE, i, GL_READ_WRITE, GL_RGBA32F);
+            while (m_rayIndexOffsets[i] < raysPerAltitude)
+            {
+                glMemoryBarrier(GL_SHADER_IMAGE_ACCESS_BARRIER_BIT);
+                auto numRays = static_cast<unsigned int>(std::min<unsigned long long>(m_raysPerStep, raysPerAltitude - m_rayIndexOffsets[i]));
+                if (usesContinuations())
+                    startContinuationQueue();
+                traceRays(i, std::max(numRays, 64u), altitude, true);
+                if (usesContinuations())
+                    traceContinuations(altitude, true);
+            }
+        }
+
+        glMemoryBarrier(GL_TEXTURE_UPDATE_BARRIER_BIT);
+        glBindTexture(GL_TEXTURE_2D_ARRAY, accumulationTexture);
+        glGetTexImage(GL_TEXTURE_2D_ARRAY, 0, GL_RGBA, GL_FLOAT, accumulatedLayers.data());
+
+        // Normalize to radiance per traced ray and per steradian
+        for (auto i = 0u; i < populationCount; ++i)
+        {
+            auto scale = 1.0 / (m_rayIndexOffsets[i] * static_cast<double>(table.getCellSolidAngle()));
+            const float *source = accumulatedLayers.data() + static_cast<std::size_t>(i) * width * height * 4;
+            float *destination = table.getLayer(table.getLayerIndex(altitudeIndex, i));
+            for (auto cell = 0u; cell < width * height; ++cell)
+            {
+                for (auto channel = 0u; channel < 3; ++channel)
+                    destination[cell * 3 + channel] = static_cast<float>(source[cell * 4 + channel] * scale);
+            }
+        }
+
+        if (progressCallback && !progressCallback(altitudeIndex + 1, altitudeCount))
+            cancelled = true;
+    }
+
+    glDeleteTextures(1, &accumulationTexture);
+    if (usesContinuations())
+        deleteContinuationBuffers();
+    reset();
+
+    if (cancelled)
+    {
+        qInfo("Building scattering table cancelled");
+        return ScatteringTable();
+    }
+
+    qInfo("Finished building scattering table");
+    return table;
+}
+
+void SimulationEngine::setScatteringTable(ScatteringTable table)
+{
+    if (!table.isEmpty() && !matchesScatteringTable(table))
+        throw std::runtime_error("Scattering table was built with different crystals or simulation settings");
+
+    clear();
+    m_scatteringTable = std::move(table);
+
+    if (!m_scatteringTable.isEmpty())
+    {
+        if (m_scatteringTableTexture == 0)
+            glGenTextures(1, &m_scatteringTableTexture);
+
+        glActiveTexture(GL_TEXTURE4);
+        glBindTexture(GL_TEXTURE_2D_ARRAY, m_scatteringTableTexture);
+        glTexImage3D(GL_TEXTURE_2D_ARRAY, 0, GL_RGB32F,
+                     m_scatteringTable.getWidth(), m_scatteringTable.getHeight(), m_scatteringTable.getLayerCount(),
+                     0, GL_RGB, GL_FLOAT, m_scatteringTable.getData().data());
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        // Azimuth wraps around, elevation does not
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, GL_REPEAT);
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    }
+    else if (m_scatteringTableTexture != 0)
+    {
+        glDeleteTextures(1, &m_scatteringTableTexture);
+        m_scatteringTableTexture = 0;
+    }
+
+    emit scatteringTableChanged();
+}
+
+const ScatteringTable &SimulationEngine::getScatteringTable() const
+{
+    return m_scatteringTable;
+}
+
+bool SimulationEngine::matchesScatteringTable(const ScatteringTable &table) const
+{
+    return table.getPopulationCount() == m_crystalRepository->getCount() &&
+           table.getSettings() == getScatteringTableSettings();
+}
+
+bool SimulationEngine::isUsingScatteringTable() const
+{
+    return !m_scatteringTable.isEmpty() &&
+           m_scatteringTable.coversAltitude(m_light.altitude) &&
+           matchesScatteringTable(m_scatteringTable);
+}
+
+ScatteringTable::Settings SimulationEngine::getScatteringTableSettings() const
+{
+    ScatteringTable::Settings settings;
+    settings.crystalFingerprint = m_crystalRepository->getFingerprint();
+    settings.multipleScatteringProbability = m_multipleScatteringProbability;
+    settings.maxScatteringOrders = m_maxScatteringOrders;
+    settings.russianRouletteDepth = m_russianRouletteDepth;
+    settings.runSeed = m_runSeed;
+    settings.quasiRandomSampling = m_quasiRandomSampling;
+    settings.sunDiameter = m_light.diameter;
+    settings.atmosphere = m_atmosphere;
+    return settings;
+}
+
+void SimulationEngine::resampleScatteringTable()
+{
+    // The whole image is recomputed from the table on every step
+    glMemoryBarrier(GL_SHADER_IMAGE_ACCESS_BARRIER_BIT);
+    glClearTexImage(m_simulationTexture->getHandle(), 0, GL_RGBA, GL_FLOAT, NULL);
+    glBindImageTexture(m_simulationTexture->getTextureUnit(), m_simulationTexture->getHandle(), 0, GL_FALSE, 0, GL_READ_WRITE, GL_RGBA32F);
+    glActiveTexture(GL_TEXTURE4);
+    glBindTexture(GL_TEXTURE_2D_ARRAY, m_scatteringTableTexture);
+
+    m_scatteringTableShader->bind();
+    m_scatteringTableShader->setUniformValue("camera.pitch", degToRad(m_camera.pitch));
+    m_scatteringTableShader->setUniformValue("camera.yaw", degToRad(m_camera.yaw));
+    m_scatteringTableShader->setUniformValue("camera.focalLength", m_camera.getFocalLength());
+    m_scatteringTableShader->setUniformValue("camera.projection", m_camera.projection);
+    m_scatteringTableShader->setUniformValue("camera.hideSubHorizon", m_camera.hideSubHorizon ? 1 : 0);
+
+    unsigned int lowerIndex, upperIndex;
+    float upperWeight;
+    m_scatteringTable.getAltitudeSlices(m_light.altitude, lowerIndex, upperIndex, upperWeight);
+
+    for (auto i = 0u; i < m_crystalRepository->getCount(); ++i)
+    {
+        auto probability = m_crystalRepository->getProbability(i);
+        if (probability <= 0.0) continue;
+
+        // Scale to the number of rays the population would have traced by now
+        auto rayCount = static_cast<float>(m_raysPerStep * probability * m_iteration);
+
+        m_scatteringTableShader->setUniformValue("lowerLayer", static_cast<int>(m_scatteringTable.getLayerIndex(lowerIndex, i)));
+        m_scatteringTableShader->setUniformValue("upperLayer", static_cast<int>(m_scatteringTable.getLayerIndex(upperIndex, i)));
+        m_scatteringTableShader->setUniformValue("upperLayerWeight", upperWeight);
+        m_scatteringTableShader->setUniformValue("rayCount", rayCount);
+
+        glMemoryBarrier(GL_SHADER_IMAGE_ACCESS_BARRIER_BIT);
+        glDispatchCompute((m_outputWidth + 15) / 16, (m_outputHeight + 15) / 16, 1);
+    }
+}
+
+void SimulationEngine::resizeOutputTextureCallback(const unsigned int width, const unsigned int height)
+{
+    m_outputWidth = width;
+    m_outputHeight = height;
+
+    m_simulationTexture.reset();
+    m_backgroundTexture.reset();
+    m_compositeTexture.reset();
+    m_monochromeTexture.reset();
+    m_accumulationStepTexture.reset();
+    m_accumulationErrorTexture.reset();
+    m_secondMomentTexture.reset();
+
+    initializeTextures();
+    initializePathLayers();
+    clear();
+}
+
+void SimulationEngine::lockCameraToLightSource(bool locked)
+{
+    if (m_cameraLockedToLightSource == locked) return;
+
+    m_cameraLockedToLightSource = locked;
+    pointCameraToLightSource();
+
+    emit cameraChanged(m_camera);
+    emit lockCameraToLightSourceChanged(m_cameraLockedToLightSource);
+}
+
+void SimulationEngine::pointCameraToLightSource()
+{
+    if (m_camera.yaw == 0.0f && m_camera.pitch == m_light.altitude) return;
+    clear();
+    m_camera.yaw = 0.0f;
+    m_camera.pitch = m_light.altitude;
+}
+
+void SimulationEngine::setMultipleScatteringProbability(double probability)
+{
+    if (m_multipleScatteringProbability == probability) return;
+
+    reset();
+    m_multipleScatteringProbability = static_cast<float>(std::min(std::max(probability, 0.0), 1.0));
+
+    emit multipleScatteringProbabilityChanged(m_multipleScatteringProbability);
+}
+
+double SimulationEngine::getMultipleScatteringProbability() const
+{
+    return static_cast<double>(m_multipleScatteringProbability);
+}
+
+void SimulationEngine::setRussianRouletteDepth(int depth)
+{
+    depth = std::min(std::max(depth, 0), (int)PathLengthHistogram::maxHits);
+    if (m_russianRouletteDepth == depth) return;
+
+    reset();
+    clearTransferTables();
+    m_russianRouletteDepth = depth;
+
+    emit russianRouletteDepthChanged(m_russianRouletteDepth);
+}
+
+int SimulationEngine::getRussianRouletteDepth() const
+{
+    return m_russianRouletteDepth;
+}
+
+void SimulationEngine::setMaxScatteringOrders(int orders)
+{
+    orders = std::min(std::max(orders, 1), scatteringOrderLimit);
+    if (m_maxScatteringOrders == orders) return;
+
+    reset();
+    m_maxScatteringOrders = orders;
+
+    emit maxScatteringOrdersChanged(m_maxScatteringOrders);
+}
+
+int SimulationEngine::getMaxScatteringOrders() const
+{
+    return m_maxScatteringOrders;
+}
+
+void SimulationEngine::setPathLengthStatisticsEnabled(bool enabled)
+{
+    if (m_pathLengthStatisticsEnabled == enabled) return;
+
+    clear();
+    m_pathLengthStatisticsEnabled = enabled;
+}
+
+bool SimulationEngine::isPathLengthStatisticsEnabled() const
+{
+    return m_pathLengthStatisticsEnabled;
+}
+
+PathLengthHistogram SimulationEngine::getPathLengthHistogram(unsigned int populationIndex)
+{
+    if (m_pathLengthBuffer == 0 || populationIndex >= m_pathLengthBufferPopulationCount)
+        return PathLengthHistogram();
+
+    unsigned int bins[PathLengthHistogram::numBins];
+    glMemoryBarrier(GL_BUFFER_UPDATE_BARRIER_BIT);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, m_pathLengthBuffer);
+    glGetBufferSubData(GL_SHADER_STORAGE_BUFFER, populationIndex * sizeof(bins), sizeof(bins), bins);
+    return PathLengthHistogram::fromBins(bins);
+}
+
+void SimulationEngine::setQuasiRandomSampling(bool enabled)
+{
+    if (m_quasiRandomSampling == enabled) return;
+
+    reset();
+    m_quasiRandomSampling = enabled;
+
+    emit quasiRandomSamplingChanged(m_quasiRandomSampling);
+}
+
+bool SimulationEngine::isQuasiRandomSampling() const
+{
+    return m_quasiRandomSampling;
+}
+
+void SimulationEngine::setRunSeed(unsigned int seed)
+{
+    if (m_runSeed == seed) return;
+
+    reset();
+    clearTransferTables();
+    m_runSeed = seed;
+
+    emit runSeedChanged(m_runSeed);
+}
+
+unsigned int SimulationEngine::getRunSeed() const
+{
+    return m_runSeed;
+}
+
+void SimulationEngine::setTransferTablesEnabled(bool enabled)
+{
+    if (m_transferTablesEnabled == enabled) return;
+
+    reset();
+    m_transferTablesEnabled = enabled;
+    if (!enabled)
+        clearTransferTables();
+
+    emit transferTablesEnabledChanged(m_transferTablesEnabled);
+}
+
+bool SimulationEngine::isTransferTablesEnabled() const
+{
+    return m_transferTablesEnabled;
+}
+
+void SimulationEngine::setSampleReweightingEnabled(bool enabled)
+{
+    if (m_sampleReweightingEnabled == enabled) return;
+
+    reset();
+    m_sampleReweightingEnabled = enabled;
+    if (!enabled)
+        deleteSampleRecordBuffers();
+
+    emit sampleReweightingEnabledChanged(m_sampleReweightingEnabled);
+}
+
+bool SimulationEngine::isSampleReweightingEnabled() const
+{
+    return m_sampleReweightingEnabled;
+}
+
+bool SimulationEngine::usesSampleRecording() const
+{
+    /* Rays sampled from transfer tables and scattered more than once have
+    more parameters than are stored, rays around the sun are not stored by
+    pixel when convolving them with the sun disk, and stored rays only
+    know their pixel in the main image. Reweighting also redraws the image
+    in color. Recording stops once the record buffer is full. */
+    return m_sampleReweightingEnabled && !m_sampleRecordsOverflowed && !usesTransferTable() && m_multipleScatteringProbability == 0.0f && !usesSunConvolution() && !usesOutputViews() &&
+           !m_monochrome;
+}
+
+void SimulationEngine::initializeSampleRecordBuffers()
+{
+    // The first value of the record buffer is the number of rays stored
+    glGenBuffers(1, &m_sampleRecordBuffer);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, m_sampleRecordBuffer);
+    glBufferData(GL_SHADER_STORAGE_BUFFER, (1 + static_cast<std::size_t>(SampleReweighting::recordCapacity) * SampleReweighting::uintsPerRecord) * sizeof(unsigned int), NULL, GL_DYNAMIC_COPY);
+    glClearBufferSubData(GL_SHADER_STORAGE_BUFFER, GL_R32UI, 0, sizeof(unsigned int), GL_RED_INTEGER, GL_UNSIGNED_INT, NULL);
+
+    glGenBuffers(1, &m_samplingDistributionBuffer);
+    glGenBuffers(1, &m_targetDistributionBuffer);
+}
+
+void SimulationEngine::deleteSampleRecordBuffers()
+{
+    if (m_sampleRecordBuffer == 0)
+        return;
+
+    glDeleteBuffers(1, &m_sampleRecordBuffer);
+    glDeleteBuffers(1, &m_samplingDistributionBuffer);
+    glDeleteBuffers(1, &m_targetDistributionBuffer);
+    m_sampleRecordBuffer = 0;
+    m_samplingDistributionBuffer = 0;
+    m_targetDistributionBuffer = 0;
+}
+
+void SimulationEngine::startSamplingEpochs()
+{
+    if (m_sampleRecordBuffer == 0)
+        initializeSampleRecordBuffers();
+
+    m_sampledPopulations.clear();
+    m_sampledProbabilities.clear();
+    m_samplingEpochs.clear();
+    for (auto i = 0u; i < m_crystalRepository->getCount(); ++i)
+    {
+        const auto &population = m_crystalRepository->get(i);
+        m_sampledPopulations.push_back(population);
+        m_sampledProbabilities.push_back(m_crystalRepository->getProbability(i));
+        m_samplingEpochs.push_back({{LatentDistributions::fromPopulation(population), 0.0}});
+    }
+    uploadSamplingDistributions();
+}
+
+void SimulationEngine::uploadSamplingDistributions()
+{
+    const auto slotCount = std::max<std::size_t>(1, m_samplingEpochs.size() * SampleReweighting::maxEpochs);
+    std::vector<float> distributions(slotCount * LatentDistributions::floatsPerDistributions, 0.0f);
+    for (auto i = 0u; i < m_samplingEpochs.size(); ++i)
+    {
+        std::vector<float> epochDistributions;
+        for (const auto &epoch : m_samplingEpochs[i])
+            epoch.distributions.appendTo(epochDistributions);
+        std::copy(epochDistributions.begin(), epochDistributions.end(),
+                  distributions.begin() + i * SampleReweighting::maxEpochs * LatentDistributions::floatsPerDistributions);
+    }
+
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, m_samplingDistributionBuffer);
+    glBufferData(GL_SHADER_STORAGE_BUFFER, distributions.size() * sizeof(float), distributions.data(), GL_DYNAMIC_DRAW);
+}
+
+unsigned int SimulationEngine::getSampleRecordCount()
+{
+    unsigned int count = 0;
+    glMemoryBarrier(GL_BUFFER_UPDATE_BARRIER_BIT);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, m_sampleRecordBuffer);
+    glGetBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, sizeof(count), &count);
+    return count;
+}
+
+bool SimulationEngine::reweightSamples()
+{
+    const auto populationCount = m_crystalRepository->getCount();
+    if (!usesSampleRecording() || isUsingScatteringTable() || m_samplingEpochs.empty() || m_samplingEpochs.size() != populationCount)
+        return false;
+
+    // Stored rays do not know their paths, so they cannot be split into halo component layers
+    if (usesPathLayers())
+        return false;
+
+    // The counter keeps growing after the buffer is full, so that lost rays can be detected
+    if (getSampleRecordCount() > SampleReweighting::recordCapacity)
+    {
+        qInfo("Too many rays stored to reweight, restarting simulation");
+        return false;
+    }
+
+    std::vector<unsigned int> changedPopulations;
+    for (auto i = 0u; i < populationCount; ++i)
+    {
+        const auto &population = m_crystalRepository->get(i);
+        if (m_crystalRepository->getProbability(i) != m_sampledProbabilities[i] || !SampleReweighting::canReweight(m_sampledPopulations[i], population))
+            return false;
+
+        auto target = LatentDistributions::fromPopulation(population);
+        if (target == m_samplingEpochs[i].back().distributions)
+            continue;
+
+        // Randomly oriented populations are accumulated into the phase function, which does not store rays
+        if (usesPhaseFunction(i) || m_samplingEpochs[i].size() >= SampleReweighting::maxEpochs)
+            return false;
+
+        auto effectiveSampleFraction = SampleReweighting::getEffectiveSampleFraction(m_samplingEpochs[i], target);
+        if (effectiveSampleFraction < SampleReweighting::minEffectiveSampleFraction)
+        {
+            qInfo("Reweighting crystal population \"%s\" would leave %.0f%% effective rays, restarting simulation",
+                  m_crystalRepository->getName(i).c_str(), 100.0 * effectiveSampleFraction);
+            return false;
+        }
+        changedPopulations.push_back(i);
+    }
+
+    if (changedPopulations.empty())
+        return true;
+
+    // Rays traced from now on are sampled from the new distributions
+    for (auto i : changedPopulations)
+    {
+        const auto &population = m_crystalRepository->get(i);
+        m_sampledPopulations[i] = population;
+        m_samplingEpochs[i].push_back({LatentDistributions::fromPopulation(population), 0.0});
+    }
+    uploadSamplingDistributions();
+
+    splatSampleRecords();
+    return true;
+}
+
+void SimulationEngine::splatSampleRecords()
+{
+    std::vector<float> targetDistributions;
+    for (auto i = 0u; i < m_crystalRepository->getCount(); ++i)
+        LatentDistributions::fromPopulation(m_crystalRepository->get(i)).appendTo(targetDistributions);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, m_targetDistributionBuffer);
+    glBufferData(GL_SHADER_STORAGE_BUFFER, targetDistributions.size() * sizeof(float), targetDistributions.data(), GL_DYNAMIC_DRAW);
+
+    glMemoryBarrier(GL_SHADER_IMAGE_ACCESS_BARRIER_BIT);
+    glClearTexImage(m_simulationTexture->getHandle(), 0, GL_RGBA, GL_FLOAT, NULL);
+    glClearTexImage(m_secondMomentTexture->getHandle(), 0, GL_RED, GL_FLOAT, NULL);
+    glBindImageTexture(m_simulationTexture->getTextureUnit(), m_simulationTexture->getHandle(), 0, GL_FALSE, 0, GL_READ_WRITE, GL_RGBA32F);
+    glBindImageTexture(3, m_secondMomentTexture->getHandle(), 0, GL_FALSE, 0, GL_READ_WRITE, GL_R32F);
+
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 7, m_sampleRecordBuffer);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 8, m_samplingDistributionBuffer);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 9, m_targetDistributionBuffer);
+
+    // Reweighting checks that no rays were lost, so the count is within the capacity
+    auto recordCount = getSampleRecordCount();
+    m_sampleReweightingShader->bind();
+    glUniform1ui(glGetUniformLocation(m_sampleReweightingShader->programId(), "recordCount"), recordCount);
+    m_sampleReweightingShader->setUniformValue("splatFilter", m_splatFilter.type);
+    m_sampleReweightingShader->setUniformValue("splatFilterRadius", m_splatFilter.radius);
+
+    // The number of work groups in a single dispatch is limited
+    const auto maxGroups = 65535u;
+    for (auto offset = 0u; offset < recordCount; offset += maxGroups * 64)
+    {
+        glUniform1ui(glGetUniformLocation(m_sampleReweightingShader->programId(), "recordOffset"), offset);
+        glMemoryBarrier(GL_SHADER_IMAGE_ACCESS_BARRIER_BIT);
+        glDispatchCompute(std::min((recordCount - offset + 63) / 64, maxGroups), 1, 1);
+    }
+
+    if (m_compositingPhaseFunction)
+    {
+        glMemoryBarrier(GL_SHADER_IMAGE_ACCESS_BARRIER_BIT);
+        compositePhaseFunction();
+    }
+}
+
+void SimulationEngine::startRayDump(const std::string &path)
+{
+    stopRayDump();
+    m_rayDumpWriter = std::make_unique<RayDumpWriter>(path);
+    qInfo("Dumping rays to: %s", path.c_str());
+}
+
+void SimulationEngine::stopRayDump()
+{
+    if (!m_rayDumpWriter)
+        return;
+
+    readBackRayDumps();
+    m_rayDumpWriter->close();
+    qInfo("Dumped %llu rays, %llu dropped because the disk could not keep up",
+          static_cast<unsigned long long>(m_rayDumpWriter->getRecordCount()),
+          static_cast<unsigned long long>(m_rayDumpWriter->getDroppedCount()));
+    m_rayDumpWriter.reset();
+}
+
+bool SimulationEngine::isDumpingRays() const
+{
+    return m_rayDumpWriter != nullptr;
+}
+
+void SimulationEngine::flushRayDump(std::uint64_t tracedRayCount)
+{
+    glMemoryBarrier(GL_BUFFER_UPDATE_BARRIER_BIT);
+    auto &dump = m_rayDumpBuffers[m_rayDumpBufferIndex];
+    dump.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    dump.tracedRayCount = tracedRayCount;
+    m_rayDumpBufferIndex = (m_rayDumpBufferIndex + 1) % rayDumpBufferCount;
+
+    // Hand over the previous step if the GPU has already finished it
+    auto &previousDump = m_rayDumpBuffers[m_rayDumpBufferIndex];
+    if (previousDump.fence != nullptr && glClientWaitSync(previousDump.fence, 0, 0) != GL_TIMEOUT_EXPIRED)
+        readBackRayDump(previousDump);
+}
+
+void SimulationEngine::readBackRayDump(RayDumpBuffer &dump)
+{
+    if (dump.fence == nullptr)
+        return;
+
+    auto status = glClientWaitSync(dump.fence, GL_SYNC_FLUSH_COMMANDS_BIT, std::numeric_limits<GLuint64>::max());
+    glDeleteSync(dump.fence);
+    dump.fence = nullptr;
+    if (status == GL_WAIT_FAILED)
+    {
+        qWarning("Waiting for dumped rays failed");
+        return;
+    }
+
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, dump.buffer);
+    auto header = static_cast<const unsigned int *>(glMapBufferRange(GL_SHADER_STORAGE_BUFFER, 0, sizeof(unsigned int), GL_MAP_READ_BIT));
+    if (header == nullptr)
+        return;
+    auto recordCount = std::min(*header, m_rayDumpBufferCapacity);
+    glUnmapBuffer(GL_SHADER_STORAGE_BUFFER);
+
+    // Records are handed to the writer thread straight from the mapped buffer
+    if (recordCount > 0)
+    {
+        auto size = sizeof(unsigned int) + static_cast<std::size_t>(recordCount) * sizeof(RayExitRecord);
+        auto data = static_cast<const unsigned int *>(glMapBufferRange(GL_SHADER_STORAGE_BUFFER, 0, size, GL_MAP_READ_BIT));
+        if (data != nullptr)
+        {
+            m_rayDumpWriter->write(reinterpret_cast<const RayExitRecord *>(data + 1), recordCount);
+            glUnmapBuffer(GL_SHADER_STORAGE_BUFFER);
+        }
+    }
+    m_rayDumpWriter->addTracedRays(dump.tracedRayCount);
+}
+
+// Hands over every pending step, oldest first
+void SimulationEngine::readBackRayDumps()
+{
+    for (unsigned int i = 0; i < rayDumpBufferCount; ++i)
+        readBackRayDump(m_rayDumpBuffers[(m_rayDumpBufferIndex + i) % rayDumpBufferCount]);
+}
+
+void SimulationEngine::setPathFilters(std::vector<PathFilter> filters)
+{
+    filters.erase(std::remove_if(filters.begin(), filters.end(), [](const PathFilter &filter) { return filter.isEmpty(); }), filters.end());
+    if (filters.size() > maxPathLayers)
+        throw std::runtime_error("At most " + std::to_string(maxPathLayers) + " halo component layers are supported");
+
+    reset();
+    m_pathFilters = std::move(filters);
+    if (m_initialized)
+        initializePathLayers();
+}
+
+const std::vector<PathFilter> &SimulationEngine::getPathFilters() const
+{
+    return m_pathFilters;
+}
+
+void SimulationEngine::setPathLayerVisibility(unsigned int visibleLayers, bool otherRaysVisible)
+{
+    m_visiblePathLayers = visibleLayers;
+    m_otherRaysVisible = otherRaysVisible;
+
+    // Only the shown image changes, the layers themselves stay as they are
+    if (m_compositingPathLayers)
+        compositePathLayers();
+}
+
+unsigned int SimulationEngine::getVisiblePathLayers() const
+{
+    return m_visiblePathLayers;
+}
+
+bool SimulationEngine::isOtherRaysVisible() const
+{
+    return m_otherRaysVisible;
+}
+
+bool SimulationEngine::usesPathLayers() const
+{
+    return !m_pathFilters.empty();
+}
+
+void SimulationEngine::initializePathLayers()
+{
+    if (m_pathLayerTexture != 0)
+    {
+        unsigned int textures[] = {m_pathLayerTexture, m_pathLayerStepTexture, m_pathLayerErrorTexture};
+        glDeleteTextures(3, textures);
+        m_pathLayerTexture = 0;
+        m_pathLayerStepTexture = 0;
+        m_pathLayerErrorTexture = 0;
+    }
+
+    // Nothing is allocated when rays are not split into layers
+    if (!usesPathLayers())
+    {
+        if (m_pathLayerMaskBuffer != 0)
+        {
+            glDeleteBuffers(1, &m_pathLayerMaskBuffer);
+            m_pathLayerMaskBuffer = 0;
+        }
+        return;
+    }
+
+    const auto layerCount = static_cast<unsigned int>(m_pathFilters.size());
+    m_pathLayerTexture = createTextureArray(m_outputWidth, m_outputHeight, layerCount);
+    m_pathLayerStepTexture = createTextureArray(m_outputWidth, m_outputHeight, layerCount);
+    m_pathLayerErrorTexture = createTextureArray(m_outputWidth, m_outputHeight, layerCount);
+
+    // Masks for hexagonal and custom crystals for each layer, see the raytracing shader
+    std::vector<std::uint32_t> masks;
+    for (const auto &filter : m_pathFilters)
+    {
+        for (auto hexagonal : {true, false})
+        {
+            auto mask = filter.createMask(hexagonal);
+            masks.insert(masks.end(), mask.begin(), mask.end());
+        }
+    }
+
+    if (m_pathLayerMaskBuffer == 0)
+        glGenBuffers(1, &m_pathLayerMaskBuffer);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, m_pathLayerMaskBuffer);
+    glBufferData(GL_SHADER_STORAGE_BUFFER, masks.size() * sizeof(std::uint32_t), masks.data(), GL_STATIC_DRAW);
+}
+
+void SimulationEngine::compositePathLayers()
+{
+    glMemoryBarrier(GL_SHADER_IMAGE_ACCESS_BARRIER_BIT);
+    glBindImageTexture(m_simulationTexture->getTextureUnit(), m_simulationTexture->getHandle(), 0, GL_FALSE, 0, GL_READ_WRITE, GL_RGBA32F);
+    glBindImageTexture(m_compositeTexture->getTextureUnit(), m_compositeTexture->getHandle(), 0, GL_FALSE, 0, GL_READ_WRITE, GL_RGBA32F);
+    glBindImageTexture(6, m_pathLayerTexture, 0, GL_TRUE, 0, GL_READ_WRITE, GL_RGBA32F);
+
+    m_pathLayerShader->bind();
+    m_pathLayerShader->setUniformValue("pathLayerCount", static_cast<int>(m_pathFilters.size()));
+    m_pathLayerShader->setUniformValue("visiblePathLayers", static_cast<int>(m_visiblePathLayers));
+    m_pathLayerShader->setUniformValue("otherRaysVisible", m_otherRaysVisible ? 1 : 0);
+    glDispatchCompute((m_outputWidth + 15) / 16, (m_outputHeight + 15) / 16, 1);
+
+    m_compositingPathLayers = true;
+}
+
+void SimulationEngine::setSunConvolutionEnabled(bool enabled)
+{
+    if (m_sunConvolutionEnabled == enabled) return;
+
+    reset();
+    m_sunConvolutionEnabled = enabled;
+    if (!enabled && m_sunConvolutionGridTexture != 0)
+    {
+        glDeleteTextures(1, &m_sunConvolutionGridTexture);
+        glDeleteTextures(1, &m_sunConvolutionTexture);
+        m_sunConvolutionGridTexture = 0;
+        m_sunConvolutionTexture = 0;
+        m_sunConvolutionGridLayers = 0;
+    }
+
+    emit sunConvolutionEnabledChanged(m_sunConvolutionEnabled);
+}
+
+bool SimulationEngine::isSunConvolutionEnabled() const
+{
+    return m_sunConvolutionEnabled;
+}
+
+bool SimulationEngine::usesSunConvolution() const
+{
+    /* Convolved light is not split by path, composited into output views
+    or traced in monochrome, and large suns do not fit in the kernels */
+    return m_sunConvolutionEnabled && !usesPathLayers() && !usesOutputViews() && !m_monochrome && m_light.diameter <= SunConvolution::maxSunDiameter;
+}
+
+void SimulationEngine::initializeSunConvolutionGrid()
+{
+    if (m_sunConvolutionGridTexture != 0)
+        glDeleteTextures(1, &m_sunConvolutionGridTexture);
+
+    const auto gridSize = static_cast<int>(SunConvolution::gridSize);
+    m_sunConvolutionGridLayers = m_crystalRepository->getCount();
+    glGenTextures(1, &m_sunConvolutionGridTexture);
+    glBindTexture(GL_TEXTURE_2D_ARRAY, m_sunConvolutionGridTexture);
+    glTexStorage3D(GL_TEXTURE_2D_ARRAY, 1, GL_RGBA32F, gridSize, gridSize, static_cast<int>(m_sunConvolutionGridLayers));
+    glClearTexImage(m_sunConvolutionGridTexture, 0, GL_RGBA, GL_FLOAT, NULL);
+
+    if (m_sunConvolutionTexture == 0)
+    {
+        glGenTextures(1, &m_sunConvolutionTexture);
+        glActiveTexture(GL_TEXTURE7);
+        glBindTexture(GL_TEXTURE_2D, m_sunConvolutionTexture);
+        glTexStorage2D(GL_TEXTURE_2D, 1, GL_RGBA32F, gridSize, gridSize);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        // Nothing is blurred beyond the grid
+        const float borderColor[] = {0.0f, 0.0f, 0.0f, 0.0f};
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_BORDER);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_BORDER);
+        glTexParameterfv(GL_TEXTURE_2D, GL_TEXTURE_BORDER_COLOR, borderColor);
+    }
+    m_sunConvolutionIteration = 0;
+}
+
+void SimulationEngine::convolveSunConvolutionGrid()
+{
+    // The sun only changes when the simulation is cleared
+    if (m_sunConvolutionIteration == 0)
+    {
+        auto skyState = SkyModel::Create(degToRad(m_light.altitude), m_atmosphere.turbidity, m_atmosphere.groundAlbedo, degToRad(m_light.diameter / 2.0));
+        /* Limb darkening is given for CIE XYZ by the sky model, which is
+        close enough to use for the red, green and blue channels */
+        std::copy(skyState.limbDarkeningScaler, skyState.limbDarkeningScaler + 3, m_limbDarkeningScaler);
+    }
+
+    std::vector<float> crystalSizes;
+    for (auto i = 0u; i < m_sunConvolutionGridLayers; ++i)
+        crystalSizes.push_back(m_crystalRepository->get(i).crystalSize);
+    m_sunConvolution.setKernels(m_light.diameter, m_limbDarkeningScaler, crystalSizes);
+
+    const auto gridSize = static_cast<int>(SunConvolution::gridSize);
+    std::vector<float> grids(static_cast<std::size_t>(gridSize) * gridSize * 4 * m_sunConvolutionGridLayers);
+    glMemoryBarrier(GL_TEXTURE_UPDATE_BARRIER_BIT);
+    glBindTexture(GL_TEXTURE_2D_ARRAY, m_sunConvolutionGridTexture);
+    glGetTexImage(GL_TEXTURE_2D_ARRAY, 0, GL_RGBA, GL_FLOAT, grids.data());
+
+    auto convolved = m_sunConvolution.convolve(grids);
+    glActiveTexture(GL_TEXTURE7);
+    glBindTexture(GL_TEXTURE_2D, m_sunConvolutionTexture);
+    glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, gridSize, gridSize, GL_RGBA, GL_FLOAT, convolved.data());
+
+    m_sunConvolutionIteration = m_iteration;
+}
+
+void SimulationEngine::compositeSunConvolution()
+{
+    if (m_sunConvolutionIteration == 0)
+        return;
+
+    glMemoryBarrier(GL_SHADER_IMAGE_ACCESS_BARRIER_BIT | GL_TEXTURE_FETCH_BARRIER_BIT);
+    glBindImageTexture(m_simulationTexture->getTextureUnit(), m_simulationTexture->getHandle(), 0, GL_FALSE, 0, GL_READ_WRITE, GL_RGBA32F);
+    glBindImageTexture(m_compositeTexture->getTextureUnit(), m_compositeTexture->getHandle(), 0, GL_FALSE, 0, GL_READ_WRITE, GL_RGBA32F);
+    glActiveTexture(GL_TEXTURE7);
+    glBindTexture(GL_TEXTURE_2D, m_sunConvolutionTexture);
+
+    m_sunConvolutionShader->bind();
+    m_sunConvolutionShader->setUniformValue("rayCountScale", static_cast<float>(m_iteration) / m_sunConvolutionIteration);
+    m_sunConvolutionShader->setUniformValue("sun.altitude", degToRad(m_light.altitude));
+    m_sunConvolutionShader->setUniformValue("camera.pitch", degToRad(m_camera.pitch));
+    m_sunConvolutionShader->setUniformValue("camera.yaw", degToRad(m_camera.yaw));
+    m_sunConvolutionShader->setUniformValue("camera.focalLength", m_camera.getFocalLength());
+    m_sunConvolutionShader->setUniformValue("camera.projection", m_camera.projection);
+    m_sunConvolutionShader->setUniformValue("camera.hideSubHorizon", m_camera.hideSubHorizon ? 1 : 0);
+    glDispatchCompute((m_outputWidth + 15) / 16, (m_outputHeight + 15) / 16, 1);
+
+    m_compositingSunConvolution = true;
+}
+
+void SimulationEngine::setPathGuidingEnabled(bool enabled)
+{
+    if (m_pathGuidingEnabled == enabled) return;
+
+    reset();
+    m_pathGuidingEnabled = enabled;
+    if (!enabled && m_pathGuideCdfBuffer != 0)
+    {
+        glDeleteBuffers(1, &m_pathGuideCdfBuffer);
+        glDeleteBuffers(1, &m_pathGuideCounterBuffer);
+        m_pathGuideCdfBuffer = 0;
+        m_pathGuideCounterBuffer = 0;
+        m_pathGuidePopulationCount = 0;
+    }
+
+    emit pathGuidingEnabledChanged(m_pathGuidingEnabled);
+}
+
+bool SimulationEngine::isPathGuidingEnabled() const
+{
+    return m_pathGuidingEnabled;
+}
+
+bool SimulationEngine::usesPathGuiding() const
+{
+    return m_pathGuidingEnabled;
+}
+
+void SimulationEngine::initializePathGuide()
+{
+    if (m_pathGuideCdfBuffer == 0)
+    {
+        glGenBuffers(1, &m_pathGuideCdfBuffer);
+        glGenBuffers(1, &m_pathGuideCounterBuffer);
+    }
+
+    m_pathGuidePopulationCount = m_crystalRepository->getCount();
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, m_pathGuideCdfBuffer);
+    glBufferData(GL_SHADER_STORAGE_BUFFER, static_cast<std::size_t>(m_pathGuidePopulationCount) * PathGuide::cellCount * sizeof(float), NULL, GL_DYNAMIC_DRAW);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, m_pathGuideCounterBuffer);
+    glBufferData(GL_SHADER_STORAGE_BUFFER, static_cast<std::size_t>(m_pathGuidePopulationCount) * PathGuide::cellCount * PathGuide::countersPerCell * sizeof(unsigned int), NULL, GL_DYNAMIC_READ);
+    clearPathGuide();
+}
+
+void SimulationEngine::clearPathGuide()
+{
+    glMemoryBarrier(GL_BUFFER_UPDATE_BARRIER_BIT);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, m_pathGuideCounterBuffer);
+    glClearBufferData(GL_SHADER_STORAGE_BUFFER, GL_R32UI, GL_RED_INTEGER, GL_UNSIGNED_INT, NULL);
+
+    // Rays are traced uniformly until something has been learned
+    auto uniformCdf = PathGuide::createUniformCdf();
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, m_pathGuideCdfBuffer);
+    for (auto i = 0u; i < m_pathGuidePopulationCount; ++i)
+        glBufferSubData(GL_SHADER_STORAGE_BUFFER, i * uniformCdf.size() * sizeof(float), uniformCdf.size() * sizeof(float), uniformCdf.data());
+}
+
+void SimulationEngine::updatePathGuide()
+{
+    const auto countersPerPopulation = static_cast<std::size_t>(PathGuide::cellCount) * PathGuide::countersPerCell;
+    std::vector<std::uint32_t> counters(countersPerPopulation * m_pathGuidePopulationCount);
+    glMemoryBarrier(GL_BUFFER_UPDATE_BARRIER_BIT);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, m_pathGuideCounterBuffer);
+    glGetBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, counters.size() * sizeof(std::uint32_t), counters.data());
+
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, m_pathGuideCdfBuffer);
+    for (auto i = 0u; i < m_pathGuidePopulationCount; ++i)
+    {
+        auto cdf = PathGuide::createCdf(counters.data() + i * countersPerPopulation);
+        glBufferSubData(GL_SHADER_STORAGE_BUFFER, i * cdf.size() * sizeof(float), cdf.size() * sizeof(float), cdf.data());
+    }
+}
+
+void SimulationEngine::setAdaptiveRayAllocationEnabled(bool enabled)
+{
+    if (m_adaptiveRayAllocationEnabled == enabled) return;
+
+    reset();
+    m_adaptiveRayAllocationEnabled = enabled;
+    if (!enabled && m_rayMomentBuffer != 0)
+    {
+        glDeleteBuffers(1, &m_rayMomentBuffer);
+        m_rayMomentBuffer = 0;
+        m_rayMomentPopulationCount = 0;
+        m_rayMomentRayCounts.clear();
+    }
+
+    emit adaptiveRayAllocationEnabledChanged(m_adaptiveRayAllocationEnabled);
+}
+
+bool SimulationEngine::isAdaptiveRayAllocationEnabled() const
+{
+    return m_adaptiveRayAllocationEnabled;
+}
+
+double SimulationEngine::getRayShare(unsigned int populationIndex) const
+{
+    if (usesAdaptiveRayAllocation() && populationIndex < m_rayShares.size())
+        return m_rayShares[populationIndex];
+    return m_crystalRepository->getProbability(populationIndex);
+}
+
+bool SimulationEngine::usesAdaptiveRayAllocation() const
+{
+    // Stored samples are reweighted assuming that every ray of a population has the same weight
+    return m_adaptiveRayAllocationEnabled && !usesSampleRecording();
+}
+
+void SimulationEngine::initializeRayMomentBuffer()
+{
+    if (m_rayMomentBuffer == 0)
+        glGenBuffers(1, &m_rayMomentBuffer);
+
+    m_rayMomentPopulationCount = m_crystalRepository->getCount();
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, m_rayMomentBuffer);
+    glBufferData(GL_SHADER_STORAGE_BUFFER, m_rayMomentPopulationCount * RayAllocation::slotsPerPopulation * RayAllocation::countersPerSlot * sizeof(unsigned int), NULL, GL_DYNAMIC_READ);
+    clearRayMoments();
+    m_rayShares.clear();
+}
+
+void SimulationEngine::clearRayMoments()
+{
+    glMemoryBarrier(GL_BUFFER_UPDATE_BARRIER_BIT);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, m_rayMomentBuffer);
+    glClearBufferData(GL_SHADER_STORAGE_BUFFER, GL_R32UI, GL_RED_INTEGER, GL_UNSIGNED_INT, NULL);
+    m_rayMomentRayCounts.assign(m_rayMomentPopulationCount, 0.0);
+}
+
+void SimulationEngine::updateRayAllocation()
+{
+    const auto countersPerPopulation = RayAllocation::slotsPerPopulation * RayAllocation::countersPerSlot;
+    std::vector<std::uint32_t> counters(countersPerPopulation * m_rayMomentPopulationCount);
+    glMemoryBarrier(GL_BUFFER_UPDATE_BARRIER_BIT);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, m_rayMomentBuffer);
+    glGetBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, counters.size() * sizeof(std::uint32_t), counters.data());
+
+    std::vector<double> probabilities;
+    std::vector<double> secondMoments;
+    std::vector<bool> adaptive;
+    for (auto i = 0u; i < m_rayMomentPopulationCount; ++i)
+    {
+        probabilities.push_back(m_crystalRepository->getProbability(i));
+        auto rayCount = m_rayMomentRayCounts[i];
+        secondMoments.push_back(rayCount > 0.0 ? RayAllocation::getMomentSum(counters.data() + i * countersPerPopulation) / rayCount : 0.0);
+        // The phase function counts all rays of randomly oriented populations, wherever they go
+        adaptive.push_back(!usesPhaseFunction(i));
+    }
+    m_rayShares = RayAllocation::allocate(probabilities, secondMoments, adaptive);
+    if (m_hybridTracer && m_hybridTracer->isBusy())
+        m_cpuBatchStale = true;
+}
+
+void SimulationEngine::logPathLengthStatistics()
+{
+    for (auto i = 0u; i < std::min(m_crystalRepository->getCount(), m_pathLengthBufferPopulationCount); ++i)
+    {
+        auto histogram = getPathLengthHistogram(i);
+        qInfo("Path lengths of population \"%s\": %u escaped, mean %.2f, median %u, 99th percentile %u, %u terminated by Russian roulette, %u trapped in orbits, %u reached maximum",
+              m_crystalRepository->getName(i).c_str(),
+              histogram.getEscapedCount(),
+              histogram.getMeanPathLength(),
+              histogram.getPathLengthPercentile(0.5),
+              histogram.getPathLengthPercentile(0.99),
+              histogram.terminatedByRussianRoulette,
+              histogram.trappedInOrbit,
+              histogram.reachedMaxHits);
+    }
+}
+
+void SimulationEngine::setWavefrontTracingEnabled(bool enabled)
+{
+    if (m_wavefrontTracingEnabled == enabled) return;
+
+    reset();
+    m_wavefrontTracingEnabled = enabled;
+    if (!enabled)
+        deleteWavefrontBuffers();
+
+    emit wavefrontTracingEnabledChanged(m_wavefrontTracingEnabled);
+}
+
+bool SimulationEngine::isWavefrontTracingEnabled() const
+{
+    return m_wavefrontTracingEnabled;
+}
+
+bool SimulationEngine::usesWavefront(int traceMode) const
+{
+    // Transfer tables replace tracing inside crystals altogether
+    return m_wavefrontTracingEnabled && traceMode == TraceModeDirect;
+}
+
+void SimulationEngine::initializeWavefrontBuffers()
+{
+    /* Queues hold every ray of a dispatch up to a limit, and rays that do
+    not fit are traced to the end by the stage that tried to queue them */
+    auto capacity = std::min(std::max(m_raysPerStep, m_continuationCapacity), (unsigned int)Wavefront::maxQueuedRays);
+    m_wavefrontCapacity = std::max((capacity + 63) / 64 * 64, 64u);
+
+    auto bounceBufferSize = static_cast<std::size_t>(Wavefront::getBounceQueueSize(m_wavefrontCapacity)) * sizeof(unsigned int);
+    for (auto &buffer : m_wavefrontBounceBuffers)
+    {
+        if (buffer == 0)
+            glGenBuffers(1, &buffer);
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, buffer);
+        glBufferData(GL_SHADER_STORAGE_BUFFER, bounceBufferSize, NULL, GL_DYNAMIC_COPY);
+    }
+
+    if (m_wavefrontEscapeBuffer == 0)
+        glGenBuffers(1, &m_wavefrontEscapeBuffer);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, m_wavefrontEscapeBuffer);
+    glBufferData(GL_SHADER_STORAGE_BUFFER, static_cast<std::size_t>(Wavefront::getEscapeQueueSize(m_wavefrontCapacity)) * sizeof(unsigned int), NULL, GL_DYNAMIC_COPY);
+
+    m_simulationShader->bind();
+    glUniform1ui(glGetUniformLocation(m_simulationShader->programId(), "wavefrontCapacity"), m_wavefrontCapacity);
+}
+
+void SimulationEngine::deleteWavefrontBuffers()
+{
+    glDeleteBuffers(2, m_wavefrontBounceBuffers);
+    m_wavefrontBounceBuffers[0] = 0;
+    m_wavefrontBounceBuffers[1] = 0;
+    if (m_wavefrontEscapeBuffer != 0)
+        glDeleteBuffers(1, &m_wavefrontEscapeBuffer);
+    m_wavefrontEscapeBuffer = 0;
+    m_wavefrontCapacity = 0;
+}
+
+void SimulationEngine::startWavefrontQueues()
+{
+    const unsigned int emptyHeader[Wavefront::headerSize] = {0, 1, 1, 0};
+    glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT | GL_COMMAND_BARRIER_BIT);
+    for (auto buffer : {m_wavefrontBounceBuffers[0], m_wavefrontEscapeBuffer})
+    {
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, buffer);
+        glClearBufferSubData(GL_SHADER_STORAGE_BUFFER, GL_RGBA32UI, 0, Wavefront::headerSize * sizeof(unsigned int),
+                             GL_RGBA_INTEGER, GL_UNSIGNED_INT, emptyHeader);
+    }
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 19, m_wavefrontBounceBuffers[0]);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 20, m_wavefrontEscapeBuffer);
+}
+
+void SimulationEngine::traceWavefront()
+{
+    /* Each bounce stage traces the rays queued by the previous stage and
+    queues the ones still inside crystals into the other buffer. Queue
+    lengths are only known on the GPU, so every stage is dispatched
+    indirectly, and empty queues dispatch no work groups. */
+    m_simulationShader->setUniformValue("wavefrontStage", static_cast<int>(Wavefront::StageBounce));
+    for (auto pass = 0u; pass < Wavefront::bouncePassCount; ++pass)
+    {
+        const unsigned int emptyHeader[Wavefront::headerSize] = {0, 1, 1, 0};
+        std::swap(m_wavefrontBounceBuffers[0], m_wavefrontBounceBuffers[1]);
+        glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT | GL_COMMAND_BARRIER_BIT | GL_SHADER_IMAGE_ACCESS_BARRIER_BIT);
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, m_wavefrontBounceBuffers[0]);
+        glClearBufferSubData(GL_SHADER_STORAGE_BUFFER, GL_RGBA32UI, 0, Wavefront::headerSize * sizeof(unsigned int),
+                             GL_RGBA_INTEGER, GL_UNSIGNED_INT, emptyHeader);
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 18, m_wavefrontBounceBuffers[1]);
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 19, m_wavefrontBounceBuffers[0]);
+        glBindBuffer(GL_DISPATCH_INDIRECT_BUFFER, m_wavefrontBounceBuffers[1]);
+        glDispatchComputeIndirect(0);
+    }
+
+    // The last bounce stage traces up to the hit limit, so no rays are left inside crystals
+    glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT | GL_COMMAND_BARRIER_BIT | GL_SHADER_IMAGE_ACCESS_BARRIER_BIT);
+    m_simulationShader->setUniformValue("wavefrontStage", static_cast<int>(Wavefront::StageSplat));
+    glBindBuffer(GL_DISPATCH_INDIRECT_BUFFER, m_wavefrontEscapeBuffer);
+    glDispatchComputeIndirect(0);
+
+    glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT | GL_SHADER_IMAGE_ACCESS_BARRIER_BIT);
+    m_simulationShader->setUniformValue("wavefrontStage", static_cast<int>(Wavefront::StageGenerate));
+}
+
+void SimulationEngine::setHybridTracingEnabled(bool enabled)
+{
+    if (m_hybridTracingEnabled == enabled) return;
+
+    reset();
+    m_hybridTracingEnabled = enabled;
+    if (!enabled)
+    {
+        m_hybridTracer.reset();
+        m_cpuBatchStale = false;
+        m_throughputBalancer.reset();
+        if (m_cpuSplatBuffer != 0)
+            glDeleteBuffers(1, &m_cpuSplatBuffer);
+        m_cpuSplatBuffer = 0;
+        m_cpuRayShare = 0.0;
+    }
+
+    emit hybridTracingEnabledChanged(m_hybridTracingEnabled);
+}
+
+bool SimulationEngine::isHybridTracingEnabled() const
+{
+    return m_hybridTracingEnabled;
+}
+
+double SimulationEngine::getGpuRaysPerSecond() const
+{
+    return m_throughputBalancer.getGpuRaysPerSecond();
+}
+
+double SimulationEngine::getCpuRaysPerSecond() const
+{
+    return m_throughputBalancer.getCpuRaysPerSecond();
+}
+
+double SimulationEngine::getCpuRayShare() const
+{
+    return m_cpuRayShare;
+}
+
+bool SimulationEngine::usesHybridTracing() const
+{
+    /* The CPU only brings the light of each ray to its pixel, so features
+    that need more from the rays, or other results of the shader, are
+    traced on the GPU alone. The CPU also only traces in color. */
+    return m_hybridTracingEnabled && !usesContinuations() && !usesTransferTable() && !usesSampleRecording() && !usesPathLayers() &&
+           !usesSunConvolution() && !usesPathGuiding() && !usesAdaptiveRayAllocation() && !usesOutputViews() && !m_rayDumpWriter &&
+           !m_pathLengthStatisticsEnabled && !m_monochrome;
+}
+
+bool SimulationEngine::usesHybridTracing(unsigned int populationIndex) const
+{
+    const auto &crystals = m_crystalRepository->get(populationIndex);
+    for (auto parameter = 0; parameter < NUM_TABULATED_PARAMETERS; ++parameter)
+    {
+        if (crystals.usesTable(static_cast<TabulatedParameter>(parameter)))
+            return false;
+    }
+    return usesHybridTracing() && !usesPhaseFunction(populationIndex) && crystals.customShape.isEmpty();
+}
+
+Kernels::SceneSettings SimulationEngine::getSceneSettings(unsigned int populationIndex) const
+{
+    // These must match the uniforms of the raytracing shader
+    Kernels::SceneSettings settings;
+    settings.sun.altitude = degToRad(m_light.altitude);
+    settings.sun.diameter = degToRad(m_light.diameter);
+    settings.sun.useSpectrum = m_atmosphere.enabled;
+    std::copy(m_sunSpectrumCache, m_sunSpectrumCache + 31, settings.sun.spectrum);
+
+    settings.camera.pitch = degToRad(m_camera.pitch);
+    settings.camera.yaw = degToRad(m_camera.yaw);
+    settings.camera.focalLength = m_camera.getFocalLength();
+    settings.camera.projection = m_camera.projection;
+    settings.camera.hideSubHorizon = m_camera.hideSubHorizon;
+    settings.camera.width = m_outputWidth;
+    settings.camera.height = m_outputHeight;
+    settings.camera.splatFilter = m_splatFilter;
+
+    // Populations with tables are not traced on the CPU, so tabulated distributions fall back to uniform ones
+    const auto &crystals = m_crystalRepository->get(populationIndex);
+    settings.crystals.tiltDistribution = crystals.tiltDistribution == Gaussian ? Kernels::SceneCrystals::Gaussian : Kernels::SceneCrystals::Uniform;
+    settings.crystals.tiltAverage = degToRad(crystals.tiltAverage);
+    settings.crystals.tiltStd = degToRad(crystals.tiltStd);
+    settings.crystals.rotationDistribution = crystals.rotationDistribution == Gaussian ? Kernels::SceneCrystals::Gaussian : Kernels::SceneCrystals::Uniform;
+    settings.crystals.rotationAverage = degToRad(crystals.rotationAverage);
+    settings.crystals.rotationStd = degToRad(crystals.rotationStd);
+    settings.crystals.caRatioAverage = crystals.caRatioAverage;
+    settings.crystals.caRatioStd = crystals.caRatioStd;
+    settings.crystals.upperApexAngle = degToRad(crystals.upperApexAngle);
+    settings.crystals.upperApexHeightAverage = crystals.upperApexHeightAverage;
+    settings.crystals.upperApexHeightStd = crystals.upperApexHeightStd;
+    settings.crystals.lowerApexAngle = degToRad(crystals.lowerApexAngle);
+    settings.crystals.lowerApexHeightAverage = crystals.lowerApexHeightAverage;
+    settings.crystals.lowerApexHeightStd = crystals.lowerApexHeightStd;
+    std::copy(crystals.prismFaceDistances, crystals.prismFaceDistances + 6, settings.crystals.prismFaceDistances);
+
+    auto share = getRayShare(populationIndex);
+    settings.crystals.weight = share <= 0.0 ? 1.0f : static_cast<float>(m_crystalRepository->getProbability(populationIndex) / share);
+
+    settings.trace.russianRouletteDepth = m_russianRouletteDepth;
+    // Rays get the same random numbers as with the same indices in the shader
+    settings.trace.seed = m_runSeed;
+    settings.trace.populationIndex = populationIndex;
+    settings.sobolDirections = m_quasiRandomSampling ? SobolSequence::getDirectionNumbers().data() : nullptr;
+    return settings;
+}
+
+void SimulationEngine::startHybridTracing()
+{
+    if (!m_hybridTracer)
+        m_hybridTracer = std::make_unique<HybridTracer>();
+    if (m_gpuTimerQuery == 0)
+        glGenQueries(1, &m_gpuTimerQuery);
+
+    measureGpuThroughput();
+    auto cpuShare = m_throughputBalancer.getCpuShare();
+
+    m_cpuBatchRays.assign(m_crystalRepository->getCount(), 0);
+    std::vector<HybridTracerTask> tasks;
+    for (auto i = 0u; i < m_crystalRepository->getCount(); ++i)
+    {
+        if (!usesHybridTracing(i))
+            continue;
+
+        // The CPU takes whole work groups, so that the frame it is merged in has as many rays as on the GPU alone
+        auto cpuRays = static_cast<unsigned int>(static_cast<unsigned int>(m_raysPerStep * getRayShare(i)) * cpuShare) / 64 * 64;
+        if (cpuRays == 0)
+            continue;
+
+        /* The CPU takes the next ray indices of the population, and the GPU
+        continues after them, so that every ray is traced once no matter how
+        the rays are split */
+        tasks.push_back({getSceneSettings(i), m_rayIndexOffsets[i], cpuRays});
+        m_rayIndexOffsets[i] += cpuRays;
+        m_cpuBatchRays[i] = cpuRays;
+    }
+
+    m_hybridTracer->start(std::move(tasks));
+}
+
+void SimulationEngine::measureGpuThroughput()
+{
+    if (!m_gpuTimerPending)
+        return;
+
+    // The result of an earlier frame is used only once it is ready, so that the GPU is not waited for
+    GLint available = 0;
+    glGetQueryObjectiv(m_gpuTimerQuery, GL_QUERY_RESULT_AVAILABLE, &available);
+    if (!available)
+        return;
+
+    GLuint64 elapsedNanoseconds = 0;
+    glGetQueryObjectui64v(m_gpuTimerQuery, GL_QUERY_RESULT, &elapsedNanoseconds);
+    m_gpuTimerPending = false;
+    m_throughputBalancer.addGpuMeasurement(m_gpuTimedRayCount, elapsedNanoseconds * 1.0e-9);
+}
+
+/* Merges the batch of CPU rays started on an earlier frame if it has
+   finished, and takes its rays out of the rays left for the GPU. Returns
+   the number of rays merged. The CPU is never waited for, so it traces
+   while the GPU traces the frames in between. */
+unsigned int SimulationEngine::mergeCpuSplats(std::vector<unsigned int> &gpuRays)
+{
+    if (!m_hybridTracer || !m_hybridTracer->isBusy() || !m_hybridTracer->isFinished())
+        return 0;
+
+    const auto &splats = m_hybridTracer->wait();
+    m_throughputBalancer.addCpuMeasurement(static_cast<double>(m_hybridTracer->getLastRayCount()), m_hybridTracer->getLastSeconds());
+
+    // Rays weighted for a cleared image or for other ray shares are dropped
+    if (m_cpuBatchStale || m_cpuBatchRays.size() != gpuRays.size())
+    {
+        m_cpuBatchStale = false;
+        return 0;
+    }
+
+    auto cpuRayCount = 0u;
+    for (auto i = 0u; i < gpuRays.size(); ++i)
+    {
+        gpuRays[i] -= m_cpuBatchRays[i];
+        cpuRayCount += m_cpuBatchRays[i];
+    }
+    if (splats.empty())
+        return cpuRayCount;
+
+    /* The buffer is orphaned before every upload, so that the driver gives
+    it new storage instead of waiting for the previous merge to read it */
+    if (m_cpuSplatBuffer == 0)
+        glGenBuffers(1, &m_cpuSplatBuffer);
+    auto size = splats.size() * sizeof(Kernels::Splat);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, m_cpuSplatBuffer);
+    glBufferData(GL_SHADER_STORAGE_BUFFER, size, NULL, GL_STREAM_DRAW);
+    glBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, size, splats.data());
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 21, m_cpuSplatBuffer);
+
+    auto splatCount = static_cast<unsigned int>(splats.size());
+    m_cpuSplatShader->bind();
+    glUniform1ui(glGetUniformLocation(m_cpuSplatShader->programId(), "splatCount"), splatCount);
+
+    // The number of work groups in a single dispatch is limited
+    const auto maxGroups = 65535u;
+    for (auto offset = 0u; offset < splatCount; offset += maxGroups * 64)
+    {
+        glUniform1ui(glGetUniformLocation(m_cpuSplatShader->programId(), "splatOffset"), offset);
+        glMemoryBarrier(GL_SHADER_IMAGE_ACCESS_BARRIER_BIT);
+        glDispatchCompute(std::min((splatCount - offset + 63) / 64, maxGroups), 1, 1);
+    }
+    m_simulationShader->bind();
+    return cpuRayCount;
+}
+
+void SimulationEngine::setOutputViews(std::vector<OutputView> views)
+{
+    if (views.size() > maxOutputViews)
+        throw std::runtime_error("At most " + std::to_string(maxOutputViews) + " output views are supported");
+    for (const auto &view : views)
+    {
+        if (!view.isValid())
+            throw std::runtime_error("Output view sizes must be between 1 and " + std::to_string(OutputView::maxSize) + " pixels");
+    }
+    if (views == m_outputViews) return;
+
+    reset();
+    m_outputViews = std::move(views);
+    if (m_initialized)
+        initializeOutputViews();
+
+    emit outputViewsChanged();
+}
+
+const std::vector<OutputView> &SimulationEngine::getOutputViews() const
+{
+    return m_outputViews;
+}
+
+std::vector<float> SimulationEngine::getOutputViewImage(unsigned int viewIndex)
+{
+    if (viewIndex >= m_outputViews.size() || m_outputViewTexture == 0)
+        throw std::runtime_error("No output view " + std::to_string(viewIndex));
+
+    /* All views share one texture as large as the largest of them. Only
+    the part of the layer covered by the view is copied out and read back,
+    as glGetTextureSubImage needs OpenGL 4.5. */
+    const auto &view = m_outputViews[viewIndex];
+    unsigned int viewTexture;
+    glGenTextures(1, &viewTexture);
+    glBindTexture(GL_TEXTURE_2D, viewTexture);
+    glTexStorage2D(GL_TEXTURE_2D, 1, GL_RGBA32F, view.width, view.height);
+    glMemoryBarrier(GL_TEXTURE_UPDATE_BARRIER_BIT);
+    glCopyImageSubData(m_outputViewTexture, GL_TEXTURE_2D_ARRAY, 0, 0, 0, viewIndex,
+                       viewTexture, GL_TEXTURE_2D, 0, 0, 0, 0,
+                       view.width, view.height, 1);
+
+    std::vector<float> image(static_cast<std::size_t>(view.width) * view.height * 4);
+    glGetTexImage(GL_TEXTURE_2D, 0, GL_RGBA, GL_FLOAT, image.data());
+    glDeleteTextures(1, &viewTexture);
+    return image;
+}
+
+bool SimulationEngine::usesOutputViews() const
+{
+    return !m_outputViews.empty();
+}
+
+void SimulationEngine::initializeOutputViews()
+{
+    if (m_outputViewTexture != 0)
+    {
+        unsigned int textures[] = {m_outputViewTexture, m_outputViewStepTexture, m_outputViewErrorTexture};
+        glDeleteTextures(3, textures);
+        m_outputViewTexture = 0;
+        m_outputViewStepTexture = 0;
+        m_outputViewErrorTexture = 0;
+    }
+    m_outputViewTextureWidth = 0;
+    m_outputViewTextureHeight = 0;
+
+    if (!usesOutputViews())
+        return;
+
+    for (const auto &view : m_outputViews)
+    {
+        m_outputViewTextureWidth = std::max(m_outputViewTextureWidth, view.width);
+        m_outputViewTextureHeight = std::max(m_outputViewTextureHeight, view.height);
+    }
+
+    const auto viewCount = static_cast<unsigned int>(m_outputViews.size());
+    m_outputViewTexture = createTextureArray(m_outputViewTextureWidth, m_outputViewTextureHeight, viewCount);
+    m_outputViewStepTexture = createTextureArray(m_outputViewTextureWidth, m_outputViewTextureHeight, viewCount);
+    m_outputViewErrorTexture = createTextureArray(m_outputViewTextureWidth, m_outputViewTextureHeight, viewCount);
+}
+
+void SimulationEngine::setSplatFilter(Kernels::SplatFilter filter)
+{
+    if (filter.type < Kernels::SplatFilter::Box || filter.type > Kernels::SplatFilter::Gaussian)
+        throw std::runtime_error("Unknown splat filter " + std::to_string(filter.type));
+    filter.radius = std::clamp(filter.radius, Kernels::SplatFilter::minRadius, Kernels::SplatFilter::maxRadius);
+    if (m_splatFilter.type == filter.type && m_splatFilter.radius == filter.radius) return;
+
+    clear();
+    m_splatFilter = filter;
+
+    emit splatFilterChanged();
+}
+
+Kernels::SplatFilter SimulationEngine::getSplatFilter() const
+{
+    return m_splatFilter;
+}
+
+void SimulationEngine::setMonochrome(bool monochrome)
+{
+    if (m_monochrome == monochrome) return;
+
+    m_monochrome = monochrome;
+    if (m_monochrome)
+        m_monochromeTexture = std::make_unique<OpenGL::Texture>(m_outputWidth, m_outputHeight, 1, OpenGL::TextureType::Monochrome);
+    else
+        m_monochromeTexture.reset();
+    reset();
+
+    emit monochromeChanged(m_monochrome);
+}
+
+bool SimulationEngine::isMonochrome() const
+{
+    return m_monochrome;
 }
 
 }
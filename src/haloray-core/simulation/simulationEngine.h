@@ -1,6 +1,11 @@
 #pragma once
-#include <random>
 #include <memory>
+#include <vector>
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <utility>
+#include <initializer_list>
 #include <QObject>
 #include <QOpenGLFunctions_4_4_Core>
 #include <QOpenGLShaderProgram>
@@ -8,8 +13,19 @@
 #include "camera.h"
 #include "atmosphere.h"
 #include "lightSource.h"
+#include "outputView.h"
 #include "crystalPopulation.h"
 #include "crystalPopulationRepository.h"
+#include "hybridTracer.h"
+#include "invalidationTracker.h"
+#include "pathFilter.h"
+#include "pathLengthHistogram.h"
+#include "rayDump.h"
+#include "sampleReweighting.h"
+#include "scatteringTable.h"
+#include "skyModel.h"
+#include "sunConvolution.h"
+#include "throughputBalancer.h"
 
 namespace HaloRay
 {
@@ -25,7 +41,19 @@ public:
     void stop();
     bool isRunning() const;
 
+    /* Clears the traced image. The phase function of randomly oriented
+       populations does not depend on the camera or the sun altitude, so
+       it is kept. */
     void clear();
+    // Clears the traced image and the phase function
+    void reset();
+
+    /* Batches changes to the simulation, so that it is cleared or reset at
+       most once when the outermost batch ends, instead of on every change.
+       Batches can be nested. No rays are traced while a batch is open. */
+    void beginUpdate();
+    void endUpdate();
+    bool isUpdating() const;
 
     unsigned int getIteration() const;
 
@@ -46,8 +74,156 @@ public:
     void setMultipleScatteringProbability(double);
     double getMultipleScatteringProbability() const;
 
+    void setRussianRouletteDepth(int depth);
+    int getRussianRouletteDepth() const;
+
+    /* Rays scatter again with the multiple scattering probability until
+       they have been scattered by this many crystals. Each scattering
+       event picks the crystal population by weight. */
+    static const int scatteringOrderLimit = 8;
+    void setMaxScatteringOrders(int orders);
+    int getMaxScatteringOrders() const;
+
+    void setPathLengthStatisticsEnabled(bool enabled);
+    bool isPathLengthStatisticsEnabled() const;
+    PathLengthHistogram getPathLengthHistogram(unsigned int populationIndex);
+
+    void setQuasiRandomSampling(bool enabled);
+    bool isQuasiRandomSampling() const;
+
+    void setRunSeed(unsigned int seed);
+    unsigned int getRunSeed() const;
+
+    /* Samples crystal populations from transfer tables of their shapes
+       instead of tracing each ray through the crystal. Tables are kept
+       when only the orientation distributions change. */
+    void setTransferTablesEnabled(bool enabled);
+    bool isTransferTablesEnabled() const;
+
+    /* Stores traced rays with the crystal parameters they were sampled
+       with, so that small changes to Gaussian parameter distributions can
+       be applied to the image without tracing it again */
+    void setSampleReweightingEnabled(bool enabled);
+    bool isSampleReweightingEnabled() const;
+
+    /* Rebuilds the image from the stored rays for the current crystal
+       populations. Returns false if the changes cannot be applied by
+       reweighting, in which case the simulation must be reset. */
+    bool reweightSamples();
+
+    /* Streams every ray escaping the crystals to a file, until stopped.
+       Throws if the file cannot be opened. */
+    void startRayDump(const std::string &path);
+    void stopRayDump();
+    bool isDumpingRays() const;
+
+    /* Splits traced rays into halo component layers by their path through
+       the crystals, so that components can be shown and hidden without
+       tracing the image again. A ray goes to the first layer whose filter
+       matches it. Changing the filters resets the simulation. */
+    static const unsigned int maxPathLayers = 4;
+    void setPathFilters(std::vector<PathFilter> filters);
+    const std::vector<PathFilter> &getPathFilters() const;
+
+    /* Chooses the shown layers with one bit for each layer. Rays that are
+       in no layer are shown if otherRaysVisible is set. */
+    void setPathLayerVisibility(unsigned int visibleLayers, bool otherRaysVisible);
+    unsigned int getVisiblePathLayers() const;
+    bool isOtherRaysVisible() const;
+
+    /* Traces rays from the center of the sun and blurs the result with
+       the sun disk and the diffraction pattern of each crystal population
+       afterwards, instead of sampling the sun disk for every ray. This is
+       not used with halo component layers or very large suns. */
+    void setSunConvolutionEnabled(bool enabled);
+    bool isSunConvolutionEnabled() const;
+
+    /* Learns which crystal orientations and entry faces send rays into
+       the image while tracing, and traces more rays from them. Rays are
+       weighted so that the image converges to the same result. This helps
+       the most with narrow fields of view. */
+    void setPathGuidingEnabled(bool enabled);
+    bool isPathGuidingEnabled() const;
+
+    /* Gives more rays to the populations that leave the most noise in the
+       image, instead of splitting rays by population weight. Rays are
+       weighted so that the image converges to the same result. This is not
+       used with sample reweighting. */
+    void setAdaptiveRayAllocationEnabled(bool enabled);
+    bool isAdaptiveRayAllocationEnabled() const;
+    // Share of the rays of each frame currently given to the population
+    double getRayShare(unsigned int populationIndex) const;
+
+    /* Traces rays inside crystals in separate dispatches that pack the
+       rays still inside crystals together after every few reflections,
+       instead of tracing each ray to the end in the dispatch that
+       generated it. This keeps more lanes busy when a few rays take much
+       longer paths than the rest. It is not used with transfer tables. */
+    void setWavefrontTracingEnabled(bool enabled);
+    bool isWavefrontTracingEnabled() const;
+
+    /* Traces part of the rays of each frame on CPU worker threads while
+       the GPU traces the rest, and adds them to the same image. Rays are
+       split by the measured throughput of both sides. Only hexagonal
+       crystals with Gaussian or uniform orientations are traced on the
+       CPU, and the CPU is not used with features that need more from each
+       ray than the light it brings to its pixel. */
+    void setHybridTracingEnabled(bool enabled);
+    bool isHybridTracingEnabled() const;
+    // Smoothed throughputs of both sides, zero until measured
+    double getGpuRaysPerSecond() const;
+    double getCpuRaysPerSecond() const;
+    // Share of the rays of the last frame traced on the CPU
+    double getCpuRayShare() const;
+
+    /* Accumulates every traced ray into extra output views as well as the
+       main image, each with its own camera and resolution. The phase
+       function, sun convolution, sample reweighting and hybrid tracing are
+       not used while there are views, as their results are only made for
+       the main camera. Views show all rays regardless of the shown halo
+       component layers, and are not filled from scattering tables.
+       Changing the views resets the simulation. */
+    static const unsigned int maxOutputViews = 4;
+    void setOutputViews(std::vector<OutputView> views);
+    const std::vector<OutputView> &getOutputViews() const;
+    // Traced light of a view as RGBA floats, starting from the bottom row
+    std::vector<float> getOutputViewImage(unsigned int viewIndex);
+
+    /* Spreads the light of each ray over the pixels around the point it is
+       seen at, in the main image and the output views, for smoother images
+       with the same number of rays. The radius is clamped to the range of
+       the filters. */
+    void setSplatFilter(Kernels::SplatFilter filter);
+    Kernels::SplatFilter getSplatFilter() const;
+
+    /* Traces only the luminance of each ray, which is accumulated with
+       integer atomics in a single channel and shown in gray. The spectrum
+       of a ray is not converted to a color. The phase function, sun
+       convolution, sample reweighting and hybrid tracing work in color,
+       so they are not used, and scattering tables stay in color. Changing
+       the mode resets the simulation. */
+    void setMonochrome(bool monochrome);
+    bool isMonochrome() const;
+
+    /* Traces a scattering table for the current crystal populations over
+       the given range of sun altitudes. The progress callback is called
+       after each altitude, and building is cancelled if it returns false,
+       in which case an empty table is returned. */
+    ScatteringTable buildScatteringTable(float minAltitude, float maxAltitude, float altitudeStep, unsigned long long raysPerAltitude,
+                                         std::function<bool(unsigned int, unsigned int)> progressCallback);
+    /* Throws if the table was built with other crystals or settings than
+       the current ones, as the simulation could not be shown from it */
+    void setScatteringTable(ScatteringTable table);
+    const ScatteringTable &getScatteringTable() const;
+    bool matchesScatteringTable(const ScatteringTable &table) const;
+    bool isUsingScatteringTable() const;
+
     unsigned int getOutputTextureHandle() const;
     unsigned int getBackgroundTextureHandle() const;
+    // Sum of the squared luminance of the rays reaching each pixel, for estimating its noise
+    unsigned int getSecondMomentTextureHandle() const;
+    unsigned int getOutputWidth() const;
+    unsigned int getOutputHeight() const;
 
     void resizeOutputTextureCallback(const unsigned int width, const unsigned int height);
 
@@ -58,30 +234,259 @@ signals:
     void atmosphereChanged(Atmosphere);
     void lockCameraToLightSourceChanged(bool);
     void multipleScatteringProbabilityChanged(double);
+    void russianRouletteDepthChanged(int);
+    void maxScatteringOrdersChanged(int);
+    void quasiRandomSamplingChanged(bool);
+    void runSeedChanged(unsigned int);
+    void transferTablesEnabledChanged(bool);
+    void sampleReweightingEnabledChanged(bool);
+    void sunConvolutionEnabledChanged(bool);
+    void pathGuidingEnabledChanged(bool);
+    void adaptiveRayAllocationEnabledChanged(bool);
+    void wavefrontTracingEnabledChanged(bool);
+    void hybridTracingEnabledChanged(bool);
+    void outputViewsChanged();
+    // Emitted whenever the traced image is cleared, including by reset()
+    void cleared();
+    void splatFilterChanged();
+    void monochromeChanged(bool);
+    void scatteringTableChanged();
 
 private:
+    /* Shared sources, e.g. cameraProjection.glsl, are inserted in the given
+       order before the shader itself */
+    static std::unique_ptr<QOpenGLShaderProgram> initializeShaderProgram(const char *name, const char *filename, std::initializer_list<const char *> sharedFilenames = {});
     void initializeShaders();
     void initializeTextures();
+    void resolveMonochromeImage();
+    bool usesTwoLevelAccumulation() const;
+    void flushAccumulation();
+    unsigned int createTextureArray(unsigned int width, unsigned int height, unsigned int layers);
+    void flushLayerAccumulation(unsigned int stepTexture, unsigned int texture, unsigned int errorTexture, unsigned int width, unsigned int height, unsigned int layers);
+    void initializePathLengthBuffer();
+    void updateDistributionTables();
+    void updateCustomShapeBuffers();
+    void updateSunSpectrum(const SkyModel &skyState);
+    void traceRays(unsigned int populationIndex, unsigned int numRays, float sunAltitude, bool directionTableOutput);
+    void setTraceUniforms(unsigned int populationIndex, float sunAltitude, bool directionTableOutput, int traceMode);
+    void setCrystalUniforms(unsigned int populationIndex);
+    bool usesContinuations() const;
+    void initializeContinuationBuffers(bool crossPopulation);
+    void deleteContinuationBuffers();
+    void startContinuationQueue();
+    void traceContinuations(float sunAltitude, bool directionTableOutput);
+    bool usesTransferTable() const;
+    unsigned int getTransferTable(unsigned int populationIndex);
+    void buildTransferTable(unsigned int populationIndex, unsigned int buffer, int slot, unsigned int generation);
+    void clearTransferTables();
+    void resampleScatteringTable();
+
+    // Crystals and settings that a scattering table traced now would be built with
+    ScatteringTable::Settings getScatteringTableSettings() const;
+    void initializePhaseFunctionBuffers();
+    bool usesPhaseFunction(unsigned int populationIndex) const;
+    void compositePhaseFunction();
+    bool usesSampleRecording() const;
+    void initializeSampleRecordBuffers();
+    void deleteSampleRecordBuffers();
+    void startSamplingEpochs();
+    void uploadSamplingDistributions();
+    unsigned int getSampleRecordCount();
+    void splatSampleRecords();
+    void flushRayDump(std::uint64_t tracedRayCount);
+    void readBackRayDump(RayDumpBuffer &dump);
+    void readBackRayDumps();
+    bool usesPathLayers() const;
+    void initializePathLayers();
+    void compositePathLayers();
+    bool usesSunConvolution() const;
+    void initializeSunConvolutionGrid();
+    void convolveSunConvolutionGrid();
+    void compositeSunConvolution();
+    bool usesPathGuiding() const;
+    void initializePathGuide();
+    void clearPathGuide();
+    void updatePathGuide();
+    bool usesAdaptiveRayAllocation() const;
+    void initializeRayMomentBuffer();
+    void clearRayMoments();
+    void updateRayAllocation();
+    bool usesWavefront(int traceMode) const;
+    void initializeWavefrontBuffers();
+    void deleteWavefrontBuffers();
+    void startWavefrontQueues();
+    void traceWavefront();
+    bool usesHybridTracing() const;
+    bool usesHybridTracing(unsigned int populationIndex) const;
+    Kernels::SceneSettings getSceneSettings(unsigned int populationIndex) const;
+    void startHybridTracing();
+    void measureGpuThroughput();
+    unsigned int mergeCpuSplats(std::vector<unsigned int> &gpuRays);
+    bool usesOutputViews() const;
+    void initializeOutputViews();
     void pointCameraToLightSource();
+    void logPathLengthStatistics();
 
     unsigned int m_outputWidth;
     unsigned int m_outputHeight;
-    std::mt19937 m_mersenneTwister;
-    std::uniform_int_distribution<unsigned int> m_uniformDistribution;
     std::unique_ptr<QOpenGLShaderProgram> m_simulationShader;
-    QOpenGLShaderProgram *m_skyShader;
+    std::unique_ptr<QOpenGLShaderProgram> m_skyShader;
+    std::unique_ptr<QOpenGLShaderProgram> m_scatteringTableShader;
     std::unique_ptr<OpenGL::Texture> m_simulationTexture;
     std::unique_ptr<OpenGL::Texture> m_backgroundTexture;
+    std::unique_ptr<QOpenGLShaderProgram> m_phaseFunctionShader;
+    std::unique_ptr<QOpenGLShaderProgram> m_sampleReweightingShader;
+    std::unique_ptr<QOpenGLShaderProgram> m_pathLayerShader;
+    std::unique_ptr<QOpenGLShaderProgram> m_sunConvolutionShader;
+    std::unique_ptr<QOpenGLShaderProgram> m_cpuSplatShader;
+    std::unique_ptr<QOpenGLShaderProgram> m_monochromeShader;
+    std::unique_ptr<QOpenGLShaderProgram> m_accumulationShader;
+    std::unique_ptr<QOpenGLShaderProgram> m_layerAccumulationShader;
+    /* Traced image with the phase function of randomly oriented populations
+       or the convolved light around the sun added, or with hidden halo
+       component layers removed */
+    std::unique_ptr<OpenGL::Texture> m_compositeTexture;
+    /* Light of the current step, which is added to the simulation texture
+       at the end of the step, and the rounding error of that sum */
+    std::unique_ptr<OpenGL::Texture> m_accumulationStepTexture;
+    std::unique_ptr<OpenGL::Texture> m_accumulationErrorTexture;
+    std::unique_ptr<OpenGL::Texture> m_secondMomentTexture;
 
     Camera m_camera;
     LightSource m_light;
 
     bool m_running;
     bool m_initialized;
+    InvalidationTracker m_invalidations;
     unsigned int m_raysPerStep;
     unsigned int m_iteration;
     bool m_cameraLockedToLightSource;
     float m_multipleScatteringProbability;
+    int m_russianRouletteDepth;
+    bool m_pathLengthStatisticsEnabled;
+    unsigned int m_pathLengthBuffer;
+    unsigned int m_pathLengthBufferPopulationCount;
+    bool m_quasiRandomSampling;
+    unsigned int m_runSeed;
+    std::vector<std::uint64_t> m_rayIndexOffsets;
+    unsigned int m_distributionTableTexture;
+    unsigned int m_crystalFaceBuffer;
+    unsigned int m_crystalTriangleBuffer;
+    std::vector<int> m_customShapeFaceOffsets;
+    std::vector<int> m_customShapeFaceCounts;
+    ScatteringTable m_scatteringTable;
+    unsigned int m_scatteringTableTexture;
+    unsigned int m_phaseFunctionBuffer;
+    unsigned int m_phaseFunctionRadianceBuffer;
+    double m_phaseFunctionRayCount;
+    double m_phaseFunctionRaysPerStep;
+    bool m_compositingPhaseFunction;
+    bool m_transferTablesEnabled;
+    struct CachedTransferTable
+    {
+        std::string shapeKey;
+        unsigned int buffer;
+        // Number of times the table has been refined, which also numbers its random streams
+        unsigned int generation;
+        unsigned int refinedIteration;
+    };
+    // Least recently used first
+    std::vector<CachedTransferTable> m_transferTables;
+    bool m_sampleReweightingEnabled;
+    // Set when the record buffer has filled up, which stops recording until the simulation is cleared
+    bool m_sampleRecordsOverflowed;
+    unsigned int m_sampleRecordBuffer;
+    unsigned int m_samplingDistributionBuffer;
+    unsigned int m_targetDistributionBuffer;
+    // Populations as they were when their stored rays were traced
+    std::vector<CrystalPopulation> m_sampledPopulations;
+    std::vector<double> m_sampledProbabilities;
+    std::vector<std::vector<SamplingEpoch>> m_samplingEpochs;
+    std::unique_ptr<RayDumpWriter> m_rayDumpWriter;
+    /* Dumped rays are read back one step after they were traced, once a
+       fence shows that the GPU has written them, so that tracing never
+       waits for the readback */
+    struct RayDumpBuffer
+    {
+        unsigned int buffer;
+        GLsync fence;
+        std::uint64_t tracedRayCount;
+    };
+    static const unsigned int rayDumpBufferCount = 2;
+    RayDumpBuffer m_rayDumpBuffers[rayDumpBufferCount];
+    unsigned int m_rayDumpBufferIndex;
+    unsigned int m_rayDumpBufferCapacity;
+    int m_maxScatteringOrders;
+    /* Queues of rays waiting for their next scattering event. These must
+       match the continuation buffers in the raytracing shader. */
+    static const unsigned int continuationHeaderSize = 4;
+    static const unsigned int continuationRecordSize = 9;
+    unsigned int m_continuationBuffers[2];
+    unsigned int m_continuationCapacity;
+    unsigned int m_continuationPopulationCount;
+    unsigned int m_populationCdfBuffer;
+    std::vector<PathFilter> m_pathFilters;
+    unsigned int m_pathLayerTexture;
+    // Step and rounding error of the layers, like for the traced image
+    unsigned int m_pathLayerStepTexture;
+    unsigned int m_pathLayerErrorTexture;
+    unsigned int m_pathLayerMaskBuffer;
+    unsigned int m_visiblePathLayers;
+    bool m_otherRaysVisible;
+    bool m_compositingPathLayers;
+    bool m_sunConvolutionEnabled;
+    SunConvolution m_sunConvolution;
+    // Light around the sun for each population, and the convolved sum of it
+    unsigned int m_sunConvolutionGridTexture;
+    unsigned int m_sunConvolutionGridLayers;
+    unsigned int m_sunConvolutionTexture;
+    // Iteration at which the grid was last convolved
+    unsigned int m_sunConvolutionIteration;
+    float m_limbDarkeningScaler[3];
+    bool m_compositingSunConvolution;
+    bool m_pathGuidingEnabled;
+    // Cumulative cell probabilities and accumulated ray weights of each population
+    unsigned int m_pathGuideCdfBuffer;
+    unsigned int m_pathGuideCounterBuffer;
+    unsigned int m_pathGuidePopulationCount;
+    bool m_adaptiveRayAllocationEnabled;
+    // Current shares of rays, empty until the first allocation
+    std::vector<double> m_rayShares;
+    unsigned int m_rayMomentBuffer;
+    unsigned int m_rayMomentPopulationCount;
+    // Rays traced for each population since the moments were cleared
+    std::vector<double> m_rayMomentRayCounts;
+    bool m_wavefrontTracingEnabled;
+    // Queues of rays inside crystals, read and written in turns, and of escaped rays
+    unsigned int m_wavefrontBounceBuffers[2];
+    unsigned int m_wavefrontEscapeBuffer;
+    unsigned int m_wavefrontCapacity;
+    bool m_hybridTracingEnabled;
+    // Worker threads, only started while hybrid tracing is enabled
+    std::unique_ptr<HybridTracer> m_hybridTracer;
+    ThroughputBalancer m_throughputBalancer;
+    /* Rays of each population in the batch the CPU is tracing. A batch is
+       merged on the first frame after it has finished, in place of as many
+       GPU rays, and dropped if the image was cleared in between. */
+    std::vector<unsigned int> m_cpuBatchRays;
+    bool m_cpuBatchStale;
+    unsigned int m_cpuSplatBuffer;
+    // Timer of the dispatches of a frame, read on a later frame so that the GPU is not waited for
+    unsigned int m_gpuTimerQuery;
+    bool m_gpuTimerPending;
+    unsigned int m_gpuTimedRayCount;
+    double m_cpuRayShare;
+    std::vector<OutputView> m_outputViews;
+    // Layer for each view, as large as the largest view
+    unsigned int m_outputViewTexture;
+    unsigned int m_outputViewStepTexture;
+    unsigned int m_outputViewErrorTexture;
+    unsigned int m_outputViewTextureWidth;
+    unsigned int m_outputViewTextureHeight;
+    Kernels::SplatFilter m_splatFilter;
+    bool m_monochrome;
+    // Fixed point luminance, only allocated in monochrome mode
+    std::unique_ptr<OpenGL::Texture> m_monochromeTexture;
     std::shared_ptr<CrystalPopulationRepository> m_crystalRepository;
     float m_sunSpectrumCache[31];
     Atmosphere m_atmosphere;
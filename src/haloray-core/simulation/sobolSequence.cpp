@@ -0,0 +1,111 @@
+#include "sobolSequence.h"
+
+namespace HaloRay
+{
+
+namespace
+{
+
+unsigned int reverseBits(unsigned int x)
+{
+    x = ((x >> 1) & 0x55555555u) | ((x & 0x55555555u) << 1);
+    x = ((x >> 2) & 0x33333333u) | ((x & 0x33333333u) << 2);
+    x = ((x >> 4) & 0x0f0f0f0fu) | ((x & 0x0f0f0f0fu) << 4);
+    x = ((x >> 8) & 0x00ff00ffu) | ((x & 0x00ff00ffu) << 8);
+    return (x >> 16) | (x << 16);
+}
+
+unsigned int laineKarrasPermutation(unsigned int x, unsigned int seed)
+{
+    x += seed;
+    x ^= x * 0x6c50b47cu;
+    x ^= x * 0xb82f1e52u;
+    x ^= x * 0xc7afe638u;
+    x ^= x * 0x8d22f6e6u;
+    return x;
+}
+
+}
+
+const std::array<unsigned int, SobolSequence::dimensions * SobolSequence::bits> &SobolSequence::getDirectionNumbers()
+{
+    static const auto directionNumbers = generateDirectionNumbers();
+    return directionNumbers;
+}
+
+std::array<unsigned int, SobolSequence::dimensions * SobolSequence::bits> SobolSequence::generateDirectionNumbers()
+{
+    std::array<unsigned int, dimensions * bits> directions;
+
+    // The first dimension is the van der Corput sequence
+    for (auto bit = 0u; bit < bits; ++bit)
+    {
+        directions[bit] = 1u << (bits - 1 - bit);
+    }
+
+    // Primitive polynomials and initial direction numbers from Joe & Kuo (2008)
+    const unsigned int degrees[dimensions - 1] = {1, 2, 3};
+    const unsigned int coefficients[dimensions - 1] = {0, 1, 1};
+    const unsigned int initialNumbers[dimensions - 1][3] = {{1, 0, 0}, {1, 3, 0}, {1, 3, 1}};
+
+    for (auto dimension = 1u; dimension < dimensions; ++dimension)
+    {
+        auto s = degrees[dimension - 1];
+        auto a = coefficients[dimension - 1];
+        unsigned int *v = &directions[dimension * bits];
+
+        for (auto k = 0u; k < s; ++k)
+        {
+            v[k] = initialNumbers[dimension - 1][k] << (bits - 1 - k);
+        }
+
+        for (auto k = s; k < bits; ++k)
+        {
+            v[k] = v[k - s] ^ (v[k - s] >> s);
+            for (auto j = 1u; j < s; ++j)
+            {
+                if ((a >> (s - 1 - j)) & 1u)
+                    v[k] ^= v[k - j];
+            }
+        }
+    }
+
+    return directions;
+}
+
+unsigned int SobolSequence::sample(unsigned int index, unsigned int dimension)
+{
+    const auto &directions = getDirectionNumbers();
+    unsigned int result = 0;
+    for (auto bit = 0u; index != 0; ++bit, index >>= 1)
+    {
+        if (index & 1u)
+            result ^= directions[dimension * bits + bit];
+    }
+    return result;
+}
+
+unsigned int SobolSequence::nestedUniformScramble(unsigned int x, unsigned int seed)
+{
+    x = reverseBits(x);
+    x = laineKarrasPermutation(x, seed);
+    x = reverseBits(x);
+    return x;
+}
+
+unsigned int SobolSequence::hashCombine(unsigned int seed, unsigned int value)
+{
+    return seed ^ (value + (seed << 6) + (seed >> 2));
+}
+
+float SobolSequence::getScrambledSample(unsigned int index, unsigned int dimension, unsigned int seed)
+{
+    auto dimensionSet = dimension / dimensions;
+    auto shuffledIndex = nestedUniformScramble(index, hashCombine(seed, dimensionSet));
+    auto value = sample(shuffledIndex, dimension % dimensions);
+    value = nestedUniformScramble(value, hashCombine(seed, dimension + 0x9e3779b9u));
+    // Only the top 24 bits fit exactly into a float
+    return (float)(value >> 8) / 16777216.0f;
+}
+
+}
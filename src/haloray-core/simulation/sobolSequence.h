@@ -0,0 +1,30 @@
+#pragma once
+#include <array>
+
+namespace HaloRay
+{
+
+/* Owen-scrambled and shuffled Sobol sequence, based on "Practical
+   Hash-based Owen Scrambling" by Brent Burley (2020). Sample dimensions
+   are grouped into independently shuffled sets of four, which allows
+   padding the sequence to any number of dimensions. The raytracing
+   shader contains an equivalent implementation that uses the direction
+   numbers generated here. */
+class SobolSequence
+{
+public:
+    static const unsigned int dimensions = 4;
+    static const unsigned int bits = 32;
+
+    static const std::array<unsigned int, dimensions * bits> &getDirectionNumbers();
+
+    static unsigned int sample(unsigned int index, unsigned int dimension);
+    static unsigned int nestedUniformScramble(unsigned int x, unsigned int seed);
+    static unsigned int hashCombine(unsigned int seed, unsigned int value);
+    static float getScrambledSample(unsigned int index, unsigned int dimension, unsigned int seed);
+
+private:
+    static std::array<unsigned int, dimensions * bits> generateDirectionNumbers();
+};
+
+}
@@ -0,0 +1,72 @@
+#pragma once
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <vector>
+
+namespace HaloRay
+{
+
+/* Lock-free ring buffer for one producer thread and one consumer thread.
+   Neither side ever waits for the other: pushing to a full buffer and
+   popping from an empty one simply transfer fewer items. */
+template <typename T>
+class SpscRingBuffer
+{
+public:
+    // The capacity is rounded up to a power of two
+    explicit SpscRingBuffer(std::size_t capacity)
+        : m_head(0),
+          m_tail(0)
+    {
+        std::size_t roundedCapacity = 1;
+        while (roundedCapacity < capacity)
+            roundedCapacity *= 2;
+        m_items.resize(roundedCapacity);
+        m_mask = roundedCapacity - 1;
+    }
+
+    std::size_t getCapacity() const
+    {
+        return m_items.size();
+    }
+
+    std::size_t getSize() const
+    {
+        return m_head.load(std::memory_order_acquire) - m_tail.load(std::memory_order_acquire);
+    }
+
+    // Called by the producer only. Returns the number of items pushed.
+    std::size_t push(const T *items, std::size_t count)
+    {
+        auto head = m_head.load(std::memory_order_relaxed);
+        auto tail = m_tail.load(std::memory_order_acquire);
+        auto pushCount = std::min(count, m_items.size() - (head - tail));
+        for (std::size_t i = 0; i < pushCount; ++i)
+            m_items[(head + i) & m_mask] = items[i];
+        m_head.store(head + pushCount, std::memory_order_release);
+        return pushCount;
+    }
+
+    // Called by the consumer only. Returns the number of items popped.
+    std::size_t pop(T *items, std::size_t maxCount)
+    {
+        auto tail = m_tail.load(std::memory_order_relaxed);
+        auto head = m_head.load(std::memory_order_acquire);
+        auto popCount = std::min(maxCount, head - tail);
+        for (std::size_t i = 0; i < popCount; ++i)
+            items[i] = m_items[(tail + i) & m_mask];
+        m_tail.store(tail + popCount, std::memory_order_release);
+        return popCount;
+    }
+
+private:
+    std::vector<T> m_items;
+    std::size_t m_mask;
+
+    // Indices grow without wrapping, and are masked when accessing items
+    alignas(64) std::atomic<std::size_t> m_head;
+    alignas(64) std::atomic<std::size_t> m_tail;
+};
+
+}
@@ -0,0 +1,258 @@
+#include "sunConvolution.h"
+#include <algorithm>
+#include <cmath>
+#include <stdexcept>
+#include "fft.h"
+#include "trigonometryUtilities.h"
+
+namespace HaloRay
+{
+
+namespace
+{
+
+const std::size_t cellCount = static_cast<std::size_t>(SunConvolution::gridSize) * SunConvolution::gridSize;
+
+std::size_t getWrappedIndex(int x, int y)
+{
+    const auto size = static_cast<int>(SunConvolution::gridSize);
+    auto wrappedX = ((x % size) + size) % size;
+    auto wrappedY = ((y % size) + size) % size;
+    return static_cast<std::size_t>(wrappedY) * SunConvolution::gridSize + wrappedX;
+}
+
+SunConvolution::Kernel createDeltaKernel()
+{
+    SunConvolution::Kernel kernel(cellCount * 3, 0.0f);
+    kernel[0] = kernel[1] = kernel[2] = 1.0f;
+    return kernel;
+}
+
+/* Fills the kernel with a radially symmetric profile of angle in radians
+   and channel, averaged over subsamples within each cell. Cells near the
+   center are subsampled more finely, as the profiles are the sharpest
+   there. */
+template <typename Profile>
+SunConvolution::Kernel createRadialKernel(double maxAngle, Profile profile)
+{
+    const auto cellAngle = SunConvolution::cellAngle;
+    const auto extent = static_cast<int>(std::ceil(maxAngle / cellAngle)) + 1;
+    const double maxCellDistance = SunConvolution::kernelRadius;
+
+    SunConvolution::Kernel kernel(cellCount * 3, 0.0f);
+    double sums[3] = {0.0, 0.0, 0.0};
+    for (auto y = -extent; y <= extent; ++y)
+    {
+        for (auto x = -extent; x <= extent; ++x)
+        {
+            auto cellDistance = std::hypot(x, y);
+            if (cellDistance > maxCellDistance)
+                continue;
+
+            auto subsamples = cellDistance < 16.0 ? 4 : 1;
+            double values[3] = {0.0, 0.0, 0.0};
+            for (auto subY = 0; subY < subsamples; ++subY)
+            {
+                for (auto subX = 0; subX < subsamples; ++subX)
+                {
+                    auto offsetX = x + (subX + 0.5) / subsamples - 0.5;
+                    auto offsetY = y + (subY + 0.5) / subsamples - 0.5;
+                    auto angle = std::hypot(offsetX, offsetY) * cellAngle;
+                    if (angle > maxAngle)
+                        continue;
+                    for (auto channel = 0u; channel < 3; ++channel)
+                        values[channel] += profile(degToRad(angle), channel);
+                }
+            }
+
+            auto index = getWrappedIndex(x, y) * 3;
+            for (auto channel = 0u; channel < 3; ++channel)
+            {
+                kernel[index + channel] = static_cast<float>(values[channel]);
+                sums[channel] += values[channel];
+            }
+        }
+    }
+
+    // Profiles narrower than a cell may miss every subsample
+    if (sums[0] <= 0.0 || sums[1] <= 0.0 || sums[2] <= 0.0)
+        return createDeltaKernel();
+
+    for (auto i = 0u; i < cellCount; ++i)
+    {
+        for (auto channel = 0u; channel < 3; ++channel)
+            kernel[i * 3 + channel] = static_cast<float>(kernel[i * 3 + channel] / sums[channel]);
+    }
+    return kernel;
+}
+
+}
+
+double SunConvolution::getCellSolidAngle(double angleFromSun)
+{
+    // Tangential distances are scaled by sin(angle) / angle in the projection
+    auto cellSide = PI * cellAngle / 180.0;
+    if (angleFromSun < 1.0e-6)
+        return cellSide * cellSide;
+    return cellSide * cellSide * std::sin(angleFromSun) / angleFromSun;
+}
+
+SunConvolution::Kernel SunConvolution::createSunDiskKernel(double diameter, const float limbDarkening[3])
+{
+    auto radius = 0.5 * std::min(diameter, maxSunDiameter);
+    if (radius <= 0.0)
+        return createDeltaKernel();
+
+    // Limb darkening as in the sun of the sky shader
+    auto sinRadius = std::sin(degToRad(radius));
+    return createRadialKernel(radius, [sinRadius, limbDarkening](double angle, unsigned int channel) {
+        auto sinAngle = std::sin(angle);
+        auto sampleCosine = std::sqrt(std::max(1.0 - sinAngle * sinAngle / (sinRadius * sinRadius), 0.0));
+        return limbDarkening[channel] + (1.0 - limbDarkening[channel]) * sampleCosine;
+    });
+}
+
+SunConvolution::Kernel SunConvolution::createDiffractionKernel(double crystalSize, double maxAngle)
+{
+    if (crystalSize <= 0.0 || maxAngle <= 0.0)
+        return createDeltaKernel();
+
+    return createRadialKernel(maxAngle, [crystalSize](double angle, unsigned int channel) {
+        // Crystal size in micrometers and wavelength in nanometers
+        auto x = PI * 1000.0 * crystalSize / channelWavelengths[channel] * std::sin(angle);
+        if (x < 1.0e-6)
+            return 1.0;
+        auto amplitude = 2.0 * std::cyl_bessel_j(1.0, x) / x;
+        return amplitude * amplitude;
+    });
+}
+
+SunConvolution::SunConvolution()
+    : m_sunDiameter(-1.0),
+      m_limbDarkening{0.0f, 0.0f, 0.0f}
+{
+}
+
+void SunConvolution::setKernels(double sunDiameter, const float limbDarkening[3], const std::vector<float> &crystalSizes)
+{
+    if (sunDiameter != m_sunDiameter || !std::equal(m_limbDarkening.begin(), m_limbDarkening.end(), limbDarkening))
+    {
+        m_sunDiameter = sunDiameter;
+        std::copy(limbDarkening, limbDarkening + 3, m_limbDarkening.begin());
+        m_sunDiskSpectrum = transformKernel(createSunDiskKernel(sunDiameter, limbDarkening));
+        m_spectra.clear();
+    }
+
+    // Diffraction gets what is left of the kernel radius after the sun disk
+    auto maxDiffractionAngle = kernelRadius * cellAngle - 0.5 * std::min(sunDiameter, maxSunDiameter) - cellAngle;
+
+    // Spectra of crystal sizes that are no longer used are dropped
+    std::vector<std::pair<float, Spectrum>> spectra;
+    for (auto crystalSize : crystalSizes)
+    {
+        auto hasSize = [crystalSize](const std::pair<float, Spectrum> &spectrum) { return spectrum.first == crystalSize; };
+        if (std::any_of(spectra.begin(), spectra.end(), hasSize))
+            continue;
+
+        auto previous = std::find_if(m_spectra.begin(), m_spectra.end(), hasSize);
+        if (previous != m_spectra.end())
+        {
+            spectra.push_back(std::move(*previous));
+            continue;
+        }
+
+        auto spectrum = transformKernel(createDiffractionKernel(crystalSize, maxDiffractionAngle));
+        for (auto channel = 0u; channel < 3; ++channel)
+        {
+            for (auto i = 0u; i < cellCount; ++i)
+                spectrum[channel][i] *= m_sunDiskSpectrum[channel][i];
+        }
+        spectra.emplace_back(crystalSize, std::move(spectrum));
+    }
+
+    m_spectra = std::move(spectra);
+    m_crystalSizes = crystalSizes;
+}
+
+std::vector<float> SunConvolution::convolve(const std::vector<float> &grids) const
+{
+    const auto populationCount = m_crystalSizes.size();
+    if (grids.size() != cellCount * 4 * populationCount)
+        throw std::runtime_error("Sun convolution grids do not match the number of crystal populations");
+
+    // Sums of the convolved spectra of all populations
+    Spectrum sums;
+    for (auto &sum : sums)
+        sum.assign(cellCount, std::complex<float>(0.0f, 0.0f));
+
+    std::vector<std::complex<float>> redGreen(cellCount);
+    std::vector<std::complex<float>> blue(cellCount);
+    for (auto population = 0u; population < populationCount; ++population)
+    {
+        const auto grid = grids.data() + population * cellCount * 4;
+        if (std::all_of(grid, grid + cellCount * 4, [](float value) { return value == 0.0f; }))
+            continue;
+
+        /* The red and green channels are transformed together as the real
+           and imaginary parts of one image, and separated afterwards using
+           the symmetry of spectra of real images */
+        for (auto i = 0u; i < cellCount; ++i)
+        {
+            redGreen[i] = std::complex<float>(grid[i * 4], grid[i * 4 + 1]);
+            blue[i] = std::complex<float>(grid[i * 4 + 2], 0.0f);
+        }
+        FFT::transform2D(redGreen, gridSize, false);
+        FFT::transform2D(blue, gridSize, false);
+
+        auto spectrum = std::find_if(m_spectra.begin(), m_spectra.end(), [this, population](const std::pair<float, Spectrum> &spectrum) {
+            return spectrum.first == m_crystalSizes[population];
+        });
+        const auto &kernel = spectrum->second;
+
+        for (auto y = 0u; y < gridSize; ++y)
+        {
+            for (auto x = 0u; x < gridSize; ++x)
+            {
+                auto i = static_cast<std::size_t>(y) * gridSize + x;
+                auto mirrored = std::conj(redGreen[getWrappedIndex(-static_cast<int>(x), -static_cast<int>(y))]);
+                auto red = 0.5f * (redGreen[i] + mirrored);
+                auto green = std::complex<float>(0.0f, -0.5f) * (redGreen[i] - mirrored);
+                sums[0][i] += red * kernel[0][i];
+                sums[1][i] += green * kernel[1][i];
+                sums[2][i] += blue[i] * kernel[2][i];
+            }
+        }
+    }
+
+    // The convolved channels are real, so red and green can again be transformed together
+    for (auto i = 0u; i < cellCount; ++i)
+        redGreen[i] = sums[0][i] + std::complex<float>(0.0f, 1.0f) * sums[1][i];
+    FFT::transform2D(redGreen, gridSize, true);
+    FFT::transform2D(sums[2], gridSize, true);
+
+    std::vector<float> result(cellCount * 4);
+    for (auto i = 0u; i < cellCount; ++i)
+    {
+        // Rounding errors can leave tiny negative values where there is no light
+        result[i * 4] = std::max(redGreen[i].real(), 0.0f);
+        result[i * 4 + 1] = std::max(redGreen[i].imag(), 0.0f);
+        result[i * 4 + 2] = std::max(sums[2][i].real(), 0.0f);
+        result[i * 4 + 3] = 1.0f;
+    }
+    return result;
+}
+
+SunConvolution::Spectrum SunConvolution::transformKernel(const Kernel &kernel)
+{
+    Spectrum spectrum;
+    for (auto channel = 0u; channel < 3; ++channel)
+    {
+        spectrum[channel].resize(cellCount);
+        for (auto i = 0u; i < cellCount; ++i)
+            spectrum[channel][i] = std::complex<float>(kernel[i * 3 + channel], 0.0f);
+        FFT::transform2D(spectrum[channel], gridSize, false);
+    }
+    return spectrum;
+}
+
+}
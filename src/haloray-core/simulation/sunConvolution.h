@@ -0,0 +1,87 @@
+#pragma once
+#include <array>
+#include <complex>
+#include <utility>
+#include <vector>
+
+namespace HaloRay
+{
+
+/* Halos are blurred by the size of the sun disk and by diffraction at
+   the crystals. Instead of sampling a point on the sun disk for every
+   ray, rays can be traced from the center of the sun and accumulated
+   into a grid of directions around it, which is then convolved with the
+   sun disk and the diffraction pattern of each crystal population.
+
+   The grid is an azimuthal equidistant projection centered on the sun.
+   A direction at some angle from the sun is that far from the center of
+   the grid, towards the direction it lies in from the sun. The grid must
+   match the raytracing shader and the sun convolution shader.
+
+   Convolution assumes that the blur is the same everywhere on the grid.
+   That holds at the sun, and farther away the projection stretches the
+   blur tangentially by angle / sin(angle), which is about 10 % at the
+   46° halo. */
+class SunConvolution
+{
+public:
+    static const unsigned int gridSize = 1024;
+    // Angular size of a grid cell in degrees
+    static constexpr double cellAngle = 0.125;
+
+    /* Rays are accumulated within this many cells from the sun. Blurring
+       spreads them at most kernelRadius cells farther, so that nothing
+       wraps around the edges of the grid. */
+    static const unsigned int gridRadius = 416;
+    static const unsigned int kernelRadius = gridSize / 2 - gridRadius;
+
+    /* The sun disk and the diffraction pattern together must fit within
+       kernelRadius, so larger suns are sampled for each ray instead */
+    static constexpr double maxSunDiameter = 16.0;
+
+    // Representative wavelengths of the red, green and blue channels in nanometers
+    static constexpr double channelWavelengths[3] = {610.0, 550.0, 465.0};
+
+    // Solid angle of a grid cell at the given angle from the sun, in radians
+    static double getCellSolidAngle(double angleFromSun);
+
+    /* Kernels are RGB images of the whole grid, centered on the first
+       cell and wrapping around the edges. Each channel sums to one. */
+    using Kernel = std::vector<float>;
+
+    /* Uniform sun disk with the given diameter in degrees, darkened
+       towards the limb by the given factors for each channel as in the
+       sky model */
+    static Kernel createSunDiskKernel(double diameter, const float limbDarkening[3]);
+
+    /* Fraunhofer diffraction of light passing a crystal of the given
+       diameter in micrometers, approximated by the Airy pattern of a
+       circular aperture, cut off at the given angle from the center in
+       degrees. Zero crystal size gives no diffraction. */
+    static Kernel createDiffractionKernel(double crystalSize, double maxAngle);
+
+    SunConvolution();
+
+    /* Kernels are only rebuilt for a sun diameter, limb darkening or
+       crystal size that has not been used before */
+    void setKernels(double sunDiameter, const float limbDarkening[3], const std::vector<float> &crystalSizes);
+
+    /* Convolves RGBA grids of each crystal population, stored one after
+       another, with the kernel of the population, and returns their sum
+       as an RGBA grid */
+    std::vector<float> convolve(const std::vector<float> &grids) const;
+
+private:
+    using Spectrum = std::array<std::vector<std::complex<float>>, 3>;
+
+    static Spectrum transformKernel(const Kernel &kernel);
+
+    double m_sunDiameter;
+    std::array<float, 3> m_limbDarkening;
+    Spectrum m_sunDiskSpectrum;
+    // Spectra of the sun disk convolved with diffraction, by crystal size
+    std::vector<std::pair<float, Spectrum>> m_spectra;
+    std::vector<float> m_crystalSizes;
+};
+
+}
@@ -0,0 +1,135 @@
+#include "tabulatedDistribution.h"
+#include <algorithm>
+#include <sstream>
+#include <stdexcept>
+#include <cmath>
+
+namespace HaloRay
+{
+
+TabulatedDistribution::TabulatedDistribution()
+{
+}
+
+TabulatedDistribution::TabulatedDistribution(std::vector<float> binEdges, std::vector<float> weights)
+    : m_binEdges(binEdges),
+      m_weights(weights)
+{
+    if (m_weights.empty())
+        throw std::runtime_error("Tabulated distribution has no bins");
+
+    if (m_binEdges.size() != m_weights.size() + 1)
+        throw std::runtime_error("Tabulated distribution must have one more bin edge than weights");
+
+    for (auto i = 0u; i < m_weights.size(); ++i)
+    {
+        if (!(m_binEdges[i + 1] > m_binEdges[i]))
+            throw std::runtime_error("Tabulated distribution bin edges must be increasing");
+        if (!(m_weights[i] >= 0.0f) || std::isinf(m_weights[i]))
+            throw std::runtime_error("Tabulated distribution weights must be non-negative");
+    }
+
+    m_cdf.push_back(0.0);
+    for (auto weight : m_weights)
+    {
+        m_cdf.push_back(m_cdf.back() + weight);
+    }
+
+    if (m_cdf.back() <= 0.0)
+        throw std::runtime_error("Tabulated distribution weights must not all be zero");
+
+    for (auto &value : m_cdf)
+    {
+        value /= m_cdf.back();
+    }
+}
+
+bool TabulatedDistribution::isEmpty() const
+{
+    return m_weights.empty();
+}
+
+unsigned int TabulatedDistribution::getBinCount() const
+{
+    return static_cast<unsigned int>(m_weights.size());
+}
+
+const std::vector<float> &TabulatedDistribution::getBinEdges() const
+{
+    return m_binEdges;
+}
+
+const std::vector<float> &TabulatedDistribution::getWeights() const
+{
+    return m_weights;
+}
+
+float TabulatedDistribution::sample(float u) const
+{
+    if (isEmpty()) return 0.0f;
+
+    double clamped = std::min(std::max((double)u, 0.0), 1.0);
+
+    // Find the last bin starting at or below u, skipping empty bins
+    auto upper = std::upper_bound(m_cdf.begin() + 1, m_cdf.end() - 1, clamped);
+    auto bin = static_cast<unsigned int>(upper - m_cdf.begin()) - 1;
+    while (bin > 0 && m_weights[bin] == 0.0f)
+        --bin;
+    while (m_weights[bin] == 0.0f)
+        ++bin;
+
+    double binProbability = m_cdf[bin + 1] - m_cdf[bin];
+    double fraction = std::min(std::max((clamped - m_cdf[bin]) / binProbability, 0.0), 1.0);
+    return static_cast<float>(m_binEdges[bin] + fraction * (m_binEdges[bin + 1] - m_binEdges[bin]));
+}
+
+std::vector<float> TabulatedDistribution::createSamplingTable(unsigned int edgeCount) const
+{
+    if (edgeCount < m_binEdges.size())
+        throw std::runtime_error("Sampling table is too small for the tabulated distribution");
+
+    std::vector<float> table(2 * edgeCount);
+    for (auto i = 0u; i < edgeCount; ++i)
+    {
+        auto edge = std::min(i, static_cast<unsigned int>(m_binEdges.size()) - 1);
+        table[2 * i] = static_cast<float>(m_cdf[edge]);
+        table[2 * i + 1] = m_binEdges[edge];
+    }
+    return table;
+}
+
+TabulatedDistribution TabulatedDistribution::fromCsv(const std::string &text)
+{
+    std::vector<float> binEdges;
+    std::vector<float> weights;
+
+    std::istringstream lines(text);
+    std::string line;
+    unsigned int lineNumber = 0;
+    while (std::getline(lines, line))
+    {
+        ++lineNumber;
+        std::replace(line.begin(), line.end(), ',', ' ');
+        std::replace(line.begin(), line.end(), ';', ' ');
+        auto firstCharacter = line.find_first_not_of(" \t\r");
+        if (firstCharacter == std::string::npos || line[firstCharacter] == '#')
+            continue;
+
+        std::istringstream columns(line);
+        float lowerEdge, upperEdge, weight;
+        if (!(columns >> lowerEdge >> upperEdge >> weight))
+            throw std::runtime_error("Line " + std::to_string(lineNumber) + " must contain lower bin edge, upper bin edge and weight");
+
+        if (binEdges.empty())
+            binEdges.push_back(lowerEdge);
+        else if (binEdges.back() != lowerEdge)
+            throw std::runtime_error("Bin on line " + std::to_string(lineNumber) + " does not start where the previous bin ended");
+
+        binEdges.push_back(upperEdge);
+        weights.push_back(weight);
+    }
+
+    return TabulatedDistribution(binEdges, weights);
+}
+
+}
@@ -0,0 +1,38 @@
+#pragma once
+#include <vector>
+#include <string>
+
+namespace HaloRay
+{
+
+/* Piecewise uniform distribution defined by a histogram, e.g. measured
+   crystal tilts. The raytracing shader reads the bin edges and the
+   cumulative distribution from a texture, and inverts it exactly like
+   sample() does. */
+class TabulatedDistribution
+{
+public:
+    TabulatedDistribution();
+    TabulatedDistribution(std::vector<float> binEdges, std::vector<float> weights);
+
+    bool isEmpty() const;
+    unsigned int getBinCount() const;
+    const std::vector<float> &getBinEdges() const;
+    const std::vector<float> &getWeights() const;
+
+    float sample(float u) const;
+
+    /* Pairs of cumulative probability and bin edge, padded to edgeCount
+       pairs with the last ones. Padding can never be sampled, just like
+       empty bins. */
+    std::vector<float> createSamplingTable(unsigned int edgeCount) const;
+
+    static TabulatedDistribution fromCsv(const std::string &text);
+
+private:
+    std::vector<float> m_binEdges;
+    std::vector<float> m_weights;
+    std::vector<double> m_cdf;
+};
+
+}
@@ -0,0 +1,59 @@
+#include "throughputBalancer.h"
+#include <algorithm>
+
+namespace HaloRay
+{
+
+ThroughputBalancer::ThroughputBalancer()
+    : m_gpuRaysPerSecond(0.0),
+      m_cpuRaysPerSecond(0.0)
+{
+}
+
+void ThroughputBalancer::addGpuMeasurement(double rayCount, double seconds)
+{
+    addMeasurement(m_gpuRaysPerSecond, rayCount, seconds);
+}
+
+void ThroughputBalancer::addCpuMeasurement(double rayCount, double seconds)
+{
+    addMeasurement(m_cpuRaysPerSecond, rayCount, seconds);
+}
+
+double ThroughputBalancer::getGpuRaysPerSecond() const
+{
+    return m_gpuRaysPerSecond;
+}
+
+double ThroughputBalancer::getCpuRaysPerSecond() const
+{
+    return m_cpuRaysPerSecond;
+}
+
+double ThroughputBalancer::getCpuShare() const
+{
+    if (m_gpuRaysPerSecond <= 0.0 || m_cpuRaysPerSecond <= 0.0)
+        return initialCpuShare;
+    return std::min(maxCpuShare, m_cpuRaysPerSecond / (m_cpuRaysPerSecond + m_gpuRaysPerSecond));
+}
+
+void ThroughputBalancer::reset()
+{
+    m_gpuRaysPerSecond = 0.0;
+    m_cpuRaysPerSecond = 0.0;
+}
+
+void ThroughputBalancer::addMeasurement(double &raysPerSecond, double rayCount, double seconds)
+{
+    // Frames too short to time say nothing about the throughput
+    if (rayCount <= 0.0 || seconds <= 0.0)
+        return;
+
+    auto measured = rayCount / seconds;
+    if (raysPerSecond <= 0.0)
+        raysPerSecond = measured;
+    else
+        raysPerSecond += smoothing * (measured - raysPerSecond);
+}
+
+}
@@ -0,0 +1,41 @@
+#pragma once
+
+namespace HaloRay
+{
+
+/* Splits the rays of each frame between the GPU and the CPU worker
+   threads, which trace at the same time. Both sides finish together when
+   each gets rays in proportion to its throughput, which is measured from
+   every frame and smoothed over the last few. */
+class ThroughputBalancer
+{
+public:
+    // Weight of the newest measurement in the smoothed throughputs
+    static constexpr double smoothing = 0.25;
+    // Share of the CPU before both sides have been measured
+    static constexpr double initialCpuShare = 0.05;
+    /* The GPU always traces some rays, so that its throughput keeps being
+       measured */
+    static constexpr double maxCpuShare = 0.9;
+
+    ThroughputBalancer();
+
+    void addGpuMeasurement(double rayCount, double seconds);
+    void addCpuMeasurement(double rayCount, double seconds);
+
+    // Smoothed throughputs in rays per second, zero until measured
+    double getGpuRaysPerSecond() const;
+    double getCpuRaysPerSecond() const;
+
+    double getCpuShare() const;
+
+    void reset();
+
+private:
+    static void addMeasurement(double &raysPerSecond, double rayCount, double seconds);
+
+    double m_gpuRaysPerSecond;
+    double m_cpuRaysPerSecond;
+};
+
+}
@@ -0,0 +1,31 @@
+#include "toneMapping.h"
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+
+namespace HaloRay
+{
+
+std::vector<std::uint8_t> toneMap(const float *pixels, unsigned int channelCount, unsigned int width, unsigned int height,
+                                  float exposure, float fov, double tracedRayCount)
+{
+    const auto adjustedExposure = static_cast<float>(500000.0 * exposure / (fov / 180.0) / tracedRayCount);
+
+    std::vector<std::uint8_t> image(static_cast<std::size_t>(width) * height * 3);
+    for (auto y = 0u; y < height; ++y)
+    {
+        auto line = &image[static_cast<std::size_t>(height - 1 - y) * width * 3];
+        for (auto x = 0u; x < width; ++x)
+        {
+            for (auto channel = 0u; channel < 3; ++channel)
+            {
+                auto linear = 0.1f * adjustedExposure * pixels[(static_cast<std::size_t>(y) * width + x) * channelCount + channel];
+                auto gammaCorrected = 1.055f * std::pow(std::max(linear, 0.0f), 0.417f) - 0.055f;
+                line[x * 3 + channel] = static_cast<std::uint8_t>(std::round(255.0f * std::min(std::max(gammaCorrected, 0.0f), 1.0f)));
+            }
+        }
+    }
+    return image;
+}
+
+}
@@ -0,0 +1,16 @@
+#pragma once
+#include <cstdint>
+#include <vector>
+
+namespace HaloRay
+{
+
+/* Tone maps a traced image like the renderer of the main application, so
+   that the same exposure gives the same brightness. The image has the
+   given number of floats per pixel and starts from the bottom row, like
+   the simulation texture. The result has three bytes per pixel and starts
+   from the top row. */
+std::vector<std::uint8_t> toneMap(const float *pixels, unsigned int channelCount, unsigned int width, unsigned int height,
+                                  float exposure, float fov, double tracedRayCount);
+
+}
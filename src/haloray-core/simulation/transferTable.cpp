@@ -0,0 +1,99 @@
+#include "transferTable.h"
+#include <algorithm>
+#include <cmath>
+#include <sstream>
+#include <utility>
+#include "trigonometryUtilities.h"
+
+namespace HaloRay
+{
+
+std::array<float, 2> TransferTable::getSquareCoordinates(float x, float y, float z)
+{
+    // Distance from the pole along the octahedron, and the angle within the octant
+    auto ax = std::abs(x);
+    auto az = std::abs(z);
+    // Same as sqrt(1 - |y|), without losing precision near the poles
+    auto r = std::sqrt((ax * ax + az * az) / (1.0f + std::abs(y)));
+    auto a = std::max(ax, az);
+    auto phi = a == 0.0f ? 0.0f : static_cast<float>(std::atan(std::min(ax, az) / a) * 2.0 / PI);
+    if (ax < az)
+        phi = 1.0f - phi;
+
+    auto v = phi * r;
+    auto u = r - v;
+    if (y < 0.0f)
+    {
+        std::swap(u, v);
+        u = 1.0f - u;
+        v = 1.0f - v;
+    }
+
+    return {0.5f * (std::copysign(u, x) + 1.0f), 0.5f * (std::copysign(v, z) + 1.0f)};
+}
+
+std::array<float, 3> TransferTable::getDirection(float u, float v)
+{
+    auto su = 2.0f * u - 1.0f;
+    auto sv = 2.0f * v - 1.0f;
+    auto signedDistance = 1.0f - (std::abs(su) + std::abs(sv));
+    auto r = 1.0f - std::abs(signedDistance);
+    auto phi = static_cast<float>((r == 0.0f ? 1.0f : (std::abs(sv) - std::abs(su)) / r + 1.0f) * PI / 4.0);
+    auto horizontal = r * std::sqrt(std::max(0.0f, 2.0f - r * r));
+    return {std::copysign(std::cos(phi), su) * horizontal,
+            std::copysign(1.0f - r * r, signedDistance),
+            std::copysign(std::sin(phi), sv) * horizontal};
+}
+
+unsigned int TransferTable::getCellIndex(float x, float y, float z)
+{
+    auto coordinates = getSquareCoordinates(x, y, z);
+    auto column = std::min(static_cast<unsigned int>(std::max(coordinates[0], 0.0f) * incidenceResolution), incidenceResolution - 1);
+    auto row = std::min(static_cast<unsigned int>(std::max(coordinates[1], 0.0f) * incidenceResolution), incidenceResolution - 1);
+    return row * incidenceResolution + column;
+}
+
+std::array<float, 3> TransferTable::getCellDirection(unsigned int cellIndex, float u, float v)
+{
+    auto column = cellIndex % incidenceResolution;
+    auto row = cellIndex / incidenceResolution;
+    return getDirection((column + u) / incidenceResolution, (row + v) / incidenceResolution);
+}
+
+std::string TransferTable::getShapeKey(const CrystalPopulation &population)
+{
+    std::ostringstream key;
+    key << std::hexfloat;
+
+    auto writeTable = [&key, &population](TabulatedParameter parameter) {
+        if (!population.usesTable(parameter))
+            return;
+        const auto &table = population.distributionTables[parameter];
+        key << " table" << parameter;
+        for (auto edge : table.getBinEdges())
+            key << ' ' << edge;
+        for (auto weight : table.getWeights())
+            key << ' ' << weight;
+    };
+
+    // Custom shapes replace all parameters of the hexagonal crystal
+    if (!population.customShape.isEmpty())
+    {
+        key << "custom";
+        for (const auto &plane : population.customShape.getPlanes())
+            key << ' ' << plane.normal[0] << ' ' << plane.normal[1] << ' ' << plane.normal[2] << ' ' << plane.distance;
+        return key.str();
+    }
+
+    key << "hexagonal " << population.caRatioAverage << ' ' << population.caRatioStd;
+    key << ' ' << population.upperApexAngle << ' ' << population.upperApexHeightAverage << ' ' << population.upperApexHeightStd;
+    key << ' ' << population.lowerApexAngle << ' ' << population.lowerApexHeightAverage << ' ' << population.lowerApexHeightStd;
+    for (auto distance : population.prismFaceDistances)
+        key << ' ' << distance;
+    writeTable(CaRatioTable);
+    writeTable(UpperApexHeightTable);
+    writeTable(LowerApexHeightTable);
+    return key.str();
+}
+
+}
@@ -0,0 +1,66 @@
+#pragma once
+#include <array>
+#include <string>
+#include "crystalPopulation.h"
+
+namespace HaloRay
+{
+
+/* Scattering of a crystal shape in the crystal frame, independent of the
+   crystal orientation. Incidence directions are divided into cells with
+   an octahedral equal-area mapping of the sphere, whose cells have about
+   the same size and shape everywhere. Each cell holds a fixed number of
+   rays, each traced from its own random direction within the cell and
+   stored with it. Orientation distributions are applied when sampling the
+   table, by rotating the exit direction of a stored ray from its incidence
+   direction to the actual one, and then into the world frame.
+
+   A stored ray rotated this way is exactly the ray of a crystal whose
+   orientation differs from the sampled one by the rotation between the
+   two incidence directions. The table therefore blurs the orientation
+   distributions by at most maxCellDiameter, and by about 0.45 degrees on
+   average, as both directions are spread evenly within the same cell.
+   One sample in every cell is traced again on every step the table is
+   used, so the rays of the table do not stay a fixed set and the image
+   keeps converging. */
+struct TransferTable
+{
+    /* These must match the TRANSFER_TABLE_* definitions in the raytracing
+       shader */
+    static const unsigned int incidenceResolution = 256;
+    static const unsigned int samplesPerCell = 16;
+    static const unsigned int cellCount = incidenceResolution * incidenceResolution;
+    static const unsigned int sampleCount = cellCount * samplesPerCell;
+
+    /* Exit direction scaled by the ray weight and the wavelength, followed
+       by the incidence direction the ray was traced from */
+    static const unsigned int floatsPerSample = 8;
+
+    // Largest angle in degrees between two directions in the same cell
+    static constexpr double maxCellDiameter = 2.0;
+
+    // Tables are built on demand, and the least recently used ones are discarded
+    static const unsigned int maxCachedTables = 8;
+
+    /* Random numbers of the traced rays come from a stream that no crystal
+       population uses, so that they are independent of the rays sampling
+       the table */
+    static const unsigned int randomStreamIndex = 0xffffffffu;
+
+    /* Octahedral equal-area mapping between directions and the unit
+       square. The Y-axis of the crystal frame maps to the center of the
+       square. This must match the raytracing shader. */
+    static std::array<float, 2> getSquareCoordinates(float x, float y, float z);
+    static std::array<float, 3> getDirection(float u, float v);
+
+    static unsigned int getCellIndex(float x, float y, float z);
+    // Direction at the given coordinates within the cell, in the range [0, 1]
+    static std::array<float, 3> getCellDirection(unsigned int cellIndex, float u = 0.5f, float v = 0.5f);
+
+    /* Identifies the crystal geometry of a population, including the
+       distributions of its shape parameters. Populations with the same
+       key share a table regardless of their orientation. */
+    static std::string getShapeKey(const CrystalPopulation &population);
+};
+
+}
@@ -0,0 +1,96 @@
+#include "wavefront.h"
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+namespace HaloRay
+{
+
+namespace
+{
+
+// Number of rays running each number of bounce loop iterations
+std::vector<double> getIterationCounts(const PathLengthHistogram &histogram)
+{
+    std::vector<double> counts(PathLengthHistogram::maxHits + 1, 0.0);
+    for (auto pathLength = 0u; pathLength < histogram.escapedCounts.size(); ++pathLength)
+        counts[std::min(pathLength + 1, (unsigned int)PathLengthHistogram::maxHits)] += histogram.escapedCounts[pathLength];
+    counts[PathLengthHistogram::maxHits] += histogram.reachedMaxHits;
+    return counts;
+}
+
+/* Expected longest run in a lane group, when the rays of the group run
+   min(iterations - firstIteration, maxIterations) iterations each */
+double getExpectedLongestRun(const std::vector<double> &counts, unsigned int firstIteration, unsigned int maxIterations, unsigned int laneCount)
+{
+    double aliveCount = 0.0;
+    for (auto iterations = firstIteration + 1; iterations < counts.size(); ++iterations)
+        aliveCount += counts[iterations];
+    if (aliveCount <= 0.0) return 0.0;
+
+    // The longest run is at least k iterations unless every lane runs fewer
+    double longestRun = 0.0;
+    double shorterCount = 0.0;
+    for (auto k = 1u; k <= maxIterations && firstIteration + k < counts.size(); ++k)
+    {
+        longestRun += 1.0 - std::pow(shorterCount / aliveCount, static_cast<double>(laneCount));
+        shorterCount += counts[firstIteration + k];
+    }
+    return longestRun;
+}
+
+double getMeanIterations(const std::vector<double> &counts, double &rayCount)
+{
+    double sum = 0.0;
+    rayCount = 0.0;
+    for (auto iterations = 0u; iterations < counts.size(); ++iterations)
+    {
+        sum += iterations * counts[iterations];
+        rayCount += counts[iterations];
+    }
+    return rayCount > 0.0 ? sum / rayCount : 0.0;
+}
+
+}
+
+unsigned int Wavefront::getBounceQueueSize(unsigned int capacity)
+{
+    return headerSize + capacity * bounceRecordSize;
+}
+
+unsigned int Wavefront::getEscapeQueueSize(unsigned int capacity)
+{
+    return headerSize + capacity * escapeRecordSize;
+}
+
+double Wavefront::estimateMegakernelLaneUtilization(const PathLengthHistogram &histogram, unsigned int laneCount)
+{
+    auto counts = getIterationCounts(histogram);
+    double rayCount;
+    auto meanIterations = getMeanIterations(counts, rayCount);
+    if (rayCount <= 0.0) return 1.0;
+
+    return meanIterations / getExpectedLongestRun(counts, 0, PathLengthHistogram::maxHits, laneCount);
+}
+
+double Wavefront::estimateWavefrontLaneUtilization(const PathLengthHistogram &histogram, unsigned int laneCount)
+{
+    auto counts = getIterationCounts(histogram);
+    double rayCount;
+    auto meanIterations = getMeanIterations(counts, rayCount);
+    if (rayCount <= 0.0) return 1.0;
+
+    // Each bounce stage only runs the rays that are still inside crystals
+    double laneIterations = 0.0;
+    for (auto pass = 0u; pass < bouncePassCount; ++pass)
+    {
+        auto firstIteration = pass * bouncesPerPass;
+        double aliveCount = 0.0;
+        for (auto iterations = firstIteration + 1; iterations < counts.size(); ++iterations)
+            aliveCount += counts[iterations];
+        laneIterations += aliveCount / rayCount * getExpectedLongestRun(counts, firstIteration, bouncesPerPass, laneCount);
+    }
+    return meanIterations / laneIterations;
+}
+
+}
@@ -0,0 +1,50 @@
+#pragma once
+#include "pathLengthHistogram.h"
+
+namespace HaloRay
+{
+
+/* Wavefront tracing splits each dispatch of the raytracing shader into a
+   generate stage, several bounce stages and a splat stage, which pass
+   rays to each other through queues. Rays still inside a crystal after a
+   bounce stage are queued again packed together, so that lanes are not
+   left idle waiting for the longest path of their work group. These must
+   match the raytracing shader. */
+class Wavefront
+{
+public:
+    enum Stage
+    {
+        StageDisabled = 0,
+        StageGenerate = 1,
+        StageBounce = 2,
+        StageSplat = 3
+    };
+
+    // Each queue starts with an indirect dispatch header followed by the number of queued rays
+    static const unsigned int headerSize = 4;
+    static const unsigned int rayStateSize = 16;
+    static const unsigned int bounceRecordSize = 44;
+    static const unsigned int escapeRecordSize = 24;
+
+    static const unsigned int bouncesPerPass = 8;
+    // Enough bounce stages for the longest path the shader traces
+    static const unsigned int bouncePassCount = (PathLengthHistogram::maxHits + bouncesPerPass - 1) / bouncesPerPass;
+    static const unsigned int maxQueuedRays = 131072;
+
+    // Size of one queue in 32-bit words
+    static unsigned int getBounceQueueSize(unsigned int capacity);
+    static unsigned int getEscapeQueueSize(unsigned int capacity);
+
+    /* Estimated fraction of lanes doing useful work while tracing rays
+       inside crystals, from the path lengths of escaped rays and rays
+       reaching the hit limit. A lane group of a single dispatch traces
+       until its longest path ends, while wavefront tracing packs the rays
+       still inside crystals together after every bounce stage. Rays
+       terminated early are left out, since their path lengths are not
+       known. Returns 1 if there are no rays to estimate from. */
+    static double estimateMegakernelLaneUtilization(const PathLengthHistogram &histogram, unsigned int laneCount);
+    static double estimateWavefrontLaneUtilization(const PathLengthHistogram &histogram, unsigned int laneCount);
+};
+
+}
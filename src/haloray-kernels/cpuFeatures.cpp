@@ -0,0 +1,102 @@
+#include "cpuFeatures.h"
+#include <cstdint>
+
+#if defined(HALORAY_KERNELS_X86)
+#if defined(_MSC_VER)
+#include <intrin.h>
+#include <immintrin.h>
+#else
+#include <cpuid.h>
+#endif
+#endif
+
+namespace HaloRay
+{
+namespace Kernels
+{
+
+namespace
+{
+
+#if defined(HALORAY_KERNELS_X86)
+
+struct CpuidResult
+{
+    std::uint32_t eax;
+    std::uint32_t ebx;
+    std::uint32_t ecx;
+    std::uint32_t edx;
+};
+
+CpuidResult cpuid(std::uint32_t leaf, std::uint32_t subleaf)
+{
+#if defined(_MSC_VER)
+    int registers[4];
+    __cpuidex(registers, static_cast<int>(leaf), static_cast<int>(subleaf));
+    return {static_cast<std::uint32_t>(registers[0]), static_cast<std::uint32_t>(registers[1]),
+            static_cast<std::uint32_t>(registers[2]), static_cast<std::uint32_t>(registers[3])};
+#else
+    CpuidResult result = {0, 0, 0, 0};
+    __cpuid_count(leaf, subleaf, result.eax, result.ebx, result.ecx, result.edx);
+    return result;
+#endif
+}
+
+// Register states the operating system saves when switching threads
+std::uint64_t getEnabledRegisterStates()
+{
+#if defined(_MSC_VER)
+    return _xgetbv(0);
+#else
+    std::uint32_t low;
+    std::uint32_t high;
+    __asm__("xgetbv" : "=a"(low), "=d"(high) : "c"(0));
+    return (static_cast<std::uint64_t>(high) << 32) | low;
+#endif
+}
+
+bool hasBit(std::uint32_t value, unsigned int bit)
+{
+    return (value >> bit) & 1u;
+}
+
+CpuFeatures detectFeatures()
+{
+    CpuFeatures features = {false, false, false};
+    auto maxLeaf = cpuid(0, 0).eax;
+    if (maxLeaf < 1) return features;
+
+    auto leaf1 = cpuid(1, 0);
+    features.sse4 = hasBit(leaf1.ecx, 19);
+
+    // AVX registers are only usable if the operating system saves them
+    if (!hasBit(leaf1.ecx, 27) || maxLeaf < 7) return features;
+    auto registerStates = getEnabledRegisterStates();
+    auto avxStates = (registerStates & 0x6) == 0x6;
+    auto avx512States = (registerStates & 0xe6) == 0xe6;
+
+    auto leaf7 = cpuid(7, 0);
+    features.avx2 = avxStates && hasBit(leaf7.ebx, 5);
+    features.avx512 = avx512States && features.avx2 && hasBit(leaf7.ebx, 16);
+    return features;
+}
+
+#else
+
+CpuFeatures detectFeatures()
+{
+    return {false, false, false};
+}
+
+#endif
+
+}
+
+const CpuFeatures &CpuFeatures::get()
+{
+    static const CpuFeatures features = detectFeatures();
+    return features;
+}
+
+}
+}
@@ -0,0 +1,21 @@
+#pragma once
+
+namespace HaloRay
+{
+namespace Kernels
+{
+
+/* Instruction sets the processor and operating system support, checked
+   once at run time. Everything is unsupported on other architectures
+   than x86. */
+struct CpuFeatures
+{
+    bool sse4;
+    bool avx2;
+    bool avx512;
+
+    static const CpuFeatures &get();
+};
+
+}
+}
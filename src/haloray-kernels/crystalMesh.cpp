@@ -0,0 +1,160 @@
+#include "crystalMesh.h"
+#include <algorithm>
+#include <cmath>
+
+namespace HaloRay
+{
+namespace Kernels
+{
+
+namespace
+{
+
+const float PI = 3.1415926535f;
+
+/* Lines are represented in Hesse normal form, where the first component
+   is the closest distance from origin to the line, and the second is the
+   angle of the line's normal in radians. Returns the intersection as X
+   and Z coordinates. */
+void lineIntersect(float p1, float theta1, float p2, float theta2, float &x, float &z)
+{
+    auto deltaSine = std::sin(theta2 - theta1);
+    x = (p1 * std::sin(theta2) - p2 * std::sin(theta1)) / deltaSine;
+    z = (p2 * std::cos(theta1) - p1 * std::cos(theta2)) / deltaSine;
+}
+
+}
+
+const unsigned int CrystalMesh::triangles[CrystalMesh::triangleCount][3] = {
+    // Face 1 (basal)
+    {0, 1, 3}, {1, 2, 3}, {0, 3, 4}, {0, 4, 5},
+    // Face 1 (pyramid edges)
+    {0, 6, 1}, {6, 7, 1}, {1, 7, 2}, {7, 8, 2}, {2, 8, 3}, {8, 9, 3},
+    {3, 9, 4}, {9, 10, 4}, {4, 10, 5}, {10, 11, 5}, {5, 11, 0}, {11, 6, 0},
+    // Face 2 (basal)
+    {18, 21, 19}, {19, 21, 20}, {18, 22, 21}, {18, 23, 22},
+    // Face 2 (pyramid edges)
+    {12, 18, 13}, {18, 19, 13}, {13, 19, 14}, {19, 20, 14}, {14, 20, 15}, {20, 21, 15},
+    {15, 21, 16}, {21, 22, 16}, {16, 22, 17}, {22, 23, 17}, {17, 23, 12}, {23, 18, 12},
+    // Faces 3 to 8 (prism)
+    {6, 12, 7}, {12, 13, 7},
+    {7, 13, 8}, {13, 14, 8},
+    {8, 14, 9}, {14, 15, 9},
+    {9, 15, 10}, {15, 16, 10},
+    {10, 16, 11}, {16, 17, 11},
+    {11, 17, 6}, {17, 12, 6},
+};
+
+HexagonalCrystalShape HexagonalCrystalShape::createDefault()
+{
+    HexagonalCrystalShape shape;
+    std::fill(shape.prismFaceDistances, shape.prismFaceDistances + 6, 1.0f);
+    shape.caRatio = 1.0f;
+    shape.upperApexAngle = 56.142f * PI / 180.0f;
+    shape.lowerApexAngle = 56.142f * PI / 180.0f;
+    shape.upperApexHeight = 0.0f;
+    shape.lowerApexHeight = 0.0f;
+    return shape;
+}
+
+CrystalMesh createHexagonalCrystal(const HexagonalCrystalShape &shape)
+{
+    const auto deltaAngle = 60.0f * PI / 180.0f;
+    float cornersX[6];
+    float cornersZ[6];
+    /* The sqrt(3)/2 multiplier makes the default crystal such that the
+       distance of a vertex from the C axis is 1.0 */
+    const auto sizeScaler = std::cos(30.0f * PI / 180.0f);
+    for (auto face = 0; face < 6; ++face)
+    {
+        auto previousFace = face == 0 ? 5 : face - 1;
+        auto nextFace = face == 5 ? 0 : face + 1;
+
+        auto previousAngle = (face + 1) * deltaAngle;
+        auto currentAngle = previousAngle + deltaAngle;
+        auto nextAngle = previousAngle + 2.0f * deltaAngle;
+
+        auto previousDistance = sizeScaler * shape.prismFaceDistances[previousFace];
+        auto currentDistance = sizeScaler * shape.prismFaceDistances[face];
+        auto nextDistance = sizeScaler * shape.prismFaceDistances[nextFace];
+
+        float previousCurrentX, previousCurrentZ, currentNextX, currentNextZ, previousNextX, previousNextZ;
+        lineIntersect(previousDistance, previousAngle, currentDistance, currentAngle, previousCurrentX, previousCurrentZ);
+        lineIntersect(currentDistance, currentAngle, nextDistance, nextAngle, currentNextX, currentNextZ);
+        lineIntersect(previousDistance, previousAngle, nextDistance, nextAngle, previousNextX, previousNextZ);
+
+        auto previousCurrentDistance = std::hypot(previousCurrentX, previousCurrentZ);
+        auto currentNextDistance = std::hypot(currentNextX, currentNextZ);
+        auto previousNextDistance = std::hypot(previousNextX, previousNextZ);
+
+        auto v1X = previousCurrentDistance < previousNextDistance ? previousCurrentX : previousNextX;
+        auto v1Z = previousCurrentDistance < previousNextDistance ? previousCurrentZ : previousNextZ;
+        auto v2X = currentNextDistance < previousNextDistance ? currentNextX : previousNextX;
+        auto v2Z = currentNextDistance < previousNextDistance ? currentNextZ : previousNextZ;
+
+        if (face > 0 && previousNextDistance > std::hypot(cornersX[face], cornersZ[face]))
+        {
+            v1X = cornersX[face];
+            v1Z = cornersZ[face];
+        }
+
+        if (face == 5 && previousNextDistance > std::hypot(cornersX[nextFace], cornersZ[nextFace]))
+        {
+            v2X = cornersX[nextFace];
+            v2Z = cornersZ[nextFace];
+        }
+
+        cornersX[face] = v1X;
+        cornersZ[face] = v1Z;
+        cornersX[nextFace] = v2X;
+        cornersZ[nextFace] = v2Z;
+    }
+
+    CrystalMesh mesh;
+    auto &vertices = mesh.vertices;
+    for (auto face = 0; face < 6; ++face)
+    {
+        vertices[face] = {cornersX[face], 1.0f, cornersZ[face]};
+        vertices[face + 6] = {cornersX[face], 1.0f, cornersZ[face]};
+        vertices[face + 12] = {cornersX[face], -1.0f, cornersZ[face]};
+        vertices[face + 18] = {cornersX[face], -1.0f, cornersZ[face]};
+    }
+
+    // Stretch the crystal to correct C/A ratio
+    auto caMultiplier = std::max(0.0f, shape.caRatio);
+    for (auto &vertex : vertices)
+        vertex.y *= caMultiplier;
+
+    // Scale pyramid caps
+    auto upperApexMaxHeight = sizeScaler / std::tan(shape.upperApexAngle / 2.0f);
+    auto lowerApexMaxHeight = sizeScaler / std::tan(shape.lowerApexAngle / 2.0f);
+    auto upperApexHeight = std::clamp(shape.upperApexHeight, 0.0f, 1.0f);
+    auto lowerApexHeight = std::clamp(shape.lowerApexHeight, 0.0f, 1.0f);
+    for (auto i = 0u; i < 6; ++i)
+    {
+        vertices[i].x *= 1.0f - upperApexHeight;
+        vertices[i].z *= 1.0f - upperApexHeight;
+        vertices[i].y += upperApexHeight * upperApexMaxHeight;
+
+        auto &lowerVertex = vertices[CrystalMesh::vertexCount - i - 1];
+        lowerVertex.x *= 1.0f - lowerApexHeight;
+        lowerVertex.z *= 1.0f - lowerApexHeight;
+        lowerVertex.y -= lowerApexHeight * lowerApexMaxHeight;
+    }
+
+    // As computed in selectFirstTriangle of the shader
+    for (auto i = 0u; i < CrystalMesh::triangleCount; ++i)
+    {
+        auto v0 = vertices[CrystalMesh::triangles[i][0]];
+        auto v1 = vertices[CrystalMesh::triangles[i][1]];
+        auto v2 = vertices[CrystalMesh::triangles[i][2]];
+        auto crossProduct = cross(v2 - v0, v1 - v0);
+        mesh.areas[i] = 0.5f * length(crossProduct);
+        mesh.normals[i] = mesh.areas[i] > 0.0f ? normalize(crossProduct) : Vector3{0.0f, 0.0f, 0.0f};
+    }
+
+    return mesh;
+}
+
+}
+}
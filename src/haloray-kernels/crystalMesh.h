@@ -0,0 +1,45 @@
+#pragma once
+#include "linearAlgebra.h"
+
+namespace HaloRay
+{
+namespace Kernels
+{
+
+/* Shape of a single hexagonal crystal, with the randomly sampled
+   parameters of its population already drawn */
+struct HexagonalCrystalShape
+{
+    // Relative distances of the prism faces from the C-axis
+    float prismFaceDistances[6];
+    float caRatio;
+    // Full apex angles of the pyramid caps in radians
+    float upperApexAngle;
+    float lowerApexAngle;
+    // Heights of the pyramid caps from zero to one
+    float upperApexHeight;
+    float lowerApexHeight;
+
+    static HexagonalCrystalShape createDefault();
+};
+
+/* Triangle mesh of a hexagonal crystal as built by the raytracing shader.
+   Triangles are wound so that the Möller-Trumbore test only finds them
+   from inside the crystal. */
+struct CrystalMesh
+{
+    static const unsigned int vertexCount = 24;
+    static const unsigned int triangleCount = 44;
+    static const unsigned int triangles[triangleCount][3];
+
+    Vector3 vertices[vertexCount];
+    // Outward unit normals and areas of the triangles
+    Vector3 normals[triangleCount];
+    float areas[triangleCount];
+};
+
+// Mirrors initializeCrystal in the raytracing shader
+CrystalMesh createHexagonalCrystal(const HexagonalCrystalShape &shape);
+
+}
+}
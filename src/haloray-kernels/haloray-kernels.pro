@@ -0,0 +1,39 @@
+TARGET = HaloRayKernels
+TEMPLATE = lib
+
+CONFIG += c++17 static
+CONFIG -= qt
+
+HEADERS += \
+    cpuFeatures.h \
+    crystalMesh.h \
+    linearAlgebra.h \
+    packetTraceJob.h \
+    packetTracer.h \
+    randomStream.h \
+    rayBatch.h \
+    rayTracer.h \
+    scalarTracer.h \
+    sceneTracer.h \
+    splatFilter.h \
+    simd/avx2.h \
+    simd/avx512.h \
+    simd/sse4.h
+
+SOURCES += \
+    cpuFeatures.cpp \
+    crystalMesh.cpp \
+    rayBatch.cpp \
+    rayTracer.cpp \
+    scalarTracer.cpp \
+    sceneTracer.cpp \
+    splatFilter.cpp
+
+# Packet kernels are compiled for their own instruction sets and picked at run time
+contains(QT_ARCH, x86_64)|contains(QT_ARCH, i386) {
+    DEFINES += HALORAY_KERNELS_X86
+    CONFIG += simd
+    SSE4_1_SOURCES += packetTracerSse4.cpp
+    AVX2_SOURCES += packetTracerAvx2.cpp
+    AVX512F_SOURCES += packetTracerAvx512.cpp
+}
@@ -0,0 +1,68 @@
+#pragma once
+#include <cmath>
+
+namespace HaloRay
+{
+namespace Kernels
+{
+
+/* Vector and matrix types with the semantics of their GLSL counterparts,
+   so that the kernels can mirror the raytracing shader line by line */
+struct Vector3
+{
+    float x;
+    float y;
+    float z;
+};
+
+inline Vector3 operator+(Vector3 a, Vector3 b) { return {a.x + b.x, a.y + b.y, a.z + b.z}; }
+inline Vector3 operator-(Vector3 a, Vector3 b) { return {a.x - b.x, a.y - b.y, a.z - b.z}; }
+inline Vector3 operator-(Vector3 a) { return {-a.x, -a.y, -a.z}; }
+inline Vector3 operator*(float s, Vector3 a) { return {s * a.x, s * a.y, s * a.z}; }
+
+inline float dot(Vector3 a, Vector3 b) { return a.x * b.x + a.y * b.y + a.z * b.z; }
+inline float length(Vector3 a) { return std::sqrt(dot(a, a)); }
+inline Vector3 normalize(Vector3 a) { return (1.0f / length(a)) * a; }
+
+inline Vector3 cross(Vector3 a, Vector3 b)
+{
+    return {a.y * b.z - a.z * b.y, a.z * b.x - a.x * b.z, a.x * b.y - a.y * b.x};
+}
+
+inline Vector3 reflect(Vector3 incident, Vector3 normal)
+{
+    return incident - 2.0f * dot(normal, incident) * normal;
+}
+
+inline Vector3 refract(Vector3 incident, Vector3 normal, float eta)
+{
+    auto cosine = dot(normal, incident);
+    auto k = 1.0f - eta * eta * (1.0f - cosine * cosine);
+    if (k < 0.0f) return {0.0f, 0.0f, 0.0f};
+    return eta * incident - (eta * cosine + std::sqrt(k)) * normal;
+}
+
+// Column-major like GLSL mat3
+struct Matrix3
+{
+    Vector3 columns[3];
+};
+
+inline Vector3 operator*(const Matrix3 &m, Vector3 v)
+{
+    return v.x * m.columns[0] + v.y * m.columns[1] + v.z * m.columns[2];
+}
+
+// Row vector times matrix, which applies the inverse of a rotation
+inline Vector3 operator*(Vector3 v, const Matrix3 &m)
+{
+    return {dot(v, m.columns[0]), dot(v, m.columns[1]), dot(v, m.columns[2])};
+}
+
+inline Matrix3 operator*(const Matrix3 &a, const Matrix3 &b)
+{
+    return {{a * b.columns[0], a * b.columns[1], a * b.columns[2]}};
+}
+
+}
+}
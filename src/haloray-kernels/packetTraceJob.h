@@ -0,0 +1,43 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include "crystalMesh.h"
+
+namespace HaloRay
+{
+namespace Kernels
+{
+
+/* Plain arrays of a ray batch for the packet kernels. The kernels are
+   compiled for other instruction sets than the rest of the library, so
+   they are handed only plain data, see packetTracer.h. */
+struct PacketTraceJob
+{
+    const CrystalMesh *meshes;
+    bool sharedMesh;
+    std::size_t rayCount;
+    const float *originX;
+    const float *originY;
+    const float *originZ;
+    float *directionX;
+    float *directionY;
+    float *directionZ;
+    const float *indexOfRefraction;
+    float *weight;
+    const std::uint32_t *rayIndex;
+    std::int32_t *status;
+    int russianRouletteDepth;
+    std::uint32_t seed;
+    std::uint32_t populationIndex;
+    std::uint32_t rayIndexHigh;
+    std::uint32_t firstDraw;
+};
+
+/* Packet kernels, each in a source file compiled for its instruction set.
+   Only call these after checking that the processor supports it. */
+void tracePacketsSse4(const PacketTraceJob &job);
+void tracePacketsAvx2(const PacketTraceJob &job);
+void tracePacketsAvx512(const PacketTraceJob &job);
+
+}
+}
@@ -0,0 +1,317 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include "crystalMesh.h"
+#include "packetTraceJob.h"
+#include "randomStream.h"
+#include "rayBatch.h"
+
+namespace HaloRay
+{
+namespace Kernels
+{
+
+/* Packet version of traceRay in scalarTracer.cpp, tracing one ray in each
+   SIMD lane. Lanes that escape or are lost are masked off while the rest
+   keep bouncing, until every lane is done.
+
+   This is included once by the source file of each instruction set, with
+   the SIMD wrapper of that instruction set. Everything here is in an
+   anonymous namespace and must not call inline functions shared with the
+   rest of the library, like the vector operations or RandomStream::get.
+   The linker is free to keep any one of the copies of such a function,
+   and might pick the one compiled for AVX-512 for a processor without it. */
+namespace
+{
+
+template <typename S>
+struct PacketVector
+{
+    typename S::Float x;
+    typename S::Float y;
+    typename S::Float z;
+};
+
+template <typename S>
+typename S::Float dotLanes(const PacketVector<S> &a, const PacketVector<S> &b)
+{
+    return a.x * b.x + a.y * b.y + a.z * b.z;
+}
+
+template <typename S>
+PacketVector<S> crossLanes(const PacketVector<S> &a, const PacketVector<S> &b)
+{
+    return {a.y * b.z - a.z * b.y, a.z * b.x - a.x * b.z, a.x * b.y - a.y * b.x};
+}
+
+template <typename S>
+PacketVector<S> selectLanes(typename S::Mask mask, const PacketVector<S> &a, const PacketVector<S> &b)
+{
+    return {S::select(mask, a.x, b.x), S::select(mask, a.y, b.y), S::select(mask, a.z, b.z)};
+}
+
+// Triangles of the crystal in each lane, with the inward normals used when tracing
+template <typename S>
+struct PacketMesh
+{
+    PacketVector<S> v0[CrystalMesh::triangleCount];
+    PacketVector<S> v0v1[CrystalMesh::triangleCount];
+    PacketVector<S> v0v2[CrystalMesh::triangleCount];
+    PacketVector<S> normal[CrystalMesh::triangleCount];
+};
+
+template <typename S>
+void loadPacketMesh(const CrystalMesh *const *laneMeshes, PacketMesh<S> &mesh)
+{
+    alignas(64) float lanes[12][S::width];
+    for (auto triangleIndex = 0u; triangleIndex < CrystalMesh::triangleCount; ++triangleIndex)
+    {
+        const auto &triangle = CrystalMesh::triangles[triangleIndex];
+        for (auto lane = 0u; lane < S::width; ++lane)
+        {
+            const auto &laneMesh = *laneMeshes[lane];
+            const auto &v0 = laneMesh.vertices[triangle[0]];
+            const auto &v1 = laneMesh.vertices[triangle[1]];
+            const auto &v2 = laneMesh.vertices[triangle[2]];
+            const auto &normal = laneMesh.normals[triangleIndex];
+            const float values[12] = {
+                v0.x, v0.y, v0.z,
+                v1.x - v0.x, v1.y - v0.y, v1.z - v0.z,
+                v2.x - v0.x, v2.y - v0.y, v2.z - v0.z,
+                -normal.x, -normal.y, -normal.z};
+            for (auto value = 0u; value < 12; ++value)
+                lanes[value][lane] = values[value];
+        }
+
+        mesh.v0[triangleIndex] = {S::load(lanes[0]), S::load(lanes[1]), S::load(lanes[2])};
+        mesh.v0v1[triangleIndex] = {S::load(lanes[3]), S::load(lanes[4]), S::load(lanes[5])};
+        mesh.v0v2[triangleIndex] = {S::load(lanes[6]), S::load(lanes[7]), S::load(lanes[8])};
+        mesh.normal[triangleIndex] = {S::load(lanes[9]), S::load(lanes[10]), S::load(lanes[11])};
+    }
+}
+
+// Same as RandomStream::get, with the ray index of each lane
+template <typename S>
+typename S::Float getRandomLanes(const PacketTraceJob &job, typename S::Int rayIndex, std::uint32_t draw)
+{
+    typename S::Int counter[4] = {rayIndex,
+                                  S::broadcastInt(static_cast<std::int32_t>(job.rayIndexHigh)),
+                                  S::broadcastInt(static_cast<std::int32_t>(draw / 4)),
+                                  S::broadcastInt(0)};
+    const auto multiplier0 = S::broadcastInt(static_cast<std::int32_t>(RandomStream::multiplier0));
+    const auto multiplier1 = S::broadcastInt(static_cast<std::int32_t>(RandomStream::multiplier1));
+    auto key0 = job.seed;
+    auto key1 = job.populationIndex;
+    for (auto round = 0u; round < RandomStream::rounds; ++round)
+    {
+        auto x = S::mulHigh(multiplier1, counter[2]) ^ counter[1] ^ S::broadcastInt(static_cast<std::int32_t>(key0));
+        auto z = S::mulHigh(multiplier0, counter[0]) ^ counter[3] ^ S::broadcastInt(static_cast<std::int32_t>(key1));
+        counter[1] = multiplier1 * counter[2];
+        counter[3] = multiplier0 * counter[0];
+        counter[0] = x;
+        counter[2] = z;
+
+        key0 += RandomStream::weyl0;
+        key1 += RandomStream::weyl1;
+    }
+
+    // Unsigned to float in two exact halves, so that the sum is rounded once like in RandomStream::toUniform
+    auto number = counter[draw % 4];
+    auto high = S::toFloat(number >> 16) * S::broadcast(65536.0f);
+    auto low = S::toFloat(number & S::broadcastInt(0xffff));
+    return (high + low) * S::broadcast(1.0f / 4294967296.0f);
+}
+
+// Inputs past the end of the batch are padded with the first ray of the packet
+template <typename S, typename T>
+void copyLanes(const T *data, unsigned int count, T *lanes)
+{
+    for (auto lane = 0u; lane < S::width; ++lane)
+        lanes[lane] = data[lane < count ? lane : 0];
+}
+
+template <typename S>
+typename S::Float loadLanes(const float *data, unsigned int count)
+{
+    if (count == S::width) return S::load(data);
+    alignas(64) float lanes[S::width];
+    copyLanes<S>(data, count, lanes);
+    return S::load(lanes);
+}
+
+template <typename S>
+typename S::Int loadLanes(const std::uint32_t *data, unsigned int count)
+{
+    alignas(64) std::int32_t lanes[S::width];
+    for (auto lane = 0u; lane < S::width; ++lane)
+        lanes[lane] = static_cast<std::int32_t>(data[lane < count ? lane : 0]);
+    return S::load(lanes);
+}
+
+template <typename S, typename T, typename V>
+void storeLanes(T *data, unsigned int count, V value)
+{
+    if (count == S::width)
+    {
+        S::store(data, value);
+        return;
+    }
+    alignas(64) T lanes[S::width];
+    S::store(lanes, value);
+    for (auto lane = 0u; lane < count; ++lane)
+        data[lane] = lanes[lane];
+}
+
+template <typename S>
+void tracePacket(const PacketTraceJob &job, const PacketMesh<S> &mesh, std::size_t first, unsigned int count)
+{
+    const auto zero = S::broadcast(0.0f);
+    const auto one = S::broadcast(1.0f);
+    const PacketVector<S> noDirection = {zero, zero, zero};
+
+    PacketVector<S> ro = {loadLanes<S>(job.originX + first, count),
+                          loadLanes<S>(job.originY + first, count),
+                          loadLanes<S>(job.originZ + first, count)};
+    PacketVector<S> rd = {loadLanes<S>(job.directionX + first, count),
+                          loadLanes<S>(job.directionY + first, count),
+                          loadLanes<S>(job.directionZ + first, count)};
+    auto indexOfRefraction = loadLanes<S>(job.indexOfRefraction + first, count);
+    auto weight = loadLanes<S>(job.weight + first, count);
+    auto rayIndex = loadLanes<S>(job.rayIndex + first, count);
+
+    auto exitDirection = noDirection;
+    auto status = S::broadcastInt(TraceReachedMaxHits);
+    auto active = S::firstLanes(count);
+
+    auto totalInternalReflectionRun = S::none();
+    auto orbitStartPoint = noDirection;
+    auto orbitStartDirection = noDirection;
+
+    for (auto i = 0; i < TraceSettings::maxHits && S::any(active); ++i)
+    {
+        // First triangle hit in each lane, like findIntersection
+        auto didHit = S::none();
+        auto t = zero;
+        auto normal = noDirection;
+        for (auto triangleIndex = 0u; triangleIndex < CrystalMesh::triangleCount; ++triangleIndex)
+        {
+            const auto &v0 = mesh.v0[triangleIndex];
+            const auto &v0v1 = mesh.v0v1[triangleIndex];
+            const auto &v0v2 = mesh.v0v2[triangleIndex];
+
+            auto pVec = crossLanes<S>(rd, v0v2);
+            auto determinant = dotLanes<S>(v0v1, pVec);
+            PacketVector<S> tVec = {ro.x - v0.x, ro.y - v0.y, ro.z - v0.z};
+            auto u = dotLanes<S>(tVec, pVec);
+            auto qVec = crossLanes<S>(tVec, v0v1);
+            auto v = dotLanes<S>(rd, qVec);
+
+            auto isHit = (determinant >= S::broadcast(0.000001f)) & (u >= zero) & (u <= determinant) &
+                         (v >= zero) & (u + v <= determinant);
+            auto isFirstHit = S::andNot(isHit & active, didHit);
+            t = S::select(isFirstHit, dotLanes<S>(v0v2, qVec) / determinant, t);
+            normal = selectLanes<S>(isFirstHit, mesh.normal[triangleIndex], normal);
+            didHit = didHit | isFirstHit;
+            if (!S::any(S::andNot(active, didHit))) break;
+        }
+
+        // Like in the shader, rays that find no exit are counted with those reaching the maximum
+        active = active & didHit;
+        if (!S::any(active)) break;
+
+        // Fresnel equations like getReflectionCoefficient, without the trigonometric round trip
+        auto incidentCos = zero - dotLanes<S>(rd, normal);
+        auto incidentSin = S::sqrt(S::max(zero, one - incidentCos * incidentCos));
+        auto transmittedSin = indexOfRefraction * incidentSin;
+        auto transmittedCos = S::sqrt(S::max(zero, one - transmittedSin * transmittedSin));
+        auto rs = (indexOfRefraction * incidentCos - transmittedCos) / (indexOfRefraction * incidentCos + transmittedCos);
+        auto rp = (indexOfRefraction * transmittedCos - incidentCos) / (indexOfRefraction * transmittedCos + incidentCos);
+        auto totalInternalReflection = one / indexOfRefraction < incidentSin;
+        auto reflectionCoefficient = S::select(totalInternalReflection, one, S::broadcast(0.5f) * (rs * rs + rp * rp));
+
+        // Closed total internal reflection orbits, see traceRay
+        PacketVector<S> hitPoint = {ro.x + t * rd.x, ro.y + t * rd.y, ro.z + t * rd.z};
+        PacketVector<S> orbitOffset = {hitPoint.x - orbitStartPoint.x, hitPoint.y - orbitStartPoint.y, hitPoint.z - orbitStartPoint.z};
+        auto orbitPointTolerance = S::broadcast(TraceSettings::orbitPointTolerance);
+        auto trapped = active & totalInternalReflection & totalInternalReflectionRun &
+                       (dotLanes<S>(orbitOffset, orbitOffset) < orbitPointTolerance * orbitPointTolerance) &
+                       (dotLanes<S>(rd, orbitStartDirection) > S::broadcast(TraceSettings::orbitDirectionTolerance));
+        auto orbitStart = S::andNot(totalInternalReflection, totalInternalReflectionRun);
+        orbitStartPoint = selectLanes<S>(orbitStart, hitPoint, orbitStartPoint);
+        orbitStartDirection = selectLanes<S>(orbitStart, rd, orbitStartDirection);
+        totalInternalReflectionRun = totalInternalReflection;
+        status = S::select(trapped, S::broadcastInt(TraceTrappedInOrbit), status);
+        active = S::andNot(active, trapped);
+
+        // Same as RandomStream::getReflectionDraw
+        auto draw = job.firstDraw + static_cast<std::uint32_t>(i > job.russianRouletteDepth ? 2 * i - job.russianRouletteDepth : i);
+        if (i >= job.russianRouletteDepth)
+        {
+            auto survivalProbability = S::broadcast(TraceSettings::russianRouletteSurvivalProbability);
+            auto terminated = active & (getRandomLanes<S>(job, rayIndex, draw++) > survivalProbability);
+            status = S::select(terminated, S::broadcastInt(TraceTerminatedByRoulette), status);
+            active = S::andNot(active, terminated);
+            weight = S::select(active, weight / survivalProbability, weight);
+        }
+
+        auto reflects = getRandomLanes<S>(job, rayIndex, draw) < reflectionCoefficient;
+        auto refracts = S::andNot(active, reflects);
+
+        // Refraction out of the crystal like GLSL refract
+        auto cosine = dotLanes<S>(normal, rd);
+        auto k = one - indexOfRefraction * indexOfRefraction * (one - cosine * cosine);
+        auto normalScale = indexOfRefraction * cosine + S::sqrt(S::max(zero, k));
+        PacketVector<S> refracted = {indexOfRefraction * rd.x - normalScale * normal.x,
+                                     indexOfRefraction * rd.y - normalScale * normal.y,
+                                     indexOfRefraction * rd.z - normalScale * normal.z};
+        exitDirection = selectLanes<S>(refracts, selectLanes<S>(k < zero, noDirection, refracted), exitDirection);
+        status = S::select(refracts, S::broadcastInt(i), status);
+        active = S::andNot(active, refracts);
+
+        // Reflection back into the crystal
+        auto reflectionScale = S::broadcast(2.0f) * cosine;
+        ro = selectLanes<S>(active, hitPoint, ro);
+        rd = selectLanes<S>(active, {rd.x - reflectionScale * normal.x,
+                                     rd.y - reflectionScale * normal.y,
+                                     rd.z - reflectionScale * normal.z}, rd);
+    }
+
+    storeLanes<S>(job.directionX + first, count, exitDirection.x);
+    storeLanes<S>(job.directionY + first, count, exitDirection.y);
+    storeLanes<S>(job.directionZ + first, count, exitDirection.z);
+    storeLanes<S>(job.weight + first, count, weight);
+    storeLanes<S>(job.status + first, count, status);
+}
+
+template <typename S>
+void tracePackets(const PacketTraceJob &job)
+{
+    if (job.rayCount == 0) return;
+
+    PacketMesh<S> mesh;
+    const CrystalMesh *laneMeshes[S::width];
+    if (job.sharedMesh)
+    {
+        for (auto lane = 0u; lane < S::width; ++lane)
+            laneMeshes[lane] = job.meshes;
+        loadPacketMesh<S>(laneMeshes, mesh);
+    }
+
+    for (std::size_t first = 0; first < job.rayCount; first += S::width)
+    {
+        auto remaining = job.rayCount - first;
+        auto count = static_cast<unsigned int>(remaining < S::width ? remaining : S::width);
+        if (!job.sharedMesh)
+        {
+            for (auto lane = 0u; lane < S::width; ++lane)
+                laneMeshes[lane] = job.meshes + first + (lane < count ? lane : 0);
+            loadPacketMesh<S>(laneMeshes, mesh);
+        }
+        tracePacket<S>(job, mesh, first, count);
+    }
+}
+
+}
+
+}
+}
@@ -0,0 +1,15 @@
+#include "packetTracer.h"
+#include "simd/avx2.h"
+
+namespace HaloRay
+{
+namespace Kernels
+{
+
+void tracePacketsAvx2(const PacketTraceJob &job)
+{
+    tracePackets<Simd::Avx2>(job);
+}
+
+}
+}
@@ -0,0 +1,15 @@
+#include "packetTracer.h"
+#include "simd/avx512.h"
+
+namespace HaloRay
+{
+namespace Kernels
+{
+
+void tracePacketsAvx512(const PacketTraceJob &job)
+{
+    tracePackets<Simd::Avx512>(job);
+}
+
+}
+}
@@ -0,0 +1,15 @@
+#include "packetTracer.h"
+#include "simd/sse4.h"
+
+namespace HaloRay
+{
+namespace Kernels
+{
+
+void tracePacketsSse4(const PacketTraceJob &job)
+{
+    tracePackets<Simd::Sse4>(job);
+}
+
+}
+}
@@ -0,0 +1,134 @@
+#pragma once
+#include <cstdint>
+
+namespace HaloRay
+{
+namespace Kernels
+{
+
+/* Random numbers of the raytracing shader, so that a ray traced on the
+   CPU gets the same numbers as on the GPU, no matter which kernel traces
+   it or which other rays are traced with it. Each ray has a Philox4x32-10
+   stream keyed by the run seed and the crystal population, with the
+   counter formed from the 64-bit ray index and the block of four numbers.
+   Draws are numbered in the order the shader makes them, and internal
+   reflection i starts at the draw given by getReflectionDraw. */
+namespace RandomStream
+{
+const std::uint32_t multiplier0 = 0xd2511f53u;
+const std::uint32_t multiplier1 = 0xcd9e8d57u;
+const std::uint32_t weyl0 = 0x9e3779b9u;
+const std::uint32_t weyl1 = 0xbb67ae85u;
+const unsigned int rounds = 10;
+
+// Same as the Philox class of the core library
+inline void philox(std::uint32_t counter[4], std::uint32_t key0, std::uint32_t key1)
+{
+    for (auto round = 0u; round < rounds; ++round)
+    {
+        auto product0 = static_cast<std::uint64_t>(multiplier0) * counter[0];
+        auto product1 = static_cast<std::uint64_t>(multiplier1) * counter[2];
+        auto x = static_cast<std::uint32_t>(product1 >> 32) ^ counter[1] ^ key0;
+        auto z = static_cast<std::uint32_t>(product0 >> 32) ^ counter[3] ^ key1;
+        counter[0] = x;
+        counter[1] = static_cast<std::uint32_t>(product1);
+        counter[2] = z;
+        counter[3] = static_cast<std::uint32_t>(product0);
+
+        key0 += weyl0;
+        key1 += weyl1;
+    }
+}
+
+// Four consecutive draws of a ray starting from draw 4 * block
+inline void getBlock(std::uint32_t seed, std::uint32_t populationIndex, std::uint64_t rayIndex, std::uint32_t block,
+                     std::uint32_t numbers[4])
+{
+    numbers[0] = static_cast<std::uint32_t>(rayIndex);
+    numbers[1] = static_cast<std::uint32_t>(rayIndex >> 32);
+    numbers[2] = block;
+    numbers[3] = 0u;
+    philox(numbers, seed, populationIndex);
+}
+
+// Uniform random number in [0, 1] like rand in the shader
+inline float toUniform(std::uint32_t number)
+{
+    return static_cast<float>(number) / 4294967295.0f;
+}
+
+inline float get(std::uint32_t seed, std::uint32_t populationIndex, std::uint64_t rayIndex, std::uint32_t draw)
+{
+    std::uint32_t numbers[4];
+    getBlock(seed, populationIndex, rayIndex, draw / 4, numbers);
+    return toUniform(numbers[draw % 4]);
+}
+
+/* Draw of the Russian roulette of internal reflection i, or of choosing
+   between reflection and refraction before the roulette starts. Every
+   earlier reflection made one draw, and those past the roulette depth
+   another one. */
+inline std::uint32_t getReflectionDraw(std::uint32_t firstDraw, int russianRouletteDepth, int reflection)
+{
+    auto rouletteDraws = reflection > russianRouletteDepth ? reflection - russianRouletteDepth : 0;
+    return firstDraw + static_cast<std::uint32_t>(reflection + rouletteDraws);
+}
+
+/* Owen-scrambled Sobol sequence the shader samples the first scattering
+   event from when quasi-random sampling is enabled, same as the
+   SobolSequence class of the core library, which also generates the
+   direction numbers. Only the low word of the ray index is used. */
+inline std::uint32_t reverseBits(std::uint32_t x)
+{
+    x = ((x >> 1) & 0x55555555u) | ((x & 0x55555555u) << 1);
+    x = ((x >> 2) & 0x33333333u) | ((x & 0x33333333u) << 2);
+    x = ((x >> 4) & 0x0f0f0f0fu) | ((x & 0x0f0f0f0fu) << 4);
+    x = ((x >> 8) & 0x00ff00ffu) | ((x & 0x00ff00ffu) << 8);
+    return (x >> 16) | (x << 16);
+}
+
+inline std::uint32_t laineKarrasPermutation(std::uint32_t x, std::uint32_t seed)
+{
+    x += seed;
+    x ^= x * 0x6c50b47cu;
+    x ^= x * 0xb82f1e52u;
+    x ^= x * 0xc7afe638u;
+    x ^= x * 0x8d22f6e6u;
+    return x;
+}
+
+inline std::uint32_t nestedUniformScramble(std::uint32_t x, std::uint32_t seed)
+{
+    return reverseBits(laineKarrasPermutation(reverseBits(x), seed));
+}
+
+inline std::uint32_t hashCombine(std::uint32_t seed, std::uint32_t value)
+{
+    return seed ^ (value + (seed << 6) + (seed >> 2));
+}
+
+// Seed of the scrambling of a crystal population
+inline std::uint32_t getQuasiRandomSeed(std::uint32_t seed, std::uint32_t populationIndex)
+{
+    return hashCombine(laineKarrasPermutation(seed, 0x2545f491u), populationIndex);
+}
+
+inline float getQuasiRandom(const unsigned int *sobolDirections, std::uint32_t quasiRandomSeed, std::uint32_t rayIndex,
+                            std::uint32_t dimension)
+{
+    const std::uint32_t dimensionsPerSet = 4;
+    const std::uint32_t bits = 32;
+    auto index = nestedUniformScramble(rayIndex, hashCombine(quasiRandomSeed, dimension / dimensionsPerSet));
+    std::uint32_t value = 0;
+    for (auto bit = 0u; index != 0; ++bit, index >>= 1)
+    {
+        if (index & 1u)
+            value ^= sobolDirections[dimension % dimensionsPerSet * bits + bit];
+    }
+    value = nestedUniformScramble(value, hashCombine(quasiRandomSeed, dimension + 0x9e3779b9u));
+    return static_cast<float>(value >> 8) / 16777216.0f;
+}
+}
+
+}
+}
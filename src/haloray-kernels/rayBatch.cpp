@@ -0,0 +1,28 @@
+#include "rayBatch.h"
+
+namespace HaloRay
+{
+namespace Kernels
+{
+
+void RayBatch::resize(std::size_t size)
+{
+    originX.resize(size);
+    originY.resize(size);
+    originZ.resize(size);
+    directionX.resize(size);
+    directionY.resize(size);
+    directionZ.resize(size);
+    indexOfRefraction.resize(size);
+    weight.resize(size, 1.0f);
+    rayIndex.resize(size);
+    status.resize(size);
+}
+
+std::size_t RayBatch::size() const
+{
+    return originX.size();
+}
+
+}
+}
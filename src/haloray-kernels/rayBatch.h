@@ -0,0 +1,59 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace HaloRay
+{
+namespace Kernels
+{
+
+/* Outcomes of tracing a ray inside a crystal. Rays that escape get the
+   number of internal reflections before escaping instead, from zero up. */
+enum TraceStatus : std::int32_t
+{
+    TraceTrappedInOrbit = -1,
+    TraceTerminatedByRoulette = -2,
+    TraceReachedMaxHits = -3
+};
+
+struct TraceSettings
+{
+    // These must match the raytracing shader
+    static const int maxHits = 100;
+    static constexpr float russianRouletteSurvivalProbability = 0.75f;
+    static constexpr float orbitPointTolerance = 1.0e-5f;
+    static constexpr float orbitDirectionTolerance = 0.999999f;
+
+    int russianRouletteDepth;
+    // Key and high word of the ray indices of the random streams, see RandomStream
+    std::uint32_t seed;
+    std::uint32_t populationIndex;
+    std::uint32_t rayIndexHigh;
+    // Draw the first internal reflection of every ray starts from
+    std::uint32_t firstDraw;
+};
+
+/* Rays inside crystals as a structure of arrays. Tracing replaces the
+   directions and weights with those of the escaping rays, and sets the
+   status of every ray. */
+struct RayBatch
+{
+    void resize(std::size_t size);
+    std::size_t size() const;
+
+    std::vector<float> originX;
+    std::vector<float> originY;
+    std::vector<float> originZ;
+    std::vector<float> directionX;
+    std::vector<float> directionY;
+    std::vector<float> directionZ;
+    std::vector<float> indexOfRefraction;
+    std::vector<float> weight;
+    // Low word of the index selecting the random stream of each ray
+    std::vector<std::uint32_t> rayIndex;
+    std::vector<std::int32_t> status;
+};
+
+}
+}
@@ -0,0 +1,139 @@
+#include "rayTracer.h"
+#include <stdexcept>
+#include <string>
+#include "cpuFeatures.h"
+#include "packetTraceJob.h"
+#include "scalarTracer.h"
+
+namespace HaloRay
+{
+namespace Kernels
+{
+
+#if defined(HALORAY_KERNELS_X86)
+namespace
+{
+
+PacketTraceJob createJob(const CrystalMesh *meshes, bool sharedMesh, RayBatch &rays, const TraceSettings &settings)
+{
+    PacketTraceJob job;
+    job.meshes = meshes;
+    job.sharedMesh = sharedMesh;
+    job.rayCount = rays.size();
+    job.originX = rays.originX.data();
+    job.originY = rays.originY.data();
+    job.originZ = rays.originZ.data();
+    job.directionX = rays.directionX.data();
+    job.directionY = rays.directionY.data();
+    job.directionZ = rays.directionZ.data();
+    job.indexOfRefraction = rays.indexOfRefraction.data();
+    job.weight = rays.weight.data();
+    job.rayIndex = rays.rayIndex.data();
+    job.status = rays.status.data();
+    job.russianRouletteDepth = settings.russianRouletteDepth;
+    job.seed = settings.seed;
+    job.populationIndex = settings.populationIndex;
+    job.rayIndexHigh = settings.rayIndexHigh;
+    job.firstDraw = settings.firstDraw;
+    return job;
+}
+
+}
+#endif
+
+InstructionSet getBestInstructionSet()
+{
+    const auto &features = CpuFeatures::get();
+    if (features.avx512) return InstructionSet::Avx512;
+    if (features.avx2) return InstructionSet::Avx2;
+    if (features.sse4) return InstructionSet::Sse4;
+    return InstructionSet::Scalar;
+}
+
+bool isInstructionSetSupported(InstructionSet instructionSet)
+{
+    const auto &features = CpuFeatures::get();
+    switch (instructionSet)
+    {
+    case InstructionSet::Scalar:
+        return true;
+    case InstructionSet::Sse4:
+        return features.sse4;
+    case InstructionSet::Avx2:
+        return features.avx2;
+    case InstructionSet::Avx512:
+        return features.avx512;
+    }
+    return false;
+}
+
+const char *getInstructionSetName(InstructionSet instructionSet)
+{
+    switch (instructionSet)
+    {
+    case InstructionSet::Scalar:
+        return "scalar";
+    case InstructionSet::Sse4:
+        return "SSE4.1";
+    case InstructionSet::Avx2:
+        return "AVX2";
+    case InstructionSet::Avx512:
+        return "AVX-512";
+    }
+    return "unknown";
+}
+
+unsigned int getPacketWidth(InstructionSet instructionSet)
+{
+    switch (instructionSet)
+    {
+    case InstructionSet::Scalar:
+        return 1;
+    case InstructionSet::Sse4:
+        return 4;
+    case InstructionSet::Avx2:
+        return 8;
+    case InstructionSet::Avx512:
+        return 16;
+    }
+    return 1;
+}
+
+void traceRays(const CrystalMesh *meshes, bool sharedMesh, RayBatch &rays, const TraceSettings &settings)
+{
+    traceRays(meshes, sharedMesh, rays, settings, getBestInstructionSet());
+}
+
+void traceRays(const CrystalMesh *meshes, bool sharedMesh, RayBatch &rays, const TraceSettings &settings,
+               InstructionSet instructionSet)
+{
+    if (!isInstructionSetSupported(instructionSet))
+        throw std::runtime_error(std::string("Processor does not support ") + getInstructionSetName(instructionSet));
+
+    if (instructionSet == InstructionSet::Scalar)
+    {
+        traceRaysScalar(meshes, sharedMesh, rays, settings);
+        return;
+    }
+
+#if defined(HALORAY_KERNELS_X86)
+    auto job = createJob(meshes, sharedMesh, rays, settings);
+    switch (instructionSet)
+    {
+    case InstructionSet::Sse4:
+        tracePacketsSse4(job);
+        break;
+    case InstructionSet::Avx2:
+        tracePacketsAvx2(job);
+        break;
+    case InstructionSet::Avx512:
+        tracePacketsAvx512(job);
+        break;
+    case InstructionSet::Scalar:
+        break;
+    }
+#endif
+}
+
+}
+}
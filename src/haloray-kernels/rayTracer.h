@@ -0,0 +1,35 @@
+#pragma once
+#include "crystalMesh.h"
+#include "rayBatch.h"
+
+namespace HaloRay
+{
+namespace Kernels
+{
+
+enum class InstructionSet
+{
+    Scalar,
+    Sse4,
+    Avx2,
+    Avx512
+};
+
+// Widest instruction set this processor supports
+InstructionSet getBestInstructionSet();
+bool isInstructionSetSupported(InstructionSet instructionSet);
+const char *getInstructionSetName(InstructionSet instructionSet);
+// Rays traced together in one packet
+unsigned int getPacketWidth(InstructionSet instructionSet);
+
+/* Traces rays inside crystals until they escape or are lost, with the
+   widest packet kernel the processor supports. Meshes are given for each
+   ray, or one mesh is shared by all rays if sharedMesh is set. */
+void traceRays(const CrystalMesh *meshes, bool sharedMesh, RayBatch &rays, const TraceSettings &settings);
+
+// Same with a specific kernel, throws if the processor does not support it
+void traceRays(const CrystalMesh *meshes, bool sharedMesh, RayBatch &rays, const TraceSettings &settings,
+               InstructionSet instructionSet);
+
+}
+}
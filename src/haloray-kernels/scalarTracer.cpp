@@ -0,0 +1,236 @@
+#include "scalarTracer.h"
+#include <algorithm>
+#include <cmath>
+#include "randomStream.h"
+
+namespace HaloRay
+{
+namespace Kernels
+{
+
+namespace
+{
+
+const float PI = 3.1415926535f;
+
+Vector3 getNormal(const CrystalMesh &mesh, unsigned int triangleIndex)
+{
+    return -mesh.normals[triangleIndex];
+}
+
+}
+
+Intersection findIntersection(const CrystalMesh &mesh, Vector3 rayOrigin, Vector3 rayDirection)
+{
+    for (auto triangleIndex = 0u; triangleIndex < CrystalMesh::triangleCount; ++triangleIndex)
+    {
+        const auto &triangle = CrystalMesh::triangles[triangleIndex];
+        auto v0 = mesh.vertices[triangle[0]];
+        auto v1 = mesh.vertices[triangle[1]];
+        auto v2 = mesh.vertices[triangle[2]];
+
+        auto v0v1 = v1 - v0;
+        auto v0v2 = v2 - v0;
+
+        auto pVec = cross(rayDirection, v0v2);
+        auto determinant = dot(v0v1, pVec);
+        if (determinant < 0.000001f) continue;
+
+        auto tVec = rayOrigin - v0;
+        auto u = dot(tVec, pVec);
+        if (u < 0.0f || u > determinant) continue;
+
+        auto qVec = cross(tVec, v0v1);
+        auto v = dot(rayDirection, qVec);
+        if (v < 0.0f || u + v > determinant) continue;
+
+        auto t = dot(v0v2, qVec) / determinant;
+
+        return {true, triangleIndex, rayOrigin + t * rayDirection};
+    }
+
+    return {false, 0, {0.0f, 0.0f, 0.0f}};
+}
+
+float getReflectionCoefficient(Vector3 normal, Vector3 rayDirection, float n0, float n1)
+{
+    auto incidentCos = dot(-rayDirection, normal);
+    auto incidentAngle = std::acos(incidentCos);
+    if (n1 / n0 < std::sin(incidentAngle)) return 1.0f;
+    auto transmittedAngle = std::asin(n0 * std::sin(incidentAngle) / n1);
+    auto transmittedCos = std::cos(transmittedAngle);
+    auto rs = (n0 * incidentCos - n1 * transmittedCos) / (n0 * incidentCos + n1 * transmittedCos);
+    rs = rs * rs;
+    auto rp = (n0 * transmittedCos - n1 * incidentCos) / (n0 * transmittedCos + n1 * incidentCos);
+    rp = rp * rp;
+    return 0.5f * (rs + rp);
+}
+
+TraceResult traceRay(const CrystalMesh &mesh, Vector3 rayOrigin, Vector3 rayDirection, float indexOfRefraction,
+                     float weight, std::uint32_t rayIndex, const TraceSettings &settings)
+{
+    auto ro = rayOrigin;
+    auto rd = rayDirection;
+    auto ray = static_cast<std::uint64_t>(settings.rayIndexHigh) << 32 | rayIndex;
+
+    /* Total internal reflection is deterministic, so a ray that hits the
+       same point in the same direction again without escaping in between
+       is bouncing around a closed orbit, and is not going to escape */
+    auto totalInternalReflectionRun = false;
+    Vector3 orbitStartPoint = {0.0f, 0.0f, 0.0f};
+    Vector3 orbitStartDirection = {0.0f, 0.0f, 0.0f};
+    const Vector3 noDirection = {0.0f, 0.0f, 0.0f};
+
+    for (auto i = 0; i < TraceSettings::maxHits; ++i)
+    {
+        auto hitResult = findIntersection(mesh, ro, rd);
+        if (!hitResult.didHit) break;
+        auto normal = getNormal(mesh, hitResult.triangleIndex);
+        auto reflectionCoefficient = getReflectionCoefficient(normal, rd, indexOfRefraction, 1.0f);
+
+        if (reflectionCoefficient >= 1.0f)
+        {
+            if (!totalInternalReflectionRun)
+            {
+                totalInternalReflectionRun = true;
+                orbitStartPoint = hitResult.hitPoint;
+                orbitStartDirection = rd;
+            }
+            else if (length(hitResult.hitPoint - orbitStartPoint) < TraceSettings::orbitPointTolerance &&
+                     dot(rd, orbitStartDirection) > TraceSettings::orbitDirectionTolerance)
+            {
+                return {noDirection, weight, TraceTrappedInOrbit};
+            }
+        }
+        else
+        {
+            totalInternalReflectionRun = false;
+        }
+
+        // Russian roulette, surviving rays are reweighted to keep the result unbiased
+        auto draw = RandomStream::getReflectionDraw(settings.firstDraw, settings.russianRouletteDepth, i);
+        if (i >= settings.russianRouletteDepth)
+        {
+            if (RandomStream::get(settings.seed, settings.populationIndex, ray, draw++) > TraceSettings::russianRouletteSurvivalProbability)
+                return {noDirection, weight, TraceTerminatedByRoulette};
+            weight /= TraceSettings::russianRouletteSurvivalProbability;
+        }
+
+        if (RandomStream::get(settings.seed, settings.populationIndex, ray, draw) < reflectionCoefficient)
+        {
+            // Ray reflects back into crystal
+            ro = hitResult.hitPoint;
+            rd = reflect(rd, normal);
+        }
+        else
+        {
+            // Ray refracts out of crystal
+            return {refract(rd, normal, indexOfRefraction), weight, i};
+        }
+    }
+
+    // Like in the shader, rays that find no exit are counted with those reaching the maximum
+    return {noDirection, weight, TraceReachedMaxHits};
+}
+
+unsigned int selectFirstTriangle(const CrystalMesh &mesh, Vector3 rayDirection, float selector)
+{
+    float projectedAreas[CrystalMesh::triangleCount];
+    auto sumProjectedAreas = 0.0f;
+    for (auto i = 0u; i < CrystalMesh::triangleCount; ++i)
+    {
+        projectedAreas[i] = std::max(0.0f, mesh.areas[i] * dot(mesh.normals[i], -rayDirection));
+        sumProjectedAreas += projectedAreas[i];
+    }
+
+    auto triangleSelector = selector * sumProjectedAreas;
+    for (auto i = 0u; i < CrystalMesh::triangleCount; ++i)
+    {
+        triangleSelector -= projectedAreas[i];
+        if (triangleSelector < 0.0f)
+            return i;
+    }
+
+    return 0;
+}
+
+Vector3 sampleTriangle(const CrystalMesh &mesh, unsigned int triangleIndex, float u, float v)
+{
+    const auto &triangle = CrystalMesh::triangles[triangleIndex];
+    auto v0 = mesh.vertices[triangle[0]];
+    auto v1 = mesh.vertices[triangle[1]];
+    auto v2 = mesh.vertices[triangle[2]];
+    if (u + v > 1.0f)
+    {
+        u = 1.0f - u;
+        v = 1.0f - v;
+    }
+
+    return v0 + u * (v1 - v0) + v * (v2 - v0);
+}
+
+Matrix3 rotateAroundX(float angle)
+{
+    auto c = std::cos(angle);
+    auto s = std::sin(angle);
+    return {{{1.0f, 0.0f, 0.0f}, {0.0f, c, s}, {0.0f, -s, c}}};
+}
+
+Matrix3 rotateAroundY(float angle)
+{
+    auto c = std::cos(angle);
+    auto s = std::sin(angle);
+    return {{{c, 0.0f, -s}, {0.0f, 1.0f, 0.0f}, {s, 0.0f, c}}};
+}
+
+Matrix3 rotateAroundZ(float angle)
+{
+    auto c = std::cos(angle);
+    auto s = std::sin(angle);
+    return {{{c, s, 0.0f}, {-s, c, 0.0f}, {0.0f, 0.0f, 1.0f}}};
+}
+
+Matrix3 getRotationMatrix(float yaw, float tilt, float rotation)
+{
+    return rotateAroundY(yaw) * rotateAroundZ(tilt) * rotateAroundY(rotation);
+}
+
+Matrix3 getUniformRandomRotationMatrix(float u0, float u1, float u2)
+{
+    // From Fast Random Rotation Matrices, by James Arvo
+    auto theta = 2.0f * PI * u0;
+    auto phi = 2.0f * PI * u1;
+    auto z = u2;
+    Matrix3 zRotationMatrix = {{{std::cos(theta), -std::sin(theta), 0.0f}, {std::sin(theta), std::cos(theta), 0.0f}, {0.0f, 0.0f, 1.0f}}};
+    Vector3 reflectionVector = {std::cos(phi) * std::sqrt(z), std::sin(phi) * std::sqrt(z), std::sqrt(1.0f - z)};
+
+    // Householder reflection 2vv^T - I
+    Matrix3 householder;
+    const float components[3] = {reflectionVector.x, reflectionVector.y, reflectionVector.z};
+    for (auto column = 0; column < 3; ++column)
+        householder.columns[column] = 2.0f * components[column] * reflectionVector;
+    householder.columns[0].x -= 1.0f;
+    householder.columns[1].y -= 1.0f;
+    householder.columns[2].z -= 1.0f;
+    return householder * zRotationMatrix;
+}
+
+void traceRaysScalar(const CrystalMesh *meshes, bool sharedMesh, RayBatch &rays, const TraceSettings &settings)
+{
+    for (auto i = 0u; i < rays.size(); ++i)
+    {
+        const auto &mesh = sharedMesh ? meshes[0] : meshes[i];
+        auto result = traceRay(mesh,
+                               {rays.originX[i], rays.originY[i], rays.originZ[i]},
+                               {rays.directionX[i], rays.directionY[i], rays.directionZ[i]},
+                               rays.indexOfRefraction[i], rays.weight[i], rays.rayIndex[i], settings);
+        rays.directionX[i] = result.direction.x;
+        rays.directionY[i] = result.direction.y;
+        rays.directionZ[i] = result.direction.z;
+        rays.weight[i] = result.weight;
+        rays.status[i] = result.status;
+    }
+}
+
+}
+}
@@ -0,0 +1,59 @@
+#pragma once
+#include <cstdint>
+#include "crystalMesh.h"
+#include "linearAlgebra.h"
+#include "rayBatch.h"
+
+namespace HaloRay
+{
+namespace Kernels
+{
+
+/* Scalar reference of the optics in the raytracing shader. These mirror
+   the shader functions of the same names, and the packet kernels are
+   tested against them. */
+struct Intersection
+{
+    bool didHit;
+    unsigned int triangleIndex;
+    Vector3 hitPoint;
+};
+
+struct TraceResult
+{
+    Vector3 direction;
+    float weight;
+    std::int32_t status;
+};
+
+Intersection findIntersection(const CrystalMesh &mesh, Vector3 rayOrigin, Vector3 rayDirection);
+float getReflectionCoefficient(Vector3 normal, Vector3 rayDirection, float n0, float n1);
+
+// Traces a ray that has entered the crystal until it escapes or is lost
+TraceResult traceRay(const CrystalMesh &mesh, Vector3 rayOrigin, Vector3 rayDirection, float indexOfRefraction,
+                     float weight, std::uint32_t rayIndex, const TraceSettings &settings);
+
+/* Entry triangle with probability proportional to its area projected
+   towards the ray, and a uniform point on it, from uniform random numbers */
+unsigned int selectFirstTriangle(const CrystalMesh &mesh, Vector3 rayDirection, float selector);
+Vector3 sampleTriangle(const CrystalMesh &mesh, unsigned int triangleIndex, float u, float v);
+
+// Angles in radians
+Matrix3 rotateAroundX(float angle);
+Matrix3 rotateAroundY(float angle);
+Matrix3 rotateAroundZ(float angle);
+
+/* Crystal orientation from yaw around the vertical axis, tilt of the
+   C-axis and rotation around the C-axis in radians. Rays are rotated into
+   the crystal frame with the inverse, by multiplying from the left. */
+Matrix3 getRotationMatrix(float yaw, float tilt, float rotation);
+
+// Uniformly distributed orientation from three uniform random numbers
+Matrix3 getUniformRandomRotationMatrix(float u0, float u1, float u2);
+
+/* Traces a batch one ray at a time. Meshes are given for each ray, or
+   one mesh is shared by all rays if sharedMesh is set. */
+void traceRaysScalar(const CrystalMesh *meshes, bool sharedMesh, RayBatch &rays, const TraceSettings &settings);
+
+}
+}
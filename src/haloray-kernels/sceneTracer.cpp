@@ -0,0 +1,392 @@
+#include "sceneTracer.h"
+#include <algorithm>
+#include <cmath>
+#include "crystalMesh.h"
+#include "randomStream.h"
+#include "scalarTracer.h"
+
+namespace HaloRay
+{
+namespace Kernels
+{
+
+namespace
+{
+
+const float PI = 3.1415926535f;
+
+// Rays are traced in batches, so that the packet kernels get enough rays at once
+const unsigned int batchSize = 1024;
+
+// Dimensions of the quasi-random sequence, these must match the raytracing shader
+enum SceneDimension : std::uint32_t
+{
+    DimensionSunDisk = 0,
+    DimensionWavelength = 2,
+    DimensionOrientationYaw = 3,
+    DimensionTilt = 4,
+    DimensionRotation = 6,
+    DimensionEntryTriangle = 8,
+    DimensionEntryPoint = 9,
+    DimensionEntryFresnel = 11,
+    DimensionCaRatio = 12,
+    DimensionApexHeights = 14
+};
+
+/* Random numbers of the first scattering event of a ray, like
+   sampleDimension in the raytracing shader. Without quasi-random
+   sampling, numbers are drawn from the random stream of the ray one after
+   another, so they must be sampled in the same order as in the shader. */
+class RayRandom
+{
+public:
+    RayRandom(const SceneSettings &settings, std::uint32_t quasiRandomSeed, std::uint64_t ray)
+        : m_trace(settings.trace),
+          m_sobolDirections(settings.sobolDirections),
+          m_quasiRandomSeed(quasiRandomSeed),
+          m_ray(ray),
+          m_draw(0)
+    {
+    }
+
+    float sample(std::uint32_t dimension)
+    {
+        if (m_sobolDirections)
+            return RandomStream::getQuasiRandom(m_sobolDirections, m_quasiRandomSeed, static_cast<std::uint32_t>(m_ray), dimension);
+
+        if (m_draw % 4 == 0)
+            RandomStream::getBlock(m_trace.seed, m_trace.populationIndex, m_ray, m_draw / 4, m_block);
+        return RandomStream::toUniform(m_block[m_draw++ % 4]);
+    }
+
+    // Pair of standard normal random numbers, like randn in the shader
+    void sampleNormal(std::uint32_t dimension, float &x, float &y)
+    {
+        auto u1 = sample(dimension);
+        auto u2 = sample(dimension + 1);
+        auto radius = std::sqrt(-2.0f * std::log(std::max(u1, 1.0e-7f)));
+        auto angle = 2.0f * PI * u2;
+        x = radius * std::cos(angle);
+        y = radius * std::sin(angle);
+    }
+
+    // Draws made from the random stream so far
+    std::uint32_t getDraw() const { return m_draw; }
+
+private:
+    const TraceSettings &m_trace;
+    const unsigned int *m_sobolDirections;
+    std::uint32_t m_quasiRandomSeed;
+    std::uint64_t m_ray;
+    std::uint32_t m_draw;
+    std::uint32_t m_block[4];
+};
+
+Vector3 getSunDirection(float altitude)
+{
+    // X and Z are horizontal, sun moves on the Y-Z plane
+    return normalize({0.0f, std::sin(altitude), std::cos(altitude)});
+}
+
+Vector3 sampleSun(const SceneSun &sun, RayRandom &random)
+{
+    auto sunCenterDirection = getSunDirection(sun.altitude);
+    // X axis is always perpendicular to the Y-Z plane
+    Vector3 diskBasis0 = {1.0f, 0.0f, 0.0f};
+    auto diskBasis1 = cross(sunCenterDirection, diskBasis0);
+    auto sampleAngle = random.sample(DimensionSunDisk) * 2.0f * PI;
+    auto sampleDistance = std::sqrt(random.sample(DimensionSunDisk + 1)) * 0.5f * sun.diameter;
+    auto offset = sampleDistance * (std::sin(sampleAngle) * diskBasis0 + std::cos(sampleAngle) * diskBasis1);
+    return normalize(sunCenterDirection + offset);
+}
+
+Matrix3 sampleOrientation(const SceneCrystals &crystals, RayRandom &random)
+{
+    if (crystals.tiltDistribution == SceneCrystals::Uniform && crystals.rotationDistribution == SceneCrystals::Uniform)
+    {
+        auto u0 = random.sample(DimensionOrientationYaw);
+        auto u1 = random.sample(DimensionTilt);
+        auto u2 = random.sample(DimensionTilt + 1);
+        return getUniformRandomRotationMatrix(u0, u1, u2);
+    }
+
+    float tilt, rotation, unused;
+    if (crystals.tiltDistribution == SceneCrystals::Uniform)
+    {
+        tilt = random.sample(DimensionTilt) * 2.0f * PI;
+    }
+    else
+    {
+        random.sampleNormal(DimensionTilt, tilt, unused);
+        tilt = crystals.tiltAverage + crystals.tiltStd * tilt;
+    }
+
+    if (crystals.rotationDistribution == SceneCrystals::Uniform)
+    {
+        rotation = random.sample(DimensionRotation) * 2.0f * PI;
+    }
+    else
+    {
+        random.sampleNormal(DimensionRotation, rotation, unused);
+        rotation = crystals.rotationAverage + crystals.rotationStd * rotation;
+    }
+
+    return getRotationMatrix(random.sample(DimensionOrientationYaw) * 2.0f * PI, tilt, rotation);
+}
+
+HexagonalCrystalShape sampleShape(const SceneCrystals &crystals, RayRandom &random)
+{
+    HexagonalCrystalShape shape;
+    std::copy(crystals.prismFaceDistances, crystals.prismFaceDistances + 6, shape.prismFaceDistances);
+    shape.upperApexAngle = crystals.upperApexAngle;
+    shape.lowerApexAngle = crystals.lowerApexAngle;
+
+    float caRandom, unused, upperRandom, lowerRandom;
+    random.sampleNormal(DimensionCaRatio, caRandom, unused);
+    random.sampleNormal(DimensionApexHeights, upperRandom, lowerRandom);
+    shape.caRatio = crystals.caRatioAverage + caRandom * crystals.caRatioStd;
+    shape.upperApexHeight = crystals.upperApexHeightAverage + crystals.upperApexHeightStd * upperRandom;
+    shape.lowerApexHeight = crystals.lowerApexHeightAverage + crystals.lowerApexHeightStd * lowerRandom;
+    return shape;
+}
+
+float getIceIndexOfRefraction(float wavelength)
+{
+    // Eq. from Simulating rainbows and halos in color by Stanley Gedzelman
+    return 1.3203f - 0.0000333f * wavelength;
+}
+
+float xFit1931(float wave)
+{
+    auto t1 = (wave - 442.0f) * ((wave < 442.0f) ? 0.0624f : 0.0374f);
+    auto t2 = (wave - 599.8f) * ((wave < 599.8f) ? 0.0264f : 0.0323f);
+    auto t3 = (wave - 501.1f) * ((wave < 501.1f) ? 0.0490f : 0.0382f);
+    return 0.362f * std::exp(-0.5f * t1 * t1) + 1.056f * std::exp(-0.5f * t2 * t2) - 0.065f * std::exp(-0.5f * t3 * t3);
+}
+
+float yFit1931(float wave)
+{
+    auto t1 = (wave - 568.8f) * ((wave < 568.8f) ? 0.0213f : 0.0247f);
+    auto t2 = (wave - 530.9f) * ((wave < 530.9f) ? 0.0613f : 0.0322f);
+    return 0.821f * std::exp(-0.5f * t1 * t1) + 0.286f * std::exp(-0.5f * t2 * t2);
+}
+
+float zFit1931(float wave)
+{
+    auto t1 = (wave - 437.0f) * ((wave < 437.0f) ? 0.0845f : 0.0278f);
+    auto t2 = (wave - 459.0f) * ((wave < 459.0f) ? 0.0385f : 0.0725f);
+    return 1.217f * std::exp(-0.5f * t1 * t1) + 0.681f * std::exp(-0.5f * t2 * t2);
+}
+
+// Ray that has been sampled, waiting for its path inside the crystal to be traced
+struct PendingRay
+{
+    Matrix3 rotation;
+    float wavelength;
+    bool entered;
+    Vector3 reflectedDirection;
+};
+
+void splatRay(const SceneSettings &settings, Vector3 direction, float wavelength, float weight, std::vector<Splat> &splats)
+{
+    float pixelX, pixelY;
+    if (!projectRay(settings.camera, direction, pixelX, pixelY)) return;
+
+    float color[3];
+    getRayColor(settings.sun, wavelength, color);
+
+    const auto &camera = settings.camera;
+    int firstX, firstY;
+    float weightsX[SplatFilter::maxFootprint], weightsY[SplatFilter::maxFootprint];
+    auto countX = camera.splatFilter.getWeights(pixelX, firstX, weightsX);
+    auto countY = camera.splatFilter.getWeights(pixelY, firstY, weightsY);
+    for (auto j = 0; j < countY; ++j)
+    {
+        auto y = firstY + j;
+        if (y < 0 || y >= static_cast<int>(camera.height)) continue;
+        for (auto i = 0; i < countX; ++i)
+        {
+            auto x = firstX + i;
+            if (x < 0 || x >= static_cast<int>(camera.width)) continue;
+            auto pixelWeight = weight * weightsX[i] * weightsY[j];
+            auto pixelIndex = static_cast<std::uint32_t>(y) * camera.width + static_cast<std::uint32_t>(x);
+            splats.push_back({pixelIndex, pixelWeight * color[0], pixelWeight * color[1], pixelWeight * color[2]});
+        }
+    }
+}
+
+}
+
+void getRayColor(const SceneSun &sun, float wavelength, float color[3])
+{
+    float sunRadiance;
+    if (sun.useSpectrum)
+    {
+        auto index = std::clamp(static_cast<int>(std::floor((wavelength - 400.0f) / 10.0f)), 0, 29);
+        auto wavelengthFract = (wavelength - (400.0f + index * 10.0f)) / 10.0f;
+        sunRadiance = sun.spectrum[index] + (sun.spectrum[index + 1] - sun.spectrum[index]) * wavelengthFract;
+    }
+    else
+    {
+        sunRadiance = 1.0f - 0.0013333f * wavelength;
+    }
+
+    Vector3 cieXYZ = sunRadiance * Vector3{xFit1931(wavelength), yFit1931(wavelength), zFit1931(wavelength)};
+    const Matrix3 xyzToSrgb = {{{3.24096994f, -0.96924364f, 0.05563008f},
+                                {-1.53738318f, 1.8759675f, -0.20397696f},
+                                {-0.49861076f, 0.04155506f, 1.05697151f}}};
+    auto srgb = xyzToSrgb * cieXYZ;
+    color[0] = srgb.x;
+    color[1] = srgb.y;
+    color[2] = srgb.z;
+}
+
+bool projectRay(const SceneCamera &camera, Vector3 direction, std::uint32_t &pixelIndex)
+{
+    float pixelX, pixelY;
+    if (!projectRay(camera, direction, pixelX, pixelY)) return false;
+
+    pixelIndex = static_cast<std::uint32_t>(pixelY) * camera.width + static_cast<std::uint32_t>(pixelX);
+    return true;
+}
+
+bool projectRay(const SceneCamera &camera, Vector3 direction, float &pixelX, float &pixelY)
+{
+    // Hide subhorizon rays
+    if (camera.hideSubHorizon && direction.y > 0.0f) return false;
+
+    auto aspectRatio = static_cast<float>(camera.height) / static_cast<float>(camera.width);
+    auto cameraOrientation = rotateAroundX(camera.pitch) * rotateAroundY(camera.yaw);
+    auto viewDirection = normalize(-(cameraOrientation * direction));
+    auto polarRadius = std::atan2(std::hypot(viewDirection.x, viewDirection.y), viewDirection.z);
+    auto polarAngle = std::atan2(viewDirection.y, viewDirection.x);
+
+    // The projection converts 3D vectors to 2D points
+    float projectionFunction = 0.0f;
+    switch (camera.projection)
+    {
+    case SceneCamera::Stereographic:
+        projectionFunction = 2.0f * std::tan(polarRadius / 2.0f);
+        break;
+    case SceneCamera::Rectilinear:
+        if (polarRadius > 0.5f * PI) return false;
+        projectionFunction = std::tan(polarRadius);
+        break;
+    case SceneCamera::Equidistant:
+        projectionFunction = polarRadius;
+        break;
+    case SceneCamera::EqualArea:
+        projectionFunction = 2.0f * std::sin(polarRadius / 2.0f);
+        break;
+    case SceneCamera::Orthographic:
+        if (polarRadius > 0.5f * PI) return false;
+        projectionFunction = std::sin(polarRadius);
+        break;
+    }
+
+    auto x = 0.5f + camera.focalLength * projectionFunction * aspectRatio * std::cos(polarAngle);
+    auto y = 0.5f + camera.focalLength * projectionFunction * std::sin(polarAngle);
+    if (x <= 0.0f || y <= 0.0f || x >= 1.0f || y >= 1.0f) return false;
+
+    pixelX = camera.width * x;
+    pixelY = camera.height * y;
+    return true;
+}
+
+void traceScene(const SceneSettings &settings, std::uint64_t firstRay, unsigned int rayCount, std::vector<Splat> &splats)
+{
+    traceScene(settings, firstRay, rayCount, splats, getBestInstructionSet());
+}
+
+void traceScene(const SceneSettings &settings, std::uint64_t firstRay, unsigned int rayCount, std::vector<Splat> &splats,
+                InstructionSet instructionSet)
+{
+    std::vector<PendingRay> pending(batchSize);
+    std::vector<CrystalMesh> meshes(batchSize);
+    std::vector<unsigned int> enteredRays;
+    RayBatch batch;
+    auto traceSettings = settings.trace;
+    auto quasiRandomSeed = RandomStream::getQuasiRandomSeed(settings.trace.seed, settings.trace.populationIndex);
+    for (auto batchStart = 0u; batchStart < rayCount;)
+    {
+        /* A batch shares the high word of its ray indices with the packet
+           kernels, so it must not cross into the next one */
+        auto firstLowWord = static_cast<std::uint32_t>(firstRay + batchStart);
+        auto count = std::min(batchSize, rayCount - batchStart);
+        if (firstLowWord != 0u)
+            count = static_cast<unsigned int>(std::min<std::uint64_t>(count, 0x100000000ull - firstLowWord));
+        traceSettings.rayIndexHigh = static_cast<std::uint32_t>((firstRay + batchStart) >> 32);
+        enteredRays.clear();
+        batch.resize(count);
+        for (auto i = 0u; i < count; ++i)
+        {
+            auto rayIndex = firstRay + batchStart + i;
+            RayRandom random(settings, quasiRandomSeed, rayIndex);
+            auto &ray = pending[i];
+            auto &mesh = meshes[enteredRays.size()];
+            mesh = createHexagonalCrystal(sampleShape(settings.crystals, random));
+
+            auto rayDirection = -sampleSun(settings.sun, random);
+            ray.wavelength = 400.0f + random.sample(DimensionWavelength) * 300.0f;
+            ray.rotation = sampleOrientation(settings.crystals, random);
+
+            /* The inverse rotation matrix must be applied because we are
+               rotating the incoming ray and not the crystal itself */
+            auto rotatedRayDirection = normalize(rayDirection * ray.rotation);
+            auto triangleIndex = selectFirstTriangle(mesh, rotatedRayDirection, random.sample(DimensionEntryTriangle));
+            auto u = random.sample(DimensionEntryPoint);
+            auto v = random.sample(DimensionEntryPoint + 1);
+            auto startingPoint = sampleTriangle(mesh, triangleIndex, u, v);
+            auto startingPointNormal = mesh.normals[triangleIndex];
+            auto indexOfRefraction = getIceIndexOfRefraction(ray.wavelength);
+            auto reflectionCoefficient = getReflectionCoefficient(startingPointNormal, rotatedRayDirection, 1.0f, indexOfRefraction);
+
+            ray.entered = random.sample(DimensionEntryFresnel) >= reflectionCoefficient;
+            // Every ray makes as many draws before its internal reflections
+            traceSettings.firstDraw = random.getDraw();
+            if (!ray.entered)
+            {
+                ray.reflectedDirection = reflect(rotatedRayDirection, startingPointNormal);
+                continue;
+            }
+
+            // Rays entering crystals are packed together for the packet kernels
+            auto slot = static_cast<unsigned int>(enteredRays.size());
+            auto refracted = refract(rotatedRayDirection, startingPointNormal, 1.0f / indexOfRefraction);
+            batch.originX[slot] = startingPoint.x;
+            batch.originY[slot] = startingPoint.y;
+            batch.originZ[slot] = startingPoint.z;
+            batch.directionX[slot] = refracted.x;
+            batch.directionY[slot] = refracted.y;
+            batch.directionZ[slot] = refracted.z;
+            batch.indexOfRefraction[slot] = indexOfRefraction;
+            batch.weight[slot] = settings.crystals.weight;
+            batch.rayIndex[slot] = static_cast<std::uint32_t>(rayIndex);
+            enteredRays.push_back(i);
+        }
+
+        batch.resize(enteredRays.size());
+        traceRays(meshes.data(), false, batch, traceSettings, instructionSet);
+
+        for (auto i = 0u; i < count; ++i)
+        {
+            const auto &ray = pending[i];
+            if (!ray.entered)
+                splatRay(settings, ray.rotation * ray.reflectedDirection, ray.wavelength, settings.crystals.weight, splats);
+        }
+
+        for (auto slot = 0u; slot < enteredRays.size(); ++slot)
+        {
+            if (batch.status[slot] < 0) continue;
+            Vector3 direction = {batch.directionX[slot], batch.directionY[slot], batch.directionZ[slot]};
+            if (length(direction) < 0.0001f) continue;
+            const auto &ray = pending[enteredRays[slot]];
+            splatRay(settings, ray.rotation * direction, ray.wavelength, batch.weight[slot], splats);
+        }
+
+        batchStart += count;
+    }
+}
+
+}
+}
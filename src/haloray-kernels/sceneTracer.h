@@ -0,0 +1,118 @@
+#pragma once
+#include <cstdint>
+#include <vector>
+#include "rayBatch.h"
+#include "rayTracer.h"
+#include "splatFilter.h"
+
+namespace HaloRay
+{
+namespace Kernels
+{
+
+/* Traces whole rays from the sun through hexagonal crystals to the
+   image, like a single scattering event of the raytracing shader. This
+   lets the CPU add rays to the same image as the GPU. Angles are in
+   radians, and the constants must match the shader. */
+struct SceneSun
+{
+    float altitude;
+    float diameter;
+    // Sampled spectrum from 400 to 700 nm, used instead of the daylight estimate if set
+    bool useSpectrum;
+    float spectrum[31];
+};
+
+struct SceneCamera
+{
+    enum Projection
+    {
+        Stereographic,
+        Rectilinear,
+        Equidistant,
+        EqualArea,
+        Orthographic
+    };
+
+    float pitch;
+    float yaw;
+    float focalLength;
+    int projection;
+    bool hideSubHorizon;
+    unsigned int width;
+    unsigned int height;
+    SplatFilter splatFilter;
+};
+
+struct SceneCrystals
+{
+    enum Distribution
+    {
+        Uniform,
+        Gaussian
+    };
+
+    int tiltDistribution;
+    float tiltAverage;
+    float tiltStd;
+    int rotationDistribution;
+    float rotationAverage;
+    float rotationStd;
+
+    float caRatioAverage;
+    float caRatioStd;
+    float upperApexAngle;
+    float upperApexHeightAverage;
+    float upperApexHeightStd;
+    float lowerApexAngle;
+    float lowerApexHeightAverage;
+    float lowerApexHeightStd;
+    float prismFaceDistances[6];
+
+    // Weight of every ray of the population
+    float weight;
+};
+
+struct SceneSettings
+{
+    SceneSun sun;
+    SceneCamera camera;
+    SceneCrystals crystals;
+    // Holds the run seed and population index of the shader, and the Russian roulette depth
+    TraceSettings trace;
+    // Direction numbers of the Sobol sequence for quasi-random sampling, or null for pseudo-random numbers
+    const unsigned int *sobolDirections;
+};
+
+// Light of a ray reaching the image, in the same units as the shader adds to it
+struct Splat
+{
+    std::uint32_t pixelIndex;
+    float red;
+    float green;
+    float blue;
+};
+
+/* Traces the rays numbered from firstRay on and appends the ones reaching
+   the image to splats. A ray gets the same random numbers as the ray with
+   the same index in the raytracing shader, when the trace settings hold
+   the run seed and population index, no matter how the rays are split
+   into calls. */
+void traceScene(const SceneSettings &settings, std::uint64_t firstRay, unsigned int rayCount, std::vector<Splat> &splats);
+
+// Same with a specific kernel, throws if the processor does not support it
+void traceScene(const SceneSettings &settings, std::uint64_t firstRay, unsigned int rayCount, std::vector<Splat> &splats,
+                InstructionSet instructionSet);
+
+// Color of a ray of the given wavelength in nm in linear sRGB, like getRayColor in the shader
+void getRayColor(const SceneSun &sun, float wavelength, float color[3]);
+
+/* Pixel a ray escaping the crystals in the given direction is seen at.
+   Returns false if it is outside the image or hidden. */
+bool projectRay(const SceneCamera &camera, Vector3 direction, std::uint32_t &pixelIndex);
+
+// Same as the point in pixels from the bottom left corner of the image, for splat filters
+bool projectRay(const SceneCamera &camera, Vector3 direction, float &pixelX, float &pixelY);
+
+}
+}
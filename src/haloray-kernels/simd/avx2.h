@@ -0,0 +1,86 @@
+#pragma once
+#include <cstdint>
+#include <immintrin.h>
+
+namespace HaloRay
+{
+namespace Kernels
+{
+namespace Simd
+{
+
+// Eight lanes of AVX2. Only for sources compiled with AVX2 enabled.
+struct Avx2
+{
+    static const unsigned int width = 8;
+
+    struct Mask
+    {
+        __m256 v;
+        friend Mask operator&(Mask a, Mask b) { return {_mm256_and_ps(a.v, b.v)}; }
+        friend Mask operator|(Mask a, Mask b) { return {_mm256_or_ps(a.v, b.v)}; }
+    };
+
+    struct Float
+    {
+        __m256 v;
+        friend Float operator+(Float a, Float b) { return {_mm256_add_ps(a.v, b.v)}; }
+        friend Float operator-(Float a, Float b) { return {_mm256_sub_ps(a.v, b.v)}; }
+        friend Float operator*(Float a, Float b) { return {_mm256_mul_ps(a.v, b.v)}; }
+        friend Float operator/(Float a, Float b) { return {_mm256_div_ps(a.v, b.v)}; }
+        friend Mask operator<(Float a, Float b) { return {_mm256_cmp_ps(a.v, b.v, _CMP_LT_OQ)}; }
+        friend Mask operator<=(Float a, Float b) { return {_mm256_cmp_ps(a.v, b.v, _CMP_LE_OQ)}; }
+        friend Mask operator>(Float a, Float b) { return {_mm256_cmp_ps(a.v, b.v, _CMP_GT_OQ)}; }
+        friend Mask operator>=(Float a, Float b) { return {_mm256_cmp_ps(a.v, b.v, _CMP_GE_OQ)}; }
+    };
+
+    struct Int
+    {
+        __m256i v;
+        friend Int operator+(Int a, Int b) { return {_mm256_add_epi32(a.v, b.v)}; }
+        friend Int operator*(Int a, Int b) { return {_mm256_mullo_epi32(a.v, b.v)}; }
+        friend Int operator^(Int a, Int b) { return {_mm256_xor_si256(a.v, b.v)}; }
+        friend Int operator&(Int a, Int b) { return {_mm256_and_si256(a.v, b.v)}; }
+        friend Int operator>>(Int a, int shift) { return {_mm256_srl_epi32(a.v, _mm_cvtsi32_si128(shift))}; }
+    };
+
+    static Float broadcast(float x) { return {_mm256_set1_ps(x)}; }
+    static Int broadcastInt(std::int32_t x) { return {_mm256_set1_epi32(x)}; }
+    static Float load(const float *data) { return {_mm256_loadu_ps(data)}; }
+    static Int load(const std::int32_t *data) { return {_mm256_loadu_si256(reinterpret_cast<const __m256i *>(data))}; }
+    static void store(float *data, Float a) { _mm256_storeu_ps(data, a.v); }
+    static void store(std::int32_t *data, Int a) { _mm256_storeu_si256(reinterpret_cast<__m256i *>(data), a.v); }
+
+    static Float sqrt(Float a) { return {_mm256_sqrt_ps(a.v)}; }
+    static Float max(Float a, Float b) { return {_mm256_max_ps(a.v, b.v)}; }
+    // Unsigned 24-bit integers to floats
+    static Float toFloat(Int a) { return {_mm256_cvtepi32_ps(a.v)}; }
+    // High words of the unsigned products
+    static Int mulHigh(Int a, Int b)
+    {
+        auto even = _mm256_srli_epi64(_mm256_mul_epu32(a.v, b.v), 32);
+        auto odd = _mm256_mul_epu32(_mm256_srli_epi64(a.v, 32), _mm256_srli_epi64(b.v, 32));
+        return {_mm256_blend_epi32(even, odd, 0xaa)};
+    }
+
+    // Picks a where the mask is set and b elsewhere
+    static Float select(Mask mask, Float a, Float b) { return {_mm256_blendv_ps(b.v, a.v, mask.v)}; }
+    static Int select(Mask mask, Int a, Int b)
+    {
+        return {_mm256_castps_si256(_mm256_blendv_ps(_mm256_castsi256_ps(b.v), _mm256_castsi256_ps(a.v), mask.v))};
+    }
+
+    static Mask andNot(Mask a, Mask b) { return {_mm256_andnot_ps(b.v, a.v)}; }
+    static bool any(Mask a) { return _mm256_movemask_ps(a.v) != 0; }
+    static Mask none() { return {_mm256_setzero_ps()}; }
+    // Lanes below count
+    static Mask firstLanes(unsigned int count)
+    {
+        auto lanes = _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7);
+        return {_mm256_castsi256_ps(_mm256_cmpgt_epi32(_mm256_set1_epi32(static_cast<int>(count)), lanes))};
+    }
+};
+
+}
+}
+}
@@ -0,0 +1,95 @@
+#pragma once
+#include <cstdint>
+
+/* The unmasked AVX-512 intrinsics of GCC 12 fill their unused source with
+   a self-initialized vector, which -Wuninitialized reports wherever they
+   are inlined (GCC bug 105593) */
+#if defined(__GNUC__) && !defined(__clang__)
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wuninitialized"
+#pragma GCC diagnostic ignored "-Wmaybe-uninitialized"
+#include <immintrin.h>
+#pragma GCC diagnostic pop
+#else
+#include <immintrin.h>
+#endif
+
+namespace HaloRay
+{
+namespace Kernels
+{
+namespace Simd
+{
+
+/* Sixteen lanes of AVX-512 with mask registers. Only for sources
+   compiled with AVX-512F enabled. */
+struct Avx512
+{
+    static const unsigned int width = 16;
+
+    struct Mask
+    {
+        __mmask16 v;
+        friend Mask operator&(Mask a, Mask b) { return {static_cast<__mmask16>(a.v & b.v)}; }
+        friend Mask operator|(Mask a, Mask b) { return {static_cast<__mmask16>(a.v | b.v)}; }
+    };
+
+    struct Float
+    {
+        __m512 v;
+        friend Float operator+(Float a, Float b) { return {_mm512_add_ps(a.v, b.v)}; }
+        friend Float operator-(Float a, Float b) { return {_mm512_sub_ps(a.v, b.v)}; }
+        friend Float operator*(Float a, Float b) { return {_mm512_mul_ps(a.v, b.v)}; }
+        friend Float operator/(Float a, Float b) { return {_mm512_div_ps(a.v, b.v)}; }
+        friend Mask operator<(Float a, Float b) { return {_mm512_cmp_ps_mask(a.v, b.v, _CMP_LT_OQ)}; }
+        friend Mask operator<=(Float a, Float b) { return {_mm512_cmp_ps_mask(a.v, b.v, _CMP_LE_OQ)}; }
+        friend Mask operator>(Float a, Float b) { return {_mm512_cmp_ps_mask(a.v, b.v, _CMP_GT_OQ)}; }
+        friend Mask operator>=(Float a, Float b) { return {_mm512_cmp_ps_mask(a.v, b.v, _CMP_GE_OQ)}; }
+    };
+
+    struct Int
+    {
+        __m512i v;
+        friend Int operator+(Int a, Int b) { return {_mm512_add_epi32(a.v, b.v)}; }
+        friend Int operator*(Int a, Int b) { return {_mm512_mullo_epi32(a.v, b.v)}; }
+        friend Int operator^(Int a, Int b) { return {_mm512_xor_si512(a.v, b.v)}; }
+        friend Int operator&(Int a, Int b) { return {_mm512_and_si512(a.v, b.v)}; }
+        friend Int operator>>(Int a, int shift) { return {_mm512_srlv_epi32(a.v, _mm512_set1_epi32(shift))}; }
+    };
+
+    static Float broadcast(float x) { return {_mm512_set1_ps(x)}; }
+    static Int broadcastInt(std::int32_t x) { return {_mm512_set1_epi32(x)}; }
+    static Float load(const float *data) { return {_mm512_loadu_ps(data)}; }
+    static Int load(const std::int32_t *data) { return {_mm512_loadu_si512(data)}; }
+    static void store(float *data, Float a) { _mm512_storeu_ps(data, a.v); }
+    static void store(std::int32_t *data, Int a) { _mm512_storeu_si512(data, a.v); }
+
+    static Float sqrt(Float a) { return {_mm512_sqrt_ps(a.v)}; }
+    static Float max(Float a, Float b) { return {_mm512_max_ps(a.v, b.v)}; }
+    // Unsigned 24-bit integers to floats
+    static Float toFloat(Int a) { return {_mm512_cvtepi32_ps(a.v)}; }
+    // High words of the unsigned products
+    static Int mulHigh(Int a, Int b)
+    {
+        auto even = _mm512_srli_epi64(_mm512_mul_epu32(a.v, b.v), 32);
+        auto odd = _mm512_mul_epu32(_mm512_srli_epi64(a.v, 32), _mm512_srli_epi64(b.v, 32));
+        return {_mm512_mask_blend_epi32(0xaaaa, even, odd)};
+    }
+
+    // Picks a where the mask is set and b elsewhere
+    static Float select(Mask mask, Float a, Float b) { return {_mm512_mask_blend_ps(mask.v, b.v, a.v)}; }
+    static Int select(Mask mask, Int a, Int b) { return {_mm512_mask_blend_epi32(mask.v, b.v, a.v)}; }
+
+    static Mask andNot(Mask a, Mask b) { return {static_cast<__mmask16>(a.v & ~b.v)}; }
+    static bool any(Mask a) { return a.v != 0; }
+    static Mask none() { return {0}; }
+    // Lanes below count
+    static Mask firstLanes(unsigned int count)
+    {
+        return {static_cast<__mmask16>(count >= width ? 0xffffu : (1u << count) - 1u)};
+    }
+};
+
+}
+}
+}
@@ -0,0 +1,85 @@
+#pragma once
+#include <cstdint>
+#include <immintrin.h>
+
+namespace HaloRay
+{
+namespace Kernels
+{
+namespace Simd
+{
+
+// Four lanes of SSE4.1. Only for sources compiled with SSE4.1 enabled.
+struct Sse4
+{
+    static const unsigned int width = 4;
+
+    struct Mask
+    {
+        __m128 v;
+        friend Mask operator&(Mask a, Mask b) { return {_mm_and_ps(a.v, b.v)}; }
+        friend Mask operator|(Mask a, Mask b) { return {_mm_or_ps(a.v, b.v)}; }
+    };
+
+    struct Float
+    {
+        __m128 v;
+        friend Float operator+(Float a, Float b) { return {_mm_add_ps(a.v, b.v)}; }
+        friend Float operator-(Float a, Float b) { return {_mm_sub_ps(a.v, b.v)}; }
+        friend Float operator*(Float a, Float b) { return {_mm_mul_ps(a.v, b.v)}; }
+        friend Float operator/(Float a, Float b) { return {_mm_div_ps(a.v, b.v)}; }
+        friend Mask operator<(Float a, Float b) { return {_mm_cmplt_ps(a.v, b.v)}; }
+        friend Mask operator<=(Float a, Float b) { return {_mm_cmple_ps(a.v, b.v)}; }
+        friend Mask operator>(Float a, Float b) { return {_mm_cmpgt_ps(a.v, b.v)}; }
+        friend Mask operator>=(Float a, Float b) { return {_mm_cmpge_ps(a.v, b.v)}; }
+    };
+
+    struct Int
+    {
+        __m128i v;
+        friend Int operator+(Int a, Int b) { return {_mm_add_epi32(a.v, b.v)}; }
+        friend Int operator*(Int a, Int b) { return {_mm_mullo_epi32(a.v, b.v)}; }
+        friend Int operator^(Int a, Int b) { return {_mm_xor_si128(a.v, b.v)}; }
+        friend Int operator&(Int a, Int b) { return {_mm_and_si128(a.v, b.v)}; }
+        friend Int operator>>(Int a, int shift) { return {_mm_srl_epi32(a.v, _mm_cvtsi32_si128(shift))}; }
+    };
+
+    static Float broadcast(float x) { return {_mm_set1_ps(x)}; }
+    static Int broadcastInt(std::int32_t x) { return {_mm_set1_epi32(x)}; }
+    static Float load(const float *data) { return {_mm_loadu_ps(data)}; }
+    static Int load(const std::int32_t *data) { return {_mm_loadu_si128(reinterpret_cast<const __m128i *>(data))}; }
+    static void store(float *data, Float a) { _mm_storeu_ps(data, a.v); }
+    static void store(std::int32_t *data, Int a) { _mm_storeu_si128(reinterpret_cast<__m128i *>(data), a.v); }
+
+    static Float sqrt(Float a) { return {_mm_sqrt_ps(a.v)}; }
+    static Float max(Float a, Float b) { return {_mm_max_ps(a.v, b.v)}; }
+    // Unsigned 24-bit integers to floats
+    static Float toFloat(Int a) { return {_mm_cvtepi32_ps(a.v)}; }
+    // High words of the unsigned products
+    static Int mulHigh(Int a, Int b)
+    {
+        auto even = _mm_srli_epi64(_mm_mul_epu32(a.v, b.v), 32);
+        auto odd = _mm_mul_epu32(_mm_srli_epi64(a.v, 32), _mm_srli_epi64(b.v, 32));
+        return {_mm_blend_epi16(even, odd, 0xcc)};
+    }
+
+    // Picks a where the mask is set and b elsewhere
+    static Float select(Mask mask, Float a, Float b) { return {_mm_blendv_ps(b.v, a.v, mask.v)}; }
+    static Int select(Mask mask, Int a, Int b)
+    {
+        return {_mm_castps_si128(_mm_blendv_ps(_mm_castsi128_ps(b.v), _mm_castsi128_ps(a.v), mask.v))};
+    }
+
+    static Mask andNot(Mask a, Mask b) { return {_mm_andnot_ps(b.v, a.v)}; }
+    static bool any(Mask a) { return _mm_movemask_ps(a.v) != 0; }
+    static Mask none() { return {_mm_setzero_ps()}; }
+    // Lanes below count
+    static Mask firstLanes(unsigned int count)
+    {
+        return {_mm_castsi128_ps(_mm_cmplt_epi32(_mm_setr_epi32(0, 1, 2, 3), _mm_set1_epi32(static_cast<int>(count))))};
+    }
+};
+
+}
+}
+}
@@ -0,0 +1,48 @@
+#include "splatFilter.h"
+#include <algorithm>
+#include <cmath>
+
+namespace HaloRay
+{
+namespace Kernels
+{
+
+int SplatFilter::getWeights(float position, int &firstPixel, float weights[maxFootprint]) const
+{
+    if (type == Box)
+    {
+        firstPixel = static_cast<int>(std::floor(position));
+        weights[0] = 1.0f;
+        return 1;
+    }
+
+    auto filterRadius = type == Bilinear ? 1.0f : std::clamp(radius, minRadius, maxRadius);
+
+    // Pixels whose centers are closer than the radius
+    firstPixel = static_cast<int>(std::ceil(position - 0.5f - filterRadius));
+    auto lastPixel = static_cast<int>(std::floor(position - 0.5f + filterRadius));
+    auto count = std::min(lastPixel - firstPixel + 1, static_cast<int>(maxFootprint));
+
+    auto totalWeight = 0.0f;
+    for (auto i = 0; i < count; ++i)
+    {
+        auto distance = std::abs(static_cast<float>(firstPixel + i) + 0.5f - position);
+        if (type == Gaussian)
+        {
+            auto deviation = 0.5f * filterRadius;
+            weights[i] = distance < filterRadius ? std::exp(-0.5f * distance * distance / (deviation * deviation)) : 0.0f;
+        }
+        else
+        {
+            weights[i] = std::max(1.0f - distance / filterRadius, 0.0f);
+        }
+        totalWeight += weights[i];
+    }
+
+    for (auto i = 0; i < count; ++i)
+        weights[i] /= totalWeight;
+    return count;
+}
+
+}
+}
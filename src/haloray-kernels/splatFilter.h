@@ -0,0 +1,38 @@
+#pragma once
+
+namespace HaloRay
+{
+namespace Kernels
+{
+
+/* Spreads the light of a ray over the pixels around the point it is seen
+   at, instead of adding all of it to the pixel the point is in. Filters
+   are separable, and the weights along each axis are normalized to one so
+   that the light of every ray is conserved. Distances are in pixels from
+   pixel centers. This must match splatFilter.glsl. */
+struct SplatFilter
+{
+    enum Type
+    {
+        Box,
+        Bilinear,
+        Tent,
+        Gaussian
+    };
+
+    static constexpr float minRadius = 1.0f;
+    static constexpr float maxRadius = 3.0f;
+    // Most pixels a filter covers along one axis
+    static const int maxFootprint = 7;
+
+    int type = Box;
+    // Radius of the tent and Gaussian filters, the Gaussian has a standard deviation of half of it
+    float radius = 1.0f;
+
+    /* Weights along one axis for the pixels from firstPixel on, around a
+       position in pixels. Returns the number of pixels covered. */
+    int getWeights(float position, int &firstPixel, float weights[maxFootprint]) const;
+};
+
+}
+}
@@ -2,7 +2,12 @@ TEMPLATE = subdirs
 SUBDIRS += \
     main \
     haloray-core \
-    tests
+    haloray-kernels \
+    replay \
+    tests \
+    benchmarks
 
-main.depends = haloray-core
-tests.depends = haloray-core
+main.depends = haloray-core haloray-kernels
+replay.depends = haloray-core haloray-kernels
+tests.depends = haloray-core haloray-kernels
+benchmarks.depends = haloray-core haloray-kernels
@@ -0,0 +1,149 @@
+#include <QCoreApplication>
+#include <QCommandLineParser>
+#include <QImage>
+#include <QString>
+#include <QStringList>
+#include <algorithm>
+#include <cstdio>
+#include <iterator>
+#include <stdexcept>
+#include <vector>
+#include "simulation/camera.h"
+#include "simulation/rayDump.h"
+#include "simulation/rayReprojection.h"
+#include "simulation/toneMapping.h"
+
+using namespace HaloRay;
+
+namespace
+{
+
+Projection parseProjection(const QString &name)
+{
+    const QStringList names = {"stereographic", "rectilinear", "equidistant", "equal-area", "orthographic"};
+    auto index = names.indexOf(name.toLower());
+    if (index < 0)
+        throw std::runtime_error("Unknown projection: " + name.toStdString());
+    return static_cast<Projection>(index);
+}
+
+float parseFloat(const QString &value, const char *option)
+{
+    bool ok;
+    auto result = value.toFloat(&ok);
+    if (!ok)
+        throw std::runtime_error(std::string("Invalid value for --") + option);
+    return result;
+}
+
+unsigned int parseSize(const QString &value, const char *option)
+{
+    bool ok;
+    auto result = value.toUInt(&ok);
+    if (!ok || result == 0)
+        throw std::runtime_error(std::string("Invalid value for --") + option);
+    return result;
+}
+
+/* Tone maps the image like the renderer of the main application, so that
+   the same exposure gives the same brightness */
+QImage toneMapReprojection(const RayReprojection &reprojection, float exposure, float fov, double tracedRayCount)
+{
+    const auto width = reprojection.getWidth();
+    const auto height = reprojection.getHeight();
+    auto pixels = toneMap(reprojection.getImage().data(), 3, width, height, exposure, fov, tracedRayCount);
+
+    QImage image(width, height, QImage::Format_RGB888);
+    for (auto y = 0u; y < height; ++y)
+        std::copy_n(&pixels[static_cast<std::size_t>(y) * width * 3], width * 3, image.scanLine(y));
+    return image;
+}
+
+}
+
+int main(int argc, char *argv[])
+{
+    QCoreApplication app(argc, argv);
+    QCoreApplication::setApplicationName("haloray-replay");
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription("Projects rays dumped by HaloRay through a camera without tracing them again.");
+    parser.addHelpOption();
+    parser.addPositionalArgument("dump", "Ray dump file written by HaloRay");
+    parser.addPositionalArgument("output", "Output PNG image");
+    parser.addOptions({
+        {"width", "Image width in pixels", "pixels", "1920"},
+        {"height", "Image height in pixels", "pixels", "1080"},
+        {"pitch", "Camera pitch in degrees", "degrees", "0"},
+        {"yaw", "Camera yaw in degrees", "degrees", "0"},
+        {"fov", "Camera field of view in degrees", "degrees", "75"},
+        {"projection", "Camera projection: stereographic, rectilinear, equidistant, equal-area or orthographic", "name", "stereographic"},
+        {"hide-subhorizon", "Hide rays below the horizon"},
+        {"exposure", "Exposure, matching the brightness setting of HaloRay", "value", "1"},
+        {"population", "Only project rays of the crystal population with the given index", "index"},
+    });
+    parser.process(app);
+
+    const auto arguments = parser.positionalArguments();
+    if (arguments.size() != 2)
+        parser.showHelp(1);
+
+    try
+    {
+        Camera camera;
+        camera.pitch = parseFloat(parser.value("pitch"), "pitch");
+        camera.yaw = parseFloat(parser.value("yaw"), "yaw");
+        camera.projection = parseProjection(parser.value("projection"));
+        camera.fov = std::min(parseFloat(parser.value("fov"), "fov"), camera.getMaximumFov());
+        camera.hideSubHorizon = parser.isSet("hide-subhorizon");
+
+        RayDumpReader reader(arguments[0].toStdString());
+        std::printf("Read %llu rays out of %llu traced, %llu dropped while dumping\n",
+                    static_cast<unsigned long long>(reader.getRecordCount()),
+                    static_cast<unsigned long long>(reader.getTracedRayCount()),
+                    static_cast<unsigned long long>(reader.getDroppedCount()));
+
+        RayReprojection reprojection(camera, parseSize(parser.value("width"), "width"), parseSize(parser.value("height"), "height"));
+        if (parser.isSet("population"))
+        {
+            bool ok;
+            auto population = parser.value("population").toUInt(&ok);
+            if (!ok)
+                throw std::runtime_error("Invalid value for --population");
+            std::vector<RayExitRecord> populationRecords;
+            std::copy_if(reader.getRecords(), reader.getRecords() + reader.getRecordCount(), std::back_inserter(populationRecords),
+                         [population](const RayExitRecord &record) { return record.populationIndex == population; });
+            reprojection.addRays(populationRecords.data(), populationRecords.size());
+        }
+        else
+        {
+            reprojection.addRays(reader.getRecords(), reader.getRecordCount());
+        }
+
+        // Dumps left unfinished do not know how many rays were traced
+        double tracedRayCount = reader.getTracedRayCount();
+        if (tracedRayCount == 0.0)
+        {
+            std::fprintf(stderr, "Number of traced rays is missing, brightness is only approximate\n");
+            tracedRayCount = std::max<double>(1.0, reader.getRecordCount());
+        }
+        else if (reader.getDroppedCount() > 0)
+        {
+            // The traced rays include those of dropped records, so only the share that was written is kept
+            double writtenCount = static_cast<double>(reader.getRecordCount());
+            tracedRayCount *= writtenCount / (writtenCount + reader.getDroppedCount());
+            tracedRayCount = std::max(1.0, tracedRayCount);
+        }
+
+        auto image = toneMapReprojection(reprojection, parseFloat(parser.value("exposure"), "exposure"), camera.fov, tracedRayCount);
+        if (!image.save(arguments[1], "PNG"))
+            throw std::runtime_error("Could not write output image");
+    }
+    catch (const std::runtime_error &e)
+    {
+        std::fprintf(stderr, "%s\n", e.what());
+        return 1;
+    }
+
+    return 0;
+}
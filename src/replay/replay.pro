@@ -0,0 +1,38 @@
+TARGET = haloray-replay
+TEMPLATE = app
+
+QT += core gui
+QT -= widgets
+CONFIG += c++17 console
+CONFIG -= app_bundle
+
+DEFINES += QT_DEPRECATED_WARNINGS
+
+SOURCES += main.cpp
+
+win32:CONFIG(release, debug|release): LIBS += -L$$OUT_PWD/../haloray-core/release/ -lHaloRayCore
+else:win32:CONFIG(debug, debug|release): LIBS += -L$$OUT_PWD/../haloray-core/debug/ -lHaloRayCore
+else:unix: LIBS += -L$$OUT_PWD/../haloray-core/ -lHaloRayCore
+
+INCLUDEPATH += $$PWD/../haloray-core
+DEPENDPATH += $$PWD/../haloray-core
+
+win32-g++:CONFIG(release, debug|release): PRE_TARGETDEPS += $$OUT_PWD/../haloray-core/release/libHaloRayCore.a
+else:win32-g++:CONFIG(debug, debug|release): PRE_TARGETDEPS += $$OUT_PWD/../haloray-core/debug/libHaloRayCore.a
+else:win32:!win32-g++:CONFIG(release, debug|release): PRE_TARGETDEPS += $$OUT_PWD/../haloray-core/release/HaloRayCore.lib
+else:win32:!win32-g++:CONFIG(debug, debug|release): PRE_TARGETDEPS += $$OUT_PWD/../haloray-core/debug/HaloRayCore.lib
+else:unix: PRE_TARGETDEPS += $$OUT_PWD/../haloray-core/libHaloRayCore.a
+
+# The CPU side of hybrid tracing in the core library uses the kernels
+win32:CONFIG(release, debug|release): LIBS += -L$$OUT_PWD/../haloray-kernels/release/ -lHaloRayKernels
+else:win32:CONFIG(debug, debug|release): LIBS += -L$$OUT_PWD/../haloray-kernels/debug/ -lHaloRayKernels
+else:unix: LIBS += -L$$OUT_PWD/../haloray-kernels/ -lHaloRayKernels
+
+INCLUDEPATH += $$PWD/../haloray-kernels
+DEPENDPATH += $$PWD/../haloray-kernels
+
+win32-g++:CONFIG(release, debug|release): PRE_TARGETDEPS += $$OUT_PWD/../haloray-kernels/release/libHaloRayKernels.a
+else:win32-g++:CONFIG(debug, debug|release): PRE_TARGETDEPS += $$OUT_PWD/../haloray-kernels/debug/libHaloRayKernels.a
+else:win32:!win32-g++:CONFIG(release, debug|release): PRE_TARGETDEPS += $$OUT_PWD/../haloray-kernels/release/HaloRayKernels.lib
+else:win32:!win32-g++:CONFIG(debug, debug|release): PRE_TARGETDEPS += $$OUT_PWD/../haloray-kernels/debug/HaloRayKernels.lib
+else:unix: PRE_TARGETDEPS += $$OUT_PWD/../haloray-kernels/libHaloRayKernels.a
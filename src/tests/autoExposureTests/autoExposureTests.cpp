@@ -0,0 +1,70 @@
+#include <QtTest>
+#include <cmath>
+#include "simulation/autoExposure.h"
+
+using namespace HaloRay;
+
+class AutoExposureTests : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void bins_coverLuminanceRange()
+    {
+        QCOMPARE(AutoExposure::getBin(0.0), 0u);
+        QCOMPARE(AutoExposure::getBin(std::exp2(AutoExposure::minLog2Luminance - 1.0)), 0u);
+        QCOMPARE(AutoExposure::getBin(std::exp2(AutoExposure::minLog2Luminance)), 1u);
+        QCOMPARE(AutoExposure::getBin(1.0e10), AutoExposure::binCount - 1);
+    }
+
+    void binLuminance_fallsInsideBin()
+    {
+        for (auto bin = 1u; bin < AutoExposure::binCount; ++bin)
+            QCOMPARE(AutoExposure::getBin(AutoExposure::getBinLuminance(bin)), bin);
+    }
+
+    void averageLuminance_isShownAtKeyValue()
+    {
+        LuminanceStatistics statistics;
+        statistics.litPixelCount = 100;
+        statistics.averageLuminance = 0.09;
+        statistics.highlightLuminance = 0.2;
+        QVERIFY(std::abs(AutoExposure::getTargetBrightness(statistics, 0.18, 1.0) - 2.0) < 1.0e-9);
+    }
+
+    void highlights_areNotPushedPastWhite()
+    {
+        LuminanceStatistics statistics;
+        statistics.litPixelCount = 100;
+        statistics.averageLuminance = 0.01;
+        statistics.highlightLuminance = 0.25;
+        QVERIFY(std::abs(AutoExposure::getTargetBrightness(statistics, 0.18, 1.0) - 4.0) < 1.0e-9);
+    }
+
+    void brightness_staysInSliderRange()
+    {
+        LuminanceStatistics statistics;
+        statistics.litPixelCount = 1;
+        statistics.averageLuminance = 1.0e-6;
+        QCOMPARE(AutoExposure::getTargetBrightness(statistics, 0.18, 1.0), AutoExposure::maxBrightness);
+        statistics.averageLuminance = 1.0e6;
+        QCOMPARE(AutoExposure::getTargetBrightness(statistics, 0.18, 1.0), AutoExposure::minBrightness);
+    }
+
+    void unlitImage_keepsPreviousBrightness()
+    {
+        LuminanceStatistics statistics;
+        QCOMPARE(AutoExposure::getTargetBrightness(statistics, 0.18, 3.0), 3.0);
+    }
+
+    void adaptation_movesHalfwayInLogSpace()
+    {
+        QVERIFY(std::abs(AutoExposure::adapt(1.0, 4.0, 0.5) - 2.0) < 1.0e-9);
+        QCOMPARE(AutoExposure::adapt(1.0, 4.0, 1.0), 4.0);
+        QCOMPARE(AutoExposure::adapt(1.0, 4.0, 0.0), 1.0);
+    }
+};
+
+QTEST_APPLESS_MAIN(AutoExposureTests)
+
+#include "autoExposureTests.moc"
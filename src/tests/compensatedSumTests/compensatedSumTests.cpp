@@ -0,0 +1,98 @@
+#include <QtTest>
+#include <cmath>
+#include <cstdint>
+#include "simulation/compensatedSum.h"
+
+using namespace HaloRay;
+
+namespace
+{
+
+// Ray weights between 0.5 and 1.5, from a fixed linear congruential generator
+class RayWeights
+{
+public:
+    float next()
+    {
+        m_state = m_state * 6364136223846793005ull + 1442695040888963407ull;
+        return 0.5f + static_cast<float>(m_state >> 40) / 16777216.0f;
+    }
+
+private:
+    std::uint64_t m_state = 1;
+};
+
+double getRelativeError(double value, double reference)
+{
+    return std::abs(value - reference) / reference;
+}
+
+}
+
+class CompensatedSumTests : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void lowPart_keepsRoundingError()
+    {
+        CompensatedSum sum;
+        sum.add(16777216.0f);
+        sum.add(1.0f);
+        QCOMPARE(sum.high, 16777216.0f);
+        QCOMPARE(sum.low, 1.0f);
+        QCOMPARE(sum.get(), 16777217.0);
+
+        sum.add(1.0f);
+        QCOMPARE(sum.high, 16777218.0f);
+        QCOMPARE(sum.low, 0.0f);
+    }
+
+    void floatAccumulation_losesRaysOfLongRuns()
+    {
+        // Adding each ray to a float stops once the sum is large enough
+        const std::uint64_t rayCount = 1ull << 26;
+        RayWeights weights;
+        float floatSum = 0.0f;
+        double reference = 0.0;
+        for (auto ray = 0ull; ray < rayCount; ++ray)
+        {
+            auto weight = weights.next();
+            floatSum += weight;
+            reference += weight;
+        }
+        QVERIFY(getRelativeError(floatSum, reference) > 0.25);
+    }
+
+    void twoLevelAccumulation_keepsBillionsOfRays()
+    {
+        /* Billions of rays are accumulated into a float for each step, and
+           the steps into a compensated sum. The reference adds up every ray
+           in a long double, so the rounding of the steps counts as error. */
+        const unsigned int raysPerStep = 4096;
+        const unsigned int stepCount = 1u << 19;
+
+        RayWeights weights;
+        CompensatedSum sum;
+        long double reference = 0.0L;
+        for (auto step = 0u; step < stepCount; ++step)
+        {
+            float stepSum = 0.0f;
+            for (auto ray = 0u; ray < raysPerStep; ++ray)
+            {
+                auto weight = weights.next();
+                stepSum += weight;
+                reference += weight;
+            }
+            sum.add(stepSum);
+        }
+
+        // What remains is the rounding of the steps, well below the error of a float sum of them
+        QVERIFY(getRelativeError(sum.get(), static_cast<double>(reference)) < 1.0e-8);
+        QVERIFY(getRelativeError(sum.high, static_cast<double>(reference)) < 1.0e-7);
+    }
+};
+
+QTEST_APPLESS_MAIN(CompensatedSumTests)
+
+#include "compensatedSumTests.moc"
@@ -0,0 +1,158 @@
+#include <QtTest>
+#include <cmath>
+#include <stdexcept>
+#include "simulation/convexPolyhedron.h"
+
+using namespace HaloRay;
+
+namespace
+{
+
+std::vector<CrystalPlane> createCubePlanes(double halfSize)
+{
+    return {
+        {{1.0, 0.0, 0.0}, halfSize},
+        {{-1.0, 0.0, 0.0}, halfSize},
+        {{0.0, 1.0, 0.0}, halfSize},
+        {{0.0, -1.0, 0.0}, halfSize},
+        {{0.0, 0.0, 1.0}, halfSize},
+        {{0.0, 0.0, -1.0}, halfSize}};
+}
+
+const char *cubeObj =
+    "# Unit cube\n"
+    "v -1 -1 -1\nv 1 -1 -1\nv 1 1 -1\nv -1 1 -1\n"
+    "v -1 -1 1\nv 1 -1 1\nv 1 1 1\nv -1 1 1\n"
+    "f 1 4 3 2\nf 5 6 7 8\nf 1 2 6 5\nf 2 3 7 6\nf 3 4 8 7\nf 4 1 5 8\n";
+
+}
+
+class ConvexPolyhedronTests : public QObject
+{
+    Q_OBJECT
+private slots:
+    void fromPlanes_givenCube_createsSixSquareFaces()
+    {
+        auto cube = ConvexPolyhedron::fromPlanes(createCubePlanes(1.0));
+
+        QCOMPARE(cube.getFaces().size(), (size_t)6);
+        QCOMPARE(cube.getVertexCount(), 8u);
+        QCOMPARE(cube.getTriangleCount(), 12u);
+        for (const auto &face : cube.getFaces())
+        {
+            QCOMPARE(face.vertices.size(), (size_t)4);
+            QVERIFY(std::abs(face.getArea() - 4.0) < 1.0e-6);
+        }
+    }
+
+    void fromPlanes_facesAreCounterclockwiseFromOutside()
+    {
+        auto cube = ConvexPolyhedron::fromPlanes(createCubePlanes(1.0));
+
+        for (const auto &face : cube.getFaces())
+        {
+            const auto &v = face.vertices;
+            Vector3 a = {v[1][0] - v[0][0], v[1][1] - v[0][1], v[1][2] - v[0][2]};
+            Vector3 b = {v[2][0] - v[0][0], v[2][1] - v[0][1], v[2][2] - v[0][2]};
+            double normalX = a[1] * b[2] - a[2] * b[1];
+            double normalY = a[2] * b[0] - a[0] * b[2];
+            double normalZ = a[0] * b[1] - a[1] * b[0];
+            QVERIFY(normalX * face.plane.normal[0] + normalY * face.plane.normal[1] + normalZ * face.plane.normal[2] > 0.0);
+        }
+    }
+
+    void fromPlanes_ignoresRedundantPlanes()
+    {
+        auto planes = createCubePlanes(1.0);
+        planes.push_back({{1.0, 0.0, 0.0}, 1.0});
+        planes.push_back({{1.0, 1.0, 0.0}, 10.0});
+
+        auto cube = ConvexPolyhedron::fromPlanes(planes);
+
+        QCOMPARE(cube.getFaces().size(), (size_t)6);
+    }
+
+    void fromPlanes_givenOpenShape_throws()
+    {
+        auto planes = createCubePlanes(1.0);
+        planes.pop_back();
+
+        QVERIFY_EXCEPTION_THROWN(ConvexPolyhedron::fromPlanes(planes), std::runtime_error);
+    }
+
+    void fromMillerBravaisIndices_givenPrismAndBasalForms_createsHexagonalPrism()
+    {
+        auto prism = ConvexPolyhedron::fromMillerBravaisIndices(
+            "# Hexagonal column\n"
+            "{1 0 -1 0} 0.866\n"
+            "{0001} 2.0\n");
+
+        QCOMPARE(prism.getFaces().size(), (size_t)8);
+        QCOMPARE(prism.getVertexCount(), 12u);
+        QCOMPARE(prism.getTriangleCount(), 20u);
+    }
+
+    void fromMillerBravaisIndices_givenSingleFaces_doesNotExpandForms()
+    {
+        QVERIFY_EXCEPTION_THROWN(ConvexPolyhedron::fromMillerBravaisIndices("(1 0 -1 0) 0.866\n{0001} 1.0\n"), std::runtime_error);
+    }
+
+    void fromMillerBravaisIndices_givenInvalidIndices_throws()
+    {
+        QVERIFY_EXCEPTION_THROWN(ConvexPolyhedron::fromMillerBravaisIndices("{1 0 0 0} 1.0\n"), std::runtime_error);
+        QVERIFY_EXCEPTION_THROWN(ConvexPolyhedron::fromMillerBravaisIndices("{1 0 -1} 1.0\n"), std::runtime_error);
+        QVERIFY_EXCEPTION_THROWN(ConvexPolyhedron::fromMillerBravaisIndices("1 0 -1 0 1.0\n"), std::runtime_error);
+    }
+
+    void millerBravaisNormal_givenPyramidalFace_hasIceApexAngle()
+    {
+        auto normal = ConvexPolyhedron::getMillerBravaisNormal(1, 0, -1, 1);
+
+        // Pyramidal faces of ice are inclined 28 degrees from the C-axis
+        auto angleFromCAxis = std::acos(normal[1]) * 180.0 / 3.14159265358979;
+        QVERIFY(std::abs((90.0 - angleFromCAxis) - 28.0) < 0.1);
+    }
+
+    void fromObj_givenCube_createsCube()
+    {
+        auto cube = ConvexPolyhedron::fromObj(cubeObj);
+
+        QCOMPARE(cube.getFaces().size(), (size_t)6);
+        QCOMPARE(cube.getVertexCount(), 8u);
+    }
+
+    void fromObj_givenConcaveMesh_throws()
+    {
+        std::string concave = cubeObj;
+        concave.replace(concave.find("v 1 1 1"), 7, "v 0 0 0");
+
+        QVERIFY_EXCEPTION_THROWN(ConvexPolyhedron::fromObj(concave), std::runtime_error);
+    }
+
+    void appendFaceTable_storesFacesAndTriangleFans()
+    {
+        auto cube = ConvexPolyhedron::fromPlanes(createCubePlanes(1.0));
+        std::vector<float> faceTable;
+        std::vector<float> triangleTable(ConvexPolyhedron::triangleTableStride, 0.0f);
+
+        cube.appendFaceTable(faceTable, triangleTable);
+
+        QCOMPARE(faceTable.size(), (size_t)6 * ConvexPolyhedron::faceTableStride);
+        QCOMPARE(triangleTable.size(), (size_t)13 * ConvexPolyhedron::triangleTableStride);
+        for (auto face = 0u; face < 6; ++face)
+        {
+            const float *entry = &faceTable[face * ConvexPolyhedron::faceTableStride];
+            QCOMPARE(entry[3], 1.0f);
+            QVERIFY(std::abs(entry[4] - 4.0f) < 1.0e-5f);
+            QCOMPARE(entry[5], 1.0f + 2.0f * face);
+            QCOMPARE(entry[6], 2.0f);
+
+            auto lastTriangle = static_cast<unsigned int>(entry[5] + entry[6]) - 1;
+            QCOMPARE(triangleTable[lastTriangle * ConvexPolyhedron::triangleTableStride + 3], 1.0f);
+        }
+    }
+};
+
+QTEST_APPLESS_MAIN(ConvexPolyhedronTests)
+
+#include "convexPolyhedronTests.moc"
@@ -53,6 +53,29 @@ private slots:
         QCOMPARE(repository.getProbability(2), 1.0 / 2.0);
     }
 
+    void fingerprintIgnoresWeightsNamesAndEnabled()
+    {
+        auto repository = HaloRay::CrystalPopulationRepository();
+        auto fingerprint = repository.getFingerprint();
+        repository.setWeight(0, 5.0);
+        repository.setName(1, "Renamed");
+        repository.get(2).enabled = false;
+        QCOMPARE(repository.getFingerprint(), fingerprint);
+    }
+
+    void fingerprintChangesWithCrystals()
+    {
+        auto repository = HaloRay::CrystalPopulationRepository();
+        auto fingerprint = repository.getFingerprint();
+        repository.get(0).tiltStd += 1.0f;
+        QVERIFY(repository.getFingerprint() != fingerprint);
+
+        repository.get(0).tiltStd -= 1.0f;
+        QCOMPARE(repository.getFingerprint(), fingerprint);
+        repository.add(HaloRay::CrystalPopulationPreset::Random);
+        QVERIFY(repository.getFingerprint() != fingerprint);
+    }
+
     void clearEmptiesRepository()
     {
         auto repository = HaloRay::CrystalPopulationRepository();
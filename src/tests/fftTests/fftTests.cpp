@@ -0,0 +1,100 @@
+#include <QtTest>
+#include <cmath>
+#include <complex>
+#include <stdexcept>
+#include <vector>
+#include "simulation/fft.h"
+#include "simulation/trigonometryUtilities.h"
+
+using namespace HaloRay;
+
+class FFTTests : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void transform_matchesDirectDft()
+    {
+        const unsigned int size = 16;
+        std::vector<std::complex<float>> data(size);
+        for (auto i = 0u; i < size; ++i)
+            data[i] = std::complex<float>(std::sin(0.7f * i) + 0.1f * i, std::cos(1.3f * i));
+
+        std::vector<std::complex<double>> expected(size);
+        for (auto k = 0u; k < size; ++k)
+        {
+            for (auto n = 0u; n < size; ++n)
+                expected[k] += std::complex<double>(data[n]) * std::polar(1.0, -2.0 * PI * k * n / size);
+        }
+
+        FFT::transform(data.data(), size, 1, false);
+        for (auto k = 0u; k < size; ++k)
+        {
+            QVERIFY(std::abs(data[k].real() - expected[k].real()) < 1.0e-4);
+            QVERIFY(std::abs(data[k].imag() - expected[k].imag()) < 1.0e-4);
+        }
+    }
+
+    void inverseTransform_restoresData()
+    {
+        const unsigned int size = 64;
+        std::vector<std::complex<float>> data(size * size);
+        for (auto i = 0u; i < data.size(); ++i)
+            data[i] = std::complex<float>(static_cast<float>((i * 7919) % 101), static_cast<float>((i * 104729) % 37));
+        auto original = data;
+
+        FFT::transform2D(data, size, false);
+        FFT::transform2D(data, size, true);
+        for (auto i = 0u; i < data.size(); ++i)
+            QVERIFY(std::abs(data[i] - original[i]) < 1.0e-3);
+    }
+
+    void stridedTransform_transformsColumn()
+    {
+        const unsigned int size = 8;
+        std::vector<std::complex<float>> data(size * size, std::complex<float>(5.0f, 0.0f));
+        for (auto y = 0u; y < size; ++y)
+            data[y * size + 2] = std::complex<float>(1.0f, 0.0f);
+
+        FFT::transform(data.data() + 2, size, size, false);
+
+        // A constant column transforms into its sum in the first element
+        QCOMPARE(data[2], std::complex<float>(8.0f, 0.0f));
+        for (auto y = 1u; y < size; ++y)
+            QVERIFY(std::abs(data[y * size + 2]) < 1.0e-5f);
+        QCOMPARE(data[3], std::complex<float>(5.0f, 0.0f));
+    }
+
+    void productOfSpectra_isCircularConvolution()
+    {
+        const unsigned int size = 32;
+        std::vector<std::complex<float>> image(size * size);
+        std::vector<std::complex<float>> kernel(size * size);
+        image[5 * size + 30] = 2.0f;
+        kernel[0] = 0.5f;
+        kernel[1 * size + 3] = 0.25f;
+
+        FFT::transform2D(image, size, false);
+        FFT::transform2D(kernel, size, false);
+        for (auto i = 0u; i < image.size(); ++i)
+            image[i] *= kernel[i];
+        FFT::transform2D(image, size, true);
+
+        // The shifted copy wraps around the right edge
+        QVERIFY(std::abs(image[5 * size + 30] - std::complex<float>(1.0f, 0.0f)) < 1.0e-5f);
+        QVERIFY(std::abs(image[6 * size + 1] - std::complex<float>(0.5f, 0.0f)) < 1.0e-5f);
+        QVERIFY(std::abs(image[5 * size + 31]) < 1.0e-5f);
+    }
+
+    void nonPowerOfTwoSize_throws()
+    {
+        std::vector<std::complex<float>> data(12 * 12);
+        QVERIFY(!FFT::isPowerOfTwo(12));
+        QVERIFY_EXCEPTION_THROWN(FFT::transform(data.data(), 12, 1, false), std::runtime_error);
+        QVERIFY_EXCEPTION_THROWN(FFT::transform2D(data, 12, false), std::runtime_error);
+    }
+};
+
+QTEST_APPLESS_MAIN(FFTTests)
+
+#include "fftTests.moc"
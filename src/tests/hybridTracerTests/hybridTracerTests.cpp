@@ -0,0 +1,169 @@
+#include <QtTest>
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <thread>
+#include <vector>
+#include "simulation/hybridTracer.h"
+#include "simulation/throughputBalancer.h"
+
+using namespace HaloRay;
+
+namespace
+{
+
+Kernels::SceneSettings createSettings(unsigned int seed)
+{
+    Kernels::SceneSettings settings;
+    settings.sun.altitude = 0.3f;
+    settings.sun.diameter = 0.01f;
+    settings.sun.useSpectrum = false;
+    std::fill(settings.sun.spectrum, settings.sun.spectrum + 31, 1.0f);
+    settings.camera = {0.3f, 0.0f, 0.5f, Kernels::SceneCamera::Stereographic, false, 64, 64};
+
+    settings.crystals.tiltDistribution = Kernels::SceneCrystals::Uniform;
+    settings.crystals.tiltAverage = 0.0f;
+    settings.crystals.tiltStd = 0.0f;
+    settings.crystals.rotationDistribution = Kernels::SceneCrystals::Uniform;
+    settings.crystals.rotationAverage = 0.0f;
+    settings.crystals.rotationStd = 0.0f;
+    settings.crystals.caRatioAverage = 1.0f;
+    settings.crystals.caRatioStd = 0.0f;
+    settings.crystals.upperApexAngle = 1.0f;
+    settings.crystals.upperApexHeightAverage = 0.0f;
+    settings.crystals.upperApexHeightStd = 0.0f;
+    settings.crystals.lowerApexAngle = 1.0f;
+    settings.crystals.lowerApexHeightAverage = 0.0f;
+    settings.crystals.lowerApexHeightStd = 0.0f;
+    std::fill(settings.crystals.prismFaceDistances, settings.crystals.prismFaceDistances + 6, 1.0f);
+    settings.crystals.weight = 1.0f;
+
+    settings.trace.russianRouletteDepth = 10;
+    settings.trace.seed = seed;
+    settings.trace.populationIndex = 0;
+    settings.sobolDirections = nullptr;
+    return settings;
+}
+
+std::size_t countPixels(std::vector<Kernels::Splat> splats)
+{
+    std::sort(splats.begin(), splats.end(), [](const Kernels::Splat &a, const Kernels::Splat &b) { return a.pixelIndex < b.pixelIndex; });
+    auto last = std::unique(splats.begin(), splats.end(), [](const Kernels::Splat &a, const Kernels::Splat &b) { return a.pixelIndex == b.pixelIndex; });
+    return static_cast<std::size_t>(last - splats.begin());
+}
+
+double sumGreen(const std::vector<Kernels::Splat> &splats)
+{
+    double sum = 0.0;
+    for (const auto &splat : splats)
+        sum += splat.green;
+    return sum;
+}
+
+}
+
+class HybridTracerTests : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void balancer_startsWithSmallCpuShare()
+    {
+        ThroughputBalancer balancer;
+        QCOMPARE(balancer.getCpuShare(), ThroughputBalancer::initialCpuShare);
+        balancer.addGpuMeasurement(1.0e6, 0.01);
+        QCOMPARE(balancer.getCpuShare(), ThroughputBalancer::initialCpuShare);
+    }
+
+    void balancer_splitsByThroughput()
+    {
+        ThroughputBalancer balancer;
+        balancer.addGpuMeasurement(3.0e6, 1.0);
+        balancer.addCpuMeasurement(1.0e5, 0.1);
+        QVERIFY(std::abs(balancer.getGpuRaysPerSecond() - 3.0e6) < 1.0);
+        QVERIFY(std::abs(balancer.getCpuRaysPerSecond() - 1.0e6) < 1.0);
+        QVERIFY(std::abs(balancer.getCpuShare() - 0.25) < 1.0e-9);
+    }
+
+    void balancer_smoothsAndLimitsShare()
+    {
+        ThroughputBalancer balancer;
+        balancer.addGpuMeasurement(1.0e6, 1.0);
+        balancer.addGpuMeasurement(2.0e6, 1.0);
+        QVERIFY(std::abs(balancer.getGpuRaysPerSecond() - (1.0e6 + ThroughputBalancer::smoothing * 1.0e6)) < 1.0);
+
+        // Empty frames are not measured
+        balancer.addGpuMeasurement(0.0, 1.0);
+        balancer.addCpuMeasurement(1.0e6, 0.0);
+        QCOMPARE(balancer.getCpuRaysPerSecond(), 0.0);
+
+        balancer.addCpuMeasurement(1.0e9, 1.0);
+        QCOMPARE(balancer.getCpuShare(), ThroughputBalancer::maxCpuShare);
+
+        balancer.reset();
+        QCOMPARE(balancer.getGpuRaysPerSecond(), 0.0);
+        QCOMPARE(balancer.getCpuShare(), ThroughputBalancer::initialCpuShare);
+    }
+
+    void pool_matchesSingleThread()
+    {
+        std::vector<HybridTracerTask> tasks = {
+            {createSettings(1), 0, 10000},
+            {createSettings(2), 500, 3000}};
+        std::vector<Kernels::Splat> expected;
+        for (const auto &task : tasks)
+            Kernels::traceScene(task.settings, task.firstRay, task.rayCount, expected);
+
+        HybridTracer tracer(3);
+        QCOMPARE(tracer.getThreadCount(), 3u);
+        tracer.start(tasks);
+        QVERIFY(tracer.isBusy());
+        const auto &splats = tracer.wait();
+        QVERIFY(!tracer.isBusy());
+        QCOMPARE(tracer.getLastRayCount(), static_cast<std::uint64_t>(13000));
+        QVERIFY(tracer.getLastSeconds() > 0.0);
+
+        // Each pixel is written once
+        QCOMPARE(splats.size(), countPixels(expected));
+        for (auto i = 1u; i < splats.size(); ++i)
+            QVERIFY(splats[i - 1].pixelIndex < splats[i].pixelIndex);
+        QVERIFY(std::abs(sumGreen(splats) - sumGreen(expected)) < 1.0e-3 * std::abs(sumGreen(expected)));
+    }
+
+    void pool_tracesFrameAfterFrame()
+    {
+        HybridTracer tracer(2);
+        std::vector<Kernels::Splat> expected;
+        Kernels::traceScene(createSettings(3), 20000, 5000, expected);
+
+        tracer.start({{createSettings(3), 0, 5000}});
+        // Starting again waits for the previous frame
+        tracer.start({{createSettings(3), 20000, 5000}});
+        QCOMPARE(tracer.wait().size(), countPixels(expected));
+        QCOMPARE(tracer.wait().size(), countPixels(expected));
+
+        tracer.start({});
+        QVERIFY(tracer.wait().empty());
+    }
+
+    void pool_reportsFinishedWithoutWaiting()
+    {
+        HybridTracer tracer(2);
+        QVERIFY(tracer.isFinished());
+
+        tracer.start({{createSettings(4), 0, 20000}});
+        auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(60);
+        while (!tracer.isFinished() && std::chrono::steady_clock::now() < deadline)
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        QVERIFY(tracer.isFinished());
+
+        // Finished rays are still merged by waiting for them
+        QVERIFY(tracer.isBusy());
+        QVERIFY(!tracer.wait().empty());
+        QVERIFY(!tracer.isBusy());
+    }
+};
+
+QTEST_APPLESS_MAIN(HybridTracerTests)
+
+#include "hybridTracerTests.moc"
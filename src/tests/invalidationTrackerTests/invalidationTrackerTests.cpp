@@ -0,0 +1,66 @@
+#include <QtTest>
+#include <stdexcept>
+#include "simulation/invalidationTracker.h"
+
+using namespace HaloRay;
+
+class InvalidationTrackerTests : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void invalidationsOutsideBatches_areAppliedRightAway()
+    {
+        InvalidationTracker tracker;
+        QVERIFY(!tracker.isUpdating());
+        QVERIFY(tracker.invalidate(InvalidationTracker::Clear));
+        QVERIFY(tracker.invalidate(InvalidationTracker::Reset));
+    }
+
+    void batch_appliesOneInvalidationAtEnd()
+    {
+        InvalidationTracker tracker;
+        tracker.beginUpdate();
+        QVERIFY(tracker.isUpdating());
+        for (auto i = 0; i < 25; ++i)
+            QVERIFY(!tracker.invalidate(InvalidationTracker::Clear));
+        QCOMPARE(tracker.endUpdate(), InvalidationTracker::Clear);
+        QVERIFY(!tracker.isUpdating());
+
+        // Nothing is left over for the next batch
+        tracker.beginUpdate();
+        QCOMPARE(tracker.endUpdate(), InvalidationTracker::None);
+    }
+
+    void batch_appliesStrongestInvalidation()
+    {
+        InvalidationTracker tracker;
+        tracker.beginUpdate();
+        tracker.invalidate(InvalidationTracker::Clear);
+        tracker.invalidate(InvalidationTracker::Reset);
+        tracker.invalidate(InvalidationTracker::Clear);
+        QCOMPARE(tracker.endUpdate(), InvalidationTracker::Reset);
+    }
+
+    void nestedBatches_applyAtOutermostEnd()
+    {
+        InvalidationTracker tracker;
+        tracker.beginUpdate();
+        tracker.beginUpdate();
+        tracker.invalidate(InvalidationTracker::Clear);
+        QCOMPARE(tracker.endUpdate(), InvalidationTracker::None);
+        QVERIFY(tracker.isUpdating());
+        QVERIFY(!tracker.invalidate(InvalidationTracker::Reset));
+        QCOMPARE(tracker.endUpdate(), InvalidationTracker::Reset);
+    }
+
+    void unbalancedEnd_throws()
+    {
+        InvalidationTracker tracker;
+        QVERIFY_EXCEPTION_THROWN(tracker.endUpdate(), std::runtime_error);
+    }
+};
+
+QTEST_APPLESS_MAIN(InvalidationTrackerTests)
+
+#include "invalidationTrackerTests.moc"
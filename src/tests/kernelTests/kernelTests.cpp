@@ -0,0 +1,247 @@
+#include <QtTest>
+#include <cmath>
+#include <random>
+#include <vector>
+#include "crystalMesh.h"
+#include "randomStream.h"
+#include "rayBatch.h"
+#include "rayTracer.h"
+#include "scalarTracer.h"
+
+using namespace HaloRay::Kernels;
+
+namespace
+{
+
+const float indexOfRefraction = 1.31f;
+
+bool isOrthonormal(const Matrix3 &m)
+{
+    for (auto i = 0; i < 3; ++i)
+    {
+        for (auto j = 0; j < 3; ++j)
+        {
+            auto expected = i == j ? 1.0f : 0.0f;
+            if (std::abs(dot(m.columns[i], m.columns[j]) - expected) > 1.0e-5f) return false;
+        }
+    }
+    return true;
+}
+
+HexagonalCrystalShape createRandomShape(std::mt19937 &engine)
+{
+    std::uniform_real_distribution<float> distribution(0.0f, 1.0f);
+    auto shape = HexagonalCrystalShape::createDefault();
+    for (auto &distance : shape.prismFaceDistances)
+        distance = 0.6f + 0.8f * distribution(engine);
+    shape.caRatio = 0.1f + 3.0f * distribution(engine);
+    shape.upperApexHeight = distribution(engine);
+    shape.lowerApexHeight = distribution(engine);
+    return shape;
+}
+
+// Rays entering the crystals through a random face, like in the raytracing shader
+RayBatch createRays(const std::vector<CrystalMesh> &meshes, unsigned int rayCount, std::mt19937 &engine)
+{
+    std::uniform_real_distribution<float> distribution(0.0f, 1.0f);
+    RayBatch rays;
+    rays.resize(rayCount);
+    for (auto i = 0u; i < rayCount; ++i)
+    {
+        const auto &mesh = meshes.size() == 1 ? meshes[0] : meshes[i];
+        auto rotation = getUniformRandomRotationMatrix(distribution(engine), distribution(engine), distribution(engine));
+        auto direction = Vector3{0.0f, -1.0f, 0.0f} * rotation;
+        auto triangleIndex = selectFirstTriangle(mesh, direction, distribution(engine));
+        auto origin = sampleTriangle(mesh, triangleIndex, distribution(engine), distribution(engine));
+        auto refracted = refract(direction, mesh.normals[triangleIndex], 1.0f / indexOfRefraction);
+
+        rays.originX[i] = origin.x;
+        rays.originY[i] = origin.y;
+        rays.originZ[i] = origin.z;
+        rays.directionX[i] = refracted.x;
+        rays.directionY[i] = refracted.y;
+        rays.directionZ[i] = refracted.z;
+        rays.indexOfRefraction[i] = indexOfRefraction;
+        rays.rayIndex[i] = i;
+    }
+    return rays;
+}
+
+// Share of rays the kernels trace to the same outcome
+double getAgreement(const RayBatch &expected, const RayBatch &actual)
+{
+    auto agreeing = 0u;
+    for (auto i = 0u; i < expected.size(); ++i)
+    {
+        if (expected.status[i] != actual.status[i]) continue;
+        if (std::abs(expected.weight[i] - actual.weight[i]) > 1.0e-4f * expected.weight[i]) continue;
+        Vector3 expectedDirection = {expected.directionX[i], expected.directionY[i], expected.directionZ[i]};
+        Vector3 actualDirection = {actual.directionX[i], actual.directionY[i], actual.directionZ[i]};
+        if (length(expectedDirection - actualDirection) > 1.0e-3f) continue;
+        ++agreeing;
+    }
+    return static_cast<double>(agreeing) / expected.size();
+}
+
+std::vector<InstructionSet> getSupportedPacketInstructionSets()
+{
+    std::vector<InstructionSet> instructionSets;
+    for (auto instructionSet : {InstructionSet::Sse4, InstructionSet::Avx2, InstructionSet::Avx512})
+    {
+        if (isInstructionSetSupported(instructionSet))
+            instructionSets.push_back(instructionSet);
+    }
+    return instructionSets;
+}
+
+}
+
+class KernelTests : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void crystalMesh_isClosed()
+    {
+        std::mt19937 engine(1);
+        auto mesh = createHexagonalCrystal(createRandomShape(engine));
+        Vector3 sum = {0.0f, 0.0f, 0.0f};
+        for (auto i = 0u; i < CrystalMesh::triangleCount; ++i)
+        {
+            QVERIFY(mesh.areas[i] >= 0.0f);
+            sum = sum + mesh.areas[i] * mesh.normals[i];
+        }
+        QVERIFY(length(sum) < 1.0e-4f);
+    }
+
+    void intersection_findsFaceFromInside()
+    {
+        auto mesh = createHexagonalCrystal(HexagonalCrystalShape::createDefault());
+        Vector3 direction = {1.0f, 0.0f, 0.0f};
+        auto hit = findIntersection(mesh, {0.0f, 0.0f, 0.0f}, direction);
+        QVERIFY(hit.didHit);
+        QVERIFY(dot(mesh.normals[hit.triangleIndex], direction) > 0.0f);
+        QVERIFY(std::abs(hit.hitPoint.y) < 1.0e-5f);
+    }
+
+    void reflectionCoefficient_matchesFresnel()
+    {
+        Vector3 normal = {0.0f, 1.0f, 0.0f};
+        auto normalIncidence = getReflectionCoefficient(normal, {0.0f, -1.0f, 0.0f}, indexOfRefraction, 1.0f);
+        auto expected = std::pow((indexOfRefraction - 1.0f) / (indexOfRefraction + 1.0f), 2.0f);
+        QVERIFY(std::abs(normalIncidence - expected) < 1.0e-5f);
+
+        // Past the critical angle of about 50 degrees everything is reflected
+        auto grazing = normalize({1.0f, -0.5f, 0.0f});
+        QCOMPARE(getReflectionCoefficient(normal, grazing, indexOfRefraction, 1.0f), 1.0f);
+    }
+
+    void rotations_areOrthonormal()
+    {
+        QVERIFY(isOrthonormal(getRotationMatrix(0.3f, 1.2f, -2.0f)));
+        QVERIFY(isOrthonormal(getUniformRandomRotationMatrix(0.1f, 0.7f, 0.4f)));
+
+        auto rotated = getRotationMatrix(0.0f, 0.0f, 0.5f) * Vector3{0.0f, 1.0f, 0.0f};
+        QVERIFY(length(rotated - Vector3{0.0f, 1.0f, 0.0f}) < 1.0e-6f);
+    }
+
+    void randomStream_matchesPhiloxKnownAnswer()
+    {
+        std::uint32_t numbers[4];
+        RandomStream::getBlock(0u, 0u, 0ull, 0u, numbers);
+        QCOMPARE(numbers[0], 0x6627e8d5u);
+        QCOMPARE(numbers[1], 0xe169c58du);
+        QCOMPARE(numbers[2], 0xbc57ac4cu);
+        QCOMPARE(numbers[3], 0x9b00dbd8u);
+
+        // Draws are taken from blocks of four in order, like rand in the shader
+        RandomStream::getBlock(5u, 2u, 0x100000007ull, 1u, numbers);
+        QCOMPARE(RandomStream::get(5u, 2u, 0x100000007ull, 6u), RandomStream::toUniform(numbers[2]));
+    }
+
+    void reflectionDraws_addRouletteDrawsPastDepth()
+    {
+        QCOMPARE(RandomStream::getReflectionDraw(10u, 2, 0), 10u);
+        QCOMPARE(RandomStream::getReflectionDraw(10u, 2, 2), 12u);
+        QCOMPARE(RandomStream::getReflectionDraw(10u, 2, 3), 14u);
+        QCOMPARE(RandomStream::getReflectionDraw(10u, 2, 4), 16u);
+    }
+
+    void scalarDispatch_matchesReference()
+    {
+        std::mt19937 engine(2);
+        std::vector<CrystalMesh> meshes = {createHexagonalCrystal(createRandomShape(engine))};
+        TraceSettings settings = {3, 1234u};
+        auto expected = createRays(meshes, 1000, engine);
+        auto actual = expected;
+
+        traceRaysScalar(meshes.data(), true, expected, settings);
+        traceRays(meshes.data(), true, actual, settings, InstructionSet::Scalar);
+        QVERIFY(actual.status == expected.status);
+        QVERIFY(actual.directionX == expected.directionX);
+        QVERIFY(actual.weight == expected.weight);
+    }
+
+    void packets_matchScalarWithSharedMesh()
+    {
+        std::mt19937 engine(3);
+        std::vector<CrystalMesh> meshes = {createHexagonalCrystal(createRandomShape(engine))};
+        TraceSettings settings = {2, 99u};
+        // Not a multiple of any packet width, to cover partial packets
+        auto reference = createRays(meshes, 10001, engine);
+        auto rays = reference;
+        traceRaysScalar(meshes.data(), true, reference, settings);
+
+        for (auto instructionSet : getSupportedPacketInstructionSets())
+        {
+            auto packetRays = rays;
+            traceRays(meshes.data(), true, packetRays, settings, instructionSet);
+            QVERIFY2(getAgreement(reference, packetRays) > 0.99, getInstructionSetName(instructionSet));
+        }
+    }
+
+    void packets_matchScalarWithMeshPerRay()
+    {
+        std::mt19937 engine(4);
+        const auto rayCount = 2003u;
+        std::vector<CrystalMesh> meshes;
+        for (auto i = 0u; i < rayCount; ++i)
+            meshes.push_back(createHexagonalCrystal(createRandomShape(engine)));
+        // Streams past the first high word of ray indices, continuing after other draws
+        TraceSettings settings = {5, 7u, 2u, 1u, 9u};
+        auto reference = createRays(meshes, rayCount, engine);
+        auto rays = reference;
+        traceRaysScalar(meshes.data(), false, reference, settings);
+
+        for (auto instructionSet : getSupportedPacketInstructionSets())
+        {
+            auto packetRays = rays;
+            traceRays(meshes.data(), false, packetRays, settings, instructionSet);
+            QVERIFY2(getAgreement(reference, packetRays) > 0.99, getInstructionSetName(instructionSet));
+        }
+    }
+
+    void rays_escapeOrAreAccountedFor()
+    {
+        std::mt19937 engine(5);
+        std::vector<CrystalMesh> meshes = {createHexagonalCrystal(HexagonalCrystalShape::createDefault())};
+        TraceSettings settings = {TraceSettings::maxHits, 11u};
+        auto rays = createRays(meshes, 4096, engine);
+        traceRays(meshes.data(), true, rays, settings);
+
+        auto escaped = 0u;
+        for (auto i = 0u; i < rays.size(); ++i)
+        {
+            QVERIFY(rays.status[i] != TraceTerminatedByRoulette);
+            if (rays.status[i] < 0) continue;
+            ++escaped;
+            Vector3 direction = {rays.directionX[i], rays.directionY[i], rays.directionZ[i]};
+            QVERIFY(std::abs(length(direction) - 1.0f) < 1.0e-3f);
+        }
+        QVERIFY(escaped > rays.size() * 9 / 10);
+    }
+};
+
+QTEST_APPLESS_MAIN(KernelTests)
+
+#include "kernelTests.moc"
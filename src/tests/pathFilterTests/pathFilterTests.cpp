@@ -0,0 +1,121 @@
+#include <QtTest>
+#include <stdexcept>
+#include "simulation/pathFilter.h"
+
+using namespace HaloRay;
+
+class PathFilterTests : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void signature_roundTrips()
+    {
+        auto signature = PathSignature::encode(3, 25, PathSignature::OneInternalReflection);
+        QCOMPARE(PathSignature::getEntryFace(signature), 3u);
+        QCOMPARE(PathSignature::getExitFace(signature), 25u);
+        QCOMPARE(PathSignature::getBounceClass(signature), static_cast<unsigned int>(PathSignature::OneInternalReflection));
+        QVERIFY(signature < PathSignature::signatureCount);
+    }
+
+    void emptyExpression_matchesNothing()
+    {
+        auto filter = PathFilter::parse("  ");
+        QVERIFY(filter.isEmpty());
+        QVERIFY(!filter.matches(PathSignature::encode(3, 5, PathSignature::NoInternalReflections), true));
+    }
+
+    void exactPath_matchesOnlyRefractedRays()
+    {
+        auto filter = PathFilter::parse("3-5");
+        QVERIFY(filter.matches(PathSignature::encode(3, 5, PathSignature::NoInternalReflections), false));
+        QVERIFY(filter.matches(PathSignature::encode(3, 5, PathSignature::ManyInternalReflections), false));
+        QVERIFY(!filter.matches(PathSignature::encode(3, 6, PathSignature::NoInternalReflections), false));
+        QVERIFY(!filter.matches(PathSignature::encode(5, 3, PathSignature::NoInternalReflections), false));
+    }
+
+    void hexagonalCrystals_matchSymmetricPaths()
+    {
+        auto filter = PathFilter::parse("3-5");
+        QVERIFY(filter.matches(PathSignature::encode(4, 6, PathSignature::NoInternalReflections), true));
+        QVERIFY(filter.matches(PathSignature::encode(8, 4, PathSignature::NoInternalReflections), true));
+        QVERIFY(filter.matches(PathSignature::encode(5, 3, PathSignature::NoInternalReflections), true));
+        QVERIFY(!filter.matches(PathSignature::encode(3, 6, PathSignature::NoInternalReflections), true));
+        QVERIFY(!filter.matches(PathSignature::encode(1, 3, PathSignature::NoInternalReflections), true));
+    }
+
+    void hexagonalSymmetry_keepsFaceGroups()
+    {
+        auto filter = PathFilter::parse("13-3");
+        QVERIFY(filter.matches(PathSignature::encode(15, 5, PathSignature::NoInternalReflections), true));
+        QVERIFY(!filter.matches(PathSignature::encode(15, 3, PathSignature::NoInternalReflections), true));
+        QVERIFY(!filter.matches(PathSignature::encode(23, 3, PathSignature::NoInternalReflections), true));
+    }
+
+    void reflectionCount_selectsBounceClass()
+    {
+        auto filter = PathFilter::parse("1-3:1, 3-5:2+");
+        QVERIFY(filter.matches(PathSignature::encode(1, 3, PathSignature::OneInternalReflection), false));
+        QVERIFY(!filter.matches(PathSignature::encode(1, 3, PathSignature::NoInternalReflections), false));
+        QVERIFY(filter.matches(PathSignature::encode(3, 5, PathSignature::ManyInternalReflections), false));
+        QVERIFY(!filter.matches(PathSignature::encode(3, 5, PathSignature::OneInternalReflection), false));
+    }
+
+    void singleFace_matchesExternalReflection()
+    {
+        auto filter = PathFilter::parse("1");
+        QVERIFY(filter.matches(PathSignature::encode(1, 1, PathSignature::ExternalReflection), true));
+        QVERIFY(!filter.matches(PathSignature::encode(1, 1, PathSignature::OneInternalReflection), true));
+        QVERIFY(!filter.matches(PathSignature::encode(2, 2, PathSignature::ExternalReflection), true));
+    }
+
+    void wildcard_matchesAnyFace()
+    {
+        auto filter = PathFilter::parse("1-*");
+        QVERIFY(filter.matches(PathSignature::encode(1, 2, PathSignature::NoInternalReflections), false));
+        QVERIFY(filter.matches(PathSignature::encode(1, 40, PathSignature::ManyInternalReflections), false));
+        QVERIFY(!filter.matches(PathSignature::encode(2, 1, PathSignature::NoInternalReflections), false));
+        QVERIFY(!filter.matches(PathSignature::encode(1, 1, PathSignature::ExternalReflection), false));
+    }
+
+    void unknownPath_matchesNothing()
+    {
+        auto filter = PathFilter::parse("*-*");
+        QVERIFY(!filter.matches(PathSignature::unknown, true));
+        QVERIFY(!filter.matches(PathSignature::unknown, false));
+    }
+
+    void mask_hasBitForEachMatchingSignature()
+    {
+        auto filter = PathFilter::parse("3-5:0");
+        auto mask = filter.createMask(false);
+        QCOMPARE(mask.size(), static_cast<std::size_t>(PathFilter::maskWordCount));
+
+        auto signature = PathSignature::encode(3, 5, PathSignature::NoInternalReflections);
+        QVERIFY(mask[signature / 32] & (1u << (signature % 32)));
+
+        auto bitCount = 0u;
+        for (auto word : mask)
+        {
+            for (auto bit = 0u; bit < 32; ++bit)
+                bitCount += (word >> bit) & 1u;
+        }
+        QCOMPARE(bitCount, 1u);
+        QCOMPARE(filter.createMask(true).size(), mask.size());
+    }
+
+    void invalidTerms_throw()
+    {
+        QVERIFY_EXCEPTION_THROWN(PathFilter::parse("3-"), std::runtime_error);
+        QVERIFY_EXCEPTION_THROWN(PathFilter::parse("0-3"), std::runtime_error);
+        QVERIFY_EXCEPTION_THROWN(PathFilter::parse("3-64"), std::runtime_error);
+        QVERIFY_EXCEPTION_THROWN(PathFilter::parse("3-5:3"), std::runtime_error);
+        QVERIFY_EXCEPTION_THROWN(PathFilter::parse("3:1"), std::runtime_error);
+        QVERIFY_EXCEPTION_THROWN(PathFilter::parse("3-5,,4-6"), std::runtime_error);
+        QVERIFY_EXCEPTION_THROWN(PathFilter::parse("a-b"), std::runtime_error);
+    }
+};
+
+QTEST_APPLESS_MAIN(PathFilterTests)
+
+#include "pathFilterTests.moc"
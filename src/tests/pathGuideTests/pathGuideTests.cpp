@@ -0,0 +1,150 @@
+#include <QtTest>
+#include <cmath>
+#include <cstdint>
+#include <random>
+#include <vector>
+#include "simulation/pathGuide.h"
+
+using namespace HaloRay;
+
+namespace
+{
+
+std::vector<std::uint32_t> createCounters()
+{
+    return std::vector<std::uint32_t>(PathGuide::cellCount * PathGuide::countersPerCell, 0u);
+}
+
+double getProbability(const std::vector<float> &cdf, unsigned int cell)
+{
+    return cell == 0 ? cdf[0] : static_cast<double>(cdf[cell]) - cdf[cell - 1];
+}
+
+// Light a ray brings to the image from a point of the guided hypercube, given as a cell and a position within it
+double getRayLight(unsigned int cell, double position)
+{
+    return (cell % 97 == 0 ? 40.0 : 1.0) * (0.5 + position);
+}
+
+}
+
+class PathGuideTests : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void cellIndex_coversAllCells()
+    {
+        QCOMPARE(PathGuide::getCellIndex(0, 0, 0, 0), 0u);
+        QCOMPARE(PathGuide::getCellIndex(0, 0, 0, 1), 1u);
+        QCOMPARE(PathGuide::getCellIndex(0, 0, 1, 0), PathGuide::entryBins);
+        QCOMPARE(PathGuide::getCellIndex(PathGuide::yawBins - 1, PathGuide::tiltBins - 1, PathGuide::rotationBins - 1, PathGuide::entryBins - 1), PathGuide::cellCount - 1);
+    }
+
+    void noCounts_givesUniformCdf()
+    {
+        auto counters = createCounters();
+        auto cdf = PathGuide::createCdf(counters.data());
+        QCOMPARE(cdf.size(), static_cast<std::size_t>(PathGuide::cellCount));
+        QCOMPARE(cdf.back(), 1.0f);
+        QVERIFY(std::abs(getProbability(cdf, 123) - 1.0 / PathGuide::cellCount) < 1.0e-7);
+    }
+
+    void countedCells_areMoreLikely()
+    {
+        auto counters = createCounters();
+        auto brightCell = PathGuide::getCellIndex(5, 3, 2, 1);
+        auto dimCell = PathGuide::getCellIndex(20, 8, 9, 0);
+        counters[brightCell * PathGuide::countersPerCell] = 3000;
+        counters[dimCell * PathGuide::countersPerCell] = 1000;
+
+        auto cdf = PathGuide::createCdf(counters.data());
+        QCOMPARE(cdf.back(), 1.0f);
+
+        auto floor = PathGuide::uniformFraction / PathGuide::cellCount;
+        QVERIFY(std::abs(getProbability(cdf, brightCell) - (0.75 * (1.0 - PathGuide::uniformFraction) + floor)) < 1.0e-5);
+        QVERIFY(std::abs(getProbability(cdf, dimCell) - (0.25 * (1.0 - PathGuide::uniformFraction) + floor)) < 1.0e-5);
+
+        // Every cell can still be sampled, so that guided images stay unbiased
+        QVERIFY(std::abs(getProbability(cdf, 0) - floor) < 1.0e-7);
+        for (auto cell = 1u; cell < PathGuide::cellCount; ++cell)
+            QVERIFY(cdf[cell] > cdf[cell - 1]);
+    }
+
+    void highCounterWord_carriesWeight()
+    {
+        auto counters = createCounters();
+        auto firstCell = PathGuide::getCellIndex(1, 0, 0, 0);
+        auto secondCell = PathGuide::getCellIndex(2, 0, 0, 0);
+        counters[firstCell * PathGuide::countersPerCell + 1] = 1;
+        counters[secondCell * PathGuide::countersPerCell] = 0x80000000u;
+
+        auto cdf = PathGuide::createCdf(counters.data());
+        auto ratio = (getProbability(cdf, firstCell) - PathGuide::uniformFraction / PathGuide::cellCount) /
+                     (getProbability(cdf, secondCell) - PathGuide::uniformFraction / PathGuide::cellCount);
+        QVERIFY(std::abs(ratio - 2.0) < 1.0e-3);
+    }
+
+    void sampledCell_hasCdfProbability()
+    {
+        auto counters = createCounters();
+        auto brightCell = PathGuide::getCellIndex(5, 3, 2, 1);
+        counters[brightCell * PathGuide::countersPerCell] = 1000;
+        auto cdf = PathGuide::createCdf(counters.data());
+
+        double probability;
+        auto middle = static_cast<float>(0.5 * (getProbability(cdf, brightCell) + 2.0 * cdf[brightCell - 1]));
+        QCOMPARE(PathGuide::sampleCell(cdf, middle, probability), brightCell);
+        QVERIFY(std::abs(probability - getProbability(cdf, brightCell)) < 1.0e-7);
+        QCOMPARE(PathGuide::sampleCell(cdf, 0.0f, probability), 0u);
+        QCOMPARE(PathGuide::sampleCell(cdf, 0.99999994f, probability), PathGuide::cellCount - 1);
+    }
+
+    void guidedEstimate_isUnbiased()
+    {
+        // The guide favors cells that are unrelated to where the light is, which guiding must not bias either
+        auto counters = createCounters();
+        for (auto cell = 0u; cell < PathGuide::cellCount; cell += 13)
+            counters[cell * PathGuide::countersPerCell] = 1000 + cell % 5000;
+        auto cdf = PathGuide::createCdf(counters.data());
+
+        std::mt19937 generator(1234);
+        std::uniform_real_distribution<float> uniform(0.0f, 1.0f);
+        const auto sampleCount = 2000000;
+        double unguidedSum = 0.0;
+        double unguidedSquares = 0.0;
+        double guidedSum = 0.0;
+        double guidedSquares = 0.0;
+        for (auto i = 0; i < sampleCount; ++i)
+        {
+            auto unguidedCell = std::min(static_cast<unsigned int>(uniform(generator) * PathGuide::cellCount), PathGuide::cellCount - 1);
+            auto unguidedLight = getRayLight(unguidedCell, uniform(generator));
+            unguidedSum += unguidedLight;
+            unguidedSquares += unguidedLight * unguidedLight;
+
+            double probability;
+            auto guidedCell = PathGuide::sampleCell(cdf, uniform(generator), probability);
+            auto guidedLight = getRayLight(guidedCell, uniform(generator)) / (PathGuide::cellCount * probability);
+            guidedSum += guidedLight;
+            guidedSquares += guidedLight * guidedLight;
+        }
+
+        auto unguidedMean = unguidedSum / sampleCount;
+        auto guidedMean = guidedSum / sampleCount;
+        auto unguidedVariance = unguidedSquares / sampleCount - unguidedMean * unguidedMean;
+        auto guidedVariance = guidedSquares / sampleCount - guidedMean * guidedMean;
+
+        // The means agree within five standard errors of their difference
+        auto standardError = std::sqrt((unguidedVariance + guidedVariance) / sampleCount);
+        QVERIFY(std::abs(guidedMean - unguidedMean) < 5.0 * standardError);
+
+        double exactMean = 0.0;
+        for (auto cell = 0u; cell < PathGuide::cellCount; ++cell)
+            exactMean += getRayLight(cell, 0.5) / PathGuide::cellCount;
+        QVERIFY(std::abs(guidedMean - exactMean) < 5.0 * std::sqrt(guidedVariance / sampleCount));
+    }
+};
+
+QTEST_APPLESS_MAIN(PathGuideTests)
+
+#include "pathGuideTests.moc"
@@ -0,0 +1,58 @@
+#include <QtTest>
+#include "simulation/pathLengthHistogram.h"
+
+using namespace HaloRay;
+
+class PathLengthHistogramTests : public QObject
+{
+    Q_OBJECT
+private slots:
+    void fromBins_splitsEscapedAndTerminatedRays()
+    {
+        unsigned int bins[PathLengthHistogram::numBins] = {};
+        bins[0] = 10;
+        bins[3] = 5;
+        bins[PathLengthHistogram::maxHits] = 2;
+        bins[PathLengthHistogram::maxHits + 1] = 3;
+        bins[PathLengthHistogram::maxHits + 2] = 4;
+
+        auto histogram = PathLengthHistogram::fromBins(bins);
+
+        QCOMPARE(histogram.getEscapedCount(), 15u);
+        QCOMPARE(histogram.terminatedByRussianRoulette, 2u);
+        QCOMPARE(histogram.trappedInOrbit, 3u);
+        QCOMPARE(histogram.reachedMaxHits, 4u);
+        QCOMPARE(histogram.getTerminatedCount(), 9u);
+    }
+
+    void meanPathLength_ignoresTerminatedRays()
+    {
+        PathLengthHistogram histogram;
+        histogram.escapedCounts[1] = 1;
+        histogram.escapedCounts[3] = 1;
+        histogram.reachedMaxHits = 100;
+
+        QCOMPARE(histogram.getMeanPathLength(), 2.0);
+    }
+
+    void meanPathLength_givenEmptyHistogram_returnsZero()
+    {
+        PathLengthHistogram histogram;
+        QCOMPARE(histogram.getMeanPathLength(), 0.0);
+    }
+
+    void percentile_returnsSmallestPathLengthCoveringFraction()
+    {
+        PathLengthHistogram histogram;
+        histogram.escapedCounts[0] = 50;
+        histogram.escapedCounts[2] = 49;
+        histogram.escapedCounts[40] = 1;
+
+        QCOMPARE(histogram.getPathLengthPercentile(0.5), 0u);
+        QCOMPARE(histogram.getPathLengthPercentile(0.9), 2u);
+        QCOMPARE(histogram.getPathLengthPercentile(1.0), 40u);
+    }
+};
+
+QTEST_APPLESS_MAIN(PathLengthHistogramTests)
+#include "pathLengthHistogramTests.moc"
@@ -0,0 +1,68 @@
+#include <QtTest>
+#include "simulation/phaseFunction.h"
+#include "simulation/crystalPopulation.h"
+#include "simulation/trigonometryUtilities.h"
+
+using namespace HaloRay;
+
+class PhaseFunctionTests : public QObject
+{
+    Q_OBJECT
+private slots:
+    void angleBins_coverAllScatteringAngles()
+    {
+        QCOMPARE(PhaseFunction::getAngleBin(0.0), 0u);
+        QCOMPARE(PhaseFunction::getAngleBin(degToRad(22.0f)), 220u);
+        QCOMPARE(PhaseFunction::getAngleBin(PI), PhaseFunction::angleBinCount - 1);
+        QCOMPARE(PhaseFunction::getAngleBin(-0.1), 0u);
+    }
+
+    void wavelengthBins_coverVisibleSpectrum()
+    {
+        QCOMPARE(PhaseFunction::getWavelengthBin(400.0), 0u);
+        QCOMPARE(PhaseFunction::getWavelengthBin(409.9), 0u);
+        QCOMPARE(PhaseFunction::getWavelengthBin(410.0), 1u);
+        QCOMPARE(PhaseFunction::getWavelengthBin(700.0), PhaseFunction::wavelengthBinCount - 1);
+    }
+
+    void counterIndices_areUniqueAndInRange()
+    {
+        QCOMPARE(PhaseFunction::getCounterIndex(0, 0), 0u);
+        QCOMPARE(PhaseFunction::getCounterIndex(1, 0), PhaseFunction::countersPerBin);
+        QCOMPARE(PhaseFunction::getCounterIndex(0, 1), PhaseFunction::angleBinCount * PhaseFunction::countersPerBin);
+        auto lastIndex = PhaseFunction::getCounterIndex(PhaseFunction::angleBinCount - 1, PhaseFunction::wavelengthBinCount - 1);
+        QCOMPARE(lastIndex + PhaseFunction::countersPerBin, PhaseFunction::counterCount);
+    }
+
+    void binSolidAngles_coverWholeSphere()
+    {
+        double totalSolidAngle = 0.0;
+        for (auto bin = 0u; bin < PhaseFunction::angleBinCount; ++bin)
+        {
+            QVERIFY(PhaseFunction::getBinSolidAngle(bin) > 0.0);
+            totalSolidAngle += PhaseFunction::getBinSolidAngle(bin);
+        }
+        QVERIFY(std::abs(totalSolidAngle - 4.0 * PI) < 1.0e-9);
+    }
+
+    void randomPopulation_isRandomlyOriented()
+    {
+        QVERIFY(CrystalPopulation::createRandom().isRandomlyOriented());
+        QVERIFY(!CrystalPopulation::createPlate().isRandomlyOriented());
+        QVERIFY(!CrystalPopulation::createColumn().isRandomlyOriented());
+    }
+
+    void tabulatedOrientation_isRandomOnlyWithoutTable()
+    {
+        auto population = CrystalPopulation::createRandom();
+        population.tiltDistribution = Tabulated;
+        QVERIFY(population.isRandomlyOriented());
+
+        population.distributionTables[TiltTable] = TabulatedDistribution({0.0f, 10.0f}, {1.0f});
+        QVERIFY(!population.isRandomlyOriented());
+    }
+};
+
+QTEST_APPLESS_MAIN(PhaseFunctionTests)
+
+#include "phaseFunctionTests.moc"
@@ -0,0 +1,65 @@
+#include <QtTest>
+#include "simulation/philox.h"
+
+using namespace HaloRay;
+
+class PhiloxTests : public QObject
+{
+    Q_OBJECT
+private slots:
+    void generate_givenZeroCounterAndKey_matchesKnownAnswer()
+    {
+        auto result = Philox::generate({0, 0, 0, 0}, {0, 0});
+
+        QCOMPARE(result[0], 0x6627e8d5u);
+        QCOMPARE(result[1], 0xe169c58du);
+        QCOMPARE(result[2], 0xbc57ac4cu);
+        QCOMPARE(result[3], 0x9b00dbd8u);
+    }
+
+    void generate_givenAllOnesCounterAndKey_matchesKnownAnswer()
+    {
+        auto result = Philox::generate({0xffffffffu, 0xffffffffu, 0xffffffffu, 0xffffffffu}, {0xffffffffu, 0xffffffffu});
+
+        QCOMPARE(result[0], 0x408f276du);
+        QCOMPARE(result[1], 0x41c83b0eu);
+        QCOMPARE(result[2], 0xa20bc7c6u);
+        QCOMPARE(result[3], 0x6d5451fdu);
+    }
+
+    void generate_givenDigitsOfPi_matchesKnownAnswer()
+    {
+        auto result = Philox::generate({0x243f6a88u, 0x85a308d3u, 0x13198a2eu, 0x03707344u}, {0xa4093822u, 0x299f31d0u});
+
+        QCOMPARE(result[0], 0xd16cfe09u);
+        QCOMPARE(result[1], 0x94fdccebu);
+        QCOMPARE(result[2], 0x5001e420u);
+        QCOMPARE(result[3], 0x24126ea1u);
+    }
+
+    void generate_givenConsecutiveCounters_producesUniformBits()
+    {
+        const unsigned int numCounters = 4096;
+        unsigned int bitCounts[32] = {};
+        for (auto i = 0u; i < numCounters; ++i)
+        {
+            auto result = Philox::generate({i, 0, 0, 0}, {1234u, 0});
+            for (auto value : result)
+            {
+                for (auto bit = 0u; bit < 32; ++bit)
+                    bitCounts[bit] += (value >> bit) & 1u;
+            }
+        }
+
+        // Each bit should be set in half of the 16384 numbers, within about five standard deviations
+        for (auto count : bitCounts)
+        {
+            QVERIFY(count > 8192 - 320);
+            QVERIFY(count < 8192 + 320);
+        }
+    }
+};
+
+QTEST_APPLESS_MAIN(PhiloxTests)
+
+#include "philoxTests.moc"
@@ -0,0 +1,59 @@
+#include <QtTest>
+#include <cmath>
+#include <cstdint>
+#include <vector>
+#include "simulation/rayAllocation.h"
+
+using namespace HaloRay;
+
+class RayAllocationTests : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void noMoments_keepsProbabilities()
+    {
+        auto shares = RayAllocation::allocate({0.25, 0.75}, {0.0, 0.0}, {true, true});
+        QCOMPARE(shares[0], 0.25);
+        QCOMPARE(shares[1], 0.75);
+    }
+
+    void noisierPopulation_getsMoreRays()
+    {
+        // The faint population has four times the root mean square weight per ray
+        auto shares = RayAllocation::allocate({0.5, 0.5}, {1.0, 16.0}, {true, true});
+        QVERIFY(std::abs(shares[0] + shares[1] - 1.0) < 1.0e-12);
+
+        auto fraction = RayAllocation::minShareFraction;
+        QVERIFY(std::abs(shares[0] - (fraction * 0.5 + (1.0 - fraction) * 0.2)) < 1.0e-12);
+        QVERIFY(std::abs(shares[1] - (fraction * 0.5 + (1.0 - fraction) * 0.8)) < 1.0e-12);
+    }
+
+    void populationOutOfView_keepsMinimumShare()
+    {
+        auto shares = RayAllocation::allocate({0.4, 0.6}, {0.0, 2.0}, {true, true});
+        QVERIFY(std::abs(shares[0] - RayAllocation::minShareFraction * 0.4) < 1.0e-12);
+        QVERIFY(std::abs(shares[0] + shares[1] - 1.0) < 1.0e-12);
+    }
+
+    void fixedPopulation_keepsProbability()
+    {
+        auto shares = RayAllocation::allocate({0.2, 0.3, 0.5}, {100.0, 1.0, 4.0}, {false, true, true});
+        QCOMPARE(shares[0], 0.2);
+        QVERIFY(std::abs(shares[1] + shares[2] - 0.8) < 1.0e-12);
+        QVERIFY(shares[2] > 0.5);
+    }
+
+    void momentSum_addsSlotsAndCarries()
+    {
+        std::vector<std::uint32_t> counters(RayAllocation::slotsPerPopulation * RayAllocation::countersPerSlot, 0u);
+        counters[0] = 65536u;
+        counters[5 * RayAllocation::countersPerSlot] = 32768u;
+        counters[7 * RayAllocation::countersPerSlot + 1] = 1u;
+        QCOMPARE(RayAllocation::getMomentSum(counters.data()), 1.5 + 65536.0);
+    }
+};
+
+QTEST_APPLESS_MAIN(RayAllocationTests)
+
+#include "rayAllocationTests.moc"
@@ -0,0 +1,258 @@
+#include <QtTest>
+#include <QTemporaryDir>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <thread>
+#include <vector>
+#include "simulation/camera.h"
+#include "simulation/rayDump.h"
+#include "simulation/rayReprojection.h"
+#include "simulation/spscRingBuffer.h"
+
+using namespace HaloRay;
+
+namespace
+{
+
+RayExitRecord createRecord(float x, float y, float z, std::uint32_t index)
+{
+    RayExitRecord record;
+    record.direction[0] = x;
+    record.direction[1] = y;
+    record.direction[2] = z;
+    record.wavelength = 550.0f;
+    record.populationIndex = index;
+    record.weight = 1.0f;
+    record.pathLength = index % 7;
+    record.scatteringEvents = 1;
+    return record;
+}
+
+Camera createLevelCamera(Projection projection)
+{
+    Camera camera;
+    camera.pitch = 0.0f;
+    camera.yaw = 0.0f;
+    camera.fov = 90.0f;
+    camera.projection = projection;
+    camera.hideSubHorizon = false;
+    return camera;
+}
+
+}
+
+class RayDumpTests : public QObject
+{
+    Q_OBJECT
+private slots:
+    void ringBuffer_roundsCapacityToPowerOfTwo()
+    {
+        SpscRingBuffer<int> buffer(100);
+        QCOMPARE(buffer.getCapacity(), std::size_t(128));
+    }
+
+    void ringBuffer_keepsOrderAcrossWrapAround()
+    {
+        SpscRingBuffer<int> buffer(8);
+        std::vector<int> output(8);
+        int next = 0;
+        int expected = 0;
+        for (auto round = 0; round < 10; ++round)
+        {
+            std::vector<int> input = {next, next + 1, next + 2, next + 3, next + 4};
+            QCOMPARE(buffer.push(input.data(), input.size()), std::size_t(5));
+            next += 5;
+
+            auto count = buffer.pop(output.data(), 5);
+            QCOMPARE(count, std::size_t(5));
+            for (auto i = 0u; i < count; ++i)
+                QCOMPARE(output[i], expected++);
+        }
+        QCOMPARE(buffer.getSize(), std::size_t(0));
+    }
+
+    void ringBuffer_pushesOnlyWhatFits()
+    {
+        SpscRingBuffer<int> buffer(4);
+        std::vector<int> input = {1, 2, 3, 4, 5, 6};
+        QCOMPARE(buffer.push(input.data(), input.size()), std::size_t(4));
+        QCOMPARE(buffer.push(input.data(), input.size()), std::size_t(0));
+
+        std::vector<int> output(6);
+        QCOMPARE(buffer.pop(output.data(), output.size()), std::size_t(4));
+        QCOMPARE(output[3], 4);
+        QCOMPARE(buffer.pop(output.data(), output.size()), std::size_t(0));
+    }
+
+    void ringBuffer_transfersItemsBetweenThreads()
+    {
+        const int itemCount = 1000000;
+        SpscRingBuffer<int> buffer(1024);
+
+        std::thread producer([&buffer]() {
+            int next = 0;
+            while (next < itemCount)
+            {
+                int items[64];
+                auto count = std::min(64, itemCount - next);
+                for (auto i = 0; i < count; ++i)
+                    items[i] = next + i;
+                next += static_cast<int>(buffer.push(items, count));
+            }
+        });
+
+        bool inOrder = true;
+        int expected = 0;
+        std::vector<int> output(100);
+        while (expected < itemCount)
+        {
+            auto count = buffer.pop(output.data(), output.size());
+            for (auto i = 0u; i < count; ++i)
+                inOrder = inOrder && output[i] == expected++;
+        }
+        producer.join();
+
+        QVERIFY(inOrder);
+        QCOMPARE(buffer.getSize(), std::size_t(0));
+    }
+
+    void writtenRecords_canBeReadBack()
+    {
+        QTemporaryDir directory;
+        QVERIFY(directory.isValid());
+        auto path = directory.filePath("rays.hrrays").toStdString();
+
+        std::vector<RayExitRecord> records;
+        for (auto i = 0u; i < 5000; ++i)
+            records.push_back(createRecord(0.0f, -1.0f, 0.0f, i));
+
+        {
+            RayDumpWriter writer(path);
+            QCOMPARE(writer.write(records.data(), 2000), std::size_t(2000));
+            QCOMPARE(writer.write(records.data() + 2000, 3000), std::size_t(3000));
+            writer.addTracedRays(12345);
+            writer.close();
+            QCOMPARE(writer.getRecordCount(), std::uint64_t(5000));
+            QCOMPARE(writer.getDroppedCount(), std::uint64_t(0));
+        }
+
+        RayDumpReader reader(path);
+        QCOMPARE(reader.getRecordCount(), std::uint64_t(5000));
+        QCOMPARE(reader.getTracedRayCount(), std::uint64_t(12345));
+        QCOMPARE(reader.getDroppedCount(), std::uint64_t(0));
+        for (auto i = 0u; i < 5000; ++i)
+        {
+            QCOMPARE(reader.getRecords()[i].populationIndex, i);
+            QCOMPARE(reader.getRecords()[i].pathLength, i % 7);
+        }
+    }
+
+    void reader_readsDroppedCount()
+    {
+        QTemporaryDir directory;
+        auto path = directory.filePath("rays.hrrays").toStdString();
+        {
+            RayDumpHeader header = {};
+            std::memcpy(header.magic, "HRRAYS02", 8);
+            header.recordSize = sizeof(RayExitRecord);
+            header.recordCount = 2;
+            header.tracedRayCount = 1000;
+            header.droppedCount = 300;
+            auto record = createRecord(0.0f, -1.0f, 0.0f, 3);
+            std::ofstream file(path, std::ios::binary);
+            file.write(reinterpret_cast<const char *>(&header), sizeof(header));
+            file.write(reinterpret_cast<const char *>(&record), sizeof(record));
+            file.write(reinterpret_cast<const char *>(&record), sizeof(record));
+        }
+
+        RayDumpReader reader(path);
+        QCOMPARE(reader.getRecordCount(), std::uint64_t(2));
+        QCOMPARE(reader.getTracedRayCount(), std::uint64_t(1000));
+        QCOMPARE(reader.getDroppedCount(), std::uint64_t(300));
+        QCOMPARE(reader.getRecords()[1].populationIndex, 3u);
+    }
+
+    void reader_readsFirstVersionFiles()
+    {
+        // The first version had a header of one record, without the dropped count
+        QTemporaryDir directory;
+        auto path = directory.filePath("rays.hrrays").toStdString();
+        {
+            RayDumpHeader header = {};
+            std::memcpy(header.magic, "HRRAYS01", 8);
+            header.recordSize = sizeof(RayExitRecord);
+            header.recordCount = 1;
+            header.tracedRayCount = 77;
+            auto record = createRecord(0.0f, -1.0f, 0.0f, 5);
+            std::ofstream file(path, std::ios::binary);
+            file.write(reinterpret_cast<const char *>(&header), sizeof(RayExitRecord));
+            file.write(reinterpret_cast<const char *>(&record), sizeof(record));
+        }
+
+        RayDumpReader reader(path);
+        QCOMPARE(reader.getRecordCount(), std::uint64_t(1));
+        QCOMPARE(reader.getTracedRayCount(), std::uint64_t(77));
+        QCOMPARE(reader.getDroppedCount(), std::uint64_t(0));
+        QCOMPARE(reader.getRecords()[0].populationIndex, 5u);
+    }
+
+    void reader_rejectsOtherFiles()
+    {
+        QTemporaryDir directory;
+        auto path = directory.filePath("other.bin").toStdString();
+        {
+            std::ofstream file(path, std::ios::binary);
+            file << "This is not a ray dump, but it is long enough to have a header";
+        }
+        QVERIFY_EXCEPTION_THROWN(RayDumpReader{path}, std::runtime_error);
+    }
+
+    void reprojection_putsRaysTowardsCameraInCenter()
+    {
+        RayReprojection reprojection(createLevelCamera(Stereographic), 101, 51);
+        float direction[3] = {0.0f, 0.0f, -1.0f};
+        unsigned int x, y;
+        QVERIFY(reprojection.getPixel(direction, x, y));
+        QCOMPARE(x, 50u);
+        QCOMPARE(y, 25u);
+    }
+
+    void reprojection_followsCameraYaw()
+    {
+        auto camera = createLevelCamera(Stereographic);
+        camera.yaw = 90.0f;
+        RayReprojection reprojection(camera, 101, 51);
+        float direction[3] = {1.0f, 0.0f, 0.0f};
+        unsigned int x, y;
+        QVERIFY(reprojection.getPixel(direction, x, y));
+        QCOMPARE(x, 50u);
+        QCOMPARE(y, 25u);
+    }
+
+    void reprojection_dropsRaysBehindRectilinearCamera()
+    {
+        RayReprojection reprojection(createLevelCamera(Rectilinear), 100, 100);
+        float direction[3] = {0.0f, 0.0f, 1.0f};
+        unsigned int x, y;
+        QVERIFY(!reprojection.getPixel(direction, x, y));
+    }
+
+    void reprojection_accumulatesWeightedColors()
+    {
+        RayReprojection reprojection(createLevelCamera(Stereographic), 11, 11);
+        std::vector<RayExitRecord> records(3, createRecord(0.0f, 0.0f, -1.0f, 0));
+        records[2].weight = 2.0f;
+        reprojection.addRays(records.data(), records.size());
+
+        auto color = RayReprojection::getRayColor(550.0f);
+        const auto &image = reprojection.getImage();
+        auto centerPixel = (5 * 11 + 5) * 3;
+        QVERIFY(std::abs(image[centerPixel + 1] - 4.0f * color[1]) < 1.0e-5f);
+        QCOMPARE(image[0], 0.0f);
+    }
+};
+
+QTEST_APPLESS_MAIN(RayDumpTests)
+
+#include "rayDumpTests.moc"
@@ -0,0 +1,113 @@
+#include <QtTest>
+#include <cmath>
+#include "simulation/sampleReweighting.h"
+#include "simulation/crystalPopulation.h"
+
+using namespace HaloRay;
+
+namespace
+{
+
+double gaussian(double x, double average, double std)
+{
+    auto z = (x - average) / std;
+    return std::exp(-0.5 * z * z) / (std * std::sqrt(2.0 * 3.14159265358979323846));
+}
+
+}
+
+class SampleReweightingTests : public QObject
+{
+    Q_OBJECT
+private slots:
+    void canReweight_givenGaussianParameterChanges_returnsTrue()
+    {
+        auto from = CrystalPopulation::createColumn();
+        from.tiltDistribution = Gaussian;
+        from.tiltStd = 1.0f;
+        from.caRatioStd = 0.2f;
+
+        auto to = from;
+        to.tiltAverage += 0.5f;
+        to.tiltStd = 1.2f;
+        to.caRatioAverage += 0.1f;
+        QVERIFY(SampleReweighting::canReweight(from, to));
+    }
+
+    void canReweight_givenShapeOrDistributionTypeChanges_returnsFalse()
+    {
+        auto from = CrystalPopulation::createColumn();
+        from.tiltDistribution = Gaussian;
+        from.tiltStd = 1.0f;
+
+        auto pyramid = from;
+        pyramid.upperApexHeightAverage = 0.3f;
+        QVERIFY(!SampleReweighting::canReweight(from, pyramid));
+
+        auto uniform = from;
+        uniform.tiltDistribution = Uniform;
+        QVERIFY(!SampleReweighting::canReweight(from, uniform));
+    }
+
+    void canReweight_givenPointDistribution_returnsFalse()
+    {
+        auto from = CrystalPopulation::createColumn();
+        from.tiltDistribution = Gaussian;
+        from.tiltStd = 0.0f;
+
+        auto to = from;
+        to.tiltAverage += 1.0f;
+        QVERIFY(!SampleReweighting::canReweight(from, to));
+    }
+
+    void secondMoment_matchesNumericalIntegral()
+    {
+        const double fromAverage = 0.2, fromStd = 1.0, toAverage = 0.5, toStd = 0.8;
+        double integral = 0.0;
+        const double step = 0.001;
+        for (double x = -20.0; x < 20.0; x += step)
+        {
+            auto to = gaussian(x, toAverage, toStd);
+            integral += to * to / gaussian(x, fromAverage, fromStd) * step;
+        }
+        QVERIFY(std::abs(SampleReweighting::getSecondMoment(fromAverage, fromStd, toAverage, toStd) - integral) < 1.0e-6);
+    }
+
+    void secondMoment_givenMuchWiderTarget_isInfinite()
+    {
+        QVERIFY(std::isinf(SampleReweighting::getSecondMoment(0.0, 1.0, 0.0, 1.5)));
+        QCOMPARE(SampleReweighting::getSecondMoment(0.3, 1.0, 0.3, 1.0), 1.0);
+    }
+
+    void effectiveSampleFraction_decreasesWithLargerChanges()
+    {
+        auto population = CrystalPopulation::createColumn();
+        population.caRatioStd = 0.5f;
+        auto from = LatentDistributions::fromPopulation(population);
+        std::vector<SamplingEpoch> epochs = {{from, 1000.0}};
+
+        QCOMPARE(SampleReweighting::getEffectiveSampleFraction(epochs, from), 1.0);
+
+        auto small = from;
+        small.caRatioAverage += 0.05f;
+        auto large = from;
+        large.caRatioAverage += 0.5f;
+        auto smallFraction = SampleReweighting::getEffectiveSampleFraction(epochs, small);
+        auto largeFraction = SampleReweighting::getEffectiveSampleFraction(epochs, large);
+        QVERIFY(smallFraction < 1.0);
+        QVERIFY(smallFraction > SampleReweighting::minEffectiveSampleFraction);
+        QVERIFY(largeFraction < smallFraction);
+    }
+
+    void latentDistributions_ignoreParametersThatAreNotGaussian()
+    {
+        auto random = LatentDistributions::fromPopulation(CrystalPopulation::createRandom());
+        QVERIFY(random.tiltStd < 0.0f);
+        QVERIFY(random.rotationStd < 0.0f);
+        QVERIFY(random.caRatioStd >= 0.0f);
+    }
+};
+
+QTEST_APPLESS_MAIN(SampleReweightingTests)
+
+#include "sampleReweightingTests.moc"
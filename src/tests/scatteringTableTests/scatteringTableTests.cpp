@@ -0,0 +1,147 @@
+#include <QtTest>
+#include <sstream>
+#include <stdexcept>
+#include "simulation/scatteringTable.h"
+
+using namespace HaloRay;
+
+class ScatteringTableTests : public QObject
+{
+    Q_OBJECT
+private slots:
+    void defaultTable_isEmpty()
+    {
+        ScatteringTable table;
+        QVERIFY(table.isEmpty());
+        QVERIFY(!table.coversAltitude(0.0f));
+    }
+
+    void constructor_givenInvalidSize_throws()
+    {
+        QVERIFY_EXCEPTION_THROWN(ScatteringTable(0, 10, 0.0f, 1.0f, 1, 1), std::runtime_error);
+        QVERIFY_EXCEPTION_THROWN(ScatteringTable(10, 10, 0.0f, 1.0f, 1, 0), std::runtime_error);
+        QVERIFY_EXCEPTION_THROWN(ScatteringTable(10, 10, 0.0f, 0.0f, 1, 1), std::runtime_error);
+    }
+
+    void coversAltitude_matchesAltitudeRange()
+    {
+        ScatteringTable table(4, 2, -5.0f, 2.5f, 5, 1);
+
+        QCOMPARE(table.getMaxAltitude(), 5.0f);
+        QVERIFY(table.coversAltitude(-5.0f));
+        QVERIFY(table.coversAltitude(5.0f));
+        QVERIFY(!table.coversAltitude(-5.1f));
+        QVERIFY(!table.coversAltitude(5.1f));
+    }
+
+    void getAltitudeSlices_interpolatesBetweenSlices()
+    {
+        ScatteringTable table(4, 2, 10.0f, 2.0f, 4, 1);
+        unsigned int lower, upper;
+        float weight;
+
+        table.getAltitudeSlices(13.5f, lower, upper, weight);
+        QCOMPARE(lower, 1u);
+        QCOMPARE(upper, 2u);
+        QCOMPARE(weight, 0.75f);
+
+        table.getAltitudeSlices(16.0f, lower, upper, weight);
+        QCOMPARE(lower, 3u);
+        QCOMPARE(upper, 3u);
+        QCOMPARE(weight, 0.0f);
+    }
+
+    void getLayerIndex_groupsPopulationsByAltitude()
+    {
+        ScatteringTable table(4, 2, 0.0f, 1.0f, 3, 2);
+
+        QCOMPARE(table.getLayerCount(), 6u);
+        QCOMPARE(table.getLayerIndex(0, 1), 1u);
+        QCOMPARE(table.getLayerIndex(2, 0), 4u);
+        QCOMPARE(table.getLayer(4) - table.getLayer(0), (std::ptrdiff_t)4 * 4 * 2 * 3);
+    }
+
+    void cellSolidAngles_coverWholeSphere()
+    {
+        ScatteringTable table(36, 18, 0.0f, 1.0f, 1, 1);
+        QVERIFY(std::abs(table.getCellSolidAngle() * 36 * 18 - 4.0 * M_PI) < 1.0e-5);
+    }
+
+    void getTableCoordinates_mapsAxes()
+    {
+        auto forward = ScatteringTable::getTableCoordinates(0.0f, 0.0f, 1.0f);
+        QCOMPARE(forward[0], 0.5f);
+        QCOMPARE(forward[1], 0.5f);
+
+        auto side = ScatteringTable::getTableCoordinates(1.0f, 0.0f, 0.0f);
+        QCOMPARE(side[0], 0.75f);
+
+        auto up = ScatteringTable::getTableCoordinates(0.0f, 1.0f, 0.0f);
+        QCOMPARE(up[1], 1.0f);
+
+        auto down = ScatteringTable::getTableCoordinates(0.0f, -1.0f, 0.0f);
+        QCOMPARE(down[1], 0.0f);
+    }
+
+    void saveAndLoad_preservesTable()
+    {
+        ScatteringTable table(3, 2, -2.0f, 0.5f, 2, 2);
+        ScatteringTable::Settings settings;
+        settings.crystalFingerprint = 0x0123456789abcdefull;
+        settings.multipleScatteringProbability = 0.25f;
+        settings.maxScatteringOrders = 3;
+        settings.russianRouletteDepth = 5;
+        settings.runSeed = 42;
+        settings.quasiRandomSampling = true;
+        settings.sunDiameter = 0.6f;
+        settings.atmosphere = Atmosphere::createDefaultAtmosphere();
+        table.setSettings(settings);
+        for (auto layer = 0u; layer < table.getLayerCount(); ++layer)
+        {
+            for (auto i = 0u; i < table.getLayerSize(); ++i)
+                table.getLayer(layer)[i] = layer * 100.0f + i;
+        }
+
+        std::stringstream stream;
+        table.save(stream);
+        auto loaded = ScatteringTable::load(stream);
+
+        QCOMPARE(loaded.getWidth(), 3u);
+        QCOMPARE(loaded.getHeight(), 2u);
+        QCOMPARE(loaded.getMinAltitude(), -2.0f);
+        QCOMPARE(loaded.getAltitudeStep(), 0.5f);
+        QCOMPARE(loaded.getAltitudeCount(), 2u);
+        QCOMPARE(loaded.getPopulationCount(), 2u);
+        QCOMPARE(loaded.getData(), table.getData());
+        QVERIFY(loaded.getSettings() == settings);
+    }
+
+    void load_givenInvalidFile_throws()
+    {
+        std::stringstream garbage("not a scattering table");
+        QVERIFY_EXCEPTION_THROWN(ScatteringTable::load(garbage), std::runtime_error);
+
+        ScatteringTable table(3, 2, 0.0f, 1.0f, 1, 1);
+        std::stringstream stream;
+        table.save(stream);
+        auto truncatedData = stream.str();
+        truncatedData.resize(truncatedData.size() - 4);
+        std::stringstream truncated(truncatedData);
+        QVERIFY_EXCEPTION_THROWN(ScatteringTable::load(truncated), std::runtime_error);
+    }
+
+    void load_givenTableWithoutSettings_throws()
+    {
+        ScatteringTable table(3, 2, 0.0f, 1.0f, 1, 1);
+        std::stringstream stream;
+        table.save(stream);
+        auto data = stream.str();
+        data[7] = '1';
+        std::stringstream unversioned(data);
+        QVERIFY_EXCEPTION_THROWN(ScatteringTable::load(unversioned), std::runtime_error);
+    }
+};
+
+QTEST_APPLESS_MAIN(ScatteringTableTests)
+
+#include "scatteringTableTests.moc"
@@ -0,0 +1,223 @@
+#include <QtTest>
+#include <algorithm>
+#include <cmath>
+#include <vector>
+#include "sceneTracer.h"
+
+using namespace HaloRay::Kernels;
+
+namespace
+{
+
+const float PI = 3.1415926535f;
+
+SceneSettings createSettings()
+{
+    SceneSettings settings;
+    settings.sun.altitude = 20.0f * PI / 180.0f;
+    settings.sun.diameter = 0.5f * PI / 180.0f;
+    settings.sun.useSpectrum = false;
+    std::fill(settings.sun.spectrum, settings.sun.spectrum + 31, 1.0f);
+
+    settings.camera.pitch = 20.0f * PI / 180.0f;
+    settings.camera.yaw = 0.0f;
+    settings.camera.focalLength = 0.5f;
+    settings.camera.projection = SceneCamera::Stereographic;
+    settings.camera.hideSubHorizon = false;
+    settings.camera.width = 64;
+    settings.camera.height = 48;
+
+    settings.crystals.tiltDistribution = SceneCrystals::Gaussian;
+    settings.crystals.tiltAverage = 0.0f;
+    settings.crystals.tiltStd = 0.2f;
+    settings.crystals.rotationDistribution = SceneCrystals::Uniform;
+    settings.crystals.rotationAverage = 0.0f;
+    settings.crystals.rotationStd = 0.0f;
+    settings.crystals.caRatioAverage = 0.3f;
+    settings.crystals.caRatioStd = 0.0f;
+    settings.crystals.upperApexAngle = 56.0f * PI / 180.0f;
+    settings.crystals.upperApexHeightAverage = 0.0f;
+    settings.crystals.upperApexHeightStd = 0.0f;
+    settings.crystals.lowerApexAngle = 56.0f * PI / 180.0f;
+    settings.crystals.lowerApexHeightAverage = 0.0f;
+    settings.crystals.lowerApexHeightStd = 0.0f;
+    std::fill(settings.crystals.prismFaceDistances, settings.crystals.prismFaceDistances + 6, 1.0f);
+    settings.crystals.weight = 1.0f;
+
+    settings.trace.russianRouletteDepth = 100;
+    settings.trace.seed = 1234u;
+    settings.trace.populationIndex = 0;
+    settings.sobolDirections = nullptr;
+    return settings;
+}
+
+bool isSameSplat(const Splat &a, const Splat &b)
+{
+    return a.pixelIndex == b.pixelIndex && a.red == b.red && a.green == b.green && a.blue == b.blue;
+}
+
+}
+
+class SceneTracerTests : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void rayAwayFromCamera_hitsImageCenter()
+    {
+        auto camera = createSettings().camera;
+        camera.pitch = 0.0f;
+        // Rays travel away from the camera, so it sees them coming from the opposite direction
+        std::uint32_t pixelIndex;
+        QVERIFY(projectRay(camera, {0.0f, 0.0f, -1.0f}, pixelIndex));
+        QCOMPARE(pixelIndex, (camera.height / 2) * camera.width + camera.width / 2);
+    }
+
+    void projections_rejectRaysBehindCamera()
+    {
+        auto camera = createSettings().camera;
+        camera.pitch = 0.0f;
+        camera.focalLength = 0.01f;
+        Vector3 sideways = normalize({1.0f, 0.0f, 0.3f});
+        std::uint32_t pixelIndex;
+        QVERIFY(projectRay(camera, sideways, pixelIndex));
+        camera.projection = SceneCamera::Rectilinear;
+        QVERIFY(!projectRay(camera, sideways, pixelIndex));
+        camera.projection = SceneCamera::Orthographic;
+        QVERIFY(!projectRay(camera, sideways, pixelIndex));
+    }
+
+    void subHorizonRays_canBeHidden()
+    {
+        auto camera = createSettings().camera;
+        camera.pitch = 0.0f;
+        Vector3 downwards = normalize({0.0f, 0.05f, -1.0f});
+        std::uint32_t pixelIndex;
+        QVERIFY(projectRay(camera, downwards, pixelIndex));
+        camera.hideSubHorizon = true;
+        QVERIFY(!projectRay(camera, downwards, pixelIndex));
+    }
+
+    void rayColor_followsSunSpectrum()
+    {
+        auto sun = createSettings().sun;
+        sun.useSpectrum = true;
+        float white[3], red[3];
+        getRayColor(sun, 600.0f, white);
+        sun.spectrum[20] = 2.0f;
+        sun.spectrum[21] = 2.0f;
+        getRayColor(sun, 600.0f, red);
+        for (auto channel = 0; channel < 3; ++channel)
+            QVERIFY(std::abs(red[channel] - 2.0f * white[channel]) < 1.0e-5f);
+        QVERIFY(white[0] > white[2]);
+    }
+
+    void tracing_doesNotDependOnSplit()
+    {
+        auto settings = createSettings();
+        std::vector<Splat> whole;
+        traceScene(settings, 5000, 3000, whole);
+        QVERIFY(!whole.empty());
+
+        std::vector<Splat> parts;
+        traceScene(settings, 5000, 700, parts);
+        traceScene(settings, 5700, 2300, parts);
+
+        // Rays are splatted in a different order, but each ray lands in the same place
+        auto byPixel = [](const Splat &a, const Splat &b) {
+            return a.pixelIndex != b.pixelIndex ? a.pixelIndex < b.pixelIndex : a.green < b.green;
+        };
+        std::sort(whole.begin(), whole.end(), byPixel);
+        std::sort(parts.begin(), parts.end(), byPixel);
+        QCOMPARE(whole.size(), parts.size());
+        QVERIFY(std::equal(whole.begin(), whole.end(), parts.begin(), isSameSplat));
+    }
+
+    void seed_changesRays()
+    {
+        auto settings = createSettings();
+        std::vector<Splat> first, second;
+        traceScene(settings, 0, 2000, first);
+        settings.trace.seed = 4321u;
+        traceScene(settings, 0, 2000, second);
+        QVERIFY(first.size() != second.size() || !std::equal(first.begin(), first.end(), second.begin(), isSameSplat));
+    }
+
+    void populations_haveTheirOwnRays()
+    {
+        auto settings = createSettings();
+        std::vector<Splat> first, second;
+        traceScene(settings, 0, 2000, first);
+        settings.trace.populationIndex = 1;
+        traceScene(settings, 0, 2000, second);
+        QVERIFY(first.size() != second.size() || !std::equal(first.begin(), first.end(), second.begin(), isSameSplat));
+    }
+
+    void quasiRandomSampling_doesNotDependOnSplit()
+    {
+        // Van der Corput sequence in every dimension, scrambled differently for each
+        unsigned int directions[4 * 32];
+        for (auto i = 0u; i < 4 * 32; ++i)
+            directions[i] = 1u << (31 - i % 32);
+        auto settings = createSettings();
+        settings.sobolDirections = directions;
+        std::vector<Splat> whole, parts, pseudoRandom;
+        traceScene(settings, 1000, 2000, whole);
+        traceScene(settings, 1000, 1300, parts);
+        traceScene(settings, 2300, 700, parts);
+        QVERIFY(!whole.empty());
+        QCOMPARE(whole.size(), parts.size());
+
+        settings.sobolDirections = nullptr;
+        traceScene(settings, 1000, 2000, pseudoRandom);
+        QVERIFY(whole.size() != pseudoRandom.size() || !std::equal(whole.begin(), whole.end(), pseudoRandom.begin(), isSameSplat));
+    }
+
+    void splats_stayInsideImage()
+    {
+        auto settings = createSettings();
+        settings.crystals.weight = 0.5f;
+        std::vector<Splat> splats;
+        traceScene(settings, 0, 4000, splats);
+        QVERIFY(!splats.empty());
+        for (const auto &splat : splats)
+            QVERIFY(splat.pixelIndex < settings.camera.width * settings.camera.height);
+    }
+
+    void splatFilter_spreadsLightWithoutAddingAny()
+    {
+        auto settings = createSettings();
+        std::vector<Splat> point, filtered;
+        traceScene(settings, 0, 4000, point);
+        settings.camera.splatFilter.type = SplatFilter::Gaussian;
+        settings.camera.splatFilter.radius = 2.0f;
+        traceScene(settings, 0, 4000, filtered);
+        QVERIFY(filtered.size() > point.size());
+
+        // Only light spread past the edges of the image is lost
+        auto sumGreen = [](const std::vector<Splat> &splats) {
+            double sum = 0.0;
+            for (const auto &splat : splats)
+                sum += splat.green;
+            return sum;
+        };
+        QVERIFY(sumGreen(filtered) <= sumGreen(point) * 1.0001);
+        QVERIFY(sumGreen(filtered) > sumGreen(point) * 0.95);
+        for (const auto &splat : filtered)
+            QVERIFY(splat.pixelIndex < settings.camera.width * settings.camera.height);
+    }
+
+    void highRayNumbers_areTracedAcrossWordBoundary()
+    {
+        auto settings = createSettings();
+        std::vector<Splat> whole, parts;
+        traceScene(settings, 0xffffff00ull, 512, whole);
+        traceScene(settings, 0xffffff00ull, 256, parts);
+        traceScene(settings, 0x100000000ull, 256, parts);
+        QCOMPARE(whole.size(), parts.size());
+    }
+};
+
+QTEST_APPLESS_MAIN(SceneTracerTests)
+
+#include "sceneTracerTests.moc"
@@ -0,0 +1,138 @@
+#include <QtTest>
+#include <cmath>
+#include <vector>
+#include "simulation/sobolSequence.h"
+
+using namespace HaloRay;
+
+namespace
+{
+
+/* Mirror of the pseudo-random generator in the raytracing shader */
+unsigned int wangHash(unsigned int a)
+{
+    a -= (a << 6);
+    a ^= (a >> 17);
+    a -= (a << 9);
+    a ^= (a << 4);
+    a -= (a << 3);
+    a ^= (a << 10);
+    a ^= (a >> 15);
+    return a;
+}
+
+float xorshift(unsigned int &state)
+{
+    state ^= (state << 13);
+    state ^= (state >> 17);
+    state ^= (state << 5);
+    return state / 4294967295.0f;
+}
+
+double integrand(double x, double y)
+{
+    return std::sin(M_PI * x) * std::sin(M_PI * y);
+}
+
+}
+
+class SobolSequenceTests : public QObject
+{
+    Q_OBJECT
+private slots:
+    void firstDimension_isVanDerCorputSequence()
+    {
+        QCOMPARE(SobolSequence::sample(0, 0), 0u);
+        QCOMPARE(SobolSequence::sample(1, 0), 0x80000000u);
+        QCOMPARE(SobolSequence::sample(2, 0), 0x40000000u);
+        QCOMPARE(SobolSequence::sample(3, 0), 0xc0000000u);
+        QCOMPARE(SobolSequence::sample(4, 0), 0x20000000u);
+    }
+
+    void secondDimension_matchesReferenceValues()
+    {
+        QCOMPARE(SobolSequence::sample(0, 1), 0u);
+        QCOMPARE(SobolSequence::sample(1, 1), 0x80000000u);
+        QCOMPARE(SobolSequence::sample(2, 1), 0xc0000000u);
+        QCOMPARE(SobolSequence::sample(3, 1), 0x40000000u);
+    }
+
+    void scrambledSamples_areInUnitInterval()
+    {
+        for (auto dimension = 0u; dimension < 16; ++dimension)
+        {
+            for (auto index = 0u; index < 1024; ++index)
+            {
+                auto value = SobolSequence::getScrambledSample(index, dimension, 1234u);
+                QVERIFY(value >= 0.0f);
+                QVERIFY(value < 1.0f);
+            }
+        }
+    }
+
+    void scrambledSamples_areStratifiedInEachDimension()
+    {
+        const unsigned int numSamples = 256;
+        for (auto dimension = 0u; dimension < 8; ++dimension)
+        {
+            std::vector<unsigned int> strata(numSamples, 0);
+            for (auto index = 0u; index < numSamples; ++index)
+            {
+                auto value = SobolSequence::getScrambledSample(index, dimension, 42u);
+                ++strata[static_cast<unsigned int>(value * numSamples)];
+            }
+            for (auto count : strata)
+                QCOMPARE(count, 1u);
+        }
+    }
+
+    void scrambledSamples_areStratifiedInPairsOfDimensions()
+    {
+        const unsigned int gridSize = 16;
+        std::vector<unsigned int> cells(gridSize * gridSize, 0);
+        for (auto index = 0u; index < gridSize * gridSize; ++index)
+        {
+            auto x = SobolSequence::getScrambledSample(index, 4, 7u);
+            auto y = SobolSequence::getScrambledSample(index, 5, 7u);
+            ++cells[static_cast<unsigned int>(y * gridSize) * gridSize + static_cast<unsigned int>(x * gridSize)];
+        }
+        for (auto count : cells)
+            QCOMPARE(count, 1u);
+    }
+
+    void scrambledSamples_convergeFasterThanPseudoRandomSamples()
+    {
+        const unsigned int numSamples = 4096;
+        const unsigned int numRuns = 32;
+        const double expected = 4.0 / (M_PI * M_PI);
+
+        double sobolSquaredError = 0.0;
+        double pseudoRandomSquaredError = 0.0;
+        for (auto run = 0u; run < numRuns; ++run)
+        {
+            double sobolSum = 0.0;
+            double pseudoRandomSum = 0.0;
+            for (auto index = 0u; index < numSamples; ++index)
+            {
+                sobolSum += integrand(SobolSequence::getScrambledSample(index, 0, run),
+                                      SobolSequence::getScrambledSample(index, 1, run));
+
+                unsigned int state = wangHash(run * numSamples + index);
+                auto x = xorshift(state);
+                auto y = xorshift(state);
+                pseudoRandomSum += integrand(x, y);
+            }
+            sobolSquaredError += std::pow(sobolSum / numSamples - expected, 2.0);
+            pseudoRandomSquaredError += std::pow(pseudoRandomSum / numSamples - expected, 2.0);
+        }
+
+        auto sobolError = std::sqrt(sobolSquaredError / numRuns);
+        auto pseudoRandomError = std::sqrt(pseudoRandomSquaredError / numRuns);
+        qInfo("RMS error with %u samples: scrambled Sobol %g, pseudo-random %g", numSamples, sobolError, pseudoRandomError);
+        QVERIFY(sobolError * 10.0 < pseudoRandomError);
+    }
+};
+
+QTEST_APPLESS_MAIN(SobolSequenceTests)
+
+#include "sobolSequenceTests.moc"
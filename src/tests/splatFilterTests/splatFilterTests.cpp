@@ -0,0 +1,118 @@
+#include <QtTest>
+#include <cmath>
+#include "splatFilter.h"
+
+using namespace HaloRay::Kernels;
+
+namespace
+{
+
+float sumWeights(const float *weights, int count)
+{
+    auto sum = 0.0f;
+    for (auto i = 0; i < count; ++i)
+        sum += weights[i];
+    return sum;
+}
+
+}
+
+class SplatFilterTests : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void box_usesPixelOfPoint()
+    {
+        SplatFilter filter;
+        int firstPixel;
+        float weights[SplatFilter::maxFootprint];
+        QCOMPARE(filter.getWeights(12.9f, firstPixel, weights), 1);
+        QCOMPARE(firstPixel, 12);
+        QCOMPARE(weights[0], 1.0f);
+    }
+
+    void bilinear_splitsBetweenNearestCenters()
+    {
+        SplatFilter filter;
+        filter.type = SplatFilter::Bilinear;
+        int firstPixel;
+        float weights[SplatFilter::maxFootprint];
+
+        // A quarter of the way from the center of pixel 4 to the center of pixel 5
+        auto count = filter.getWeights(4.75f, firstPixel, weights);
+        auto pixel4 = 4 - firstPixel;
+        QVERIFY(pixel4 >= 0 && pixel4 + 1 < count);
+        QVERIFY(std::abs(weights[pixel4] - 0.75f) < 1.0e-6f);
+        QVERIFY(std::abs(weights[pixel4 + 1] - 0.25f) < 1.0e-6f);
+        QVERIFY(std::abs(sumWeights(weights, count) - 1.0f) < 1.0e-6f);
+
+        // All of the light of a point at a pixel center stays in that pixel
+        count = filter.getWeights(7.5f, firstPixel, weights);
+        QCOMPARE(weights[7 - firstPixel], 1.0f);
+    }
+
+    void weights_areNormalizedAndSymmetric()
+    {
+        for (auto type : {SplatFilter::Tent, SplatFilter::Gaussian})
+        {
+            for (auto radius : {1.0f, 1.7f, 3.0f})
+            {
+                SplatFilter filter;
+                filter.type = type;
+                filter.radius = radius;
+                for (auto position : {10.0f, 10.25f, 10.5f, 10.9f})
+                {
+                    int firstPixel;
+                    float weights[SplatFilter::maxFootprint];
+                    auto count = filter.getWeights(position, firstPixel, weights);
+                    QVERIFY(count > 0 && count <= SplatFilter::maxFootprint);
+                    QVERIFY(std::abs(sumWeights(weights, count) - 1.0f) < 1.0e-5f);
+                }
+
+                // Around a pixel center, pixels on both sides get the same weight
+                int firstPixel;
+                float weights[SplatFilter::maxFootprint];
+                auto count = filter.getWeights(20.5f, firstPixel, weights);
+                for (auto i = 0; i < count; ++i)
+                    QVERIFY(std::abs(weights[i] - weights[count - 1 - i]) < 1.0e-6f);
+            }
+        }
+    }
+
+    void largerRadius_spreadsFurther()
+    {
+        SplatFilter narrow;
+        narrow.type = SplatFilter::Gaussian;
+        narrow.radius = 1.0f;
+        SplatFilter wide = narrow;
+        wide.radius = 3.0f;
+
+        int narrowFirst, wideFirst;
+        float narrowWeights[SplatFilter::maxFootprint], wideWeights[SplatFilter::maxFootprint];
+        narrow.getWeights(8.5f, narrowFirst, narrowWeights);
+        wide.getWeights(8.5f, wideFirst, wideWeights);
+        QVERIFY(wideWeights[8 - wideFirst] < narrowWeights[8 - narrowFirst]);
+        QVERIFY(wideWeights[6 - wideFirst] > 0.0f);
+    }
+
+    void radius_isClamped()
+    {
+        SplatFilter filter;
+        filter.type = SplatFilter::Tent;
+        filter.radius = 50.0f;
+        int firstPixel;
+        float weights[SplatFilter::maxFootprint];
+        auto count = filter.getWeights(3.3f, firstPixel, weights);
+        QVERIFY(count <= SplatFilter::maxFootprint);
+        QVERIFY(std::abs(sumWeights(weights, count) - 1.0f) < 1.0e-5f);
+
+        filter.radius = 0.0f;
+        count = filter.getWeights(3.3f, firstPixel, weights);
+        QVERIFY(std::abs(sumWeights(weights, count) - 1.0f) < 1.0e-5f);
+    }
+};
+
+QTEST_APPLESS_MAIN(SplatFilterTests)
+
+#include "splatFilterTests.moc"
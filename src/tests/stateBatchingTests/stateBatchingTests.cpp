@@ -0,0 +1,163 @@
+#include <QtTest>
+#include <QOffscreenSurface>
+#include <QOpenGLContext>
+#include <QSignalSpy>
+#include <QTemporaryDir>
+#include <memory>
+#include "gui/models/crystalModel.h"
+#include "gui/models/simulationStateModel.h"
+#include "gui/stateSaver.h"
+#include "simulation/crystalPopulationRepository.h"
+#include "simulation/lightSource.h"
+#include "simulation/simulationEngine.h"
+
+using namespace HaloRay;
+
+namespace
+{
+
+const unsigned int populationCount = 20;
+
+}
+
+/* Counts how many times the simulation is cleared when changes are batched.
+   The engine needs an OpenGL 4.4 context, so the tests are skipped without
+   one. */
+class StateBatchingTests : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void initTestCase()
+    {
+        Q_INIT_RESOURCE(haloray);
+
+        QSurfaceFormat format;
+        format.setVersion(4, 4);
+        format.setProfile(QSurfaceFormat::OpenGLContextProfile::CoreProfile);
+        m_context = std::make_unique<QOpenGLContext>();
+        m_context->setFormat(format);
+        m_surface = std::make_unique<QOffscreenSurface>();
+        m_surface->setFormat(format);
+        m_surface->create();
+        if (!m_context->create() || !m_context->makeCurrent(m_surface.get()))
+            QSKIP("OpenGL context could not be created");
+        if (m_context->format().version() < qMakePair(4, 4))
+            QSKIP("OpenGL 4.4 is not supported");
+    }
+
+    void init()
+    {
+        m_repository = std::make_shared<CrystalPopulationRepository>();
+        m_engine = std::make_unique<SimulationEngine>(m_repository);
+        m_simulationState = std::make_unique<SimulationStateModel>(m_engine.get());
+        m_crystalModel = std::make_unique<CrystalModel>(m_repository);
+
+        // Crystal changes restart the simulation, as in the main window
+        connect(m_crystalModel.get(), &CrystalModel::rowsInserted, m_engine.get(), &SimulationEngine::reset);
+        connect(m_crystalModel.get(), &CrystalModel::rowsRemoved, m_engine.get(), &SimulationEngine::reset);
+        connect(m_crystalModel.get(), &CrystalModel::modelReset, m_engine.get(), &SimulationEngine::reset);
+    }
+
+    void unbatchedRows_clearOncePerRow()
+    {
+        QSignalSpy clears(m_engine.get(), &SimulationEngine::cleared);
+        for (auto i = 0u; i < populationCount; ++i)
+            m_crystalModel->addRow(Random);
+        QCOMPARE(clears.count(), static_cast<int>(populationCount));
+    }
+
+    void crystalBatch_clearsOnce()
+    {
+        QSignalSpy clears(m_engine.get(), &SimulationEngine::cleared);
+        m_crystalModel->beginUpdate();
+        m_crystalModel->clear();
+        for (auto i = 0u; i < populationCount; ++i)
+            m_crystalModel->addRow(Random);
+        QCOMPARE(clears.count(), 0);
+        m_crystalModel->endUpdate();
+
+        QCOMPARE(clears.count(), 1);
+        QCOMPARE(m_repository->getCount(), populationCount);
+    }
+
+    void loadState_clearsOnceBeforeReturning()
+    {
+        QTemporaryDir directory;
+        QVERIFY(directory.isValid());
+        auto filename = directory.filePath("state.ini");
+
+        m_repository->clear();
+        for (auto i = 0u; i < populationCount; ++i)
+            m_repository->add(Random);
+        auto lightSource = m_engine->getLightSource();
+        lightSource.altitude += 10.0f;
+        m_engine->setLightSource(lightSource);
+        StateSaver::SaveState(filename, m_engine.get(), m_repository.get());
+
+        m_repository->clear();
+        m_repository->add(Random);
+        m_engine->setLightSource(LightSource::createDefaultLightSource());
+
+        QSignalSpy clears(m_engine.get(), &SimulationEngine::cleared);
+        StateSaver::LoadState(filename, m_simulationState.get(), m_crystalModel.get());
+
+        QCOMPARE(clears.count(), 1);
+        QVERIFY(!m_engine->isUpdating());
+        QCOMPARE(m_repository->getCount(), populationCount);
+        QCOMPARE(m_engine->getLightSource().altitude, lightSource.altitude);
+    }
+
+    void edits_areDebounced()
+    {
+        QSignalSpy clears(m_engine.get(), &SimulationEngine::cleared);
+        auto altitude = m_simulationState->index(0, SimulationStateModel::SunAltitude);
+        for (auto i = 1; i <= 10; ++i)
+            QVERIFY(m_simulationState->setData(altitude, static_cast<float>(i)));
+        QCOMPARE(clears.count(), 0);
+        QVERIFY(m_engine->isUpdating());
+
+        QTRY_VERIFY(!m_engine->isUpdating());
+        QCOMPARE(clears.count(), 1);
+    }
+
+    void batch_appliesPendingEdits()
+    {
+        QSignalSpy clears(m_engine.get(), &SimulationEngine::cleared);
+        auto altitude = m_simulationState->index(0, SimulationStateModel::SunAltitude);
+        QVERIFY(m_simulationState->setData(altitude, 15.0f));
+
+        m_simulationState->beginUpdate();
+        m_simulationState->setRunSeed(m_engine->getRunSeed() + 1);
+        m_simulationState->endUpdate();
+
+        QCOMPARE(clears.count(), 1);
+        QVERIFY(!m_engine->isUpdating());
+    }
+
+    void cleanup()
+    {
+        m_crystalModel.reset();
+        m_simulationState.reset();
+        m_engine.reset();
+        m_repository.reset();
+    }
+
+    void cleanupTestCase()
+    {
+        if (m_context)
+            m_context->doneCurrent();
+    }
+
+private:
+    std::unique_ptr<QOpenGLContext> m_context;
+    std::unique_ptr<QOffscreenSurface> m_surface;
+    std::shared_ptr<CrystalPopulationRepository> m_repository;
+    std::unique_ptr<SimulationEngine> m_engine;
+    std::unique_ptr<SimulationStateModel> m_simulationState;
+    std::unique_ptr<CrystalModel> m_crystalModel;
+};
+
+QTEST_MAIN(StateBatchingTests)
+
+#include "stateBatchingTests.moc"
@@ -0,0 +1,132 @@
+#include <QtTest>
+#include <cmath>
+#include <numeric>
+#include <stdexcept>
+#include <vector>
+#include "simulation/sunConvolution.h"
+
+using namespace HaloRay;
+
+namespace
+{
+
+const std::size_t cellCount = static_cast<std::size_t>(SunConvolution::gridSize) * SunConvolution::gridSize;
+const float noLimbDarkening[3] = {1.0f, 1.0f, 1.0f};
+
+double sumChannel(const std::vector<float> &image, unsigned int channel, unsigned int channelCount)
+{
+    double sum = 0.0;
+    for (auto i = 0u; i < cellCount; ++i)
+        sum += image[i * channelCount + channel];
+    return sum;
+}
+
+std::size_t getCell(int x, int y)
+{
+    return static_cast<std::size_t>(y + SunConvolution::gridSize / 2) * SunConvolution::gridSize + x + SunConvolution::gridSize / 2;
+}
+
+}
+
+class SunConvolutionTests : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void sunDiskKernel_isNormalizedAndCoversDisk()
+    {
+        auto kernel = SunConvolution::createSunDiskKernel(0.5, noLimbDarkening);
+        for (auto channel = 0u; channel < 3; ++channel)
+            QVERIFY(std::abs(sumChannel(kernel, channel, 3) - 1.0) < 1.0e-4);
+
+        // The radius of 0.25 degrees is two cells
+        QVERIFY(kernel[0] > 0.0f);
+        QVERIFY(kernel[1 * 3] > 0.0f);
+        QCOMPARE(kernel[(SunConvolution::gridSize - 1) * 3], kernel[1 * 3]);
+        QCOMPARE(kernel[3 * 3], 0.0f);
+    }
+
+    void limbDarkening_dimsDiskEdge()
+    {
+        const float limbDarkening[3] = {0.5f, 0.4f, 0.3f};
+        auto kernel = SunConvolution::createSunDiskKernel(2.0, limbDarkening);
+        auto plainKernel = SunConvolution::createSunDiskKernel(2.0, noLimbDarkening);
+
+        // Eight cells from the center is at the edge of the disk
+        auto edge = 7u * 3;
+        QVERIFY(kernel[0] > plainKernel[0]);
+        QVERIFY(kernel[edge] < plainKernel[edge]);
+        QVERIFY(kernel[edge + 2] / kernel[2] < kernel[edge] / kernel[0]);
+    }
+
+    void diffractionKernel_spreadsMoreForSmallCrystalsAndRed()
+    {
+        QCOMPARE(SunConvolution::createDiffractionKernel(0.0, 10.0)[0], 1.0f);
+
+        auto smallCrystals = SunConvolution::createDiffractionKernel(10.0, 10.0);
+        auto largeCrystals = SunConvolution::createDiffractionKernel(100.0, 10.0);
+        QVERIFY(std::abs(sumChannel(smallCrystals, 1, 3) - 1.0) < 1.0e-4);
+        QVERIFY(smallCrystals[1] < largeCrystals[1]);
+
+        // Longer wavelengths diffract more, leaving less light in the center
+        QVERIFY(smallCrystals[0] < smallCrystals[2]);
+    }
+
+    void convolution_preservesLightAndSpreadsPoint()
+    {
+        SunConvolution convolution;
+        convolution.setKernels(1.0, noLimbDarkening, {0.0f});
+
+        std::vector<float> grid(cellCount * 4, 0.0f);
+        auto cell = getCell(100, -40);
+        grid[cell * 4] = 3.0f;
+        grid[cell * 4 + 1] = 2.0f;
+        grid[cell * 4 + 2] = 1.0f;
+
+        auto result = convolution.convolve(grid);
+        QVERIFY(std::abs(sumChannel(result, 0, 4) - 3.0) < 1.0e-2);
+        QVERIFY(std::abs(sumChannel(result, 1, 4) - 2.0) < 1.0e-2);
+        QVERIFY(std::abs(sumChannel(result, 2, 4) - 1.0) < 1.0e-2);
+
+        // The disk with a radius of four cells is centered on the point
+        QVERIFY(result[cell * 4] < 3.0f);
+        QVERIFY(std::abs(result[getCell(103, -40) * 4 + 1] - result[getCell(97, -40) * 4 + 1]) < 1.0e-4f);
+        QVERIFY(result[getCell(103, -40) * 4 + 1] > 0.0f);
+        QVERIFY(result[getCell(106, -40) * 4 + 1] < 1.0e-4f);
+    }
+
+    void convolution_usesKernelOfEachPopulation()
+    {
+        SunConvolution convolution;
+        convolution.setKernels(0.5, noLimbDarkening, {0.0f, 20.0f});
+
+        std::vector<float> grids(2 * cellCount * 4, 0.0f);
+        grids[getCell(-200, 0) * 4 + 1] = 1.0f;
+        grids[(cellCount + getCell(200, 0)) * 4 + 1] = 1.0f;
+
+        auto result = convolution.convolve(grids);
+        // Diffraction at the second population spreads its light beyond the sun disk
+        QVERIFY(result[getCell(-200, 10) * 4 + 1] < 1.0e-5f);
+        QVERIFY(result[getCell(200, 10) * 4 + 1] > 1.0e-5f);
+        QVERIFY(result[getCell(-200, 0) * 4 + 1] > result[getCell(200, 0) * 4 + 1]);
+    }
+
+    void gridCountMismatch_throws()
+    {
+        SunConvolution convolution;
+        convolution.setKernels(0.5, noLimbDarkening, {0.0f, 0.0f});
+        std::vector<float> grid(cellCount * 4, 0.0f);
+        QVERIFY_EXCEPTION_THROWN(convolution.convolve(grid), std::runtime_error);
+    }
+
+    void cellSolidAngle_shrinksAwayFromSun()
+    {
+        auto cellSide = 0.125 * 3.14159265358979 / 180.0;
+        QVERIFY(std::abs(SunConvolution::getCellSolidAngle(0.0) - cellSide * cellSide) < 1.0e-12);
+        QVERIFY(std::abs(SunConvolution::getCellSolidAngle(3.14159265358979 / 2.0) - cellSide * cellSide * 2.0 / 3.14159265358979) < 1.0e-12);
+    }
+};
+
+QTEST_APPLESS_MAIN(SunConvolutionTests)
+
+#include "sunConvolutionTests.moc"
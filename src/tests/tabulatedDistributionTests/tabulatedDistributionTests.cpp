@@ -0,0 +1,142 @@
+#include <QtTest>
+#include <cmath>
+#include <stdexcept>
+#include <vector>
+#include "simulation/tabulatedDistribution.h"
+
+using namespace HaloRay;
+
+namespace
+{
+
+// Inverts a sampling table like sampleTable in the raytracing shader
+float sampleTable(const std::vector<float> &table, float u)
+{
+    auto lowerEdge = 0u;
+    auto upperEdge = static_cast<unsigned int>(table.size() / 2) - 1;
+    while (upperEdge - lowerEdge > 1)
+    {
+        auto middleEdge = (lowerEdge + upperEdge) / 2;
+        if (table[2 * middleEdge] <= u)
+            lowerEdge = middleEdge;
+        else
+            upperEdge = middleEdge;
+    }
+    auto fraction = (u - table[2 * lowerEdge]) / (table[2 * upperEdge] - table[2 * lowerEdge]);
+    return table[2 * lowerEdge + 1] + fraction * (table[2 * upperEdge + 1] - table[2 * lowerEdge + 1]);
+}
+
+}
+
+class TabulatedDistributionTests : public QObject
+{
+    Q_OBJECT
+private slots:
+    void defaultDistribution_isEmpty()
+    {
+        TabulatedDistribution distribution;
+        QVERIFY(distribution.isEmpty());
+        QCOMPARE(distribution.getBinCount(), 0u);
+    }
+
+    void sample_givenSingleBin_isLinearOverBin()
+    {
+        TabulatedDistribution distribution({10.0f, 20.0f}, {1.0f});
+
+        QCOMPARE(distribution.sample(0.0f), 10.0f);
+        QCOMPARE(distribution.sample(0.5f), 15.0f);
+        QCOMPARE(distribution.sample(1.0f), 20.0f);
+    }
+
+    void sample_followsBinWeights()
+    {
+        TabulatedDistribution distribution({0.0f, 1.0f, 2.0f}, {3.0f, 1.0f});
+
+        QCOMPARE(distribution.sample(0.375f), 0.5f);
+        QCOMPARE(distribution.sample(0.75f), 1.0f);
+        QCOMPARE(distribution.sample(0.875f), 1.5f);
+    }
+
+    void sample_skipsEmptyBins()
+    {
+        TabulatedDistribution distribution({0.0f, 1.0f, 2.0f, 3.0f, 4.0f}, {0.0f, 1.0f, 0.0f, 1.0f});
+
+        QCOMPARE(distribution.sample(0.0f), 1.0f);
+        QCOMPARE(distribution.sample(0.25f), 1.5f);
+        QCOMPARE(distribution.sample(0.75f), 3.5f);
+        QCOMPARE(distribution.sample(1.0f), 4.0f);
+    }
+
+    void samplingTable_holdsCdfAndEdges()
+    {
+        TabulatedDistribution distribution({-5.0f, 0.0f, 5.0f}, {1.0f, 3.0f});
+        auto table = distribution.createSamplingTable(4);
+
+        QCOMPARE(table.size(), (size_t)8);
+        QCOMPARE(table[0], 0.0f);
+        QCOMPARE(table[1], -5.0f);
+        QCOMPARE(table[2], 0.25f);
+        QCOMPARE(table[3], 0.0f);
+        QCOMPARE(table[4], 1.0f);
+        QCOMPARE(table[5], 5.0f);
+
+        // Padding repeats the last edge
+        QCOMPARE(table[6], 1.0f);
+        QCOMPARE(table[7], 5.0f);
+
+        QVERIFY_EXCEPTION_THROWN(distribution.createSamplingTable(2), std::runtime_error);
+    }
+
+    void samplingTable_invertsExactly()
+    {
+        TabulatedDistribution distribution({0.0f, 1.0f, 2.0f, 3.0f, 4.0f, 5.0f}, {2.0f, 0.0f, 1.0f, 0.0f, 1.0f});
+        auto table = distribution.createSamplingTable(9);
+
+        for (auto i = 0u; i < 1000; ++i)
+        {
+            auto u = (i + 0.5f) / 1000.0f;
+            auto value = sampleTable(table, u);
+            QVERIFY(std::abs(value - distribution.sample(u)) < 1.0e-5f);
+
+            // Empty bins are never sampled, not even near their edges
+            QVERIFY(!(value > 1.0f && value < 2.0f));
+            QVERIFY(!(value > 3.0f && value < 4.0f));
+        }
+    }
+
+    void constructor_givenInvalidBins_throws()
+    {
+        QVERIFY_EXCEPTION_THROWN(TabulatedDistribution({0.0f, 1.0f}, {1.0f, 1.0f}), std::runtime_error);
+        QVERIFY_EXCEPTION_THROWN(TabulatedDistribution({1.0f, 0.0f}, {1.0f}), std::runtime_error);
+        QVERIFY_EXCEPTION_THROWN(TabulatedDistribution({0.0f, 1.0f}, {-1.0f}), std::runtime_error);
+        QVERIFY_EXCEPTION_THROWN(TabulatedDistribution({0.0f, 1.0f}, {0.0f}), std::runtime_error);
+    }
+
+    void fromCsv_readsBinsAndSkipsComments()
+    {
+        auto distribution = TabulatedDistribution::fromCsv(
+            "# tilt, degrees\n"
+            "0, 1, 10\n"
+            "\n"
+            "1;2;30\r\n"
+            "2 4 60\n");
+
+        QCOMPARE(distribution.getBinCount(), 3u);
+        QCOMPARE(distribution.getBinEdges(), std::vector<float>({0.0f, 1.0f, 2.0f, 4.0f}));
+        QCOMPARE(distribution.getWeights(), std::vector<float>({10.0f, 30.0f, 60.0f}));
+    }
+
+    void fromCsv_givenGapBetweenBins_throws()
+    {
+        QVERIFY_EXCEPTION_THROWN(TabulatedDistribution::fromCsv("0,1,1\n2,3,1\n"), std::runtime_error);
+    }
+
+    void fromCsv_givenMissingColumn_throws()
+    {
+        QVERIFY_EXCEPTION_THROWN(TabulatedDistribution::fromCsv("0,1\n"), std::runtime_error);
+    }
+};
+
+QTEST_APPLESS_MAIN(TabulatedDistributionTests)
+
+#include "tabulatedDistributionTests.moc"
@@ -2,4 +2,29 @@ TEMPLATE = subdirs
 SUBDIRS = \
     cameraTests \
     crystalPopulationRepositoryTests \
-    lightSourceTests
+    lightSourceTests \
+    pathLengthHistogramTests \
+    sobolSequenceTests \
+    philoxTests \
+    tabulatedDistributionTests \
+    convexPolyhedronTests \
+    scatteringTableTests \
+    phaseFunctionTests \
+    transferTableTests \
+    sampleReweightingTests \
+    rayDumpTests \
+    pathFilterTests \
+    fftTests \
+    sunConvolutionTests \
+    pathGuideTests \
+    rayAllocationTests \
+    kernelTests \
+    sceneTracerTests \
+    hybridTracerTests \
+    wavefrontTests \
+    toneMappingTests \
+    splatFilterTests \
+    autoExposureTests \
+    compensatedSumTests \
+    invalidationTrackerTests \
+    stateBatchingTests
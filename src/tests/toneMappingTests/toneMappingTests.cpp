@@ -0,0 +1,73 @@
+#include <QtTest>
+#include <cmath>
+#include <cstdint>
+#include <vector>
+#include "simulation/toneMapping.h"
+
+using namespace HaloRay;
+
+namespace
+{
+
+// Exposure that maps a pixel value of one to a linear value of one
+const float unitExposure = 1.0f / 50000.0f;
+
+}
+
+class ToneMappingTests : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void blackImage_staysBlack()
+    {
+        std::vector<float> pixels(4 * 3 * 2, 0.0f);
+        auto image = toneMap(pixels.data(), 3, 4, 2, 3.0f, 75.0f, 1000.0);
+        QCOMPARE(image.size(), static_cast<std::size_t>(4 * 3 * 2));
+        for (auto value : image)
+            QCOMPARE(value, static_cast<std::uint8_t>(0));
+    }
+
+    void rows_startFromTop()
+    {
+        // Two pixels wide, three high, with the bottom left pixel lit
+        std::vector<float> pixels(2 * 3 * 3, 0.0f);
+        pixels[0] = 1.0f;
+        auto image = toneMap(pixels.data(), 3, 2, 3, unitExposure, 180.0f, 1.0);
+        QCOMPARE(image[2 * 2 * 3], static_cast<std::uint8_t>(255));
+        QCOMPARE(image[0], static_cast<std::uint8_t>(0));
+        QCOMPARE(image[2 * 2 * 3 + 1], static_cast<std::uint8_t>(0));
+    }
+
+    void fourChannels_skipAlpha()
+    {
+        const float pixels[8] = {0.2f, 0.4f, 0.6f, 100.0f, 0.0f, 0.0f, 0.0f, 100.0f};
+        const float rgbPixels[6] = {0.2f, 0.4f, 0.6f, 0.0f, 0.0f, 0.0f};
+        auto image = toneMap(pixels, 4, 2, 1, unitExposure, 180.0f, 1.0);
+        auto rgbImage = toneMap(rgbPixels, 3, 2, 1, unitExposure, 180.0f, 1.0);
+        QVERIFY(image == rgbImage);
+        QCOMPARE(image[3], static_cast<std::uint8_t>(0));
+    }
+
+    void exposure_isPerRayAndFieldOfView()
+    {
+        const float pixels[3] = {0.1f, 0.2f, 0.3f};
+        auto image = toneMap(pixels, 3, 1, 1, unitExposure, 180.0f, 1.0);
+        QVERIFY(image == toneMap(pixels, 3, 1, 1, 2.0f * unitExposure, 180.0f, 2.0));
+        QVERIFY(image == toneMap(pixels, 3, 1, 1, 0.5f * unitExposure, 90.0f, 1.0));
+        QVERIFY(image != toneMap(pixels, 3, 1, 1, unitExposure, 90.0f, 1.0));
+    }
+
+    void gamma_matchesRenderer()
+    {
+        const float pixels[3] = {0.5f, 0.0f, 2.0f};
+        auto image = toneMap(pixels, 3, 1, 1, unitExposure, 180.0f, 1.0);
+        auto expected = std::round(255.0 * (1.055 * std::pow(0.5, 0.417) - 0.055));
+        QCOMPARE(static_cast<double>(image[0]), expected);
+        QCOMPARE(image[2], static_cast<std::uint8_t>(255));
+    }
+};
+
+QTEST_APPLESS_MAIN(ToneMappingTests)
+
+#include "toneMappingTests.moc"
@@ -0,0 +1,133 @@
+#include <QtTest>
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <vector>
+#include "simulation/transferTable.h"
+#include "simulation/crystalPopulation.h"
+#include "simulation/trigonometryUtilities.h"
+
+using namespace HaloRay;
+
+class TransferTableTests : public QObject
+{
+    Q_OBJECT
+private slots:
+    void cellDirections_areUnitVectorsInsideTheirCells()
+    {
+        for (auto cell = 0u; cell < TransferTable::cellCount; ++cell)
+        {
+            for (auto offset : {0.5f, 0.01f, 0.99f})
+            {
+                auto direction = TransferTable::getCellDirection(cell, offset, 1.0f - offset);
+                auto length = std::sqrt(direction[0] * direction[0] + direction[1] * direction[1] + direction[2] * direction[2]);
+                QVERIFY(std::abs(length - 1.0f) < 1.0e-5f);
+                QCOMPARE(TransferTable::getCellIndex(direction[0], direction[1], direction[2]), cell);
+            }
+        }
+    }
+
+    void cells_haveEqualAreaAndBoundedDiameter()
+    {
+        // Solid angles of cells from spherical triangles between their corners
+        auto solidAngle = [](std::array<float, 3> a, std::array<float, 3> b, std::array<float, 3> c) {
+            auto dot = [](std::array<float, 3> u, std::array<float, 3> v) { return (double)u[0] * v[0] + (double)u[1] * v[1] + (double)u[2] * v[2]; };
+            auto triple = a[0] * ((double)b[1] * c[2] - (double)b[2] * c[1]) - a[1] * ((double)b[0] * c[2] - (double)b[2] * c[0]) + a[2] * ((double)b[0] * c[1] - (double)b[1] * c[0]);
+            return 2.0 * std::atan2(std::abs(triple), 1.0 + dot(a, b) + dot(b, c) + dot(c, a));
+        };
+        auto angle = [](std::array<float, 3> a, std::array<float, 3> b) {
+            auto cosine = (double)a[0] * b[0] + (double)a[1] * b[1] + (double)a[2] * b[2];
+            return std::acos(std::min(1.0, cosine)) * 180.0 / PI;
+        };
+
+        const auto expectedSolidAngle = 4.0 * PI / TransferTable::cellCount;
+        const auto samplesPerEdge = 4;
+        for (auto cell = 0u; cell < TransferTable::cellCount; cell += 7)
+        {
+            // Cell edges are not great circles, so cells are split into smaller quads
+            auto area = 0.0;
+            for (auto i = 0; i < samplesPerEdge; ++i)
+            {
+                for (auto j = 0; j < samplesPerEdge; ++j)
+                {
+                    auto u0 = static_cast<float>(i) / samplesPerEdge;
+                    auto u1 = static_cast<float>(i + 1) / samplesPerEdge;
+                    auto v0 = static_cast<float>(j) / samplesPerEdge;
+                    auto v1 = static_cast<float>(j + 1) / samplesPerEdge;
+                    auto corner00 = TransferTable::getCellDirection(cell, u0, v0);
+                    auto corner10 = TransferTable::getCellDirection(cell, u1, v0);
+                    auto corner01 = TransferTable::getCellDirection(cell, u0, v1);
+                    auto corner11 = TransferTable::getCellDirection(cell, u1, v1);
+                    area += solidAngle(corner00, corner10, corner11) + solidAngle(corner00, corner11, corner01);
+                }
+            }
+            QVERIFY(std::abs(area / expectedSolidAngle - 1.0) < 0.02);
+
+            // Cells are convex enough that their widest extent is between edge points
+            std::vector<std::array<float, 3>> edge;
+            for (auto i = 0; i <= samplesPerEdge; ++i)
+            {
+                auto t = static_cast<float>(i) / samplesPerEdge;
+                edge.push_back(TransferTable::getCellDirection(cell, t, 0.0f));
+                edge.push_back(TransferTable::getCellDirection(cell, t, 1.0f));
+                edge.push_back(TransferTable::getCellDirection(cell, 0.0f, t));
+                edge.push_back(TransferTable::getCellDirection(cell, 1.0f, t));
+            }
+            for (auto i = 0u; i < edge.size(); ++i)
+            {
+                for (auto j = i + 1; j < edge.size(); ++j)
+                    QVERIFY(angle(edge[i], edge[j]) <= TransferTable::maxCellDiameter);
+            }
+        }
+    }
+
+    void cellIndex_coversPoles()
+    {
+        auto center = TransferTable::incidenceResolution / 2;
+        QCOMPARE(TransferTable::getCellIndex(0.0f, 1.0f, 0.0f), center * TransferTable::incidenceResolution + center);
+        QCOMPARE(TransferTable::getCellIndex(0.0f, -1.0f, 0.0f), TransferTable::cellCount - 1);
+    }
+
+    void shapeKey_ignoresOrientation()
+    {
+        auto population = CrystalPopulation::createPlate();
+        auto key = TransferTable::getShapeKey(population);
+
+        population.tiltStd += 1.0f;
+        population.rotationDistribution = Gaussian;
+        population.rotationAverage = 30.0f;
+        QCOMPARE(TransferTable::getShapeKey(population), key);
+    }
+
+    void shapeKey_dependsOnShape()
+    {
+        auto population = CrystalPopulation::createPlate();
+        auto key = TransferTable::getShapeKey(population);
+
+        auto taller = population;
+        taller.caRatioAverage += 0.01f;
+        QVERIFY(TransferTable::getShapeKey(taller) != key);
+
+        auto pyramid = population;
+        pyramid.upperApexHeightAverage = 0.5f;
+        QVERIFY(TransferTable::getShapeKey(pyramid) != key);
+
+        auto tabulated = population;
+        tabulated.distributionTables[CaRatioTable] = TabulatedDistribution({0.1f, 0.2f}, {1.0f});
+        QVERIFY(TransferTable::getShapeKey(tabulated) != key);
+    }
+
+    void shapeKey_ofCustomShapeIgnoresHexagonalParameters()
+    {
+        auto population = CrystalPopulation::createRandom();
+        population.customShape = ConvexPolyhedron::fromMillerBravaisIndices("{10-10} 0.866\n{0001} 2.0\n");
+        auto key = TransferTable::getShapeKey(population);
+
+        population.caRatioAverage = 5.0f;
+        QCOMPARE(TransferTable::getShapeKey(population), key);
+    }
+};
+
+QTEST_APPLESS_MAIN(TransferTableTests)
+
+#include "transferTableTests.moc"
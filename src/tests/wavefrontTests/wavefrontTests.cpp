@@ -0,0 +1,79 @@
+#include <QtTest>
+#include <cmath>
+#include "simulation/wavefront.h"
+
+using namespace HaloRay;
+
+class WavefrontTests : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void bouncePasses_coverLongestPath()
+    {
+        QVERIFY(Wavefront::bouncePassCount * Wavefront::bouncesPerPass >= PathLengthHistogram::maxHits);
+        QVERIFY((Wavefront::bouncePassCount - 1) * Wavefront::bouncesPerPass < PathLengthHistogram::maxHits);
+    }
+
+    void queueSizes_includeHeader()
+    {
+        QCOMPARE(Wavefront::getBounceQueueSize(0), Wavefront::headerSize);
+        QCOMPARE(Wavefront::getBounceQueueSize(64), Wavefront::headerSize + 64 * Wavefront::bounceRecordSize);
+        QCOMPARE(Wavefront::getEscapeQueueSize(64), Wavefront::headerSize + 64 * Wavefront::escapeRecordSize);
+    }
+
+    void emptyHistogram_isFullyUtilized()
+    {
+        PathLengthHistogram histogram;
+        QCOMPARE(Wavefront::estimateMegakernelLaneUtilization(histogram, 32), 1.0);
+        QCOMPARE(Wavefront::estimateWavefrontLaneUtilization(histogram, 32), 1.0);
+    }
+
+    void equalPathLengths_areFullyUtilized()
+    {
+        PathLengthHistogram histogram;
+        histogram.escapedCounts[5] = 1000;
+        QVERIFY(std::abs(Wavefront::estimateMegakernelLaneUtilization(histogram, 32) - 1.0) < 1.0e-9);
+        QVERIFY(std::abs(Wavefront::estimateWavefrontLaneUtilization(histogram, 32) - 1.0) < 1.0e-9);
+    }
+
+    void singleLane_isFullyUtilized()
+    {
+        PathLengthHistogram histogram;
+        histogram.escapedCounts[1] = 900;
+        histogram.escapedCounts[40] = 100;
+        histogram.reachedMaxHits = 10;
+        QVERIFY(std::abs(Wavefront::estimateMegakernelLaneUtilization(histogram, 1) - 1.0) < 1.0e-9);
+        QVERIFY(std::abs(Wavefront::estimateWavefrontLaneUtilization(histogram, 1) - 1.0) < 1.0e-9);
+    }
+
+    void longPathTail_favorsWavefront()
+    {
+        PathLengthHistogram histogram;
+        histogram.escapedCounts[1] = 900;
+        histogram.escapedCounts[40] = 100;
+
+        // Two iterations for most rays and 41 for the rest
+        auto megakernel = Wavefront::estimateMegakernelLaneUtilization(histogram, 32);
+        auto meanIterations = 0.9 * 2.0 + 0.1 * 41.0;
+        auto longestRun = 2.0 + 39.0 * (1.0 - std::pow(0.9, 32.0));
+        QVERIFY(std::abs(megakernel - meanIterations / longestRun) < 1.0e-9);
+
+        auto wavefront = Wavefront::estimateWavefrontLaneUtilization(histogram, 32);
+        QVERIFY(wavefront > 2.0 * megakernel);
+        QVERIFY(wavefront <= 1.0);
+    }
+
+    void terminatedRays_areIgnored()
+    {
+        PathLengthHistogram histogram;
+        histogram.escapedCounts[3] = 1000;
+        histogram.terminatedByRussianRoulette = 500;
+        histogram.trappedInOrbit = 500;
+        QVERIFY(std::abs(Wavefront::estimateMegakernelLaneUtilization(histogram, 32) - 1.0) < 1.0e-9);
+    }
+};
+
+QTEST_APPLESS_MAIN(WavefrontTests)
+
+#include "wavefrontTests.moc"